@@ -8,7 +8,9 @@
  * The driver and CCD's status is determined by reading from the driver's character device.
  * The modes the CCD and driver support are read via IOCTL.
  * Exposure commands are sent to the CCD via IOCTL.
- * Images are retrieved from the driver (after being read out from the CCD) via IOCTL.
+ * Images are retrieved from the driver (after being read out from the CCD) via IOCTL, either by copying the
+ * image (IOCTL_GET_IMAGE) or, without copying, by mapping the driver's image ring into the programme's address
+ * space and retrieving the index of the ring slot that holds the image (IOCTL_GET_IMAGE_SLOT).
  *
  * The driver was also designed to be able to function without a MERLIN CCD present and to work with an
  * outside programem to simulate the presence of a CCD. From the point of view of a programme using the
@@ -37,6 +39,10 @@
 #include <linux/delay.h>
 #include <linux/io.h>
 #include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/atomic.h>
 
 #ifndef ACQSIM
  #include <act_plc/act_plc.h>
@@ -97,6 +103,9 @@
 #define   DEC_HEIGHT   670
 /** \} */
 
+/// Address of slot number slot in the image ring
+#define RING_SLOT(slot)                ((struct merlin_img *)((char *)G_ring + (slot)*MERLIN_RING_SLOT_SIZE))
+
 /// Convenience definition for converting from seconds+nanoseconds to milliseconds
 #define SECNSEC_MSEC(sec,nsec)         sec*1000 + nsec/1000000
 /// Convenience definition for converting from milliseconds to seconds+nanoseconds
@@ -116,8 +125,16 @@ static struct device *G_dev_merlin;
 static struct ccd_modes G_modes;
 /// Last command sent to driver - this is only useful in ACQSIM mode, where the camera simulator programme needs to read the commands sent
 static struct ccd_cmd G_cmd;
-/// Last image retrieved by driver
-static struct merlin_img G_img;
+/// Ring of image buffers, which user-space programmes can mmap
+static void *G_ring = NULL;
+/// Number of references user-space programmes hold to each slot in the image ring
+static atomic_t G_ring_refs[MERLIN_RING_LEN];
+/// Ring slot the current/last exposure is read into
+static unsigned int G_ring_cur = 0;
+/// Ring slot containing the last completed image
+static unsigned int G_ring_ready = 0;
+/// Image the current/last exposure is read into (ring slot G_ring_cur)
+static struct merlin_img *G_img = NULL;
 /// Queue for asynchronous communication with user-space programmes
 static wait_queue_head_t inq;
 #ifndef ACQSIM
@@ -132,6 +149,15 @@ static wait_queue_head_t inq;
 #endif
 /** \} */
 
+/** \brief Data kept for each open file of the character device.
+ * \{ */
+struct merlin_file
+{
+  /// Number of references to each ring slot held through this file
+  atomic_t held[MERLIN_RING_LEN];
+};
+/** \} */
+
 /** \name Function definitions
  ( \{ */
 #ifndef ACQSIM
@@ -154,6 +180,8 @@ static wait_queue_head_t inq;
  static void check_exp_time_valid(unsigned long *exp_t_sec, unsigned long *exp_t_nanosec);
  static void calc_exp_time_div(unsigned long exp_t_sec, unsigned long exp_t_nanosec, unsigned char *hi_div, unsigned char *lo_div);
 #endif
+/// Select the ring slot the next image is read into
+static void ring_next_slot(void);
 /// Module initialisation function
 int init_module(void);
 /// Module cleanup/exit function
@@ -170,6 +198,8 @@ static ssize_t device_read(struct file *, char *, size_t, loff_t *);
 static ssize_t device_write(struct file *, const char *, size_t, loff_t *);
 /// Register asynchronous notification
 static unsigned int device_poll(struct file *filp, poll_table *wait);
+/// Map the image ring into a programme's address space
+static int device_mmap(struct file *filp, struct vm_area_struct *vma);
 /** \} */
 
 /** \brief Structure containing file operations (on character device) supported by driver.
@@ -182,7 +212,8 @@ static struct file_operations fops =
   .unlocked_ioctl = device_ioctl,
   .open = device_open,
   .release = device_release,
-  .poll = device_poll
+  .poll = device_poll,
+  .mmap = device_mmap
 };
 /** \} */
 
@@ -192,6 +223,7 @@ static struct file_operations fops =
  * Initialises all variables of the driver.
  * Algorithm:
  * - Registers the driver's character device.
+ * - Allocates the image ring.
  * - If not in simulation mode:
  *   - Initialises CCD.
  *   - Retrieves CCD identifier.
@@ -202,6 +234,7 @@ static struct file_operations fops =
  */
 int init_module(void)
 {
+  int i;
   G_major = register_chrdev(0, MERLIN_DEVICE_NAME, &fops);
   if (G_major < 0)
   {
@@ -227,6 +260,20 @@ int init_module(void)
     return -ENODEV;
   }
   
+  G_ring = vmalloc_user(MERLIN_RING_SIZE);
+  if (G_ring == NULL)
+  {
+    printk (KERN_ALERT PRINTK_PREFIX "Error allocating image ring.\n" );
+    device_destroy(G_class_merlin, MKDEV(G_major, 0));
+    class_destroy(G_class_merlin);
+    unregister_chrdev(G_major, MERLIN_DEVICE_NAME);
+    return -ENOMEM;
+  }
+  for (i=0; i<MERLIN_RING_LEN; i++)
+    atomic_set(&G_ring_refs[i], 0);
+  G_ring_cur = G_ring_ready = 0;
+  G_img = RING_SLOT(G_ring_cur);
+  
   #ifndef ACQSIM
     outb(0x08, PORT_8212);
     outb(0x00, PORT_8212);
@@ -236,6 +283,7 @@ int init_module(void)
     if (get_ccd_id() == 0)
     {
       printk(KERN_ALERT PRINTK_PREFIX "Failed to get identifier for CCD. Exiting.\n");
+      vfree(G_ring);
       device_destroy(G_class_merlin, MKDEV(G_major, 0));
       class_destroy(G_class_merlin);
       unregister_chrdev(G_major, MERLIN_DEVICE_NAME);
@@ -256,8 +304,6 @@ int init_module(void)
 
   init_waitqueue_head(&inq);
 
-  memset(&G_img.img_data, 0, sizeof(G_img.img_data));
-
   return 0;
 }
 
@@ -270,7 +316,7 @@ int init_module(void)
  * - If not in simulation mode:
  *   - Unregisters the turn-of-second handler function with external timing providor.
  *   - Cancels all pending operations (esp. readouts)
- * - Unregisters driver's character device.
+ * - Unregisters driver's character device and frees the image ring.
  */
 void cleanup_module(void)
 {
@@ -287,6 +333,7 @@ void cleanup_module(void)
   device_destroy(G_class_merlin, MKDEV(G_major, 0));
   class_destroy(G_class_merlin);
   unregister_chrdev(G_major, MERLIN_DEVICE_NAME);
+  vfree(G_ring);
   printk(KERN_INFO PRINTK_PREFIX "MERLIN CCD driver unloaded.\n");
 }
 
@@ -426,10 +473,11 @@ static char get_ccd_id(void)
  *     when none can be read.
  *   - Return from the function if the module is about to exit.
  *   - If a pixel was successfully read, the pixel read in the previous iteration was also a pixel.
- *     - Save the previous pixel to the G_img.img_data array.
+ *     - Save the previous pixel to the G_img->img_data array.
  *   - If a pixel was not successfully read, the previous pixel was the CCD status, which should be 0.
  * - Determine if the CCD is OK to continue (the last "pixel" returned is 0). If not, report an error.
- * - Set the image parameters of the G_img structure as appropriate.
+ * - Set the image parameters of the G_img structure as appropriate and mark its ring slot as containing the
+ *   latest image.
  * - Signal that the CCD is finished reading out.
  *
  * \note An obscene amount of development and testing has gone into this driver and probably more is
@@ -487,7 +535,7 @@ static void ccd_readout(struct work_struct *work)
       break;
     if (G_status & MERLIN_EXIT)
       return;
-    G_img.img_data[(i-1)%MERLIN_MAX_IMG_LEN] = lastchar;
+    G_img->img_data[(i-1)%MERLIN_MAX_IMG_LEN] = lastchar;
     lastchar = (ccd_pixel_type)tmpchar;
   }
 
@@ -503,10 +551,11 @@ static void ccd_readout(struct work_struct *work)
   {
     if (i != MERLIN_MAX_IMG_LEN+1)
       printk(KERN_DEBUG PRINTK_PREFIX "Read %u pixels (should be %d)\n", i, MERLIN_MAX_IMG_LEN+1);
+    G_img->img_params.img_len = MERLIN_MAX_IMG_LEN;
+    G_ring_ready = G_ring_cur;
     G_status |= CCD_IMG_READY | CCD_STAT_UPDATE;
   }
   wake_up_interruptible(&inq);
-  G_img.img_params.img_len = MERLIN_MAX_IMG_LEN;
 }
 
 /** \brief Send CCD expose command to CCD.
@@ -545,11 +594,11 @@ static int start_exp(void *data)
     printk(KERN_INFO PRINTK_PREFIX "Driver status indicates that CCD is currently busy (%hu).\n", G_status);
     return 0;
   }
-  calc_exp_time_div(G_img.img_params.exp_t_sec, G_img.img_params.exp_t_nanosec, &hi_div, &lo_div);
-  G_img.img_params.prebin_x = G_img.img_params.prebin_y = 1;
-  G_img.img_params.win_start_x = G_img.img_params.win_start_y = 0;
-  G_img.img_params.win_width = WIDTH_PX;
-  G_img.img_params.win_height = HEIGHT_PX;
+  calc_exp_time_div(G_img->img_params.exp_t_sec, G_img->img_params.exp_t_nanosec, &hi_div, &lo_div);
+  G_img->img_params.prebin_x = G_img->img_params.prebin_y = 1;
+  G_img->img_params.win_start_x = G_img->img_params.win_start_y = 0;
+  G_img->img_params.win_width = WIDTH_PX;
+  G_img->img_params.win_height = HEIGHT_PX;
   
   if (!ccd_send_char('R'))
   {
@@ -567,8 +616,8 @@ static int start_exp(void *data)
     return 0;
   }
   // Start trying to read out a little sooner than necessary
-  tmpts.tv_sec = G_img.img_params.exp_t_sec*9/10;
-  tmpts.tv_nsec = G_img.img_params.exp_t_nanosec*9/10;
+  tmpts.tv_sec = G_img->img_params.exp_t_sec*9/10;
+  tmpts.tv_nsec = G_img->img_params.exp_t_nanosec*9/10;
   queue_delayed_work(ccd_workq, &readout_work, timespec_to_jiffies(&tmpts));
   G_status |= CCD_INTEGRATING | CCD_STAT_UPDATE;
   wake_up_interruptible(&inq);
@@ -606,8 +655,8 @@ static void start_exp_now(void)
     return;
   }
   getnstimeofday(&ts);
-  G_img.img_params.start_sec = ts.tv_sec;
-  G_img.img_params.start_nanosec = ts.tv_nsec;
+  G_img->img_params.start_sec = ts.tv_sec;
+  G_img->img_params.start_nanosec = ts.tv_nsec;
   kthread_run(start_exp,NULL,"start_exp_thread");
 }
 
@@ -670,11 +719,43 @@ static void calc_exp_time_div(unsigned long exp_t_sec, unsigned long exp_t_nanos
 }
 #endif
 
+/** \brief Select the ring slot the next image is read into.
+ * \return (void)
+ *
+ * Algorithm:
+ * - Starting after the current slot, pick the first slot that does not contain the last completed image and to 
+ *   which no programme holds a reference.
+ * - If there is no such slot (programmes are not releasing their images), reuse the slot after the current one
+ *   anyway and report it.
+ * - Point G_img to the selected slot.
+ */
+static void ring_next_slot(void)
+{
+  unsigned int i, slot = 0;
+  for (i=1; i<=MERLIN_RING_LEN; i++)
+  {
+    slot = (G_ring_cur+i) % MERLIN_RING_LEN;
+    if ((slot != G_ring_ready) && (atomic_read(&G_ring_refs[slot]) == 0))
+      break;
+  }
+  if (i > MERLIN_RING_LEN)
+  {
+    slot = (G_ring_cur+1) % MERLIN_RING_LEN;
+    printk(KERN_INFO PRINTK_PREFIX "All image ring slots are in use. Overwriting slot %u.\n", slot);
+  }
+  G_ring_cur = slot;
+  G_img = RING_SLOT(slot);
+}
+
 /** \brief Called when a programme tries to open the driver's character device.
- * \return 0 (success)
+ * \return 0 on success, -ENOMEM if the per-file data could not be allocated.
  */
 static int device_open(struct inode *inode, struct file *file)
 {
+  struct merlin_file *mfile = kzalloc(sizeof(struct merlin_file), GFP_KERNEL);
+  if (mfile == NULL)
+    return -ENOMEM;
+  file->private_data = mfile;
   G_status |= CCD_STAT_UPDATE;
   wake_up_interruptible(&inq);
   return 0;
@@ -682,16 +763,27 @@ static int device_open(struct inode *inode, struct file *file)
 
 /** \brief Called when a programme that previously opened the driver's character device, closes it again.
  * \return 0 (success)
+ *
+ * Releases all ring slots the programme still holds through this file.
  */
 static int device_release(struct inode *inode, struct file *file)
 {
+  struct merlin_file *mfile = file->private_data;
+  int i;
+  if (mfile == NULL)
+    return 0;
+  for (i=0; i<MERLIN_RING_LEN; i++)
+    atomic_sub(atomic_read(&mfile->held[i]), &G_ring_refs[i]);
+  kfree(mfile);
+  file->private_data = NULL;
   return 0;
 }
 
 /** \brief Called when a programme does an IOCTL call on the driver's character device.
  * \return 0 on success, <0 on failure.
  * 
- * IOCTL_GET_IMAGE, IOCTL_ORDER_EXP and IOCTL_GET_MODES are always supported.
+ * IOCTL_GET_IMAGE, IOCTL_GET_IMAGE_SLOT, IOCTL_RELEASE_IMAGE, IOCTL_ORDER_EXP and IOCTL_GET_MODES are always
+ * supported.
  * IOCTL_SET_IMAGE, IOCTL_GET_CMD and IOCTL_SET_MODES are only available if the ACQSIM compiler flag was
  * active at compile time.
  * If an invalid IOCTL number is supplied, -ENOTTY is returned.
@@ -699,6 +791,11 @@ static int device_release(struct inode *inode, struct file *file)
  * IOCTL_GET_IMAGE:
  * - Send the image to the calling programme
  * - Unset the CCD_IMG_READY status flag.
+ * IOCTL_GET_IMAGE_SLOT:
+ * - Take a reference to the ring slot containing the latest image and send its index to the calling programme.
+ * - Unset the CCD_IMG_READY status flag.
+ * IOCTL_RELEASE_IMAGE:
+ * - Drop a reference to a ring slot previously taken with IOCTL_GET_IMAGE_SLOT.
  * IOCTL_ORDER_EXP:
  * - Check that the CCD is ready for an expose command.
  * - Copy the exposure parameters (ccd_cmd struct) from the calling programme.
@@ -711,7 +808,7 @@ static int device_release(struct inode *inode, struct file *file)
  * - Copy the G_modes structure (which describes all the modes supported by the CCD and driver to the
  *   calling programme.
  * IOCTL_SET_IMAGE:
- * - Copy a new simulated image from the calling programme.
+ * - Copy a new simulated image from the calling programme into the next free ring slot.
  * IOCTL_GET_CMD:
  * - Copy the last received exposure command to the calling programme.
  * IOCTL_SET_MODES:
@@ -720,6 +817,8 @@ static int device_release(struct inode *inode, struct file *file)
 long device_ioctl(struct file *file, unsigned int ioctl_num, unsigned long ioctl_param)
 {
   int ret_val;
+  unsigned long slot;
+  struct merlin_file *mfile = file->private_data;
 
   switch (ioctl_num)
   {
@@ -747,9 +846,10 @@ long device_ioctl(struct file *file, unsigned int ioctl_num, unsigned long ioctl
         printk(KERN_INFO PRINTK_PREFIX "Could not copy exposure parameters from user (%d)\n", ret_val);
         break;
       }
-      G_img.img_params.exp_t_sec = G_cmd.exp_t_sec;
-      G_img.img_params.exp_t_nanosec = G_cmd.exp_t_nanosec;
-      check_exp_time_valid(&G_img.img_params.exp_t_sec, &G_img.img_params.exp_t_nanosec);
+      ring_next_slot();
+      G_img->img_params.exp_t_sec = G_cmd.exp_t_sec;
+      G_img->img_params.exp_t_nanosec = G_cmd.exp_t_nanosec;
+      check_exp_time_valid(&G_img->img_params.exp_t_sec, &G_img->img_params.exp_t_nanosec);
       #ifdef ACQSIM
        G_status |= CCD_INTEGRATING;
       #else
@@ -758,11 +858,33 @@ long device_ioctl(struct file *file, unsigned int ioctl_num, unsigned long ioctl
       ret_val = 0;
       break;
     case IOCTL_GET_IMAGE:
-      ret_val = copy_to_user((void *)ioctl_param, &G_img, sizeof(struct merlin_img));
+      ret_val = copy_to_user((void *)ioctl_param, RING_SLOT(G_ring_ready), sizeof(struct merlin_img));
       if (ret_val < 0)
         printk(KERN_DEBUG PRINTK_PREFIX "Error writing image data to user-space\n");
       G_status &= ~CCD_IMG_READY;
       break;
+    case IOCTL_GET_IMAGE_SLOT:
+      slot = G_ring_ready;
+      ret_val = put_user(slot, (unsigned long *)ioctl_param);
+      if (ret_val < 0)
+      {
+        printk(KERN_DEBUG PRINTK_PREFIX "Error writing image ring slot to user-space\n");
+        break;
+      }
+      atomic_inc(&mfile->held[slot]);
+      atomic_inc(&G_ring_refs[slot]);
+      G_status &= ~CCD_IMG_READY;
+      break;
+    case IOCTL_RELEASE_IMAGE:
+      if ((ioctl_param >= MERLIN_RING_LEN) || (atomic_add_unless(&mfile->held[ioctl_param], -1, 0) == 0))
+      {
+        printk(KERN_DEBUG PRINTK_PREFIX "Cannot release image ring slot %lu, it is not held\n", ioctl_param);
+        ret_val = -EINVAL;
+        break;
+      }
+      atomic_dec(&G_ring_refs[ioctl_param]);
+      ret_val = 0;
+      break;
     case IOCTL_ACQ_RESET:
       G_status |= CCD_ERR_RETRY;
       reset_acq_merlin();
@@ -770,9 +892,11 @@ long device_ioctl(struct file *file, unsigned int ioctl_num, unsigned long ioctl
       break;
 #ifdef ACQSIM
     case IOCTL_SET_IMAGE:
-      ret_val = copy_from_user(&G_img, (void *)ioctl_param, sizeof(struct merlin_img));
+      ring_next_slot();
+      ret_val = copy_from_user(G_img, (void *)ioctl_param, sizeof(struct merlin_img));
       if (ret_val < 0)
         printk(KERN_DEBUG PRINTK_PREFIX "Error reading image data from user-space\n");
+      G_ring_ready = G_ring_cur;
       G_status = CCD_IMG_READY | CCD_STAT_UPDATE;
       wake_up_interruptible(&inq);
       ret_val = 0;
@@ -837,6 +961,19 @@ static unsigned int device_poll(struct file *filp, poll_table *wait)
   return mask;
 }
 
+/** \brief Called when a programme maps the driver's character device into its address space.
+ * \return 0 on success, <0 on failure.
+ *
+ * Maps (part of) the image ring. Only read-only shared mappings are allowed.
+ */
+static int device_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+  if ((vma->vm_flags & VM_WRITE) != 0)
+    return -EPERM;
+  vma->vm_flags &= ~VM_MAYWRITE;
+  return remap_vmalloc_range(vma, G_ring, vma->vm_pgoff);
+}
+
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("PIERRE VAN HEERDEN");
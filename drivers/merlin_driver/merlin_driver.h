@@ -39,6 +39,19 @@ struct merlin_img
 };
 /** \} */
 
+/** \brief Image ring definitions
+ * The driver reads images into a ring of MERLIN_RING_LEN struct merlin_img buffers, which programmes can map 
+ * (read-only, shared) into their address space with mmap on the character device. Slot i starts at byte
+ * i*MERLIN_RING_SLOT_SIZE of the mapping.
+ * \{ */
+/// Number of image buffers in the ring
+#define   MERLIN_RING_LEN        4
+/// Size of each image buffer in the ring (a whole number of 4 kB pages)
+#define   MERLIN_RING_SLOT_SIZE  ((sizeof(struct merlin_img)+4095) & ~4095UL)
+/// Total size of the image ring
+#define   MERLIN_RING_SIZE       (MERLIN_RING_LEN*MERLIN_RING_SLOT_SIZE)
+/** \} */
+
 /** \brief Driver status definitions
  * \{
  */
@@ -66,6 +79,8 @@ enum
   IOCTL_NUM_ORDER_EXP,
   IOCTL_NUM_GET_IMAGE,
   IOCTL_NUM_ACQ_RESET,
+  IOCTL_NUM_GET_IMAGE_SLOT,
+  IOCTL_NUM_RELEASE_IMAGE,
   #ifdef ACQSIM
   IOCTL_NUM_SET_MODES,
   IOCTL_NUM_GET_CMD,
@@ -86,6 +101,12 @@ enum
 /// IOCTL to reset camera driver (should be paired with manual reset of merlin crate)
 #define IOCTL_ACQ_RESET _IOR(MERLIN_IOCTL_NUM, IOCTL_NUM_ACQ_RESET, unsigned long*)
 
+/// IOCTL to read the index of the ring slot containing the latest image. The slot is not reused until released with IOCTL_RELEASE_IMAGE.
+#define IOCTL_GET_IMAGE_SLOT _IOR(MERLIN_IOCTL_NUM, IOCTL_NUM_GET_IMAGE_SLOT, unsigned long*)
+
+/// IOCTL to release a ring slot retrieved with IOCTL_GET_IMAGE_SLOT (the slot index is passed as the argument)
+#define IOCTL_RELEASE_IMAGE _IOW(MERLIN_IOCTL_NUM, IOCTL_NUM_RELEASE_IMAGE, unsigned long)
+
 #ifdef ACQSIM
   /// IOCTL to write simulated CCD available modes to driver
   #define IOCTL_SET_MODES _IOW(MERLIN_IOCTL_NUM, IOCTL_NUM_SET_MODES, unsigned long*)
@@ -21,6 +21,10 @@
 #include <linux/interrupt.h>
 #include <linux/string.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
 
 #include <time_driver/time_driver.h>
 #include <act_plc/act_plc.h>
@@ -29,6 +33,8 @@
 #include "pmt_defs.h"
 
 #define PRINTK_PREFIX "[ACT_PMT] "
+#define TRUE  1
+#define FALSE 0
 
 /** \brief PHOTOMETRY CARD port numbers
  * \{
@@ -53,9 +59,6 @@
 #define MODE0      0X9292
 /** \} */
 
-/// Length of buffer for average counts
-#define INTEG_BUFF_LEN                5000
-
 /// Minimum number of counts to be counted as non-zero
 #define MIN_COUNTS_NONZERO            5
 
@@ -86,6 +89,14 @@ ssize_t pmt_read(struct file *filp, char *buf, size_t count, loff_t *f_pos);
 int pmt_release(struct inode *inodePtr, struct file *filePtr);
 long pmt_ioctl(struct file *filePtr, unsigned int ioctl_num, unsigned long ioctl_param);
 int pmt_fasync(int fd, struct file *filp, int mode);
+unsigned int pmt_poll(struct file *filp, poll_table *wait);
+int pmt_mmap(struct file *filp, struct vm_area_struct *vma);
+__u32 ring_cons_idx(struct pmt_ring_hdr *hdr, __u32 prod_idx, __u32 ring_len);
+unsigned long ring_num_unread(void);
+void ring_push(struct pmt_integ_data *data);
+unsigned long ttag_num_unread(void);
+long ttag_copy_to_user(struct pmt_ttag_data *buf, unsigned long num);
+void check_ttag(unsigned long check_period_ns, unsigned long unit_s, unsigned long unit_ns);
 void pmt_millisec_handler(unsigned long unit, unsigned short unit_msec);
 void pmt_time_sync_handler(char synced);
 unsigned char check_counts(unsigned char cur_err, unsigned long counts, unsigned long sample_p_ns);
@@ -118,12 +129,26 @@ static struct pmt_information G_pmt_info;
 static struct pmt_command G_pmt_cmd;
 /// Structure with data for integration currently in progress
 static struct pmt_integ_data G_cur_integ;
-/// Data buffer
-static struct pmt_integ_data G_integ_buffer[INTEG_BUFF_LEN];
-/// Reference index to last user-read photometric count in G_integ_buffer.
-static unsigned long G_user_idx=0;
-/// Reference index to current photometric count in G_integ_buffer.
-static unsigned long G_cur_idx=0;
+/// Integration data ring (header followed by records), which user-space programmes can mmap
+static void *G_ring = NULL;
+/// Header of the integration data ring
+static struct pmt_ring_hdr *G_ring_hdr;
+/// Records of the integration data ring
+static struct pmt_integ_data *G_ring_data;
+/// Number of unread records at which poll() reports the device readable
+static unsigned long G_ring_thresh = 1;
+/// Queue of programmes waiting in poll() for integration data or time tags
+static wait_queue_head_t G_ring_wq;
+/// Time tag ring (header followed by time tags), which user-space programmes can mmap
+static void *G_ttag_ring = NULL;
+/// Header of the time tag ring
+static struct pmt_ring_hdr *G_ttag_hdr;
+/// Time tags in the time tag ring
+static struct pmt_ttag_data *G_ttag_data;
+/// Number of unread time tags at which poll() reports the device readable
+static unsigned long G_ttag_thresh = 1;
+/// Milliseconds covered by the time-tag run in progress (check_ttag is called once per millisecond)
+static unsigned long G_ttag_elapsed_ms = 0;
 /// Photometer countrate above which over-illumination is triggered.
 static unsigned long G_overillum_counts=PMT_WARN_COUNTRATE;
 /// Counter for probing the PMT for an overillumination/overflow before integrating.
@@ -139,7 +164,9 @@ struct file_operations pmt_fops = {
   .read = pmt_read,
   .release = pmt_release,
   .unlocked_ioctl = pmt_ioctl,
-  .fasync = pmt_fasync
+  .fasync = pmt_fasync,
+  .poll = pmt_poll,
+  .mmap = pmt_mmap
 };
 
 /** \brief Called when module is inserted into the kernel.
@@ -174,10 +201,37 @@ int insert_module(void)
     return -ENODEV;
   }
 
+  G_ring = vmalloc_user(PMT_RING_SIZE);
+  if (G_ring == NULL)
+  {
+    printk (KERN_ALERT PRINTK_PREFIX "Error allocating integration data ring.\n" );
+    device_destroy(G_class_pmt, MKDEV(G_major, 0));
+    class_destroy(G_class_pmt);
+    unregister_chrdev(G_major, PMT_DEVICE_NAME);
+    return -ENOMEM;
+  }
+  G_ring_hdr = (struct pmt_ring_hdr *)G_ring;
+  G_ring_data = (struct pmt_integ_data *)((char *)G_ring + PMT_RING_HDR_SIZE);
+  G_ttag_ring = vmalloc_user(PMT_TTAG_RING_SIZE);
+  if (G_ttag_ring == NULL)
+  {
+    printk (KERN_ALERT PRINTK_PREFIX "Error allocating time tag ring.\n" );
+    vfree(G_ring);
+    device_destroy(G_class_pmt, MKDEV(G_major, 0));
+    class_destroy(G_class_pmt);
+    unregister_chrdev(G_major, PMT_DEVICE_NAME);
+    return -ENOMEM;
+  }
+  G_ttag_hdr = (struct pmt_ring_hdr *)G_ttag_ring;
+  G_ttag_data = (struct pmt_ttag_data *)((char *)G_ttag_ring + PMT_RING_HDR_SIZE);
+  init_waitqueue_head(&G_ring_wq);
+
   ret = register_millisec_handler(&pmt_millisec_handler);
   if (!ret)
   {
     printk(KERN_ERR PRINTK_PREFIX "Could not register millisecond handler function with time system.\n");
+    vfree(G_ttag_ring);
+    vfree(G_ring);
     device_destroy(G_class_pmt, MKDEV(G_major, 0));
     class_destroy(G_class_pmt);
     unregister_chrdev(G_major, PMT_DEVICE_NAME);
@@ -188,6 +242,8 @@ int insert_module(void)
   {
     printk(KERN_ERR PRINTK_PREFIX "Could not register time sync alert handeler function with time system.\n");
     unregister_millisec_handler(&pmt_millisec_handler);
+    vfree(G_ttag_ring);
+    vfree(G_ring);
     device_destroy(G_class_pmt, MKDEV(G_major, 0));
     class_destroy(G_class_pmt);
     unregister_chrdev(G_major, PMT_DEVICE_NAME);
@@ -223,6 +279,8 @@ void remove_module(void)
   printk(KERN_DEBUG PRINTK_PREFIX "Module removed\n");
   unregister_millisec_handler(&pmt_millisec_handler);
   unregister_time_sync_handler(&pmt_time_sync_handler);
+  vfree(G_ttag_ring);
+  vfree(G_ring);
   device_destroy(G_class_pmt, MKDEV(G_major, 0));
   class_destroy(G_class_pmt);
   unregister_chrdev(G_major, PMT_DEVICE_NAME);
@@ -249,6 +307,11 @@ int pmt_open(struct inode *inodePtr, struct file *filePtr)
  */
 ssize_t pmt_read(struct file *filp, char *buf, size_t count, loff_t *f_pos)
 {
+  // Programmes that map the rings consume records without the driver's involvement
+  if ((ring_num_unread() > 0) || (ttag_num_unread() > 0))
+    G_status |= PMT_STAT_DATA_READY;
+  else
+    G_status &= ~PMT_STAT_DATA_READY;
   if (copy_to_user (buf, &G_status, sizeof(G_status)))
     return -EFAULT;
   G_status &= ~PMT_STAT_UPDATE;
@@ -266,8 +329,10 @@ int pmt_release(struct inode *inodePtr, struct file *filePtr)
   pmt_fasync(-1, filePtr, 0);
   if (G_num_open > 0)
     return 0;
-  // Reset PMT shutter forced closure countrate to the default.
+  // Reset PMT shutter forced closure countrate and ring wake-up threshold to the defaults.
   G_overillum_counts = PMT_WARN_COUNTRATE;
+  G_ring_thresh = 1;
+  G_ttag_thresh = 1;
   cancel_integ();
   return 0;
 }
@@ -283,7 +348,9 @@ long pmt_ioctl(struct file *filePtr, unsigned int ioctl_num, unsigned long ioctl
 {
   int ret_val = 0;
   unsigned long value = 0;
+  __u32 cons_idx;
   struct pmt_command tmp_cmd;
+  struct pmt_ttag_read ttag_read;
 
   switch (ioctl_num)
   {
@@ -321,15 +388,19 @@ long pmt_ioctl(struct file *filePtr, unsigned int ioctl_num, unsigned long ioctl
       }
       else
         printk(KERN_DEBUG PRINTK_PREFIX "Data ready.\n");
-      if (G_user_idx >= G_cur_idx)
+      if (ring_num_unread() == 0)
       {
         printk(KERN_DEBUG PRINTK_PREFIX "Integration has not started (yet?)");
+        G_status &= ~PMT_STAT_DATA_READY;
         ret_val = -EAGAIN;
         break;
       }
       else
         printk(KERN_DEBUG PRINTK_PREFIX "Indexes OK (integration has started.\n");
-      ret_val = copy_to_user((void *)ioctl_param, &G_integ_buffer[G_user_idx%INTEG_BUFF_LEN], sizeof(struct pmt_integ_data));
+      cons_idx = ring_cons_idx(G_ring_hdr, READ_ONCE(G_ring_hdr->prod_idx), PMT_RING_LEN);
+      // Read the record only after seeing the producer index that covers it
+      smp_rmb();
+      ret_val = copy_to_user((void *)ioctl_param, &G_ring_data[cons_idx % PMT_RING_LEN], sizeof(struct pmt_integ_data));
       if (ret_val < 0)
       {
         printk(KERN_ALERT PRINTK_PREFIX "Failed to copy integration data to user space.\n");
@@ -337,8 +408,10 @@ long pmt_ioctl(struct file *filePtr, unsigned int ioctl_num, unsigned long ioctl
       }
       else
         printk(KERN_DEBUG PRINTK_PREFIX "Copied integration data to user space.\n");
-      G_user_idx++;
-      if (G_user_idx >= G_cur_idx)
+      // Finish reading the record before handing its slot back to the producer
+      smp_mb();
+      WRITE_ONCE(G_ring_hdr->cons_idx, cons_idx + 1);
+      if (ring_num_unread() == 0)
       {
         G_status &= ~PMT_STAT_DATA_READY;
         if ((G_status & PMT_STAT_UPDATE) == 0)
@@ -394,6 +467,51 @@ long pmt_ioctl(struct file *filePtr, unsigned int ioctl_num, unsigned long ioctl
       printk(KERN_DEBUG PRINTK_PREFIX "Using counter %lu (0x%lx)", (G_counter_chan - COUNTER0) / 2, G_counter_chan);
       break;
 
+    case IOCTL_SET_RING_THRESH:
+      ret_val = copy_from_user(&value, (void*)ioctl_param, sizeof(unsigned long));
+      if (ret_val != 0)
+      {
+        printk(KERN_ERR PRINTK_PREFIX "Error reading ring wake-up threshold from user space.\n");
+        ret_val = -EFAULT;
+        break;
+      }
+      if ((value < 1) || (value > PMT_RING_LEN))
+      {
+        printk(KERN_ERR PRINTK_PREFIX "Invalid ring wake-up threshold specified (%lu - must be between 1 and %d)\n", value, PMT_RING_LEN);
+        ret_val = -EINVAL;
+        break;
+      }
+      G_ring_thresh = value;
+      break;
+
+    case IOCTL_SET_TTAG_THRESH:
+      ret_val = copy_from_user(&value, (void*)ioctl_param, sizeof(unsigned long));
+      if (ret_val != 0)
+      {
+        printk(KERN_ERR PRINTK_PREFIX "Error reading time tag wake-up threshold from user space.\n");
+        ret_val = -EFAULT;
+        break;
+      }
+      if ((value < 1) || (value > PMT_TTAG_RING_LEN))
+      {
+        printk(KERN_ERR PRINTK_PREFIX "Invalid time tag wake-up threshold specified (%lu - must be between 1 and %d)\n", value, PMT_TTAG_RING_LEN);
+        ret_val = -EINVAL;
+        break;
+      }
+      G_ttag_thresh = value;
+      break;
+
+    case IOCTL_GET_TTAG_DATA:
+      ret_val = copy_from_user(&ttag_read, (void*)ioctl_param, sizeof(struct pmt_ttag_read));
+      if (ret_val != 0)
+      {
+        printk(KERN_ERR PRINTK_PREFIX "Error reading time tag buffer details from user space.\n");
+        ret_val = -EFAULT;
+        break;
+      }
+      ret_val = ttag_copy_to_user(ttag_read.buf, ttag_read.num);
+      break;
+
     default:  // Invalid IOCTL number
       ret_val = -ENOTTY;
       break;
@@ -413,6 +531,199 @@ int pmt_fasync(int fd, struct file *filp, int mode)
   return fasync_helper(fd, filp, mode, &G_async_queue);
 }
 
+/** \brief Called when a programme polls the character device.
+ * \return Mask of available poll events.
+ *
+ * The device is readable once the number of unread records in the integration data ring or the time tag ring reaches
+ * its wake-up threshold (IOCTL_SET_RING_THRESH or IOCTL_SET_TTAG_THRESH), or when records are left unread after the
+ * integration has stopped.
+ */
+unsigned int pmt_poll(struct file *filp, poll_table *wait)
+{
+  unsigned int mask = 0;
+  unsigned long num_unread;
+  poll_wait(filp, &G_ring_wq, wait);
+  num_unread = ring_num_unread();
+  if ((num_unread >= G_ring_thresh) || ((num_unread > 0) && ((G_status & PMT_STAT_BUSY) == 0)))
+    mask |= POLLIN | POLLRDNORM;
+  num_unread = ttag_num_unread();
+  if ((num_unread >= G_ttag_thresh) || ((num_unread > 0) && ((G_status & PMT_STAT_BUSY) == 0)))
+    mask |= POLLIN | POLLRDNORM;
+  return mask;
+}
+
+/** \brief Called when a programme maps the driver's character device into its address space.
+ * \return 0 on success, <0 on failure.
+ *
+ * Maps (part of) the integration data ring, or the time tag ring if the offset is PMT_TTAG_RING_OFFSET or beyond. Only
+ * shared mappings are allowed, because the programme reports which records it has read by writing the consumer index
+ * in the ring header.
+ */
+int pmt_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+  if ((vma->vm_flags & VM_SHARED) == 0)
+    return -EINVAL;
+  if (vma->vm_pgoff >= (PMT_TTAG_RING_OFFSET >> PAGE_SHIFT))
+    return remap_vmalloc_range(vma, G_ttag_ring, vma->vm_pgoff - (PMT_TTAG_RING_OFFSET >> PAGE_SHIFT));
+  return remap_vmalloc_range(vma, G_ring, vma->vm_pgoff);
+}
+
+/** \brief Reader's index of a ring, clamped to [prod_idx - ring_len, prod_idx].
+ * \param hdr Ring header.
+ * \param prod_idx Producer index, as read by the caller.
+ * \param ring_len Number of slots in the ring.
+ * \return Index of the oldest unread record.
+ *
+ * cons_idx is written by the programme that maps the ring, so it is read once and never trusted to be in range.
+ */
+__u32 ring_cons_idx(struct pmt_ring_hdr *hdr, __u32 prod_idx, __u32 ring_len)
+{
+  __u32 cons_idx = READ_ONCE(hdr->cons_idx);
+  if ((__s32)(prod_idx - cons_idx) < 0)
+    return prod_idx;
+  if (prod_idx - cons_idx > ring_len)
+    return prod_idx - ring_len;
+  return cons_idx;
+}
+
+/** \brief Number of records in the integration data ring that have not been read yet.
+ */
+unsigned long ring_num_unread(void)
+{
+  __u32 prod_idx = READ_ONCE(G_ring_hdr->prod_idx);
+  return prod_idx - ring_cons_idx(G_ring_hdr, prod_idx, PMT_RING_LEN);
+}
+
+/** \brief Number of time tags in the time tag ring that have not been read yet.
+ */
+unsigned long ttag_num_unread(void)
+{
+  __u32 prod_idx = READ_ONCE(G_ttag_hdr->prod_idx);
+  return prod_idx - ring_cons_idx(G_ttag_hdr, prod_idx, PMT_TTAG_RING_LEN);
+}
+
+/** \brief Copy unread time tags to user space.
+ * \param buf User-space buffer.
+ * \param num Maximum number of time tags to copy.
+ * \return Number of time tags copied, \< 0 on error.
+ */
+long ttag_copy_to_user(struct pmt_ttag_data *buf, unsigned long num)
+{
+  __u32 prod_idx = READ_ONCE(G_ttag_hdr->prod_idx), cons_idx = ring_cons_idx(G_ttag_hdr, prod_idx, PMT_TTAG_RING_LEN);
+  unsigned long slot, chunk, done = 0;
+  if (num > prod_idx - cons_idx)
+    num = prod_idx - cons_idx;
+  // Read the time tags only after seeing the producer index that covers them
+  smp_rmb();
+  while (done < num)
+  {
+    slot = (cons_idx + done) % PMT_TTAG_RING_LEN;
+    chunk = num - done;
+    if (chunk > PMT_TTAG_RING_LEN - slot)
+      chunk = PMT_TTAG_RING_LEN - slot;
+    if (copy_to_user(&buf[done], &G_ttag_data[slot], chunk*sizeof(struct pmt_ttag_data)) != 0)
+    {
+      printk(KERN_ALERT PRINTK_PREFIX "Failed to copy time tags to user space.\n");
+      break;
+    }
+    done += chunk;
+  }
+  if (done == 0)
+    return num == 0 ? 0 : -EFAULT;
+  // Finish reading the time tags before handing their slots back to the producer
+  smp_mb();
+  WRITE_ONCE(G_ttag_hdr->cons_idx, cons_idx + done);
+  return done;
+}
+
+/** \brief Register a time-tagging front end.
+ * \param time_res_ns Time resolution of the front end's time tags in nanoseconds.
+ * \return TRUE on success, FALSE if a front end has already been registered.
+ */
+char pmt_register_ttag_source(unsigned long time_res_ns)
+{
+  if ((G_pmt_info.modes & PMT_MODE_TTAG) != 0)
+  {
+    printk(KERN_ERR PRINTK_PREFIX "A time-tagging front end has already been registered.\n");
+    return FALSE;
+  }
+  G_pmt_info.timetag_time_res_ns = time_res_ns;
+  G_pmt_info.modes |= PMT_MODE_TTAG;
+  printk(KERN_DEBUG PRINTK_PREFIX "Time-tagging front end registered (%lu ns resolution).\n", time_res_ns);
+  return TRUE;
+}
+EXPORT_SYMBOL(pmt_register_ttag_source);
+
+/** \brief Unregister the time-tagging front end, cancelling a time-tag run in progress.
+ */
+void pmt_unregister_ttag_source(void)
+{
+  if (((G_status & (PMT_STAT_BUSY | PMT_STAT_PROBE)) != 0) && (G_pmt_cmd.mode == PMT_MODE_TTAG))
+    cancel_integ();
+  G_pmt_info.modes &= ~PMT_MODE_TTAG;
+  G_pmt_info.timetag_time_res_ns = 0;
+}
+EXPORT_SYMBOL(pmt_unregister_ttag_source);
+
+/** \brief Called by the time-tagging front end for every photon.
+ * \param time_s Universal time of the photon's arrival (seconds component)
+ * \param time_ns Universal time of the photon's arrival (nanoseconds component)
+ *
+ * Appends the time tag to the time tag ring while a time-tag run is in progress, in the same way ring_push appends
+ * integration records. To keep the cost per photon down, programmes waiting in poll() are only woken up when the
+ * number of unread time tags reaches the threshold (the millisecond handler wakes them up while it stays above it).
+ */
+void pmt_ttag_add(unsigned long time_s, unsigned long time_ns)
+{
+  __u32 prod_idx, cons_idx;
+  if (((G_status & PMT_STAT_BUSY) == 0) || (G_pmt_cmd.mode != PMT_MODE_TTAG))
+    return;
+  prod_idx = G_ttag_hdr->prod_idx;
+  cons_idx = ring_cons_idx(G_ttag_hdr, prod_idx, PMT_TTAG_RING_LEN);
+  if (prod_idx - cons_idx >= PMT_TTAG_RING_LEN)
+  {
+    if (G_ttag_hdr->num_lost == 0)
+      printk(KERN_ERR PRINTK_PREFIX "Time tag ring is full. Discarding time tags until it is read.\n");
+    WRITE_ONCE(G_ttag_hdr->num_lost, G_ttag_hdr->num_lost + 1);
+    return;
+  }
+  smp_mb();
+  G_ttag_data[prod_idx % PMT_TTAG_RING_LEN].time_s = time_s;
+  G_ttag_data[prod_idx % PMT_TTAG_RING_LEN].time_ns = time_ns;
+  smp_wmb();
+  WRITE_ONCE(G_ttag_hdr->prod_idx, prod_idx + 1);
+  if (prod_idx + 1 - cons_idx == G_ttag_thresh)
+    wake_up_interruptible(&G_ring_wq);
+}
+EXPORT_SYMBOL(pmt_ttag_add);
+
+/** \brief Append a record to the integration data ring.
+ * \param data Integration record.
+ *
+ * If the ring is full the record is discarded and counted in the ring header. Otherwise the record is written to the
+ * next slot before the producer index is advanced, so that a programme reading the mapped ring never sees a partial
+ * record. Wakes up programmes waiting in poll() once the wake-up threshold is reached.
+ */
+void ring_push(struct pmt_integ_data *data)
+{
+  __u32 prod_idx = G_ring_hdr->prod_idx, cons_idx = ring_cons_idx(G_ring_hdr, prod_idx, PMT_RING_LEN);
+  if (prod_idx - cons_idx >= PMT_RING_LEN)
+  {
+    if (G_ring_hdr->num_lost == 0)
+      printk(KERN_ERR PRINTK_PREFIX "Integration data ring is full. Discarding data until it is read.\n");
+    WRITE_ONCE(G_ring_hdr->num_lost, G_ring_hdr->num_lost + 1);
+    return;
+  }
+  // The reader must be done with the slot (cons_idx read above) before it is overwritten
+  smp_mb();
+  memcpy(&G_ring_data[prod_idx % PMT_RING_LEN], data, sizeof(struct pmt_integ_data));
+  smp_wmb();
+  WRITE_ONCE(G_ring_hdr->prod_idx, prod_idx + 1);
+  G_status |= PMT_STAT_DATA_READY;
+  if (prod_idx + 1 - cons_idx >= G_ring_thresh)
+    wake_up_interruptible(&G_ring_wq);
+}
+
 /** \brief Handler for millisecond interrupt (from time_driver)
  * \param unit Universal time (seconds component)
  * \param unit_msec Universal time (milliseconds component)
@@ -441,7 +752,10 @@ void pmt_millisec_handler(unsigned long unit, unsigned short unit_msec)
   }
   if ((G_status & PMT_STAT_BUSY) != 0)
   {
-    check_integ(1000000L, unit, unit_msec*1000000L);
+    if (G_pmt_cmd.mode == PMT_MODE_TTAG)
+      check_ttag(1000000L, unit, unit_msec*1000000L);
+    else
+      check_integ(1000000L, unit, unit_msec*1000000L);
     return;
   }
   G_cur_integ.start_time_s = unit;
@@ -569,9 +883,13 @@ void check_probe(unsigned long check_period_ns, unsigned long unit_s, unsigned l
   G_cur_integ.counts = inw_p(G_counter_chan);
   new_err = check_counts(G_cur_integ.error, G_cur_integ.counts, check_period_ns);
 
-  tmp_overflow_counts = G_cur_integ.counts * (G_pmt_cmd.sample_length*G_pmt_info.min_sample_period_ns / check_period_ns);
-  if (tmp_overflow_counts >= PMT_COUNTER_MAX)
-    new_err |= PMT_ERR_OVERFLOW;
+  // In time-tag mode the counter is read every millisecond, so it can't overflow below the overillumination rate
+  if (G_pmt_cmd.mode == PMT_MODE_INTEG)
+  {
+    tmp_overflow_counts = G_cur_integ.counts * (G_pmt_cmd.sample_length*G_pmt_info.min_sample_period_ns / check_period_ns);
+    if (tmp_overflow_counts >= PMT_COUNTER_MAX)
+      new_err |= PMT_ERR_OVERFLOW;
+  }
   
   if (G_status & PMT_STAT_ERR)
     G_cur_integ.error |= new_err;
@@ -622,7 +940,7 @@ int order_integ(struct pmt_command *cmd)
     printk(KERN_ERR PRINTK_PREFIX "An integration is currently underway. Cannot start another.\n");
     return -EPERM;
   }
-  if (cmd->mode != PMT_MODE_INTEG)
+  if ((cmd->mode != PMT_MODE_INTEG) && ((cmd->mode != PMT_MODE_TTAG) || ((G_pmt_info.modes & PMT_MODE_TTAG) == 0)))
   {
     printk(KERN_ERR PRINTK_PREFIX "Invalid mode specified.\n");
     return -EINVAL;
@@ -662,8 +980,19 @@ int order_integ(struct pmt_command *cmd)
 void start_integ(void)
 {
   printk(KERN_DEBUG PRINTK_PREFIX "Starting integration.\n");
-  G_cur_idx = 0;
-  G_user_idx = 0;
+  // Unread records of a previous integration are left in the ring - the reader discards them before ordering
+  WRITE_ONCE(G_ring_hdr->num_lost, 0);
+  if (G_pmt_cmd.mode == PMT_MODE_TTAG)
+  {
+    WRITE_ONCE(G_ttag_hdr->num_lost, 0);
+    WRITE_ONCE(G_ttag_hdr->run_start_s, G_cur_integ.start_time_s);
+    WRITE_ONCE(G_ttag_hdr->run_start_ns, G_cur_integ.start_time_ns);
+    WRITE_ONCE(G_ttag_hdr->run_elapsed_ms, 0);
+    WRITE_ONCE(G_ttag_hdr->run_ended, 0);
+    G_ttag_elapsed_ms = 0;
+    smp_wmb();
+    WRITE_ONCE(G_ttag_hdr->run_num, G_ttag_hdr->run_num + 1);
+  }
   G_cur_integ.sample_period_ns = 0;
   G_cur_integ.prebin_num = 0;
   G_cur_integ.repetitions = 0;
@@ -688,9 +1017,16 @@ void start_integ(void)
 void cancel_integ(void)
 {
   printk(KERN_DEBUG PRINTK_PREFIX "Cancelling integration.\n");
-  memcpy(&G_integ_buffer[G_cur_idx%INTEG_BUFF_LEN], &G_cur_integ, sizeof(struct pmt_integ_data));
-  G_cur_idx++;
+  // A time-tag run's data is in the time tag ring
+  if (G_pmt_cmd.mode == PMT_MODE_TTAG)
+  {
+    if ((G_status & PMT_STAT_BUSY) != 0)
+      WRITE_ONCE(G_ttag_hdr->run_ended, 1);
+  }
+  else
+    ring_push(&G_cur_integ);
   G_status &= ~(PMT_STAT_BUSY | PMT_STAT_PROBE);
+  wake_up_interruptible(&G_ring_wq);
   G_cur_integ.counts = 0;
   G_cur_integ.sample_period_ns = G_pmt_info.min_sample_period_ns;
   G_cur_integ.prebin_num = 0;
@@ -717,6 +1053,7 @@ void check_integ(unsigned long check_period_ns, unsigned long unit_s, unsigned l
 {
   unsigned long tmp_counts;
   unsigned short new_err;
+  struct pmt_integ_data *oldest;
   G_cur_integ.sample_period_ns += check_period_ns;
   if (G_cur_integ.sample_period_ns < G_pmt_cmd.sample_length*G_pmt_info.min_sample_period_ns)
     return;
@@ -751,9 +1088,7 @@ void check_integ(unsigned long check_period_ns, unsigned long unit_s, unsigned l
   }
   if (G_cur_integ.prebin_num > G_pmt_cmd.prebin_num)
     printk(KERN_ERR PRINTK_PREFIX "Error: Requested prebinning number exceeded. This should not have happend.\n");
-  memcpy(&G_integ_buffer[G_cur_idx%INTEG_BUFF_LEN], &G_cur_integ, sizeof(struct pmt_integ_data));
-  G_cur_idx++;
-  G_status |= PMT_STAT_DATA_READY;
+  ring_push(&G_cur_integ);
   G_cur_integ.repetitions++;
   G_cur_integ.start_time_s = unit_s;
   G_cur_integ.start_time_ns = unit_ns;
@@ -765,8 +1100,9 @@ void check_integ(unsigned long check_period_ns, unsigned long unit_s, unsigned l
     finish_integ();
   if ((G_status & PMT_STAT_UPDATE) == 0)
   {
-    // Only signal user-space if more than 1 second has elapsed since last data read.
-    if (((G_integ_buffer[G_cur_idx%INTEG_BUFF_LEN].start_time_s - G_integ_buffer[G_user_idx%INTEG_BUFF_LEN].start_time_s)*1000000000L + G_integ_buffer[G_cur_idx%INTEG_BUFF_LEN].start_time_ns - G_integ_buffer[G_user_idx%INTEG_BUFF_LEN].start_time_ns) > 1000000000L)
+    // Only signal user-space if the oldest unread record is more than 1 second old.
+    oldest = &G_ring_data[ring_cons_idx(G_ring_hdr, READ_ONCE(G_ring_hdr->prod_idx), PMT_RING_LEN) % PMT_RING_LEN];
+    if ((ring_num_unread() > 0) && (((G_cur_integ.start_time_s - oldest->start_time_s)*1000000000L + G_cur_integ.start_time_ns - oldest->start_time_ns) > 1000000000L))
     {
       G_status |= PMT_STAT_UPDATE;
       kill_fasync(&G_async_queue, SIGIO, POLL_IN);
@@ -774,11 +1110,67 @@ void check_integ(unsigned long check_period_ns, unsigned long unit_s, unsigned l
   }
 }
 
+/** \brief Checks on a time-tag run and performs any necessary tasks (reads hardware, error checking, etc.)
+ * \param check_period_ns Period with which function is called (should be 1 ms, i.e. 1000000 ns)
+ * \param unit_s Universal time (seconds component)
+ * \param unit_ns Universal time (nanoseconds component)
+ *
+ * The photons are time-tagged by the front end (pmt_ttag_add). The photometry card's counter still counts them, so that
+ * the same error checks as during an integration protect the PMT, and the total is kept in G_cur_integ.counts.
+ * Advances the run's progress in the time tag ring header (allowing a millisecond for the front end to report
+ * photons) and finishes the run once the requested duration (sample length x prebinning x repetitions) has been
+ * covered.
+ */
+void check_ttag(unsigned long check_period_ns, unsigned long unit_s, unsigned long unit_ns)
+{
+  unsigned long tmp_counts, duration_ms, elapsed_ms;
+  unsigned short new_err;
+  tmp_counts = inw_p(G_counter_chan);
+  new_err = check_counts(G_cur_integ.error, tmp_counts, check_period_ns);
+  G_cur_integ.counts += tmp_counts;
+  G_ttag_elapsed_ms++;
+  if (G_cur_integ.error != new_err)
+  {
+    if ((new_err) && ((G_status & PMT_STAT_ERR) == 0))
+    {
+      G_status |= PMT_STAT_ERR;
+      if ((G_status & PMT_STAT_UPDATE) == 0)
+      {
+        G_status |= PMT_STAT_UPDATE;
+        kill_fasync(&G_async_queue, SIGIO, POLL_IN);
+      }
+    }
+    G_cur_integ.error |= new_err;
+  }
+  if (G_cur_integ.error & PMT_CRIT_ERR_MASK)
+  {
+    cancel_integ();
+    return;
+  }
+
+  duration_ms = G_pmt_cmd.sample_length * (G_pmt_info.min_sample_period_ns / 1000000) * G_pmt_cmd.prebin_num * G_pmt_cmd.repetitions;
+  elapsed_ms = G_ttag_elapsed_ms;
+  // Time tags must be in the ring before the run's progress is advanced past them
+  smp_wmb();
+  if (elapsed_ms <= duration_ms)
+  {
+    WRITE_ONCE(G_ttag_hdr->run_elapsed_ms, elapsed_ms - 1);
+    if (ttag_num_unread() >= G_ttag_thresh)
+      wake_up_interruptible(&G_ring_wq);
+    return;
+  }
+  WRITE_ONCE(G_ttag_hdr->run_elapsed_ms, duration_ms);
+  smp_wmb();
+  WRITE_ONCE(G_ttag_hdr->run_ended, 1);
+  finish_integ();
+}
+
 /** \brief Finalises all internal counters and variables after completion of a series of integrations.
  */
 void finish_integ(void)
 {
   G_status &= ~(PMT_STAT_BUSY | PMT_STAT_PROBE);
+  wake_up_interruptible(&G_ring_wq);
   G_cur_integ.counts = 0;
   G_cur_integ.sample_period_ns = G_pmt_info.min_sample_period_ns;
   G_cur_integ.prebin_num = 0;
@@ -2,6 +2,7 @@
 #define PMT_DRIVER_H
 
 #include <linux/ioctl.h>
+#include <linux/types.h>
 #include "pmt_defs.h"
 // #include <linux/signal.h>
 
@@ -29,4 +30,91 @@
 /// IOCTL to set photometer count rate (per second) above which over-illumination condition is triggered
 #define IOCTL_SET_CHANNEL _IOW(PMT_IOCTL_NUM, 6, unsigned long*)
 
+/// IOCTL to set the number of unread records in the integration data ring at which poll() reports the device readable
+#define IOCTL_SET_RING_THRESH _IOW(PMT_IOCTL_NUM, 7, unsigned long*)
+
+/// IOCTL to set the number of unread time tags in the time tag ring at which poll() reports the device readable
+#define IOCTL_SET_TTAG_THRESH _IOW(PMT_IOCTL_NUM, 8, unsigned long*)
+
+/// IOCTL to copy unread time tags to user space in bulk (parameter is a struct pmt_ttag_read), returns number copied
+#define IOCTL_GET_TTAG_DATA _IOR(PMT_IOCTL_NUM, 9, unsigned long*)
+
+/// Buffer for IOCTL_GET_TTAG_DATA
+struct pmt_ttag_read
+{
+  /// Buffer for up to num time tags
+  struct pmt_ttag_data *buf;
+  unsigned long num;
+};
+
+/** \brief Integration data ring definitions
+ * The driver stores integration records in a ring of PMT_RING_LEN struct pmt_integ_data, preceded by a struct
+ * pmt_ring_hdr, which programmes can map (shared) into their address space with mmap on the character device. The
+ * header occupies the first PMT_RING_HDR_SIZE bytes of the mapping and the records follow it.
+ *
+ * Both indices count records since the driver was loaded (record i is in slot i % PMT_RING_LEN). They are 32 bits wide
+ * and wrap around, so the number of unread records is (__u32)(prod_idx - cons_idx). The driver fills a slot and then
+ * advances prod_idx; a programme reads the records from cons_idx up to prod_idx and then advances cons_idx. Only the
+ * driver writes prod_idx and num_lost and only the reading programme writes cons_idx (the driver also advances it
+ * when records are read with IOCTL_GET_INTEG_DATA, so a programme should use one method or the other). The driver
+ * treats a cons_idx outside [prod_idx - ring length, prod_idx] as the nearest end of that range. Records produced
+ * while the ring is full are discarded and counted in num_lost.
+ *
+ * The header only has fixed-width fields, with the 64-bit field explicitly aligned, so that 32-bit programmes see the
+ * same layout as a 64-bit kernel.
+ *
+ * poll() reports the device readable (POLLIN) once at least the number of records set with IOCTL_SET_RING_THRESH
+ * (1 by default) is unread, or when any record is unread and no integration is in progress.
+ *
+ * In time-tag mode (PMT_MODE_TTAG) photon arrival times are stored in a second ring of PMT_TTAG_RING_LEN struct
+ * pmt_ttag_data with the same kind of header, mapped at offset PMT_TTAG_RING_OFFSET. Its header also describes the
+ * time-tag run: run_start_s/ns and then run_num are set when a run starts, run_elapsed_ms advances as the run
+ * progresses (all photons that arrived before run_start + run_elapsed_ms are in the ring) and run_ended is set when
+ * it stops. poll() uses the threshold set with IOCTL_SET_TTAG_THRESH for this ring.
+ * \{ */
+/// Number of records in the ring (a power of 2, so that the indices may wrap)
+#define PMT_RING_LEN        8192
+/// Size of the ring header in the mapping
+#define PMT_RING_HDR_SIZE   4096
+/// Total size of the mapping (a whole number of 4 kB pages)
+#define PMT_RING_SIZE       ((PMT_RING_HDR_SIZE + PMT_RING_LEN*sizeof(struct pmt_integ_data) + 4095) & ~4095UL)
+
+struct pmt_ring_hdr
+{
+  /// Index of the next record the driver will write
+  __u32 prod_idx;
+  /// Number of records discarded because the ring was full (reset when an integration starts)
+  __u32 num_lost;
+  /// Time tag ring only: universal time at which the run started
+  __u64 run_start_s __attribute__((aligned(8)));
+  __u32 run_start_ns;
+  /// Time tag ring only: number of the current/last time-tag run (incremented once the run's start time is set)
+  __u32 run_num;
+  /// Time tag ring only: milliseconds since the run started up to which all time tags are in the ring
+  __u32 run_elapsed_ms;
+  /// Time tag ring only: set once the run has ended
+  __u32 run_ended;
+  /// Index of the next record to be read - kept on its own cache line, because it is written by the reader
+  __u32 cons_idx __attribute__((aligned(64)));
+};
+
+/// Number of time tags in the time tag ring (a power of 2; about 2 s at 1 million photons per second)
+#define PMT_TTAG_RING_LEN     2097152
+/// Offset of the time tag ring in the mapping
+#define PMT_TTAG_RING_OFFSET  PMT_RING_SIZE
+/// Size of the time tag ring mapping (a whole number of 4 kB pages)
+#define PMT_TTAG_RING_SIZE    ((PMT_RING_HDR_SIZE + PMT_TTAG_RING_LEN*sizeof(struct pmt_ttag_data) + 4095) & ~4095UL)
+/** \} */
+
+/** \brief Time-tagging front end interface
+ * A module that can time-tag photon arrivals registers itself with pmt_register_ttag_source (giving its time
+ * resolution in nanoseconds), which adds PMT_MODE_TTAG to the driver's modes. While a time-tag run is in progress it
+ * reports every photon with pmt_ttag_add, in order of arrival and within a millisecond of the arrival. Photons
+ * reported outside a run are ignored.
+ * \{ */
+char pmt_register_ttag_source(unsigned long time_res_ns);
+void pmt_unregister_ttag_source(void);
+void pmt_ttag_add(unsigned long time_s, unsigned long time_ns);
+/** \} */
+
 #endif
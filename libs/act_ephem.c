@@ -0,0 +1,269 @@
+/*!
+ * \file act_ephem.c
+ * \brief Precomputed ephemeris tables (Sun, Moon, sidereal time, twilight) covering a night.
+ *
+ * The tables are built once from the batch routines in act_positastro, after which all lookups are constant-time
+ * interpolations. This is meant for programmes that need the positions of the Sun and Moon every time they receive the
+ * time (act_environ, act_timecoord_disp) or for many times at once (act_sched).
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include "act_site.h"
+#include "act_timecoord.h"
+#include "act_positastro.h"
+#include "act_ephem.h"
+
+/// Interval between table entries (days)
+#define STEP_D          (ACT_EPHEM_STEP_MIN / 1440.0)
+/// Rate of change of sidereal time (hours per day), from the linear terms of the GMST polynomial used by calc_SidT
+#define SIDT_RATE_H_D   (24.0 * 1.00273781191135448 + 307.47710227 / 36525.0 / 3600.0)
+/// Number of bisection steps used to find twilight times (resolution better than 1 ms)
+#define TWIL_ITER       30
+
+/// Altitude of the centre of the Sun (degrees) for each twilight index
+static const double twil_alt_deg[ACT_EPHEM_NUM_TWIL] = { -0.833, -6.0, -12.0, -18.0 };
+
+/** \brief Calculates the cubic interpolation weights for the four table entries around jd.
+ * \param ephem Ephemeris table.
+ * \param jd Geocentric Julian date.
+ * \param w Where the four weights will be stored.
+ * \return Index of the first of the four entries.
+ *
+ * Times outside the period of the table are extrapolated from the first or last interval.
+ */
+static int interp_weights(struct act_ephem *ephem, double jd, double w[4])
+{
+  double x = (jd - ephem->start_jd) / STEP_D;
+  int k = (int)floor(x);
+  if (k < 0)
+    k = 0;
+  else if (k > ephem->num_nodes-4)
+    k = ephem->num_nodes-4;
+  double t = x - k;
+  w[0] = -t*(t-1.0)*(t-2.0)/6.0;
+  w[1] = (t+1.0)*(t-1.0)*(t-2.0)/2.0;
+  w[2] = -(t+1.0)*t*(t-2.0)/2.0;
+  w[3] = (t+1.0)*t*(t-1.0)/6.0;
+  return k;
+}
+
+static void interp_vec(struct act_ephem *ephem, const double *table, double jd, double vec[3])
+{
+  double w[4];
+  int k = interp_weights(ephem, jd, w), i;
+  for (i=0; i<3; i++)
+    vec[i] = w[0]*table[3*k+i] + w[1]*table[3*(k+1)+i] + w[2]*table[3*(k+2)+i] + w[3]*table[3*(k+3)+i];
+}
+
+static void vec_to_radec(const double vec[3], double *ra_rad, double *dec_rad)
+{
+  double r = sqrt(vec[0]*vec[0] + vec[1]*vec[1] + vec[2]*vec[2]);
+  double tmp_ra = atan2(vec[1], vec[0]);
+  if (ra_rad != NULL)
+    *ra_rad = tmp_ra < 0.0 ? tmp_ra + TWOPI : tmp_ra;
+  if (dec_rad != NULL)
+    *dec_rad = asin(vec[2] / r);
+}
+
+static void radec_to_vec(double ra_rad, double dec_rad, double *vec)
+{
+  vec[0] = cos(dec_rad)*cos(ra_rad);
+  vec[1] = cos(dec_rad)*sin(ra_rad);
+  vec[2] = sin(dec_rad);
+}
+
+/// Finds the time in [jd1, jd2] at which the altitude of the Sun is alt_rad (the altitude must cross it in the interval)
+static double find_sun_alt(struct act_ephem *ephem, double jd1, double jd2, double alt_rad)
+{
+  char rising = act_ephem_sun_alt(ephem, jd1) < alt_rad;
+  int i;
+  for (i=0; i<TWIL_ITER; i++)
+  {
+    double jd = (jd1 + jd2) / 2.0;
+    if ((act_ephem_sun_alt(ephem, jd) < alt_rad) == rising)
+      jd1 = jd;
+    else
+      jd2 = jd;
+  }
+  return (jd1 + jd2) / 2.0;
+}
+
+/** \brief Builds ephemeris tables covering num_hours hours from start_jd.
+ * \param start_jd Geocentric Julian date at the start of the period.
+ * \param num_hours Length of the period (hours).
+ * \return New ephemeris tables (free with act_ephem_free), or NULL on error.
+ */
+struct act_ephem *act_ephem_new(double start_jd, double num_hours)
+{
+  if (num_hours <= 0.0)
+    return NULL;
+  struct act_ephem *ephem = malloc(sizeof(struct act_ephem));
+  if (ephem == NULL)
+    return NULL;
+  int num_steps = (int)ceil(num_hours * 60.0 / ACT_EPHEM_STEP_MIN);
+  int num_nodes = num_steps + 3;
+  ephem->start_jd = start_jd;
+  ephem->end_jd = start_jd + num_steps*STEP_D;
+  ephem->start_lst_h = calc_SidT(start_jd);
+  ephem->num_nodes = num_nodes;
+  ephem->sun_xyz = malloc(3*num_nodes*sizeof(double));
+  ephem->moon_xyz = malloc(3*num_nodes*sizeof(double));
+  ephem->hjd_xyz = malloc(3*num_nodes*sizeof(double));
+  ephem->moon_illum = malloc(num_nodes*sizeof(double));
+  double *work = malloc(7*num_nodes*sizeof(double));
+  if ((ephem->sun_xyz == NULL) || (ephem->moon_xyz == NULL) || (ephem->hjd_xyz == NULL) || (ephem->moon_illum == NULL) || (work == NULL))
+  {
+    free(work);
+    act_ephem_free(ephem);
+    return NULL;
+  }
+  double *jd = work, *julcen = &work[num_nodes], *ra = &work[2*num_nodes], *dec = &work[3*num_nodes];
+  double *axis_ra = &work[4*num_nodes], *axis_dec = &work[5*num_nodes], *hjd = &work[6*num_nodes];
+
+  int i, j;
+  for (i=0; i<num_nodes; i++)
+  {
+    jd[i] = start_jd + (i-1)*STEP_D;
+    julcen[i] = (jd[i] - 2451545.0) / 36525.0;
+  }
+  calc_sun_batch(jd, NULL, NULL, ra, dec, NULL, num_nodes);
+  for (i=0; i<num_nodes; i++)
+    radec_to_vec(ra[i], dec[i], &ephem->sun_xyz[3*i]);
+  calc_moon_pos_batch(julcen, ra, dec, num_nodes);
+  for (i=0; i<num_nodes; i++)
+  {
+    radec_to_vec(ra[i], dec[i], &ephem->moon_xyz[3*i]);
+    double *sun = &ephem->sun_xyz[3*i], *moon = &ephem->moon_xyz[3*i];
+    ephem->moon_illum[i] = (1.0 - (sun[0]*moon[0] + sun[1]*moon[1] + sun[2]*moon[2])) / 2.0;
+  }
+  // The HJD correction is linear in the unit vector of the target, so tabulate it for targets along the three axes
+  for (j=0; j<3; j++)
+  {
+    for (i=0; i<num_nodes; i++)
+    {
+      axis_ra[i] = j == 1 ? ONEPI/2.0 : 0.0;
+      axis_dec[i] = j == 2 ? ONEPI/2.0 : 0.0;
+    }
+    calc_sun_batch(jd, axis_ra, axis_dec, ra, dec, hjd, num_nodes);
+    for (i=0; i<num_nodes; i++)
+      ephem->hjd_xyz[3*i+j] = hjd[i] - jd[i];
+  }
+
+  for (j=0; j<ACT_EPHEM_NUM_TWIL; j++)
+  {
+    double alt_rad = convert_DEG_RAD(twil_alt_deg[j]);
+    ephem->dusk_jd[j] = ephem->dawn_jd[j] = 0.0;
+    double prev_alt = act_ephem_sun_alt(ephem, start_jd);
+    for (i=1; i<=num_steps; i++)
+    {
+      double cur_jd = start_jd + i*STEP_D;
+      double cur_alt = act_ephem_sun_alt(ephem, cur_jd);
+      if ((ephem->dusk_jd[j] == 0.0) && (prev_alt >= alt_rad) && (cur_alt < alt_rad))
+        ephem->dusk_jd[j] = find_sun_alt(ephem, cur_jd - STEP_D, cur_jd, alt_rad);
+      else if ((ephem->dawn_jd[j] == 0.0) && (prev_alt < alt_rad) && (cur_alt >= alt_rad))
+        ephem->dawn_jd[j] = find_sun_alt(ephem, cur_jd - STEP_D, cur_jd, alt_rad);
+      prev_alt = cur_alt;
+    }
+  }
+  free(work);
+  return ephem;
+}
+
+/** \brief Builds ephemeris tables for the night containing jd, from local noon to the following local noon.
+ * \param jd Geocentric Julian date.
+ * \return New ephemeris tables (free with act_ephem_free), or NULL on error.
+ */
+struct act_ephem *act_ephem_new_night(double jd)
+{
+  double start_jd = floor(jd + TIMEZONE/24.0) - TIMEZONE/24.0;
+  return act_ephem_new(start_jd, 24.0);
+}
+
+void act_ephem_free(struct act_ephem *ephem)
+{
+  if (ephem == NULL)
+    return;
+  free(ephem->sun_xyz);
+  free(ephem->moon_xyz);
+  free(ephem->hjd_xyz);
+  free(ephem->moon_illum);
+  free(ephem);
+}
+
+/** \brief Checks whether jd falls within the period covered by the tables.
+ * \return 1 if it does, otherwise 0 (also if ephem is NULL).
+ */
+char act_ephem_covers(struct act_ephem *ephem, double jd)
+{
+  if (ephem == NULL)
+    return 0;
+  return (jd >= ephem->start_jd) && (jd <= ephem->end_jd);
+}
+
+/** \brief Local mean sidereal time (as calc_SidT).
+ * \return Sidereal time in fractional hours, in [0, 24).
+ */
+double act_ephem_sidt(struct act_ephem *ephem, double jd)
+{
+  double lst_h = fmod(ephem->start_lst_h + (jd - ephem->start_jd)*SIDT_RATE_H_D, 24.0);
+  return lst_h < 0.0 ? lst_h + 24.0 : lst_h;
+}
+
+/** \brief Position of the Sun (as calc_sun).
+ * \param ra_rad Where right ascension will be stored (radians), may be NULL.
+ * \param dec_rad Where declination will be stored (radians), may be NULL.
+ */
+void act_ephem_sun(struct act_ephem *ephem, double jd, double *ra_rad, double *dec_rad)
+{
+  double vec[3];
+  interp_vec(ephem, ephem->sun_xyz, jd, vec);
+  vec_to_radec(vec, ra_rad, dec_rad);
+}
+
+/** \brief Position of the Moon (as calc_moon_pos).
+ * \param ra_rad Where right ascension will be stored (radians), may be NULL.
+ * \param dec_rad Where declination will be stored (radians), may be NULL.
+ */
+void act_ephem_moon(struct act_ephem *ephem, double jd, double *ra_rad, double *dec_rad)
+{
+  double vec[3];
+  interp_vec(ephem, ephem->moon_xyz, jd, vec);
+  vec_to_radec(vec, ra_rad, dec_rad);
+}
+
+/** \brief Illuminated fraction of the Moon (as calc_moon_illum).
+ * \return Illuminated fraction in [0, 1].
+ */
+double act_ephem_moon_illum(struct act_ephem *ephem, double jd)
+{
+  double w[4];
+  int k = interp_weights(ephem, jd, w);
+  double illum = w[0]*ephem->moon_illum[k] + w[1]*ephem->moon_illum[k+1] + w[2]*ephem->moon_illum[k+2] + w[3]*ephem->moon_illum[k+3];
+  return illum < 0.0 ? 0.0 : (illum > 1.0 ? 1.0 : illum);
+}
+
+/** \brief Altitude of the Sun at the site.
+ * \return Altitude (radians), without refraction.
+ */
+double act_ephem_sun_alt(struct act_ephem *ephem, double jd)
+{
+  double ra_rad, dec_rad, ha_rad, alt_rad, azm_rad;
+  act_ephem_sun(ephem, jd, &ra_rad, &dec_rad);
+  ha_rad = convert_H_RAD(act_ephem_sidt(ephem, jd)) - ra_rad;
+  convert_EQUI_ALTAZ_batch(&ha_rad, &dec_rad, &alt_rad, &azm_rad, 1);
+  return alt_rad;
+}
+
+/** \brief Heliocentric Julian date for the given target (as calc_sun).
+ * \param targ_ra_rad Right ascension of the target (radians).
+ * \param targ_dec_rad Declination of the target (radians).
+ * \return Heliocentric Julian date.
+ */
+double act_ephem_hjd(struct act_ephem *ephem, double jd, double targ_ra_rad, double targ_dec_rad)
+{
+  double vec[3], targ[3];
+  interp_vec(ephem, ephem->hjd_xyz, jd, vec);
+  radec_to_vec(targ_ra_rad, targ_dec_rad, targ);
+  return jd + vec[0]*targ[0] + vec[1]*targ[1] + vec[2]*targ[2];
+}
@@ -0,0 +1,61 @@
+/*!
+ * \file act_ephem.h
+ * \brief Definitions for precomputed ephemeris tables (Sun, Moon, sidereal time, twilight) covering a night.
+ */
+
+#ifndef ACT_EPHEM_H
+#define ACT_EPHEM_H
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/// Interval between table entries (minutes)
+#define ACT_EPHEM_STEP_MIN      15
+/** \name Twilight indices
+ * \brief Indices into act_ephem.dusk_jd/dawn_jd for sunset/sunrise and civil, nautical and astronomical twilight.
+ * \{
+ */
+#define ACT_EPHEM_TWIL_SET      0
+#define ACT_EPHEM_TWIL_CIVIL    1
+#define ACT_EPHEM_TWIL_NAUT     2
+#define ACT_EPHEM_TWIL_ASTRO    3
+#define ACT_EPHEM_NUM_TWIL      4
+/** \} */
+
+/** \brief Sun and Moon positions tabulated over a period, from the closed-form routines in act_positastro.
+ *
+ * The positions are stored as unit vectors so that they can be interpolated across the 0h/24h boundary. Lookups use
+ * cubic interpolation between the four nearest entries and take constant time; with entries every
+ * ACT_EPHEM_STEP_MIN minutes they agree with the closed-form routines to better than 0.1 arcsec (see
+ * libs/unit_tests/ephem_test.c). Sidereal time is linear over a night, so only its value at the start is stored.
+ */
+struct act_ephem
+{
+  //! Geocentric Julian date of the first entry that lookups may use, and of the end of the period
+  double start_jd, end_jd;
+  //! Local sidereal time at start_jd (hours)
+  double start_lst_h;
+  //! Number of entries, including one extra entry at each end for interpolation
+  int num_nodes;
+  //! Per entry (3 per entry for vectors): Sun and Moon unit vectors, HJD correction vector, Moon illuminated fraction
+  double *sun_xyz, *moon_xyz, *hjd_xyz, *moon_illum;
+  //! Times (GJD) at which the Sun sets/rises through each twilight altitude, 0 if it doesn't during the period
+  double dusk_jd[ACT_EPHEM_NUM_TWIL], dawn_jd[ACT_EPHEM_NUM_TWIL];
+};
+
+struct act_ephem *act_ephem_new(double start_jd, double num_hours);
+struct act_ephem *act_ephem_new_night(double jd);
+void act_ephem_free(struct act_ephem *ephem);
+char act_ephem_covers(struct act_ephem *ephem, double jd);
+double act_ephem_sidt(struct act_ephem *ephem, double jd);
+void act_ephem_sun(struct act_ephem *ephem, double jd, double *ra_rad, double *dec_rad);
+void act_ephem_moon(struct act_ephem *ephem, double jd, double *ra_rad, double *dec_rad);
+double act_ephem_moon_illum(struct act_ephem *ephem, double jd);
+double act_ephem_sun_alt(struct act_ephem *ephem, double jd);
+double act_ephem_hjd(struct act_ephem *ephem, double jd, double targ_ra_rad, double targ_dec_rad);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,194 @@
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "act_ipc.h"
+
+/** \brief Returns the length of the payload of a message of the given type.
+ * \param mtype Message type (one of MT_*).
+ * \return Payload length in bytes, 0 if the message type is invalid.
+ */
+unsigned short act_msg_payload_len(unsigned char mtype)
+{
+  switch (mtype)
+  {
+    case MT_QUIT:
+      return sizeof(struct act_msg_quit);
+    case MT_CAP:
+      return sizeof(struct act_msg_cap);
+    case MT_STAT:
+      return sizeof(struct act_msg_stat);
+    case MT_GUISOCK:
+      return sizeof(struct act_msg_guisock);
+    case MT_COORD:
+      return sizeof(struct act_msg_coord);
+    case MT_TIME:
+      return sizeof(struct act_msg_time);
+    case MT_ENVIRON:
+      return sizeof(struct act_msg_environ);
+    case MT_TARG_CAP:
+      return sizeof(struct act_msg_targcap);
+    case MT_TARG_SET:
+      return sizeof(struct act_msg_targset);
+    case MT_PMT_CAP:
+      return sizeof(struct act_msg_pmtcap);
+    case MT_DATA_PMT:
+      return sizeof(struct act_msg_datapmt);
+    case MT_CCD_CAP:
+      return sizeof(struct act_msg_ccdcap);
+    case MT_DATA_CCD:
+      return sizeof(struct act_msg_dataccd);
+    default:
+      return 0;
+  }
+}
+
+/** \brief Build the network frame for a message.
+ * \param msg Message.
+ * \param seq Sequence number of the frame on its connection.
+ * \param frame Buffer for the frame, at least ACT_MSG_MAX_FRAME bytes long.
+ * \return Length of the frame in bytes, 0 if the message type is invalid.
+ */
+unsigned int act_msg_frame(struct act_msg const *msg, unsigned int seq, char *frame)
+{
+  struct act_msg_hdr hdr;
+  hdr.magic = ACT_MSG_MAGIC;
+  hdr.mtype = msg->mtype;
+  hdr.len = act_msg_payload_len(msg->mtype);
+  hdr.seq = seq;
+  if (hdr.len == 0)
+    return 0;
+  memcpy(frame, &hdr, sizeof(hdr));
+  memcpy(frame+sizeof(hdr), &msg->content, hdr.len);
+  return sizeof(hdr) + hdr.len;
+}
+
+/** \brief Send a message over a socket as a single frame.
+ * \param sockfd Socket (blocking or non-blocking).
+ * \param msg Message.
+ * \param seq Sequence number for the frame, incremented if the frame was sent.
+ * \return Number of bytes sent, or -1 on error (with errno set).
+ *
+ * Waits until the whole frame has been sent, so that a partially sent frame cannot corrupt the stream.
+ */
+int act_msg_send(int sockfd, struct act_msg const *msg, unsigned int *seq)
+{
+  char frame[ACT_MSG_MAX_FRAME];
+  unsigned int frame_len = act_msg_frame(msg, *seq, frame), sent = 0;
+  if (frame_len == 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  while (sent < frame_len)
+  {
+    ssize_t ret = send(sockfd, frame+sent, frame_len-sent, MSG_NOSIGNAL);
+    if (ret >= 0)
+    {
+      sent += ret;
+      continue;
+    }
+    if (errno == EINTR)
+      continue;
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+    {
+      struct pollfd pfd = { .fd = sockfd, .events = POLLOUT };
+      if ((poll(&pfd, 1, -1) >= 0) || (errno == EINTR))
+        continue;
+    }
+    return -1;
+  }
+  (*seq)++;
+  return sent;
+}
+
+void act_msg_rx_init(struct act_msg_rx *rx)
+{
+  rx->start = rx->fill = 0;
+  rx->next_seq = 0;
+  rx->num_lost = rx->num_bad = 0;
+}
+
+/** \brief Returns where received bytes should be written, for reading from the connection by other means.
+ * \param rx Reassembly buffer.
+ * \param space Returns the number of bytes that may be written (more than ACT_MSG_MAX_FRAME, provided all complete
+ *              messages have been extracted with act_msg_rx_next).
+ * \return Pointer to the free space, pass the number of bytes written to act_msg_rx_commit.
+ */
+char *act_msg_rx_space(struct act_msg_rx *rx, unsigned int *space)
+{
+  if (rx->start > 0)
+  {
+    memmove(rx->buf, &rx->buf[rx->start], rx->fill - rx->start);
+    rx->fill -= rx->start;
+    rx->start = 0;
+  }
+  *space = ACT_MSG_RX_LEN - rx->fill;
+  return &rx->buf[rx->fill];
+}
+
+void act_msg_rx_commit(struct act_msg_rx *rx, unsigned int num_bytes)
+{
+  rx->fill += num_bytes;
+}
+
+/** \brief Read whatever is available on a socket into the reassembly buffer, without blocking.
+ * \return Number of bytes read, 0 if the connection was closed, -1 on error (errno is EAGAIN if nothing was available).
+ */
+int act_msg_rx_fill(struct act_msg_rx *rx, int sockfd)
+{
+  unsigned int space;
+  char *dest = act_msg_rx_space(rx, &space);
+  ssize_t ret = recv(sockfd, dest, space, MSG_DONTWAIT);
+  if (ret > 0)
+    act_msg_rx_commit(rx, ret);
+  return ret;
+}
+
+/** \brief Extract the next complete message from the reassembly buffer.
+ * \param rx Reassembly buffer.
+ * \param msg Returns the message (the unused part of the content union is zeroed).
+ * \return 1 if a message was returned, 0 if more bytes are needed.
+ *
+ * Invalid bytes (e.g. left by a peer using the old fixed-size messages) are skipped until the start of a valid frame
+ * is found, and counted in num_bad. Gaps in the sequence numbers are counted in num_lost.
+ */
+int act_msg_rx_next(struct act_msg_rx *rx, struct act_msg *msg)
+{
+  struct act_msg_hdr hdr;
+  while (rx->fill - rx->start >= sizeof(hdr))
+  {
+    char const *frame = &rx->buf[rx->start];
+    unsigned int avail = rx->fill - rx->start;
+    if ((unsigned char)frame[0] != ACT_MSG_MAGIC)
+    {
+      char const *magic = memchr(frame+1, ACT_MSG_MAGIC, avail-1);
+      unsigned int skip = magic != NULL ? (unsigned int)(magic - frame) : avail;
+      rx->start += skip;
+      rx->num_bad += skip;
+      continue;
+    }
+    memcpy(&hdr, frame, sizeof(hdr));
+    if ((hdr.len == 0) || (hdr.len != act_msg_payload_len(hdr.mtype)))
+    {
+      // not a frame header, the magic byte was part of something else
+      rx->start++;
+      rx->num_bad++;
+      continue;
+    }
+    if (avail < sizeof(hdr) + hdr.len)
+      break;
+    if ((int)(hdr.seq - rx->next_seq) > 0)
+      rx->num_lost += hdr.seq - rx->next_seq;
+    rx->next_seq = hdr.seq + 1;
+    memset(msg, 0, sizeof(struct act_msg));
+    msg->mtype = hdr.mtype;
+    memcpy(&msg->content, frame+sizeof(hdr), hdr.len);
+    rx->start += sizeof(hdr) + hdr.len;
+    if (rx->start == rx->fill)
+      rx->start = rx->fill = 0;
+    return 1;
+  }
+  return 0;
+}
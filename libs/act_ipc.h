@@ -55,6 +55,10 @@
 #define SERVICE_TIME      0x01  /**< Local time.*/
 #define SERVICE_COORD     0x02  /**< Telescope coordinates.*/
 #define SERVICE_ENVIRON   0x04  /**< Environment.*/
+#define NUM_SERVICES      3     /**< Number of services above (bit numbers 0 to NUM_SERVICES-1).*/
+#define SERVICE_IDX_TIME     0  /**< Bit number of SERVICE_TIME, for arrays indexed by service.*/
+#define SERVICE_IDX_COORD    1  /**< Bit number of SERVICE_COORD, for arrays indexed by service.*/
+#define SERVICE_IDX_ENVIRON  2  /**< Bit number of SERVICE_ENVIRON, for arrays indexed by service.*/
 /*! \} */
 
 /*! \name Control defininitions
@@ -255,6 +259,9 @@ struct act_msg_cap
   unsigned short dataccd_prov;
   //! Version string of sub-programme.
   char version_str[MAX_VERSION_LEN];
+  //! Maximum number of updates per second the client wants of each service it requires, indexed by the bit number of
+  //! the SERVICE_* flag (0 - no limit). Updates in between are coalesced by act_control.
+  float service_max_rate[NUM_SERVICES];
 };
 
 //! IPC message structure for client status
@@ -535,4 +542,57 @@ struct act_msg
   union act_msg_data content;
 };
 
+/*! \name Message framing
+ * \brief Wire format of IPC messages.
+ *
+ * On the network each message is sent as a frame: an act_msg_hdr followed by only the in-use member of the
+ * content union (act_msg_payload_len bytes), so a time or coordinate broadcast does not carry the size of the
+ * largest message type. Payloads are the message structures as they are laid out in memory, so as before all
+ * programmes must be built with compatible compilers (the header fields are in host byte order too).
+ *
+ * Frames are sent with act_msg_send (blocking sockets), or built with act_msg_frame and written by other means
+ * (e.g. a GIOChannel). Each connection needs its own struct act_msg_rx to reassemble frames from a byte stream,
+ * since a read may return part of a frame or several frames at once. A zero-filled act_msg_rx (e.g. a static one)
+ * is ready for use.
+ */
+/*! \{ */
+#define ACT_MSG_MAGIC      0xAC  /**< First byte of every frame, used to resynchronise a corrupted stream.*/
+#define ACT_MSG_MAX_FRAME  (sizeof(struct act_msg_hdr) + sizeof(union act_msg_data))
+#define ACT_MSG_RX_LEN     4096  /**< Size of the reassembly buffer, must be at least ACT_MSG_MAX_FRAME.*/
+
+//! Frame header
+struct act_msg_hdr
+{
+  //! Always ACT_MSG_MAGIC
+  unsigned char magic;
+  //! Message type (MT_*)
+  unsigned char mtype;
+  //! Length of the payload following the header in bytes
+  unsigned short len;
+  //! Sequence number of the frame on its connection (starting at 0), used to detect lost frames
+  unsigned int seq;
+};
+
+//! Reassembly buffer for frames received on a connection
+struct act_msg_rx
+{
+  //! Received bytes, of which buf[start] to buf[fill-1] have not been returned as messages yet
+  char buf[ACT_MSG_RX_LEN];
+  unsigned int start, fill;
+  //! Sequence number expected for the next frame
+  unsigned int next_seq;
+  //! Number of frames whose sequence numbers were skipped (lost), and number of bytes discarded as invalid
+  unsigned long num_lost, num_bad;
+};
+
+unsigned short act_msg_payload_len(unsigned char mtype);
+unsigned int act_msg_frame(struct act_msg const *msg, unsigned int seq, char *frame);
+int act_msg_send(int sockfd, struct act_msg const *msg, unsigned int *seq);
+void act_msg_rx_init(struct act_msg_rx *rx);
+char *act_msg_rx_space(struct act_msg_rx *rx, unsigned int *space);
+void act_msg_rx_commit(struct act_msg_rx *rx, unsigned int num_bytes);
+int act_msg_rx_fill(struct act_msg_rx *rx, int sockfd);
+int act_msg_rx_next(struct act_msg_rx *rx, struct act_msg *msg);
+/*! \} */
+
 #endif
@@ -1,32 +1,260 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
 #include "act_log.h"
 
 #define MAX_MSGBUF_LEN 256
+/// Number of messages that can wait for the writer thread (must be a power of 2)
+#define LOG_RING_LEN   1024
 
+/** \brief A message waiting in the ring.
+ *
+ * seq hands the entry over between threads: it is equal to the entry's position when the entry is free for that
+ * position, position+1 once a message has been stored, and position+LOG_RING_LEN once the writer is done with it.
+ */
+struct log_entry
+{
+  unsigned long seq;
+  int pri;
+  const char *progname, *funcname;
+  char msg[MAX_MSGBUF_LEN];
+};
+
+/// Messages with a less severe priority than this are neither formatted nor logged
+int act_log_cur_level = LOG_INFO;
+
+static struct log_entry G_ring[LOG_RING_LEN];
+//! Next position to be claimed by a logging thread, and next position to be written by the writer thread
+static unsigned long G_ring_head, G_ring_tail;
+static unsigned long G_num_dropped, G_num_dropped_reported;
+/// Number of act_log_full calls that may still claim a position or post the semaphore (act_log_close waits for them)
+static unsigned long G_num_in_flight;
+//! Posted once for every message stored and once when the writer must exit
+static sem_t G_ring_sem;
+static pthread_t G_writer_thr;
+static char G_writer_running, G_writer_exiting, G_handlers_set;
+/// Formatting buffer for act_log_msg, one per thread
+static __thread char G_msgbuf[MAX_MSGBUF_LEN];
+
+static void write_msg(int pri, const char *progname_msg, const char *funcname_msg, const char *log_msg)
+{
+  syslog(pri, "[%s %s] %s", progname_msg, funcname_msg, log_msg);
+}
+
+static void report_dropped(void)
+{
+  unsigned long num_dropped = __atomic_load_n(&G_num_dropped, __ATOMIC_RELAXED);
+  if (num_dropped != G_num_dropped_reported)
+  {
+    syslog(LOG_ERR, "[%s %s] %lu log messages dropped because the log ring was full", __progname, __FUNCTION__, num_dropped - G_num_dropped_reported);
+    G_num_dropped_reported = num_dropped;
+  }
+}
+
+/** \brief Writes the messages in the ring to syslog, in the order their positions were claimed.
+ */
+static void *writer_thread(void *arg)
+{
+  (void)arg;
+  while (1)
+  {
+    while ((sem_wait(&G_ring_sem) != 0) && (errno == EINTR));
+    unsigned long tail = G_ring_tail;
+    if (tail == __atomic_load_n(&G_ring_head, __ATOMIC_ACQUIRE))
+    {
+      if (__atomic_load_n(&G_writer_exiting, __ATOMIC_ACQUIRE))
+      {
+        report_dropped();
+        break;
+      }
+      continue;
+    }
+    // The position has been claimed, but the message may still be being copied in
+    struct log_entry *entry = &G_ring[tail & (LOG_RING_LEN-1)];
+    while (__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) != tail+1)
+      sched_yield();
+    write_msg(entry->pri, entry->progname, entry->funcname, entry->msg);
+    __atomic_store_n(&entry->seq, tail + LOG_RING_LEN, __ATOMIC_RELEASE);
+    G_ring_tail = tail + 1;
+    report_dropped();
+  }
+  return NULL;
+}
+
+/// A child process doesn't have the writer thread, so it logs directly (e.g. when exec fails after fork)
+static void atfork_child()
+{
+  G_writer_running = 0;
+}
+
+static int parse_level(const char *str)
+{
+  if (strcasecmp(str, "debug") == 0)
+    return LOG_DEBUG;
+  if ((strcasecmp(str, "normal") == 0) || (strcasecmp(str, "info") == 0))
+    return LOG_INFO;
+  if (strcasecmp(str, "error") == 0)
+    return LOG_ERR;
+  if (strcasecmp(str, "crit") == 0)
+    return LOG_CRIT;
+  char *endptr;
+  long pri = strtol(str, &endptr, 10);
+  if ((*endptr != '\0') || (pri < LOG_EMERG) || (pri > LOG_DEBUG))
+    return -1;
+  return (int)pri;
+}
+
+/** \brief Opens the connection to syslog and starts the writer thread.
+ *
+ * The run-time level is taken from the ACT_LOG_LEVEL environment variable (debug, normal, error, crit or a syslog
+ * priority) if it is set, otherwise it is LOG_INFO. If the writer thread can't be started, messages are written
+ * directly. act_log_close is registered with atexit, so the messages still in the ring are written on every normal
+ * exit, and the number of messages dropped because the ring was full is reported.
+ */
 void act_log_open()
 {
   openlog(__progname, LOG_CONS, LOG_LOCAL0);
+  const char *level_str = getenv("ACT_LOG_LEVEL");
+  if (level_str != NULL)
+  {
+    int pri = parse_level(level_str);
+    if (pri < 0)
+      syslog(LOG_ERR, "[%s %s] Invalid log level %s in ACT_LOG_LEVEL", __progname, __FUNCTION__, level_str);
+    else
+      act_log_set_level(pri);
+  }
+
+  if (G_writer_running)
+    return;
+  unsigned long i;
+  for (i=0; i<LOG_RING_LEN; i++)
+    G_ring[i].seq = i;
+  G_ring_head = G_ring_tail = 0;
+  G_writer_exiting = 0;
+  if (sem_init(&G_ring_sem, 0, 0) != 0)
+    return;
+  if (!G_handlers_set)
+  {
+    pthread_atfork(NULL, NULL, atfork_child);
+    // Programmes that exit without calling act_log_close (e.g. on an error during start-up) must not lose the waiting messages
+    atexit(act_log_close);
+    G_handlers_set = 1;
+  }
+  // Signals must still be delivered to the programme's own threads
+  sigset_t all_sigs, old_sigs;
+  sigfillset(&all_sigs);
+  pthread_sigmask(SIG_SETMASK, &all_sigs, &old_sigs);
+  int ret = pthread_create(&G_writer_thr, NULL, writer_thread, NULL);
+  pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
+  if (ret != 0)
+  {
+    sem_destroy(&G_ring_sem);
+    return;
+  }
+  __atomic_store_n(&G_writer_running, 1, __ATOMIC_RELEASE);
 }
 
+/** \brief Writes all waiting messages, stops the writer thread and closes the connection to syslog.
+ *
+ * Threads that log from now on write directly. Those that already found the writer running are waited for, so that
+ * their messages are in the ring before the writer is told to exit and none of them posts the semaphore after it has
+ * been destroyed.
+ */
 void act_log_close()
 {
+  if (G_writer_running)
+  {
+    __atomic_store_n(&G_writer_running, 0, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&G_num_in_flight, __ATOMIC_SEQ_CST) > 0)
+      sched_yield();
+    __atomic_store_n(&G_writer_exiting, 1, __ATOMIC_RELEASE);
+    sem_post(&G_ring_sem);
+    pthread_join(G_writer_thr, NULL);
+    sem_destroy(&G_ring_sem);
+  }
   closelog();
 }
 
+/** \brief Sets the least severe syslog priority that is logged (e.g. LOG_DEBUG to log everything).
+ */
+void act_log_set_level(int pri)
+{
+  act_log_cur_level = pri;
+}
+
+/** \brief Number of messages (less severe than LOG_ERR) that were dropped because the ring was full.
+ */
+unsigned long act_log_num_dropped()
+{
+  return __atomic_load_n(&G_num_dropped, __ATOMIC_RELAXED);
+}
+
+/** \brief Formats a log message into the calling thread's buffer.
+ * \return The buffer, which is only valid until the thread's next call.
+ */
 char *act_log_msg (const char *fmt, ...)
 {
   va_list ap;
-  char *msgbuf = malloc(MAX_MSGBUF_LEN*sizeof(char));
   va_start(ap, fmt);
-  vsnprintf(msgbuf, (MAX_MSGBUF_LEN-1)*sizeof(char), fmt, ap);
+  vsnprintf(G_msgbuf, MAX_MSGBUF_LEN, fmt, ap);
   va_end(ap);
-  return msgbuf;
+  return G_msgbuf;
 }
 
+/** \brief Queues a message for the writer thread, or writes it directly if the writer isn't running.
+ *
+ * Logging threads claim a position in the ring with a compare-and-swap, so they never wait for each other or the
+ * writer. If the ring is full, error and more severe messages are written directly (at the cost of a synchronous
+ * syslog() call, and out of order with the queued messages); less severe ones are dropped and counted, and the writer
+ * reports the number dropped.
+ */
 void act_log_full(int pri, const char *progname_msg, const char *funcname_msg, char *log_msg)
 {
-  syslog(pri, "[%s %s] %s", progname_msg, funcname_msg, log_msg);
-  free(log_msg);
+  // Announced before the writer is checked, so that act_log_close either sees this call or this call sees it
+  __atomic_add_fetch(&G_num_in_flight, 1, __ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&G_writer_running, __ATOMIC_SEQ_CST))
+  {
+    __atomic_sub_fetch(&G_num_in_flight, 1, __ATOMIC_RELEASE);
+    write_msg(pri, progname_msg, funcname_msg, log_msg);
+    return;
+  }
+  unsigned long pos = __atomic_load_n(&G_ring_head, __ATOMIC_RELAXED);
+  struct log_entry *entry;
+  while (1)
+  {
+    entry = &G_ring[pos & (LOG_RING_LEN-1)];
+    long diff = (long)(__atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE) - pos);
+    if (diff == 0)
+    {
+      if (__atomic_compare_exchange_n(&G_ring_head, &pos, pos+1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        break;
+    }
+    else if (diff < 0)
+    {
+      __atomic_sub_fetch(&G_num_in_flight, 1, __ATOMIC_RELEASE);
+      if (pri <= LOG_ERR)
+        write_msg(pri, progname_msg, funcname_msg, log_msg);
+      else
+        __atomic_add_fetch(&G_num_dropped, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    else
+      pos = __atomic_load_n(&G_ring_head, __ATOMIC_RELAXED);
+  }
+  entry->pri = pri;
+  entry->progname = progname_msg;
+  entry->funcname = funcname_msg;
+  size_t len = strnlen(log_msg, MAX_MSGBUF_LEN-1);
+  memcpy(entry->msg, log_msg, len);
+  entry->msg[len] = '\0';
+  __atomic_store_n(&entry->seq, pos+1, __ATOMIC_RELEASE);
+  sem_post(&G_ring_sem);
+  __atomic_sub_fetch(&G_num_in_flight, 1, __ATOMIC_RELEASE);
 }
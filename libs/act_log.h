@@ -1,16 +1,37 @@
+#ifndef ACT_LOG_H
+#define ACT_LOG_H
+
 #include <stdio.h>
 #include <syslog.h>
 
-#define act_log_debug(msg)  act_log_full(LOG_DEBUG, __progname, __FUNCTION__, msg)
-#define act_log_normal(msg) act_log_full(LOG_INFO, __progname, __FUNCTION__, msg)
-#define act_log_error(msg)  act_log_full(LOG_ERR, __progname, __FUNCTION__, msg)
-#define act_log_crit(msg)   act_log_full(LOG_CRIT, __progname, __FUNCTION__, msg)
-#define act_log_level(level,msg), act_log_full(lvel, __progname, __FUNCTION__, msg)
+/** \brief Least severe syslog priority that is compiled in.
+ *
+ * Calls at less severe priorities (e.g. act_log_debug when this is LOG_INFO) are removed by the compiler. Override with
+ * -DACT_LOG_COMPILED_LEVEL=LOG_INFO.
+ */
+#ifndef ACT_LOG_COMPILED_LEVEL
+#define ACT_LOG_COMPILED_LEVEL LOG_DEBUG
+#endif
+
+/// Whether messages with priority pri are logged - checked before the message is formatted
+#define act_log_enabled(pri) (((pri) <= ACT_LOG_COMPILED_LEVEL) && ((pri) <= act_log_cur_level))
+
+/* The message argument (normally act_log_msg(...)) is only evaluated if the priority is enabled, so disabled messages
+ * are never formatted. */
+#define act_log_level(pri,msg) (act_log_enabled(pri) ? act_log_full(pri, __progname, __FUNCTION__, msg) : (void)0)
+#define act_log_debug(msg)  act_log_level(LOG_DEBUG, msg)
+#define act_log_normal(msg) act_log_level(LOG_INFO, msg)
+#define act_log_error(msg)  act_log_level(LOG_ERR, msg)
+#define act_log_crit(msg)   act_log_level(LOG_CRIT, msg)
 
 extern const char *__progname;
+extern int act_log_cur_level;
 
 void act_log_open();
 void act_log_close();
+void act_log_set_level(int pri);
 char *act_log_msg(const char *fmt, ...);
 void act_log_full(int log_level, const char *progname_msg, const char *funcname_msg, char *log_msg);
+unsigned long act_log_num_dropped();
 
+#endif
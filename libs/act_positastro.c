@@ -240,9 +240,8 @@ void convert_EQUI_ALTAZ (struct hastruct *ha, struct decstruct *dec, struct alts
     return;
   double ha_rad = convert_H_RAD(convert_HMSMS_H_ha(ha));
   double dec_rad = convert_DEG_RAD(convert_DMS_D_dec(dec));
-  double lat_rad = convert_DEG_RAD(LATITUDE);
-  double alt_rad = asin(sin(lat_rad)*sin(dec_rad) + cos(lat_rad)*cos(dec_rad)*cos(ha_rad));
-  double azm_rad = atan2(sin(-ha_rad) * cos(dec_rad) / cos(alt_rad), (sin(dec_rad)-sin(lat_rad)*sin(alt_rad)) / cos(lat_rad) / cos(alt_rad));
+  double alt_rad, azm_rad;
+  convert_EQUI_ALTAZ_batch(&ha_rad, &dec_rad, &alt_rad, &azm_rad, 1);
   convert_D_DMS_alt(convert_RAD_DEG(alt_rad), alt);
   convert_D_DMS_azm(convert_RAD_DEG(azm_rad), azm);
   check_alt_azm_ranges(alt, azm);
@@ -264,9 +263,8 @@ void convert_ALTAZ_EQUI (struct altstruct *alt, struct azmstruct *azm, struct ha
     return;
   double alt_rad = convert_DEG_RAD(convert_DMS_D_alt(alt));
   double azm_rad = convert_DEG_RAD(convert_DMS_D_azm(azm));
-  double lat_rad = convert_DEG_RAD(LATITUDE);
-  double dec_rad = asin(sin(lat_rad)*sin(alt_rad) + cos(lat_rad)*cos(alt_rad)*cos(azm_rad));
-  double ha_rad = atan2(-sin(azm_rad)*cos(alt_rad)/cos(dec_rad), (sin(alt_rad) - sin(dec_rad)*sin(lat_rad))/cos(dec_rad)/cos(lat_rad));
+  double ha_rad, dec_rad;
+  convert_ALTAZ_EQUI_batch(&alt_rad, &azm_rad, &ha_rad, &dec_rad, 1);
   convert_H_HMSMS_ha(convert_RAD_H(ha_rad), ha);
   convert_D_DMS_dec(convert_RAD_DEG(dec_rad), dec);
   check_ra_ha_dec_ranges(NULL, ha, dec);
@@ -390,78 +388,36 @@ double calc_SidT (double jd)
  */
 void calc_sun (double jd, struct rastruct *targ_ra, struct decstruct *targ_dec, struct rastruct *sun_ra, struct decstruct *sun_dec, double *hjd)
 {
-  double n = jd - 2451545.0;
-  double L = convert_DEG_RAD(280.460 + 0.9856474*n);
-  double g = convert_DEG_RAD(357.528 + 0.9856003*n);
-  double lam = fmod(L + convert_DEG_RAD(1.915*sin(g) + 0.020*sin(2.0*g)), TWOPI);
-  lam += lam < 0.0 ? TWOPI : 0.0;
-  double eps = convert_DEG_RAD(23.439 - 0.0000004*n);
-  double ra_rad = atan(cos(eps)*tan(lam));
-  ra_rad += (floor(lam/(ONEPI/2.0)) - floor(ra_rad/(ONEPI/2.0))) * (ONEPI/2.0);
-  ra_rad = fmod(ra_rad, TWOPI);
-  ra_rad += ra_rad < 0.0 ? TWOPI : 0.0;
-  convert_H_HMSMS_ra(convert_RAD_H(ra_rad), sun_ra);
-  double dec_rad = asin(sin(eps)*sin(lam));
-  convert_D_DMS_dec(convert_RAD_DEG(dec_rad), sun_dec);
+  double sun_ra_rad, sun_dec_rad, targ_ra_rad, targ_dec_rad, tmp_hjd;
+  if ((targ_ra == NULL) || (targ_dec == NULL) || (hjd == NULL))
+    calc_sun_batch(&jd, NULL, NULL, &sun_ra_rad, &sun_dec_rad, NULL, 1);
+  else
+  {
+    targ_ra_rad = convert_H_RAD(convert_HMSMS_H_ra(targ_ra));
+    targ_dec_rad = convert_DEG_RAD(convert_DMS_D_dec(targ_dec));
+    calc_sun_batch(&jd, &targ_ra_rad, &targ_dec_rad, &sun_ra_rad, &sun_dec_rad, &tmp_hjd, 1);
+    *hjd = tmp_hjd;
+  }
+  convert_H_HMSMS_ra(convert_RAD_H(sun_ra_rad), sun_ra);
+  convert_D_DMS_dec(convert_RAD_DEG(sun_dec_rad), sun_dec);
   check_ra_ha_dec_ranges(sun_ra, NULL, sun_dec);
-  double r = 1.00014 - 0.01671*cos(g) - 0.00014*cos(2.0*g);
-  if ((targ_ra == NULL) || (targ_dec == NULL))
-    return;
-  ra_rad = convert_H_RAD(convert_HMSMS_H_ra(targ_ra));
-  dec_rad = convert_DEG_RAD(convert_DMS_D_dec(targ_dec));
-  double hc = -0.0057755*r*(cos(lam)*cos(ra_rad)*cos(dec_rad) + sin(lam)*(sin(eps)*sin(dec_rad) + cos(eps)*cos(dec_rad)*sin(ra_rad)) ) ;
-  if (hjd != NULL)
-    *hjd = jd + hc;
 }
 
 /** \brief Calculate RA and Dec of the Moon
  * \param moon_ra Structure where right ascension of Moon will be stored.
  * \param moon_dec Structure where declination of Moon will be stored.
- * \param JulCen Julian century in fractional centuries.
+ * \param JulCen Julian centuries since J2000.0 (i.e. (GJD - 2451545) / 36525).
  *
- * \todo Check results.
+ * Low-precision topocentric position (about 0.3 degrees) from page D22 of the Astronomical Almanac.
  *
  * Any NULL pointers will be ignored. The other values will be returned anyway.
  */
 void calc_moon_pos (double JulCen, struct rastruct *moon_ra, struct decstruct *moon_dec)
 {
-  double lam  =  218.32 + 481267.881*JulCen;
-  lam +=  6.29 * sin (convert_DEG_RAD(fmod(135.0 + 477198.87*JulCen,360.0)));
-  lam += -1.27 * sin (convert_DEG_RAD(fmod(259.3 - 413335.36*JulCen,360.0)));
-  lam +=  0.66 * sin (convert_DEG_RAD(fmod(235.7 + 890534.22*JulCen,360.0)));
-  lam +=  0.21 * sin (convert_DEG_RAD(fmod(269.9 + 954397.74*JulCen,360.0)));
-  lam += -0.19 * sin (convert_DEG_RAD(fmod(357.5 +  35999.05*JulCen,360.0)));
-  lam += -0.11 * sin (convert_DEG_RAD(fmod(186.5 + 966404.03*JulCen,360.0)));
-  lam = convert_DEG_RAD(fmod(lam,180.0));
-  
-  double bet = 5.13 * sin (convert_DEG_RAD(fmod(93.3 + 483202.02*JulCen,360.0)));
-  bet +=  0.28 * sin (convert_DEG_RAD(fmod(228.2 + 960400.89*JulCen,360.0)));
-  bet += -0.28 * sin (convert_DEG_RAD(fmod(318.3 +   6003.15*JulCen,360.0)));
-  bet += -0.17 * sin (convert_DEG_RAD(fmod(217.6 - 407332.21*JulCen,360.0)));
-  bet = convert_DEG_RAD(fmod(bet,360.0));
-
-  double l = cos(bet)*cos(lam);
-  double m = 0.9175*cos(bet)*sin(lam) - 0.3978*sin(bet);
-  double n = 0.3978*cos(bet)*sin(lam) + 0.9175*sin(bet);
-
-  double phi = convert_DEG_RAD(LATITUDE);
-  double theta = 0.0;
-  
-  double par =  0.9508 + 0.0518 * cos(convert_DEG_RAD(135.0 + 477198.87*JulCen))  +  0.0095 * cos(convert_DEG_RAD(259.3 - 413335.36*JulCen)) + 0.0078 * cos(convert_DEG_RAD(235.7 + 890534.22*JulCen))  +  0.0028 * cos(convert_DEG_RAD(269.9 + 954397.74*JulCen));
-
-  double rr = 1.0 / sin(convert_DEG_RAD(par));
-  double x = rr*l - cos (phi)*cos (theta);
-  double y = rr*m - cos (phi)*sin (theta);
-  double z = rr*n - sin (phi);
-  double r = sqrt (x*x + y*y + z*z);
-  convert_D_DMS_dec(convert_RAD_DEG(asin(z/r)), moon_dec);
-  
-  if (fabs (x) < 1.0e-5)
-    z = 1.0E+5;
-  else
-    z = y/x;
-  r = atan (z);
-  convert_H_HMSMS_ra(convert_RAD_H(r), moon_ra);
+  double ra_rad, dec_rad;
+  calc_moon_pos_batch(&JulCen, &ra_rad, &dec_rad, 1);
+  convert_D_DMS_dec(convert_RAD_DEG(dec_rad), moon_dec);
+  convert_H_HMSMS_ra(convert_RAD_H(ra_rad), moon_ra);
 }
 
 /** \brief Calculate the fraction of illumination of the Moon.
@@ -495,13 +451,9 @@ double calc_moon_illum (struct rastruct *moon_ra, struct decstruct *moon_dec, st
 double calc_airmass(struct altstruct *alt)
 {
   double alt_rad = convert_DEG_RAD(convert_DMS_D_alt(alt));
-  // Prevents division by 0
-  if (alt_rad < convert_DEG_RAD(HORIZON_ALT))
-    return 200.0;
-  if (alt_rad > ONEPI / 2.0)
-    alt_rad = ONEPI - alt_rad;
-
-  return 1.0 / cos((ONEPI/2.0) - alt_rad);
+  double airmass;
+  calc_airmass_batch(&alt_rad, &airmass, 1);
+  return airmass;
 }
 
 /** \brief Function to precess input coordinates at input epoch to output coordinates in output epoch.
@@ -520,17 +472,7 @@ void precess_coord(struct rastruct *ra_in, struct decstruct *dec_in, float epoch
     return;
   double ra_rad = convert_H_RAD(convert_HMSMS_H_ra(ra_in));
   double dec_rad = convert_DEG_RAD(convert_DMS_D_dec(dec_in));
-  double T, xa, za, ta, sacd, cacd, sd ;
-  
-  T = 0.01*(epoch_out - epoch_in) ;
-  xa = convert_DEG_RAD((0.6406161 + 0.0000839*T + 0.0000050*T*T)*T);
-  za = convert_DEG_RAD((0.6406161 + 0.0003041*T + 0.0000051*T*T)*T);
-  ta = convert_DEG_RAD((0.5567530 - 0.0001185*T - 0.0000116*T*T)*T);
-  sacd = sin(ra_rad+xa)*cos(dec_rad);
-  cacd = cos(ra_rad+xa)*cos(ta)*cos(dec_rad) - sin(ta)*sin(dec_rad);
-  sd = cos(ra_rad + xa)*sin(ta)*cos(dec_rad) + cos(ta)*sin(dec_rad);
-  dec_rad = asin(sd);
-  ra_rad = atan2(sacd, cacd) + za;
+  precess_coord_batch(&ra_rad, &dec_rad, epoch_in, epoch_out, &ra_rad, &dec_rad, 1);
   convert_H_HMSMS_ra(convert_RAD_H(ra_rad),ra_out);
   convert_D_DMS_dec(convert_RAD_DEG(dec_rad),dec_out);
 }
@@ -563,12 +505,7 @@ void corr_atm_refract_tel_sky_equat(struct hastruct *ha, struct decstruct *dec)
 {
   double ha_rad = convert_H_RAD(convert_HMSMS_H_ha(ha));
   double dec_rad = convert_DEG_RAD(convert_DMS_D_dec(dec));
-  double lat_rad = convert_DEG_RAD(LATITUDE);
-  double alt_rad = asin(sin(lat_rad)*sin(dec_rad) + cos(lat_rad)*cos(dec_rad)*cos(ha_rad));
-  double azm_rad = atan2(sin(-ha_rad) * cos(dec_rad) / cos(alt_rad), (sin(dec_rad)-sin(lat_rad)*sin(alt_rad)) / cos(lat_rad) / cos(alt_rad));
-  alt_rad -= convert_DEG_RAD(calc_atm_refract_deg(convert_RAD_DEG(alt_rad), AVG_PRESS_kPa, AVG_TEMP_degC));
-  dec_rad = asin(sin(lat_rad)*sin(alt_rad) + cos(lat_rad)*cos(alt_rad)*cos(azm_rad));
-  ha_rad = atan2(-sin(azm_rad)*cos(alt_rad)/cos(dec_rad), (sin(alt_rad) - sin(dec_rad)*sin(lat_rad))/cos(dec_rad)/cos(lat_rad));
+  corr_atm_refract_tel_sky_equat_batch(&ha_rad, &dec_rad, 1);
   convert_H_HMSMS_ha(convert_RAD_H(ha_rad), ha);
   convert_D_DMS_dec(convert_RAD_DEG(dec_rad), dec);
   check_ra_ha_dec_ranges(NULL, ha, dec);
@@ -578,12 +515,7 @@ void corr_atm_refract_sky_tel_equat(struct hastruct *ha, struct decstruct *dec)
 {
   double ha_rad = convert_H_RAD(convert_HMSMS_H_ha(ha));
   double dec_rad = convert_DEG_RAD(convert_DMS_D_dec(dec));
-  double lat_rad = convert_DEG_RAD(LATITUDE);
-  double alt_rad = asin(sin(lat_rad)*sin(dec_rad) + cos(lat_rad)*cos(dec_rad)*cos(ha_rad));
-  double azm_rad = atan2(sin(-ha_rad) * cos(dec_rad) / cos(alt_rad), (sin(dec_rad)-sin(lat_rad)*sin(alt_rad)) / cos(lat_rad) / cos(alt_rad));
-  alt_rad += convert_DEG_RAD(calc_atm_refract_deg(convert_RAD_DEG(alt_rad), AVG_PRESS_kPa, AVG_TEMP_degC));
-  dec_rad = asin(sin(lat_rad)*sin(alt_rad) + cos(lat_rad)*cos(alt_rad)*cos(azm_rad));
-  ha_rad = atan2(-sin(azm_rad)*cos(alt_rad)/cos(dec_rad), (sin(alt_rad) - sin(dec_rad)*sin(lat_rad))/cos(dec_rad)/cos(lat_rad));
+  corr_atm_refract_sky_tel_equat_batch(&ha_rad, &dec_rad, 1);
   convert_H_HMSMS_ha(convert_RAD_H(ha_rad), ha);
   convert_D_DMS_dec(convert_RAD_DEG(dec_rad), dec);
   check_ra_ha_dec_ranges(NULL, ha, dec);
@@ -602,9 +534,297 @@ void corr_atm_refract_sky_tel_equat(struct hastruct *ha, struct decstruct *dec)
  */
 double calc_atm_refract_deg(double alt_deg, double press_kpa, double temp_c)
 {
-  double coeff = alt_deg + 10.3/(alt_deg+5.11);
-  double R = (press_kpa/101.0) * (283.0/(273.0+temp_c)) * 1.02 / tan(coeff*ONEPI/180.0);
-  if (R < 0.0)
-    return 0.0;
-  return R / 60.0;
+  double alt_rad = convert_DEG_RAD(alt_deg), refract_rad;
+  calc_atm_refract_batch(&alt_rad, press_kpa, temp_c, &refract_rad, 1);
+  return convert_RAD_DEG(refract_rad);
+}
+
+/* Batch coordinate transforms.
+ *
+ * These work on contiguous arrays of doubles with all angles in radians, so that callers with many coordinates
+ * (visibility windows, catalogues, image pixels) don't have to go through the sexagesimal structures for each one. The
+ * loop bodies have no branches (only selects) and everything that doesn't depend on the coordinate is calculated once
+ * before the loop, so the compiler can vectorise them where the maths library allows. Each output element is only
+ * written after the corresponding input elements have been read, so outputs may be the same arrays as the inputs.
+ */
+
+static inline void equi_altaz(double ha_rad, double dec_rad, double sin_lat, double cos_lat, double *alt_rad, double *azm_rad)
+{
+  double sin_dec = sin(dec_rad), cos_dec = cos(dec_rad), cos_ha = cos(ha_rad);
+  *alt_rad = asin(sin_lat*sin_dec + cos_lat*cos_dec*cos_ha);
+  double tmp_azm = atan2(-sin(ha_rad)*cos_dec, cos_lat*sin_dec - sin_lat*cos_dec*cos_ha);
+  *azm_rad = tmp_azm < 0.0 ? tmp_azm + TWOPI : tmp_azm;
+}
+
+static inline void altaz_equi(double alt_rad, double azm_rad, double sin_lat, double cos_lat, double *ha_rad, double *dec_rad)
+{
+  double sin_alt = sin(alt_rad), cos_alt = cos(alt_rad), cos_azm = cos(azm_rad);
+  *dec_rad = asin(sin_lat*sin_alt + cos_lat*cos_alt*cos_azm);
+  *ha_rad = atan2(-sin(azm_rad)*cos_alt, cos_lat*sin_alt - sin_lat*cos_alt*cos_azm);
+}
+
+/// Refraction (radians) at the given altitude, scale is the pressure/temperature factor in arcminutes
+static inline double atm_refract(double alt_rad, double scale)
+{
+  double alt_deg = convert_RAD_DEG(alt_rad);
+  double R = scale / tan(convert_DEG_RAD(alt_deg + 10.3/(alt_deg+5.11)));
+  return R < 0.0 ? 0.0 : convert_DEG_RAD(R / 60.0);
+}
+
+static inline double atm_refract_scale(double press_kpa, double temp_c)
+{
+  return (press_kpa/101.0) * (283.0/(273.0+temp_c)) * 1.02;
+}
+
+/** \brief Calculates the rotation matrix that precesses equatorial coordinates between two epochs.
+ * \param epoch_in Input epoch (fractional years).
+ * \param epoch_out Output epoch (fractional years).
+ * \param mat Row-major 3x3 matrix, applied to the (x,y,z) unit vector of the input coordinates.
+ * \return (void)
+ *
+ * Uses the same precession angles as the original precess_coord (from the Linus 160 programme).
+ */
+void calc_precess_matrix(double epoch_in, double epoch_out, double mat[9])
+{
+  double T = 0.01*(epoch_out - epoch_in);
+  double xa = convert_DEG_RAD((0.6406161 + 0.0000839*T + 0.0000050*T*T)*T);
+  double za = convert_DEG_RAD((0.6406161 + 0.0003041*T + 0.0000051*T*T)*T);
+  double ta = convert_DEG_RAD((0.5567530 - 0.0001185*T - 0.0000116*T*T)*T);
+  double cx = cos(xa), sx = sin(xa), cz = cos(za), sz = sin(za), ct = cos(ta), st = sin(ta);
+  mat[0] = cx*ct*cz - sx*sz;
+  mat[1] = -sx*ct*cz - cx*sz;
+  mat[2] = -st*cz;
+  mat[3] = cx*ct*sz + sx*cz;
+  mat[4] = -sx*ct*sz + cx*cz;
+  mat[5] = -st*sz;
+  mat[6] = cx*st;
+  mat[7] = -sx*st;
+  mat[8] = ct;
+}
+
+/** \brief Precesses num coordinates from epoch_in to epoch_out.
+ * \param ra_in Input right ascensions (radians).
+ * \param dec_in Input declinations (radians).
+ * \param epoch_in Input epoch.
+ * \param epoch_out Output epoch.
+ * \param ra_out Where output right ascensions will be stored, in [0, 2pi).
+ * \param dec_out Where output declinations will be stored.
+ * \param num Number of coordinates.
+ * \return (void)
+ */
+void precess_coord_batch(const double *ra_in, const double *dec_in, double epoch_in, double epoch_out, double *ra_out, double *dec_out, int num)
+{
+  double mat[9];
+  int i;
+  calc_precess_matrix(epoch_in, epoch_out, mat);
+  for (i=0; i<num; i++)
+  {
+    double cos_dec = cos(dec_in[i]);
+    double x = cos_dec*cos(ra_in[i]), y = cos_dec*sin(ra_in[i]), z = sin(dec_in[i]);
+    double xp = mat[0]*x + mat[1]*y + mat[2]*z;
+    double yp = mat[3]*x + mat[4]*y + mat[5]*z;
+    double zp = mat[6]*x + mat[7]*y + mat[8]*z;
+    zp = zp > 1.0 ? 1.0 : (zp < -1.0 ? -1.0 : zp);
+    double tmp_ra = atan2(yp, xp);
+    ra_out[i] = tmp_ra < 0.0 ? tmp_ra + TWOPI : tmp_ra;
+    dec_out[i] = asin(zp);
+  }
+}
+
+/** \brief Converts num equatorial coordinates (hour-angle, declination) to horizontal coordinates at the site.
+ * \param ha Hour-angles (radians).
+ * \param dec Declinations (radians).
+ * \param alt Where altitudes will be stored.
+ * \param azm Where azimuths will be stored, in [0, 2pi).
+ * \param num Number of coordinates.
+ * \return (void)
+ */
+void convert_EQUI_ALTAZ_batch(const double *ha, const double *dec, double *alt, double *azm, int num)
+{
+  double sin_lat = sin(convert_DEG_RAD(LATITUDE)), cos_lat = cos(convert_DEG_RAD(LATITUDE));
+  int i;
+  for (i=0; i<num; i++)
+    equi_altaz(ha[i], dec[i], sin_lat, cos_lat, &alt[i], &azm[i]);
+}
+
+/** \brief Converts num horizontal coordinates (altitude, azimuth) at the site to equatorial coordinates.
+ * \param alt Altitudes (radians).
+ * \param azm Azimuths (radians).
+ * \param ha Where hour-angles will be stored, in (-pi, pi].
+ * \param dec Where declinations will be stored.
+ * \param num Number of coordinates.
+ * \return (void)
+ */
+void convert_ALTAZ_EQUI_batch(const double *alt, const double *azm, double *ha, double *dec, int num)
+{
+  double sin_lat = sin(convert_DEG_RAD(LATITUDE)), cos_lat = cos(convert_DEG_RAD(LATITUDE));
+  int i;
+  for (i=0; i<num; i++)
+    altaz_equi(alt[i], azm[i], sin_lat, cos_lat, &ha[i], &dec[i]);
+}
+
+/** \brief Calculates atmospheric refraction at num altitudes.
+ * \param alt Altitudes (radians).
+ * \param press_kpa Atmospheric pressure in kPa.
+ * \param temp_c Atmospheric temperature in degrees Celcius.
+ * \param refract Where refraction angles (radians) will be stored.
+ * \param num Number of altitudes.
+ * \return (void)
+ *
+ * See calc_atm_refract_deg.
+ */
+void calc_atm_refract_batch(const double *alt, double press_kpa, double temp_c, double *refract, int num)
+{
+  double scale = atm_refract_scale(press_kpa, temp_c);
+  int i;
+  for (i=0; i<num; i++)
+    refract[i] = atm_refract(alt[i], scale);
+}
+
+/** \brief Removes refraction from num observed equatorial coordinates (see corr_atm_refract_tel_sky_equat).
+ * \param ha Hour-angles (radians) - modified in-place.
+ * \param dec Declinations (radians) - modified in-place.
+ * \param num Number of coordinates.
+ * \return (void)
+ */
+void corr_atm_refract_tel_sky_equat_batch(double *ha, double *dec, int num)
+{
+  double sin_lat = sin(convert_DEG_RAD(LATITUDE)), cos_lat = cos(convert_DEG_RAD(LATITUDE));
+  double scale = atm_refract_scale(AVG_PRESS_kPa, AVG_TEMP_degC);
+  double alt_rad, azm_rad;
+  int i;
+  for (i=0; i<num; i++)
+  {
+    equi_altaz(ha[i], dec[i], sin_lat, cos_lat, &alt_rad, &azm_rad);
+    alt_rad -= atm_refract(alt_rad, scale);
+    altaz_equi(alt_rad, azm_rad, sin_lat, cos_lat, &ha[i], &dec[i]);
+  }
+}
+
+/** \brief Adds refraction to num equatorial coordinates (see corr_atm_refract_sky_tel_equat).
+ * \param ha Hour-angles (radians) - modified in-place.
+ * \param dec Declinations (radians) - modified in-place.
+ * \param num Number of coordinates.
+ * \return (void)
+ */
+void corr_atm_refract_sky_tel_equat_batch(double *ha, double *dec, int num)
+{
+  double sin_lat = sin(convert_DEG_RAD(LATITUDE)), cos_lat = cos(convert_DEG_RAD(LATITUDE));
+  double scale = atm_refract_scale(AVG_PRESS_kPa, AVG_TEMP_degC);
+  double alt_rad, azm_rad;
+  int i;
+  for (i=0; i<num; i++)
+  {
+    equi_altaz(ha[i], dec[i], sin_lat, cos_lat, &alt_rad, &azm_rad);
+    alt_rad += atm_refract(alt_rad, scale);
+    altaz_equi(alt_rad, azm_rad, sin_lat, cos_lat, &ha[i], &dec[i]);
+  }
+}
+
+/** \brief Calculates the airmass at num altitudes.
+ * \param alt Altitudes (radians).
+ * \param airmass Where airmasses will be stored.
+ * \param num Number of altitudes.
+ * \return (void)
+ *
+ * Altitudes below HORIZON_ALT give an airmass of 200 (see calc_airmass).
+ */
+void calc_airmass_batch(const double *alt, double *airmass, int num)
+{
+  double horizon_rad = convert_DEG_RAD(HORIZON_ALT);
+  int i;
+  for (i=0; i<num; i++)
+  {
+    double alt_rad = alt[i] > ONEPI/2.0 ? ONEPI - alt[i] : alt[i];
+    airmass[i] = alt[i] < horizon_rad ? 200.0 : 1.0 / sin(alt_rad);
+  }
+}
+
+/** \brief Calculates the position of the Sun and optionally heliocentric Julian dates at num times.
+ * \param jd Geocentric Julian dates.
+ * \param targ_ra Right ascensions of the targets (radians), may be NULL.
+ * \param targ_dec Declinations of the targets (radians), may be NULL.
+ * \param sun_ra Where right ascensions of the Sun will be stored, in [0, 2pi).
+ * \param sun_dec Where declinations of the Sun will be stored.
+ * \param hjd Where heliocentric Julian dates will be stored, may be NULL.
+ * \param num Number of times.
+ * \return (void)
+ *
+ * HJDs are only calculated if targ_ra, targ_dec and hjd are all given. See calc_sun.
+ */
+void calc_sun_batch(const double *jd, const double *targ_ra, const double *targ_dec, double *sun_ra, double *sun_dec, double *hjd, int num)
+{
+  char do_hjd = (targ_ra != NULL) && (targ_dec != NULL) && (hjd != NULL);
+  int i;
+  for (i=0; i<num; i++)
+  {
+    double tmp_jd = jd[i];
+    double n = tmp_jd - 2451545.0;
+    double L = convert_DEG_RAD(280.460 + 0.9856474*n);
+    double g = convert_DEG_RAD(357.528 + 0.9856003*n);
+    double lam = fmod(L + convert_DEG_RAD(1.915*sin(g) + 0.020*sin(2.0*g)), TWOPI);
+    lam += lam < 0.0 ? TWOPI : 0.0;
+    double eps = convert_DEG_RAD(23.439 - 0.0000004*n);
+    double ra_rad = atan(cos(eps)*tan(lam));
+    ra_rad += (floor(lam/(ONEPI/2.0)) - floor(ra_rad/(ONEPI/2.0))) * (ONEPI/2.0);
+    ra_rad = fmod(ra_rad, TWOPI);
+    sun_ra[i] = ra_rad < 0.0 ? ra_rad + TWOPI : ra_rad;
+    sun_dec[i] = asin(sin(eps)*sin(lam));
+    if (!do_hjd)
+      continue;
+    double r = 1.00014 - 0.01671*cos(g) - 0.00014*cos(2.0*g);
+    double cos_targ_dec = cos(targ_dec[i]);
+    hjd[i] = tmp_jd - 0.0057755*r*(cos(lam)*cos(targ_ra[i])*cos_targ_dec + sin(lam)*(sin(eps)*sin(targ_dec[i]) + cos(eps)*cos_targ_dec*sin(targ_ra[i])));
+  }
+}
+
+/** \brief Calculates the position of the Moon at num times.
+ * \param julcen Julian centuries since J2000.0.
+ * \param moon_ra Where right ascensions of the Moon will be stored, in [0, 2pi).
+ * \param moon_dec Where declinations of the Moon will be stored.
+ * \param num Number of times.
+ * \return (void)
+ *
+ * See calc_moon_pos.
+ */
+void calc_moon_pos_batch(const double *julcen, double *moon_ra, double *moon_dec, int num)
+{
+  double phi = convert_DEG_RAD(LATITUDE);
+  double cos_phi = cos(phi), sin_phi = sin(phi);
+  int i;
+  for (i=0; i<num; i++)
+  {
+    double JulCen = julcen[i];
+    double theta = convert_H_RAD(calc_SidT(JulCen*36525.0 + 2451545.0));
+    double lam  =  218.32 + 481267.881*JulCen;
+    lam +=  6.29 * sin (convert_DEG_RAD(fmod(135.0 + 477198.87*JulCen,360.0)));
+    lam += -1.27 * sin (convert_DEG_RAD(fmod(259.3 - 413335.36*JulCen,360.0)));
+    lam +=  0.66 * sin (convert_DEG_RAD(fmod(235.7 + 890534.22*JulCen,360.0)));
+    lam +=  0.21 * sin (convert_DEG_RAD(fmod(269.9 + 954397.74*JulCen,360.0)));
+    lam += -0.19 * sin (convert_DEG_RAD(fmod(357.5 +  35999.05*JulCen,360.0)));
+    lam += -0.11 * sin (convert_DEG_RAD(fmod(186.5 + 966404.03*JulCen,360.0)));
+    lam = convert_DEG_RAD(fmod(lam,360.0));
+
+    double bet = 5.13 * sin (convert_DEG_RAD(fmod(93.3 + 483202.02*JulCen,360.0)));
+    bet +=  0.28 * sin (convert_DEG_RAD(fmod(228.2 + 960400.89*JulCen,360.0)));
+    bet += -0.28 * sin (convert_DEG_RAD(fmod(318.3 +   6003.15*JulCen,360.0)));
+    bet += -0.17 * sin (convert_DEG_RAD(fmod(217.6 - 407332.21*JulCen,360.0)));
+    bet = convert_DEG_RAD(fmod(bet,360.0));
+
+    double l = cos(bet)*cos(lam);
+    double m = 0.9175*cos(bet)*sin(lam) - 0.3978*sin(bet);
+    double n = 0.3978*cos(bet)*sin(lam) + 0.9175*sin(bet);
+
+    double par =  0.9508 + 0.0518 * cos(convert_DEG_RAD(135.0 + 477198.87*JulCen))  +  0.0095 * cos(convert_DEG_RAD(259.3 - 413335.36*JulCen)) + 0.0078 * cos(convert_DEG_RAD(235.7 + 890534.22*JulCen))  +  0.0028 * cos(convert_DEG_RAD(269.9 + 954397.74*JulCen));
+
+    // Topocentric correction for the local sidereal time theta
+    double rr = 1.0 / sin(convert_DEG_RAD(par));
+    double x = rr*l - cos_phi*cos(theta);
+    double y = rr*m - cos_phi*sin(theta);
+    double z = rr*n - sin_phi;
+    double r = sqrt (x*x + y*y + z*z);
+    moon_dec[i] = asin(z/r);
+    double ra_rad = atan2(y, x);
+    moon_ra[i] = ra_rad < 0.0 ? ra_rad + TWOPI : ra_rad;
+  }
 }
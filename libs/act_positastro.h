@@ -39,6 +39,18 @@ void corr_atm_refract_tel_sky_equat(struct hastruct *ha, struct decstruct *dec);
 void corr_atm_refract_sky_tel_equat(struct hastruct *ha, struct decstruct *dec);
 double calc_atm_refract_deg(double alt_deg, double press_kpa, double temp_c);
 
+/* Batch versions of the above, on arrays of num doubles with angles in radians. The scalar functions are wrappers around these. */
+void calc_precess_matrix(double epoch_in, double epoch_out, double mat[9]);
+void precess_coord_batch(const double *ra_in, const double *dec_in, double epoch_in, double epoch_out, double *ra_out, double *dec_out, int num);
+void convert_EQUI_ALTAZ_batch(const double *ha, const double *dec, double *alt, double *azm, int num);
+void convert_ALTAZ_EQUI_batch(const double *alt, const double *azm, double *ha, double *dec, int num);
+void calc_atm_refract_batch(const double *alt, double press_kpa, double temp_c, double *refract, int num);
+void corr_atm_refract_tel_sky_equat_batch(double *ha, double *dec, int num);
+void corr_atm_refract_sky_tel_equat_batch(double *ha, double *dec, int num);
+void calc_airmass_batch(const double *alt, double *airmass, int num);
+void calc_sun_batch(const double *jd, const double *targ_ra, const double *targ_dec, double *sun_ra, double *sun_dec, double *hjd, int num);
+void calc_moon_pos_batch(const double *julcen, double *moon_ra, double *moon_dec, int num);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,339 @@
+/*!
+ * \file act_timing.c
+ * \brief Lightweight timing of the stages of a processing pipeline.
+ *
+ * Each thread records the spans it times into its own buffer, without locking. The buffers are collected when a frame
+ * (e.g. an image) ends: the spans are written to the timing file as the frame's timeline and their durations are added
+ * to per-stage windows, from which rolling percentiles are written every ACT_TIMING_STATS_FRAMES frames.
+ *
+ * Lines in the timing file are
+ *   frame <frame number> <duration (ms)>
+ *   span <frame number> <stage> <thread number> <start relative to the start of the frame written (ms)> <duration (ms)>
+ *   pct <stage> <number of durations> <50th percentile> <90th percentile> <99th percentile> <maximum (ms)>
+ * Spans may nest (e.g. a conversion triggered from within another stage). A span is labelled with the frame that was in
+ * progress when it ended, or 0 if none was.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "act_timing.h"
+
+/// Number of spans a thread can record before they are collected (must be a power of 2)
+#define SPAN_BUF_LEN   256
+
+struct timing_span
+{
+  unsigned long frame;
+  int stage, thread_num;
+  unsigned long long start_ns, end_ns;
+};
+
+/** \brief Spans recorded by one thread.
+ *
+ * head is only written by the owning thread and tail only by the collector, so neither needs a lock. When the thread
+ * exits, dead is set and the collector frees the buffer once it is empty.
+ */
+struct span_buf
+{
+  struct timing_span spans[SPAN_BUF_LEN];
+  unsigned long head, tail;
+  int thread_num;
+  char dead;
+  struct span_buf *next;
+};
+
+/// Most recent durations (ms) of a stage
+struct stage_window
+{
+  double dur_ms[ACT_TIMING_WINDOW];
+  unsigned int num, next;
+};
+
+char act_timing_on = 0;
+
+static __thread struct span_buf *G_thr_buf;
+static pthread_key_t G_buf_key;
+static pthread_once_t G_buf_key_once = PTHREAD_ONCE_INIT;
+//! Protects everything below, which is only used when buffers are registered and collected
+static pthread_mutex_t G_timing_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct span_buf *G_bufs;
+static int G_num_threads;
+static FILE *G_file;
+static const char *G_stage_names[ACT_TIMING_MAX_STAGES];
+static int G_num_stages;
+static struct stage_window G_windows[ACT_TIMING_MAX_STAGES];
+static unsigned long G_num_frames;
+static unsigned long long G_frame_start_ns;
+static struct timing_span *G_collected;
+static unsigned long G_collected_len;
+//! Frame in progress (0 if none), read by all recording threads
+static unsigned long G_cur_frame;
+static unsigned long G_num_dropped;
+
+static void buf_thread_exit(void *buf)
+{
+  __atomic_store_n(&((struct span_buf *)buf)->dead, 1, __ATOMIC_RELEASE);
+}
+
+static void buf_key_create()
+{
+  pthread_key_create(&G_buf_key, buf_thread_exit);
+}
+
+/** \brief Creates the calling thread's span buffer and registers it for collection.
+ */
+static struct span_buf *thread_buf_new()
+{
+  struct span_buf *buf = calloc(1, sizeof(struct span_buf));
+  if (buf == NULL)
+    return NULL;
+  pthread_mutex_lock(&G_timing_mutex);
+  buf->thread_num = G_num_threads++;
+  buf->next = G_bufs;
+  G_bufs = buf;
+  pthread_mutex_unlock(&G_timing_mutex);
+  pthread_setspecific(G_buf_key, buf);
+  G_thr_buf = buf;
+  return buf;
+}
+
+static void window_add(struct stage_window *window, double dur_ms)
+{
+  window->dur_ms[window->next] = dur_ms;
+  window->next = (window->next + 1) % ACT_TIMING_WINDOW;
+  if (window->num < ACT_TIMING_WINDOW)
+    window->num++;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static int cmp_span_start(const void *a, const void *b)
+{
+  unsigned long long sa = ((const struct timing_span *)a)->start_ns, sb = ((const struct timing_span *)b)->start_ns;
+  return (sa > sb) - (sa < sb);
+}
+
+/** \brief Moves the spans out of all threads' buffers and frees the buffers of threads that have exited.
+ * \return Number of spans collected into G_collected.
+ *
+ * Must be called with G_timing_mutex held.
+ */
+static unsigned long collect_spans()
+{
+  unsigned long num = 0;
+  struct span_buf **link = &G_bufs;
+  while (*link != NULL)
+  {
+    struct span_buf *buf = *link;
+    char dead = __atomic_load_n(&buf->dead, __ATOMIC_ACQUIRE);
+    unsigned long head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE), tail = buf->tail;
+    if (num + (head - tail) > G_collected_len)
+    {
+      unsigned long new_len = G_collected_len == 0 ? SPAN_BUF_LEN : G_collected_len;
+      while (new_len < num + (head - tail))
+        new_len *= 2;
+      struct timing_span *new_collected = realloc(G_collected, new_len*sizeof(struct timing_span));
+      if (new_collected == NULL)
+        return num;
+      G_collected = new_collected;
+      G_collected_len = new_len;
+    }
+    for (; tail != head; tail++)
+    {
+      G_collected[num] = buf->spans[tail & (SPAN_BUF_LEN-1)];
+      G_collected[num].thread_num = buf->thread_num;
+      num++;
+    }
+    __atomic_store_n(&buf->tail, tail, __ATOMIC_RELEASE);
+    if (dead)
+    {
+      *link = buf->next;
+      free(buf);
+    }
+    else
+      link = &buf->next;
+  }
+  return num;
+}
+
+/** \brief Writes the rolling percentiles of every stage that has been timed.
+ *
+ * Must be called with G_timing_mutex held.
+ */
+static void write_percentiles()
+{
+  double sorted[ACT_TIMING_WINDOW];
+  int i;
+  for (i=0; i<G_num_stages; i++)
+  {
+    struct stage_window *window = &G_windows[i];
+    if (window->num == 0)
+      continue;
+    memcpy(sorted, window->dur_ms, window->num*sizeof(double));
+    qsort(sorted, window->num, sizeof(double), cmp_double);
+    fprintf(G_file, "pct %s %u %.3f %.3f %.3f %.3f\n", G_stage_names[i], window->num, sorted[(window->num-1)*50/100], sorted[(window->num-1)*90/100], sorted[(window->num-1)*99/100], sorted[window->num-1]);
+  }
+  fflush(G_file);
+}
+
+/** \brief Collects all recorded spans, adds them to the per-stage windows and writes them as a frame's timeline.
+ * \param frame Frame number written with the timeline.
+ * \param end_ns End of the frame (ns, monotonic clock).
+ *
+ * Must be called with G_timing_mutex held.
+ */
+static void write_frame(unsigned long frame, unsigned long long end_ns)
+{
+  unsigned long i, num = collect_spans();
+  qsort(G_collected, num, sizeof(struct timing_span), cmp_span_start);
+  fprintf(G_file, "frame %lu %.3f\n", frame, (end_ns - G_frame_start_ns)/1e6);
+  for (i=0; i<num; i++)
+  {
+    struct timing_span *span = &G_collected[i];
+    double dur_ms = (span->end_ns - span->start_ns)/1e6;
+    window_add(&G_windows[span->stage], dur_ms);
+    fprintf(G_file, "span %lu %s %d %.3f %.3f\n", span->frame, G_stage_names[span->stage], span->thread_num, ((long long)(span->start_ns - G_frame_start_ns))/1e6, dur_ms);
+  }
+  if (G_num_frames % ACT_TIMING_STATS_FRAMES == 0)
+    write_percentiles();
+  else
+    fflush(G_file);
+}
+
+/** \brief Starts timing, writing timelines and percentiles to the given file.
+ * \param filename File to write to (truncated if it exists).
+ * \param stage_names Names of the stages, indexed by the stage numbers passed to act_timing_end/act_timing_record.
+ *                    Must remain valid until act_timing_close and must not contain whitespace.
+ * \param num_stages Number of stages (at most ACT_TIMING_MAX_STAGES).
+ * \return 0 on success, otherwise a negative error code.
+ */
+int act_timing_open(const char *filename, const char *const *stage_names, int num_stages)
+{
+  if ((num_stages <= 0) || (num_stages > ACT_TIMING_MAX_STAGES))
+    return -1;
+  pthread_once(&G_buf_key_once, buf_key_create);
+  pthread_mutex_lock(&G_timing_mutex);
+  if (G_file != NULL)
+  {
+    pthread_mutex_unlock(&G_timing_mutex);
+    return -2;
+  }
+  G_file = fopen(filename, "w");
+  if (G_file == NULL)
+  {
+    pthread_mutex_unlock(&G_timing_mutex);
+    return -3;
+  }
+  fprintf(G_file, "# frame <frame> <ms>\n# span <frame> <stage> <thread> <start ms> <ms>\n# pct <stage> <num> <p50 ms> <p90 ms> <p99 ms> <max ms>\n");
+  memcpy(G_stage_names, stage_names, num_stages*sizeof(const char *));
+  G_num_stages = num_stages;
+  memset(G_windows, 0, sizeof(G_windows));
+  G_num_frames = 0;
+  __atomic_store_n(&G_cur_frame, 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&G_timing_mutex);
+  act_timing_on = 1;
+  return 0;
+}
+
+/** \brief Stops timing, ends the current frame (if any), writes the final percentiles and closes the file.
+ *
+ * Thread buffers are kept so that threads which are still running can't be left with a stale buffer.
+ */
+void act_timing_close()
+{
+  act_timing_on = 0;
+  pthread_mutex_lock(&G_timing_mutex);
+  if (G_file == NULL)
+  {
+    pthread_mutex_unlock(&G_timing_mutex);
+    return;
+  }
+  if (__atomic_load_n(&G_cur_frame, __ATOMIC_RELAXED) != 0)
+    write_frame(G_num_frames, act_timing_now());
+  write_percentiles();
+  fclose(G_file);
+  G_file = NULL;
+  free(G_collected);
+  G_collected = NULL;
+  G_collected_len = 0;
+  __atomic_store_n(&G_cur_frame, 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&G_timing_mutex);
+}
+
+/** \brief Records a span in the calling thread's buffer (normally through act_timing_end).
+ * \param stage Stage number.
+ * \param start_ns Start of the span (ns, monotonic clock).
+ * \param end_ns End of the span.
+ *
+ * Never blocks, except when the thread records its first span. If the thread's buffer is full the span is dropped and
+ * counted.
+ */
+void act_timing_record(int stage, unsigned long long start_ns, unsigned long long end_ns)
+{
+  if ((stage < 0) || (stage >= G_num_stages))
+    return;
+  struct span_buf *buf = G_thr_buf;
+  if ((buf == NULL) && ((buf = thread_buf_new()) == NULL))
+    return;
+  unsigned long head = buf->head;
+  if (head - __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE) >= SPAN_BUF_LEN)
+  {
+    __atomic_add_fetch(&G_num_dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  struct timing_span *span = &buf->spans[head & (SPAN_BUF_LEN-1)];
+  span->frame = __atomic_load_n(&G_cur_frame, __ATOMIC_RELAXED);
+  span->stage = stage;
+  span->start_ns = start_ns;
+  span->end_ns = end_ns;
+  __atomic_store_n(&buf->head, head+1, __ATOMIC_RELEASE);
+}
+
+/** \brief Starts a new frame (e.g. when a new image is received); its timeline is written by act_timing_frame_end.
+ *
+ * If the previous frame was not ended, it is ended now.
+ */
+void act_timing_frame_begin()
+{
+  if (!act_timing_on)
+    return;
+  unsigned long long now = act_timing_now();
+  pthread_mutex_lock(&G_timing_mutex);
+  if (G_file != NULL)
+  {
+    if (__atomic_load_n(&G_cur_frame, __ATOMIC_RELAXED) != 0)
+      write_frame(G_num_frames, now);
+    G_frame_start_ns = now;
+    __atomic_store_n(&G_cur_frame, ++G_num_frames, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&G_timing_mutex);
+}
+
+/** \brief Ends the current frame and writes its timeline (and the rolling percentiles if they are due).
+ */
+void act_timing_frame_end()
+{
+  if (!act_timing_on)
+    return;
+  unsigned long long now = act_timing_now();
+  pthread_mutex_lock(&G_timing_mutex);
+  if ((G_file != NULL) && (__atomic_load_n(&G_cur_frame, __ATOMIC_RELAXED) != 0))
+  {
+    write_frame(G_num_frames, now);
+    __atomic_store_n(&G_cur_frame, 0, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&G_timing_mutex);
+}
+
+/** \brief Number of spans that were dropped because a thread's buffer was full.
+ */
+unsigned long act_timing_num_dropped()
+{
+  return __atomic_load_n(&G_num_dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,50 @@
+/*!
+ * \file act_timing.h
+ * \brief Definitions for lightweight timing of the stages of a processing pipeline.
+ */
+
+#ifndef ACT_TIMING_H
+#define ACT_TIMING_H
+
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/// Maximum number of distinct stages that can be timed
+#define ACT_TIMING_MAX_STAGES   32
+/// Number of most recent durations per stage from which the rolling percentiles are calculated
+#define ACT_TIMING_WINDOW       256
+/// Rolling percentiles are written to the timing file after every this many frames
+#define ACT_TIMING_STATS_FRAMES 50
+
+/// Whether timing is on - spans are neither timed nor recorded while this is 0
+extern char act_timing_on;
+
+/** \brief Reads the monotonic clock.
+ * \return Nanoseconds since an arbitrary starting point.
+ */
+static inline unsigned long long act_timing_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+/// Start time of a span, or 0 if timing is off (so that the clock is not read)
+#define act_timing_start() (act_timing_on ? act_timing_now() : 0ULL)
+/// Records a span of the given stage that started at start (from act_timing_start) and ends now
+#define act_timing_end(stage,start) ((act_timing_on && ((start) != 0)) ? act_timing_record(stage, start, act_timing_now()) : (void)0)
+
+int act_timing_open(const char *filename, const char *const *stage_names, int num_stages);
+void act_timing_close();
+void act_timing_record(int stage, unsigned long long start_ns, unsigned long long end_ns);
+void act_timing_frame_begin();
+void act_timing_frame_end();
+unsigned long act_timing_num_dropped();
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,169 @@
+/* Compile from local directory with:
+ * gcc -Wall -O2 -I../ ./ephem_test.c ../act_ephem.c ../act_positastro.c ../act_timecoord.c -lm -o ./ephem_test
+ *
+ * Checks the interpolated act_ephem tables against the closed-form routines in act_positastro (calc_sun,
+ * calc_moon_pos, calc_moon_illum, calc_SidT) at random times in a number of nights spread over a decade, prints the
+ * largest differences and the twilight times of the first night, and compares the time per lookup. Exits with status 1
+ * if any difference exceeds the stated bounds:
+ *   ./ephem_test [num_nights]
+ * (default 50).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "act_site.h"
+#include "act_positastro.h"
+#include "act_ephem.h"
+
+#define LOOKUPS_PER_NIGHT   2000
+/// Bounds on the differences: positions (arcsec), illuminated fraction, sidereal time (ms), HJD (ms)
+#define MAX_POS_ASEC        0.1
+#define MAX_ILLUM           1.0e-6
+#define MAX_SIDT_MS         1.0
+#define MAX_HJD_MS          1.0
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+static double rand_range(double min, double max)
+{
+  return min + (max - min) * (rand() / (double)RAND_MAX);
+}
+
+static double sep_asec(double ra1, double dec1, double ra2, double dec2)
+{
+  // Haversine formula, which (unlike acos) stays accurate for small separations
+  double sin_ddec = sin((dec1-dec2)/2.0), sin_dra = sin((ra1-ra2)/2.0);
+  return convert_RAD_DEG(2.0*asin(sqrt(sin_ddec*sin_ddec + cos(dec1)*cos(dec2)*sin_dra*sin_dra))) * 3600.0;
+}
+
+static void print_jd(const char *name, double jd)
+{
+  if (jd == 0.0)
+  {
+    printf("  %-22s  none\n", name);
+    return;
+  }
+  double loc_h = fmod(jd + 0.5 + TIMEZONE/24.0, 1.0) * 24.0;
+  printf("  %-22s  %.5f  (%02d:%02d local)\n", name, jd, (int)loc_h, (int)(fmod(loc_h, 1.0) * 60.0));
+}
+
+int main(int argc, char **argv)
+{
+  int num_nights = 50;
+  if (argc > 1)
+    num_nights = atoi(argv[1]);
+  if (num_nights <= 0)
+  {
+    fprintf(stderr, "Invalid number of nights.\n");
+    return 1;
+  }
+  srand(1);
+
+  double max_sun = 0.0, max_moon = 0.0, max_illum = 0.0, max_sidt = 0.0, max_hjd = 0.0, max_twil = 0.0;
+  double build_s = 0.0, closed_s = 0.0, table_s = 0.0;
+  volatile double sink = 0.0;
+  int night, i, j;
+  for (night=0; night<num_nights; night++)
+  {
+    double night_jd = 2457000.0 + rand_range(0.0, 3650.0);
+    double start = now_s();
+    struct act_ephem *ephem = act_ephem_new_night(night_jd);
+    build_s += now_s() - start;
+    if (ephem == NULL)
+    {
+      fprintf(stderr, "Failed to build ephemeris tables.\n");
+      return 1;
+    }
+    if (night == 0)
+    {
+      printf("Twilight, night of JD %.1f:\n", ephem->start_jd);
+      print_jd("sunset", ephem->dusk_jd[ACT_EPHEM_TWIL_SET]);
+      print_jd("end civil twilight", ephem->dusk_jd[ACT_EPHEM_TWIL_CIVIL]);
+      print_jd("end nautical twilight", ephem->dusk_jd[ACT_EPHEM_TWIL_NAUT]);
+      print_jd("end astro twilight", ephem->dusk_jd[ACT_EPHEM_TWIL_ASTRO]);
+      print_jd("start astro twilight", ephem->dawn_jd[ACT_EPHEM_TWIL_ASTRO]);
+      print_jd("start nautical twilight", ephem->dawn_jd[ACT_EPHEM_TWIL_NAUT]);
+      print_jd("start civil twilight", ephem->dawn_jd[ACT_EPHEM_TWIL_CIVIL]);
+      print_jd("sunrise", ephem->dawn_jd[ACT_EPHEM_TWIL_SET]);
+    }
+    // The Sun must be at the twilight altitude at each twilight time
+    double twil_alt_deg[ACT_EPHEM_NUM_TWIL] = { -0.833, -6.0, -12.0, -18.0 };
+    for (j=0; j<ACT_EPHEM_NUM_TWIL; j++)
+    {
+      if (ephem->dusk_jd[j] != 0.0)
+        max_twil = fmax(max_twil, fabs(convert_RAD_DEG(act_ephem_sun_alt(ephem, ephem->dusk_jd[j])) - twil_alt_deg[j]) * 3600.0);
+      if (ephem->dawn_jd[j] != 0.0)
+        max_twil = fmax(max_twil, fabs(convert_RAD_DEG(act_ephem_sun_alt(ephem, ephem->dawn_jd[j])) - twil_alt_deg[j]) * 3600.0);
+    }
+
+    for (i=0; i<LOOKUPS_PER_NIGHT; i++)
+    {
+      double jd = rand_range(ephem->start_jd, ephem->end_jd);
+      double targ_ra = rand_range(0.0, TWOPI), targ_dec = rand_range(-ONEPI/2.0, ONEPI/2.0);
+      double sun_ra, sun_dec, moon_ra, moon_dec, hjd;
+      calc_sun_batch(&jd, &targ_ra, &targ_dec, &sun_ra, &sun_dec, &hjd, 1);
+      double tab_ra, tab_dec;
+      act_ephem_sun(ephem, jd, &tab_ra, &tab_dec);
+      max_sun = fmax(max_sun, sep_asec(sun_ra, sun_dec, tab_ra, tab_dec));
+      max_hjd = fmax(max_hjd, fabs(hjd - act_ephem_hjd(ephem, jd, targ_ra, targ_dec)) * 86400000.0);
+      double julcen = (jd - 2451545.0) / 36525.0;
+      calc_moon_pos_batch(&julcen, &moon_ra, &moon_dec, 1);
+      act_ephem_moon(ephem, jd, &tab_ra, &tab_dec);
+      max_moon = fmax(max_moon, sep_asec(moon_ra, moon_dec, tab_ra, tab_dec));
+      double sidt_diff = fabs(calc_SidT(jd) - act_ephem_sidt(ephem, jd));
+      if (sidt_diff > 12.0)
+        sidt_diff = 24.0 - sidt_diff;
+      max_sidt = fmax(max_sidt, sidt_diff * 3600000.0);
+      // Same formula as calc_moon_illum, without the rounding to the structures
+      double illum = (1.0 - (sin(sun_dec)*sin(moon_dec) + cos(sun_dec)*cos(moon_dec)*cos(sun_ra-moon_ra))) / 2.0;
+      max_illum = fmax(max_illum, fabs(illum - act_ephem_moon_illum(ephem, jd)));
+    }
+
+    // Throughput: everything act_environ and act_timecoord_disp need for one time update
+    double jd = ephem->start_jd + 0.3, targ_ra = 1.0, targ_dec = -0.5;
+    start = now_s();
+    for (i=0; i<LOOKUPS_PER_NIGHT; i++)
+    {
+      double t = jd + i * 1.0e-5, julcen = (t - 2451545.0) / 36525.0, ra, dec, moon_ra, moon_dec, hjd;
+      calc_sun_batch(&t, &targ_ra, &targ_dec, &ra, &dec, &hjd, 1);
+      calc_moon_pos_batch(&julcen, &moon_ra, &moon_dec, 1);
+      sink += ra + dec + moon_ra + moon_dec + hjd + calc_SidT(t);
+    }
+    closed_s += now_s() - start;
+    start = now_s();
+    for (i=0; i<LOOKUPS_PER_NIGHT; i++)
+    {
+      double t = jd + i * 1.0e-5, ra, dec, moon_ra, moon_dec;
+      act_ephem_sun(ephem, t, &ra, &dec);
+      act_ephem_moon(ephem, t, &moon_ra, &moon_dec);
+      sink += ra + dec + moon_ra + moon_dec + act_ephem_hjd(ephem, t, targ_ra, targ_dec) + act_ephem_sidt(ephem, t) + act_ephem_moon_illum(ephem, t);
+    }
+    table_s += now_s() - start;
+    act_ephem_free(ephem);
+  }
+
+  printf("%d nights, %d random lookups per night\n", num_nights, LOOKUPS_PER_NIGHT);
+  printf("  Sun position     max diff %10.6f arcsec  (bound %g)\n", max_sun, MAX_POS_ASEC);
+  printf("  Moon position    max diff %10.6f arcsec  (bound %g)\n", max_moon, MAX_POS_ASEC);
+  printf("  Moon illum.      max diff %10.2e         (bound %g)\n", max_illum, MAX_ILLUM);
+  printf("  Sidereal time    max diff %10.6f ms      (bound %g)\n", max_sidt, MAX_SIDT_MS);
+  printf("  HJD              max diff %10.6f ms      (bound %g)\n", max_hjd, MAX_HJD_MS);
+  printf("  Twilight times   max Sun altitude error %.6f arcsec\n", max_twil);
+  printf("Table build %.1f us per night\n", build_s / num_nights * 1.0e6);
+  printf("Per time update: closed form %.0f ns, tables %.0f ns (%.1fx)\n", closed_s / num_nights / LOOKUPS_PER_NIGHT * 1.0e9, table_s / num_nights / LOOKUPS_PER_NIGHT * 1.0e9, closed_s / table_s);
+
+  if ((max_sun > MAX_POS_ASEC) || (max_moon > MAX_POS_ASEC) || (max_illum > MAX_ILLUM) || (max_sidt > MAX_SIDT_MS) || (max_hjd > MAX_HJD_MS) || (max_twil > MAX_POS_ASEC))
+  {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}
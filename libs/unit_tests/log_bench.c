@@ -0,0 +1,188 @@
+/* Compile from local directory with:
+ * gcc -Wall -O2 -I../ ./log_bench.c ../act_log.c -lpthread -o ./log_bench
+ *
+ * Measures the cost of act_log calls as seen by the calling thread:
+ *  - a debug message while the run-time level is LOG_INFO (not formatted at all),
+ *  - the previous implementation (malloc, vsnprintf and a synchronous syslog() for every call, whether or not syslog
+ *    keeps the message),
+ *  - enabled messages queued for the writer thread, from one and from NUM_THREADS threads, as fast as possible,
+ *  - NUM_BURSTS bursts of BURST_LEN enabled messages (well within the ring) with a pause for the writer after each, so
+ *    that none is dropped and the time is that of queueing a message,
+ *  - error messages logged while the ring is full, which must be written directly rather than dropped,
+ *  - act_log_open and act_log_close repeated while NUM_THREADS threads keep logging.
+ * Enabled messages really are sent to syslog (facility local0), so keep num_msgs moderate:
+ *   ./log_bench [num_msgs]
+ * (default 20000). Messages logged faster than syslog accepts them are dropped and counted, so the number dropped is
+ * printed with the enabled results - when most are dropped, the time per call is mostly that of dropping a message.
+ * Prints PASSED or FAILED.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include "act_log.h"
+
+#define NUM_THREADS     4
+#define NUM_DISABLED    10000000
+#define BURST_LEN       256
+#define NUM_BURSTS      10
+/// Pause after each burst, for the writer to empty the ring
+#define BURST_PAUSE_NS  500000000
+#define NUM_REOPEN      200
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+/// The previous act_log_msg/act_log_full, for comparison
+static char *old_log_msg(const char *fmt, ...)
+{
+  va_list ap;
+  char *msgbuf = malloc(256);
+  va_start(ap, fmt);
+  vsnprintf(msgbuf, 255, fmt, ap);
+  va_end(ap);
+  return msgbuf;
+}
+
+static void old_log_full(int pri, const char *progname_msg, const char *funcname_msg, char *log_msg)
+{
+  syslog(pri, "[%s %s] %s", progname_msg, funcname_msg, log_msg);
+  free(log_msg);
+}
+
+static int G_num_msgs;
+static char G_keep_logging;
+
+static void *log_thread(void *arg)
+{
+  int id = *(int *)arg, i;
+  for (i=0; i<G_num_msgs/NUM_THREADS; i++)
+    act_log_normal(act_log_msg("log_bench thread %d row %d value %f", id, i, i*0.5));
+  return NULL;
+}
+
+static void *reopen_thread(void *arg)
+{
+  int id = *(int *)arg, i = 0;
+  while (__atomic_load_n(&G_keep_logging, __ATOMIC_RELAXED))
+  {
+    act_log_normal(act_log_msg("log_bench reopen thread %d row %d", id, i));
+    i++;
+  }
+  return NULL;
+}
+
+static void report(const char *name, int num, double elapsed_s)
+{
+  printf("%-32s %10.0f calls/s  %9.1f ns/call\n", name, num / elapsed_s, elapsed_s / num * 1.0e9);
+}
+
+int main(int argc, char **argv)
+{
+  G_num_msgs = 20000;
+  if (argc > 1)
+    G_num_msgs = atoi(argv[1]);
+  if (G_num_msgs < NUM_THREADS)
+  {
+    fprintf(stderr, "Invalid number of messages.\n");
+    return 1;
+  }
+  act_log_open();
+  act_log_set_level(LOG_INFO);
+
+  int i;
+  double start = now_s();
+  for (i=0; i<NUM_DISABLED; i++)
+    act_log_debug(act_log_msg("row %d value %f", i, i*0.5));
+  report("disabled (debug at LOG_INFO)", NUM_DISABLED, now_s() - start);
+
+  start = now_s();
+  for (i=0; i<G_num_msgs; i++)
+    old_log_full(LOG_DEBUG, __progname, __FUNCTION__, old_log_msg("log_bench old row %d value %f", i, i*0.5));
+  report("previous implementation", G_num_msgs, now_s() - start);
+
+  unsigned long dropped = act_log_num_dropped();
+  start = now_s();
+  for (i=0; i<G_num_msgs; i++)
+    act_log_normal(act_log_msg("log_bench row %d value %f", i, i*0.5));
+  double elapsed_s = now_s() - start;
+  report("enabled, 1 thread", G_num_msgs, elapsed_s);
+  printf("%32s %lu of %d dropped\n", "", act_log_num_dropped() - dropped, G_num_msgs);
+
+  // Let the writer catch up before the next test
+  struct timespec wait = { 1, 0 };
+  nanosleep(&wait, NULL);
+  dropped = act_log_num_dropped();
+  pthread_t thr[NUM_THREADS];
+  int ids[NUM_THREADS];
+  start = now_s();
+  for (i=0; i<NUM_THREADS; i++)
+  {
+    ids[i] = i;
+    pthread_create(&thr[i], NULL, log_thread, &ids[i]);
+  }
+  for (i=0; i<NUM_THREADS; i++)
+    pthread_join(thr[i], NULL);
+  elapsed_s = now_s() - start;
+  report("enabled, 4 threads (total)", G_num_msgs/NUM_THREADS*NUM_THREADS, elapsed_s);
+  printf("%32s %lu of %d dropped\n", "", act_log_num_dropped() - dropped, G_num_msgs/NUM_THREADS*NUM_THREADS);
+
+  int failed = 0, j;
+  struct timespec pause = { 0, BURST_PAUSE_NS };
+  nanosleep(&wait, NULL);
+  dropped = act_log_num_dropped();
+  elapsed_s = 0.0;
+  for (i=0; i<NUM_BURSTS; i++)
+  {
+    start = now_s();
+    for (j=0; j<BURST_LEN; j++)
+      act_log_normal(act_log_msg("log_bench burst %d row %d value %f", i, j, j*0.5));
+    elapsed_s += now_s() - start;
+    nanosleep(&pause, NULL);
+  }
+  report("enabled, bursts within ring", NUM_BURSTS*BURST_LEN, elapsed_s);
+  printf("%32s %lu of %d dropped\n", "", act_log_num_dropped() - dropped, NUM_BURSTS*BURST_LEN);
+
+  // Fill the ring, then log errors - these must be written directly, not dropped
+  nanosleep(&wait, NULL);
+  for (i=0; i<G_num_msgs; i++)
+    act_log_normal(act_log_msg("log_bench fill row %d", i));
+  dropped = act_log_num_dropped();
+  int num_err = G_num_msgs < 2000 ? G_num_msgs : 2000;
+  start = now_s();
+  for (i=0; i<num_err; i++)
+    act_log_error(act_log_msg("log_bench error row %d", i));
+  elapsed_s = now_s() - start;
+  failed |= act_log_num_dropped() != dropped;
+  report("errors while ring full", num_err, elapsed_s);
+  printf("%32s %lu of %d dropped - %s\n", "", act_log_num_dropped() - dropped, num_err, act_log_num_dropped() != dropped ? "FAILED" : "OK");
+
+  start = now_s();
+  act_log_close();
+  printf("act_log_close (writing remaining messages) took %.1f ms\n", (now_s() - start) * 1000.0);
+
+  // Threads that are logging while the writer is stopped must not be lost or post the semaphore after it's destroyed
+  G_keep_logging = 1;
+  for (i=0; i<NUM_THREADS; i++)
+    pthread_create(&thr[i], NULL, reopen_thread, &ids[i]);
+  start = now_s();
+  for (i=0; i<NUM_REOPEN; i++)
+  {
+    act_log_open();
+    act_log_close();
+  }
+  elapsed_s = now_s() - start;
+  __atomic_store_n(&G_keep_logging, 0, __ATOMIC_RELAXED);
+  for (i=0; i<NUM_THREADS; i++)
+    pthread_join(thr[i], NULL);
+  printf("%d x act_log_open/close while %d threads log: %.1f ms\n", NUM_REOPEN, NUM_THREADS, elapsed_s * 1000.0);
+
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
@@ -0,0 +1,442 @@
+/* Compile from local directory with:
+ * gcc -Wall -O2 -I../ ./positastro_bench.c ../act_positastro.c ../act_timecoord.c -lm -o ./positastro_bench
+ *
+ * Compares the cost per coordinate of the structure-based act_positastro functions with the batch functions that work
+ * on arrays of doubles (radians), for equatorial to horizontal conversion, precession, refraction, airmass and the
+ * positions of the Sun and Moon. Checks that:
+ *   - the batch functions agree to within 1 arcsec with the formulas the structure-based functions used before the
+ *     batch functions were added (reproduced below). The Moon is not checked, since its previous position was wrong
+ *     by up to 180 degrees.
+ *   - the structure-based functions agree with the batch functions to within 2 arcsec. The structures truncate to
+ *     1 arcsec (1 ms), and the range checks (check_alt_azm_ranges, check_ra_ha_dec_ranges) truncate again, so
+ *     structure results can be up to 2 arcsec below the exact value. The previous implementation did the same.
+ * Run with:
+ *   ./positastro_bench [num_coords]
+ * (default 100000). Prints PASSED or FAILED. To see how much the batch kernels gain from vectorisation, compare with
+ * a build using -O3 -ffast-math (which allows GCC to use the vector maths functions in glibc).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "act_site.h"
+#include "act_positastro.h"
+
+#define NUM_REPEATS     5
+#define MAX_DIFF_ASEC      2.0
+#define MAX_REF_DIFF_ASEC  1.0
+/// Altitude below which the airmass is 200 (as in act_positastro.c)
+#define HORIZON_ALT        5.0
+
+static int G_failed = 0;
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+static double rand_range(double min, double max)
+{
+  return min + (max - min) * (rand() / (double)RAND_MAX);
+}
+
+/// Difference between two angles in arcseconds, taking wrap-around into account
+static double diff_asec(double a_rad, double b_rad)
+{
+  double diff = fabs(fmod(a_rad - b_rad, TWOPI));
+  if (diff > ONEPI)
+    diff = TWOPI - diff;
+  return convert_RAD_DEG(diff) * 3600.0;
+}
+
+/// Print timings and differences of a transform, max_ref_diff < 0 if the batch function was not checked against the previous formulas
+static void report(const char *name, double scalar_s, double batch_s, int num, double max_diff, double max_ref_diff)
+{
+  char mismatch = (max_diff > MAX_DIFF_ASEC) || (max_ref_diff > MAX_REF_DIFF_ASEC);
+  printf("%-22s  struct %8.1f ns   batch %8.1f ns   speed-up %5.1fx   max diff %6.2f\"   ", name, scalar_s / num * 1.0e9, batch_s / num * 1.0e9, scalar_s / batch_s, max_diff);
+  if (max_ref_diff < 0.0)
+    printf("prev      -  %s\n", mismatch ? "  MISMATCH" : "");
+  else
+    printf("prev %6.2f\"%s\n", max_ref_diff, mismatch ? "  MISMATCH" : "");
+  G_failed |= mismatch;
+}
+
+/*
+ * Formulas of the structure-based functions before the batch functions were added, working in radians.
+ */
+
+static void prev_equi_altaz(double ha_rad, double dec_rad, double *alt_rad, double *azm_rad)
+{
+  double lat_rad = convert_DEG_RAD(LATITUDE);
+  *alt_rad = asin(sin(lat_rad)*sin(dec_rad) + cos(lat_rad)*cos(dec_rad)*cos(ha_rad));
+  *azm_rad = atan2(sin(-ha_rad) * cos(dec_rad) / cos(*alt_rad), (sin(dec_rad)-sin(lat_rad)*sin(*alt_rad)) / cos(lat_rad) / cos(*alt_rad));
+}
+
+static void prev_altaz_equi(double alt_rad, double azm_rad, double *ha_rad, double *dec_rad)
+{
+  double lat_rad = convert_DEG_RAD(LATITUDE);
+  *dec_rad = asin(sin(lat_rad)*sin(alt_rad) + cos(lat_rad)*cos(alt_rad)*cos(azm_rad));
+  *ha_rad = atan2(-sin(azm_rad)*cos(alt_rad)/cos(*dec_rad), (sin(alt_rad) - sin(*dec_rad)*sin(lat_rad))/cos(*dec_rad)/cos(lat_rad));
+}
+
+static double prev_airmass(double alt_rad)
+{
+  if (alt_rad < convert_DEG_RAD(HORIZON_ALT))
+    return 200.0;
+  if (alt_rad > ONEPI / 2.0)
+    alt_rad = ONEPI - alt_rad;
+  return 1.0 / cos((ONEPI/2.0) - alt_rad);
+}
+
+static double prev_atm_refract_deg(double alt_deg, double press_kpa, double temp_c)
+{
+  double coeff = alt_deg + 10.3/(alt_deg+5.11);
+  double R = (press_kpa/101.0) * (283.0/(273.0+temp_c)) * 1.02 / tan(coeff*ONEPI/180.0);
+  if (R < 0.0)
+    return 0.0;
+  return R / 60.0;
+}
+
+/// Refraction-corrected equatorial coordinates, sign -1 for telescope to sky and +1 for sky to telescope
+static void prev_refract_equat(double sign, double *ha_rad, double *dec_rad)
+{
+  double alt_rad, azm_rad;
+  prev_equi_altaz(*ha_rad, *dec_rad, &alt_rad, &azm_rad);
+  alt_rad += sign * convert_DEG_RAD(prev_atm_refract_deg(convert_RAD_DEG(alt_rad), AVG_PRESS_kPa, AVG_TEMP_degC));
+  prev_altaz_equi(alt_rad, azm_rad, ha_rad, dec_rad);
+}
+
+static void prev_precess(double ra_rad, double dec_rad, float epoch_in, float epoch_out, double *ra_out, double *dec_out)
+{
+  double T, xa, za, ta, sacd, cacd, sd ;
+  T = 0.01*(epoch_out - epoch_in) ;
+  xa = convert_DEG_RAD((0.6406161 + 0.0000839*T + 0.0000050*T*T)*T);
+  za = convert_DEG_RAD((0.6406161 + 0.0003041*T + 0.0000051*T*T)*T);
+  ta = convert_DEG_RAD((0.5567530 - 0.0001185*T - 0.0000116*T*T)*T);
+  sacd = sin(ra_rad+xa)*cos(dec_rad);
+  cacd = cos(ra_rad+xa)*cos(ta)*cos(dec_rad) - sin(ta)*sin(dec_rad);
+  sd = cos(ra_rad + xa)*sin(ta)*cos(dec_rad) + cos(ta)*sin(dec_rad);
+  *dec_out = asin(sd);
+  *ra_out = atan2(sacd, cacd) + za;
+}
+
+static void prev_sun(double jd, double targ_ra, double targ_dec, double *sun_ra, double *sun_dec, double *hjd)
+{
+  double n = jd - 2451545.0;
+  double L = convert_DEG_RAD(280.460 + 0.9856474*n);
+  double g = convert_DEG_RAD(357.528 + 0.9856003*n);
+  double lam = fmod(L + convert_DEG_RAD(1.915*sin(g) + 0.020*sin(2.0*g)), TWOPI);
+  lam += lam < 0.0 ? TWOPI : 0.0;
+  double eps = convert_DEG_RAD(23.439 - 0.0000004*n);
+  double ra_rad = atan(cos(eps)*tan(lam));
+  ra_rad += (floor(lam/(ONEPI/2.0)) - floor(ra_rad/(ONEPI/2.0))) * (ONEPI/2.0);
+  ra_rad = fmod(ra_rad, TWOPI);
+  *sun_ra = ra_rad < 0.0 ? ra_rad + TWOPI : ra_rad;
+  *sun_dec = asin(sin(eps)*sin(lam));
+  double r = 1.00014 - 0.01671*cos(g) - 0.00014*cos(2.0*g);
+  *hjd = jd - 0.0057755*r*(cos(lam)*cos(targ_ra)*cos(targ_dec) + sin(lam)*(sin(eps)*sin(targ_dec) + cos(eps)*cos(targ_dec)*sin(targ_ra)));
+}
+
+int main(int argc, char **argv)
+{
+  int num = 100000;
+  if (argc > 1)
+    num = atoi(argv[1]);
+  if (num <= 0)
+  {
+    fprintf(stderr, "Invalid number of coordinates.\n");
+    return 1;
+  }
+  srand(1);
+
+  struct hastruct *ha = malloc(num*sizeof(struct hastruct)), *ha_out = malloc(num*sizeof(struct hastruct));
+  struct rastruct *ra = malloc(num*sizeof(struct rastruct)), *ra_out = malloc(num*sizeof(struct rastruct));
+  struct decstruct *dec = malloc(num*sizeof(struct decstruct)), *dec_out = malloc(num*sizeof(struct decstruct));
+  struct altstruct *alt = malloc(num*sizeof(struct altstruct));
+  struct azmstruct *azm = malloc(num*sizeof(struct azmstruct));
+  double *ha_rad = malloc(num*sizeof(double)), *ra_rad = malloc(num*sizeof(double)), *dec_rad = malloc(num*sizeof(double));
+  double *out1 = malloc(num*sizeof(double)), *out2 = malloc(num*sizeof(double)), *out3 = malloc(num*sizeof(double));
+  double *jd = malloc(num*sizeof(double)), *julcen = malloc(num*sizeof(double)), *res = malloc(num*sizeof(double));
+  if ((ha == NULL) || (ha_out == NULL) || (ra == NULL) || (ra_out == NULL) || (dec == NULL) || (dec_out == NULL) || (alt == NULL) || (azm == NULL) || (ha_rad == NULL) || (ra_rad == NULL) || (dec_rad == NULL) || (out1 == NULL) || (out2 == NULL) || (out3 == NULL) || (jd == NULL) || (julcen == NULL) || (res == NULL))
+  {
+    fprintf(stderr, "Failed to allocate memory.\n");
+    return 1;
+  }
+
+  int i, rep;
+  for (i=0; i<num; i++)
+  {
+    // Round to the resolution of the structures so both paths start from the same coordinates
+    convert_H_HMSMS_ha(rand_range(-12.0, 12.0), &ha[i]);
+    convert_H_HMSMS_ra(rand_range(0.0, 24.0), &ra[i]);
+    convert_D_DMS_dec(rand_range(-89.0, 89.0), &dec[i]);
+    ha_rad[i] = convert_H_RAD(convert_HMSMS_H_ha(&ha[i]));
+    ra_rad[i] = convert_H_RAD(convert_HMSMS_H_ra(&ra[i]));
+    dec_rad[i] = convert_DEG_RAD(convert_DMS_D_dec(&dec[i]));
+    jd[i] = 2457000.0 + rand_range(0.0, 3650.0);
+    julcen[i] = (jd[i] - 2451545.0) / 36525.0;
+  }
+  printf("%d coordinates, best of %d runs, time per coordinate\n", num, NUM_REPEATS);
+
+  double start, scalar_s, batch_s, max_diff, max_ref_diff;
+
+  // Equatorial to horizontal
+  scalar_s = batch_s = 1.0e9;
+  for (rep=0; rep<NUM_REPEATS; rep++)
+  {
+    start = now_s();
+    for (i=0; i<num; i++)
+      convert_EQUI_ALTAZ(&ha[i], &dec[i], &alt[i], &azm[i]);
+    scalar_s = fmin(scalar_s, now_s() - start);
+    start = now_s();
+    convert_EQUI_ALTAZ_batch(ha_rad, dec_rad, out1, out2, num);
+    batch_s = fmin(batch_s, now_s() - start);
+  }
+  max_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    max_diff = fmax(max_diff, diff_asec(out1[i], convert_DEG_RAD(convert_DMS_D_alt(&alt[i]))));
+    // Azimuth is undefined at the zenith
+    if (out1[i] < convert_DEG_RAD(89.0))
+      max_diff = fmax(max_diff, diff_asec(out2[i], convert_DEG_RAD(convert_DMS_D_azm(&azm[i]))) * cos(out1[i]));
+  }
+  max_ref_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    double prev_alt, prev_azm;
+    prev_equi_altaz(ha_rad[i], dec_rad[i], &prev_alt, &prev_azm);
+    max_ref_diff = fmax(max_ref_diff, diff_asec(out1[i], prev_alt));
+    if (out1[i] < convert_DEG_RAD(89.0))
+      max_ref_diff = fmax(max_ref_diff, diff_asec(out2[i], prev_azm) * cos(out1[i]));
+  }
+  report("EQUI -> ALTAZ", scalar_s, batch_s, num, max_diff, max_ref_diff);
+
+  // Horizontal to equatorial (using the altitudes and azimuths calculated above)
+  double *alt_rad = out1, *azm_rad = out2;
+  scalar_s = batch_s = 1.0e9;
+  for (rep=0; rep<NUM_REPEATS; rep++)
+  {
+    start = now_s();
+    for (i=0; i<num; i++)
+      convert_ALTAZ_EQUI(&alt[i], &azm[i], &ha_out[i], &dec_out[i]);
+    scalar_s = fmin(scalar_s, now_s() - start);
+    start = now_s();
+    convert_ALTAZ_EQUI_batch(alt_rad, azm_rad, out3, res, num);
+    batch_s = fmin(batch_s, now_s() - start);
+  }
+  max_diff = 0.0;
+  for (i=0; i<num; i++)
+    max_diff = fmax(max_diff, diff_asec(res[i], dec_rad[i]));
+  for (i=0; i<num; i++)
+    max_diff = fmax(max_diff, diff_asec(out3[i], ha_rad[i]) * cos(dec_rad[i]));
+  max_ref_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    double prev_ha, prev_dec;
+    prev_altaz_equi(alt_rad[i], azm_rad[i], &prev_ha, &prev_dec);
+    max_ref_diff = fmax(max_ref_diff, diff_asec(out3[i], prev_ha) * cos(prev_dec));
+    max_ref_diff = fmax(max_ref_diff, diff_asec(res[i], prev_dec));
+  }
+  report("ALTAZ -> EQUI", scalar_s, batch_s, num, max_diff, max_ref_diff);
+
+  // Airmass
+  scalar_s = batch_s = 1.0e9;
+  for (rep=0; rep<NUM_REPEATS; rep++)
+  {
+    start = now_s();
+    for (i=0; i<num; i++)
+      res[i] = calc_airmass(&alt[i]);
+    scalar_s = fmin(scalar_s, now_s() - start);
+    start = now_s();
+    calc_airmass_batch(alt_rad, out3, num);
+    batch_s = fmin(batch_s, now_s() - start);
+  }
+  max_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    // Express the difference as the change in altitude that would give it
+    if (res[i] < 200.0)
+      max_diff = fmax(max_diff, convert_RAD_DEG(fabs(asin(1.0/res[i]) - asin(1.0/out3[i]))) * 3600.0);
+    else if (out3[i] < 200.0)
+      max_diff = fmax(max_diff, 3600.0 * fabs(convert_RAD_DEG(alt_rad[i]) - HORIZON_ALT));
+  }
+  max_ref_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    double prev = prev_airmass(alt_rad[i]);
+    if ((prev < 200.0) && (out3[i] < 200.0))
+      max_ref_diff = fmax(max_ref_diff, convert_RAD_DEG(fabs(asin(1.0/prev) - asin(1.0/out3[i]))) * 3600.0);
+    else if ((prev < 200.0) || (out3[i] < 200.0))
+      max_ref_diff = fmax(max_ref_diff, 3600.0 * fabs(convert_RAD_DEG(alt_rad[i]) - HORIZON_ALT));
+  }
+  report("airmass", scalar_s, batch_s, num, max_diff, max_ref_diff);
+
+  // Refraction
+  scalar_s = batch_s = 1.0e9;
+  for (rep=0; rep<NUM_REPEATS; rep++)
+  {
+    start = now_s();
+    for (i=0; i<num; i++)
+      res[i] = calc_atm_refract_deg(convert_DMS_D_alt(&alt[i]), AVG_PRESS_kPa, AVG_TEMP_degC);
+    scalar_s = fmin(scalar_s, now_s() - start);
+    start = now_s();
+    calc_atm_refract_batch(alt_rad, AVG_PRESS_kPa, AVG_TEMP_degC, out3, num);
+    batch_s = fmin(batch_s, now_s() - start);
+  }
+  max_diff = 0.0;
+  for (i=0; i<num; i++)
+    if (alt_rad[i] > 0.0)
+      max_diff = fmax(max_diff, fabs(res[i] - convert_RAD_DEG(out3[i])) * 3600.0);
+  max_ref_diff = 0.0;
+  for (i=0; i<num; i++)
+    if (alt_rad[i] > 0.0)
+      max_ref_diff = fmax(max_ref_diff, fabs(prev_atm_refract_deg(convert_RAD_DEG(alt_rad[i]), AVG_PRESS_kPa, AVG_TEMP_degC) - convert_RAD_DEG(out3[i])) * 3600.0);
+  report("refraction", scalar_s, batch_s, num, max_diff, max_ref_diff);
+
+  // Refraction correction of equatorial coordinates, in both directions (on coordinates above the horizon)
+  const char *refract_names[2] = { "refract tel -> sky", "refract sky -> tel" };
+  int dir;
+  for (dir=0; dir<2; dir++)
+  {
+    scalar_s = batch_s = 1.0e9;
+    for (rep=0; rep<NUM_REPEATS; rep++)
+    {
+      for (i=0; i<num; i++)
+      {
+        ha_out[i] = ha[i];
+        dec_out[i] = dec[i];
+        out3[i] = ha_rad[i];
+        res[i] = dec_rad[i];
+      }
+      start = now_s();
+      for (i=0; i<num; i++)
+      {
+        if (dir == 0)
+          corr_atm_refract_tel_sky_equat(&ha_out[i], &dec_out[i]);
+        else
+          corr_atm_refract_sky_tel_equat(&ha_out[i], &dec_out[i]);
+      }
+      scalar_s = fmin(scalar_s, now_s() - start);
+      start = now_s();
+      if (dir == 0)
+        corr_atm_refract_tel_sky_equat_batch(out3, res, num);
+      else
+        corr_atm_refract_sky_tel_equat_batch(out3, res, num);
+      batch_s = fmin(batch_s, now_s() - start);
+    }
+    max_diff = max_ref_diff = 0.0;
+    for (i=0; i<num; i++)
+    {
+      if (alt_rad[i] <= 0.0)
+        continue;
+      max_diff = fmax(max_diff, diff_asec(out3[i], convert_H_RAD(convert_HMSMS_H_ha(&ha_out[i]))) * cos(res[i]));
+      max_diff = fmax(max_diff, diff_asec(res[i], convert_DEG_RAD(convert_DMS_D_dec(&dec_out[i]))));
+      double prev_ha = ha_rad[i], prev_dec = dec_rad[i];
+      prev_refract_equat(dir == 0 ? -1.0 : 1.0, &prev_ha, &prev_dec);
+      max_ref_diff = fmax(max_ref_diff, diff_asec(out3[i], prev_ha) * cos(prev_dec));
+      max_ref_diff = fmax(max_ref_diff, diff_asec(res[i], prev_dec));
+    }
+    report(refract_names[dir], scalar_s, batch_s, num, max_diff, max_ref_diff);
+  }
+
+  // Precession B1950 -> J2000
+  scalar_s = batch_s = 1.0e9;
+  for (rep=0; rep<NUM_REPEATS; rep++)
+  {
+    start = now_s();
+    for (i=0; i<num; i++)
+      precess_coord(&ra[i], &dec[i], 1950.0, 2000.0, &ra_out[i], &dec_out[i]);
+    scalar_s = fmin(scalar_s, now_s() - start);
+    start = now_s();
+    precess_coord_batch(ra_rad, dec_rad, 1950.0, 2000.0, out1, out2, num);
+    batch_s = fmin(batch_s, now_s() - start);
+  }
+  max_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    max_diff = fmax(max_diff, diff_asec(out1[i], convert_H_RAD(convert_HMSMS_H_ra(&ra_out[i]))) * cos(out2[i]));
+    max_diff = fmax(max_diff, diff_asec(out2[i], convert_DEG_RAD(convert_DMS_D_dec(&dec_out[i]))));
+  }
+  max_ref_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    double prev_ra, prev_dec;
+    prev_precess(ra_rad[i], dec_rad[i], 1950.0, 2000.0, &prev_ra, &prev_dec);
+    max_ref_diff = fmax(max_ref_diff, diff_asec(out1[i], prev_ra) * cos(prev_dec));
+    max_ref_diff = fmax(max_ref_diff, diff_asec(out2[i], prev_dec));
+  }
+  report("precession", scalar_s, batch_s, num, max_diff, max_ref_diff);
+
+  // Sun, with heliocentric Julian date
+  scalar_s = batch_s = 1.0e9;
+  for (rep=0; rep<NUM_REPEATS; rep++)
+  {
+    start = now_s();
+    for (i=0; i<num; i++)
+      calc_sun(jd[i], &ra[i], &dec[i], &ra_out[i], &dec_out[i], &res[i]);
+    scalar_s = fmin(scalar_s, now_s() - start);
+    start = now_s();
+    calc_sun_batch(jd, ra_rad, dec_rad, out1, out2, out3, num);
+    batch_s = fmin(batch_s, now_s() - start);
+  }
+  max_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    max_diff = fmax(max_diff, diff_asec(out1[i], convert_H_RAD(convert_HMSMS_H_ra(&ra_out[i]))) * cos(out2[i]));
+    max_diff = fmax(max_diff, diff_asec(out2[i], convert_DEG_RAD(convert_DMS_D_dec(&dec_out[i]))));
+  }
+  max_ref_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    double prev_ra, prev_dec, prev_hjd;
+    prev_sun(jd[i], ra_rad[i], dec_rad[i], &prev_ra, &prev_dec, &prev_hjd);
+    max_ref_diff = fmax(max_ref_diff, diff_asec(out1[i], prev_ra) * cos(prev_dec));
+    max_ref_diff = fmax(max_ref_diff, diff_asec(out2[i], prev_dec));
+    // Express the heliocentric correction as the equivalent rotation of the Earth (15 arcsec per second)
+    max_ref_diff = fmax(max_ref_diff, fabs(out3[i] - prev_hjd) * 86400.0 * 15.0);
+  }
+  report("Sun", scalar_s, batch_s, num, max_diff, max_ref_diff);
+
+  // Moon
+  scalar_s = batch_s = 1.0e9;
+  for (rep=0; rep<NUM_REPEATS; rep++)
+  {
+    start = now_s();
+    for (i=0; i<num; i++)
+      calc_moon_pos(julcen[i], &ra_out[i], &dec_out[i]);
+    scalar_s = fmin(scalar_s, now_s() - start);
+    start = now_s();
+    calc_moon_pos_batch(julcen, out1, out2, num);
+    batch_s = fmin(batch_s, now_s() - start);
+  }
+  max_diff = 0.0;
+  for (i=0; i<num; i++)
+  {
+    max_diff = fmax(max_diff, diff_asec(out1[i], convert_H_RAD(convert_HMSMS_H_ra(&ra_out[i]))) * cos(out2[i]));
+    max_diff = fmax(max_diff, diff_asec(out2[i], convert_DEG_RAD(convert_DMS_D_dec(&dec_out[i]))));
+  }
+  report("Moon", scalar_s, batch_s, num, max_diff, -1.0);
+
+  free(ha);
+  free(ha_out);
+  free(ra);
+  free(ra_out);
+  free(dec);
+  free(dec_out);
+  free(alt);
+  free(azm);
+  free(ha_rad);
+  free(ra_rad);
+  free(dec_rad);
+  free(out1);
+  free(out2);
+  free(out3);
+  free(jd);
+  free(julcen);
+  free(res);
+  printf("%s\n", G_failed ? "FAILED" : "PASSED");
+  return G_failed;
+}
@@ -0,0 +1,124 @@
+/* Compile from local directory with:
+ * gcc -Wall -O2 -I../ ./timing_test.c ../act_timing.c -lpthread -o ./timing_test
+ *
+ * Checks act_timing and measures its cost:
+ *  - the cost of a span while timing is off and while it is on,
+ *  - frames in which the main thread and NUM_THREADS short-lived worker threads (as in the star extraction) record
+ *    spans; every span must appear in the timing file with the right frame, and the percentiles must match the known
+ *    durations.
+ * The timing file is written to /tmp/timing_test.txt. Prints PASSED or FAILED.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "act_timing.h"
+
+#define NUM_THREADS   4
+#define NUM_FRAMES    60
+#define NUM_SPANS     5000000
+#define TIMING_FILE   "/tmp/timing_test.txt"
+
+enum
+{
+  STAGE_MAIN = 0,
+  STAGE_WORKER,
+  NUM_STAGES
+};
+
+static const char *const G_stage_names[NUM_STAGES] = { "main", "worker" };
+
+static void *worker_thread(void *arg)
+{
+  (void)arg;
+  // Fixed duration of 2 ms, so that the percentiles are known
+  unsigned long long start = act_timing_start();
+  act_timing_record(STAGE_WORKER, start, start + 2000000ULL);
+  return NULL;
+}
+
+static double span_cost_ns(int num)
+{
+  int i;
+  unsigned long long start = act_timing_now();
+  for (i=0; i<num; i++)
+  {
+    unsigned long long span_start = act_timing_start();
+    __asm__ __volatile__("" ::: "memory");
+    act_timing_end(STAGE_MAIN, span_start);
+  }
+  return (act_timing_now() - start) / (double)num;
+}
+
+int main()
+{
+  int i, j, failed = 0;
+  printf("Span while timing is off: %8.2f ns\n", span_cost_ns(NUM_SPANS));
+
+  if (act_timing_open(TIMING_FILE, G_stage_names, NUM_STAGES) != 0)
+  {
+    fprintf(stderr, "Failed to open %s\n", TIMING_FILE);
+    return 1;
+  }
+  // Collected (and counted in the percentiles) with the first frame
+  printf("Span while timing is on:  %8.2f ns\n", span_cost_ns(200));
+
+  pthread_t threads[NUM_THREADS];
+  for (i=0; i<NUM_FRAMES; i++)
+  {
+    act_timing_frame_begin();
+    unsigned long long start = act_timing_start();
+    for (j=0; j<NUM_THREADS; j++)
+      pthread_create(&threads[j], NULL, worker_thread, NULL);
+    for (j=0; j<NUM_THREADS; j++)
+      pthread_join(threads[j], NULL);
+    act_timing_end(STAGE_MAIN, start);
+    act_timing_frame_end();
+  }
+  act_timing_close();
+
+  FILE *fp = fopen(TIMING_FILE, "r");
+  if (fp == NULL)
+    return 1;
+  char line[256], stage[32];
+  int num_frames = 0, num_worker = 0, num_pct = 0;
+  unsigned long cur_frame = 0, frame;
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    int thread_num;
+    unsigned int num;
+    double start_ms, dur_ms, p50, p90, p99, max;
+    if (sscanf(line, "frame %lu", &frame) == 1)
+    {
+      cur_frame = frame;
+      num_frames++;
+    }
+    else if (sscanf(line, "span %lu %31s %d %lf %lf", &frame, stage, &thread_num, &start_ms, &dur_ms) == 5)
+    {
+      if (strcmp(stage, "worker") != 0)
+        continue;
+      num_worker++;
+      if ((frame != cur_frame) || (dur_ms < 1.999) || (dur_ms > 2.001))
+      {
+        printf("Bad worker span: %s", line);
+        failed = 1;
+      }
+    }
+    else if (sscanf(line, "pct %31s %u %lf %lf %lf %lf", stage, &num, &p50, &p90, &p99, &max) == 6)
+    {
+      num_pct++;
+      if ((strcmp(stage, "worker") == 0) && ((num == 0) || (p50 < 1.999) || (max > 2.001)))
+      {
+        printf("Bad worker percentiles: %s", line);
+        failed = 1;
+      }
+    }
+  }
+  fclose(fp);
+  printf("%d frames, %d worker spans, %d percentile lines, %lu spans dropped\n", num_frames, num_worker, num_pct, act_timing_num_dropped());
+  if ((num_frames != NUM_FRAMES) || (num_worker != NUM_FRAMES*NUM_THREADS) || (num_pct != 2*(1 + NUM_FRAMES/ACT_TIMING_STATS_FRAMES)))
+    failed = 1;
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
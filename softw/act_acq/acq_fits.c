@@ -0,0 +1,501 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <fitsio.h>
+#include <glib/gstdio.h>
+#include <act_log.h>
+#include "acq_fits.h"
+
+/// Maximum number of suffixes tried when a file with the name of a new image already exists
+#define FITS_MAX_NAME_TRIES  100
+
+/// cfitsio is not necessarily built thread-safe, so all cfitsio calls in this module are serialised
+static pthread_mutex_t G_fits_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void fits_log_error(char const *action, gchar const *filepath, int fits_stat);
+static gboolean write_header(fitsfile *fptr, CcdImg *img, int *fits_stat);
+static gboolean write_data(fitsfile *fptr, CcdImg *img, gboolean byte_data, int *fits_stat);
+static gboolean read_header(fitsfile *fptr, CcdImg *img, int *fits_stat);
+static gboolean read_key_opt(fitsfile *fptr, int datatype, char const *keyname, void *value, int *fits_stat);
+static char const *img_type_name(guchar img_type);
+static void *writer_thread(void *fits_writer);
+
+/** \brief Write an image to a FITS file.
+ * \param img Image to write.
+ * \param filepath Path of the new file (must not exist yet).
+ * \param compress Whether to tile-compress the image.
+ * \return TRUE on success, otherwise FALSE (a partially written file is removed).
+ *
+ * Images read from the camera (whose pixels are 8-bit values scaled to 0..1, see ccd_img_get_raw_max) are written
+ * as 8-bit integers with BSCALE set to restore the original values exactly. If compressed, they are Rice-compressed
+ * in tiles of ACQ_FITS_TILE_ROWS rows. Other images are written as 32-bit floats, which are compressed losslessly
+ * with GZIP (Rice compression of floats requires lossy quantisation).
+ *
+ * The header contains all the metadata of the image, so that acq_fits_read_img can recreate it.
+ */
+gboolean acq_fits_write_img(CcdImg *img, gchar const *filepath, gboolean compress)
+{
+  long naxes[2] = { ccd_img_get_img_width(img), ccd_img_get_img_height(img) };
+  if ((naxes[0] == 0) || (naxes[1] == 0) || (ccd_img_get_img_len(img) < (gulong)(naxes[0]*naxes[1])))
+  {
+    act_log_error(act_log_msg("Cannot write incomplete image to %s (%lu pixels, should be %ld).", filepath, ccd_img_get_img_len(img), naxes[0]*naxes[1]));
+    return FALSE;
+  }
+  gfloat raw_max = ccd_img_get_raw_max(img);
+  gboolean byte_data = (raw_max >= 1.0) && (raw_max <= 255.0) && (raw_max == floor(raw_max));
+
+  fitsfile *fptr;
+  int fits_stat = 0;
+  pthread_mutex_lock(&G_fits_mutex);
+  if (fits_create_file(&fptr, filepath, &fits_stat))
+  {
+    fits_log_error("creating FITS file", filepath, fits_stat);
+    pthread_mutex_unlock(&G_fits_mutex);
+    return FALSE;
+  }
+  if (compress)
+  {
+    long tile_dim[2] = { naxes[0], ACQ_FITS_TILE_ROWS };
+    fits_set_compression_type(fptr, byte_data ? RICE_1 : GZIP_1, &fits_stat);
+    fits_set_tile_dim(fptr, 2, tile_dim, &fits_stat);
+    if (!byte_data)
+      fits_set_quantize_level(fptr, 0.0, &fits_stat);
+  }
+  fits_create_img(fptr, byte_data ? BYTE_IMG : FLOAT_IMG, 2, naxes, &fits_stat);
+  if (fits_stat != 0)
+    fits_log_error("creating FITS image", filepath, fits_stat);
+  else if (!write_header(fptr, img, &fits_stat))
+    fits_log_error("writing FITS header", filepath, fits_stat);
+  else if (!write_data(fptr, img, byte_data, &fits_stat))
+    fits_log_error("writing FITS image data", filepath, fits_stat);
+
+  if (fits_stat != 0)
+  {
+    int del_stat = 0;
+    fits_delete_file(fptr, &del_stat);
+    pthread_mutex_unlock(&G_fits_mutex);
+    return FALSE;
+  }
+  fits_close_file(fptr, &fits_stat);
+  pthread_mutex_unlock(&G_fits_mutex);
+  if (fits_stat != 0)
+  {
+    fits_log_error("closing FITS file", filepath, fits_stat);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/** \brief Recreate an image from a FITS file written by acq_fits_write_img.
+ * \param filepath Path of the FITS file (compressed or not).
+ * \return New image, or NULL on failure.
+ */
+CcdImg *acq_fits_read_img(gchar const *filepath)
+{
+  fitsfile *fptr;
+  int fits_stat = 0, naxis = 0;
+  long naxes[2] = { 0, 0 };
+  pthread_mutex_lock(&G_fits_mutex);
+  if (fits_open_image(&fptr, filepath, READONLY, &fits_stat))
+  {
+    fits_log_error("opening FITS file", filepath, fits_stat);
+    pthread_mutex_unlock(&G_fits_mutex);
+    return NULL;
+  }
+  fits_get_img_dim(fptr, &naxis, &fits_stat);
+  fits_get_img_size(fptr, 2, naxes, &fits_stat);
+  if ((fits_stat != 0) || (naxis != 2) || (naxes[0] <= 0) || (naxes[1] <= 0))
+  {
+    act_log_error(act_log_msg("FITS file %s does not contain a 2-dimensional image.", filepath));
+    fits_close_file(fptr, &fits_stat);
+    pthread_mutex_unlock(&G_fits_mutex);
+    return NULL;
+  }
+
+  CcdImg *img = CCD_IMG(g_object_new (ccd_img_get_type(), NULL));
+  gulong img_len = naxes[0]*naxes[1];
+  gfloat *img_data = g_malloc(img_len*sizeof(gfloat));
+  if (!read_header(fptr, img, &fits_stat))
+    fits_log_error("reading FITS header", filepath, fits_stat);
+  else if (fits_read_img(fptr, TFLOAT, 1, img_len, NULL, img_data, NULL, &fits_stat))
+    fits_log_error("reading FITS image data", filepath, fits_stat);
+  else if ((ccd_img_get_img_width(img) != naxes[0]) || (ccd_img_get_img_height(img) != naxes[1]))
+  {
+    act_log_error(act_log_msg("Image size in FITS file %s (%ldx%ld) does not match window in header (%hux%hu).", filepath, naxes[0], naxes[1], ccd_img_get_img_width(img), ccd_img_get_img_height(img)));
+    fits_stat = BAD_DIMEN;
+  }
+  int close_stat = 0;
+  fits_close_file(fptr, &close_stat);
+  pthread_mutex_unlock(&G_fits_mutex);
+  if (fits_stat != 0)
+  {
+    g_free(img_data);
+    g_object_unref(G_OBJECT(img));
+    return NULL;
+  }
+  ccd_img_set_img_data(img, img_len, img_data);
+  g_free(img_data);
+  return img;
+}
+
+/** \brief Name of the FITS file for an image, based on the integration start time (UTC).
+ * \return Newly allocated file name (without directory), e.g. acq_20150420_213502.250.fits.
+ */
+gchar *acq_fits_img_filename(CcdImg *img)
+{
+  gdouble start_sec = ccd_img_get_start_datetime(img);
+  time_t start_time = (time_t)floor(start_sec);
+  struct tm start_tm;
+  gmtime_r(&start_time, &start_tm);
+  return g_strdup_printf("acq_%04d%02d%02d_%02d%02d%02d.%03d.fits", start_tm.tm_year+1900, start_tm.tm_mon+1, start_tm.tm_mday, start_tm.tm_hour, start_tm.tm_min, start_tm.tm_sec, (int)floor(fmod(start_sec, 1.0)*1000.0));
+}
+
+/** \brief Write an image to a new FITS file in the given directory.
+ * \param img Image to write.
+ * \param dir Directory in which to create the file.
+ * \param compress Whether to tile-compress the image.
+ * \return Newly allocated path of the file written, or NULL on failure.
+ *
+ * The file is named with acq_fits_img_filename. If a file with that name already exists, a numerical suffix is
+ * added to the name. The image is written to a temporary ".part" file that is renamed once it is complete, so
+ * anything scanning the directory for ".fits" files never sees a partially written image.
+ */
+gchar *acq_fits_save_img(CcdImg *img, gchar const *dir, gboolean compress)
+{
+  gchar *filename = acq_fits_img_filename(img);
+  gchar *filepath = g_build_filename(dir, filename, NULL);
+  guint i;
+  for (i=1; g_file_test(filepath, G_FILE_TEST_EXISTS) && (i<FITS_MAX_NAME_TRIES); i++)
+  {
+    g_free(filepath);
+    gchar *numbered = g_strdup_printf("%.*s_%u.fits", (int)(strlen(filename)-strlen(".fits")), filename, i);
+    filepath = g_build_filename(dir, numbered, NULL);
+    g_free(numbered);
+  }
+  g_free(filename);
+  gchar *part_path = g_strconcat(filepath, ".part", NULL);
+  g_unlink(part_path);
+  if (!acq_fits_write_img(img, part_path, compress))
+  {
+    g_free(part_path);
+    g_free(filepath);
+    return NULL;
+  }
+  if (g_rename(part_path, filepath) != 0)
+  {
+    act_log_error(act_log_msg("Failed to rename %s to %s - %s", part_path, filepath, strerror(errno)));
+    g_free(part_path);
+    g_free(filepath);
+    return NULL;
+  }
+  g_free(part_path);
+  return filepath;
+}
+
+/** \brief Create a background FITS writer.
+ * \param dir Directory in which to save images (created if it does not exist).
+ * \param compress Whether to tile-compress the images.
+ * \return New writer, or NULL on failure.
+ */
+acq_fits_writer_t *acq_fits_writer_new(gchar const *dir, gboolean compress)
+{
+  if (g_mkdir_with_parents(dir, 0755) != 0)
+  {
+    act_log_error(act_log_msg("Failed to create FITS output directory %s - %s", dir, strerror(errno)));
+    return NULL;
+  }
+  acq_fits_writer_t *writer = malloc(sizeof(acq_fits_writer_t));
+  if (writer == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for FITS writer."));
+    return NULL;
+  }
+  writer->dir = g_strdup(dir);
+  writer->compress = compress;
+  memset(writer->queue, 0, sizeof(writer->queue));
+  writer->queue_head = writer->queue_depth = 0;
+  writer->busy = writer->exiting = FALSE;
+  writer->num_written = writer->num_failed = 0;
+  pthread_mutex_init(&writer->mutex, NULL);
+  pthread_cond_init(&writer->cond, NULL);
+  int ret = pthread_create(&writer->thr, NULL, writer_thread, writer);
+  if (ret != 0)
+  {
+    act_log_error(act_log_msg("Failed to start FITS writer thread - %s", strerror(ret)));
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    g_free(writer->dir);
+    free(writer);
+    return NULL;
+  }
+  return writer;
+}
+
+/** \brief Write all queued images, then stop the writer thread and free the writer. */
+void acq_fits_writer_free(acq_fits_writer_t *writer)
+{
+  if (writer == NULL)
+    return;
+  pthread_mutex_lock(&writer->mutex);
+  if (writer->queue_depth > 0)
+    act_log_normal(act_log_msg("Waiting for %u images to be written to %s.", writer->queue_depth, writer->dir));
+  writer->exiting = TRUE;
+  pthread_cond_broadcast(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+  pthread_join(writer->thr, NULL);
+  pthread_cond_destroy(&writer->cond);
+  pthread_mutex_destroy(&writer->mutex);
+  g_free(writer->dir);
+  free(writer);
+}
+
+/** \brief Queue an image to be written.
+ * \param writer FITS writer.
+ * \param img Image to write, a reference is taken until it has been written.
+ * \return TRUE if the image was queued, FALSE if the queue is full (the caller should then write the image itself).
+ *
+ * Does not block.
+ */
+gboolean acq_fits_writer_append(acq_fits_writer_t *writer, CcdImg *img)
+{
+  pthread_mutex_lock(&writer->mutex);
+  if ((writer->queue_depth >= ACQ_FITS_QUEUE_LEN) || (writer->exiting))
+  {
+    pthread_mutex_unlock(&writer->mutex);
+    return FALSE;
+  }
+  g_object_ref(G_OBJECT(img));
+  writer->queue[(writer->queue_head + writer->queue_depth) % ACQ_FITS_QUEUE_LEN] = img;
+  writer->queue_depth++;
+  pthread_cond_signal(&writer->cond);
+  pthread_mutex_unlock(&writer->mutex);
+  return TRUE;
+}
+
+/** \brief Retrieve the number of images written, failed and waiting (any of the parameters may be NULL). */
+void acq_fits_writer_get_counters(acq_fits_writer_t *writer, gulong *num_written, gulong *num_failed, guint *queue_depth)
+{
+  pthread_mutex_lock(&writer->mutex);
+  if (num_written != NULL)
+    *num_written = writer->num_written;
+  if (num_failed != NULL)
+    *num_failed = writer->num_failed;
+  if (queue_depth != NULL)
+    *queue_depth = writer->queue_depth + (writer->busy ? 1 : 0);
+  pthread_mutex_unlock(&writer->mutex);
+}
+
+static void fits_log_error(char const *action, gchar const *filepath, int fits_stat)
+{
+  char err_str[FLEN_STATUS];
+  fits_get_errstatus(fits_stat, err_str);
+  act_log_error(act_log_msg("Error %s (%s) - %s", action, filepath, err_str));
+}
+
+static gboolean write_header(fitsfile *fptr, CcdImg *img, int *fits_stat)
+{
+  gdouble start_sec = ccd_img_get_start_datetime(img);
+  time_t start_time = (time_t)floor(start_sec);
+  struct tm start_tm;
+  gmtime_r(&start_time, &start_tm);
+  char date_obs[FLEN_VALUE];
+  snprintf(date_obs, sizeof(date_obs), "%04d-%02d-%02dT%02d:%02d:%06.3f", start_tm.tm_year+1900, start_tm.tm_mon+1, start_tm.tm_mday, start_tm.tm_hour, start_tm.tm_min, start_tm.tm_sec + fmod(start_sec, 1.0));
+
+  int img_type = ccd_img_get_img_type(img);
+  gfloat integ_t = ccd_img_get_integ_t(img), tel_ra, tel_dec;
+  ccd_img_get_tel_pos(img, &tel_ra, &tel_dec);
+  gfloat pix_size_ra = ccd_img_get_pixel_size_ra(img), pix_size_dec = ccd_img_get_pixel_size_dec(img);
+  gulong targ_id = ccd_img_get_targ_id(img), user_id = ccd_img_get_user_id(img);
+  gushort win_start_x = ccd_img_get_win_start_x(img), win_start_y = ccd_img_get_win_start_y(img);
+  gushort win_width = ccd_img_get_win_width(img), win_height = ccd_img_get_win_height(img);
+  gushort prebin_x = ccd_img_get_prebin_x(img), prebin_y = ccd_img_get_prebin_y(img);
+
+  fits_write_key(fptr, TSTRING, "DATE-OBS", date_obs, "Integration start (UTC)", fits_stat);
+  fits_write_key(fptr, TDOUBLE, "STARTSEC", &start_sec, "Integration start (seconds since 1970 UTC)", fits_stat);
+  fits_write_key(fptr, TFLOAT, "EXPTIME", &integ_t, "Integration time (s)", fits_stat);
+  fits_write_key(fptr, TSTRING, "IMAGETYP", (void *)img_type_name(img_type), "Image type", fits_stat);
+  fits_write_key(fptr, TINT, "ACQIMGT", &img_type, "act_acq image type code", fits_stat);
+  if (ccd_img_get_targ_name(img) != NULL)
+    fits_write_key(fptr, TSTRING, "OBJECT", (void *)ccd_img_get_targ_name(img), "Target name", fits_stat);
+  fits_write_key(fptr, TULONG, "TARGID", &targ_id, "Target database identifier", fits_stat);
+  if (ccd_img_get_user_name(img) != NULL)
+    fits_write_key(fptr, TSTRING, "OBSERVER", (void *)ccd_img_get_user_name(img), "User name", fits_stat);
+  fits_write_key(fptr, TULONG, "USERID", &user_id, "User database identifier", fits_stat);
+  fits_write_key(fptr, TFLOAT, "TELRA", &tel_ra, "Telescope right ascension at start (degrees)", fits_stat);
+  fits_write_key(fptr, TFLOAT, "TELDEC", &tel_dec, "Telescope declination at start (degrees)", fits_stat);
+  fits_write_key(fptr, TFLOAT, "PIXSZRA", &pix_size_ra, "Pixel size in right ascension (arcsec)", fits_stat);
+  fits_write_key(fptr, TFLOAT, "PIXSZDEC", &pix_size_dec, "Pixel size in declination (arcsec)", fits_stat);
+  fits_write_key(fptr, TUSHORT, "WINSTRTX", &win_start_x, "Window start x (unbinned pixels)", fits_stat);
+  fits_write_key(fptr, TUSHORT, "WINSTRTY", &win_start_y, "Window start y (unbinned pixels)", fits_stat);
+  fits_write_key(fptr, TUSHORT, "WINWIDTH", &win_width, "Window width (unbinned pixels)", fits_stat);
+  fits_write_key(fptr, TUSHORT, "WINHEIGH", &win_height, "Window height (unbinned pixels)", fits_stat);
+  fits_write_key(fptr, TUSHORT, "XBINNING", &prebin_x, "Prebinning in x", fits_stat);
+  fits_write_key(fptr, TUSHORT, "YBINNING", &prebin_y, "Prebinning in y", fits_stat);
+  return *fits_stat == 0;
+}
+
+/** \brief Write the pixels of an image, ACQ_FITS_TILE_ROWS rows at a time.
+ *
+ * For 8-bit images, each block of rows is converted back to the raw values, so no full-size copy of the image is
+ * made.
+ */
+static gboolean write_data(fitsfile *fptr, CcdImg *img, gboolean byte_data, int *fits_stat)
+{
+  gulong width = ccd_img_get_img_width(img), height = ccd_img_get_img_height(img), row, i;
+  gfloat *img_data = ccd_img_get_img_data(img);
+  if (img_data == NULL)
+  {
+    *fits_stat = BAD_DATA_FILL;
+    return FALSE;
+  }
+  if (!byte_data)
+  {
+    for (row=0; (row<height) && (*fits_stat==0); row+=ACQ_FITS_TILE_ROWS)
+    {
+      gulong num_pix = MIN(ACQ_FITS_TILE_ROWS, height-row) * width;
+      fits_write_img(fptr, TFLOAT, row*width+1, num_pix, &img_data[row*width], fits_stat);
+    }
+    return *fits_stat == 0;
+  }
+
+  gfloat raw_max = ccd_img_get_raw_max(img);
+  gdouble bscale = 1.0/raw_max, bzero = 0.0;
+  fits_write_key(fptr, TDOUBLE, "BSCALE", &bscale, "Pixel value = raw value / saturated raw value", fits_stat);
+  fits_write_key(fptr, TDOUBLE, "BZERO", &bzero, NULL, fits_stat);
+  // the raw values are written as they are, the scaling only applies when the file is read
+  fits_set_bscale(fptr, 1.0, 0.0, fits_stat);
+  guchar *raw = g_malloc(ACQ_FITS_TILE_ROWS*width);
+  for (row=0; (row<height) && (*fits_stat==0); row+=ACQ_FITS_TILE_ROWS)
+  {
+    gulong num_pix = MIN(ACQ_FITS_TILE_ROWS, height-row) * width;
+    gfloat const *block = &img_data[row*width];
+    for (i=0; i<num_pix; i++)
+      raw[i] = (guchar)lrintf(block[i]*raw_max);
+    fits_write_img(fptr, TBYTE, row*width+1, num_pix, raw, fits_stat);
+  }
+  g_free(raw);
+  return *fits_stat == 0;
+}
+
+static gboolean read_header(fitsfile *fptr, CcdImg *img, int *fits_stat)
+{
+  gdouble start_sec = 0.0;
+  gfloat integ_t = 0.0, tel_ra = 0.0, tel_dec = 0.0, pix_size_ra = 0.0, pix_size_dec = 0.0;
+  int img_type = IMGT_NONE;
+  gulong targ_id = 0, user_id = 0;
+  gushort win_start_x = 0, win_start_y = 0, win_width = 0, win_height = 0, prebin_x = 1, prebin_y = 1;
+  char targ_name[FLEN_VALUE] = "", user_name[FLEN_VALUE] = "";
+
+  read_key_opt(fptr, TDOUBLE, "STARTSEC", &start_sec, fits_stat);
+  read_key_opt(fptr, TFLOAT, "EXPTIME", &integ_t, fits_stat);
+  read_key_opt(fptr, TINT, "ACQIMGT", &img_type, fits_stat);
+  read_key_opt(fptr, TSTRING, "OBJECT", targ_name, fits_stat);
+  read_key_opt(fptr, TULONG, "TARGID", &targ_id, fits_stat);
+  read_key_opt(fptr, TSTRING, "OBSERVER", user_name, fits_stat);
+  read_key_opt(fptr, TULONG, "USERID", &user_id, fits_stat);
+  read_key_opt(fptr, TFLOAT, "TELRA", &tel_ra, fits_stat);
+  read_key_opt(fptr, TFLOAT, "TELDEC", &tel_dec, fits_stat);
+  read_key_opt(fptr, TFLOAT, "PIXSZRA", &pix_size_ra, fits_stat);
+  read_key_opt(fptr, TFLOAT, "PIXSZDEC", &pix_size_dec, fits_stat);
+  read_key_opt(fptr, TUSHORT, "WINSTRTX", &win_start_x, fits_stat);
+  read_key_opt(fptr, TUSHORT, "WINSTRTY", &win_start_y, fits_stat);
+  read_key_opt(fptr, TUSHORT, "WINWIDTH", &win_width, fits_stat);
+  read_key_opt(fptr, TUSHORT, "WINHEIGH", &win_height, fits_stat);
+  read_key_opt(fptr, TUSHORT, "XBINNING", &prebin_x, fits_stat);
+  read_key_opt(fptr, TUSHORT, "YBINNING", &prebin_y, fits_stat);
+  if (*fits_stat != 0)
+    return FALSE;
+  if ((prebin_x == 0) || (prebin_y == 0) || (win_width == 0) || (win_height == 0))
+  {
+    // not written by acq_fits_write_img, assume a full unbinned frame
+    long naxes[2];
+    fits_get_img_size(fptr, 2, naxes, fits_stat);
+    win_start_x = win_start_y = 0;
+    win_width = naxes[0];
+    win_height = naxes[1];
+    prebin_x = prebin_y = 1;
+  }
+
+  ccd_img_set_img_type(img, img_type);
+  ccd_img_set_start_datetime(img, start_sec);
+  ccd_img_set_integ_t(img, integ_t);
+  ccd_img_set_target(img, targ_id, targ_name);
+  ccd_img_set_user(img, user_id, user_name);
+  ccd_img_set_tel_pos(img, tel_ra, tel_dec);
+  ccd_img_set_pixel_size(img, pix_size_ra, pix_size_dec);
+  ccd_img_set_window(img, win_start_x, win_start_y, win_width, win_height, prebin_x, prebin_y);
+  return *fits_stat == 0;
+}
+
+/// Read a keyword if it is present, leaving value unchanged otherwise
+static gboolean read_key_opt(fitsfile *fptr, int datatype, char const *keyname, void *value, int *fits_stat)
+{
+  if (*fits_stat != 0)
+    return FALSE;
+  fits_read_key(fptr, datatype, (char *)keyname, value, NULL, fits_stat);
+  if (*fits_stat == KEY_NO_EXIST)
+  {
+    *fits_stat = 0;
+    return FALSE;
+  }
+  return *fits_stat == 0;
+}
+
+static char const *img_type_name(guchar img_type)
+{
+  switch (img_type)
+  {
+    case IMGT_ACQ_OBJ:
+      return "ACQ_OBJECT";
+    case IMGT_ACQ_SKY:
+      return "ACQ_SKY";
+    case IMGT_OBJECT:
+      return "OBJECT";
+    case IMGT_BIAS:
+      return "BIAS";
+    case IMGT_DARK:
+      return "DARK";
+    case IMGT_FLAT:
+      return "FLAT";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+static void *writer_thread(void *fits_writer)
+{
+  acq_fits_writer_t *writer = (acq_fits_writer_t *)fits_writer;
+  pthread_mutex_lock(&writer->mutex);
+  while (TRUE)
+  {
+    while ((writer->queue_depth == 0) && (!writer->exiting))
+      pthread_cond_wait(&writer->cond, &writer->mutex);
+    if (writer->queue_depth == 0)
+      break;
+    CcdImg *img = writer->queue[writer->queue_head];
+    writer->queue[writer->queue_head] = NULL;
+    writer->queue_head = (writer->queue_head + 1) % ACQ_FITS_QUEUE_LEN;
+    writer->queue_depth--;
+    writer->busy = TRUE;
+    pthread_mutex_unlock(&writer->mutex);
+
+    gchar *filepath = acq_fits_save_img(img, writer->dir, writer->compress);
+    if (filepath != NULL)
+      act_log_debug(act_log_msg("Image saved to %s", filepath));
+    else
+      act_log_error(act_log_msg("Failed to save image to FITS file in %s. Image will be lost.", writer->dir));
+    g_free(filepath);
+    g_object_unref(G_OBJECT(img));
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->busy = FALSE;
+    if (filepath != NULL)
+      writer->num_written++;
+    else
+      writer->num_failed++;
+  }
+  pthread_mutex_unlock(&writer->mutex);
+  return NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef __ACQ_FITS_H__
+#define __ACQ_FITS_H__
+
+#include <glib.h>
+#include <pthread.h>
+#include "ccd_img.h"
+
+/// Maximum number of images that can be waiting to be written by a FITS writer
+#define ACQ_FITS_QUEUE_LEN   32
+/// Number of image rows in each compression tile (tiles span the full width of the image)
+#define ACQ_FITS_TILE_ROWS   16
+
+/** \brief Background writer that saves images to FITS files in a directory.
+ *
+ * Images are queued by acq_fits_writer_append and written by a dedicated thread, so that queueing never waits for
+ * the disk. Files are named after the integration start time (see acq_fits_img_filename).
+ */
+typedef struct _acq_fits_writer_t
+{
+  gchar *dir;
+  gboolean compress;
+  pthread_t thr;
+  /// Bounded ring of images waiting to be written, protected by mutex
+  CcdImg *queue[ACQ_FITS_QUEUE_LEN];
+  guint queue_head, queue_depth;
+  gboolean busy, exiting;
+  /// Counters, protected by mutex
+  gulong num_written, num_failed;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} acq_fits_writer_t;
+
+gboolean acq_fits_write_img(CcdImg *img, gchar const *filepath, gboolean compress);
+CcdImg *acq_fits_read_img(gchar const *filepath);
+gchar *acq_fits_img_filename(CcdImg *img);
+gchar *acq_fits_save_img(CcdImg *img, gchar const *dir, gboolean compress);
+acq_fits_writer_t *acq_fits_writer_new(gchar const *dir, gboolean compress);
+void acq_fits_writer_free(acq_fits_writer_t *writer);
+gboolean acq_fits_writer_append(acq_fits_writer_t *writer, CcdImg *img);
+void acq_fits_writer_get_counters(acq_fits_writer_t *writer, gulong *num_written, gulong *num_failed, guint *queue_depth);
+
+#endif   /* __ACQ_FITS_H__ */
@@ -4,10 +4,14 @@
 #include <act_ipc.h>
 #include <act_log.h>
 #include "acq_net.h"
+#include "acq_timing.h"
 #include "ccd_img.h"
 #include "ccd_cntrl.h"
 #include "marshallers.h"
 
+//! Maximum number of telescope coordinate updates per second act_acq asks act_control for
+#define ACQ_NET_COORD_MAX_RATE     2.0
+
 #define PENDING_MSG_TARGSET(objs)  (&((struct act_msg *)objs->pending_msg)->content.msg_targset)
 #define PENDING_MSG_DATACCD(objs)  (&((struct act_msg *)objs->pending_msg)->content.msg_dataccd)
 #define OBJS_CCDCAP_MSG(objs)      (&((struct act_msg *)objs->ccdcap_msg)->content.msg_ccdcap)
@@ -138,7 +142,9 @@ gint acq_net_send_targset_response(AcqNet *objs, gchar status, gdouble adj_ra_d,
   PENDING_MSG_TARGSET(objs)->adj_ra_h = convert_DEG_H(adj_ra_d);
   PENDING_MSG_TARGSET(objs)->adj_dec_d = adj_dec_d;
   PENDING_MSG_TARGSET(objs)->targ_cent = targ_cent;
+  unsigned long long send_start = act_timing_start();
   int ret = acq_net_send(objs->net_chan, (struct act_msg *)objs->pending_msg);
+  act_timing_end(ACQ_TIMING_RESPONSE, send_start);
   if (ret < 0)
     act_log_error(act_log_msg("Failed to send target set response."));
   else
@@ -298,7 +304,15 @@ static gint acq_net_send(GIOChannel *channel, struct act_msg *msg)
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_write_chars (channel, (gchar *)(msg), sizeof(struct act_msg), &num_bytes, &error);
+  static unsigned int tx_seq = 0;
+  gchar frame[ACT_MSG_MAX_FRAME];
+  gsize frame_len = act_msg_frame(msg, tx_seq, frame);
+  if (frame_len == 0)
+  {
+    act_log_error(act_log_msg("Cannot send message with invalid type %hhd.", (msg)->mtype));
+    return -1;
+  }
+  status = g_io_channel_write_chars (channel, frame, frame_len, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("Error sending message - %s", error->message));
@@ -310,11 +324,12 @@ static gint acq_net_send(GIOChannel *channel, struct act_msg *msg)
     act_log_error(act_log_msg("Incorrect status returned while attempting to send message over network."));
     return -1;
   }
-  if (num_bytes != sizeof(struct act_msg))
+  if (num_bytes != frame_len)
   {
     act_log_error(act_log_msg("Entire message was not transmitted (%d bytes)", num_bytes));
     return -1;
   }
+  tx_seq++;
   return num_bytes;
 }
 
@@ -322,11 +337,14 @@ static gboolean net_read_ready(GIOChannel *net_chan, GIOCondition cond, gpointer
 {
   (void) cond;
   AcqNet *objs = ACQ_NET(acq_net);
+  static struct act_msg_rx net_rx;
   struct act_msg msgbuf;
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_read_chars (net_chan, (gchar *)&msgbuf, sizeof(msgbuf), &num_bytes, &error);
+  unsigned int rx_space;
+  gchar *rx_buf = act_msg_rx_space(&net_rx, &rx_space);
+  status = g_io_channel_read_chars (net_chan, rx_buf, rx_space, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("An error occurred while attempting to read message from network - ", error->message));
@@ -338,74 +356,76 @@ static gboolean net_read_ready(GIOChannel *net_chan, GIOCondition cond, gpointer
     act_log_error(act_log_msg("Incorrect status returned while attempting to read message from network."));
     return TRUE;
   }
-  if (num_bytes != sizeof(msgbuf))
-  {
-    act_log_error(act_log_msg("Received message has invalid length: %d", num_bytes));
-    return TRUE;
-  }
+  act_msg_rx_commit(&net_rx, num_bytes);
   
-  switch(msgbuf.mtype)
+  while (act_msg_rx_next(&net_rx, &msgbuf))
   {
-    case MT_QUIT:
-      // Quit the main programme loop
-      gtk_main_quit();
-      break;
-    case MT_CAP:
-      msgbuf.content.msg_cap.service_provides = 0;
-      msgbuf.content.msg_cap.service_needs = SERVICE_TIME | SERVICE_COORD;
-      msgbuf.content.msg_cap.targset_prov = TARGSET_ACQUIRE;
-      msgbuf.content.msg_cap.datapmt_prov = 0;
-      msgbuf.content.msg_cap.dataccd_prov = DATACCD_PHOTOM;
-      snprintf(msgbuf.content.msg_cap.version_str, MAX_VERSION_LEN-1, "%d.%d", MAJOR_VER, MINOR_VER);
-      if (acq_net_send(net_chan, &msgbuf) < 0)
-        act_log_error(act_log_msg("Failed to send programme capabilities response.\n"));
-      break;
-    case MT_STAT:
-      msgbuf.content.msg_stat.status = objs->status;
-      if (acq_net_send(net_chan, &msgbuf) < 0)
-        act_log_error(act_log_msg("Failed to send programme status response.\n"));
-      break;
-    case MT_GUISOCK:
-      g_signal_emit(G_OBJECT(acq_net), acq_net_signals[SIG_GUISOCK], 0, msgbuf.content.msg_guisock.gui_socket);
-      break;
-    case MT_COORD:
-      g_signal_emit(G_OBJECT(acq_net), acq_net_signals[SIG_TELCOORD], 0, convert_H_DEG(convert_HMSMS_H_ra(&msgbuf.content.msg_coord.ra)), convert_DMS_D_dec(&msgbuf.content.msg_coord.dec));
-      break;
-    case MT_TIME:
-      // ignore
-      break;
-    case MT_ENVIRON:
-      // ignore
-      break;
-    case MT_TARG_CAP:
-      // ignore
-      break;
-    case MT_TARG_SET:
-      process_msg_targset(objs, &msgbuf);
-      break;
-    case MT_PMT_CAP:
-      // ignore
-      break;
-    case MT_DATA_PMT:
-      // ignore
-      break;
-    case MT_CCD_CAP:
-      if (msgbuf.content.msg_ccdcap.dataccd_stage != 0)
-        break; // Ignore
-      if (((struct act_msg *)objs->ccdcap_msg)->mtype == MT_CCD_CAP)
-      {
-        act_log_debug(act_log_msg("Sending DATACCD capabilities response."));
-        if (acq_net_send(net_chan, (struct act_msg *)objs->ccdcap_msg) < 0)
-          act_log_error(act_log_msg("Failed to send CCD capabilities response message."));
-      }
-      else
-        objs->ccdcap_pending = TRUE;
-      break;
-    case MT_DATA_CCD:
-      process_msg_dataccd(objs, &msgbuf);
-      break;
-    default:
-      act_log_normal(act_log_msg("Invalid message type received (%d)", msgbuf.mtype));
+    switch(msgbuf.mtype)
+    {
+      case MT_QUIT:
+        // Quit the main programme loop
+        gtk_main_quit();
+        break;
+      case MT_CAP:
+        msgbuf.content.msg_cap.service_provides = 0;
+        msgbuf.content.msg_cap.service_needs = SERVICE_TIME | SERVICE_COORD;
+        msgbuf.content.msg_cap.targset_prov = TARGSET_ACQUIRE;
+        msgbuf.content.msg_cap.datapmt_prov = 0;
+        msgbuf.content.msg_cap.dataccd_prov = DATACCD_PHOTOM;
+        // coordinates only matter once the telescope has settled, so don't let slews flood the acquisition loop
+        memset(msgbuf.content.msg_cap.service_max_rate, 0, sizeof(msgbuf.content.msg_cap.service_max_rate));
+        msgbuf.content.msg_cap.service_max_rate[SERVICE_IDX_COORD] = ACQ_NET_COORD_MAX_RATE;
+        snprintf(msgbuf.content.msg_cap.version_str, MAX_VERSION_LEN-1, "%d.%d", MAJOR_VER, MINOR_VER);
+        if (acq_net_send(net_chan, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send programme capabilities response.\n"));
+        break;
+      case MT_STAT:
+        msgbuf.content.msg_stat.status = objs->status;
+        if (acq_net_send(net_chan, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send programme status response.\n"));
+        break;
+      case MT_GUISOCK:
+        g_signal_emit(G_OBJECT(acq_net), acq_net_signals[SIG_GUISOCK], 0, msgbuf.content.msg_guisock.gui_socket);
+        break;
+      case MT_COORD:
+        g_signal_emit(G_OBJECT(acq_net), acq_net_signals[SIG_TELCOORD], 0, convert_H_DEG(convert_HMSMS_H_ra(&msgbuf.content.msg_coord.ra)), convert_DMS_D_dec(&msgbuf.content.msg_coord.dec));
+        break;
+      case MT_TIME:
+        // ignore
+        break;
+      case MT_ENVIRON:
+        // ignore
+        break;
+      case MT_TARG_CAP:
+        // ignore
+        break;
+      case MT_TARG_SET:
+        process_msg_targset(objs, &msgbuf);
+        break;
+      case MT_PMT_CAP:
+        // ignore
+        break;
+      case MT_DATA_PMT:
+        // ignore
+        break;
+      case MT_CCD_CAP:
+        if (msgbuf.content.msg_ccdcap.dataccd_stage != 0)
+          break; // Ignore
+        if (((struct act_msg *)objs->ccdcap_msg)->mtype == MT_CCD_CAP)
+        {
+          act_log_debug(act_log_msg("Sending DATACCD capabilities response."));
+          if (acq_net_send(net_chan, (struct act_msg *)objs->ccdcap_msg) < 0)
+            act_log_error(act_log_msg("Failed to send CCD capabilities response message."));
+        }
+        else
+          objs->ccdcap_pending = TRUE;
+        break;
+      case MT_DATA_CCD:
+        process_msg_dataccd(objs, &msgbuf);
+        break;
+      default:
+        act_log_normal(act_log_msg("Invalid message type received (%d)", msgbuf.mtype));
+    }
   }
   
   return TRUE;
@@ -1,13 +1,14 @@
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <dirent.h>
 #include <stdlib.h>
 #include <pwd.h>
 #include <errno.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include <act_log.h>
 #include <act_ipc.h>
 #include <act_positastro.h>
@@ -19,13 +20,22 @@
 
 #define STORE_MAX_RETRIES 3
 
-#define IMG_QRY_MIN_LEN    1024
-#define IMG_QRY_PREF_LEN   60
-#define IMG_QRY_PIX_LEN    22
+#define STORE_DEF_HIGH_MARK  (3*ACQ_STORE_QUEUE_LEN/4)
+#define STORE_DEF_LOW_MARK   (ACQ_STORE_QUEUE_LEN/4)
+
+#define IMG_QRY_LEN        1024
+
+/// Directory (relative to the home directory) in which images are saved if they cannot be stored in the database
+#define FALLBACK_DIR_NAME  "acq_img_fallback"
+
+/// Extra declination coverage (degrees) when preloading catalogue zones, to allow for precession of the target coordinates
+#define CAT_PRELOAD_MARGIN_D  1.0
 
 enum
 {
   STATUS_UPDATE,
+  QUEUE_HIGH,
+  QUEUE_LOW,
   LAST_SIGNAL
 };
 
@@ -52,16 +62,29 @@ static guint acq_store_signals[LAST_SIGNAL] = { 0 };
 static void acq_store_instance_init(GObject *acq_store);
 static void acq_store_class_init(AcqStoreClass *klass);
 static void acq_store_instance_dispose(GObject *acq_store);
-static void *store_pending_img(void *acq_store);
-static gboolean store_next_img(AcqStore *objs);
+static MYSQL *store_connect(gchar const *sqlhost);
+static void *store_worker(void *store_worker);
+static gboolean store_next_img(struct acq_store_worker *worker);
+static gboolean store_queue_push(AcqStore *objs, CcdImg *img, gchar *fits_path);
+static void store_img_done(AcqStore *objs, struct acq_store_pend *pend, gboolean saved);
 static gboolean store_img(MYSQL *conn, CcdImg *img);
-static void store_img_fallback(CcdImg *img);
-static gboolean store_reconnect(AcqStore *objs);
+static gboolean store_img_data(MYSQL *conn, gulong img_id, CcdImg *img);
+static gchar *fallback_dir_path(void);
+static void store_img_fallback(AcqStore *objs, CcdImg *img);
+static gint fits_name_cmp(gconstpointer name1, gconstpointer name2);
+static gboolean store_reconnect(struct acq_store_worker *worker);
+static void store_set_status(AcqStore *objs, guchar set_flags, guchar clear_flags);
+static void store_emit_signal(AcqStore *objs, guint signal_id);
+static gboolean store_emit_idle(gpointer emit_data);
+static gdouble store_monotonic_sec(void);
 static guchar img_type_acq_to_db(guchar acq_img_type);
 static void precess_fk5(gfloat ra_d, gfloat dec_d, gfloat equinox, gfloat *ra_d_fk5, gfloat *dec_d_fk5);
 static void region_list(MYSQL *conn, gfloat ra_d_fk5, gfloat dec_d_fk5, gfloat radius_d, string256 reg_str);
 static void coord_constraint(gfloat ra_d_fk5, gfloat dec_d_fk5, gfloat radius_d, string256 constr_str);
 static PointList *get_catalog_stars(MYSQL *conn, string256 qrystr);
+static void cat_preload(AcqStore *objs, cat_cache_t *cache, gfloat dec_d, gfloat radius_d);
+static void *cat_loader(void *acq_store);
+static void cat_load_zone(MYSQL *conn, cat_cache_t *cache, gchar const *cat_table, guint zone);
 
 
 GType acq_store_get_type (void)
@@ -92,46 +115,49 @@ GType acq_store_get_type (void)
 
 AcqStore *acq_store_new(gchar const *sqlhost)
 {
-  // check connections
-  act_log_debug(act_log_msg("Creating MySQL image storage connection."));
-  MYSQL *store_conn;
-  store_conn = mysql_init(NULL);
-  if (store_conn == NULL)
-  {
-    act_log_error(act_log_msg("Error initialising MySQL image storage connection handler - %s.", mysql_error(store_conn)));
-    return NULL;
-  }
-  if (mysql_real_connect(store_conn, sqlhost, "act_acq", NULL, "act", 0, NULL, 0) == NULL)
-  {
-    act_log_error(act_log_msg("Error establishing image storage connection to MySQL database - %s.", mysql_error(store_conn)));
-    mysql_close(store_conn);
-    return NULL;
-  }
-  
   act_log_debug(act_log_msg("Creating general MySQL connection."));
-  MYSQL *genl_conn;
-  genl_conn = mysql_init(NULL);
+  MYSQL *genl_conn = store_connect(sqlhost);
   if (genl_conn == NULL)
   {
-    act_log_error(act_log_msg("Error initialising general MySQL connection handler - %s.", mysql_error(store_conn)));
-    mysql_close(store_conn);
-    return NULL;
-  }
-  if (mysql_real_connect(genl_conn, sqlhost, "act_acq", NULL, "act", 0, NULL, 0) == NULL)
-  {
-    act_log_error(act_log_msg("Error establishing general connection to MySQL database - %s.", mysql_error(store_conn)));
-    mysql_close(store_conn);
-    mysql_close(genl_conn);
+    act_log_error(act_log_msg("Failed to create general MySQL connection."));
     return NULL;
   }
   
   // create object
   AcqStore *objs = g_object_new (acq_store_get_type(), NULL);
-  objs->sqlhost = malloc(strlen(sqlhost)+1);
-  sprintf(objs->sqlhost, "%s", sqlhost);
-  objs->store_conn = store_conn;
+  objs->sqlhost = g_strdup(sqlhost);
   objs->genl_conn = genl_conn;
-  pthread_mutex_init (&objs->img_list_mutex, NULL);
+  
+  // each worker gets its own connection, since a MySQL connection can only be used by one thread at a time
+  gint i, ret;
+  for (i=0; i<ACQ_STORE_NUM_WORKERS; i++)
+  {
+    act_log_debug(act_log_msg("Creating MySQL image storage connection %d.", i));
+    objs->workers[i].objs = objs;
+    MYSQL *store_conn = store_connect(sqlhost);
+    if (store_conn == NULL)
+    {
+      act_log_error(act_log_msg("Failed to create MySQL image storage connection %d.", i));
+      g_object_unref(G_OBJECT(objs));
+      return NULL;
+    }
+    objs->workers[i].conn = store_conn;
+    ret = pthread_create(&objs->workers[i].thr, NULL, store_worker, (void *)&objs->workers[i]);
+    if (ret != 0)
+    {
+      act_log_error(act_log_msg("Failed to create image store thread %d - %s", i, strerror(ret)));
+      objs->workers[i].conn = NULL;
+      mysql_close(store_conn);
+      g_object_unref(G_OBJECT(objs));
+      return NULL;
+    }
+  }
+  
+  objs->fallback_dir = fallback_dir_path();
+  if (objs->fallback_dir != NULL)
+    objs->fallback_writer = acq_fits_writer_new(objs->fallback_dir, TRUE);
+  if (objs->fallback_writer == NULL)
+    act_log_error(act_log_msg("Could not start fallback FITS writer. Images that cannot be stored in the database will be saved synchronously (if possible)."));
   return objs; 
 }
 
@@ -406,12 +432,20 @@ PointList *acq_store_get_tycho_pattern(AcqStore *objs, gfloat ra_d, gfloat dec_d
   gfloat ra_d_fk5, dec_d_fk5;
   precess_fk5(ra_d, dec_d, equinox, &ra_d_fk5, &dec_d_fk5);
   
+  PointList *list = cat_cache_box_search(objs->tycho_cache, ra_d_fk5, dec_d_fk5, radius_d);
+  if (list != NULL)
+  {
+    act_log_debug(act_log_msg("Tycho2 stars retrieved from cache: %u", point_list_get_num_used(list)));
+    return list;
+  }
+  cat_preload(objs, objs->tycho_cache, dec_d_fk5, radius_d);
+  
   string256 coord_constr, qrystr;
   coord_constraint(ra_d_fk5, dec_d_fk5, radius_d, coord_constr);
   sprintf(qrystr, "SELECT ra_d_fk5, dec_d_fk5 FROM tycho2 WHERE %s", coord_constr);
   act_log_debug(act_log_msg("SQL query: %s\n", qrystr));
   
-  PointList *list = get_catalog_stars(objs->genl_conn, qrystr);
+  list = get_catalog_stars(objs->genl_conn, qrystr);
   if (list == NULL)
     act_log_error(act_log_msg("Failed to retrieve Tycho2 catalog stars"));
   
@@ -429,6 +463,14 @@ PointList *acq_store_get_gsc1_pattern(AcqStore *objs, gfloat ra_d, gfloat dec_d,
   gfloat ra_d_fk5, dec_d_fk5;
   precess_fk5(ra_d, dec_d, equinox, &ra_d_fk5, &dec_d_fk5);
   
+  PointList *list = cat_cache_box_search(objs->gsc1_cache, ra_d_fk5, dec_d_fk5, radius_d);
+  if (list != NULL)
+  {
+    act_log_debug(act_log_msg("GSC-1.2 stars retrieved from cache: %u", point_list_get_num_used(list)));
+    return list;
+  }
+  cat_preload(objs, objs->gsc1_cache, dec_d_fk5, radius_d);
+  
   string256 reg_list, coord_constr, qrystr;
   region_list(objs->genl_conn, ra_d_fk5, dec_d_fk5, radius_d, reg_list);
   
@@ -436,55 +478,251 @@ PointList *acq_store_get_gsc1_pattern(AcqStore *objs, gfloat ra_d, gfloat dec_d,
   sprintf(qrystr, "SELECT ra_d_fk5, dec_d_fk5 FROM gsc1 WHERE reg_id IN (%s) AND (%s)", reg_list, coord_constr);
   act_log_debug(act_log_msg("SQL query: %s\n", qrystr));
   
-  PointList *list = get_catalog_stars(objs->genl_conn, qrystr);
+  list = get_catalog_stars(objs->genl_conn, qrystr);
   if (list == NULL)
     act_log_error(act_log_msg("Failed to retrieve GSC-1.2 catalog stars"));
   
   return list;
 }
 
+/** \brief Start loading the GSC-1.2 catalogue zones around the given declination into memory.
+ * \param objs AcqStore object
+ * \param dec_d Declination (degrees, any recent equinox) of the upcoming target
+ * \param radius_d Search radius (degrees) that will be used for the pattern lookup
+ *
+ * Does not block - the zones are loaded by a background thread with its own database connection. Until they have
+ * been loaded, acq_store_get_gsc1_pattern falls back to querying the database.
+ */
+void acq_store_preload_gsc1(AcqStore *objs, gfloat dec_d, gfloat radius_d)
+{
+  cat_preload(objs, objs->gsc1_cache, dec_d, radius_d + CAT_PRELOAD_MARGIN_D);
+}
+
+/** \brief Queue an image for storage in the database.
+ * \param objs AcqStore object
+ * \param new_img Image to store, a reference is taken until the image has been stored
+ *
+ * Does not block. If the pending images queue is full, the image is written to the fallback directory instead.
+ * The "store-queue-high" signal is emitted when the queue depth reaches the high watermark, and "store-queue-low"
+ * once it has drained to the low watermark again. If a FITS directory has been set (see acq_store_set_fits_dir),
+ * the image is also queued to be saved there.
+ */
 void acq_store_append_image(AcqStore *objs, CcdImg *new_img)
 {
-  act_log_debug(act_log_msg("Locking mutex"));
-  int ret = pthread_mutex_lock(&objs->img_list_mutex);
+  if ((objs->archive_writer != NULL) && (!acq_fits_writer_append(objs->archive_writer, new_img)))
+  {
+    act_log_error(act_log_msg("FITS archive queue is full (%d images). Saving new image synchronously.", ACQ_FITS_QUEUE_LEN));
+    g_free(acq_fits_save_img(new_img, objs->archive_writer->dir, objs->archive_writer->compress));
+  }
+  
+  int ret = pthread_mutex_lock(&objs->queue_mutex);
   if (ret != 0)
   {
-    act_log_error(act_log_msg("Failed to obtain mutex lock on pending images list - %d. New image will be lost", ret));
+    act_log_error(act_log_msg("Failed to obtain mutex lock on pending images queue - %s. New image will be lost", strerror(ret)));
     return;
   }
-  act_log_debug(act_log_msg("Appending image to list"));
-  objs->img_pend = g_slist_append(objs->img_pend, G_OBJECT(new_img));
-  g_object_ref(G_OBJECT(new_img));
-  act_log_debug(act_log_msg("Unlocking mutex"));
-  ret = pthread_mutex_unlock(&objs->img_list_mutex);
-  if (ret != 0)
-    act_log_error(act_log_msg("Failed to release mutex lock on pending images list - %d", ret));
-  if ((objs->status & STAT_STORING) != 0)
+  if (objs->queue_depth >= ACQ_STORE_QUEUE_LEN)
+  {
+    pthread_mutex_unlock(&objs->queue_mutex);
+    act_log_error(act_log_msg("Pending images queue is full (%d images). Saving new image to fallback directory.", ACQ_STORE_QUEUE_LEN));
+    store_img_fallback(objs, new_img);
+    pthread_mutex_lock(&objs->queue_mutex);
+    objs->num_fallback++;
+    pthread_mutex_unlock(&objs->queue_mutex);
     return;
-  act_log_debug(act_log_msg("No storage thread running, creating thread for storing images"));
-  ret = pthread_create(&objs->store_thr, NULL, store_pending_img, (void *)objs);
-  if (ret != 0)
-    act_log_error(act_log_msg("Failed to create image store thread - %d", ret));
+  }
+  gboolean went_high = store_queue_push(objs, new_img, NULL);
+  act_log_debug(act_log_msg("Image appended to pending images queue (%u pending)", objs->queue_depth));
+  pthread_mutex_unlock(&objs->queue_mutex);
+  
+  if (went_high)
+  {
+    act_log_normal(act_log_msg("Pending images queue reached high watermark (%u images).", objs->high_mark));
+    g_signal_emit(G_OBJECT(objs), acq_store_signals[QUEUE_HIGH], 0, objs->high_mark);
+  }
+}
+
+/** \brief Save all new images to FITS files in the given directory, in addition to storing them in the database.
+ * \param objs AcqStore object
+ * \param fits_dir Directory for the FITS files (created if necessary), NULL to stop saving FITS files
+ * \return TRUE on success, FALSE if the FITS writer could not be started
+ *
+ * The files are Rice-compressed and written by a background thread, so acq_store_append_image does not wait for the
+ * disk. Unlike files in the fallback directory, they are never deleted.
+ */
+gboolean acq_store_set_fits_dir(AcqStore *objs, gchar const *fits_dir)
+{
+  if (objs->archive_writer != NULL)
+  {
+    acq_fits_writer_free(objs->archive_writer);
+    objs->archive_writer = NULL;
+  }
+  if (fits_dir == NULL)
+    return TRUE;
+  objs->archive_writer = acq_fits_writer_new(fits_dir, TRUE);
+  if (objs->archive_writer == NULL)
+    return FALSE;
+  act_log_normal(act_log_msg("Saving images to FITS files in %s", fits_dir));
+  return TRUE;
+}
+
+/** \brief Queue images from the fallback directory for storage in the database.
+ * \param objs AcqStore object
+ * \return Number of images queued
+ *
+ * The oldest files are queued first, leaving the queue just below its high watermark so that ingesting old images
+ * does not throttle new integrations. Each file is deleted once its image has been stored; files that fail to be
+ * stored are kept for the next call. Nothing is queued while the database is unavailable or while images from a
+ * previous call are still pending, so call this again (e.g. whenever the store becomes idle) to ingest large
+ * backlogs.
+ */
+guint acq_store_ingest_fallback(AcqStore *objs)
+{
+  if (objs->fallback_dir == NULL)
+    return 0;
+  pthread_mutex_lock(&objs->queue_mutex);
+  gboolean busy = (objs->num_ingest_pending > 0) || ((objs->status & STAT_ERR_NO_RECOV) > 0);
+  guint room = objs->queue_depth+1 < objs->high_mark ? objs->high_mark - objs->queue_depth - 1 : 0;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  if ((busy) || (room == 0))
+    return 0;
+  
+  GError *error = NULL;
+  GDir *dir = g_dir_open(objs->fallback_dir, 0, &error);
+  if (dir == NULL)
+  {
+    act_log_error(act_log_msg("Failed to open fallback directory %s - %s", objs->fallback_dir, error->message));
+    g_error_free(error);
+    return 0;
+  }
+  GPtrArray *names = g_ptr_array_new_with_free_func(g_free);
+  gchar const *name;
+  while ((name = g_dir_read_name(dir)) != NULL)
+  {
+    if (g_str_has_suffix(name, ".fits"))
+      g_ptr_array_add(names, g_strdup(name));
+  }
+  g_dir_close(dir);
+  // file names start with the integration start time, so this stores the oldest images first
+  g_ptr_array_sort(names, fits_name_cmp);
+  
+  guint i, num_queued = 0;
+  gboolean went_high = FALSE;
+  for (i=0; (i<names->len) && (num_queued<room); i++)
+  {
+    gchar *fits_path = g_build_filename(objs->fallback_dir, g_ptr_array_index(names, i), NULL);
+    CcdImg *img = acq_fits_read_img(fits_path);
+    if (img == NULL)
+    {
+      act_log_error(act_log_msg("Could not read fallback image %s. Skipping it.", fits_path));
+      g_free(fits_path);
+      continue;
+    }
+    pthread_mutex_lock(&objs->queue_mutex);
+    if (objs->queue_depth >= ACQ_STORE_QUEUE_LEN)
+    {
+      pthread_mutex_unlock(&objs->queue_mutex);
+      g_object_unref(G_OBJECT(img));
+      g_free(fits_path);
+      break;
+    }
+    went_high |= store_queue_push(objs, img, fits_path);
+    objs->num_ingest_pending++;
+    pthread_mutex_unlock(&objs->queue_mutex);
+    g_object_unref(G_OBJECT(img));
+    num_queued++;
+  }
+  g_ptr_array_free(names, TRUE);
+  
+  if (num_queued > 0)
+    act_log_normal(act_log_msg("Queued %u images from fallback directory %s for storage.", num_queued, objs->fallback_dir));
+  if (went_high)
+    g_signal_emit(G_OBJECT(objs), acq_store_signals[QUEUE_HIGH], 0, objs->high_mark);
+  return num_queued;
+}
+
+/** \brief Set the queue depths at which the "store-queue-high" and "store-queue-low" signals are emitted.
+ * \param objs AcqStore object
+ * \param high_mark Queue depth at or above which the queue is considered full (at most ACQ_STORE_QUEUE_LEN)
+ * \param low_mark Queue depth at or below which a full queue is considered drained (less than high_mark)
+ */
+void acq_store_set_watermarks(AcqStore *objs, guint high_mark, guint low_mark)
+{
+  if ((high_mark == 0) || (high_mark > ACQ_STORE_QUEUE_LEN) || (low_mark >= high_mark))
+  {
+    act_log_error(act_log_msg("Invalid storage queue watermarks (high %u, low %u, queue length %d).", high_mark, low_mark, ACQ_STORE_QUEUE_LEN));
+    return;
+  }
+  pthread_mutex_lock(&objs->queue_mutex);
+  objs->high_mark = high_mark;
+  objs->low_mark = low_mark;
+  pthread_mutex_unlock(&objs->queue_mutex);
+}
+
+guint acq_store_get_queue_depth(AcqStore *objs)
+{
+  pthread_mutex_lock(&objs->queue_mutex);
+  guint depth = objs->queue_depth;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  return depth;
+}
+
+/** \brief Retrieve storage counters.
+ * \param objs AcqStore object
+ * \param num_stored Number of images stored in the database
+ * \param num_fallback Number of images written to the fallback directory
+ * \param latency_mean Mean time (seconds) from queueing an image to its storage being completed
+ * \param latency_max Maximum queue-to-storage time (seconds)
+ * \param latency_last Queue-to-storage time (seconds) of the most recently stored image
+ *
+ * Any of the output parameters may be NULL.
+ */
+void acq_store_get_counters(AcqStore *objs, gulong *num_stored, gulong *num_fallback, gdouble *latency_mean, gdouble *latency_max, gdouble *latency_last)
+{
+  pthread_mutex_lock(&objs->queue_mutex);
+  if (num_stored != NULL)
+    *num_stored = objs->num_stored;
+  if (num_fallback != NULL)
+    *num_fallback = objs->num_fallback;
+  if (latency_mean != NULL)
+    *latency_mean = objs->num_stored > 0 ? objs->latency_sum / objs->num_stored : 0.0;
+  if (latency_max != NULL)
+    *latency_max = objs->latency_max;
+  if (latency_last != NULL)
+    *latency_last = objs->latency_last;
+  pthread_mutex_unlock(&objs->queue_mutex);
 }
 
 gboolean acq_store_idle(AcqStore *objs)
 {
-  return objs->status == 0;
+  pthread_mutex_lock(&objs->queue_mutex);
+  gboolean ret = objs->status == 0;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  return ret;
 }
 
 gboolean acq_store_storing(AcqStore *objs)
 {
-  return (objs->status & STAT_STORING) > 0;
+  pthread_mutex_lock(&objs->queue_mutex);
+  gboolean ret = (objs->status & STAT_STORING) > 0;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  return ret;
 }
 
 gboolean acq_store_error_retry(AcqStore *objs)
 {
-  return (objs->status & STAT_ERR_RETRY) > 0;
+  pthread_mutex_lock(&objs->queue_mutex);
+  gboolean ret = (objs->status & STAT_ERR_RETRY) > 0;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  return ret;
 }
 
 gboolean acq_store_error_no_recov(AcqStore *objs)
 {
-  return (objs->status & STAT_ERR_NO_RECOV) > 0;
+  pthread_mutex_lock(&objs->queue_mutex);
+  gboolean ret = (objs->status & STAT_ERR_NO_RECOV) > 0;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  return ret;
 }
 
 static void acq_store_instance_init(GObject *acq_store)
@@ -492,143 +730,290 @@ static void acq_store_instance_init(GObject *acq_store)
   AcqStore *objs = ACQ_STORE(acq_store);
   objs->status = 0;
   objs->sqlhost = NULL;
-  objs->store_conn = NULL;
   objs->genl_conn = NULL;
-  objs->img_pend = NULL;
+  memset(objs->workers, 0, sizeof(objs->workers));
+  memset(objs->queue, 0, sizeof(objs->queue));
+  objs->queue_head = objs->queue_depth = 0;
+  objs->num_busy = 0;
+  objs->high_mark = STORE_DEF_HIGH_MARK;
+  objs->low_mark = STORE_DEF_LOW_MARK;
+  objs->throttled = FALSE;
+  objs->exiting = FALSE;
+  pthread_mutex_init(&objs->queue_mutex, NULL);
+  pthread_cond_init(&objs->queue_cond, NULL);
+  objs->num_stored = objs->num_fallback = 0;
+  objs->latency_sum = objs->latency_max = objs->latency_last = 0.0;
+  objs->num_ingest_pending = 0;
+  objs->fallback_dir = NULL;
+  objs->fallback_writer = objs->archive_writer = NULL;
+  objs->gsc1_cache = cat_cache_new();
+  objs->tycho_cache = cat_cache_new();
+  objs->cat_loader_started = objs->cat_loader_running = FALSE;
+  pthread_mutex_init(&objs->cat_mutex, NULL);
 }
 
 static void acq_store_class_init(AcqStoreClass *klass)
 {
   acq_store_signals[STATUS_UPDATE] = g_signal_new("store-status-update", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST|G_SIGNAL_ACTION, 0, NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+  acq_store_signals[QUEUE_HIGH] = g_signal_new("store-queue-high", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST|G_SIGNAL_ACTION, 0, NULL, NULL, g_cclosure_marshal_VOID__UINT, G_TYPE_NONE, 1, G_TYPE_UINT);
+  acq_store_signals[QUEUE_LOW] = g_signal_new("store-queue-low", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST|G_SIGNAL_ACTION, 0, NULL, NULL, g_cclosure_marshal_VOID__UINT, G_TYPE_NONE, 1, G_TYPE_UINT);
   G_OBJECT_CLASS(klass)->dispose = acq_store_instance_dispose;
 }
 
 static void acq_store_instance_dispose(GObject *acq_store)
 {
   AcqStore *objs = ACQ_STORE(acq_store);
-  if ((objs->status & STAT_STORING) > 0)
+  gint i, ret;
+  pthread_mutex_lock(&objs->queue_mutex);
+  gboolean was_exiting = objs->exiting;
+  objs->exiting = TRUE;
+  if (objs->queue_depth > 0)
+    act_log_normal(act_log_msg("There are %u images waiting to be stored. Waiting for storage to complete.", objs->queue_depth));
+  pthread_cond_broadcast(&objs->queue_cond);
+  pthread_mutex_unlock(&objs->queue_mutex);
+  if (!was_exiting)
+  {
+    for (i=0; i<ACQ_STORE_NUM_WORKERS; i++)
+    {
+      if (objs->workers[i].conn == NULL)
+        continue;
+      ret = pthread_join(objs->workers[i].thr, NULL);
+      if (ret != 0)
+      {
+        act_log_error(act_log_msg("Failed to join storage thread %d - %s. Not closing its database connection.", i, strerror(ret)));
+        objs->workers[i].conn = NULL;
+      }
+    }
+  }
+  // after the workers have finished, so that images they could not store are written too
+  if (objs->fallback_writer != NULL)
   {
-    gint ret = pthread_join(objs->store_thr, NULL);
+    acq_fits_writer_free(objs->fallback_writer);
+    objs->fallback_writer = NULL;
+  }
+  if (objs->archive_writer != NULL)
+  {
+    acq_fits_writer_free(objs->archive_writer);
+    objs->archive_writer = NULL;
+  }
+  if (objs->fallback_dir != NULL)
+  {
+    g_free(objs->fallback_dir);
+    objs->fallback_dir = NULL;
+  }
+  pthread_mutex_lock(&objs->cat_mutex);
+  gboolean loader_started = objs->cat_loader_started;
+  objs->cat_loader_started = FALSE;
+  pthread_mutex_unlock(&objs->cat_mutex);
+  if (loader_started)
+  {
+    ret = pthread_join(objs->cat_loader_thr, NULL);
     if (ret != 0)
+      act_log_error(act_log_msg("Failed to join catalogue loader thread - %s.", strerror(ret)));
+  }
+  if (objs->gsc1_cache != NULL)
+  {
+    cat_cache_free(objs->gsc1_cache);
+    objs->gsc1_cache = NULL;
+  }
+  if (objs->tycho_cache != NULL)
+  {
+    cat_cache_free(objs->tycho_cache);
+    objs->tycho_cache = NULL;
+  }
+  for (i=0; i<ACQ_STORE_NUM_WORKERS; i++)
+  {
+    if (objs->workers[i].conn != NULL)
     {
-      act_log_error(act_log_msg("Failed to join storage thread - %s", strerror(ret)));
-      objs->status &= ~STAT_STORING;
+      mysql_close(objs->workers[i].conn);
+      objs->workers[i].conn = NULL;
     }
-    else
-      pthread_mutex_destroy(&objs->img_list_mutex);
   }
   if (objs->sqlhost != NULL)
   {
     g_free(objs->sqlhost);
     objs->sqlhost = NULL;
   }
-  if (objs->store_conn != NULL)
-  {
-    if ((objs->status & STAT_STORING) > 0)
-      act_log_error(act_log_msg("Need to close MySQL store connection, but images are still being store. Not closing connection."));
-    else
-    {
-      mysql_close(objs->store_conn);
-      objs->store_conn = NULL;
-    }
-  }
   if (objs->genl_conn != NULL)
   {
     mysql_close(objs->genl_conn);
     objs->genl_conn = NULL;
   }
-  if (objs->img_pend != NULL)
-    act_log_error(act_log_msg("There are images waiting to be stored."));
 }
 
-static void *store_pending_img(void *acq_store)
+static MYSQL *store_connect(gchar const *sqlhost)
 {
-  AcqStore *objs = ACQ_STORE(acq_store);
-  objs->status |= STAT_STORING;
-  g_object_ref(G_OBJECT(objs));
-  for (;;)
+  MYSQL *conn = mysql_init(NULL);
+  if (conn == NULL)
   {
-    if (!store_next_img(objs))
-      break;
+    act_log_error(act_log_msg("Error initialising MySQL connection handler - out of memory."));
+    return NULL;
   }
-  g_object_unref(G_OBJECT(objs));
-  objs->status &= ~STAT_STORING;
+  if (mysql_real_connect(conn, sqlhost, "act_acq", NULL, "act", 0, NULL, 0) == NULL)
+  {
+    act_log_error(act_log_msg("Error establishing connection to MySQL database - %s.", mysql_error(conn)));
+    mysql_close(conn);
+    return NULL;
+  }
+  return conn;
+}
+
+/** \brief Storage worker thread - stores images from the pending queue until the AcqStore object is disposed.
+ *
+ * Images still in the queue when the object is disposed are stored before the thread exits.
+ */
+static void *store_worker(void *store_worker)
+{
+  struct acq_store_worker *worker = (struct acq_store_worker *)store_worker;
+  mysql_thread_init();
+  while (store_next_img(worker));
+  mysql_thread_end();
   return 0;
 }
 
-static gboolean store_next_img(AcqStore *objs)
+static gboolean store_next_img(struct acq_store_worker *worker)
 {
-  if (objs->img_pend == NULL)
-  {
-    act_log_debug(act_log_msg("Stored all images."));
-    return FALSE;
-  }
-  int ret = pthread_mutex_lock(&objs->img_list_mutex);
+  AcqStore *objs = worker->objs;
+  int ret = pthread_mutex_lock(&objs->queue_mutex);
   if (ret != 0)
   {
-    act_log_error(act_log_msg("Error returned while trying to obtain mutex lock on pending images list (%d - %s)", ret, strerror(abs(ret))));
+    act_log_error(act_log_msg("Error returned while trying to obtain mutex lock on pending images queue (%d - %s)", ret, strerror(ret)));
     return FALSE;
   }
-  CcdImg *cur_img = CCD_IMG(objs->img_pend->data);
-  GSList *cur_el = objs->img_pend;
-  objs->img_pend = objs->img_pend->next;
-  g_slist_free_1 (cur_el);
-  ret = pthread_mutex_unlock(&objs->img_list_mutex);
-  if (ret != 0)
+  while ((objs->queue_depth == 0) && (!objs->exiting))
+    pthread_cond_wait(&objs->queue_cond, &objs->queue_mutex);
+  if (objs->queue_depth == 0)
   {
-    act_log_error(act_log_msg("Error returned while trying to release mutex lock on pending images list (%d - %s)", ret, strerror(abs(ret))));
+    pthread_mutex_unlock(&objs->queue_mutex);
+    act_log_debug(act_log_msg("Stored all images."));
     return FALSE;
   }
+  struct acq_store_pend cur_pend = objs->queue[objs->queue_head];
+  objs->queue[objs->queue_head].img = NULL;
+  objs->queue[objs->queue_head].fits_path = NULL;
+  objs->queue_head = (objs->queue_head + 1) % ACQ_STORE_QUEUE_LEN;
+  objs->queue_depth--;
+  objs->num_busy++;
+  gboolean status_changed = (objs->status & STAT_STORING) == 0;
+  objs->status |= STAT_STORING;
+  gboolean no_recov = (objs->status & STAT_ERR_NO_RECOV) > 0;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  if (status_changed)
+    store_emit_signal(objs, STATUS_UPDATE);
   
-  if ((objs->status & STAT_ERR_NO_RECOV) > 0)
-  {
-    act_log_error(act_log_msg("Need to save an image, but data store is currently unavailable."));
-    store_img_fallback(cur_img);
-    g_object_unref(cur_img);
-    return FALSE;
-  }
-  gboolean img_saved;
+  CcdImg *cur_img = cur_pend.img;
+  gboolean img_saved = FALSE;
   guchar i;
-  for (i=0; i<STORE_MAX_RETRIES; i++)
+  if (no_recov)
+    act_log_debug(act_log_msg("Data store was unavailable for the previous image, reconnecting before storing next image."));
+  else
   {
-    act_log_debug(act_log_msg("Trying to save image (%d / %d)", i, STORE_MAX_RETRIES));
-    img_saved = store_img(objs->store_conn, cur_img);
-    if (img_saved)
-      break;
-    act_log_debug(act_log_msg("Failed to save image to database, retrying (try %hhu/%hhu).", i+1, STORE_MAX_RETRIES));
-    if ((objs->status & STAT_ERR_RETRY) == 0)
+    for (i=0; i<STORE_MAX_RETRIES; i++)
     {
-      objs->status |= STAT_ERR_RETRY;
-      g_signal_emit(G_OBJECT(objs), acq_store_signals[STATUS_UPDATE], 0);
+      act_log_debug(act_log_msg("Trying to save image (%d / %d)", i, STORE_MAX_RETRIES));
+      img_saved = store_img(worker->conn, cur_img);
+      if (img_saved)
+        break;
+      act_log_debug(act_log_msg("Failed to save image to database, retrying (try %hhu/%hhu).", i+1, STORE_MAX_RETRIES));
+      store_set_status(objs, STAT_ERR_RETRY, 0);
     }
   }
   if (!img_saved)
   {
     act_log_debug(act_log_msg("Attempting to reconnect to MYSQL server."));
-    img_saved = store_reconnect(objs);
+    img_saved = store_reconnect(worker);
     if (img_saved)
-      img_saved = store_img(objs->store_conn, cur_img);
+      img_saved = store_img(worker->conn, cur_img);
     if (!img_saved)
     {
       act_log_crit(act_log_msg("Failed to reconnect to MySQL server and save an image. Please consult IT technician."));
-      objs->status &= ~STAT_ERR_RETRY;
-      objs->status |= STAT_ERR_NO_RECOV;
-      store_img_fallback(cur_img);
-      g_object_unref(cur_img);
-      return FALSE;
+      store_set_status(objs, STAT_ERR_NO_RECOV, STAT_ERR_RETRY);
+      if (cur_pend.fits_path == NULL)
+        store_img_fallback(objs, cur_img);
+      else
+        act_log_normal(act_log_msg("Keeping fallback image %s for a later attempt.", cur_pend.fits_path));
     }
   }
-  if ((objs->status & (STAT_ERR_NO_RECOV | STAT_ERR_RETRY)) > 0)
-  {
-    objs->status &= ~(STAT_ERR_NO_RECOV | STAT_ERR_RETRY);
-    g_signal_emit(G_OBJECT(objs), acq_store_signals[STATUS_UPDATE], 0);
-    g_object_unref(cur_img);
-    return FALSE;
-  }
+  if (img_saved)
+    store_set_status(objs, 0, STAT_ERR_NO_RECOV | STAT_ERR_RETRY);
+  store_img_done(objs, &cur_pend, img_saved);
   g_object_unref(cur_img);
   return TRUE;
 }
 
+/** \brief Add an image to the pending images queue, which must not be full.
+ * \param objs AcqStore object, queue_mutex must be held
+ * \param img Image to queue, a reference is taken
+ * \param fits_path Fallback file the image was read from (ownership is transferred to the queue), or NULL
+ * \return TRUE if the queue reached the high watermark (the caller must emit the "store-queue-high" signal)
+ */
+static gboolean store_queue_push(AcqStore *objs, CcdImg *img, gchar *fits_path)
+{
+  g_object_ref(G_OBJECT(img));
+  guint tail = (objs->queue_head + objs->queue_depth) % ACQ_STORE_QUEUE_LEN;
+  objs->queue[tail].img = img;
+  objs->queue[tail].queue_t = store_monotonic_sec();
+  objs->queue[tail].fits_path = fits_path;
+  objs->queue_depth++;
+  pthread_cond_signal(&objs->queue_cond);
+  if ((!objs->throttled) && (objs->queue_depth >= objs->high_mark))
+  {
+    objs->throttled = TRUE;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/** \brief Update counters and status once a worker has finished with an image, emitting signals as necessary.
+ *
+ * Deletes the fallback file an image was read from if it has now been stored.
+ */
+static void store_img_done(AcqStore *objs, struct acq_store_pend *pend, gboolean saved)
+{
+  gdouble latency = store_monotonic_sec() - pend->queue_t;
+  gboolean ingested = pend->fits_path != NULL;
+  if (ingested)
+  {
+    if ((saved) && (g_unlink(pend->fits_path) != 0))
+      act_log_error(act_log_msg("Stored fallback image %s, but failed to delete it - %s", pend->fits_path, strerror(errno)));
+    else if (saved)
+      act_log_debug(act_log_msg("Stored fallback image %s", pend->fits_path));
+    g_free(pend->fits_path);
+    pend->fits_path = NULL;
+  }
+  pthread_mutex_lock(&objs->queue_mutex);
+  if (ingested)
+    objs->num_ingest_pending--;
+  if (saved)
+  {
+    objs->num_stored++;
+    objs->latency_sum += latency;
+    objs->latency_last = latency;
+    if (latency > objs->latency_max)
+      objs->latency_max = latency;
+  }
+  else if (!ingested)
+    objs->num_fallback++;
+  objs->num_busy--;
+  gboolean went_low = FALSE, status_changed = FALSE;
+  if ((objs->throttled) && (objs->queue_depth <= objs->low_mark))
+  {
+    objs->throttled = FALSE;
+    went_low = TRUE;
+  }
+  if ((objs->num_busy == 0) && (objs->queue_depth == 0))
+  {
+    objs->status &= ~STAT_STORING;
+    status_changed = TRUE;
+  }
+  pthread_mutex_unlock(&objs->queue_mutex);
+  act_log_debug(act_log_msg("Image storage completed in %f seconds.", latency));
+  if (went_low)
+    store_emit_signal(objs, QUEUE_LOW);
+  if (status_changed)
+    store_emit_signal(objs, STATUS_UPDATE);
+}
+
 static gboolean store_img(MYSQL *conn, CcdImg *img)
 {
   /** \NOTE:
@@ -644,18 +1029,20 @@ static gboolean store_img(MYSQL *conn, CcdImg *img)
    * date is kept as a standard MySQL DATE type so the date can be set with relative ease and using the MySQL 
    * conversion routines.
    */
-  gushort img_width = ccd_img_get_img_width(img), img_height = ccd_img_get_img_height(img);
   gfloat tel_ra, tel_dec;
   ccd_img_get_tel_pos(img, &tel_ra, &tel_dec);
-  long len = IMG_QRY_PREF_LEN + IMG_QRY_PIX_LEN*img_width;
-  if (len < IMG_QRY_MIN_LEN)
-    len = IMG_QRY_MIN_LEN;
-  char *qrystr = malloc(len*sizeof(char));
+  char *qrystr = malloc(IMG_QRY_LEN*sizeof(char));
   if (qrystr == NULL)
   {
     act_log_error(act_log_msg("Failed to allocate memory for SQL query string."));
     return FALSE;
   }
+  if (mysql_query(conn, "START TRANSACTION;"))
+  {
+    act_log_error(act_log_msg("Failed to start image storage transaction - %s.", mysql_error(conn)));
+    free(qrystr);
+    return FALSE;
+  }
   gdouble start_time_s = fmod(ccd_img_get_start_datetime(img), 60*60*24);
   sprintf(qrystr, "INSERT INTO ccd_img (targ_id, user_id, type, exp_t_s, start_date, start_time_h, win_start_x, win_start_y, win_width, win_height, prebin_x, prebin_y, tel_ra_h, tel_dec_d) VALUES (%lu, %lu, %hhu, %f, DATE(FROM_UNIXTIME(%d)), %lf, %hu, %hu, %hu, %hu, %hu, %hu, %f, %f);", 
           ccd_img_get_targ_id(img),
@@ -690,181 +1077,228 @@ static gboolean store_img(MYSQL *conn, CcdImg *img)
     return FALSE;
   }
   act_log_debug(act_log_msg("Image ID: %lu", img_id));
+  free(qrystr);
   
-  gulong i, j;
-  MYSQL_STMT  *stmt;
-  stmt = mysql_stmt_init(conn);
-  if (!stmt)
+  if (!store_img_data(conn, img_id, img))
   {
-    act_log_error(act_log_msg("Failed to initialise MySQL prepared statement object - out of memory."));
+    act_log_error(act_log_msg("Entire image not saved. Rolling back database transactions."));
     mysql_query(conn, "ROLLBACK;");
-    free(qrystr);
     return FALSE;
   }
-  len = sprintf(qrystr, "INSERT INTO ccd_img_data (ccd_img_id, x, y, value) VALUES ");
-  for (j=0; j<img_width; j++)
-    len += sprintf(&qrystr[len], "(%10lu, ?, ?, ?),", img_id);
-  qrystr[len-1] = ';';
-  if (mysql_stmt_prepare(stmt, qrystr, strlen(qrystr)))
+  if (mysql_query(conn, "COMMIT;"))
   {
-    act_log_error(act_log_msg("Failed to prepare statement for inserting image pixel data - %s", mysql_stmt_error(stmt)));
+    act_log_error(act_log_msg("Failed to commit CCD image %lu to database - %s. Rolling back database transactions.", img_id, mysql_error(conn)));
     mysql_query(conn, "ROLLBACK;");
-    free(qrystr);
     return FALSE;
   }
-  if (mysql_stmt_param_count(stmt) != 3*img_width)
+  act_log_debug(act_log_msg("Finished saving image %lu", img_id));
+  return TRUE;
+}
+
+/** \brief Store the pixel data of an image in a single round trip to the database.
+ * \param conn MySQL connection over which to store the data.
+ * \param img_id Database identifier of the image header (ccd_img.id) the pixel data belongs to.
+ * \param img Image whose pixel data to store.
+ * \return TRUE on success, otherwise FALSE.
+ *
+ * The entire image is written as one row in the ccd_img_blob table, with the pixels packed as a row-major array of
+ * native (little-endian) 32-bit floats:
+ *
+ *   CREATE TABLE ccd_img_blob (ccd_img_id INT UNSIGNED NOT NULL PRIMARY KEY, width SMALLINT UNSIGNED NOT NULL,
+ *                              height SMALLINT UNSIGNED NOT NULL, data LONGBLOB NOT NULL);
+ *
+ * Images stored before the introduction of this table have their pixels in ccd_img_data (one row per pixel). Readers
+ * should check ccd_img_blob first and fall back to ccd_img_data when no blob exists for the image.
+ */
+static gboolean store_img_data(MYSQL *conn, gulong img_id, CcdImg *img)
+{
+  gushort img_width = ccd_img_get_img_width(img), img_height = ccd_img_get_img_height(img);
+  gulong img_len = ccd_img_get_img_len(img);
+  gfloat *img_data = ccd_img_get_img_data(img);
+  if ((img_data == NULL) || (img_len < (gulong)img_width*img_height))
   {
-    act_log_error(act_log_msg("Invalid number of parameters in prepared statement - %d",  mysql_stmt_param_count(stmt)));
-    mysql_query(conn, "ROLLBACK;");
-    free(qrystr);
+    act_log_error(act_log_msg("Image %lu pixel data incomplete (%lu pixels, should be %d).", img_id, img_len, img_width*img_height));
     return FALSE;
   }
-
-  gushort cur_x[img_width], cur_y[img_width];
-  gfloat cur_val[img_width];
-  MYSQL_BIND  bind[3*img_width];
-  memset(bind, 0, sizeof(bind));
-  for (j=0; j<img_width; j++)
-  {
-    bind[j*3+0].buffer_type = MYSQL_TYPE_SHORT;
-    bind[j*3+0].buffer = (char *)&cur_x[j];
-    bind[j*3+0].is_null = 0;
-    bind[j*3+0].length = 0;
-    bind[j*3+0].is_unsigned = TRUE;
-    bind[j*3+1].buffer_type = MYSQL_TYPE_SHORT;
-    bind[j*3+1].buffer = (char *)&cur_y[j];
-    bind[j*3+1].is_null = 0;
-    bind[j*3+1].length = 0;
-    bind[j*3+1].is_unsigned = TRUE;
-    bind[j*3+2].buffer_type = MYSQL_TYPE_FLOAT;
-    bind[j*3+2].buffer = (char *)&cur_val[j];
-    bind[j*3+2].is_null = 0;
-    bind[j*3+2].length = 0;
-    cur_x[j] = j;
+  
+  MYSQL_STMT *stmt = mysql_stmt_init(conn);
+  if (!stmt)
+  {
+    act_log_error(act_log_msg("Failed to initialise MySQL prepared statement object - out of memory."));
+    return FALSE;
   }
-  if (mysql_stmt_bind_param(stmt, bind))
+  const char qrystr[] = "INSERT INTO ccd_img_blob (ccd_img_id, width, height, data) VALUES (?, ?, ?, ?);";
+  if (mysql_stmt_prepare(stmt, qrystr, strlen(qrystr)))
   {
-    act_log_error(act_log_msg("Failed to bind parameters for prepared statement - %s", mysql_stmt_error(stmt)));
-    mysql_query(conn, "ROLLBACK;");
-    free(qrystr);
+    act_log_error(act_log_msg("Failed to prepare statement for inserting image pixel data - %s", mysql_stmt_error(stmt)));
+    mysql_stmt_close(stmt);
     return FALSE;
   }
   
-  gboolean ret = TRUE;
-  gfloat *img_data = ccd_img_get_img_data(img);
-  act_log_debug(act_log_msg("Starting image %d save", img_id));
-  for (i=0; i<img_height; i++)
+  guint32 db_img_id = img_id;
+  unsigned long data_len = (unsigned long)img_width*img_height*sizeof(gfloat);
+  MYSQL_BIND bind[4];
+  memset(bind, 0, sizeof(bind));
+  bind[0].buffer_type = MYSQL_TYPE_LONG;
+  bind[0].buffer = (char *)&db_img_id;
+  bind[0].is_unsigned = TRUE;
+  bind[1].buffer_type = MYSQL_TYPE_SHORT;
+  bind[1].buffer = (char *)&img_width;
+  bind[1].is_unsigned = TRUE;
+  bind[2].buffer_type = MYSQL_TYPE_SHORT;
+  bind[2].buffer = (char *)&img_height;
+  bind[2].is_unsigned = TRUE;
+  bind[3].buffer_type = MYSQL_TYPE_LONG_BLOB;
+  bind[3].buffer = (char *)img_data;
+  bind[3].buffer_length = data_len;
+  bind[3].length = &data_len;
+  if (mysql_stmt_bind_param(stmt, bind))
   {
-    for (j=0; j<img_width; j++)
-    {
-      cur_y[j] = i;
-//       cur_val[j] = ccd_img_get_pixel(img, j, i);
-    }
-    memcpy(cur_val, &img_data[i*img_width], sizeof(cur_val));
-    if (mysql_stmt_execute(stmt))
-    {
-      act_log_error(act_log_msg("Failed to execute prepared statement to insert image %lu row %d into database - %s", img_id, i, mysql_stmt_error(stmt)));
-      ret = FALSE;
-      break;
-    }
-    else if (i%10 == 0)
-      act_log_debug(act_log_msg("Image %lu row %d inserted into database", img_id, i));
+    act_log_error(act_log_msg("Failed to bind parameters for prepared statement - %s", mysql_stmt_error(stmt)));
+    mysql_stmt_close(stmt);
+    return FALSE;
   }
-  if (!ret)
+  
+  act_log_debug(act_log_msg("Starting image %lu save (%lu bytes)", img_id, data_len));
+  if (mysql_stmt_execute(stmt))
   {
-    act_log_error(act_log_msg("Entire image not saved. Rolling back database transactions."));
-    mysql_query(conn, "ROLLBACK;");
-    free(qrystr);
+    act_log_error(act_log_msg("Failed to execute prepared statement to insert image %lu pixel data into database - %s", img_id, mysql_stmt_error(stmt)));
+    mysql_stmt_close(stmt);
     return FALSE;
   }
-  mysql_query(conn, "COMMIT;");
-  act_log_debug(act_log_msg("Finished saving image %lu", img_id));
-  free(qrystr);
+  mysql_stmt_close(stmt);
   return TRUE;
 }
 
-static void store_img_fallback(CcdImg *img)
+/** \brief Full path of the fallback directory, or NULL if the home directory cannot be determined. */
+static gchar *fallback_dir_path(void)
 {
-  static char *fallback_path = NULL;
-  if (fallback_path == NULL)
+  const char* homedir;
+  homedir = getenv("HOME");
+  if (homedir == NULL)
   {
-    const char* homedir;
-    homedir = getenv("HOME");
+    struct passwd *pw = getpwuid(getuid());
+    homedir = pw != NULL ? pw->pw_dir : NULL;
     if (homedir == NULL)
     {
-      struct passwd *pw = getpwuid(getuid());
-      homedir = pw->pw_dir;
-      if (homedir == NULL)
-      {
-        act_log_error(act_log_msg("Need to save an image to the fallback directory, but cannot determine software home directory. Image will be lost."));
-        return;
-      }
-    }
-    int len = strlen(homedir);
-    fallback_path = malloc(len+20);
-    if (homedir[len-1] == '/')
-      sprintf(fallback_path, "%sacq_img_fallback/", homedir);
-    else
-      sprintf(fallback_path, "%s/acq_img_fallback/", homedir);
-    DIR* dir = opendir(fallback_path);
-    if (dir != NULL)
-    {
-      /* Directory exists. */
-      closedir(dir);
-    }
-    else if (errno == ENOENT)
-    {
-      /* Directory does not exist. */
-      mkdir(fallback_path, 0755);
-    }
-    else
-    {
-      /* opendir() failed for some other reason. */
-      act_log_error(act_log_msg("Need to save an image to the fallback directory (%s), but an error occurred while trying to open the directory - %s", fallback_path, strerror(errno)));
-      return;
+      act_log_error(act_log_msg("Cannot determine software home directory for fallback image storage."));
+      return NULL;
     }
   }
-  
-  char filepath[strlen(fallback_path)+50];
-  sprintf(filepath, "%s%ld.dat", fallback_path, (long)trunc(ccd_img_get_start_datetime(img)));
-  FILE *fp = fopen(filepath, "ab");
-  if (fp == NULL)
+  return g_build_filename(homedir, FALLBACK_DIR_NAME, NULL);
+}
+
+/** \brief Save an image that could not be stored in the database to a FITS file in the fallback directory.
+ *
+ * The file is written in the background if possible, otherwise immediately. acq_store_ingest_fallback queues such
+ * files for storage again.
+ */
+static void store_img_fallback(AcqStore *objs, CcdImg *img)
+{
+  if (objs->fallback_dir == NULL)
+  {
+    act_log_error(act_log_msg("No fallback directory available. Image will be lost."));
+    return;
+  }
+  if ((objs->fallback_writer != NULL) && (acq_fits_writer_append(objs->fallback_writer, img)))
+    return;
+  act_log_debug(act_log_msg("Fallback FITS writer unavailable or busy, saving image synchronously."));
+  if (g_mkdir_with_parents(objs->fallback_dir, 0755) != 0)
   {
-    act_log_error(act_log_msg("Failed to open file %s for fallback image storage. Image will be lost. Error - %s", filepath, strerror(errno)));
+    act_log_error(act_log_msg("Failed to create fallback directory %s - %s. Image will be lost.", objs->fallback_dir, strerror(errno)));
     return;
   }
-  fwrite(img+sizeof(GObject), 1, sizeof(CcdImg)-sizeof(GObject), fp);
-  fclose(fp);
+  gchar *filepath = acq_fits_save_img(img, objs->fallback_dir, TRUE);
+  if (filepath == NULL)
+    act_log_error(act_log_msg("Failed to save image to fallback directory %s. Image will be lost.", objs->fallback_dir));
+  g_free(filepath);
 }
 
-static gboolean store_reconnect(AcqStore *objs)
+static gint fits_name_cmp(gconstpointer name1, gconstpointer name2)
 {
-  if (objs->sqlhost == NULL)
+  return strcmp(*(gchar * const *)name1, *(gchar * const *)name2);
+}
+
+static gboolean store_reconnect(struct acq_store_worker *worker)
+{
+  if (worker->objs->sqlhost == NULL)
   {
     act_log_error(act_log_msg("Hostname of database server not available."));
     return FALSE;
   }
   act_log_debug(act_log_msg("Recreating MySQL image storage connection."));
-  MYSQL *store_conn;
-  store_conn = mysql_init(NULL);
+  MYSQL *store_conn = store_connect(worker->objs->sqlhost);
   if (store_conn == NULL)
-  {
-    act_log_error(act_log_msg("Error initialising MySQL image storage connection handler - %s.", mysql_error(store_conn)));
     return FALSE;
-  }
-  if (mysql_real_connect(store_conn, objs->sqlhost, "act_acq", NULL, "act", 0, NULL, 0) == NULL)
-  {
-    act_log_error(act_log_msg("Error establishing image storage connecting to MySQL database - %s.", mysql_error(store_conn)));
-    mysql_close(store_conn);
-    return FALSE;
-  }
-  if (objs->store_conn != NULL)
-    mysql_close(objs->store_conn);
-  objs->store_conn = store_conn;
+  if (worker->conn != NULL)
+    mysql_close(worker->conn);
+  worker->conn = store_conn;
   
   return TRUE;
 }
 
+/** \brief Set and clear status flags, emitting "store-status-update" if the status changed. */
+static void store_set_status(AcqStore *objs, guchar set_flags, guchar clear_flags)
+{
+  pthread_mutex_lock(&objs->queue_mutex);
+  guchar old_stat = objs->status;
+  objs->status = (objs->status & ~clear_flags) | set_flags;
+  gboolean changed = objs->status != old_stat;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  if (changed)
+    store_emit_signal(objs, STATUS_UPDATE);
+}
+
+struct store_emit_data
+{
+  AcqStore *objs;
+  guint signal_id;
+};
+
+/** \brief Emit a signal from a storage worker thread.
+ *
+ * The emission is deferred to the main loop so signal handlers (which typically update the GUI) always run in the
+ * main thread.
+ */
+static void store_emit_signal(AcqStore *objs, guint signal_id)
+{
+  pthread_mutex_lock(&objs->queue_mutex);
+  gboolean exiting = objs->exiting;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  if (exiting)
+    return;
+  struct store_emit_data *emit_data = malloc(sizeof(struct store_emit_data));
+  if (emit_data == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for storage signal emission."));
+    return;
+  }
+  g_object_ref(G_OBJECT(objs));
+  emit_data->objs = objs;
+  emit_data->signal_id = signal_id;
+  g_idle_add(store_emit_idle, emit_data);
+}
+
+static gboolean store_emit_idle(gpointer emit_data)
+{
+  struct store_emit_data *data = (struct store_emit_data *)emit_data;
+  AcqStore *objs = data->objs;
+  if (data->signal_id == STATUS_UPDATE)
+    g_signal_emit(G_OBJECT(objs), acq_store_signals[STATUS_UPDATE], 0);
+  else
+    g_signal_emit(G_OBJECT(objs), acq_store_signals[data->signal_id], 0, data->signal_id == QUEUE_HIGH ? objs->high_mark : objs->low_mark);
+  g_object_unref(G_OBJECT(objs));
+  free(data);
+  return FALSE;
+}
+
+static gdouble store_monotonic_sec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
 static guchar img_type_acq_to_db(guchar acq_img_type)
 {
   guchar ret;
@@ -1022,8 +1456,155 @@ static PointList *get_catalog_stars(MYSQL *conn, string256 qrystr)
     }
     point_list_append(list, point_ra, point_dec);
   }
+  mysql_free_result(result);
   act_log_debug(act_log_msg("Stars retrieved from database: %u", point_list_get_num_used(list)));
   if (point_list_get_num_used(list) != (guint)rowcount)
     act_log_error(act_log_msg("Not all catalog stars extracted from database (%u should be %d).", point_list_get_num_used(list), rowcount));
   return list;
 }
+
+/** \brief Request the catalogue zones needed for a search around the given declination and make sure the loader
+ *         thread is running.
+ */
+static void cat_preload(AcqStore *objs, cat_cache_t *cache, gfloat dec_d, gfloat radius_d)
+{
+  if (cache == NULL)
+    return;
+  pthread_mutex_lock(&objs->queue_mutex);
+  gboolean exiting = objs->exiting;
+  pthread_mutex_unlock(&objs->queue_mutex);
+  if (exiting)
+    return;
+  
+  pthread_mutex_lock(&objs->cat_mutex);
+  if ((!cat_cache_request(cache, dec_d, radius_d)) || (objs->cat_loader_running))
+  {
+    pthread_mutex_unlock(&objs->cat_mutex);
+    return;
+  }
+  // the previous loader thread (if any) has run out of zones to load and is exiting
+  if (objs->cat_loader_started)
+  {
+    pthread_join(objs->cat_loader_thr, NULL);
+    objs->cat_loader_started = FALSE;
+  }
+  gint ret = pthread_create(&objs->cat_loader_thr, NULL, cat_loader, (void *)objs);
+  if (ret != 0)
+  {
+    act_log_error(act_log_msg("Failed to create catalogue loader thread - %s.", strerror(ret)));
+    gint zone;
+    while ((zone = cat_cache_next_request(cache)) >= 0)
+      cat_cache_fail_zone(cache, zone);
+  }
+  else
+    objs->cat_loader_started = objs->cat_loader_running = TRUE;
+  pthread_mutex_unlock(&objs->cat_mutex);
+}
+
+/** \brief Catalogue loader thread - loads requested catalogue zones until none are left.
+ *
+ * Zones that cannot be loaded are marked empty again, so they will be requested again by the next cache miss.
+ */
+static void *cat_loader(void *acq_store)
+{
+  AcqStore *objs = (AcqStore *)acq_store;
+  mysql_thread_init();
+  MYSQL *conn = store_connect(objs->sqlhost);
+  if (conn == NULL)
+    act_log_error(act_log_msg("Failed to create catalogue loader MySQL connection."));
+  
+  gint zone;
+  cat_cache_t *cache;
+  gchar const *cat_table;
+  while (TRUE)
+  {
+    pthread_mutex_lock(&objs->queue_mutex);
+    gboolean exiting = objs->exiting;
+    pthread_mutex_unlock(&objs->queue_mutex);
+    
+    pthread_mutex_lock(&objs->cat_mutex);
+    cache = objs->gsc1_cache;
+    cat_table = "gsc1";
+    zone = exiting ? -1 : cat_cache_next_request(cache);
+    if ((zone < 0) && (!exiting))
+    {
+      cache = objs->tycho_cache;
+      cat_table = "tycho2";
+      zone = cat_cache_next_request(cache);
+    }
+    if (zone < 0)
+    {
+      objs->cat_loader_running = FALSE;
+      pthread_mutex_unlock(&objs->cat_mutex);
+      break;
+    }
+    pthread_mutex_unlock(&objs->cat_mutex);
+    
+    if (conn == NULL)
+      cat_cache_fail_zone(cache, zone);
+    else
+      cat_load_zone(conn, cache, cat_table, zone);
+  }
+  
+  if (conn != NULL)
+    mysql_close(conn);
+  mysql_thread_end();
+  return 0;
+}
+
+static void cat_load_zone(MYSQL *conn, cat_cache_t *cache, gchar const *cat_table, guint zone)
+{
+  gfloat dec_min_d, dec_max_d;
+  cat_cache_zone_limits(zone, &dec_min_d, &dec_max_d);
+  string256 qrystr;
+  gchar const *max_cmp = zone == CAT_CACHE_NUM_ZONES-1 ? "<=" : "<";
+  // the GSC-1.2 table is indexed by region, so narrow the scan down to the regions overlapping the zone
+  if (strcmp(cat_table, "gsc1") == 0)
+    sprintf(qrystr, "SELECT ra_d_fk5, dec_d_fk5 FROM gsc1 WHERE reg_id IN (SELECT id FROM gsc1_reg WHERE dec_max>=%f AND dec_min<=%f) AND dec_d_fk5>=%f AND dec_d_fk5%s%f;", dec_min_d, dec_max_d, dec_min_d, max_cmp, dec_max_d);
+  else
+    sprintf(qrystr, "SELECT ra_d_fk5, dec_d_fk5 FROM %s WHERE dec_d_fk5>=%f AND dec_d_fk5%s%f;", cat_table, dec_min_d, max_cmp, dec_max_d);
+  act_log_debug(act_log_msg("Loading catalogue zone %u (%f to %f) from %s.", zone, dec_min_d, dec_max_d, cat_table));
+  
+  MYSQL_RES *result;
+  MYSQL_ROW row;
+  mysql_query(conn, qrystr);
+  result = mysql_store_result(conn);
+  if ((result == NULL) || (mysql_num_fields(result) != 2))
+  {
+    act_log_error(act_log_msg("Could not load catalogue zone %u from %s - %s.", zone, cat_table, mysql_error(conn)));
+    if (result != NULL)
+      mysql_free_result(result);
+    cat_cache_fail_zone(cache, zone);
+    return;
+  }
+  guint rowcount = mysql_num_rows(result);
+  gfloat *ra_d = malloc((rowcount > 0 ? rowcount : 1)*sizeof(gfloat));
+  gfloat *dec_d = malloc((rowcount > 0 ? rowcount : 1)*sizeof(gfloat));
+  if ((ra_d == NULL) || (dec_d == NULL))
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for catalogue zone %u (%u stars).", zone, rowcount));
+    free(ra_d);
+    free(dec_d);
+    mysql_free_result(result);
+    cat_cache_fail_zone(cache, zone);
+    return;
+  }
+  
+  guint num_stars = 0;
+  gchar *endptr_ra, *endptr_dec;
+  while ((row = mysql_fetch_row(result)) != NULL)
+  {
+    if ((row[0] == NULL) || (row[1] == NULL))
+      continue;
+    ra_d[num_stars] = strtof(row[0], &endptr_ra);
+    dec_d[num_stars] = strtof(row[1], &endptr_dec);
+    if ((endptr_ra == row[0]) || (endptr_dec == row[1]))
+      continue;
+    num_stars++;
+  }
+  mysql_free_result(result);
+  if (num_stars != rowcount)
+    act_log_error(act_log_msg("Not all stars of catalogue zone %u extracted from %s (%u should be %u).", zone, cat_table, num_stars, rowcount));
+  act_log_debug(act_log_msg("Catalogue zone %u loaded from %s: %u stars.", zone, cat_table, num_stars));
+  cat_cache_set_zone(cache, zone, num_stars, ra_d, dec_d);
+}
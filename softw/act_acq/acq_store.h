@@ -8,6 +8,8 @@
 #include "ccd_cntrl.h"
 #include "ccd_img.h"
 #include "point_list.h"
+#include "cat_cache.h"
+#include "acq_fits.h"
 #include "act_ipc.h"
 
 typedef struct _acq_filters_list_t{ struct filtaper filt[IPC_MAX_NUM_FILTAPERS]; } acq_filters_list_t;
@@ -20,20 +22,66 @@ G_BEGIN_DECLS
 #define IS_ACQ_STORE(objs)          (G_TYPE_CHECK_INSTANCE_TYPE ((objs), ACQ_STORE_TYPE))
 #define IS_ACQ_STORE_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), ACQ_STORE_TYPE))
 
+/// Number of storage worker threads, each with its own database connection
+#define ACQ_STORE_NUM_WORKERS  2
+/// Maximum number of images that can be waiting to be stored
+#define ACQ_STORE_QUEUE_LEN    32
+
 typedef struct _AcqStore       AcqStore;
 typedef struct _AcqStoreClass  AcqStoreClass;
 
+/// Storage worker thread and its private database connection
+struct acq_store_worker
+{
+  AcqStore *objs;
+  pthread_t thr;
+  MYSQL *conn;
+};
+
+/// Entry in the pending images queue
+struct acq_store_pend
+{
+  CcdImg *img;
+  /// Monotonic time (in seconds) at which the image was queued
+  gdouble queue_t;
+  /// Fallback FITS file the image was read from (deleted once the image is stored), NULL for new images
+  gchar *fits_path;
+};
+
 struct _AcqStore
 {
   GObject parent;
   
   guchar status;
-  pthread_t store_thr;
   gchar *sqlhost;
-  MYSQL *store_conn;
   MYSQL *genl_conn;
-  GSList *img_pend;
-  pthread_mutex_t img_list_mutex;
+  struct acq_store_worker workers[ACQ_STORE_NUM_WORKERS];
+  
+  /// Bounded ring of pending images, protected by queue_mutex
+  struct acq_store_pend queue[ACQ_STORE_QUEUE_LEN];
+  guint queue_head, queue_depth;
+  guint num_busy;
+  guint high_mark, low_mark;
+  gboolean throttled, exiting;
+  pthread_mutex_t queue_mutex;
+  pthread_cond_t queue_cond;
+  
+  /// Storage counters, protected by queue_mutex
+  gulong num_stored, num_fallback;
+  gdouble latency_sum, latency_max, latency_last;
+  /// Number of images from the fallback directory still pending, protected by queue_mutex
+  guint num_ingest_pending;
+  
+  /// FITS writers for images that cannot be stored in the database, and for archiving all images (may be NULL)
+  gchar *fallback_dir;
+  acq_fits_writer_t *fallback_writer, *archive_writer;
+  
+  /// In-memory catalogue caches, filled in the background by the catalogue loader thread
+  cat_cache_t *gsc1_cache, *tycho_cache;
+  pthread_t cat_loader_thr;
+  /// Loader thread state, protected by cat_mutex
+  gboolean cat_loader_started, cat_loader_running;
+  pthread_mutex_t cat_mutex;
 };
 
 struct _AcqStoreClass
@@ -50,7 +98,13 @@ gchar *acq_store_get_user_name(AcqStore *objs, gulong user_id);
 gboolean acq_store_get_filt_list(AcqStore *objs, acq_filters_list_t *ccd_filters);
 PointList *acq_store_get_tycho_pattern(AcqStore *objs, gfloat ra_d, gfloat dec_d, gfloat equinox, gfloat radius_d);
 PointList *acq_store_get_gsc1_pattern(AcqStore *objs, gfloat ra_d, gfloat dec_d, gfloat equinox, gfloat radius_d);
+void acq_store_preload_gsc1(AcqStore *objs, gfloat dec_d, gfloat radius_d);
 void acq_store_append_image(AcqStore *objs, CcdImg *new_img);
+gboolean acq_store_set_fits_dir(AcqStore *objs, gchar const *fits_dir);
+guint acq_store_ingest_fallback(AcqStore *objs);
+void acq_store_set_watermarks(AcqStore *objs, guint high_mark, guint low_mark);
+guint acq_store_get_queue_depth(AcqStore *objs);
+void acq_store_get_counters(AcqStore *objs, gulong *num_stored, gulong *num_fallback, gdouble *latency_mean, gdouble *latency_max, gdouble *latency_last);
 gboolean acq_store_idle(AcqStore *objs);
 gboolean acq_store_storing(AcqStore *objs);
 gboolean acq_store_error_retry(AcqStore *objs);
@@ -0,0 +1,39 @@
+#ifndef __ACQ_TIMING_H__
+#define __ACQ_TIMING_H__
+
+#include <act_timing.h>
+
+/** \brief Stages of the acquisition pipeline timed with act_timing.
+ *
+ * A frame starts when the camera driver reports a new image and ends once the image has been handled (pattern
+ * matched, displayed and queued for storage).
+ */
+enum
+{
+  /// Reading the image from the camera driver's ring
+  ACQ_TIMING_CCD_READ = 0,
+  /// Converting raw pixels to floating point (on first use, possibly inside another stage or thread)
+  ACQ_TIMING_CONVERT,
+  /// Uploading the image texture for display
+  ACQ_TIMING_DISPLAY,
+  /// Estimating and subtracting the sky background
+  ACQ_TIMING_BACKGROUND,
+  /// Extracting stars and converting their positions to RA and Dec
+  ACQ_TIMING_EXTRACT,
+  /// Fetching catalogue stars around the telescope position
+  ACQ_TIMING_CAT_QUERY,
+  /// Asterism (rotation and scale) matching
+  ACQ_TIMING_ASTERISM,
+  /// Translation-only matching (find_point_list_map)
+  ACQ_TIMING_POINT_MAP,
+  /// Queueing the image for storage
+  ACQ_TIMING_STORE,
+  /// Sending the target set response to the controller
+  ACQ_TIMING_RESPONSE,
+  ACQ_TIMING_NUM_STAGES
+};
+
+/// Names of the stages (in the timing file), in the same order as the stage numbers
+#define ACQ_TIMING_STAGE_NAMES { "ccd_read", "convert", "display", "background", "extract", "cat_query", "asterism", "point_map", "store", "response" }
+
+#endif
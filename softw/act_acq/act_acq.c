@@ -14,6 +14,7 @@
 #include "expose_dialog.h"
 #include "point_list.h"
 #include "pattern_match.h"
+#include "acq_timing.h"
 #include "sep/sep.h"
 
 #define TABLE_PADDING 3
@@ -45,6 +46,22 @@
 #define TARGSET_CENT_RADIUS      0.002777777777777778
 /** \} */
 
+/// Match radius (degrees) for the asterism matcher, which fits out field rotation and plate scale errors
+#define PAT_FIT_RADIUS           0.002777777777777778
+
+/// Number of image strips (and threads) used to extract stars from acquisition images
+#define EXTRACT_NUM_THREADS      4
+
+/** \brief Star extraction parameters
+ * The sky background and its RMS are estimated in EXTRACT_BACK_TILE x EXTRACT_BACK_TILE pixel tiles (median filtered
+ * over EXTRACT_BACK_FILTER x EXTRACT_BACK_FILTER tiles) and stars are extracted where the background-subtracted image
+ * exceeds EXTRACT_THRESH_SIGMA times the local RMS.
+ * \{ */
+#define EXTRACT_BACK_TILE        64
+#define EXTRACT_BACK_FILTER      3
+#define EXTRACT_THRESH_SIGMA     1.5
+/** \} */
+
 /// Converts time in seconds since the UNIX epoch to fractional number of years (for coordinates epoch)
 #define SEC_TO_YEAR(sec)   (1970 + sec/(float)31556926)
 
@@ -84,6 +101,18 @@ struct acq_objects
   guchar last_imgt;
   gfloat last_integ_t;
   guint last_repeat;
+  
+  /// Triangle index of the last catalogue field used for auto target set
+  asterism_index_t *pat_index;
+  /// SEP extraction contexts, one per extraction thread, reused for every image
+  sep_context *sep_ctx[EXTRACT_NUM_THREADS];
+  /// Background interpolation weights and background, RMS and background-subtracted images, reused while the image size stays the same
+  struct extract_back
+  {
+    gushort width, height;
+    sepbackinterp *interp;
+    gfloat *back, *rms, *sub;
+  } back;
 };
 
 void acq_net_init(AcqNet *net, AcqStore *store, CcdCntrl *cntrl);
@@ -104,10 +133,12 @@ void manual_pattern_match(struct acq_objects *objs, CcdImg *img);
 void manual_pattern_match_msg(GtkWidget *parent, guint type, const char *msg);
 void print_point_list(const char *heading, PointList *list);
 void image_auto_target_set(struct acq_objects *objs, CcdImg *img);
-PointList *image_extract_stars(CcdImg *img, GtkWidget *imgdisp);
+PointList *image_extract_stars(struct acq_objects *objs, CcdImg *img);
 guchar targset_integ_retry(CcdCntrl *cntrl, CcdImg *img);
 gboolean reconnect_timeout(gpointer user_data);
 void store_stat_update(GObject *acq_store, gpointer lbl_store_stat);
+void store_queue_high(GObject *acq_store, guint queue_depth, gpointer user_data);
+void store_queue_low(GObject *acq_store, guint queue_depth, gpointer user_data);
 void coord_received(GObject *acq_net, gdouble tel_ra, gdouble tel_dec, gpointer user_data);
 void guisock_received(GObject *acq_net, gulong win_id, gpointer box_main);
 void destroy_gui_plug(GtkWidget *plug, gpointer box_main);
@@ -126,12 +157,15 @@ int main(int argc, char** argv)
   act_log_debug(act_log_msg("Pattern search radius: %f", DEFAULT_RADIUS));
   
   const char *host, *port, *sqlhost;
+  gchar *fits_dir = NULL, *timing_file = NULL;
   gtk_init(&argc, &argv);
   struct arg_str *addrarg = arg_str1("a", "addr", "<str>", "The host to connect to. May be a hostname, IP4 address or IP6 address.");
   struct arg_str *portarg = arg_str1("p", "port", "<str>", "The port to connect to. Must be an unsigned short integer.");
   struct arg_str *sqlconfigarg = arg_str1("s", "sqlconfighost", "<server ip/hostname>", "The hostname or IP address of the SQL server than contains act_control's configuration information");
+  struct arg_str *fitsdirarg = arg_str0("f", "fitsdir", "<directory>", "Also save all images as compressed FITS files in this directory.");
+  struct arg_str *timingarg = arg_str0("t", "timingfile", "<file>", "Write the timeline of each image through the acquisition pipeline and rolling percentiles of each stage to this file.");
   struct arg_end *endargs = arg_end(10);
-  void* argtable[] = {addrarg, portarg, sqlconfigarg, endargs};
+  void* argtable[] = {addrarg, portarg, sqlconfigarg, fitsdirarg, timingarg, endargs};
   if (arg_nullcheck(argtable) != 0)
     act_log_error(act_log_msg("Argument parsing error: insufficient memory."));
   int argparse_errors = arg_parse(argc,argv,argtable);
@@ -143,8 +177,17 @@ int main(int argc, char** argv)
   host = addrarg->sval[0];
   port = portarg->sval[0];
   sqlhost = sqlconfigarg->sval[0];
+  if (fitsdirarg->count > 0)
+    fits_dir = g_strdup(fitsdirarg->sval[0]);
+  if (timingarg->count > 0)
+    timing_file = g_strdup(timingarg->sval[0]);
   arg_freetable(argtable,sizeof(argtable)/sizeof(argtable[0]));
   
+  static const char *const timing_stages[ACQ_TIMING_NUM_STAGES] = ACQ_TIMING_STAGE_NAMES;
+  if ((timing_file != NULL) && (act_timing_open(timing_file, timing_stages, ACQ_TIMING_NUM_STAGES) < 0))
+    act_log_error(act_log_msg("Failed to open timing file %s. Acquisition pipeline will not be timed.", timing_file));
+  g_free(timing_file);
+  
   CcdCntrl *cntrl = ccd_cntrl_new();
   if (cntrl == NULL)
   {
@@ -159,6 +202,9 @@ int main(int argc, char** argv)
     g_object_unref(G_OBJECT(cntrl));
     return 1;
   }
+  if ((fits_dir != NULL) && (!acq_store_set_fits_dir(store, fits_dir)))
+    act_log_error(act_log_msg("Failed to start saving images to FITS directory %s. Images will only be stored in the database.", fits_dir));
+  g_free(fits_dir);
   
   AcqNet *net = acq_net_new(host, port);
   if (net == NULL)
@@ -228,7 +274,12 @@ int main(int argc, char** argv)
     .last_imgt = IMGT_NONE,
     .last_integ_t = 1.0,
     .last_repeat = 1,
+    .pat_index = NULL,
+    .back = { .width = 0, .height = 0, .interp = NULL, .back = NULL, .rms = NULL, .sub = NULL },
   };
+  gint i;
+  for (i=0; i<EXTRACT_NUM_THREADS; i++)
+    objs.sep_ctx[i] = sep_context_new();
   sprintf(objs.cur_targ_name, "ACT_ANY");
   sprintf(objs.cur_user_name, "ACT_ANY");
   prog_change_mode(&objs, MODE_IDLE);
@@ -243,6 +294,8 @@ int main(int argc, char** argv)
   g_signal_connect (G_OBJECT(cntrl), "ccd-integ-rem", G_CALLBACK (ccd_integt_update), lbl_integ_rem);
   g_signal_connect (G_OBJECT(cntrl), "ccd-new-image", G_CALLBACK (ccd_new_image), &objs);
   g_signal_connect (G_OBJECT(store), "store-status-update", G_CALLBACK(store_stat_update), lbl_store_stat);
+  g_signal_connect (G_OBJECT(store), "store-queue-high", G_CALLBACK(store_queue_high), &objs);
+  g_signal_connect (G_OBJECT(store), "store-queue-low", G_CALLBACK(store_queue_low), &objs);
   g_signal_connect (G_OBJECT(net), "coord-received", G_CALLBACK(coord_received), &objs);
   g_signal_connect (G_OBJECT(net), "gui-socket", G_CALLBACK(guisock_received), box_main);
   g_signal_connect (G_OBJECT(net), "change-user", G_CALLBACK(change_user), &objs);
@@ -253,6 +306,7 @@ int main(int argc, char** argv)
   g_signal_connect (G_OBJECT(net), "data-ccd-stop", G_CALLBACK(data_ccd_stop), &objs);
   gint guicheck_to_id = g_timeout_add(GUICHECK_LOOP_PERIOD, guicheck_timeout, &objs);
   ccd_cntrl_gen_test_image(cntrl);
+  acq_store_ingest_fallback(store);
   
   act_log_debug(act_log_msg("Entering main loop."));
   gtk_main();
@@ -263,6 +317,14 @@ int main(int argc, char** argv)
   g_object_unref(G_OBJECT(net));
   g_object_unref(G_OBJECT(store));
   g_object_unref(G_OBJECT(cntrl));
+  asterism_index_free(objs.pat_index);
+  for (i=0; i<EXTRACT_NUM_THREADS; i++)
+    sep_context_free(objs.sep_ctx[i]);
+  sep_freebackinterp(objs.back.interp);
+  g_free(objs.back.back);
+  g_free(objs.back.rms);
+  g_free(objs.back.sub);
+  act_timing_close();
   return 0;
 }
 
@@ -598,8 +660,12 @@ void ccd_new_image(GObject *ccd_cntrl, GObject *img, gpointer user_data)
   
   gtk_widget_set_size_request(objs->imgdisp, ccd_cntrl_get_max_width(objs->cntrl), ccd_cntrl_get_max_height(objs->cntrl));
   imgdisp_set_window(objs->imgdisp, 0, 0, ccd_img_get_img_width(CCD_IMG(img)), ccd_img_get_img_height(CCD_IMG(img)));
+  unsigned long long span_start = act_timing_start();
   imgdisp_set_img(objs->imgdisp, CCD_IMG(img));
+  act_timing_end(ACQ_TIMING_DISPLAY, span_start);
+  span_start = act_timing_start();
   acq_store_append_image(objs->store, CCD_IMG(img));
+  act_timing_end(ACQ_TIMING_STORE, span_start);
   g_object_unref(G_OBJECT(img));
 }
 
@@ -607,7 +673,7 @@ void manual_pattern_match(struct acq_objects *objs, CcdImg *img)
 {
   char msg_str[256] = "No error message";
   // Extract stars from image
-  PointList *img_pts = image_extract_stars(img, objs->imgdisp);
+  PointList *img_pts = image_extract_stars(objs, img);
   gint num_stars = point_list_get_num_used(img_pts);
   act_log_debug(act_log_msg("Manual img - number of stars extracted from image: %d\n", num_stars));
   if (num_stars < MIN_NUM_STARS)
@@ -622,7 +688,9 @@ void manual_pattern_match(struct acq_objects *objs, CcdImg *img)
   gfloat img_ra, img_dec;
   ccd_img_get_tel_pos(img, &img_ra, &img_dec);
   gdouble img_start_sec = ccd_img_get_start_datetime(img);
+  unsigned long long span_start = act_timing_start();
   PointList *pat_pts = acq_store_get_gsc1_pattern(objs->store, img_ra, img_dec, SEC_TO_YEAR(img_start_sec), PAT_SEARCH_RADIUS);
+  act_timing_end(ACQ_TIMING_CAT_QUERY, span_start);
   if (pat_pts == NULL)
   {
     sprintf(msg_str, "Failed to fetch GSC catalog stars.");
@@ -640,7 +708,9 @@ void manual_pattern_match(struct acq_objects *objs, CcdImg *img)
   print_point_list("Pattern points", pat_pts);
   
   // Match the two lists of points
+  span_start = act_timing_start();
   GSList *map = find_point_list_map(img_pts, pat_pts, DEFAULT_RADIUS);
+  act_timing_end(ACQ_TIMING_POINT_MAP, span_start);
   gint num_match;
   if (map == NULL)
   {
@@ -694,7 +764,7 @@ void print_point_list(const char *heading, PointList *list)
 void image_auto_target_set(struct acq_objects *objs, CcdImg *img)
 {
   // Extract stars from image
-  PointList *img_pts = image_extract_stars(img, objs->imgdisp);
+  PointList *img_pts = image_extract_stars(objs, img);
   gint num_stars = point_list_get_num_used(img_pts);
   act_log_debug(act_log_msg("Number of stars extracted from image: %d\n", num_stars));
   if (num_stars < MIN_NUM_STARS)
@@ -713,7 +783,9 @@ void image_auto_target_set(struct acq_objects *objs, CcdImg *img)
   gfloat img_ra, img_dec;
   ccd_img_get_tel_pos(img, &img_ra, &img_dec);
   gdouble img_start_sec = ccd_img_get_start_datetime(img);
+  unsigned long long span_start = act_timing_start();
   PointList *pat_pts = acq_store_get_gsc1_pattern(objs->store, img_ra, img_dec, SEC_TO_YEAR(img_start_sec), PAT_SEARCH_RADIUS);
+  act_timing_end(ACQ_TIMING_CAT_QUERY, span_start);
   gint num_pat = point_list_get_num_used(pat_pts);
   act_log_debug(act_log_msg("Number of catalog stars within search region: %d\n", num_pat));
   if (num_pat < MIN_NUM_STARS)
@@ -724,19 +796,49 @@ void image_auto_target_set(struct acq_objects *objs, CcdImg *img)
     return;
   }
   
-  // Match the two lists of points
-  GSList *map = find_point_list_map(img_pts, pat_pts, DEFAULT_RADIUS);
-  gint num_match;
-  if (map == NULL)
+  // Match the two lists of points - first allowing for field rotation and plate scale errors, then falling back to
+  // the translation-only matcher
+  span_start = act_timing_start();
+  if (!asterism_index_matches(objs->pat_index, pat_pts))
   {
-    act_log_error(act_log_msg("Failed to find point mapping."));
-    num_match = 0;
+    asterism_index_free(objs->pat_index);
+    objs->pat_index = asterism_index_new(pat_pts, img_ra, img_dec);
   }
+  asterism_fit_t fit;
+  GSList *map = find_asterism_map(objs->pat_index, img_pts, img_ra, img_dec, PAT_FIT_RADIUS, &fit);
+  act_timing_end(ACQ_TIMING_ASTERISM, span_start);
+  gint num_match = map == NULL ? 0 : g_slist_length(map);
+  gboolean fitted = num_match / (float)num_stars >= MIN_MATCH_FRAC;
+  if (fitted)
+    act_log_debug(act_log_msg("Asterism match: %d stars mapped, rotation %8.4f deg, scale %8.5f, residuals mean %6.2f\" rms %6.2f\" max %6.2f\"", num_match, fit.rot_d, fit.scale, fit.resid_mean*3600.0, fit.resid_rms*3600.0, fit.resid_max*3600.0));
   else
-    num_match = g_slist_length(map);
+  {
+    act_log_debug(act_log_msg("Asterism match failed (%d stars mapped), trying translation-only match.", num_match));
+    if (map != NULL)
+    {
+      point_list_map_free(map);
+      g_slist_free(map);
+    }
+    span_start = act_timing_start();
+    map = find_point_list_map(img_pts, pat_pts, DEFAULT_RADIUS);
+    act_timing_end(ACQ_TIMING_POINT_MAP, span_start);
+    if (map == NULL)
+    {
+      act_log_error(act_log_msg("Failed to find point mapping."));
+      num_match = 0;
+    }
+    else
+      num_match = g_slist_length(map);
+  }
   guchar obsnstat;
   gfloat rashift, decshift;
-  if (num_match / (float)num_stars < MIN_MATCH_FRAC)
+  if (fitted)
+  {
+    rashift = fit.ra_shift;
+    decshift = fit.dec_shift;
+    obsnstat = OBSNSTAT_GOOD;
+  }
+  else if (num_match / (float)num_stars < MIN_MATCH_FRAC)
   {
     act_log_normal(act_log_msg("Too few stars mapped to pattern (%d mapped, %d required)", num_match, MIN_MATCH_FRAC*num_stars));
     rashift = decshift = 0.0;
@@ -765,23 +867,56 @@ void image_auto_target_set(struct acq_objects *objs, CcdImg *img)
   prog_change_mode(objs, MODE_IDLE);
 }
 
-PointList *image_extract_stars(CcdImg *img, GtkWidget *imgdisp)
+PointList *image_extract_stars(struct acq_objects *objs, CcdImg *img)
 {
   float conv[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
-  float mean=0.0, stddev=0.0;
-  int i, num_pix=ccd_img_get_img_len(img);
+  int i, ret, num_pix=ccd_img_get_img_len(img);
+  gushort width = ccd_img_get_img_width(img), height = ccd_img_get_img_height(img);
   float const *img_data = ccd_img_get_img_data(img);
+  struct extract_back *back = &objs->back;
+  
+  unsigned long long span_start = act_timing_start();
+  sepbackmap *bkmap = NULL;
+  ret = sep_makeback((void *)img_data, NULL, SEP_TFLOAT, SEP_TFLOAT, width, height, EXTRACT_BACK_TILE, EXTRACT_BACK_TILE, 0.0, EXTRACT_BACK_FILTER, EXTRACT_BACK_FILTER, 0.0, &bkmap);
+  if (ret != 0)
+  {
+    act_log_error(act_log_msg("Failed to estimate image background - SEP error code %d", ret));
+    return point_list_new();
+  }
+  if ((back->interp == NULL) || (back->width != width) || (back->height != height))
+  {
+    act_log_debug(act_log_msg("Setting up background interpolation for %hux%hu image", width, height));
+    sep_freebackinterp(back->interp);
+    back->interp = NULL;
+    back->width = back->height = 0;
+    ret = sep_makebackinterp(bkmap, &back->interp);
+    if (ret != 0)
+    {
+      act_log_error(act_log_msg("Failed to set up background interpolation - SEP error code %d", ret));
+      sep_freeback(bkmap);
+      return point_list_new();
+    }
+    back->back = g_realloc(back->back, num_pix*sizeof(gfloat));
+    back->rms = g_realloc(back->rms, num_pix*sizeof(gfloat));
+    back->sub = g_realloc(back->sub, num_pix*sizeof(gfloat));
+    back->width = width;
+    back->height = height;
+  }
+  ret = sep_backinterparrays(bkmap, back->interp, back->back, back->rms);
+  sep_freeback(bkmap);
+  if (ret != 0)
+  {
+    act_log_error(act_log_msg("Failed to calculate image background - SEP error code %d", ret));
+    return point_list_new();
+  }
   for (i=0; i<num_pix; i++)
-    mean += img_data[i];
-  mean /= num_pix;
-  for (i=0; i<num_pix; i++)
-    stddev += pow(mean-img_data[i],2.0);
-  stddev /= num_pix;
-  stddev = pow(stddev, 0.5);
+    back->sub[i] = img_data[i] - back->back[i];
+  act_timing_end(ACQ_TIMING_BACKGROUND, span_start);
   
+  span_start = act_timing_start();
   sepobj *obj = NULL;
-  int ret, num_stars;
-  ret = sep_extract((void *)img_data, NULL, SEP_TFLOAT, SEP_TFLOAT, 0, ccd_img_get_win_width(img), ccd_img_get_win_height(img), mean+2.0*stddev, 5, conv, 3, 3, 32, 0.005, 1, 1.0, &obj, &num_stars);
+  int num_stars;
+  ret = sep_extract_tiled(objs->sep_ctx, EXTRACT_NUM_THREADS, back->sub, back->rms, SEP_TFLOAT, SEP_TFLOAT, 0, width, height, EXTRACT_THRESH_SIGMA, 5, conv, 3, 3, 32, 0.005, 1, 1.0, &obj, &num_stars);
   if (ret != 0)
   {
     act_log_error(act_log_msg("Failed to extract stars from image - SEP error code %d", ret));
@@ -793,7 +928,7 @@ PointList *image_extract_stars(CcdImg *img, GtkWidget *imgdisp)
   gfloat tmp_ra, tmp_dec;
   for (i=0; i<num_stars; i++)
   {
-    ret = imgdisp_coord_equat(imgdisp, obj[i].x, obj[i].y, &tmp_ra, &tmp_dec);
+    ret = imgdisp_coord_equat(objs->imgdisp, obj[i].x, obj[i].y, &tmp_ra, &tmp_dec);
     if (ret < 0)
     {
       act_log_error(act_log_msg("Failed to calculate RA and Dec of star %d in star list."));
@@ -809,6 +944,8 @@ PointList *image_extract_stars(CcdImg *img, GtkWidget *imgdisp)
     if (!ret)
       act_log_debug(act_log_msg("Failed to add identified star %d to stars list."));
   }
+  sep_freeobjarray(obj, num_stars);
+  act_timing_end(ACQ_TIMING_EXTRACT, span_start);
 
   return star_list;
 }
@@ -864,7 +1001,11 @@ void store_stat_update(GObject *acq_store, gpointer lbl_store_stat)
   AcqStore *store = ACQ_STORE(acq_store);
   gchar stat_str[100];
   if (acq_store_idle(store))
+  {
     sprintf(stat_str, "IDLE");
+    // store images left in the fallback directory a batch at a time, whenever the store has nothing else to do
+    acq_store_ingest_fallback(store);
+  }
   else if (acq_store_storing(store))
     sprintf(stat_str, "BUSY");
   else if (acq_store_error_retry(store))
@@ -885,6 +1026,23 @@ void store_stat_update(GObject *acq_store, gpointer lbl_store_stat)
   gtk_label_set_text(GTK_LABEL(lbl_store_stat), stat_str);
 }
 
+void store_queue_high(GObject *acq_store, guint queue_depth, gpointer user_data)
+{
+  (void) acq_store;
+  struct acq_objects *objs = (struct acq_objects *)user_data;
+  act_log_normal(act_log_msg("Image storage falling behind (%u images pending). Holding integration repetitions.", queue_depth));
+  ccd_cntrl_set_hold(objs->cntrl, TRUE);
+  gtk_label_set_text(GTK_LABEL(objs->lbl_store_stat), "BACKLOG");
+}
+
+void store_queue_low(GObject *acq_store, guint queue_depth, gpointer user_data)
+{
+  struct acq_objects *objs = (struct acq_objects *)user_data;
+  act_log_normal(act_log_msg("Image storage caught up (%u images pending). Resuming integration repetitions.", queue_depth));
+  ccd_cntrl_set_hold(objs->cntrl, FALSE);
+  store_stat_update(acq_store, objs->lbl_store_stat);
+}
+
 void coord_received(GObject *acq_net, gdouble tel_ra, gdouble tel_dec, gpointer user_data)
 {
 //  act_log_debug(act_log_msg("Updated coordinates received: %f %f", tel_ra, tel_dec));
@@ -940,7 +1098,6 @@ void change_target(GObject *acq_net, gulong new_targ_id, gchar *new_targ_name, g
 void targset_start(GObject *acq_net, gdouble targ_ra, gdouble targ_dec, gpointer user_data)
 {
   (void) targ_ra;
-  (void) targ_dec;
   struct acq_objects *objs = (struct acq_objects *)user_data;
   if ((objs->mode != MODE_IDLE) && (objs->mode != MODE_TARGSET_EXP))
   {
@@ -960,6 +1117,8 @@ void targset_start(GObject *acq_net, gdouble targ_ra, gdouble targ_dec, gpointer
   }
   prog_change_mode(objs, MODE_TARGSET_EXP);
   g_object_unref(G_OBJECT(cmd));
+  // load the catalogue stars around the target while the exposure is running
+  acq_store_preload_gsc1(objs->store, targ_dec, PAT_SEARCH_RADIUS);
 }
 
 void targset_stop(GObject *acq_net, gpointer user_data)
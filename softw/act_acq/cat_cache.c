@@ -0,0 +1,324 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <act_log.h>
+#include "cat_cache.h"
+
+struct cat_star
+{
+  gfloat ra_d;
+  gfloat dec_d;
+};
+
+static gint zone_index(gdouble dec_d);
+static void zone_range(gdouble dec_d, gdouble radius_d, gint *first, gint *last);
+static int star_compare_ra(const void *star1, const void *star2);
+static guint zone_first_above(struct cat_zone *zone, gdouble ra_d);
+static guint zone_first_not_below(struct cat_zone *zone, gdouble ra_d);
+static void zone_append_range(PointList *list, struct cat_zone *zone, guint start, guint end, gdouble dec_min_d, gdouble dec_max_d);
+
+cat_cache_t *cat_cache_new(void)
+{
+  cat_cache_t *cache = malloc(sizeof(cat_cache_t));
+  if (cache == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for catalogue cache."));
+    return NULL;
+  }
+  pthread_mutex_init(&cache->mutex, NULL);
+  memset(cache->zone_state, CAT_ZONE_EMPTY, sizeof(cache->zone_state));
+  memset(cache->zones, 0, sizeof(cache->zones));
+  return cache;
+}
+
+void cat_cache_free(cat_cache_t *cache)
+{
+  if (cache == NULL)
+    return;
+  gint i;
+  for (i=0; i<CAT_CACHE_NUM_ZONES; i++)
+  {
+    if (cache->zones[i] == NULL)
+      continue;
+    free(cache->zones[i]->ra_d);
+    free(cache->zones[i]->dec_d);
+    free(cache->zones[i]);
+  }
+  pthread_mutex_destroy(&cache->mutex);
+  free(cache);
+}
+
+/** \brief Declination limits of the given zone.
+ * \param zone Zone index
+ * \param dec_min_d Return location for the (inclusive) lower declination limit, in degrees
+ * \param dec_max_d Return location for the (exclusive) upper declination limit, in degrees
+ *
+ * The upper limit of the northern-most zone is 90 degrees inclusive.
+ */
+void cat_cache_zone_limits(guint zone, gfloat *dec_min_d, gfloat *dec_max_d)
+{
+  *dec_min_d = -90.0 + zone*CAT_CACHE_ZONE_HEIGHT_D;
+  *dec_max_d = *dec_min_d + CAT_CACHE_ZONE_HEIGHT_D;
+}
+
+/** \brief Mark all zones needed for a search around the given declination that have not been loaded yet for loading.
+ * \return TRUE if any zones were newly marked for loading.
+ */
+gboolean cat_cache_request(cat_cache_t *cache, gfloat dec_d, gfloat radius_d)
+{
+  gint first, last, i;
+  gboolean ret = FALSE;
+  zone_range(dec_d, radius_d, &first, &last);
+  pthread_mutex_lock(&cache->mutex);
+  for (i=first; i<=last; i++)
+  {
+    if (cache->zone_state[i] != CAT_ZONE_EMPTY)
+      continue;
+    cache->zone_state[i] = CAT_ZONE_REQUESTED;
+    ret = TRUE;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+  return ret;
+}
+
+/** \brief Fetch the next zone waiting to be loaded and mark it as being loaded.
+ * \return Zone index, or <0 if no zones are waiting to be loaded.
+ */
+gint cat_cache_next_request(cat_cache_t *cache)
+{
+  gint i, ret = -1;
+  pthread_mutex_lock(&cache->mutex);
+  for (i=0; i<CAT_CACHE_NUM_ZONES; i++)
+  {
+    if (cache->zone_state[i] != CAT_ZONE_REQUESTED)
+      continue;
+    cache->zone_state[i] = CAT_ZONE_LOADING;
+    ret = i;
+    break;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+  return ret;
+}
+
+/** \brief Install the stars of a zone in the cache.
+ * \param cache Catalogue cache
+ * \param zone Zone index
+ * \param num_stars Number of stars in ra_d and dec_d
+ * \param ra_d Right ascensions (FK5, degrees) - the cache takes ownership of the array
+ * \param dec_d Declinations (FK5, degrees) - the cache takes ownership of the array
+ *
+ * The stars need not be sorted, they are sorted by right ascension here.
+ */
+void cat_cache_set_zone(cat_cache_t *cache, guint zone, guint num_stars, gfloat *ra_d, gfloat *dec_d)
+{
+  guint i;
+  if (num_stars > 0)
+  {
+    struct cat_star *stars = malloc(num_stars*sizeof(struct cat_star));
+    if (stars == NULL)
+    {
+      act_log_error(act_log_msg("Failed to allocate memory for sorting catalogue zone %u.", zone));
+      free(ra_d);
+      free(dec_d);
+      cat_cache_fail_zone(cache, zone);
+      return;
+    }
+    for (i=0; i<num_stars; i++)
+    {
+      stars[i].ra_d = ra_d[i];
+      stars[i].dec_d = dec_d[i];
+    }
+    qsort(stars, num_stars, sizeof(struct cat_star), star_compare_ra);
+    for (i=0; i<num_stars; i++)
+    {
+      ra_d[i] = stars[i].ra_d;
+      dec_d[i] = stars[i].dec_d;
+    }
+    free(stars);
+  }
+  struct cat_zone *new_zone = malloc(sizeof(struct cat_zone));
+  if (new_zone == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for catalogue zone %u.", zone));
+    free(ra_d);
+    free(dec_d);
+    cat_cache_fail_zone(cache, zone);
+    return;
+  }
+  new_zone->num_stars = num_stars;
+  new_zone->ra_d = ra_d;
+  new_zone->dec_d = dec_d;
+  pthread_mutex_lock(&cache->mutex);
+  if (cache->zones[zone] != NULL)
+  {
+    // should not happen, but never free a zone that readers may be using
+    act_log_error(act_log_msg("Catalogue zone %u already loaded.", zone));
+    pthread_mutex_unlock(&cache->mutex);
+    free(new_zone->ra_d);
+    free(new_zone->dec_d);
+    free(new_zone);
+    return;
+  }
+  cache->zones[zone] = new_zone;
+  cache->zone_state[zone] = CAT_ZONE_LOADED;
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+/// Mark a zone that could not be loaded as empty again, so that it may be requested again later.
+void cat_cache_fail_zone(cat_cache_t *cache, guint zone)
+{
+  pthread_mutex_lock(&cache->mutex);
+  if (cache->zone_state[zone] != CAT_ZONE_LOADED)
+    cache->zone_state[zone] = CAT_ZONE_EMPTY;
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+/// Check whether all zones needed for a search around the given declination have been loaded.
+gboolean cat_cache_covers(cat_cache_t *cache, gfloat dec_d, gfloat radius_d)
+{
+  gint first, last, i;
+  gboolean ret = TRUE;
+  zone_range(dec_d, radius_d, &first, &last);
+  pthread_mutex_lock(&cache->mutex);
+  for (i=first; i<=last; i++)
+  {
+    if (cache->zone_state[i] != CAT_ZONE_LOADED)
+    {
+      ret = FALSE;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&cache->mutex);
+  return ret;
+}
+
+/** \brief Find all cached stars within a box around the given coordinates.
+ * \param cache Catalogue cache
+ * \param ra_d Right ascension (FK5, degrees) of the centre of the search box
+ * \param dec_d Declination (FK5, degrees) of the centre of the search box
+ * \param radius_d Half-height of the search box in degrees (the half-width is scaled by 1/cos(dec))
+ * \return New PointList with the (RA, Dec) of all stars in the box, or NULL if not all zones covering the box have
+ *         been loaded.
+ *
+ * The box has exactly the same shape as the database query used by acq_store, including the special cases near
+ * the poles and at RA 0/360 degrees.
+ */
+PointList *cat_cache_box_search(cat_cache_t *cache, gfloat ra_d, gfloat dec_d, gfloat radius_d)
+{
+  gint first, last, i;
+  struct cat_zone *zones[CAT_CACHE_NUM_ZONES];
+  zone_range(dec_d, radius_d, &first, &last);
+  pthread_mutex_lock(&cache->mutex);
+  for (i=first; i<=last; i++)
+  {
+    if (cache->zone_state[i] != CAT_ZONE_LOADED)
+    {
+      pthread_mutex_unlock(&cache->mutex);
+      return NULL;
+    }
+    zones[i] = cache->zones[i];
+  }
+  pthread_mutex_unlock(&cache->mutex);
+
+  guint num_stars = 0;
+  for (i=first; i<=last; i++)
+    num_stars += zones[i]->num_stars;
+  PointList *list = point_list_new_with_length(num_stars > 0 ? num_stars : 1);
+  if (list == NULL)
+  {
+    act_log_error(act_log_msg("Failed to create point list for cached catalogue stars."));
+    return NULL;
+  }
+
+  gdouble ra_radius_d = radius_d / cos(dec_d*M_PI/180.0);
+  gdouble dec_min_d = dec_d - radius_d, dec_max_d = dec_d + radius_d;
+  if (dec_max_d >= 90.0)
+    dec_max_d = 90.0;
+  else if (dec_min_d <= -90.0)
+    dec_min_d = -90.0;
+  for (i=first; i<=last; i++)
+  {
+    struct cat_zone *zone = zones[i];
+    if ((dec_d + radius_d >= 90.0) || (dec_d - radius_d <= -90.0) || (ra_radius_d >= 180.0))
+      zone_append_range(list, zone, 0, zone->num_stars, dec_min_d, dec_max_d);
+    else if (ra_d - ra_radius_d < 0.0)
+    {
+      zone_append_range(list, zone, 0, zone_first_not_below(zone, ra_d+ra_radius_d), dec_min_d, dec_max_d);
+      zone_append_range(list, zone, zone_first_above(zone, ra_d-ra_radius_d+360.0), zone->num_stars, dec_min_d, dec_max_d);
+    }
+    else if (ra_d + ra_radius_d >= 360.0)
+    {
+      zone_append_range(list, zone, 0, zone_first_not_below(zone, ra_d+ra_radius_d-360.0), dec_min_d, dec_max_d);
+      zone_append_range(list, zone, zone_first_above(zone, ra_d-ra_radius_d), zone->num_stars, dec_min_d, dec_max_d);
+    }
+    else
+      zone_append_range(list, zone, zone_first_above(zone, ra_d-ra_radius_d), zone_first_not_below(zone, ra_d+ra_radius_d), dec_min_d, dec_max_d);
+  }
+  return list;
+}
+
+static gint zone_index(gdouble dec_d)
+{
+  gint zone = floor((dec_d + 90.0) / CAT_CACHE_ZONE_HEIGHT_D);
+  if (zone < 0)
+    return 0;
+  if (zone >= CAT_CACHE_NUM_ZONES)
+    return CAT_CACHE_NUM_ZONES-1;
+  return zone;
+}
+
+static void zone_range(gdouble dec_d, gdouble radius_d, gint *first, gint *last)
+{
+  *first = zone_index(dec_d - radius_d);
+  *last = zone_index(dec_d + radius_d);
+}
+
+static int star_compare_ra(const void *star1, const void *star2)
+{
+  gfloat ra1 = ((const struct cat_star *)star1)->ra_d, ra2 = ((const struct cat_star *)star2)->ra_d;
+  if (ra1 < ra2)
+    return -1;
+  if (ra1 > ra2)
+    return 1;
+  return 0;
+}
+
+/// Index of the first star in the zone with RA strictly greater than ra_d.
+static guint zone_first_above(struct cat_zone *zone, gdouble ra_d)
+{
+  guint lo = 0, hi = zone->num_stars, mid;
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if (zone->ra_d[mid] > ra_d)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+/// Index of the first star in the zone with RA greater than or equal to ra_d.
+static guint zone_first_not_below(struct cat_zone *zone, gdouble ra_d)
+{
+  guint lo = 0, hi = zone->num_stars, mid;
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if (zone->ra_d[mid] >= ra_d)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return lo;
+}
+
+static void zone_append_range(PointList *list, struct cat_zone *zone, guint start, guint end, gdouble dec_min_d, gdouble dec_max_d)
+{
+  guint i;
+  for (i=start; i<end; i++)
+  {
+    if ((zone->dec_d[i] > dec_min_d) && (zone->dec_d[i] < dec_max_d))
+      point_list_append(list, zone->ra_d[i], zone->dec_d[i]);
+  }
+}
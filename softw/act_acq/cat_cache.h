@@ -0,0 +1,51 @@
+#ifndef __CAT_CACHE_H__
+#define __CAT_CACHE_H__
+
+#include <glib.h>
+#include <pthread.h>
+#include "point_list.h"
+
+/// Height (in degrees) of a declination zone in the catalogue cache
+#define CAT_CACHE_ZONE_HEIGHT_D  1.0
+/// Number of declination zones covering the sky from -90 to +90 degrees
+#define CAT_CACHE_NUM_ZONES      180
+
+enum
+{
+  CAT_ZONE_EMPTY = 0,
+  CAT_ZONE_REQUESTED,
+  CAT_ZONE_LOADING,
+  CAT_ZONE_LOADED
+};
+
+/// Stars (FK5 J2000) in one declination zone, stored as separate arrays sorted by right ascension.
+struct cat_zone
+{
+  guint num_stars;
+  gfloat *ra_d;
+  gfloat *dec_d;
+};
+
+/** \brief In-memory star catalogue, indexed by declination zone.
+ *
+ * Zones are loaded once (typically by a background thread) and are never modified or freed until the cache itself
+ * is freed, so readers only need to hold the mutex while looking up the zone pointers.
+ */
+typedef struct _cat_cache_t
+{
+  pthread_mutex_t mutex;
+  guchar zone_state[CAT_CACHE_NUM_ZONES];
+  struct cat_zone *zones[CAT_CACHE_NUM_ZONES];
+} cat_cache_t;
+
+cat_cache_t *cat_cache_new(void);
+void cat_cache_free(cat_cache_t *cache);
+void cat_cache_zone_limits(guint zone, gfloat *dec_min_d, gfloat *dec_max_d);
+gboolean cat_cache_request(cat_cache_t *cache, gfloat dec_d, gfloat radius_d);
+gint cat_cache_next_request(cat_cache_t *cache);
+void cat_cache_set_zone(cat_cache_t *cache, guint zone, guint num_stars, gfloat *ra_d, gfloat *dec_d);
+void cat_cache_fail_zone(cat_cache_t *cache, guint zone);
+gboolean cat_cache_covers(cat_cache_t *cache, gfloat dec_d, gfloat radius_d);
+PointList *cat_cache_box_search(cat_cache_t *cache, gfloat ra_d, gfloat dec_d, gfloat radius_d);
+
+#endif   /* __CAT_CACHE_H__ */
@@ -3,12 +3,15 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <merlin_driver.h>
 #include <ccd_defs.h>
 #include <act_log.h>
 #include <act_positastro.h>
 #include "ccd_cntrl.h"
+#include "acq_timing.h"
 #include "marshallers.h"
 
 // #define DATETIME_TO_MSEC    60000
@@ -16,6 +19,26 @@
 #define TEL_POS_TO_MSEC     60000
 #define SIG_INTEG_TO_MSEC     100
 
+/** \brief Camera driver's image ring mapped into memory.
+ *
+ * Shared by the CCD controller and the images that still reference ring slots, so that the mapping outlives a
+ * reconnection to the driver. The ring has its own duplicate of the driver file descriptor, which is used to release
+ * slots.
+ */
+struct ccd_img_ring
+{
+  gint ref_count;
+  gint fd;
+  guchar const *map;
+};
+
+/// Reference to a slot of the image ring held by an image
+struct ccd_ring_slot
+{
+  struct ccd_img_ring *ring;
+  gulong slot;
+};
+
 static void ccd_cmd_instance_init(GObject *ccd_cmd);
 static void ccd_cmd_class_init(CcdCmdClass *klass);
 static void ccd_cmd_instance_dispose(GObject *ccd_cmd);
@@ -27,6 +50,10 @@ static gboolean ccd_cntrl_ccd_init(CcdCntrl *ccd_cntrl);
 static gboolean drv_watch(GIOChannel *drv_chan, GIOCondition cond, gpointer ccd_cntrl);
 static gboolean integ_timer(gpointer ccd_cntrl);
 static gboolean tel_pos_timeout(gpointer ccd_cntrl);
+static struct ccd_img_ring *img_ring_new(gint drv_fd);
+static void img_ring_unref(struct ccd_img_ring *ring);
+static void img_ring_slot_release(gpointer ring_slot);
+static struct merlin_img const *drv_get_image(CcdCntrl *objs, GDestroyNotify *img_release, gpointer *img_release_data);
 
 
 enum
@@ -285,6 +312,8 @@ gboolean ccd_cntrl_reconnect(CcdCntrl *objs)
   {
     gint drv_fd = g_io_channel_unix_get_fd (objs->drv_chan);
     ioctl(drv_fd, IOCTL_ACQ_RESET, 0);
+    img_ring_unref(objs->img_ring);
+    objs->img_ring = NULL;
     GError *err = NULL;
     GIOStatus chan_stat = g_io_channel_shutdown (objs->drv_chan, FALSE, &err);
     if ((chan_stat != G_IO_STATUS_NORMAL) || (err != NULL))
@@ -405,11 +434,45 @@ gint ccd_cntrl_start_integ(CcdCntrl *objs, CcdCmd *cmd)
 
 void ccd_cntrl_cancel_integ(CcdCntrl *objs)
 {
+  if (objs->held_cmd != NULL)
+  {
+    act_log_debug(act_log_msg("Cancelling held integration repetition."));
+    g_object_unref(G_OBJECT(objs->held_cmd));
+    objs->held_cmd = NULL;
+    objs->rpt_rem = 0;
+    g_signal_emit(G_OBJECT(objs), cntrl_signals[SIG_INTEG_REM], 0,  0.0, 0);
+    return;
+  }
   act_log_debug(act_log_msg("Not fully implemented yet. Not cancelling current integration, but will cancel future integrations in this series."));
   if (objs->rpt_rem > 0)
     objs->rpt_rem = 1;
 }
 
+/** \brief Hold back (or release) the remaining repetitions of an integration series.
+ * \param objs CcdCntrl object
+ * \param hold If TRUE, the next repetition is not started when the current image is read out. If FALSE, a held
+ *             repetition is started immediately.
+ *
+ * Used to throttle exposures while images cannot be stored as fast as they are produced.
+ */
+void ccd_cntrl_set_hold(CcdCntrl *objs, gboolean hold)
+{
+  objs->hold = hold;
+  if ((hold) || (objs->held_cmd == NULL))
+    return;
+  CcdCmd *cmd = objs->held_cmd;
+  objs->held_cmd = NULL;
+  act_log_debug(act_log_msg("Releasing held integration repetition (%lu remain).", objs->rpt_rem));
+  gint ret = ccd_cntrl_start_integ(objs, cmd);
+  if (ret < 0)
+  {
+    act_log_error(act_log_msg("Failed to start held integration repetition (%d - %s)", ret, strerror(abs(ret))));
+    objs->rpt_rem = 0;
+    g_signal_emit(G_OBJECT(objs), cntrl_signals[SIG_INTEG_REM], 0,  0.0, 0);
+  }
+  g_object_unref(G_OBJECT(cmd));
+}
+
 guchar ccd_cntrl_get_stat(CcdCntrl *objs)
 {
   return objs->drv_stat;
@@ -468,6 +531,7 @@ static void ccd_cntrl_instance_init(GObject *ccd_cntrl)
   objs->drv_chan = NULL;
   objs->drv_watch_id = 0;
   objs->drv_stat = 0;
+  objs->img_ring = NULL;
   objs->win_start_x = objs->win_start_y = 0;
   objs->win_width = objs->win_height = 0;
   objs->prebin_x = objs->prebin_y = 0;
@@ -483,6 +547,8 @@ static void ccd_cntrl_instance_init(GObject *ccd_cntrl)
   
   objs->cur_img = NULL;
   objs->rpt_rem = 0;
+  objs->hold = FALSE;
+  objs->held_cmd = NULL;
   objs->integ_trem_to_id = 0;
   objs->integ_timer = g_timer_new();
 }
@@ -508,6 +574,11 @@ static void ccd_cntrl_instance_dispose(GObject *ccd_cntrl)
     g_io_channel_unref(objs->drv_chan);
     objs->drv_chan = NULL;
   }
+  if (objs->img_ring != NULL)
+  {
+    img_ring_unref(objs->img_ring);
+    objs->img_ring = NULL;
+  }
   if (objs->ccd_id != NULL)
   {
     g_free(objs->ccd_id);
@@ -518,6 +589,11 @@ static void ccd_cntrl_instance_dispose(GObject *ccd_cntrl)
     g_object_unref(objs->cur_img);
     objs->cur_img = NULL;
   }
+  if (objs->held_cmd != NULL)
+  {
+    g_object_unref(G_OBJECT(objs->held_cmd));
+    objs->held_cmd = NULL;
+  }
   if (objs->integ_trem_to_id != 0)
   {
     g_source_remove(objs->integ_trem_to_id);
@@ -560,6 +636,9 @@ static gboolean ccd_cntrl_ccd_init(CcdCntrl *objs)
   }
   
   objs->drv_stat = tmp_stat;
+  objs->img_ring = img_ring_new(drv_fd);
+  if (objs->img_ring == NULL)
+    act_log_normal(act_log_msg("Camera driver image ring not available. Images will be copied from the driver."));
   objs->drv_chan = g_io_channel_unix_new(drv_fd);
   g_io_channel_set_close_on_unref(objs->drv_chan, TRUE);
   objs->drv_watch_id = g_io_add_watch(objs->drv_chan, G_IO_IN|G_IO_PRI, drv_watch, objs);
@@ -614,29 +693,44 @@ static gboolean drv_watch(GIOChannel *drv_chan, GIOCondition cond, gpointer ccd_
   if ((tmp_stat & CCD_IMG_READY) == 0)
     return TRUE;
   
-  struct merlin_img tmp_img;
-  ret = ioctl(g_io_channel_unix_get_fd(objs->drv_chan), IOCTL_GET_IMAGE, &tmp_img);
-  struct ccd_img_params *tmp_params = &tmp_img.img_params;
+  // Each image is a timing frame, which ends once the new image has been handled
+  act_timing_frame_begin();
+  unsigned long long read_start = act_timing_start();
+  GDestroyNotify img_release;
+  gpointer img_release_data;
+  struct merlin_img const *drv_img = drv_get_image(objs, &img_release, &img_release_data);
+  act_timing_end(ACQ_TIMING_CCD_READ, read_start);
+  if (drv_img == NULL)
+  {
+    act_timing_frame_end();
+    return TRUE;
+  }
+  struct ccd_img_params const *tmp_params = &drv_img->img_params;
   if (objs->cur_img == NULL)
   {
     act_log_debug(act_log_msg("New image received, but CCD control structure has no reference to a current image - integration was probably cancelled. Ignoring this image."));
+    img_release(img_release_data);
+    act_timing_frame_end();
     return TRUE;
   }
   
   objs->rpt_rem--;
-  gfloat *tmp_data = malloc(tmp_params->img_len*sizeof(gfloat));
-  gulong i;
-  for (i=0; i<tmp_params->img_len; i++)
-    tmp_data[i] = (gfloat)tmp_img.img_data[i]/CCDPIX_MAX;
   CcdImg *img = CCD_IMG(objs->cur_img);
   objs->cur_img = NULL;
-  ccd_img_set_img_data(img, tmp_params->img_len, tmp_data);
   ccd_img_set_window(img, tmp_params->win_start_x, tmp_params->win_start_y, tmp_params->win_width, tmp_params->win_height, tmp_params->prebin_x, tmp_params->prebin_y);
   ccd_img_set_integ_t(img, ccd_img_exp_t((*tmp_params)));
   ccd_img_set_start_datetime(img, tmp_params->start_sec + tmp_params->start_nanosec/(double)1e9);
   ccd_img_set_pixel_size(img, objs->ra_width_asec, objs->dec_height_asec);
+  gulong img_len = tmp_params->img_len;
+  if (img_len > MERLIN_MAX_IMG_LEN)
+  {
+    act_log_error(act_log_msg("Camera driver reports too many pixels in image (%lu). Truncating.", img_len));
+    img_len = MERLIN_MAX_IMG_LEN;
+  }
+  ccd_img_set_raw_data(img, img_len, drv_img->img_data, CCDPIX_MAX, img_release, img_release_data);
   g_signal_emit(G_OBJECT(ccd_cntrl), cntrl_signals[SIG_NEW_IMG], 0,  img);
   g_object_unref(G_OBJECT(img));
+  act_timing_frame_end();
 
   if (objs->rpt_rem > 0)
   {
@@ -652,12 +746,21 @@ static gboolean drv_watch(GIOChannel *drv_chan, GIOCondition cond, gpointer ccd_
     ccd_cmd_set_rpt(cmd, objs->rpt_rem);
     ccd_cmd_set_user(cmd, ccd_img_get_user_id(img), ccd_img_get_user_name(img));
     ccd_cmd_set_target(cmd, ccd_img_get_targ_id(img), ccd_img_get_targ_name(img));
+    if (objs->hold)
+    {
+      act_log_normal(act_log_msg("Integration repetitions on hold (%lu remain).", objs->rpt_rem));
+      if (objs->held_cmd != NULL)
+        g_object_unref(G_OBJECT(objs->held_cmd));
+      objs->held_cmd = cmd;
+      return TRUE;
+    }
     ret = ccd_cntrl_start_integ(objs, cmd);
     if (ret < 0)
     {
       act_log_error(act_log_msg("Failed to start next integration repetition (%d - %s)", ret, strerror(abs(ret))));
       objs->rpt_rem = 0;
     }
+    g_object_unref(G_OBJECT(cmd));
   }
   else
     g_signal_emit(G_OBJECT(ccd_cntrl), cntrl_signals[SIG_INTEG_REM], 0,  0.0, 0);
@@ -696,3 +799,98 @@ static gboolean tel_pos_timeout(gpointer ccd_cntrl)
 }
 
 
+
+/** \brief Map the camera driver's image ring.
+ * \param drv_fd File descriptor of the camera driver character device.
+ * \return New ring (one reference), or NULL if the driver does not support mapping its image ring.
+ */
+static struct ccd_img_ring *img_ring_new(gint drv_fd)
+{
+  gint ring_fd = dup(drv_fd);
+  if (ring_fd < 0)
+  {
+    act_log_error(act_log_msg("Failed to duplicate camera driver file descriptor - %s.", strerror(errno)));
+    return NULL;
+  }
+  void *map = mmap(NULL, MERLIN_RING_SIZE, PROT_READ, MAP_SHARED, ring_fd, 0);
+  if (map == MAP_FAILED)
+  {
+    act_log_debug(act_log_msg("Failed to map camera driver image ring - %s.", strerror(errno)));
+    close(ring_fd);
+    return NULL;
+  }
+  struct ccd_img_ring *ring = g_malloc(sizeof(struct ccd_img_ring));
+  ring->ref_count = 1;
+  ring->fd = ring_fd;
+  ring->map = map;
+  return ring;
+}
+
+/// Drop a reference to the image ring, unmapping it when the last reference is dropped (ring may be NULL)
+static void img_ring_unref(struct ccd_img_ring *ring)
+{
+  if (ring == NULL)
+    return;
+  if (!g_atomic_int_dec_and_test(&ring->ref_count))
+    return;
+  munmap((void *)ring->map, MERLIN_RING_SIZE);
+  close(ring->fd);
+  g_free(ring);
+}
+
+/// Release a ring slot held by an image (called by the image once the pixels have been converted)
+static void img_ring_slot_release(gpointer ring_slot)
+{
+  struct ccd_ring_slot *slot = (struct ccd_ring_slot *)ring_slot;
+  if (ioctl(slot->ring->fd, IOCTL_RELEASE_IMAGE, slot->slot) < 0)
+    act_log_error(act_log_msg("Failed to release camera driver image ring slot %lu - %s.", slot->slot, strerror(errno)));
+  img_ring_unref(slot->ring);
+  g_free(slot);
+}
+
+/** \brief Retrieve the latest image from the camera driver.
+ * \param objs CCD controller.
+ * \param img_release Returns the function that must be called (with img_release_data) when the image is no longer
+ *                    needed.
+ * \param img_release_data Returns data to pass to img_release.
+ * \return The image, or NULL on failure.
+ *
+ * If the driver's image ring is mapped, this returns the ring slot holding the image, which the driver will not
+ * overwrite until it is released. Otherwise the image is copied from the driver into a newly allocated buffer.
+ */
+static struct merlin_img const *drv_get_image(CcdCntrl *objs, GDestroyNotify *img_release, gpointer *img_release_data)
+{
+  gint drv_fd = g_io_channel_unix_get_fd(objs->drv_chan);
+  if (objs->img_ring != NULL)
+  {
+    gulong slot_idx;
+    if (ioctl(drv_fd, IOCTL_GET_IMAGE_SLOT, &slot_idx) < 0)
+    {
+      act_log_error(act_log_msg("Failed to retrieve image ring slot from camera driver - %s.", strerror(errno)));
+      return NULL;
+    }
+    if (slot_idx >= MERLIN_RING_LEN)
+    {
+      act_log_error(act_log_msg("Camera driver returned invalid image ring slot %lu.", slot_idx));
+      return NULL;
+    }
+    struct ccd_ring_slot *slot = g_malloc(sizeof(struct ccd_ring_slot));
+    g_atomic_int_inc(&objs->img_ring->ref_count);
+    slot->ring = objs->img_ring;
+    slot->slot = slot_idx;
+    *img_release = img_ring_slot_release;
+    *img_release_data = slot;
+    return (struct merlin_img const *)(objs->img_ring->map + slot_idx*MERLIN_RING_SLOT_SIZE);
+  }
+  
+  struct merlin_img *img = g_malloc(sizeof(struct merlin_img));
+  if (ioctl(drv_fd, IOCTL_GET_IMAGE, img) < 0)
+  {
+    act_log_error(act_log_msg("Failed to retrieve image from camera driver - %s.", strerror(errno)));
+    g_free(img);
+    return NULL;
+  }
+  *img_release = g_free;
+  *img_release_data = img;
+  return img;
+}
@@ -83,12 +83,16 @@ void ccd_cmd_set_user(CcdCmd *objs, gulong user_id, gchar const *user_name);
 typedef struct _CcdCntrl       CcdCntrl;
 typedef struct _CcdCntrlClass  CcdCntrlClass;
 
+struct ccd_img_ring;
+
 struct _CcdCntrl
 {
   GObject parent;
   GIOChannel *drv_chan;
   gint drv_watch_id;
   guchar drv_stat;
+  /// Camera driver's image ring mapped into memory (NULL if it could not be mapped)
+  struct ccd_img_ring *img_ring;
   
   gchar *ccd_id;
   gfloat min_integ_t_s, max_integ_t_s;
@@ -100,6 +104,9 @@ struct _CcdCntrl
   
   CcdImg *cur_img;
   gulong rpt_rem;
+  /// While TRUE, the next repetition of a series is not started but kept in held_cmd
+  gboolean hold;
+  CcdCmd *held_cmd;
   GTimer *integ_timer;
   gint integ_trem_to_id;
   
@@ -128,6 +135,7 @@ gushort ccd_cntrl_get_max_width(CcdCntrl *objs);
 gushort ccd_cntrl_get_max_height(CcdCntrl *objs);
 gint ccd_cntrl_start_integ(CcdCntrl *objs, CcdCmd *cmd);
 void ccd_cntrl_cancel_integ(CcdCntrl *objs);
+void ccd_cntrl_set_hold(CcdCntrl *objs, gboolean hold);
 gfloat ccd_cntrl_get_integ_trem(CcdCntrl *objs);
 gulong ccd_cntrl_get_rpt_rem(CcdCntrl *objs);
 guchar ccd_cntrl_get_stat(CcdCntrl *objs);
@@ -3,7 +3,11 @@
 #include <errno.h>
 #include <math.h>
 #include <stdlib.h>
+#ifdef __SSE2__
+ #include <emmintrin.h>
+#endif
 #include "ccd_img.h"
+#include "acq_timing.h"
 
 #define CENT_X 203
 #define CENT_Y 144
@@ -11,6 +15,9 @@
 static void ccd_img_instance_init(GObject *ccd_img);
 static void ccd_img_class_init(CcdImgClass *klass);
 static void ccd_img_instance_dispose(GObject *ccd_img);
+static void ccd_img_instance_finalize(GObject *ccd_img);
+static void release_raw_data(CcdImg *objs);
+static void convert_raw_data(gfloat *img_data, guchar const *raw_data, gulong img_len, gfloat raw_max);
 
 // CCD Image implementation
 GType ccd_img_get_type(void)
@@ -208,25 +215,85 @@ gulong ccd_img_get_img_len(CcdImg const *objs)
   return objs->img_len;
 }
 
+/** \brief Returns the image data, converting it from the raw pixels first if necessary.
+ *
+ * For images set with ccd_img_set_raw_data, the raw pixels are converted on the first call and released
+ * immediately afterwards.
+ */
 gfloat *ccd_img_get_img_data(CcdImg const *objs)
 {
-  return objs->img_data;
+  CcdImg *img = (CcdImg *)objs;
+  pthread_mutex_lock(&img->conv_mutex);
+  if ((img->img_data == NULL) && (img->raw_data != NULL))
+  {
+    unsigned long long conv_start = act_timing_start();
+    img->img_data = g_malloc(img->img_len*sizeof(gfloat));
+    convert_raw_data(img->img_data, img->raw_data, img->img_len, img->raw_max);
+    release_raw_data(img);
+    act_timing_end(ACQ_TIMING_CONVERT, conv_start);
+  }
+  pthread_mutex_unlock(&img->conv_mutex);
+  return img->img_data;
 }
 
 gfloat ccd_img_get_pixel(CcdImg const *objs, gushort x, gushort y)
 {
   if ((x >= ccd_img_get_img_width(objs)) || (y >= ccd_img_get_img_height(objs)))
     return -1.0;
-  return objs->img_data[y*ccd_img_get_img_width(objs)+x];
+  gfloat const *img_data = ccd_img_get_img_data(objs);
+  if (img_data == NULL)
+    return -1.0;
+  return img_data[y*ccd_img_get_img_width(objs)+x];
 }
 
 void ccd_img_set_img_data(CcdImg *objs, gulong img_len, gfloat const *img_data)
 {
+  pthread_mutex_lock(&objs->conv_mutex);
+  release_raw_data(objs);
   objs->img_len = img_len;
   if (objs->img_data != NULL)
     g_free(objs->img_data);
-  objs->img_data = malloc(img_len*sizeof(gfloat));
+  objs->img_data = g_malloc(img_len*sizeof(gfloat));
   memcpy(objs->img_data, img_data, img_len*sizeof(gfloat));
+  objs->raw_max = 0.0;
+  pthread_mutex_unlock(&objs->conv_mutex);
+}
+
+/** \brief Returns the raw value of a saturated pixel if the image data were set from raw pixels, otherwise 0.
+ *
+ * The image data of such an image are exact multiples of 1/raw_max, so they can be stored as raw values without loss.
+ */
+gfloat ccd_img_get_raw_max(CcdImg const *objs)
+{
+  return objs->raw_max;
+}
+
+/** \brief Set the image data from raw CCD pixels without copying them.
+ * \param objs Image.
+ * \param img_len Number of pixels.
+ * \param raw_data Raw pixels, which must remain valid until raw_release is called.
+ * \param raw_max Raw value of a saturated pixel (image data are raw values divided by raw_max).
+ * \param raw_release Function called with raw_release_data when the raw pixels are no longer needed (may be NULL).
+ * \param raw_release_data Data passed to raw_release.
+ *
+ * The pixels are converted to floating point when the image data are first needed, which saves copying the image
+ * when it arrives from the camera driver. raw_release may be called from any thread that accesses the image.
+ */
+void ccd_img_set_raw_data(CcdImg *objs, gulong img_len, guchar const *raw_data, gfloat raw_max, GDestroyNotify raw_release, gpointer raw_release_data)
+{
+  pthread_mutex_lock(&objs->conv_mutex);
+  release_raw_data(objs);
+  if (objs->img_data != NULL)
+  {
+    g_free(objs->img_data);
+    objs->img_data = NULL;
+  }
+  objs->img_len = img_len;
+  objs->raw_data = raw_data;
+  objs->raw_max = raw_max;
+  objs->raw_release = raw_release;
+  objs->raw_release_data = raw_release_data;
+  pthread_mutex_unlock(&objs->conv_mutex);
 }
 
 static void ccd_img_instance_init(GObject *ccd_img)
@@ -246,11 +313,17 @@ static void ccd_img_instance_init(GObject *ccd_img)
   objs->pix_size_ra = objs->pix_size_dec = 0.0;
   objs->img_len = 0;
   objs->img_data = NULL;
+  objs->raw_data = NULL;
+  objs->raw_max = 0.0;
+  objs->raw_release = NULL;
+  objs->raw_release_data = NULL;
+  pthread_mutex_init(&objs->conv_mutex, NULL);
 }
 
 static void ccd_img_class_init(CcdImgClass *klass)
 {
   G_OBJECT_CLASS(klass)->dispose = ccd_img_instance_dispose;
+  G_OBJECT_CLASS(klass)->finalize = ccd_img_instance_finalize;
 }
 
 static void ccd_img_instance_dispose(GObject *ccd_img)
@@ -266,7 +339,52 @@ static void ccd_img_instance_dispose(GObject *ccd_img)
     g_free(objs->img_data);
     objs->img_data = NULL;
   }
+  release_raw_data(objs);
   objs->img_len = 0;
   objs->img_type = IMGT_NONE;
 }
 
+static void ccd_img_instance_finalize(GObject *ccd_img)
+{
+  pthread_mutex_destroy(&CCD_IMG(ccd_img)->conv_mutex);
+  G_OBJECT_CLASS(g_type_class_peek_parent(G_OBJECT_GET_CLASS(ccd_img)))->finalize(ccd_img);
+}
+
+/// Hand the raw pixels back to their owner (the caller must hold conv_mutex, except during dispose)
+static void release_raw_data(CcdImg *objs)
+{
+  if (objs->raw_data == NULL)
+    return;
+  if (objs->raw_release != NULL)
+    objs->raw_release(objs->raw_release_data);
+  objs->raw_data = NULL;
+  objs->raw_release = NULL;
+  objs->raw_release_data = NULL;
+}
+
+/** \brief Convert raw pixels to image data (raw value divided by raw_max).
+ *
+ * Uses SSE2 to convert 16 pixels per iteration where available. Dividing (rather than multiplying by the reciprocal)
+ * keeps the results identical to those of the scalar loop.
+ */
+static void convert_raw_data(gfloat *img_data, guchar const *raw_data, gulong img_len, gfloat raw_max)
+{
+  gulong i = 0;
+  #ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  __m128 max4 = _mm_set1_ps(raw_max);
+  for (; i+16<=img_len; i+=16)
+  {
+    __m128i raw8 = _mm_loadu_si128((__m128i const *)&raw_data[i]);
+    __m128i raw16_lo = _mm_unpacklo_epi8(raw8, zero), raw16_hi = _mm_unpackhi_epi8(raw8, zero);
+    _mm_storeu_ps(&img_data[i], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(raw16_lo, zero)), max4));
+    _mm_storeu_ps(&img_data[i+4], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(raw16_lo, zero)), max4));
+    _mm_storeu_ps(&img_data[i+8], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(raw16_hi, zero)), max4));
+    _mm_storeu_ps(&img_data[i+12], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(raw16_hi, zero)), max4));
+  }
+  #endif
+  for (; i<img_len; i++)
+    img_data[i] = (gfloat)raw_data[i]/raw_max;
+}
+
+
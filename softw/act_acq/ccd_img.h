@@ -3,6 +3,7 @@
 
 #include <glib.h>
 #include <glib-object.h>
+#include <pthread.h>
 #include <act_timecoord.h>
 
 G_BEGIN_DECLS
@@ -58,8 +59,16 @@ struct _CcdImg
   gfloat pix_size_dec;
   /// Length of image
   gulong img_len;
-  /// Image data
+  /// Image data - for images set with ccd_img_set_raw_data this is only filled in on first access
   gfloat *img_data;
+  /// Raw (8-bit) pixels the image data will be converted from, with the value of a saturated pixel
+  guchar const *raw_data;
+  gfloat raw_max;
+  /// Called with raw_release_data once the raw pixels are no longer needed
+  GDestroyNotify raw_release;
+  gpointer raw_release_data;
+  /// Serialises the conversion of raw pixels (the image may be accessed from several threads)
+  pthread_mutex_t conv_mutex;
 };
 
 struct _CcdImgClass
@@ -99,6 +108,8 @@ gulong ccd_img_get_img_len(CcdImg const *objs);
 gfloat *ccd_img_get_img_data(CcdImg const *objs);
 gfloat ccd_img_get_pixel(CcdImg const *objs, gushort x, gushort y);
 void ccd_img_set_img_data(CcdImg *objs, gulong img_len, gfloat const *img_data);
+void ccd_img_set_raw_data(CcdImg *objs, gulong img_len, guchar const *raw_data, gfloat raw_max, GDestroyNotify raw_release, gpointer raw_release_data);
+gfloat ccd_img_get_raw_max(CcdImg const *objs);
 
 G_END_DECLS
 
@@ -3,6 +3,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <gtk/gtk.h>
+#include <act_log.h>
 #include "pattern_match.h"
 
 struct point
@@ -13,7 +14,46 @@ struct point
   float y;
 };
 
+/// Size of the hash grid cells used by FindPointMapping, in units of the match radius
+#define GRID_CELL_RADII   2.0
+/// Upper limit on the number of hash grid buckets
+#define GRID_MAX_BUCKETS  (1<<20)
+/// Number of side ratio bins (per axis) in the asterism triangle hash
+#define ASTERISM_INV_NUM_BINS  ((int)(1.0/ASTERISM_INV_BIN)+1)
+/// Grid cell indices are clamped to this magnitude, which only merges (never separates) distant cells
+#define GRID_MAX_CELL     (1<<28)
+
+/// Hash grid of items (cluster means or points), with the items in each bucket chained through next
+struct point_grid
+{
+  int num_buckets;
+  int *head, *next;
+  int *cell_x, *cell_y;
+};
+
+/// Candidate offset cluster in FindPointMapping
+struct dist_cand
+{
+  int idx;
+  int count;
+};
+
 void FindPointMapping (struct point *pList1, int nPts1, struct point *pList2, int nPts2, int** nMap, int* nMatch, float radius);
+static int grid_cell(float coord, float cell_size);
+static int grid_bucket(struct point_grid *grid, int cell_x, int cell_y);
+static int point_grid_init(struct point_grid *grid, int num_items);
+static void point_grid_free(struct point_grid *grid);
+static void point_grid_insert(struct point_grid *grid, int item, int cell_x, int cell_y);
+static void point_grid_move(struct point_grid *grid, int item, int cell_x, int cell_y);
+static int dist_cand_compare(const void *cand1, const void *cand2);
+static void tangent_project(gdouble ra0_d, gdouble dec0_d, gdouble ra_d, gdouble dec_d, gfloat *x, gfloat *y);
+static void tangent_deproject(gdouble ra0_d, gdouble dec0_d, gdouble x, gdouble y, gdouble *ra_d, gdouble *dec_d);
+static gint asterism_inv_bin(gfloat inv);
+static gint asterism_build_triangles(gfloat *x, gfloat *y, gint num, gint num_neighbours, struct asterism_tri **tri);
+static gboolean asterism_make_triangle(gfloat *x, gfloat *y, gint i, gint j, gint k, struct asterism_tri *tri);
+static int asterism_tri_compare(const void *tri1, const void *tri2);
+static gboolean similarity_fit(gfloat *px, gfloat *py, gfloat *qx, gfloat *qy, gint num, gdouble *tf);
+static gint asterism_count_matches(asterism_index_t *index, struct point_grid *grid2, gfloat *x1, gfloat *y1, gint num1, gdouble *tf, gfloat radius, gint *match, gdouble *sum_sq);
 
 GSList *find_point_list_map(PointList *list1, PointList *list2, gfloat radius)
 {
@@ -115,23 +155,70 @@ void point_list_map_free(GSList *map)
   }
 }
 
+/** \brief Find the translation that maps the most points in pList1 onto points in pList2.
+ *
+ * All offsets between points in the two lists are clustered: an offset is added to every existing cluster whose mean
+ * lies within radius of it (in x and y), otherwise it starts a new cluster. The clusters are then tried in order of
+ * decreasing size and for each the pairs of points that match within radius at that offset are counted, keeping the
+ * best mapping.
+ *
+ * Cluster means and the points of pList2 are binned in hash grids with cells of GRID_CELL_RADII times the radius, so
+ * only the 3x3 block of cells around an offset (or point) has to be searched instead of every cluster (or point).
+ * The clusters and the mapping found are the same as those of an exhaustive search.
+ */
 void FindPointMapping (struct point *pList1, int nPts1, struct point *pList2, int nPts2, int** nMap, int* nMatch, float radius)
 {
   struct point *dList;
   int *dCount, *cList, *cBest;
   int nDist;
-  int i, j, d, m;
+  int i, j, d, m, k;
   int nFound;
   float dx, dy;
-  int nMax, nPairs, nPairsBest;
+  int nPairs, nPairsBest;
+  struct point_grid dGrid, pGrid;
+  int *dMatched, nMatched;
+  struct dist_cand *dCand;
+  int nCand;
+  float cell_size = GRID_CELL_RADII * radius;
   
   dList = (struct point*) calloc( nPts1*nPts2, sizeof(struct point) );
   dCount = (int*) calloc( nPts1*nPts2, sizeof(int) );
   cList = (int*) calloc( nPts1*nPts2, sizeof(int) );
   cBest = (int*) calloc( nPts1*nPts2, sizeof(int) );
+  dMatched = (int*) calloc( nPts1*nPts2, sizeof(int) );
+  
+  if ((dList == NULL) || (dCount == NULL) || (cList == NULL) || (cBest == NULL) || (dMatched == NULL))
+  {
+    free( dList );
+    free( dCount );
+    free( cList );
+    free( cBest );
+    free( dMatched );
+    *nMap = NULL;
+    *nMatch = -1;
+    return;
+  }
   
-  if ((dList == NULL) || (dCount == NULL) || (cList == NULL) || (cBest == NULL))
+  /* nothing can lie within a non-positive radius */
+  if (!(radius > 0.0))
   {
+    *nMatch = 0;
+    *nMap = cBest;
+    free( dList );
+    free( dCount );
+    free( cList );
+    free( dMatched );
+    return;
+  }
+  
+  if ((point_grid_init(&dGrid, nPts1*nPts2) < 0) || (point_grid_init(&pGrid, nPts2) < 0))
+  {
+    point_grid_free(&dGrid);
+    free( dList );
+    free( dCount );
+    free( cList );
+    free( cBest );
+    free( dMatched );
     *nMap = NULL;
     *nMatch = -1;
     return;
@@ -146,30 +233,50 @@ void FindPointMapping (struct point *pList1, int nPts1, struct point *pList2, in
       dx = pList1[i].x - pList2[j].x;
       dy = pList1[i].y - pList2[j].y;
       
-      nFound = 0;
-      for (d=0; d<nDist; d++)
+      /* collect all clusters whose mean lies within radius before updating any of them, since an update can move a
+       * cluster to another grid cell */
+      nMatched = 0;
+      int cell_x = grid_cell(dx, cell_size), cell_y = grid_cell(dy, cell_size);
+      int ox, oy;
+      for (ox=-1; ox<=1; ox++)
       {
-        if ( (fabs(dList[d].x/dCount[d] - dx) < radius) 
-          && (fabs(dList[d].y/dCount[d] - dy) < radius) )
+        for (oy=-1; oy<=1; oy++)
         {
-          nFound = 1;
-          
-          dList[d].x += dx;
-          dList[d].y += dy;                                       
-          dCount[d]++;
+          d = dGrid.head[grid_bucket(&dGrid, cell_x+ox, cell_y+oy)];
+          for (; d>=0; d=dGrid.next[d])
+          {
+            if ((dGrid.cell_x[d] != cell_x+ox) || (dGrid.cell_y[d] != cell_y+oy))
+              continue;
+            if ( (fabs(dList[d].x/dCount[d] - dx) < radius) 
+              && (fabs(dList[d].y/dCount[d] - dy) < radius) )
+              dMatched[nMatched++] = d;
+          }
         }
       }
       
+      nFound = nMatched > 0;
+      for (k=0; k<nMatched; k++)
+      {
+        d = dMatched[k];
+        dList[d].x += dx;
+        dList[d].y += dy;                                       
+        dCount[d]++;
+        point_grid_move(&dGrid, d, grid_cell(dList[d].x/dCount[d], cell_size), grid_cell(dList[d].y/dCount[d], cell_size));
+      }
+      
       if (!nFound)
       {
         dList[nDist].x = dx;
         dList[nDist].y = dy;
         dCount[nDist] = 1;
+        point_grid_insert(&dGrid, nDist, cell_x, cell_y);
         
         nDist++;
       }
     }
   }
+  point_grid_free(&dGrid);
+  free( dMatched );
     
   /* get means of distance clusters */
   for (d=0; d<nDist; d++)
@@ -183,65 +290,91 @@ void FindPointMapping (struct point *pList1, int nPts1, struct point *pList2, in
     printf( "%4d  %9.3f  %9.3f %d\n", i, dList[i].x, dList[i].y, dCount[i] );
   #endif
   
+  /* only clusters with more than one member are possible mappings - try them from largest to smallest (the earliest
+   * cluster first where sizes are equal) */
+  dCand = (struct dist_cand*) calloc( nDist > 0 ? nDist : 1, sizeof(struct dist_cand) );
+  if (dCand == NULL)
+  {
+    point_grid_free(&pGrid);
+    free( dList );
+    free( dCount );
+    free( cList );
+    free( cBest );
+    *nMap = NULL;
+    *nMatch = -1;
+    return;
+  }
+  nCand = 0;
+  for (d=0; d<nDist; d++)
+  {
+    if (dCount[d] <= 1)
+      continue;
+    dCand[nCand].idx = d;
+    dCand[nCand].count = dCount[d];
+    nCand++;
+  }
+  qsort(dCand, nCand, sizeof(struct dist_cand), dist_cand_compare);
+  
+  for (j=0; j<nPts2; j++)
+    point_grid_insert(&pGrid, j, grid_cell(pList2[j].x, cell_size), grid_cell(pList2[j].y, cell_size));
+  
   /* find largest point mapping */
   nPairsBest = 0;
-  while (1)
+  for (k=0; k<nCand; k++)
   {
-    m = -1;
-    nMax = 1;
-    for (d=0; d<nDist; d++)
-    {
-      if (nMax < dCount[d])
-      {
-        m = d;
-        nMax = dCount[d];
-      }
-    }
+    m = dCand[k].idx;
     
-    /* stop if no more possibilities exist */
-    if (m == -1)
+    /* clusters are sorted by size, so none of the remaining options can be larger than the current best */
+    if (dCount[m] <= nPairsBest)
       break;
     
     #ifdef DEBUG
-      printf( "Offset (%f,%f)\n", dList[m].x, dList[m].y );
-      #endif
-      
-      /* only examine this option if it can possibly be larger than the current best */
-      if (dCount[m] > nPairsBest) 
+    printf( "Offset (%f,%f)\n", dList[m].x, dList[m].y );
+    #endif
+    
+    nPairs = 0;
+    for (i=0; i<nPts1; i++)
+    {
+      /* the first point in pList2 that matches at this offset */
+      cList[i] = -1;
+      int cell_x = grid_cell(pList1[i].x - dList[m].x, cell_size), cell_y = grid_cell(pList1[i].y - dList[m].y, cell_size);
+      int ox, oy;
+      for (ox=-1; ox<=1; ox++)
       {
-        nPairs = 0;
-        for (i=0; i<nPts1; i++)
+        for (oy=-1; oy<=1; oy++)
         {
-          cList[i] = -1;
-          for (j=0; j<nPts2; j++)
+          j = pGrid.head[grid_bucket(&pGrid, cell_x+ox, cell_y+oy)];
+          for (; j>=0; j=pGrid.next[j])
           {
+            if ((pGrid.cell_x[j] != cell_x+ox) || (pGrid.cell_y[j] != cell_y+oy))
+              continue;
+            if ((cList[i] >= 0) && (cList[i] < j))
+              continue;
             dx = pList1[i].x - pList2[j].x - dList[m].x;
             dy = pList1[i].y - pList2[j].y - dList[m].y;
             
             if ( fabs(dx) < radius && fabs(dy) < radius )
-            {
               cList[i] = j;
-              nPairs++;
-              break;
-            }
           }
         }
-        
-        if (nPairs > nPairsBest)
-        {
-          int* tmp;
-          
-          tmp = cBest;
-          cBest = cList;
-          cList = tmp;
-          
-          nPairsBest = nPairs;
-        }
       }
+      if (cList[i] >= 0)
+        nPairs++;
+    }
+    
+    if (nPairs > nPairsBest)
+    {
+      int* tmp;
+      
+      tmp = cBest;
+      cBest = cList;
+      cList = tmp;
       
-      /* don't try this option again */
-      dCount[m] = 0;
+      nPairsBest = nPairs;
+    }
   }
+  point_grid_free(&pGrid);
+  free( dCand );
   
   #ifdef DEBUG
   for (i=0; i<nPts1; i++)
@@ -259,3 +392,590 @@ void FindPointMapping (struct point *pList1, int nPts1, struct point *pList2, in
   free( dCount );
   free( cList );
 }
+
+static int grid_cell(float coord, float cell_size)
+{
+  double cell = floor(coord / cell_size);
+  if (cell > GRID_MAX_CELL)
+    return GRID_MAX_CELL;
+  if (!(cell >= -GRID_MAX_CELL))
+    return -GRID_MAX_CELL;
+  return (int) cell;
+}
+
+static int grid_bucket(struct point_grid *grid, int cell_x, int cell_y)
+{
+  unsigned int hash = ((unsigned int)cell_x * 73856093u) ^ ((unsigned int)cell_y * 19349663u);
+  return hash & (grid->num_buckets - 1);
+}
+
+static int point_grid_init(struct point_grid *grid, int num_items)
+{
+  grid->num_buckets = 1;
+  while ((grid->num_buckets < num_items) && (grid->num_buckets < GRID_MAX_BUCKETS))
+    grid->num_buckets *= 2;
+  grid->head = (int*) malloc( grid->num_buckets*sizeof(int) );
+  grid->next = (int*) malloc( (num_items > 0 ? num_items : 1)*sizeof(int) );
+  grid->cell_x = (int*) malloc( (num_items > 0 ? num_items : 1)*sizeof(int) );
+  grid->cell_y = (int*) malloc( (num_items > 0 ? num_items : 1)*sizeof(int) );
+  if ((grid->head == NULL) || (grid->next == NULL) || (grid->cell_x == NULL) || (grid->cell_y == NULL))
+  {
+    point_grid_free(grid);
+    return -1;
+  }
+  memset(grid->head, -1, grid->num_buckets*sizeof(int));
+  return 0;
+}
+
+static void point_grid_free(struct point_grid *grid)
+{
+  free(grid->head);
+  free(grid->next);
+  free(grid->cell_x);
+  free(grid->cell_y);
+  grid->head = grid->next = grid->cell_x = grid->cell_y = NULL;
+}
+
+static void point_grid_insert(struct point_grid *grid, int item, int cell_x, int cell_y)
+{
+  int bucket = grid_bucket(grid, cell_x, cell_y);
+  grid->cell_x[item] = cell_x;
+  grid->cell_y[item] = cell_y;
+  grid->next[item] = grid->head[bucket];
+  grid->head[bucket] = item;
+}
+
+static void point_grid_move(struct point_grid *grid, int item, int cell_x, int cell_y)
+{
+  if ((grid->cell_x[item] == cell_x) && (grid->cell_y[item] == cell_y))
+    return;
+  int *link = &grid->head[grid_bucket(grid, grid->cell_x[item], grid->cell_y[item])];
+  while (*link != item)
+    link = &grid->next[*link];
+  *link = grid->next[item];
+  point_grid_insert(grid, item, cell_x, cell_y);
+}
+
+static int dist_cand_compare(const void *cand1, const void *cand2)
+{
+  const struct dist_cand *c1 = (const struct dist_cand *)cand1, *c2 = (const struct dist_cand *)cand2;
+  if (c1->count != c2->count)
+    return c2->count - c1->count;
+  return c1->idx - c2->idx;
+}
+
+/** \brief Build the triangle index of a catalogue field.
+ * \param cat_list Catalogue stars (RA and Dec in degrees)
+ * \param ra0_d Right ascension of the field centre (degrees), used as the tangent point
+ * \param dec0_d Declination of the field centre (degrees), used as the tangent point
+ * \return New index, to be freed with asterism_index_free, or NULL on error.
+ */
+asterism_index_t *asterism_index_new(PointList *cat_list, gdouble ra0_d, gdouble dec0_d)
+{
+  gint i, num = point_list_get_num_used(cat_list);
+  asterism_index_t *index = calloc(1, sizeof(asterism_index_t));
+  if (index == NULL)
+    return NULL;
+  index->ra0_d = ra0_d;
+  index->dec0_d = dec0_d;
+  index->num_pts = num;
+  index->ra_d = calloc(num > 0 ? num : 1, sizeof(gfloat));
+  index->dec_d = calloc(num > 0 ? num : 1, sizeof(gfloat));
+  index->x = calloc(num > 0 ? num : 1, sizeof(gfloat));
+  index->y = calloc(num > 0 ? num : 1, sizeof(gfloat));
+  index->tri_head = malloc(ASTERISM_INV_NUM_BINS*ASTERISM_INV_NUM_BINS*sizeof(gint));
+  if ((index->ra_d == NULL) || (index->dec_d == NULL) || (index->x == NULL) || (index->y == NULL) || (index->tri_head == NULL))
+  {
+    asterism_index_free(index);
+    return NULL;
+  }
+  gdouble ra, dec;
+  for (i=0; i<num; i++)
+  {
+    point_list_get_coord(cat_list, i, &ra, &dec);
+    index->ra_d[i] = ra;
+    index->dec_d[i] = dec;
+    tangent_project(ra0_d, dec0_d, ra, dec, &index->x[i], &index->y[i]);
+  }
+  
+  index->num_tri = asterism_build_triangles(index->x, index->y, num, ASTERISM_CAT_NEIGHBOURS, &index->tri);
+  if (index->num_tri < 0)
+  {
+    asterism_index_free(index);
+    return NULL;
+  }
+  index->tri_next = malloc((index->num_tri > 0 ? index->num_tri : 1)*sizeof(gint));
+  if (index->tri_next == NULL)
+  {
+    asterism_index_free(index);
+    return NULL;
+  }
+  memset(index->tri_head, -1, ASTERISM_INV_NUM_BINS*ASTERISM_INV_NUM_BINS*sizeof(gint));
+  gint bin;
+  for (i=index->num_tri-1; i>=0; i--)
+  {
+    bin = asterism_inv_bin(index->tri[i].u)*ASTERISM_INV_NUM_BINS + asterism_inv_bin(index->tri[i].w);
+    index->tri_next[i] = index->tri_head[bin];
+    index->tri_head[bin] = i;
+  }
+  return index;
+}
+
+void asterism_index_free(asterism_index_t *index)
+{
+  if (index == NULL)
+    return;
+  free(index->ra_d);
+  free(index->dec_d);
+  free(index->x);
+  free(index->y);
+  free(index->tri);
+  free(index->tri_head);
+  free(index->tri_next);
+  free(index);
+}
+
+/// Check whether the index was built from exactly the stars in cat_list, so that it can be reused.
+gboolean asterism_index_matches(asterism_index_t *index, PointList *cat_list)
+{
+  if ((index == NULL) || (cat_list == NULL))
+    return FALSE;
+  if ((gint)point_list_get_num_used(cat_list) != index->num_pts)
+    return FALSE;
+  gint i;
+  gdouble ra, dec;
+  for (i=0; i<index->num_pts; i++)
+  {
+    point_list_get_coord(cat_list, i, &ra, &dec);
+    if (((gfloat)ra != index->ra_d[i]) || ((gfloat)dec != index->dec_d[i]))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/** \brief Match a list of points against an indexed catalogue field, allowing for rotation and scale differences.
+ * \param index Triangle index of the catalogue field
+ * \param list1 Points to match (RA and Dec in degrees), typically stars extracted from an image
+ * \param ra0_d Right ascension (degrees) of the centre of the list1 field
+ * \param dec0_d Declination (degrees) of the centre of the list1 field
+ * \param radius Match radius (degrees)
+ * \param fit Return location for the fitted transform and residual statistics, may be NULL
+ * \return List of point_map_t (list1 to catalogue), to be freed with point_list_map_free and g_slist_free. NULL if
+ *         no transform could be found.
+ *
+ * Every pair of similar triangles in list1 and the catalogue gives a similarity transform hypothesis and the one
+ * that maps the most list1 points to within radius of a catalogue star wins (a RANSAC search with the samples
+ * guided by the triangle hashes). The winning transform is then refined by a least-squares fit to all its matches.
+ */
+GSList *find_asterism_map(asterism_index_t *index, PointList *list1, gdouble ra0_d, gdouble dec0_d, gfloat radius, asterism_fit_t *fit)
+{
+  if (fit != NULL)
+    memset(fit, 0, sizeof(asterism_fit_t));
+  gint i, num1 = point_list_get_num_used(list1);
+  if ((index == NULL) || (num1 < 3) || (index->num_tri <= 0) || (!(radius > 0.0)))
+    return NULL;
+  
+  gfloat *x1 = malloc(num1*sizeof(gfloat)), *y1 = malloc(num1*sizeof(gfloat));
+  gint *match = malloc(num1*sizeof(gint));
+  struct asterism_tri *tri1 = NULL;
+  struct point_grid grid2;
+  memset(&grid2, 0, sizeof(grid2));
+  if ((x1 == NULL) || (y1 == NULL) || (match == NULL) || (point_grid_init(&grid2, index->num_pts) < 0))
+  {
+    free(x1);
+    free(y1);
+    free(match);
+    return NULL;
+  }
+  gdouble ra, dec;
+  for (i=0; i<num1; i++)
+  {
+    point_list_get_coord(list1, i, &ra, &dec);
+    tangent_project(index->ra0_d, index->dec0_d, ra, dec, &x1[i], &y1[i]);
+  }
+  gfloat cell_size = GRID_CELL_RADII * radius;
+  for (i=0; i<index->num_pts; i++)
+    point_grid_insert(&grid2, i, grid_cell(index->x[i], cell_size), grid_cell(index->y[i], cell_size));
+  gint num_tri1 = asterism_build_triangles(x1, y1, num1, ASTERISM_IMG_NEIGHBOURS, &tri1);
+  
+  // test the hypotheses given by all pairs of similar triangles
+  gdouble best_tf[4] = { 1.0, 0.0, 0.0, 0.0 }, tf[4], best_sq = 0.0, sq;
+  gint best_num = 0, num, num_hypoth = 0;
+  gint t, c, du, dw, bin_u, bin_w;
+  for (t=0; (t<num_tri1) && (num_hypoth<ASTERISM_MAX_HYPOTH) && (best_num<num1); t++)
+  {
+    bin_u = asterism_inv_bin(tri1[t].u);
+    bin_w = asterism_inv_bin(tri1[t].w);
+    for (du=-1; du<=1; du++)
+    {
+      if ((bin_u+du < 0) || (bin_u+du >= ASTERISM_INV_NUM_BINS))
+        continue;
+      for (dw=-1; dw<=1; dw++)
+      {
+        if ((bin_w+dw < 0) || (bin_w+dw >= ASTERISM_INV_NUM_BINS))
+          continue;
+        for (c=index->tri_head[(bin_u+du)*ASTERISM_INV_NUM_BINS + bin_w+dw]; c>=0; c=index->tri_next[c])
+        {
+          if ((fabs(index->tri[c].u - tri1[t].u) >= ASTERISM_INV_TOL) || (fabs(index->tri[c].w - tri1[t].w) >= ASTERISM_INV_TOL))
+            continue;
+          num_hypoth++;
+          gfloat px[3], py[3], qx[3], qy[3];
+          for (i=0; i<3; i++)
+          {
+            px[i] = x1[tri1[t].v[i]];
+            py[i] = y1[tri1[t].v[i]];
+            qx[i] = index->x[index->tri[c].v[i]];
+            qy[i] = index->y[index->tri[c].v[i]];
+          }
+          if (!similarity_fit(px, py, qx, qy, 3, tf))
+            continue;
+          num = asterism_count_matches(index, &grid2, x1, y1, num1, tf, radius, NULL, &sq);
+          if ((num > best_num) || ((num == best_num) && (sq < best_sq)))
+          {
+            best_num = num;
+            best_sq = sq;
+            memcpy(best_tf, tf, sizeof(best_tf));
+          }
+        }
+      }
+    }
+  }
+  free(tri1);
+  act_log_debug(act_log_msg("Asterism match: %d triangles in list, %d hypotheses tested, best maps %d of %d points.", num_tri1, num_hypoth, best_num, num1));
+  
+  // refine the best transform with a least-squares fit to all of its matches
+  gint iter, k;
+  gfloat *mx1 = malloc(num1*sizeof(gfloat)), *my1 = malloc(num1*sizeof(gfloat)), *mx2 = malloc(num1*sizeof(gfloat)), *my2 = malloc(num1*sizeof(gfloat));
+  for (iter=0; (iter<2) && (best_num>=3) && (mx1!=NULL) && (my1!=NULL) && (mx2!=NULL) && (my2!=NULL); iter++)
+  {
+    asterism_count_matches(index, &grid2, x1, y1, num1, best_tf, radius, match, NULL);
+    for (i=0, k=0; i<num1; i++)
+    {
+      if (match[i] < 0)
+        continue;
+      mx1[k] = x1[i];
+      my1[k] = y1[i];
+      mx2[k] = index->x[match[i]];
+      my2[k] = index->y[match[i]];
+      k++;
+    }
+    if (!similarity_fit(mx1, my1, mx2, my2, k, tf))
+      break;
+    num = asterism_count_matches(index, &grid2, x1, y1, num1, tf, radius, NULL, NULL);
+    if (num < best_num)
+      break;
+    best_num = num;
+    memcpy(best_tf, tf, sizeof(best_tf));
+  }
+  free(mx1);
+  free(my1);
+  free(mx2);
+  free(my2);
+  
+  GSList *ret = NULL;
+  if (best_num >= 3)
+  {
+    asterism_count_matches(index, &grid2, x1, y1, num1, best_tf, radius, match, NULL);
+    gdouble resid, resid_sum=0.0, resid_sq=0.0, resid_max=0.0;
+    point_map_t *tmp_map;
+    for (i=0; i<num1; i++)
+    {
+      if (match[i] < 0)
+        continue;
+      tmp_map = g_malloc(sizeof(point_map_t));
+      if (tmp_map == NULL)
+      {
+        // Failed to allocate memory
+        point_list_map_free(ret);
+        g_slist_free(ret);
+        ret = NULL;
+        best_num = 0;
+        break;
+      }
+      point_list_get_coord(list1, i, &ra, &dec);
+      tmp_map->idx1 = i;
+      tmp_map->idx2 = match[i];
+      tmp_map->x1 = ra;
+      tmp_map->y1 = dec;
+      tmp_map->x2 = index->ra_d[match[i]];
+      tmp_map->y2 = index->dec_d[match[i]];
+      ret = g_slist_prepend(ret, tmp_map);
+      resid = hypot(best_tf[0]*x1[i] - best_tf[1]*y1[i] + best_tf[2] - index->x[match[i]], best_tf[1]*x1[i] + best_tf[0]*y1[i] + best_tf[3] - index->y[match[i]]);
+      resid_sum += resid;
+      resid_sq += resid*resid;
+      if (resid > resid_max)
+        resid_max = resid;
+    }
+    if ((fit != NULL) && (ret != NULL))
+    {
+      fit->a = best_tf[0];
+      fit->b = best_tf[1];
+      fit->dx = best_tf[2];
+      fit->dy = best_tf[3];
+      fit->scale = hypot(best_tf[0], best_tf[1]);
+      fit->rot_d = atan2(best_tf[1], best_tf[0]) * 180.0 / M_PI;
+      fit->num_match = best_num;
+      fit->resid_mean = resid_sum / best_num;
+      fit->resid_rms = sqrt(resid_sq / best_num);
+      fit->resid_max = resid_max;
+      // where the centre of the list1 field lands in the catalogue field
+      gfloat xc, yc;
+      gdouble ra_c, dec_c;
+      tangent_project(index->ra0_d, index->dec0_d, ra0_d, dec0_d, &xc, &yc);
+      tangent_deproject(index->ra0_d, index->dec0_d, best_tf[0]*xc - best_tf[1]*yc + best_tf[2], best_tf[1]*xc + best_tf[0]*yc + best_tf[3], &ra_c, &dec_c);
+      fit->ra_shift = ra0_d - ra_c;
+      if (fit->ra_shift > 180.0)
+        fit->ra_shift -= 360.0;
+      else if (fit->ra_shift < -180.0)
+        fit->ra_shift += 360.0;
+      fit->dec_shift = dec0_d - dec_c;
+    }
+  }
+  point_grid_free(&grid2);
+  free(x1);
+  free(y1);
+  free(match);
+  return ret;
+}
+
+/// Gnomonic projection of (ra_d, dec_d) onto the plane tangent to the sky at (ra0_d, dec0_d), in degrees.
+static void tangent_project(gdouble ra0_d, gdouble dec0_d, gdouble ra_d, gdouble dec_d, gfloat *x, gfloat *y)
+{
+  gdouble ra0 = ra0_d*M_PI/180.0, dec0 = dec0_d*M_PI/180.0, ra = ra_d*M_PI/180.0, dec = dec_d*M_PI/180.0;
+  gdouble cosc = sin(dec0)*sin(dec) + cos(dec0)*cos(dec)*cos(ra-ra0);
+  *x = cos(dec)*sin(ra-ra0) / cosc * 180.0/M_PI;
+  *y = (cos(dec0)*sin(dec) - sin(dec0)*cos(dec)*cos(ra-ra0)) / cosc * 180.0/M_PI;
+}
+
+/// Inverse of tangent_project.
+static void tangent_deproject(gdouble ra0_d, gdouble dec0_d, gdouble x, gdouble y, gdouble *ra_d, gdouble *dec_d)
+{
+  gdouble xi = x*M_PI/180.0, eta = y*M_PI/180.0, dec0 = dec0_d*M_PI/180.0;
+  gdouble rho = hypot(xi, eta);
+  if (rho == 0.0)
+  {
+    *ra_d = ra0_d;
+    *dec_d = dec0_d;
+    return;
+  }
+  gdouble c = atan(rho);
+  *dec_d = asin(cos(c)*sin(dec0) + eta*sin(c)*cos(dec0)/rho) * 180.0/M_PI;
+  *ra_d = ra0_d + atan2(xi*sin(c), rho*cos(dec0)*cos(c) - eta*sin(dec0)*sin(c)) * 180.0/M_PI;
+  if (*ra_d < 0.0)
+    *ra_d += 360.0;
+  else if (*ra_d >= 360.0)
+    *ra_d -= 360.0;
+}
+
+static gint asterism_inv_bin(gfloat inv)
+{
+  gint bin = (gint)(inv / ASTERISM_INV_BIN);
+  if (bin < 0)
+    return 0;
+  if (bin >= ASTERISM_INV_NUM_BINS)
+    return ASTERISM_INV_NUM_BINS-1;
+  return bin;
+}
+
+/** \brief Form triangles from every point and each pair of its num_neighbours nearest neighbours.
+ * \return Number of (distinct) triangles, or <0 on error.
+ */
+static gint asterism_build_triangles(gfloat *x, gfloat *y, gint num, gint num_neighbours, struct asterism_tri **tri)
+{
+  if (num_neighbours > num-1)
+    num_neighbours = num-1;
+  gint num_alloc = num_neighbours > 1 ? num*num_neighbours*(num_neighbours-1)/2 : 1;
+  *tri = malloc(num_alloc*sizeof(struct asterism_tri));
+  gint *nbr = malloc((num_neighbours > 0 ? num_neighbours : 1)*sizeof(gint));
+  gfloat *nbr_dist = malloc((num_neighbours > 0 ? num_neighbours : 1)*sizeof(gfloat));
+  if ((*tri == NULL) || (nbr == NULL) || (nbr_dist == NULL))
+  {
+    free(*tri);
+    *tri = NULL;
+    free(nbr);
+    free(nbr_dist);
+    return -1;
+  }
+  
+  gint i, j, k, l, num_nbr, num_tri = 0;
+  gfloat dist;
+  for (i=0; i<num; i++)
+  {
+    // nearest neighbours by insertion into a short sorted list
+    num_nbr = 0;
+    for (j=0; j<num; j++)
+    {
+      if (j == i)
+        continue;
+      dist = (x[j]-x[i])*(x[j]-x[i]) + (y[j]-y[i])*(y[j]-y[i]);
+      if ((num_nbr == num_neighbours) && (dist >= nbr_dist[num_nbr-1]))
+        continue;
+      if (num_nbr < num_neighbours)
+        num_nbr++;
+      for (k=num_nbr-1; (k>0) && (nbr_dist[k-1]>dist); k--)
+      {
+        nbr_dist[k] = nbr_dist[k-1];
+        nbr[k] = nbr[k-1];
+      }
+      nbr_dist[k] = dist;
+      nbr[k] = j;
+    }
+    for (k=0; k<num_nbr; k++)
+    {
+      for (l=k+1; l<num_nbr; l++)
+      {
+        if (asterism_make_triangle(x, y, i, nbr[k], nbr[l], &(*tri)[num_tri]))
+          num_tri++;
+      }
+    }
+  }
+  free(nbr);
+  free(nbr_dist);
+  
+  // the same triangle is found from each of its vertices when they are mutual neighbours
+  qsort(*tri, num_tri, sizeof(struct asterism_tri), asterism_tri_compare);
+  for (i=0, j=0; i<num_tri; i++)
+  {
+    if ((j > 0) && (asterism_tri_compare(&(*tri)[j-1], &(*tri)[i]) == 0))
+      continue;
+    (*tri)[j++] = (*tri)[i];
+  }
+  return j;
+}
+
+/// Fill in a triangle with vertices in canonical order and its side ratios. Returns FALSE for degenerate triangles.
+static gboolean asterism_make_triangle(gfloat *x, gfloat *y, gint i, gint j, gint k, struct asterism_tri *tri)
+{
+  // side lengths, each indexed by the opposite vertex
+  gint vert[3] = { i, j, k }, tmp_v, m, n;
+  gfloat side[3], tmp_s;
+  side[0] = hypot(x[j]-x[k], y[j]-y[k]);
+  side[1] = hypot(x[i]-x[k], y[i]-y[k]);
+  side[2] = hypot(x[i]-x[j], y[i]-y[j]);
+  // sort ascending, so the vertices end up opposite the shortest, middle and longest sides
+  for (m=0; m<2; m++)
+  {
+    for (n=0; n<2-m; n++)
+    {
+      if (side[n] <= side[n+1])
+        continue;
+      tmp_s = side[n];
+      side[n] = side[n+1];
+      side[n+1] = tmp_s;
+      tmp_v = vert[n];
+      vert[n] = vert[n+1];
+      vert[n+1] = tmp_v;
+    }
+  }
+  if (!(side[2] > 0.0))
+    return FALSE;
+  tri->u = side[1] / side[2];
+  tri->w = side[0] / side[2];
+  if (tri->w < ASTERISM_MIN_SIDE_RATIO)
+    return FALSE;
+  memcpy(tri->v, vert, sizeof(vert));
+  return TRUE;
+}
+
+static int asterism_tri_compare(const void *tri1, const void *tri2)
+{
+  const struct asterism_tri *t1 = (const struct asterism_tri *)tri1, *t2 = (const struct asterism_tri *)tri2;
+  gint i;
+  for (i=0; i<3; i++)
+  {
+    if (t1->v[i] != t2->v[i])
+      return t1->v[i] - t2->v[i];
+  }
+  return 0;
+}
+
+/** \brief Least-squares similarity transform (rotation, uniform scale and translation) mapping p onto q.
+ * \param tf Return location for the transform (a, b, dx, dy) - see asterism_fit_t
+ * \return FALSE if the points are degenerate or the scale is outside ASTERISM_MIN_SCALE to ASTERISM_MAX_SCALE.
+ */
+static gboolean similarity_fit(gfloat *px, gfloat *py, gfloat *qx, gfloat *qy, gint num, gdouble *tf)
+{
+  if (num < 2)
+    return FALSE;
+  gint i;
+  gdouble pcx=0.0, pcy=0.0, qcx=0.0, qcy=0.0;
+  for (i=0; i<num; i++)
+  {
+    pcx += px[i];
+    pcy += py[i];
+    qcx += qx[i];
+    qcy += qy[i];
+  }
+  pcx /= num;
+  pcy /= num;
+  qcx /= num;
+  qcy /= num;
+  gdouble sum_pp=0.0, sum_a=0.0, sum_b=0.0, dpx, dpy, dqx, dqy;
+  for (i=0; i<num; i++)
+  {
+    dpx = px[i] - pcx;
+    dpy = py[i] - pcy;
+    dqx = qx[i] - qcx;
+    dqy = qy[i] - qcy;
+    sum_pp += dpx*dpx + dpy*dpy;
+    sum_a += dpx*dqx + dpy*dqy;
+    sum_b += dpx*dqy - dpy*dqx;
+  }
+  if (!(sum_pp > 0.0))
+    return FALSE;
+  tf[0] = sum_a / sum_pp;
+  tf[1] = sum_b / sum_pp;
+  gdouble scale = hypot(tf[0], tf[1]);
+  if ((scale < ASTERISM_MIN_SCALE) || (scale > ASTERISM_MAX_SCALE))
+    return FALSE;
+  tf[2] = qcx - (tf[0]*pcx - tf[1]*pcy);
+  tf[3] = qcy - (tf[1]*pcx + tf[0]*pcy);
+  return TRUE;
+}
+
+/** \brief Count the points that the transform maps to within radius of a catalogue star.
+ * \param match If not NULL, filled in with the index of the nearest catalogue star for each point (-1 if none).
+ * \param sum_sq If not NULL, set to the sum of the squared distances of the matched points.
+ */
+static gint asterism_count_matches(asterism_index_t *index, struct point_grid *grid2, gfloat *x1, gfloat *y1, gint num1, gdouble *tf, gfloat radius, gint *match, gdouble *sum_sq)
+{
+  gint i, j, ox, oy, cell_x, cell_y, best_j, num = 0;
+  gfloat cell_size = GRID_CELL_RADII * radius;
+  gdouble tx, ty, dist, best_dist;
+  if (sum_sq != NULL)
+    *sum_sq = 0.0;
+  for (i=0; i<num1; i++)
+  {
+    tx = tf[0]*x1[i] - tf[1]*y1[i] + tf[2];
+    ty = tf[1]*x1[i] + tf[0]*y1[i] + tf[3];
+    cell_x = grid_cell(tx, cell_size);
+    cell_y = grid_cell(ty, cell_size);
+    best_j = -1;
+    best_dist = radius*radius;
+    for (ox=-1; ox<=1; ox++)
+    {
+      for (oy=-1; oy<=1; oy++)
+      {
+        for (j=grid2->head[grid_bucket(grid2, cell_x+ox, cell_y+oy)]; j>=0; j=grid2->next[j])
+        {
+          if ((grid2->cell_x[j] != cell_x+ox) || (grid2->cell_y[j] != cell_y+oy))
+            continue;
+          dist = (index->x[j]-tx)*(index->x[j]-tx) + (index->y[j]-ty)*(index->y[j]-ty);
+          if (dist < best_dist)
+          {
+            best_dist = dist;
+            best_j = j;
+          }
+        }
+      }
+    }
+    if (match != NULL)
+      match[i] = best_j;
+    if (best_j < 0)
+      continue;
+    num++;
+    if (sum_sq != NULL)
+      *sum_sq += best_dist;
+  }
+  return num;
+}
@@ -22,9 +22,68 @@ typedef struct _point_map_t
   gfloat y1, y2;
 } point_map_t;
 
+/** \brief Definitions for the triangle asterism matcher
+ * Triangles are formed from each star and pairs of its ASTERISM_CAT_NEIGHBOURS (catalogue) or ASTERISM_IMG_NEIGHBOURS
+ * (image) nearest neighbours and hashed by their side ratios in bins of ASTERISM_INV_BIN. Triangles whose side ratios
+ * agree to within ASTERISM_INV_TOL give similarity transform hypotheses, which are accepted if their scale lies 
+ * between ASTERISM_MIN_SCALE and ASTERISM_MAX_SCALE. At most ASTERISM_MAX_HYPOTH hypotheses are tested.
+ * \{ */
+#define ASTERISM_CAT_NEIGHBOURS  8
+#define ASTERISM_IMG_NEIGHBOURS  6
+#define ASTERISM_INV_BIN         0.01
+#define ASTERISM_INV_TOL         0.01
+#define ASTERISM_MIN_SIDE_RATIO  0.1
+#define ASTERISM_MIN_SCALE       0.8
+#define ASTERISM_MAX_SCALE       1.25
+#define ASTERISM_MAX_HYPOTH      20000
+/** \} */
+
+/// Triangle of stars, vertices ordered opposite the shortest, middle and longest sides.
+struct asterism_tri
+{
+  gint v[3];
+  /// Middle and shortest side lengths as fractions of the longest side
+  gfloat u, w;
+};
+
+/** \brief Triangle index of a catalogue field, built once per field and reused for every image of that field.
+ *
+ * Stars are projected onto the tangent plane at (ra0_d, dec0_d), in degrees.
+ */
+typedef struct _asterism_index_t
+{
+  gdouble ra0_d, dec0_d;
+  gint num_pts;
+  gfloat *ra_d, *dec_d;
+  gfloat *x, *y;
+  gint num_tri;
+  struct asterism_tri *tri;
+  gint *tri_head, *tri_next;
+} asterism_index_t;
+
+/** \brief Result of an asterism match.
+ *
+ * The transform maps list1 onto list2 tangent plane coordinates (degrees):
+ *   x2 = a*x1 - b*y1 + dx,   y2 = b*x1 + a*y1 + dy
+ * ra_shift and dec_shift are the offsets of the list1 field centre in the same sense as point_list_map_calc_offset
+ * (list1 minus list2). Residuals are the distances (degrees) between the transformed list1 points and their matches.
+ */
+typedef struct _asterism_fit_t
+{
+  gdouble a, b, dx, dy;
+  gdouble scale, rot_d;
+  gdouble ra_shift, dec_shift;
+  gint num_match;
+  gdouble resid_mean, resid_rms, resid_max;
+} asterism_fit_t;
+
 /// \brief Thin wrapper around FindPointMapping
 GSList *find_point_list_map(PointList *list1, PointList *list2, gfloat radius);
 void point_list_map_calc_offset(GSList *map, gfloat *mean_x, gfloat *mean_y, gfloat *std_x, gfloat *std_y);
 void point_list_map_free(GSList *map);
+asterism_index_t *asterism_index_new(PointList *cat_list, gdouble ra0_d, gdouble dec0_d);
+void asterism_index_free(asterism_index_t *index);
+gboolean asterism_index_matches(asterism_index_t *index, PointList *cat_list);
+GSList *find_asterism_map(asterism_index_t *index, PointList *list1, gdouble ra0_d, gdouble dec0_d, gfloat radius, asterism_fit_t *fit);
 
 #endif
\ No newline at end of file
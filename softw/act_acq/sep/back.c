@@ -50,6 +50,7 @@ void backstat(backstruct *, PIXTYPE *, PIXTYPE *,
 int filterback(sepbackmap *bkmap, int fw, int fh, float fthresh);
 float backguess(backstruct *, float *, float *);
 int makebackspline(sepbackmap *, float *, float *);
+int backinterpmap(sepbackinterp *, float *, float *, float *);
 
 
 int sep_makeback(void *im, void *mask, int dtype, int mdtype, int w, int h,
@@ -1197,6 +1198,250 @@ int sep_subbackarray(sepbackmap *bkmap, void *arr, int dtype)
   return status;
 }
 
+/*****************************************************************************/
+/* Interpolation with precomputed weights */
+
+int sep_makebackinterp(sepbackmap *bkmap, sepbackinterp **interp)
+{
+  sepbackinterp *ip;
+  int   i,j,x,y,yl, nbx,nbxm1,nby, nx, node, changepoint, status;
+  float dx,dx0,dy, cdx,cdy, xstep;
+
+  status = RETURN_OK;
+  ip = NULL;
+
+  QCALLOC(ip, sepbackinterp, 1, status);
+  ip->w = bkmap->w;
+  ip->h = bkmap->h;
+  ip->bw = bkmap->bw;
+  ip->bh = bkmap->bh;
+  ip->nx = nbx = bkmap->nx;
+  ip->ny = nby = bkmap->ny;
+  nbxm1 = nbx - 1;
+  QMALLOC(ip->segstart, int, nbx+1, status);
+  QMALLOC(ip->segnode, int, nbx, status);
+  QMALLOC(ip->xlo, float, ip->w, status);
+  QMALLOC(ip->xhi, float, ip->w, status);
+  QMALLOC(ip->xdlo, float, ip->w, status);
+  QMALLOC(ip->xdhi, float, ip->w, status);
+  QMALLOC(ip->ynode, int, ip->h, status);
+  QMALLOC(ip->ylo, float, ip->h, status);
+  QMALLOC(ip->yhi, float, ip->h, status);
+  QMALLOC(ip->ydlo, float, ip->h, status);
+  QMALLOC(ip->ydhi, float, ip->h, status);
+
+  /*-- Columns, stepped through as in sep_backline_flt() */
+  ip->nseg = 1;
+  ip->segstart[0] = 0;
+  ip->segnode[0] = 0;
+  if (nbx>1)
+    {
+      nx = bkmap->bw;
+      xstep = 1.0/nx;
+      changepoint = nx/2;
+      dx  = (xstep - 1)/2;	/* dx of the first pixel in the row */
+      dx0 = ((nx+1)%2)*xstep/2;	/* dx of the 1st pixel right to a bkgnd node */
+      node = 0;
+      for (x=i=j=0; j<ip->w; j++, i++, dx += xstep)
+	{
+	  if (i==changepoint && x>0 && x<nbxm1)
+	    {
+	      ip->segstart[ip->nseg] = j;
+	      ip->segnode[ip->nseg++] = ++node;
+	      dx = dx0;
+	    }
+	  cdx = 1 - dx;
+	  ip->xlo[j] = cdx;
+	  ip->xhi[j] = dx;
+	  ip->xdlo[j] = cdx*(cdx*cdx-1);
+	  ip->xdhi[j] = dx*(dx*dx-1);
+	  if (i==nx)
+	    {
+	      x++;
+	      i = 0;
+	    }
+	}
+    }
+  else
+    for (j=0; j<ip->w; j++)
+      {
+	ip->xlo[j] = 1.0;
+	ip->xhi[j] = ip->xdlo[j] = ip->xdhi[j] = 0.0;
+      }
+  ip->segstart[ip->nseg] = ip->w;
+
+  /*-- Rows */
+  for (y=0; y<ip->h; y++)
+    {
+      if (nby > 1)
+	{
+	  dy = (float)y/bkmap->bh - 0.5;
+	  dy -= (yl = (int)dy);
+	  if (yl<0)
+	    {
+	      yl = 0;
+	      dy -= 1.0;
+	    }
+	  else if (yl>=nby-1)
+	    {
+	      yl = nby<2 ? 0 : nby-2;
+	      dy += 1.0;
+	    }
+	  cdy = 1 - dy;
+	  ip->ynode[y] = yl;
+	  ip->ylo[y] = cdy;
+	  ip->yhi[y] = dy;
+	  ip->ydlo[y] = cdy*cdy*cdy-cdy;
+	  ip->ydhi[y] = dy*dy*dy-dy;
+	}
+      else
+	{
+	  ip->ynode[y] = 0;
+	  ip->ylo[y] = 1.0;
+	  ip->yhi[y] = ip->ydlo[y] = ip->ydhi[y] = 0.0;
+	}
+    }
+
+  *interp = ip;
+  return status;
+
+ exit:
+  sep_freebackinterp(ip);
+  *interp = NULL;
+  return status;
+}
+
+/*
+Evaluate a background map (back or sigma, with 2nd derivatives along y in
+dmap) for the whole image, using the weights in interp.
+*/
+int backinterpmap(sepbackinterp *ip, float *map, float *dmap, float *arr)
+{
+  int   j,k,s,x,y, nbx,nby, w, status;
+  float a,b,c,d, temp;
+  float *node,*dnode,*u, *nd,*dnd, *nodep,*dn,*uu, *blo,*bhi,*dblo,*dbhi;
+  float *line;
+
+  status = RETURN_OK;
+  node = dnode = u = NULL;
+  nbx = ip->nx;
+  nby = ip->ny;
+  w = ip->w;
+
+  QMALLOC(node, float, nbx, status);
+  QMALLOC(dnode, float, nbx, status);
+  QMALLOC(u, float, nbx, status);
+
+  for (y=0, line=arr; y<ip->h; y++, line+=w)
+    {
+      if (nby > 1)
+	{
+	  /*-- Interpolation along y for each node */
+	  a = ip->ylo[y];
+	  b = ip->yhi[y];
+	  c = ip->ydlo[y];
+	  d = ip->ydhi[y];
+	  blo = map + nbx*ip->ynode[y];
+	  bhi = blo + nbx;
+	  dblo = dmap + nbx*ip->ynode[y];
+	  dbhi = dblo + nbx;
+	  for (x=0; x<nbx; x++)
+	    node[x] = a*blo[x] + b*bhi[x] + c*dblo[x] + d*dbhi[x];
+	  nd = node;
+	  dnd = dnode;
+
+	  /*-- Computation of 2nd derivatives along x */
+	  if (nbx>1)
+	    {
+	      dn = dnode;
+	      uu = u;
+	      *dn = *uu = 0.0;	/* "natural" lower boundary condition */
+	      nodep = node+1;
+	      for (x=nbx-1; --x; nodep++)
+		{
+		  temp = -1/(*(dn++)+4);
+		  *dn = temp;
+		  temp *= *(uu++) - 6*(*(nodep+1)+*(nodep-1)-2**nodep);
+		  *uu = temp;
+		}
+	      *(++dn) = 0.0;	/* "natural" upper boundary condition */
+	      for (x=nbx-2; x--;)
+		{
+		  temp = *(dn--);
+		  *dn = (*dn*temp+*(uu--))/6.0;
+		}
+	    }
+	}
+      else
+	{
+	  /*-- No interpolation and no new 2nd derivatives needed along y */
+	  nd = map;
+	  dnd = dmap;
+	}
+
+      /*-- Interpolation along x, one run of columns at a time */
+      if (nbx>1)
+	for (s=0; s<ip->nseg; s++)
+	  {
+	    k = ip->segnode[s];
+	    a = nd[k];
+	    b = nd[k+1];
+	    c = dnd[k];
+	    d = dnd[k+1];
+	    for (j=ip->segstart[s]; j<ip->segstart[s+1]; j++)
+	      line[j] = a*ip->xlo[j] + b*ip->xhi[j] + c*ip->xdlo[j]
+		+ d*ip->xdhi[j];
+	  }
+      else
+	for (j=0; j<w; j++)
+	  line[j] = *nd;
+    }
+
+ exit:
+  free(node);
+  free(dnode);
+  free(u);
+  return status;
+}
+
+int sep_backinterparrays(sepbackmap *bkmap, sepbackinterp *interp,
+			 float *back, float *rms)
+{
+  int status = RETURN_OK;
+
+  if (bkmap->w != interp->w || bkmap->h != interp->h ||
+      bkmap->bw != interp->bw || bkmap->bh != interp->bh)
+    return BACKINTERP_MISMATCH;
+
+  if (back &&
+      (status = backinterpmap(interp, bkmap->back, bkmap->dback, back))
+      != RETURN_OK)
+    return status;
+  if (rms)
+    status = backinterpmap(interp, bkmap->sigma, bkmap->dsigma, rms);
+
+  return status;
+}
+
+void sep_freebackinterp(sepbackinterp *interp)
+{
+  if (interp)
+    {
+      free(interp->segstart);
+      free(interp->segnode);
+      free(interp->xlo);
+      free(interp->xhi);
+      free(interp->xdlo);
+      free(interp->xdhi);
+      free(interp->ynode);
+      free(interp->ylo);
+      free(interp->yhi);
+      free(interp->ydlo);
+      free(interp->ydhi);
+    }
+  free(interp);
+}
+
 /*****************************************************************************/
 
 void sep_freeback(sepbackmap *bkmap)
@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "sep.h"
 #include "sepcore.h"
 #include "extract.h"
@@ -35,9 +36,6 @@
 			             /* thresholding filtered weight-maps */
 
 /* globals */
-int plistexist_cdvalue, plistexist_thresh, plistexist_var;
-int plistoff_value, plistoff_cdvalue, plistoff_thresh, plistoff_var;
-int plistsize;
 size_t extract_pixstack = 300000;
 
 /* get and set pixstack */
@@ -51,11 +49,53 @@ size_t sep_get_extract_pixstack()
   return extract_pixstack;
 }
 
-int  sortit(infostruct *, objliststruct *, int,
+/* a horizontal strip of the image, extracted by one thread of
+ * sep_extract_tiled() */
+typedef struct
+{
+  sep_context   *ctx;
+  void          *image, *noise;
+  int           dtype, ndtype, w, h;
+  int           ystart, yend, yown0, yown1;
+  float         thresh, *conv;
+  int           minarea, convw, convh, deblend_nthresh;
+  double        deblend_cont;
+  objliststruct objlist;
+  int           status;
+} extractstrip;
+
+int  sortit(sep_context *, infostruct *, objliststruct *, int,
 	    objliststruct *, int, double);
-void plistinit(void *, void *);
+void plistinit(sep_context *, void *, void *);
 void clean(objliststruct *objlist, double clean_param, int *survives);
 int convertobj(int l, objliststruct *objlist, sepobj *objout, int w);
+int extractrows(sep_context *ctx, void *image, void *noise,
+		int dtype, int ndtype, int w, int h,
+		float thresh, int minarea, float *conv, int convw, int convh,
+		int deblend_nthresh, double deblend_cont,
+		objliststruct *finalobjlist);
+int finishobjlist(sep_context *ctx, objliststruct *finalobjlist, int w,
+		  float thresh, int minarea, int clean_flag, double clean_param,
+		  sepobj **objects, int *nobj);
+int extractinit(sep_context *ctx, void *noise, int w, int h, float *conv,
+		int deblend_nthresh);
+void *extractstrip_thread(void *arg);
+
+/****************************** context **************************************/
+sep_context *sep_context_new(void)
+{
+  return (sep_context *)calloc(1, sizeof(sep_context));
+}
+
+void sep_context_free(sep_context *ctx)
+{
+  if (!ctx)
+    return;
+  lutzfree(ctx);
+  freedeblend(ctx);
+  free(ctx->pixstack);
+  free(ctx);
+}
 
 /****************************** extract **************************************/
 int sep_extract(void *image, void *noise,
@@ -64,13 +104,266 @@ int sep_extract(void *image, void *noise,
 		int deblend_nthresh, double deblend_cont,
 		int clean_flag, double clean_param,
 		sepobj **objects, int *nobj)
+{
+  sep_context *ctx;
+  int         status;
+
+  if (!(ctx = sep_context_new()))
+    {
+      *objects = NULL;
+      *nobj = 0;
+      return MEMORY_ALLOC_ERROR;
+    }
+  status = sep_extract_ctx(ctx, image, noise, dtype, ndtype, noise_flag, w, h,
+			   thresh, minarea, conv, convw, convh,
+			   deblend_nthresh, deblend_cont, clean_flag,
+			   clean_param, objects, nobj);
+  sep_context_free(ctx);
+
+  return status;
+}
+
+int sep_extract_ctx(sep_context *ctx, void *image, void *noise,
+		    int dtype, int ndtype, short noise_flag, int w, int h,
+		    float thresh, int minarea, float *conv, int convw,
+		    int convh, int deblend_nthresh, double deblend_cont,
+		    int clean_flag, double clean_param,
+		    sepobj **objects, int *nobj)
+{
+  objliststruct finalobjlist;
+  int           status;
+
+  /* the return catalog */
+  finalobjlist.obj = NULL;
+  finalobjlist.plist = NULL;
+  finalobjlist.nobj = finalobjlist.npix = 0;
+
+  status = extractinit(ctx, noise, w, h, conv, deblend_nthresh);
+  if (status != RETURN_OK)
+    goto exit;
+
+  ctx->ystart = ctx->yown0 = 0;
+  ctx->yend = ctx->yown1 = h;
+  status = extractrows(ctx, image, noise, dtype, ndtype, w, h, thresh,
+		       minarea, conv, convw, convh, deblend_nthresh,
+		       deblend_cont, &finalobjlist);
+  if (status != RETURN_OK)
+    goto exit;
+
+  status = finishobjlist(ctx, &finalobjlist, w, thresh, minarea,
+			 clean_flag, clean_param, objects, nobj);
+
+ exit:
+  free(finalobjlist.obj);
+  free(finalobjlist.plist);
+
+  if (status != RETURN_OK)
+    {
+      *objects = NULL;
+      *nobj = 0;
+    }
+
+  return status;
+}
+
+/***************************** extract_tiled *********************************/
+int sep_extract_tiled(sep_context **ctx, int nctx, void *image, void *noise,
+		      int dtype, int ndtype, short noise_flag, int w, int h,
+		      float thresh, int minarea, float *conv, int convw,
+		      int convh, int deblend_nthresh, double deblend_cont,
+		      int clean_flag, double clean_param,
+		      sepobj **objects, int *nobj)
+{
+  extractstrip  *strips;
+  pthread_t     *threads;
+  objliststruct finalobjlist;
+  int           i, j, nstrip, nstarted, status;
+
+  status = RETURN_OK;
+  strips = NULL;
+  threads = NULL;
+  nstarted = 0;
+  finalobjlist.obj = NULL;
+  finalobjlist.plist = NULL;
+  finalobjlist.nobj = finalobjlist.npix = 0;
+
+  /* strips much shorter than the margin would mostly extract the margin */
+  nstrip = h / (2*SEP_STRIP_MARGIN);
+  if (nstrip > nctx)
+    nstrip = nctx;
+  if (nstrip <= 1)
+    return sep_extract_ctx(ctx[0], image, noise, dtype, ndtype, noise_flag,
+			   w, h, thresh, minarea, conv, convw, convh,
+			   deblend_nthresh, deblend_cont, clean_flag,
+			   clean_param, objects, nobj);
+
+  QCALLOC(strips, extractstrip, nstrip, status);
+  QMALLOC(threads, pthread_t, nstrip, status);
+
+  /* Each strip also extracts the last row of the previous strip, so it can
+   * recognise objects that started there, and SEP_STRIP_MARGIN rows of the
+   * next strip, so objects that start in the strip are seen in full. */
+  for (i=0; i<nstrip; i++)
+    {
+      strips[i].ctx = ctx[i];
+      strips[i].image = image;
+      strips[i].noise = noise;
+      strips[i].dtype = dtype;
+      strips[i].ndtype = ndtype;
+      strips[i].w = w;
+      strips[i].h = h;
+      strips[i].yown0 = (int)((long)h*i/nstrip);
+      strips[i].yown1 = (int)((long)h*(i+1)/nstrip);
+      strips[i].ystart = i ? strips[i].yown0 - 1 : 0;
+      strips[i].yend = strips[i].yown1 + SEP_STRIP_MARGIN;
+      if (strips[i].yend > h)
+	strips[i].yend = h;
+      strips[i].thresh = thresh;
+      strips[i].conv = conv;
+      strips[i].minarea = minarea;
+      strips[i].convw = convw;
+      strips[i].convh = convh;
+      strips[i].deblend_nthresh = deblend_nthresh;
+      strips[i].deblend_cont = deblend_cont;
+    }
+
+  for (nstarted=0; nstarted<nstrip; nstarted++)
+    if (pthread_create(&threads[nstarted], NULL, extractstrip_thread,
+		       &strips[nstarted]) != 0)
+      {
+	put_errdetail("failed to start strip extraction thread");
+	status = MEMORY_ALLOC_ERROR;
+	break;
+      }
+  for (i=0; i<nstarted; i++)
+    pthread_join(threads[i], NULL);
+  if (status != RETURN_OK)
+    goto exit;
+
+  for (i=0; i<nstrip; i++)
+    if (strips[i].status != RETURN_OK)
+      {
+	status = strips[i].status;
+	goto exit;
+      }
+
+  /* an object was taller than the margin, so it may have been cut up */
+  for (i=0; i<nstrip; i++)
+    if (strips[i].ctx->truncobj)
+      break;
+  if (i < nstrip)
+    {
+      for (i=0; i<nstrip; i++)
+	{
+	  free(strips[i].objlist.obj);
+	  free(strips[i].objlist.plist);
+	}
+      free(strips);
+      free(threads);
+      return sep_extract_ctx(ctx[0], image, noise, dtype, ndtype, noise_flag,
+			     w, h, thresh, minarea, conv, convw, convh,
+			     deblend_nthresh, deblend_cont, clean_flag,
+			     clean_param, objects, nobj);
+    }
+
+  /* merge the strips */
+  for (i=0; i<nstrip; i++)
+    for (j=0; j<strips[i].objlist.nobj; j++)
+      {
+	status = addobjdeep(ctx[0], j, &strips[i].objlist, &finalobjlist);
+	if (status != RETURN_OK)
+	  goto exit;
+      }
+
+  status = finishobjlist(ctx[0], &finalobjlist, w, thresh, minarea,
+			 clean_flag, clean_param, objects, nobj);
+
+ exit:
+  if (strips)
+    for (i=0; i<nstrip; i++)
+      {
+	free(strips[i].objlist.obj);
+	free(strips[i].objlist.plist);
+      }
+  free(strips);
+  free(threads);
+  free(finalobjlist.obj);
+  free(finalobjlist.plist);
+
+  if (status != RETURN_OK)
+    {
+      *objects = NULL;
+      *nobj = 0;
+    }
+
+  return status;
+}
+
+/*
+Extract the objects of one strip (see sep_extract_tiled).
+*/
+void *extractstrip_thread(void *arg)
+{
+  extractstrip *strip = (extractstrip *)arg;
+  sep_context  *ctx = strip->ctx;
+
+  strip->status = extractinit(ctx, strip->noise, strip->w, strip->h,
+			      strip->conv, strip->deblend_nthresh);
+  if (strip->status != RETURN_OK)
+    return NULL;
+
+  ctx->ystart = strip->ystart;
+  ctx->yend = strip->yend;
+  ctx->yown0 = strip->yown0;
+  ctx->yown1 = strip->yown1;
+  strip->status = extractrows(ctx, strip->image, strip->noise, strip->dtype,
+			      strip->ndtype, strip->w, strip->h, strip->thresh,
+			      strip->minarea, strip->conv, strip->convw,
+			      strip->convh, strip->deblend_nthresh,
+			      strip->deblend_cont, &strip->objlist);
+  return NULL;
+}
+
+/****************************** extractinit **********************************/
+/*
+Prepare the context for an extraction.
+*/
+int extractinit(sep_context *ctx, void *noise, int w, int h, float *conv,
+		int deblend_nthresh)
+{
+  int status;
+
+  /* seed the random number generator consistently on each call to get
+     consistent results. rand_r() is used in deblending. */
+  ctx->randseed = 1;
+  ctx->truncobj = 0;
+
+  if ((status = lutzalloc(ctx, w, h)) != RETURN_OK)
+    return status;
+  if ((status = allocdeblend(ctx, deblend_nthresh)) != RETURN_OK)
+    return status;
+  plistinit(ctx, conv, noise);
+
+  return RETURN_OK;
+}
+
+/****************************** extractrows **********************************/
+/*
+Extract the objects in rows ctx->ystart to ctx->yend-1 of the image, keeping
+only those whose first row lies between ctx->yown0 and ctx->yown1-1.
+*/
+int extractrows(sep_context *ctx, void *image, void *noise,
+		int dtype, int ndtype, int w, int h,
+		float thresh, int minarea, float *conv, int convw, int convh,
+		int deblend_nthresh, double deblend_cont,
+		objliststruct *finalobjlist)
 {
   infostruct        curpixinfo, initinfo, freeinfo;
   objliststruct     objlist;
   char              newmarker;
   size_t            mem_pixstack;
   int               nposize, oldnposize;
-  int               co, i, j, luflag, pstop, xl, xl2, yl, cn;
+  int               co, i, luflag, pstop, xl, xl2, yl, cn;
   int               stacksize, convn, status;
   int               elsize_im, elsize_noise;
   short             trunflag;
@@ -79,12 +372,11 @@ int sep_extract(void *image, void *noise,
   pixstatus         cs, ps;
 
   infostruct        *info, *store;
-  objliststruct     *finalobjlist;
   pliststruct	    *pixel, *pixt;
   char              *marker;
   PIXTYPE           *scan, *cdscan, *cdwscan, *wscan, *dumscan;
   float             *convnorm;
-  int               *start, *end, *survives;
+  int               *start, *end;
   pixstatus         *psstack;
   BYTE              *imageline, *noiseline;
   convolver         convolve_im, convolve_noise;
@@ -100,22 +392,16 @@ int sep_extract(void *image, void *noise,
   marker = NULL;
   psstack = NULL;
   start = end = NULL;
-  finalobjlist = NULL; /* final return value */
   convn = 0;
   sum = 0.0;
   convolve_im = NULL;
   convolve_noise = NULL;
   convert_im = NULL;
   convert_noise = NULL;
-  imageline = (BYTE *)image;
-  noiseline = (BYTE *)noise;
+  elsize_noise = 0;
 
   mem_pixstack = sep_get_extract_pixstack();
 
-  /* seed the random number generator consistently on each call to get
-     consistent results. rand() is used in deblending. */
-  srand(1);
-
   /* If we have a noise array, thresh is actually relthresh; we'll use
    * relthresh below to set the threshold for each pixel. */
   relthresh = thresh;
@@ -131,10 +417,6 @@ int sep_extract(void *image, void *noise,
   QMALLOC(psstack, pixstatus, stacksize, status);
   QCALLOC(start, int, stacksize, status);
   QMALLOC(end, int, stacksize, status);
-  if ((status = lutzalloc(w, h)) != RETURN_OK)
-    goto exit;
-  if ((status = allocdeblend(deblend_nthresh)) != RETURN_OK)
-    goto exit;
 
   /* allocate scan buffer(s) and get array converter function(s) */
   QMALLOC(scan, PIXTYPE, stacksize, status);
@@ -148,6 +430,8 @@ int sep_extract(void *image, void *noise,
       if (status != RETURN_OK)
 	goto exit;
     }
+  imageline = (BYTE *)image + (size_t)ctx->ystart*w*elsize_im;
+  noiseline = noise? (BYTE *)noise + (size_t)ctx->ystart*w*elsize_noise: NULL;
 
   /* More initializations */
   initinfo.pixnb = 0;
@@ -164,28 +448,39 @@ int sep_extract(void *image, void *noise,
   objlist.nobj = 1;
   curpixinfo.pixnb = 1;
 
-  /* Init finalobjlist (the return catalog) */
-  QMALLOC(finalobjlist, objliststruct, 1, status);
-  finalobjlist->obj = NULL;
-  finalobjlist->plist = NULL;
-  finalobjlist->nobj = finalobjlist->npix = 0;
-
-
-  /* Allocate memory for the pixel list */
-  plistinit(conv, noise);
-  if (!(pixel = objlist.plist = malloc(nposize=mem_pixstack*plistsize)))
+  /* Allocate memory for the pixel list (kept in the context) */
+  nposize = mem_pixstack*ctx->plistsize;
+  if (nposize > ctx->pixstacksize)
     {
-      status = MEMORY_ALLOC_ERROR;
-      goto exit;
+      free(ctx->pixstack);
+      ctx->pixstacksize = 0;
+      if (!(ctx->pixstack = malloc(nposize)))
+	{
+	  status = MEMORY_ALLOC_ERROR;
+	  goto exit;
+	}
+      ctx->pixstacksize = nposize;
+      ctx->pixfreesize = 0;
     }
-
-  /*----- at the beginning, "free" object fills the whole pixel list */
-  freeinfo.firstpix = 0;
-  freeinfo.lastpix = nposize-plistsize;
-  pixt = pixel;
-  for (i=plistsize; i<nposize; i += plistsize, pixt += plistsize)
-    PLIST(pixt, nextpix) = i;
-  PLIST(pixt, nextpix) = -1;
+  pixel = objlist.plist = ctx->pixstack;
+
+  /*----- at the beginning, "free" object fills the whole pixel list. The
+   * list left behind by the last extraction with this context can be used
+   * as is if it was laid out the same way (see end of this function). */
+  freeinfo.lastpix = nposize-ctx->plistsize;
+  freeinfo.pixnb = 0;   /* number of pixels taken from the list */
+  if (ctx->pixfreesize == nposize && ctx->pixfreeplistsize == ctx->plistsize)
+    freeinfo.firstpix = ctx->pixfreefirst;
+  else
+    {
+      freeinfo.firstpix = 0;
+      pixt = pixel;
+      for (i=ctx->plistsize; i<nposize;
+	   i += ctx->plistsize, pixt += ctx->plistsize)
+	PLIST(pixt, nextpix) = i;
+      PLIST(pixt, nextpix) = -1;
+    }
+  ctx->pixfreesize = 0;
 
   if (conv)
     {
@@ -216,14 +511,14 @@ int sep_extract(void *image, void *noise,
     }
 
   /*----- MAIN LOOP ------ */
-  for (yl=0; yl<=h; yl++)
+  for (yl=ctx->ystart; yl<=ctx->yend; yl++)
     {
 
       ps = COMPLETE;
       cs = NONOBJECT;
     
       /* Need an empty line for Lutz' algorithm to end gracely */
-      if (yl==h)
+      if (yl==ctx->yend)
 	{
 	  if (conv)
 	    {
@@ -277,7 +572,7 @@ int sep_extract(void *image, void *noise,
 
 	  curpixinfo.flag = trunflag;
 	  if (noise)
-	    thresh = relthresh * ((xl==w || yl==h)? 0.0: cdwscan[xl]);
+	    thresh = relthresh * ((xl==w || yl==ctx->yend)? 0.0: cdwscan[xl]);
 	  luflag = cdnewsymbol > thresh? 1: 0;  /* is pixel above thresh? */
 
 	  if (luflag)
@@ -290,6 +585,7 @@ int sep_extract(void *image, void *noise,
 	      /* and increment the "first free pixel" */
 	      pixt = pixel + (cn=freeinfo.firstpix);
 	      freeinfo.firstpix = PLIST(pixt, nextpix);
+	      freeinfo.pixnb++;
 	      curpixinfo.lastpix = curpixinfo.firstpix = cn;
 
 	      /* set values for the new pixel */ 
@@ -328,26 +624,28 @@ int sep_extract(void *image, void *noise,
 		  /* increase the stack size */
 		  oldnposize = nposize;
  		  mem_pixstack = (int)(mem_pixstack * 2);
-		  nposize = mem_pixstack * plistsize;
+		  nposize = mem_pixstack * ctx->plistsize;
 		  pixel = (pliststruct *)realloc(pixel, nposize);
-		  objlist.plist = pixel;
+		  objlist.plist = ctx->pixstack = pixel;
 		  if (!pixel)
 		    {
+		      ctx->pixstacksize = 0;
 		      status = MEMORY_ALLOC_ERROR;
 		      goto exit;
 		    }
+		  ctx->pixstacksize = nposize;
 
 		  /* set next free pixel to the start of the new block 
 		   * and link up all the pixels in the new block */
 		  PLIST(pixel+freeinfo.firstpix, nextpix) = oldnposize;
 		  pixt = pixel + oldnposize;
-		  for (i=oldnposize + plistsize; i<nposize;
-		       i += plistsize, pixt += plistsize)
+		  for (i=oldnposize + ctx->plistsize; i<nposize;
+		       i += ctx->plistsize, pixt += ctx->plistsize)
 		    PLIST(pixt, nextpix) = i;
 		  PLIST(pixt, nextpix) = -1;
 
 		  /* last free pixel is now at the end of the new block */
-		  freeinfo.lastpix = nposize - plistsize;
+		  freeinfo.lastpix = nposize - ctx->plistsize;
 		}
 	      /*------------------------------------------------------------*/
 
@@ -428,7 +726,7 @@ int sep_extract(void *image, void *noise,
 			      /* update threshold before object is processed */
 			      objlist.thresh = thresh;
 
-			      status = sortit(&info[co], &objlist, minarea,
+			      status = sortit(ctx, &info[co], &objlist, minarea,
 					      finalobjlist,
 					      deblend_nthresh,deblend_cont);
 			      if (status != RETURN_OK)
@@ -439,6 +737,7 @@ int sep_extract(void *image, void *noise,
 			  PLIST(pixel+info[co].lastpix, nextpix) =
 			    freeinfo.firstpix;
 			  freeinfo.firstpix = info[co].firstpix;
+			  freeinfo.pixnb -= info[co].pixnb;
 			}
 		      else
 			{
@@ -483,13 +782,60 @@ int sep_extract(void *image, void *noise,
 
     } /*---------------- End of the loop over the y's -----------------------*/
 
-  /* convert `finalobjlist` to an array of `sepobj` structs */
+  /* all pixels are back in the free list, so keep it for the next call */
+  if (freeinfo.pixnb == 0)
+    {
+      ctx->pixfreefirst = freeinfo.firstpix;
+      ctx->pixfreesize = nposize;
+      ctx->pixfreeplistsize = ctx->plistsize;
+    }
+
+ exit:
+  free(info);
+  free(store);
+  free(marker);
+  free(dumscan);
+  free(psstack);
+  free(start);
+  free(end);
+  free(scan);
+  free(wscan);
+  if (conv)
+    {
+      free(convnorm);
+      /* only need to free these in case of early exit */
+      if (cdscan != dumscan)
+	{
+	  free(cdscan);
+	  free(cdwscan);
+	}
+    }
+
+  return status;
+}
+
+/***************************** finishobjlist *********************************/
+/*
+Clean `finalobjlist` (if requested) and convert it to an array of `sepobj`
+structs.
+*/
+int finishobjlist(sep_context *ctx, objliststruct *finalobjlist, int w,
+		  float thresh, int minarea, int clean_flag, double clean_param,
+		  sepobj **objects, int *nobj)
+{
+  int i, j, status, *survives;
+
+  status = RETURN_OK;
+  survives = NULL;
+  *objects = NULL;
+  *nobj = 0;
+
   if (clean_flag)
     {
       /* Calculate mthresh for all objects in the list (needed for cleaning) */
       for (i=0; i<finalobjlist->nobj; i++)
 	{
-	  status = analysemthresh(i, finalobjlist, minarea, thresh);
+	  status = analysemthresh(ctx, i, finalobjlist, minarea, thresh);
 	  if (status != RETURN_OK)
 	    goto exit;
 	}
@@ -498,7 +844,6 @@ int sep_extract(void *image, void *noise,
       clean(finalobjlist, clean_param, survives);
 
       /* count surviving objects and allocate space accordingly*/
-      *nobj = 0;
       for (i=0; i<finalobjlist->nobj; i++)
 	*nobj += survives[i];
       QMALLOC(*objects, sepobj, *nobj, status);
@@ -518,32 +863,7 @@ int sep_extract(void *image, void *noise,
     }
 
  exit:
-  free(finalobjlist->obj);
-  free(finalobjlist->plist);
-  free(finalobjlist);
-  freedeblend();
-  free(pixel);
-  lutzfree();
-  free(info);
-  free(store);
-  free(marker);
-  free(dumscan);
-  free(psstack);
-  free(start);
-  free(end);
-  free(scan);
-  free(wscan);
-  if (conv)
-    free(convnorm);
-
-  if (status != RETURN_OK)
-    {
-      free(cdscan);   /* only need to free these in case of early exit */
-      free(cdwscan);
-      *objects = NULL;
-      *nobj = 0;
-    }
-
+  free(survives);
   return status;
 }
 
@@ -552,12 +872,12 @@ int sep_extract(void *image, void *noise,
 /*
 build the object structure.
 */
-int sortit(infostruct *info, objliststruct *objlist, int minarea,
-	   objliststruct *finalobjlist,
+int sortit(sep_context *ctx, infostruct *info, objliststruct *objlist,
+	   int minarea, objliststruct *finalobjlist,
 	   int deblend_nthresh, double deblend_mincont)
 {
   objliststruct	        objlistout, *objlist2;
-  static objstruct	obj;
+  objstruct		obj;
   int 			i, status;
 
   status=RETURN_OK;  
@@ -576,10 +896,17 @@ int sortit(infostruct *info, objliststruct *objlist, int minarea,
   obj.flag = info->flag;
   obj.thresh = objlist->thresh;
 
-  preanalyse(0, objlist);
+  preanalyse(ctx, 0, objlist);
+
+  /* skip objects that belong to another strip (see sep_extract_tiled) */
+  if (obj.ymin < ctx->yown0 || obj.ymin >= ctx->yown1)
+    return RETURN_OK;
+  /* the object may continue below the extracted rows */
+  if (ctx->yend < ctx->ymax+1 && obj.ymax >= ctx->yend-1)
+    ctx->truncobj = 1;
 
-  status = deblend(objlist, 0, &objlistout, deblend_nthresh, deblend_mincont,
-		   minarea);
+  status = deblend(ctx, objlist, 0, &objlistout, deblend_nthresh,
+		   deblend_mincont, minarea);
   if (status)
     {
       /* formerly, this wasn't a fatal error, so a flag was set for
@@ -597,14 +924,14 @@ int sortit(infostruct *info, objliststruct *objlist, int minarea,
   /* Analyze the deblended objects and add to the final list */
   for (i=0; i<objlist2->nobj; i++)
     {
-      analyse(i, objlist2, 1);
+      analyse(ctx, i, objlist2, 1);
 
       /* this does nothing if DETECT_MAXAREA is 0 (and it currently is) */
       if (DETECT_MAXAREA && objlist2->obj[i].fdnpix > DETECT_MAXAREA)
 	continue;
 
       /* add the object to the final list */
-      status = addobjdeep(i, objlist2, finalobjlist);
+      status = addobjdeep(ctx, i, objlist2, finalobjlist);
       if (status != RETURN_OK)
 	goto exit;
     }
@@ -622,14 +949,15 @@ Add object number `objnb` from list `objl1` to list `objl2`.
 Unlike `addobjshallow` this also copies plist pixels to the second list.
 */
 
-int addobjdeep(int objnb, objliststruct *objl1, objliststruct *objl2)
+int addobjdeep(sep_context *ctx, int objnb, objliststruct *objl1,
+	       objliststruct *objl2)
 {
   objstruct	*objl2obj;
   pliststruct	*plist1 = objl1->plist, *plist2 = objl2->plist;
   int		fp, i, j, npx, objnb2;
   
   fp = objl2->npix;      /* 2nd list's plist size in pixels */
-  j = fp*plistsize;      /* 2nd list's plist size in bytes */
+  j = fp*ctx->plistsize;      /* 2nd list's plist size in bytes */
   objnb2 = objl2->nobj;  /* # of objects currently in 2nd list*/
 
   /* Allocate space in `objl2` for the new object */
@@ -646,9 +974,9 @@ int addobjdeep(int objnb, objliststruct *objl1, objliststruct *objl2)
   /* Allocate space for the new object's pixels in 2nd list's plist */
   npx = objl1->obj[objnb].fdnpix;
   if (fp)
-    plist2 = (pliststruct *)realloc(plist2, (objl2->npix+=npx)*plistsize);
+    plist2 = (pliststruct *)realloc(plist2, (objl2->npix+=npx)*ctx->plistsize);
   else
-    plist2 = (pliststruct *)malloc((objl2->npix=npx)*plistsize);
+    plist2 = (pliststruct *)malloc((objl2->npix=npx)*ctx->plistsize);
 
   if (!plist2)
     goto earlyexit;
@@ -658,16 +986,16 @@ int addobjdeep(int objnb, objliststruct *objl1, objliststruct *objl2)
   plist2 += j;
   for(i=objl1->obj[objnb].firstpix; i!=-1; i=PLIST(plist1+i,nextpix))
     {
-      memcpy(plist2, plist1+i, (size_t)plistsize);
-      PLIST(plist2,nextpix) = (j+=plistsize);
-      plist2 += plistsize;
+      memcpy(plist2, plist1+i, (size_t)ctx->plistsize);
+      PLIST(plist2,nextpix) = (j+=ctx->plistsize);
+      plist2 += ctx->plistsize;
     }
-  PLIST(plist2-=plistsize, nextpix) = -1;
+  PLIST(plist2-=ctx->plistsize, nextpix) = -1;
   
   /* copy the object itself */
   objl2->obj[objnb2] = objl1->obj[objnb];
-  objl2->obj[objnb2].firstpix = fp*plistsize;
-  objl2->obj[objnb2].lastpix = j-plistsize;
+  objl2->obj[objnb2].firstpix = fp*ctx->plistsize;
+  objl2->obj[objnb2].lastpix = j-ctx->plistsize;
 
   return RETURN_OK;
   
@@ -684,39 +1012,39 @@ int addobjdeep(int objnb, objliststruct *objl1, objliststruct *objl2)
  * (originally init_plist() in sextractor)
 PURPOSE	initialize a pixel-list and its components.
  ***/
-void plistinit(void *conv, void *var)
+void plistinit(sep_context *ctx, void *conv, void *var)
 {
   pbliststruct	*pbdum = NULL;
 
-  plistsize = sizeof(pbliststruct);
-  plistoff_value = (char *)&pbdum->value - (char *)pbdum;
+  ctx->plistsize = sizeof(pbliststruct);
+  ctx->plistoff_value = (char *)&pbdum->value - (char *)pbdum;
 
   if (conv)
     {
-      plistexist_cdvalue = 1;
-      plistoff_cdvalue = plistsize;
-      plistsize += sizeof(PIXTYPE);
+      ctx->plistexist_cdvalue = 1;
+      ctx->plistoff_cdvalue = ctx->plistsize;
+      ctx->plistsize += sizeof(PIXTYPE);
     }
   else
     {
-      plistexist_cdvalue = 0;
-      plistoff_cdvalue = plistoff_value;
+      ctx->plistexist_cdvalue = 0;
+      ctx->plistoff_cdvalue = ctx->plistoff_value;
     }
 
   if (var)
     {
-      plistexist_var = 1;
-      plistoff_var = plistsize;
-      plistsize += sizeof(PIXTYPE);
+      ctx->plistexist_var = 1;
+      ctx->plistoff_var = ctx->plistsize;
+      ctx->plistsize += sizeof(PIXTYPE);
 
-      plistexist_thresh = 1;
-      plistoff_thresh = plistsize;
-      plistsize += sizeof(PIXTYPE);
+      ctx->plistexist_thresh = 1;
+      ctx->plistoff_thresh = ctx->plistsize;
+      ctx->plistsize += sizeof(PIXTYPE);
     }
   else
     {
-      plistexist_var = 0;
-      plistexist_thresh = 0;
+      ctx->plistexist_var = 0;
+      ctx->plistexist_thresh = 0;
     }
 
   return;
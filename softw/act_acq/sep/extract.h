@@ -33,9 +33,9 @@
 
 /* plist-related macros */
 #define	PLIST(ptr, elem)	(((pbliststruct *)(ptr))->elem)
-#define	PLISTEXIST(elem)	(plistexist_##elem)
-#define	PLISTPIX(ptr, elem)	(*((PIXTYPE *)((ptr)+plistoff_##elem)))
-#define	PLISTFLAG(ptr, elem)	(*((FLAGTYPE *)((ptr)+plistoff_##elem)))
+#define	PLISTEXIST(elem)	(ctx->plistexist_##elem)
+#define	PLISTPIX(ptr, elem)	(*((PIXTYPE *)((ptr)+ctx->plistoff_##elem)))
+#define	PLISTFLAG(ptr, elem)	(*((FLAGTYPE *)((ptr)+ctx->plistoff_##elem)))
 
 /* Extraction status */
 typedef	enum {COMPLETE, INCOMPLETE, NONOBJECT, OBJECT} pixstatus;
@@ -58,11 +58,6 @@ typedef struct
   PIXTYPE value;
 } pbliststruct;
 
-/* globals */
-extern int plistexist_cdvalue, plistexist_thresh, plistexist_var;
-extern int plistoff_value, plistoff_cdvalue, plistoff_thresh, plistoff_var;
-extern int plistsize;
-
 typedef struct
 {
   /* thresholds */
@@ -113,29 +108,66 @@ typedef struct
   PIXTYPE       thresh;   /* detection threshold */
 } objliststruct;
 
-
-int analysemthresh(int objnb, objliststruct *objlist, int minarea,
-		   PIXTYPE thresh);
-void preanalyse(int, objliststruct *);
-void analyse(int, objliststruct *, int);
-
-int  lutzalloc(int, int);
-void lutzfree(void);
-int  lutz(pliststruct *plistin,
+/* Extraction context (formerly file-scope globals in extract.c, lutz.c and
+ * deblend.c). The PLIST* macros above expect a `ctx` pointer in scope. */
+struct sep_context
+{
+  /* pixel list layout (set by plistinit) */
+  int           plistexist_cdvalue, plistexist_thresh, plistexist_var;
+  int           plistoff_value, plistoff_cdvalue, plistoff_thresh, plistoff_var;
+  int           plistsize;
+
+  /* pixel stack of the extraction (pixstacksize bytes), and its free list
+   * as left by the last extraction (pixfreesize is 0 if it is not valid) */
+  pliststruct   *pixstack;
+  int           pixstacksize;
+  int           pixfreefirst, pixfreesize, pixfreeplistsize;
+
+  /* seed for rand_r() in gatherup */
+  unsigned int  randseed;
+
+  /* rows extracted, and rows in which objects must start to be kept */
+  int           ystart, yend, yown0, yown1;
+  int           truncobj;   /* a kept object reached the last row (yend-1) */
+
+  /* buffers for lutz(), allocated for images up to lutzw pixels wide */
+  int           lutzw;
+  infostruct    *info, *store;
+  char          *marker;
+  pixstatus     *psstack;
+  int           *start, *end, *discan;
+  int           xmin, ymin, xmax, ymax;
+
+  /* buffers for deblend(), allocated for debnthresh thresholds */
+  int           debnthresh;
+  objliststruct *objlist;
+  short         *son, *ok;
+};
+
+
+int analysemthresh(sep_context *ctx, int objnb, objliststruct *objlist,
+		   int minarea, PIXTYPE thresh);
+void preanalyse(sep_context *, int, objliststruct *);
+void analyse(sep_context *, int, objliststruct *, int);
+
+int  lutzalloc(sep_context *, int, int);
+void lutzfree(sep_context *);
+int  lutz(sep_context *ctx, pliststruct *plistin,
 	  int *objrootsubmap, int subx, int suby, int subw,
 	  objstruct *objparent, objliststruct *objlist, int minarea);
 
 void update(infostruct *, infostruct *, pliststruct *);
 
-int  allocdeblend(int);
-void freedeblend(void);
-int  deblend(objliststruct *, int, objliststruct *, int, double, int);
+int  allocdeblend(sep_context *, int);
+void freedeblend(sep_context *);
+int  deblend(sep_context *, objliststruct *, int, objliststruct *, int,
+	     double, int);
 
 /*int addobjshallow(objstruct *, objliststruct *);
 int rmobjshallow(int, objliststruct *);
 void mergeobjshallow(objstruct *, objstruct *);
 */
-int addobjdeep(int, objliststruct *, objliststruct *);
+int addobjdeep(sep_context *, int, objliststruct *, objliststruct *);
 
 typedef void (*convolver)(void *image, int w, int h, int y,
 			  float *conv, int convw, int convh, PIXTYPE *buf);
@@ -32,69 +32,67 @@
 
 #define	NOBJ 256  /* starting number of obj. */
 
-void lutzsort(infostruct *, objliststruct *);
-
-/*------------------------- Static buffers for lutz() -----------------------*/
-
-static infostruct  *info=NULL, *store=NULL;
-static char	   *marker=NULL;
-static pixstatus   *psstack=NULL;
-static int         *start=NULL, *end=NULL, *discan=NULL;
-static int         xmin, ymin, xmax, ymax;
-
+void lutzsort(sep_context *, infostruct *, objliststruct *);
 
 /******************************* lutzalloc ***********************************/
 /*
-Allocate once for all memory space for buffers used by lutz().
+Allocate memory space for buffers used by lutz(). The buffers are kept in the
+context and only reallocated if a wider image is extracted.
 */
-int lutzalloc(int width, int height)
+int lutzalloc(sep_context *ctx, int width, int height)
 {
   int *discant;
   int stacksize, i, status=RETURN_OK;
 
+  ctx->xmin = ctx->ymin = 0;
+  ctx->xmax = width-1;
+  ctx->ymax = height-1;
+  if (width <= ctx->lutzw)
+    return status;
+
+  lutzfree(ctx);
   stacksize = width+1;
-  xmin = ymin = 0;
-  xmax = width-1;
-  ymax = height-1;
-  QMALLOC(info, infostruct, stacksize, status);
-  QMALLOC(store, infostruct, stacksize, status);
-  QMALLOC(marker, char, stacksize, status);
-  QMALLOC(psstack, pixstatus, stacksize, status);
-  QMALLOC(start, int, stacksize, status);
-  QMALLOC(end, int, stacksize, status);
-  QMALLOC(discan, int, stacksize, status);
-  discant = discan;
+  QMALLOC(ctx->info, infostruct, stacksize, status);
+  QMALLOC(ctx->store, infostruct, stacksize, status);
+  QMALLOC(ctx->marker, char, stacksize, status);
+  QMALLOC(ctx->psstack, pixstatus, stacksize, status);
+  QMALLOC(ctx->start, int, stacksize, status);
+  QMALLOC(ctx->end, int, stacksize, status);
+  QMALLOC(ctx->discan, int, stacksize, status);
+  discant = ctx->discan;
   for (i=stacksize; i--;)
     *(discant++) = -1;
+  ctx->lutzw = width;
 
   return status;
 
  exit:
-  lutzfree();
+  lutzfree(ctx);
 
   return status;
 }
 
 /******************************* lutzfree ************************************/
 /*
-Free once for all memory space for buffers used by lutz().
+Free memory space for buffers used by lutz().
 */
-void lutzfree()
+void lutzfree(sep_context *ctx)
 {
-  free(discan);
-  discan = NULL;
-  free(info);
-  info = NULL;
-  free(store);
-  store = NULL;
-  free(marker);
-  marker = NULL;
-  free(psstack);
-  psstack = NULL;
-  free(start);
-  start = NULL;
-  free(end);
-  end = NULL;
+  free(ctx->discan);
+  ctx->discan = NULL;
+  free(ctx->info);
+  ctx->info = NULL;
+  free(ctx->store);
+  ctx->store = NULL;
+  free(ctx->marker);
+  ctx->marker = NULL;
+  free(ctx->psstack);
+  ctx->psstack = NULL;
+  free(ctx->start);
+  ctx->start = NULL;
+  free(ctx->end);
+  ctx->end = NULL;
+  ctx->lutzw = 0;
   return;
 }
 
@@ -104,11 +102,15 @@ void lutzfree()
 C implementation of R.K LUTZ' algorithm for the extraction of 8-connected pi-
 xels in an image
 */
-int lutz(pliststruct *plistin,
+int lutz(sep_context *ctx, pliststruct *plistin,
 	 int *objrootsubmap, int subx, int suby, int subw,
 	 objstruct *objparent, objliststruct *objlist, int minarea)
 {
-  static infostruct	curpixinfo,initinfo;
+  infostruct		curpixinfo,initinfo;
+  infostruct		*info = ctx->info, *store = ctx->store;
+  char			*marker = ctx->marker;
+  pixstatus		*psstack = ctx->psstack;
+  int			*start = ctx->start, *end = ctx->end;
   objstruct		*obj;
   pliststruct		*plist,*pixel, *plistint;
   
@@ -154,7 +156,7 @@ int lutz(pliststruct *plistin,
   /*------Allocate memory for the pixel list */
   free(objlist->plist);
   if (!(objlist->plist
-	= (pliststruct *)malloc((eny-sty)*(enx-stx)*plistsize)))
+	= (pliststruct *)malloc((eny-sty)*(enx-stx)*ctx->plistsize)))
     {
       out = MEMORY_ALLOC_ERROR;
       plist = NULL;			/* To avoid gcc -Wall warnings */
@@ -170,14 +172,16 @@ int lutz(pliststruct *plistin,
   objlist->nobj = 0;
   co = pstop = 0;
   curpixinfo.pixnb = 1;
+  curpixinfo.flag = 0;
+  curpixinfo.firstpix = curpixinfo.lastpix = -1;
 
   for (yl=sty; yl<=eny; yl++, iscan += step)
     {
       ps = COMPLETE;
       cs = NONOBJECT;
-      trunflag = (yl==0 || yl==ymax) ? SEP_OBJ_TRUNC : 0;
+      trunflag = (yl==0 || yl==ctx->ymax) ? SEP_OBJ_TRUNC : 0;
       if (yl==eny)
-	iscan = discan;
+	iscan = ctx->discan;
 
       for (xl=stx; xl<=enx; xl++)
 	{
@@ -193,13 +197,13 @@ int lutz(pliststruct *plistin,
 	    }
 	  if (luflag)
 	    {
-	      if (xl==0 || xl==xmax)
+	      if (xl==0 || xl==ctx->xmax)
 		curpixinfo.flag |= SEP_OBJ_TRUNC;
-	      memcpy(pixel, plistint, (size_t)plistsize);
+	      memcpy(pixel, plistint, (size_t)ctx->plistsize);
 	      PLIST(pixel, nextpix) = -1;
 	      curpixinfo.lastpix = curpixinfo.firstpix = cn;
-	      cn += plistsize;
-	      pixel += plistsize;
+	      cn += ctx->plistsize;
+	      pixel += ctx->plistsize;
 
 	      /*----------------- Start Segment -----------------------------*/
 	      if (cs != OBJECT)
@@ -275,7 +279,7 @@ int lutz(pliststruct *plistin,
 				    out = MEMORY_ALLOC_ERROR;
 				    goto exit_lutz;
 				  }
-			      lutzsort(&info[co], objlist);
+			      lutzsort(ctx, &info[co], objlist);
 			    }
 			}
 		      else
@@ -347,7 +351,7 @@ int lutz(pliststruct *plistin,
 /*
 Add an object to the object list based on info (pixel info)
 */
-void  lutzsort(infostruct *info, objliststruct *objlist)
+void  lutzsort(sep_context *ctx, infostruct *info, objliststruct *objlist)
 {
   objstruct *obj = objlist->obj+objlist->nobj;
 
@@ -357,7 +361,7 @@ void  lutzsort(infostruct *info, objliststruct *objlist)
   obj->flag = info->flag;
   objlist->npix += info->pixnb;
   
-  preanalyse(objlist->nobj, objlist);
+  preanalyse(ctx, objlist->nobj, objlist);
   
   objlist->nobj++;
   
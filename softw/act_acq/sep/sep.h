@@ -109,6 +109,37 @@ int sep_backrmsarray(sepbackmap *bkmap, void *arr, int dtype);
 void sep_freeback(sepbackmap *bkmap);
 /* Free memory associated with bkmap */
 
+typedef struct
+{
+  int w, h;          /* image width, height */
+  int bw, bh;        /* single tile width, height */
+  int nx, ny;        /* number of tiles in x, y */
+  int nseg;          /* number of runs of columns between the same nodes */
+  int *segstart;     /* first column of each run (nseg+1 entries) */
+  int *segnode;      /* lower node of each run */
+  float *xlo, *xhi;  /* column weights of the lower and upper nodes */
+  float *xdlo, *xdhi;/* column weights of their 2nd derivatives */
+  int *ynode;        /* lower node row of each image row */
+  float *ylo, *yhi;  /* row weights of the lower and upper nodes */
+  float *ydlo, *ydhi;/* row weights of their 2nd derivatives */
+} sepbackinterp;
+
+int sep_makebackinterp(sepbackmap *bkmap, sepbackinterp **interp);
+/* Precompute the spline interpolation weights for every row and column of
+ * images with the same size and tiling as `bkmap`. The result depends only
+ * on the geometry, so it can be reused for every background map of the same
+ * image window. Free with `sep_freebackinterp()`. */
+
+int sep_backinterparrays(sepbackmap *bkmap, sepbackinterp *interp,
+			 float *back, float *rms);
+/* Evaluate the background and RMS for the entire image into `back` and
+ * `rms` (either may be NULL), using precomputed interpolation weights.
+ * Gives the same result as sep_backarray() and sep_backrmsarray(), but
+ * without recomputing the interpolation for every pixel. */
+
+void sep_freebackinterp(sepbackinterp *interp);
+/* Free memory associated with interp */
+
 /*-------------------------- source extraction ------------------------------*/
 
 typedef struct
@@ -165,6 +196,48 @@ int sep_extract(void *image,          /* image array                         */
  * 
  */
 
+typedef struct sep_context sep_context;
+/* Extraction context. Holds the working buffers used by the extraction,
+ * which are kept between calls. A context may only be used by one thread at
+ * a time, but different threads can extract concurrently using different
+ * contexts. */
+
+sep_context *sep_context_new(void);
+void sep_context_free(sep_context *ctx);
+
+int sep_extract_ctx(sep_context *ctx,  /* extraction context                */
+		    void *image, void *noise, int dtype, int ndtype,
+		    short noise_flag, int w, int h, float thresh, int minarea,
+		    float *conv, int convw, int convh,
+		    int deblend_nthresh, double deblend_cont,
+		    int clean_flag, double clean_param,
+		    sepobj **objects, int *nobj);
+/* Same as sep_extract(), but using the buffers of an existing context.
+ * sep_extract() is a wrapper that creates a temporary context. */
+
+int sep_extract_tiled(sep_context **ctx, /* one context per thread          */
+		      int nctx,          /* number of contexts (threads)    */
+		      void *image, void *noise, int dtype, int ndtype,
+		      short noise_flag, int w, int h, float thresh,
+		      int minarea, float *conv, int convw, int convh,
+		      int deblend_nthresh, double deblend_cont,
+		      int clean_flag, double clean_param,
+		      sepobj **objects, int *nobj);
+/* Extract sources from `nctx` horizontal strips of the image in parallel.
+ *
+ * Each strip is extracted by its own thread together with SEP_STRIP_MARGIN
+ * rows of the next strip, and keeps only the objects whose first row lies
+ * inside the strip, so every object is detected (and deblended) in one
+ * piece by exactly one strip. The objects are then merged and cleaned
+ * together. If an object is taller than the margin, the image is extracted
+ * again serially with ctx[0].
+ *
+ * The result matches sep_extract_ctx() apart from the order of the objects
+ * and the random assignment of faint pixels between deblended objects. */
+
+/* rows of the next strip extracted with each strip by sep_extract_tiled() */
+#define SEP_STRIP_MARGIN 32
+
 /* set and get the size of the pixel stack used in extract() */
 void sep_set_extract_pixstack(size_t val);
 size_t sep_get_extract_pixstack(void);
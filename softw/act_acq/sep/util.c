@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "sep.h"
 #include "sepcore.h"
 
@@ -26,6 +27,7 @@
 
 char *sep_version_string = "0.2.0.dev";
 static char _errdetail_buffer[DETAILSIZE] = "";
+static pthread_mutex_t _errdetail_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /****************************************************************************/
 /* data type conversion mechanics for runtime type conversion */
@@ -277,22 +279,29 @@ void sep_get_errmsg(int status, char *errtext)
     case ILLEGAL_APER_PARAMS:
       strcpy(errtext, "invalid aperture parameters");
       break;
+    case BACKINTERP_MISMATCH:
+      strcpy(errtext, "background interpolation for different image size");
+      break;
     default:
        strcpy(errtext, "unknown error status");
        break;
     }
 }
 
+/* the detail buffer is shared by all extraction contexts and threads */
 void sep_get_errdetail(char *errtext)
 {
+  pthread_mutex_lock(&_errdetail_mutex);
   strcpy(errtext, _errdetail_buffer);
   memset(_errdetail_buffer, 0, DETAILSIZE);
+  pthread_mutex_unlock(&_errdetail_mutex);
 }
 
 void put_errdetail(char *errtext)
 {
-   strcpy(_errdetail_buffer, errtext);
-
+  pthread_mutex_lock(&_errdetail_mutex);
+  strncpy(_errdetail_buffer, errtext, DETAILSIZE-1);
+  pthread_mutex_unlock(&_errdetail_mutex);
 }
 
 /*****************************************************************************/
@@ -0,0 +1,150 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra `pkg-config --cflags gtk+-2.0` -I../ -I../../../libs/ ./asterism_test.c ../pattern_match.c
+ * ../point_list.c ../../../libs/act_log.c `pkg-config --libs gtk+-2.0` -lpthread -lm -o ./asterism_test
+ *
+ * Matches synthetic acquisition images, rotated and scaled with respect to the catalogue and offset from the
+ * telescope position, against a synthetic catalogue field with both the translation-only matcher
+ * (find_point_list_map) and the triangle asterism matcher (find_asterism_map), and checks that the asterism matcher
+ * recovers the rotation, scale and pointing offset:
+ *   ./asterism_test [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <gtk/gtk.h>
+#include "point_list.h"
+#include "pattern_match.h"
+
+/// Catalogue stars per square degree (about the GSC-1.2 average)
+#define CAT_DENSITY       460.0
+#define PAT_SEARCH_RADIUS 1.0
+/// Radius (degrees) of the image field
+#define IMG_RADIUS        0.12
+/// Fraction of catalogue stars detected in the image
+#define IMG_DETECT_FRAC   0.5
+#define NUM_SPURIOUS      3
+#define POS_NOISE_D       (1.5/3600.0)
+/// act_acq does not attempt a match with fewer stars than this in the image
+#define MIN_NUM_STARS     6
+#define MIN_MATCH_FRAC    0.4
+/// Match radius for the asterism matcher, which fits out rotation and scale so needs less slack than DEFAULT_RADIUS
+#define FIT_RADIUS        (10.0/3600.0)
+/// Maximum error (degrees) in the recovered pointing offset for a match to be deemed correct
+#define MAX_SHIFT_ERR_D   (5.0/3600.0)
+
+void project(double ra0, double dec0, double ra, double dec, double *x, double *y);
+void deproject(double ra0, double dec0, double x, double y, double *ra, double *dec);
+double frand(void);
+
+int main(int argc, char **argv)
+{
+  g_type_init();
+  unsigned int seed = argc > 1 ? (unsigned int)atoi(argv[1]) : (unsigned int)time(NULL);
+  srand(seed);
+  printf("Seed %u\n", seed);
+  printf("%8s %8s %7s %7s | %7s %7s | %7s %9s %8s %8s %9s %9s %s\n", "rot", "scale", "stars", "cat", "tr_num", "tr_frac", "as_num", "as_rot", "as_scale", "rms\"", "shift_err\"", "time_ms", "");
+  double rots[] = { 0.0, 0.5, 2.0, 10.0, 45.0, 170.0 }, scales[] = { 1.0, 0.97, 1.05 };
+  unsigned int r, s;
+  int num_fail = 0;
+  for (r=0; r<sizeof(rots)/sizeof(rots[0]); r++)
+  {
+    for (s=0; s<sizeof(scales)/sizeof(scales[0]); s++)
+    {
+      double ra_t = 360.0*frand(), dec_t = -70.0 + 100.0*frand();
+      double ra_n = ra_t + (0.1*frand() - 0.05)/cos(dec_t*M_PI/180.0), dec_n = dec_t + 0.1*frand() - 0.05;
+      double rot = rots[r]*M_PI/180.0, scale = scales[s];
+      
+      // catalogue field around the (nominal) telescope position and an image of the true position
+      int i, num_cat = CAT_DENSITY * 4.0*PAT_SEARCH_RADIUS*PAT_SEARCH_RADIUS;
+      PointList *cat = point_list_new_with_length(num_cat), *img = point_list_new();
+      double x, y, xr, yr, ra, dec;
+      for (i=0; i<num_cat; i++)
+      {
+        deproject(ra_n, dec_n, PAT_SEARCH_RADIUS*(2.0*frand()-1.0), PAT_SEARCH_RADIUS*(2.0*frand()-1.0), &ra, &dec);
+        point_list_append(cat, ra, dec);
+        project(ra_t, dec_t, ra, dec, &x, &y);
+        if ((hypot(x, y) > IMG_RADIUS) || (frand() > IMG_DETECT_FRAC))
+          continue;
+        xr = scale*(cos(rot)*x - sin(rot)*y) + POS_NOISE_D*(frand()-0.5);
+        yr = scale*(sin(rot)*x + cos(rot)*y) + POS_NOISE_D*(frand()-0.5);
+        deproject(ra_n, dec_n, xr, yr, &ra, &dec);
+        point_list_append(img, ra, dec);
+      }
+      for (i=0; i<NUM_SPURIOUS; i++)
+      {
+        deproject(ra_n, dec_n, IMG_RADIUS*(2.0*frand()-1.0), IMG_RADIUS*(2.0*frand()-1.0), &ra, &dec);
+        point_list_append(img, ra, dec);
+      }
+      int num_img = point_list_get_num_used(img);
+      if (num_img < MIN_NUM_STARS)
+      {
+        printf("%8.1f %8.3f %7d %7d | too few stars\n", rots[r], scale, num_img, num_cat);
+        g_object_unref(G_OBJECT(cat));
+        g_object_unref(G_OBJECT(img));
+        continue;
+      }
+      
+      GSList *map = find_point_list_map(img, cat, DEFAULT_RADIUS);
+      int tr_num = g_slist_length(map);
+      point_list_map_free(map);
+      g_slist_free(map);
+      
+      struct timespec start, end;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      asterism_index_t *index = asterism_index_new(cat, ra_n, dec_n);
+      asterism_fit_t fit;
+      map = find_asterism_map(index, img, ra_n, dec_n, FIT_RADIUS, &fit);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      double elapsed = (end.tv_sec - start.tv_sec)*1e3 + (end.tv_nsec - start.tv_nsec)/1e6;
+      
+      double shift_err = hypot((fit.ra_shift - (ra_n - ra_t))*cos(dec_t*M_PI/180.0), fit.dec_shift - (dec_n - dec_t));
+      int ok = (map != NULL) && (fit.num_match / (double)num_img >= MIN_MATCH_FRAC) && (shift_err < MAX_SHIFT_ERR_D);
+      if (!ok)
+        num_fail++;
+      printf("%8.1f %8.3f %7d %7d | %7d %7.2f | %7d %9.3f %8.4f %8.2f %9.2f %9.2f %s\n", rots[r], scale, num_img, num_cat, tr_num, tr_num/(double)num_img, fit.num_match, -fit.rot_d, 1.0/(fit.scale > 0.0 ? fit.scale : 1.0), fit.resid_rms*3600.0, shift_err*3600.0, elapsed, ok ? "OK" : "FAIL");
+      point_list_map_free(map);
+      g_slist_free(map);
+      asterism_index_free(index);
+      g_object_unref(G_OBJECT(cat));
+      g_object_unref(G_OBJECT(img));
+    }
+  }
+  printf("%d failures\n", num_fail);
+  return num_fail > 0;
+}
+
+void project(double ra0, double dec0, double ra, double dec, double *x, double *y)
+{
+  ra0 *= M_PI/180.0;
+  dec0 *= M_PI/180.0;
+  ra *= M_PI/180.0;
+  dec *= M_PI/180.0;
+  double cosc = sin(dec0)*sin(dec) + cos(dec0)*cos(dec)*cos(ra-ra0);
+  *x = cos(dec)*sin(ra-ra0) / cosc * 180.0/M_PI;
+  *y = (cos(dec0)*sin(dec) - sin(dec0)*cos(dec)*cos(ra-ra0)) / cosc * 180.0/M_PI;
+}
+
+void deproject(double ra0, double dec0, double x, double y, double *ra, double *dec)
+{
+  double xi = x*M_PI/180.0, eta = y*M_PI/180.0, d0 = dec0*M_PI/180.0;
+  double rho = hypot(xi, eta), c = atan(rho);
+  if (rho == 0.0)
+  {
+    *ra = ra0;
+    *dec = dec0;
+    return;
+  }
+  *dec = asin(cos(c)*sin(d0) + eta*sin(c)*cos(d0)/rho) * 180.0/M_PI;
+  *ra = ra0 + atan2(xi*sin(c), rho*cos(d0)*cos(c) - eta*sin(d0)*sin(c)) * 180.0/M_PI;
+  if (*ra < 0.0)
+    *ra += 360.0;
+  else if (*ra >= 360.0)
+    *ra -= 360.0;
+}
+
+double frand(void)
+{
+  return rand() / ((double)RAND_MAX + 1.0);
+}
@@ -0,0 +1,195 @@
+/* Compile from local directory with:
+ * gcc -Wall -O2 -I../sep/ ./back_bench.c ../sep/analyse.c ../sep/aper.c ../sep/back.c ../sep/convolve.c
+ * ../sep/deblend.c ../sep/extract.c ../sep/lutz.c ../sep/util.c -lm -lpthread -o ./back_bench
+ *
+ * Compares star extraction on synthetic Merlin-size (407x288) frames with a sky gradient (as near the moon or in
+ * twilight) using
+ *  - a flat threshold at the global mean plus 2 standard deviations (as image_extract_stars did before), and
+ *  - a background map and RMS map from sep_makeback, evaluated with cached interpolation weights.
+ * Prints the time per frame and the detection completeness and number of spurious detections of each. Also checks
+ * that sep_backinterparrays gives the same result as sep_backarray/sep_backrmsarray, and times both:
+ *   ./back_bench [gradient]
+ * where gradient is the increase in sky level across the frame in ADU (default 200).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "sep.h"
+
+#define WIDTH          407
+#define HEIGHT         288
+#define NUM_FRAMES     50
+#define NUM_STARS      25
+#define SKY_LEVEL      100.0
+#define SKY_NOISE      5.0
+#define STAR_SIGMA     1.2
+#define MATCH_RADIUS   1.5
+/// Parameters used by image_extract_stars
+#define BACK_TILE      64
+#define BACK_FILTER    3
+#define THRESH_SIGMA   1.5
+
+struct star
+{
+  double x, y, flux;
+};
+
+static double gauss_rand(void)
+{
+  double u1 = (rand()+1.0) / (RAND_MAX+2.0), u2 = (rand()+1.0) / (RAND_MAX+2.0);
+  return sqrt(-2.0*log(u1)) * cos(2.0*M_PI*u2);
+}
+
+static void make_frame(float *img, struct star *stars, double gradient)
+{
+  int i, x, y;
+  for (y=0; y<HEIGHT; y++)
+    for (x=0; x<WIDTH; x++)
+    {
+      double sky = SKY_LEVEL + gradient * (0.7*x/WIDTH + 0.3*((double)y/HEIGHT)*((double)y/HEIGHT));
+      img[y*WIDTH+x] = sky + sqrt(SKY_NOISE*SKY_NOISE + sky - SKY_LEVEL)*gauss_rand();
+    }
+  for (i=0; i<NUM_STARS; i++)
+  {
+    stars[i].x = 5.0 + rand() / (RAND_MAX+1.0) * (WIDTH-10.0);
+    stars[i].y = 5.0 + rand() / (RAND_MAX+1.0) * (HEIGHT-10.0);
+    stars[i].flux = 300.0 * pow(100.0, rand() / (RAND_MAX+1.0));
+    for (y=(int)stars[i].y-6; y<=(int)stars[i].y+6; y++)
+      for (x=(int)stars[i].x-6; x<=(int)stars[i].x+6; x++)
+        img[y*WIDTH+x] += stars[i].flux / (2.0*M_PI*STAR_SIGMA*STAR_SIGMA) * exp(-((x-stars[i].x)*(x-stars[i].x)+(y-stars[i].y)*(y-stars[i].y))/(2.0*STAR_SIGMA*STAR_SIGMA));
+  }
+}
+
+static double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec)*1000.0 + (end->tv_nsec - start->tv_nsec)/1.0e6;
+}
+
+/// Count injected stars with a detection within MATCH_RADIUS pixels, and detections without an injected star
+static void score(struct star *stars, sepobj *obj, int num_obj, int *found, int *spurious)
+{
+  int i, j;
+  for (i=0; i<NUM_STARS; i++)
+    for (j=0; j<num_obj; j++)
+      if (pow(obj[j].x-stars[i].x,2.0) + pow(obj[j].y-stars[i].y,2.0) < MATCH_RADIUS*MATCH_RADIUS)
+      {
+        (*found)++;
+        break;
+      }
+  for (j=0; j<num_obj; j++)
+  {
+    for (i=0; i<NUM_STARS; i++)
+      if (pow(obj[j].x-stars[i].x,2.0) + pow(obj[j].y-stars[i].y,2.0) < MATCH_RADIUS*MATCH_RADIUS)
+        break;
+    if (i == NUM_STARS)
+      (*spurious)++;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  float conv[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+  double gradient = 200.0;
+  int i, frame, ret;
+  int flat_found = 0, flat_spurious = 0, back_found = 0, back_spurious = 0;
+  double t_flat = 0.0, t_back = 0.0, t_plain_arrays = 0.0, t_interp_arrays = 0.0, max_diff = 0.0;
+  struct timespec start, end;
+  struct star stars[NUM_STARS];
+  float *img = malloc(WIDTH*HEIGHT*sizeof(float));
+  float *back = malloc(WIDTH*HEIGHT*sizeof(float)), *rms = malloc(WIDTH*HEIGHT*sizeof(float));
+  float *back_ref = malloc(WIDTH*HEIGHT*sizeof(float)), *rms_ref = malloc(WIDTH*HEIGHT*sizeof(float));
+  float *sub = malloc(WIDTH*HEIGHT*sizeof(float));
+  sep_context *ctx = sep_context_new();
+  sepbackinterp *interp = NULL;
+
+  if (argc >= 2)
+    gradient = atof(argv[1]);
+  srand(4321);
+
+  for (frame=0; frame<NUM_FRAMES; frame++)
+  {
+    sepobj *obj = NULL;
+    int num_obj = 0;
+    sepbackmap *bkmap = NULL;
+    make_frame(img, stars, gradient);
+
+    // Flat threshold
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    float mean=0.0, stddev=0.0;
+    for (i=0; i<WIDTH*HEIGHT; i++)
+      mean += img[i];
+    mean /= WIDTH*HEIGHT;
+    for (i=0; i<WIDTH*HEIGHT; i++)
+      stddev += pow(mean-img[i],2.0);
+    stddev /= WIDTH*HEIGHT;
+    stddev = pow(stddev, 0.5);
+    ret = sep_extract_ctx(ctx, img, NULL, SEP_TFLOAT, SEP_TFLOAT, 0, WIDTH, HEIGHT, mean+2.0*stddev, 5, conv, 3, 3, 32, 0.005, 1, 1.0, &obj, &num_obj);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_flat += elapsed_ms(&start, &end);
+    if (ret != 0)
+    {
+      fprintf(stderr, "Flat threshold extraction failed (%d)\n", ret);
+      return 1;
+    }
+    score(stars, obj, num_obj, &flat_found, &flat_spurious);
+    sep_freeobjarray(obj, num_obj);
+
+    // Background map with cached interpolation weights
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = sep_makeback(img, NULL, SEP_TFLOAT, SEP_TFLOAT, WIDTH, HEIGHT, BACK_TILE, BACK_TILE, 0.0, BACK_FILTER, BACK_FILTER, 0.0, &bkmap);
+    if ((ret == 0) && (interp == NULL))
+      ret = sep_makebackinterp(bkmap, &interp);
+    if (ret == 0)
+      ret = sep_backinterparrays(bkmap, interp, back, rms);
+    for (i=0; i<WIDTH*HEIGHT; i++)
+      sub[i] = img[i] - back[i];
+    if (ret == 0)
+      ret = sep_extract_ctx(ctx, sub, rms, SEP_TFLOAT, SEP_TFLOAT, 0, WIDTH, HEIGHT, THRESH_SIGMA, 5, conv, 3, 3, 32, 0.005, 1, 1.0, &obj, &num_obj);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_back += elapsed_ms(&start, &end);
+    if (ret != 0)
+    {
+      fprintf(stderr, "Background map extraction failed (%d)\n", ret);
+      return 1;
+    }
+    score(stars, obj, num_obj, &back_found, &back_spurious);
+    sep_freeobjarray(obj, num_obj);
+
+    // Interpolation with and without cached weights
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sep_backarray(bkmap, back_ref, SEP_TFLOAT);
+    sep_backrmsarray(bkmap, rms_ref, SEP_TFLOAT);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_plain_arrays += elapsed_ms(&start, &end);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sep_backinterparrays(bkmap, interp, back, rms);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_interp_arrays += elapsed_ms(&start, &end);
+    for (i=0; i<WIDTH*HEIGHT; i++)
+    {
+      if (fabs(back[i]-back_ref[i]) > max_diff)
+        max_diff = fabs(back[i]-back_ref[i]);
+      if (fabs(rms[i]-rms_ref[i]) > max_diff)
+        max_diff = fabs(rms[i]-rms_ref[i]);
+    }
+    sep_freeback(bkmap);
+  }
+
+  printf("%d frames of %dx%d pixels, %d stars each, sky gradient %.0f ADU\n", NUM_FRAMES, WIDTH, HEIGHT, NUM_STARS, gradient);
+  printf("  flat threshold:   %6.2f ms/frame  %5.1f%% complete  %5.2f spurious/frame\n", t_flat/NUM_FRAMES, 100.0*flat_found/(NUM_FRAMES*NUM_STARS), (double)flat_spurious/NUM_FRAMES);
+  printf("  background map:   %6.2f ms/frame  %5.1f%% complete  %5.2f spurious/frame\n", t_back/NUM_FRAMES, 100.0*back_found/(NUM_FRAMES*NUM_STARS), (double)back_spurious/NUM_FRAMES);
+  printf("  background and RMS arrays: %6.2f ms/frame with sep_backarray, %6.2f ms/frame with cached weights (max difference %g)\n", t_plain_arrays/NUM_FRAMES, t_interp_arrays/NUM_FRAMES, max_diff);
+
+  sep_freebackinterp(interp);
+  sep_context_free(ctx);
+  free(img);
+  free(back);
+  free(rms);
+  free(back_ref);
+  free(rms_ref);
+  free(sub);
+  return max_diff > 1.0e-3;
+}
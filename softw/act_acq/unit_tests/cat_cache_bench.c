@@ -0,0 +1,287 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra `pkg-config --cflags gtk+-2.0` -I../ -I../../../libs/ ./cat_cache_bench.c ../cat_cache.c
+ * ../point_list.c ../../../libs/act_log.c `pkg-config --libs gtk+-2.0` -lmysqlclient -lpthread -lm -o ./cat_cache_bench
+ *
+ * Benchmarks box searches in the in-memory catalogue cache used by acq_store. Without arguments a synthetic
+ * catalogue with GSC-1.2 star density is searched and the results checked against a brute force search. If a
+ * database is given, the GSC-1.2 zones around the given declination are loaded into the cache and the cache search
+ * latency is compared with that of the SQL query acq_store falls back to:
+ *   ./cat_cache_bench [<host> <user> <database> [dec_d]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <mysql/mysql.h>
+#include "cat_cache.h"
+
+#define SEARCH_RADIUS_D   1.0
+#define NUM_SEARCHES      1000
+#define NUM_SQL_SEARCHES  20
+/// Approximate mean GSC-1.2 star density (stars per square degree)
+#define SYNTH_DENSITY     460.0
+#define SYNTH_DEC_D       -30.0
+
+double monotonic_sec(void);
+void bench_synthetic(void);
+int bench_database(MYSQL *conn, double dec_d);
+int load_zone(MYSQL *conn, cat_cache_t *cache, unsigned int zone);
+PointList *sql_box_search(MYSQL *conn, double ra_d, double dec_d, double radius_d);
+
+int main(int argc, char **argv)
+{
+  g_type_init();
+  srand(time(NULL));
+  bench_synthetic();
+  if (argc < 4)
+    return 0;
+
+  double dec_d = SYNTH_DEC_D;
+  if ((argc > 4) && ((sscanf(argv[4], "%lf", &dec_d) != 1) || (fabs(dec_d) > 90.0)))
+  {
+    fprintf(stderr, "Invalid declination specified (%s).\n", argv[4]);
+    return 1;
+  }
+  MYSQL *conn = mysql_init(NULL);
+  if (conn == NULL)
+  {
+    fprintf(stderr, "Error initialising MySQL connection handler.\n");
+    return 2;
+  }
+  if (mysql_real_connect(conn, argv[1], argv[2], NULL, argv[3], 0, NULL, 0) == NULL)
+  {
+    fprintf(stderr, "Error establishing connection to MySQL database - %s.\n", mysql_error(conn));
+    mysql_close(conn);
+    return 2;
+  }
+  int ret = bench_database(conn, dec_d);
+  mysql_close(conn);
+  return ret;
+}
+
+double monotonic_sec(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void bench_synthetic(void)
+{
+  cat_cache_t *cache = cat_cache_new();
+  cat_cache_request(cache, SYNTH_DEC_D, SEARCH_RADIUS_D+1.0);
+  int zone, total_stars = 0;
+  float dec_min, dec_max;
+  while ((zone = cat_cache_next_request(cache)) >= 0)
+  {
+    cat_cache_zone_limits(zone, &dec_min, &dec_max);
+    // stars per zone scales with the cosine of the declination
+    unsigned int i, num_stars = SYNTH_DENSITY * 360.0 * (dec_max - dec_min) * cos((dec_min+dec_max)*M_PI/360.0);
+    float *ra_d = malloc(num_stars*sizeof(float)), *dec_d = malloc(num_stars*sizeof(float));
+    for (i=0; i<num_stars; i++)
+    {
+      ra_d[i] = 360.0 * rand() / ((double)RAND_MAX + 1.0);
+      dec_d[i] = dec_min + (dec_max - dec_min) * rand() / ((double)RAND_MAX + 1.0);
+    }
+    cat_cache_set_zone(cache, zone, num_stars, ra_d, dec_d);
+    total_stars += num_stars;
+  }
+  printf("Synthetic catalogue: %d stars in zones around %.1f degrees.\n", total_stars, SYNTH_DEC_D);
+
+  int i, num_found = 0, num_mismatch = 0;
+  double ra_d[NUM_SEARCHES], dec_d[NUM_SEARCHES];
+  for (i=0; i<NUM_SEARCHES; i++)
+  {
+    ra_d[i] = 360.0 * rand() / ((double)RAND_MAX + 1.0);
+    dec_d[i] = SYNTH_DEC_D + 0.5 * (2.0 * rand() / RAND_MAX - 1.0);
+  }
+  double start = monotonic_sec();
+  for (i=0; i<NUM_SEARCHES; i++)
+  {
+    PointList *list = cat_cache_box_search(cache, ra_d[i], dec_d[i], SEARCH_RADIUS_D);
+    num_found += point_list_get_num_used(list);
+    g_object_unref(G_OBJECT(list));
+  }
+  double elapsed = monotonic_sec() - start;
+  printf("%-10s %12s %12s\n", "method", "us/search", "stars/search");
+  printf("%-10s %12.2f %12.1f\n", "cache", elapsed/NUM_SEARCHES*1e6, (double)num_found/NUM_SEARCHES);
+
+  // brute force check of a few searches, including ones straddling RA 0
+  for (i=0; i<20; i++)
+  {
+    double ra = i < 10 ? ra_d[i] : 359.9 * (i % 2) + 0.05;
+    double ra_radius = SEARCH_RADIUS_D / cos(dec_d[i]*M_PI/180.0);
+    int num_brute = 0;
+    unsigned int j;
+    for (zone=0; zone<CAT_CACHE_NUM_ZONES; zone++)
+    {
+      struct cat_zone *cz = cache->zones[zone];
+      if (cz == NULL)
+        continue;
+      for (j=0; j<cz->num_stars; j++)
+      {
+        double dra = fabs(cz->ra_d[j] - ra);
+        if (dra > 180.0)
+          dra = 360.0 - dra;
+        if ((dra < ra_radius) && (fabs(cz->dec_d[j] - dec_d[i]) < SEARCH_RADIUS_D))
+          num_brute++;
+      }
+    }
+    PointList *list = cat_cache_box_search(cache, ra, dec_d[i], SEARCH_RADIUS_D);
+    if ((int)point_list_get_num_used(list) != num_brute)
+    {
+      printf("Mismatch at (%f, %f): cache %u, brute force %d\n", ra, dec_d[i], point_list_get_num_used(list), num_brute);
+      num_mismatch++;
+    }
+    g_object_unref(G_OBJECT(list));
+  }
+  printf("Brute force check: %d mismatches.\n", num_mismatch);
+  cat_cache_free(cache);
+}
+
+int bench_database(MYSQL *conn, double dec_d)
+{
+  cat_cache_t *cache = cat_cache_new();
+  cat_cache_request(cache, dec_d, SEARCH_RADIUS_D+1.0);
+  int zone;
+  double start = monotonic_sec();
+  while ((zone = cat_cache_next_request(cache)) >= 0)
+  {
+    if (load_zone(conn, cache, zone) != 0)
+    {
+      cat_cache_free(cache);
+      return 2;
+    }
+  }
+  printf("\nZones around %.1f degrees loaded from database in %.3f s.\n", dec_d, monotonic_sec() - start);
+
+  int i, num_found = 0, num_mismatch = 0;
+  double ra_d[NUM_SEARCHES], search_dec_d[NUM_SEARCHES];
+  for (i=0; i<NUM_SEARCHES; i++)
+  {
+    ra_d[i] = 360.0 * rand() / ((double)RAND_MAX + 1.0);
+    search_dec_d[i] = dec_d + 0.5 * (2.0 * rand() / RAND_MAX - 1.0);
+    if (fabs(search_dec_d[i]) > 90.0)
+      search_dec_d[i] = dec_d;
+  }
+  start = monotonic_sec();
+  for (i=0; i<NUM_SEARCHES; i++)
+  {
+    PointList *list = cat_cache_box_search(cache, ra_d[i], search_dec_d[i], SEARCH_RADIUS_D);
+    num_found += point_list_get_num_used(list);
+    g_object_unref(G_OBJECT(list));
+  }
+  double cache_t = (monotonic_sec() - start) / NUM_SEARCHES;
+  double cache_found = (double)num_found / NUM_SEARCHES;
+
+  num_found = 0;
+  start = monotonic_sec();
+  for (i=0; i<NUM_SQL_SEARCHES; i++)
+  {
+    PointList *list = sql_box_search(conn, ra_d[i], search_dec_d[i], SEARCH_RADIUS_D);
+    if (list == NULL)
+      continue;
+    num_found += point_list_get_num_used(list);
+    g_object_unref(G_OBJECT(list));
+  }
+  double sql_t = (monotonic_sec() - start) / NUM_SQL_SEARCHES;
+  double sql_found = (double)num_found / NUM_SQL_SEARCHES;
+
+  for (i=0; i<NUM_SQL_SEARCHES; i++)
+  {
+    PointList *sql_list = sql_box_search(conn, ra_d[i], search_dec_d[i], SEARCH_RADIUS_D);
+    PointList *cache_list = cat_cache_box_search(cache, ra_d[i], search_dec_d[i], SEARCH_RADIUS_D);
+    unsigned int num_sql = sql_list == NULL ? 0 : point_list_get_num_used(sql_list);
+    if (num_sql != point_list_get_num_used(cache_list))
+    {
+      printf("Mismatch at (%f, %f): cache %u, SQL %u\n", ra_d[i], search_dec_d[i], point_list_get_num_used(cache_list), num_sql);
+      num_mismatch++;
+    }
+    if (sql_list != NULL)
+      g_object_unref(G_OBJECT(sql_list));
+    g_object_unref(G_OBJECT(cache_list));
+  }
+
+  printf("%-10s %12s %12s\n", "method", "us/search", "stars/search");
+  printf("%-10s %12.2f %12.1f\n", "cache", cache_t*1e6, cache_found);
+  printf("%-10s %12.2f %12.1f\n", "sql", sql_t*1e6, sql_found);
+  printf("SQL check: %d mismatches (boundary stars may differ by float rounding).\n", num_mismatch);
+  cat_cache_free(cache);
+  return 0;
+}
+
+/// Loads a GSC-1.2 zone the same way the acq_store catalogue loader thread does.
+int load_zone(MYSQL *conn, cat_cache_t *cache, unsigned int zone)
+{
+  float dec_min, dec_max;
+  char qrystr[512];
+  cat_cache_zone_limits(zone, &dec_min, &dec_max);
+  sprintf(qrystr, "SELECT ra_d_fk5, dec_d_fk5 FROM gsc1 WHERE reg_id IN (SELECT id FROM gsc1_reg WHERE dec_max>=%f AND dec_min<=%f) AND dec_d_fk5>=%f AND dec_d_fk5%s%f;", dec_min, dec_max, dec_min, zone == CAT_CACHE_NUM_ZONES-1 ? "<=" : "<", dec_max);
+  if (mysql_query(conn, qrystr))
+  {
+    fprintf(stderr, "Failed to query zone %u - %s\n", zone, mysql_error(conn));
+    return -1;
+  }
+  MYSQL_RES *result = mysql_store_result(conn);
+  if (result == NULL)
+  {
+    fprintf(stderr, "Failed to retrieve zone %u - %s\n", zone, mysql_error(conn));
+    return -1;
+  }
+  unsigned int num_stars = 0, rowcount = mysql_num_rows(result);
+  float *ra_d = malloc((rowcount+1)*sizeof(float)), *dec_d = malloc((rowcount+1)*sizeof(float));
+  MYSQL_ROW row;
+  while ((row = mysql_fetch_row(result)) != NULL)
+  {
+    ra_d[num_stars] = strtof(row[0], NULL);
+    dec_d[num_stars] = strtof(row[1], NULL);
+    num_stars++;
+  }
+  mysql_free_result(result);
+  cat_cache_set_zone(cache, zone, num_stars, ra_d, dec_d);
+  return 0;
+}
+
+/// Same region and box queries as acq_store_get_gsc1_pattern (away from the poles).
+PointList *sql_box_search(MYSQL *conn, double ra_d, double dec_d, double radius_d)
+{
+  char qrystr[1024], reg_list[512];
+  double ra_radius_d = radius_d / cos(dec_d*M_PI/180.0);
+  MYSQL_RES *result;
+  MYSQL_ROW row;
+  int len = 0;
+  if (ra_d - ra_radius_d < 0.0)
+    sprintf(qrystr, "SELECT id FROM gsc1_reg WHERE dec_max>=%f AND dec_min<=%f AND ((ra_max>=360.0 AND ra_min<=%f) OR (ra_max>=%f AND ra_min<=0.0));", dec_d-radius_d, dec_d+radius_d, ra_d-ra_radius_d+360.0, ra_d+ra_radius_d);
+  else if (ra_d + ra_radius_d >= 360.0)
+    sprintf(qrystr, "SELECT id FROM gsc1_reg WHERE dec_max>=%f AND dec_min<=%f AND ((ra_max>=360.0 AND ra_min<=%f) OR (ra_max>=%f AND ra_min<=0.0));", dec_d-radius_d, dec_d+radius_d, ra_d-ra_radius_d, ra_d+ra_radius_d-360.0);
+  else
+    sprintf(qrystr, "SELECT id FROM gsc1_reg WHERE dec_max>=%f AND dec_min<=%f AND ra_max>=%f AND ra_min<=%f;", dec_d-radius_d, dec_d+radius_d, ra_d-ra_radius_d, ra_d+ra_radius_d);
+  if (mysql_query(conn, qrystr) || ((result = mysql_store_result(conn)) == NULL))
+    return NULL;
+  while (((row = mysql_fetch_row(result)) != NULL) && (len < 500))
+    len += sprintf(&reg_list[len], "%s,", row[0]);
+  mysql_free_result(result);
+  if (len == 0)
+    return NULL;
+  reg_list[len-1] = '\0';
+
+  if (ra_d - ra_radius_d < 0.0)
+    sprintf(qrystr, "SELECT ra_d_fk5, dec_d_fk5 FROM gsc1 WHERE reg_id IN (%s) AND (dec_d_fk5<%lf AND dec_d_fk5>%lf AND (ra_d_fk5<%lf OR ra_d_fk5>%lf))", reg_list, dec_d+radius_d, dec_d-radius_d, ra_d+ra_radius_d, ra_d-ra_radius_d+360.0);
+  else if (ra_d + ra_radius_d >= 360.0)
+    sprintf(qrystr, "SELECT ra_d_fk5, dec_d_fk5 FROM gsc1 WHERE reg_id IN (%s) AND (dec_d_fk5<%lf AND dec_d_fk5>%lf AND (ra_d_fk5<%lf OR ra_d_fk5>%lf))", reg_list, dec_d+radius_d, dec_d-radius_d, ra_d+ra_radius_d-360.0, ra_d-ra_radius_d);
+  else
+    sprintf(qrystr, "SELECT ra_d_fk5, dec_d_fk5 FROM gsc1 WHERE reg_id IN (%s) AND (dec_d_fk5<%lf AND dec_d_fk5>%lf AND ra_d_fk5<%lf AND ra_d_fk5>%lf)", reg_list, dec_d+radius_d, dec_d-radius_d, ra_d+ra_radius_d, ra_d-ra_radius_d);
+  if (mysql_query(conn, qrystr) || ((result = mysql_store_result(conn)) == NULL))
+    return NULL;
+  PointList *list = point_list_new_with_length(mysql_num_rows(result)+1);
+  double point_ra, point_dec;
+  while ((row = mysql_fetch_row(result)) != NULL)
+  {
+    if ((sscanf(row[0], "%lf", &point_ra) == 1) && (sscanf(row[1], "%lf", &point_dec) == 1))
+      point_list_append(list, point_ra, point_dec);
+  }
+  mysql_free_result(result);
+  return list;
+}
@@ -1,8 +1,8 @@
 /* Compile from local directory with:
  * gcc -Wall -Wextra `pkg-config --cflags gtk+-2.0 gtkglext-1.0` -I../ -I../../../libs/ 
  * ./disp_db_img.c ../ccd_img.c ../imgdisp.c ../view_param_dialog.c ../sep/*.c ../point_list.c ../pattern_match.c
- * ../../../libs/act_log.c ../../../libs/act_timecoord.c `pkg-config --libs gtk+-2.0 gtkglext-1.0` -lmysqlclient -lm
- * -o ./disp_db_img
+ * ../../../libs/act_log.c ../../../libs/act_timecoord.c ../../../libs/act_timing.c
+ * `pkg-config --libs gtk+-2.0 gtkglext-1.0` -lmysqlclient -lpthread -lm -o ./disp_db_img
  */
 
 #include <gtk/gtk.h>
@@ -33,6 +33,7 @@ typedef gchar string256[256];
 
 gint get_img_info(gint img_id, CcdImg *img);
 gint get_img_data(gint img_id, CcdImg *img);
+gint get_img_blob(gint img_id, CcdImg *img);
 PointList *image_extract_stars(CcdImg *img, GtkWidget *imgdisp);
 PointList *get_pat_points(gdouble ra_d, gdouble dec_d, gdouble equinox, gdouble radius_d);
 void precess_fk5(gdouble ra_in, gdouble dec_in, gdouble eq_in, gdouble *ra_d_fk5, gdouble *dec_d_fk5);
@@ -188,8 +189,45 @@ gint get_img_info(gint img_id, CcdImg *img)
   return 0;
 }
 
+/** Returns 0 if the image's pixels were read from ccd_img_blob, 1 if there is no blob for the image and <0 on error. */
+gint get_img_blob(gint img_id, CcdImg *img)
+{
+  char qrystr[256];
+  sprintf(qrystr, "SELECT data FROM ccd_img_blob WHERE ccd_img_id=%d", img_id);
+  MYSQL_RES *result;
+  MYSQL_ROW res_row;
+  mysql_query(conn,qrystr);
+  result = mysql_store_result(conn);
+  if (result == NULL)
+  {
+    act_log_error(act_log_msg("Failed to retrieve pixel data blob for image %d - %s.", img_id, mysql_error(conn)));
+    return -1;
+  }
+  res_row = mysql_fetch_row(result);
+  if (res_row == NULL)
+  {
+    mysql_free_result(result);
+    return 1;
+  }
+  unsigned long *lengths = mysql_fetch_lengths(result);
+  gint img_len = (gint)ccd_img_get_img_width(img) * ccd_img_get_img_height(img);
+  if ((res_row[0] == NULL) || (lengths[0] != img_len*sizeof(gfloat)))
+  {
+    act_log_error(act_log_msg("Image size mismatch (database blob has %lu bytes, should be %d), image %d", lengths[0], (gint)(img_len*sizeof(gfloat)), img_id));
+    mysql_free_result(result);
+    return -1;
+  }
+  ccd_img_set_img_data(img, img_len, (gfloat const *)res_row[0]);
+  mysql_free_result(result);
+  return 0;
+}
+
 gint get_img_data(gint img_id, CcdImg *img)
 {
+  gint blob_ret = get_img_blob(img_id, img);
+  if (blob_ret <= 0)
+    return blob_ret;
+  // Image was stored before ccd_img_blob was introduced, fall back to one row per pixel
   string256 qrystr;
   sprintf(qrystr, "SELECT y*%hu+x, value FROM ccd_img_data WHERE ccd_img_id=%d", ccd_img_get_img_width(img), img_id);
   MYSQL_RES *result;
@@ -0,0 +1,201 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra `pkg-config --cflags gtk+-2.0` -I../ -I../../../libs/ ./fits_test.c ../acq_fits.c ../ccd_img.c
+ * ../../../libs/act_log.c ../../../libs/act_timecoord.c ../../../libs/act_timing.c
+ * `pkg-config --libs gtk+-2.0` -lcfitsio -lpthread -lm -o ./fits_test
+ *
+ * Writes synthetic Merlin-size (407x288) images to FITS files with acq_fits and reads them back, checking that the
+ * pixels and metadata survive unchanged, for
+ *  - an image set from raw 8-bit pixels (Rice-compressed bytes with BSCALE),
+ *  - an image set from floating point pixels (GZIP-compressed floats), and
+ *  - the same images uncompressed.
+ * Also queues images to a background writer and checks that they are all written. Prints the time and file size
+ * of each. Files are written to the given directory (default /tmp):
+ *   ./fits_test [directory]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#include "acq_fits.h"
+
+#define WIDTH          407
+#define HEIGHT         288
+#define RAW_MAX        255.0
+#define NUM_QUEUED     10
+
+static double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec)*1000.0 + (end->tv_nsec - start->tv_nsec)/1.0e6;
+}
+
+static CcdImg *make_img(guchar *raw, gboolean from_raw)
+{
+  int i;
+  CcdImg *img = CCD_IMG(g_object_new (ccd_img_get_type(), NULL));
+  ccd_img_set_img_type(img, IMGT_ACQ_OBJ);
+  ccd_img_set_window(img, 0, 0, WIDTH, HEIGHT, 1, 1);
+  ccd_img_set_integ_t(img, 2.5);
+  ccd_img_set_start_datetime(img, 1429565702.25);
+  ccd_img_set_target(img, 42, "HD 12345");
+  ccd_img_set_user(img, 7, "observer");
+  ccd_img_set_tel_pos(img, 123.456, -45.678);
+  ccd_img_set_pixel_size(img, 2.1, 2.2);
+  // sky with noise and a few saturated stars, as the Merlin camera sees it
+  for (i=0; i<WIDTH*HEIGHT; i++)
+    raw[i] = 20 + rand() % 12;
+  for (i=0; i<20; i++)
+    raw[(rand() % HEIGHT)*WIDTH + rand() % WIDTH] = 255;
+  if (from_raw)
+    ccd_img_set_raw_data(img, WIDTH*HEIGHT, raw, RAW_MAX, NULL, NULL);
+  else
+  {
+    gfloat *data = malloc(WIDTH*HEIGHT*sizeof(gfloat));
+    for (i=0; i<WIDTH*HEIGHT; i++)
+      data[i] = raw[i] * 3.3 + 0.125;
+    ccd_img_set_img_data(img, WIDTH*HEIGHT, data);
+    free(data);
+  }
+  return img;
+}
+
+static int compare(CcdImg *img, CcdImg *read_img)
+{
+  int errors = 0;
+  gfloat ra1, dec1, ra2, dec2;
+  if (read_img == NULL)
+  {
+    fprintf(stderr, "  could not read image back\n");
+    return 1;
+  }
+  ccd_img_get_tel_pos(img, &ra1, &dec1);
+  ccd_img_get_tel_pos(read_img, &ra2, &dec2);
+  if ((ccd_img_get_img_type(img) != ccd_img_get_img_type(read_img)) ||
+      (ccd_img_get_img_width(img) != ccd_img_get_img_width(read_img)) ||
+      (ccd_img_get_img_height(img) != ccd_img_get_img_height(read_img)) ||
+      (ccd_img_get_integ_t(img) != ccd_img_get_integ_t(read_img)) ||
+      (ccd_img_get_start_datetime(img) != ccd_img_get_start_datetime(read_img)) ||
+      (ccd_img_get_targ_id(img) != ccd_img_get_targ_id(read_img)) ||
+      (strcmp(ccd_img_get_targ_name(img), ccd_img_get_targ_name(read_img)) != 0) ||
+      (ccd_img_get_user_id(img) != ccd_img_get_user_id(read_img)) ||
+      (strcmp(ccd_img_get_user_name(img), ccd_img_get_user_name(read_img)) != 0) ||
+      (ra1 != ra2) || (dec1 != dec2) ||
+      (ccd_img_get_pixel_size_ra(img) != ccd_img_get_pixel_size_ra(read_img)) ||
+      (ccd_img_get_pixel_size_dec(img) != ccd_img_get_pixel_size_dec(read_img)))
+  {
+    fprintf(stderr, "  metadata differ\n");
+    errors++;
+  }
+  gfloat const *data = ccd_img_get_img_data(img), *read_data = ccd_img_get_img_data(read_img);
+  int i, num_diff = 0;
+  for (i=0; i<WIDTH*HEIGHT; i++)
+    if (fabs(data[i]-read_data[i]) > 1.0e-6*fabs(data[i]))
+      num_diff++;
+  if (num_diff > 0)
+  {
+    fprintf(stderr, "  %d pixels differ\n", num_diff);
+    errors++;
+  }
+  return errors;
+}
+
+static int round_trip(gchar const *dir, gchar const *desc, gboolean from_raw, gboolean compress)
+{
+  struct timespec start, end;
+  struct stat st;
+  guchar *raw = malloc(WIDTH*HEIGHT);
+  CcdImg *img = make_img(raw, from_raw);
+  gchar *filepath = g_build_filename(dir, "fits_test.fits", NULL);
+  g_unlink(filepath);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  gboolean ret = acq_fits_write_img(img, filepath, compress);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double t_write = elapsed_ms(&start, &end);
+  if (!ret)
+  {
+    fprintf(stderr, "%s: write failed\n", desc);
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  CcdImg *read_img = acq_fits_read_img(filepath);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double t_read = elapsed_ms(&start, &end);
+  stat(filepath, &st);
+  printf("%-32s write %6.2f ms  read %6.2f ms  %8ld bytes\n", desc, t_write, t_read, (long)st.st_size);
+  int errors = compare(img, read_img);
+
+  if (read_img != NULL)
+    g_object_unref(G_OBJECT(read_img));
+  g_object_unref(G_OBJECT(img));
+  g_unlink(filepath);
+  g_free(filepath);
+  free(raw);
+  return errors;
+}
+
+static int queued(gchar const *dir)
+{
+  int i, errors = 0;
+  guint depth;
+  guchar *raw = malloc(WIDTH*HEIGHT*NUM_QUEUED);
+  gchar *queue_dir = g_build_filename(dir, "fits_test_queue", NULL);
+  acq_fits_writer_t *writer = acq_fits_writer_new(queue_dir, TRUE);
+  if (writer == NULL)
+  {
+    fprintf(stderr, "Could not create FITS writer\n");
+    return 1;
+  }
+  for (i=0; i<NUM_QUEUED; i++)
+  {
+    // all with the same start time, so the writer must number the files
+    CcdImg *img = make_img(&raw[i*WIDTH*HEIGHT], TRUE);
+    if (!acq_fits_writer_append(writer, img))
+      errors++;
+    g_object_unref(G_OBJECT(img));
+  }
+  acq_fits_writer_get_counters(writer, NULL, NULL, &depth);
+  acq_fits_writer_free(writer);
+  free(raw);
+
+  GDir *gdir = g_dir_open(queue_dir, 0, NULL);
+  gchar const *name;
+  int num_files = 0;
+  while ((gdir != NULL) && ((name = g_dir_read_name(gdir)) != NULL))
+  {
+    gchar *filepath = g_build_filename(queue_dir, name, NULL);
+    if (g_str_has_suffix(name, ".fits"))
+      num_files++;
+    g_unlink(filepath);
+    g_free(filepath);
+  }
+  if (gdir != NULL)
+    g_dir_close(gdir);
+  g_rmdir(queue_dir);
+  g_free(queue_dir);
+  printf("Background writer: %d images queued (%u waiting after queueing), %d files written\n", NUM_QUEUED, depth, num_files);
+  if (num_files != NUM_QUEUED)
+    errors++;
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  gchar const *dir = argc >= 2 ? argv[1] : "/tmp";
+  int errors = 0;
+  srand(1234);
+  g_type_init();
+  errors += round_trip(dir, "raw pixels, compressed", TRUE, TRUE);
+  errors += round_trip(dir, "raw pixels, uncompressed", TRUE, FALSE);
+  errors += round_trip(dir, "float pixels, compressed", FALSE, TRUE);
+  errors += round_trip(dir, "float pixels, uncompressed", FALSE, FALSE);
+  errors += queued(dir);
+  if (errors == 0)
+    printf("All tests passed\n");
+  else
+    printf("%d tests failed\n", errors);
+  return errors != 0;
+}
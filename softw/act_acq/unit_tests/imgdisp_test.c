@@ -1,7 +1,8 @@
 /* Compile from local directory with:
  * gcc -Wall -Wextra `pkg-config --cflags gtk+-2.0 gtkglext-1.0` -I../ -I../../../libs/ 
- * ./imgdisp_test.c ../ccd_img.c ../imgdisp.c ../view_param_dialog.c ../../../libs/act_log.c ../../../libs/act_timecoord.c 
- * `pkg-config --libs gtk+-2.0 gtkglext-1.0` -lm -o ./imgdisp_test
+ * ./imgdisp_test.c ../ccd_img.c ../imgdisp.c ../view_param_dialog.c ../../../libs/act_log.c
+ * ../../../libs/act_timecoord.c ../../../libs/act_timing.c
+ * `pkg-config --libs gtk+-2.0 gtkglext-1.0` -lpthread -lm -o ./imgdisp_test
  */
 
 #include <gtk/gtk.h>
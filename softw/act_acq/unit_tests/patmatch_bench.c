@@ -0,0 +1,263 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra `pkg-config --cflags gtk+-2.0` -I../ -I../../../libs/ ./patmatch_bench.c ../pattern_match.c ../point_list.c
+ * ../../../libs/act_log.c `pkg-config --libs gtk+-2.0` -lpthread -lm -o ./patmatch_bench
+ *
+ * Times FindPointMapping on synthetic star fields of 50, 200 and 1000 stars and checks that its mapping is identical
+ * to that of the original exhaustive clustering algorithm (kept below as FindPointMappingRef) at the match radii
+ * swept by patmatch_test. The exhaustive algorithm is very slow for large fields, so it is only run for fields of up
+ * to 200 stars unless -a is given:
+ *   ./patmatch_bench [-a]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define PAT_MATCH_RADIUS  30./3600.0
+#define FIELD_SIZE_D      0.5
+#define MAX_REF_STARS     200
+
+struct point
+{
+  float x;
+  float y;
+};
+
+void FindPointMapping (struct point *pList1, int nPts1, struct point *pList2, int nPts2, int** nMap, int* nMatch, float radius);
+void FindPointMappingRef (struct point *pList1, int nPts1, struct point *pList2, int nPts2, int** nMap, int* nMatch, float radius);
+double monotonic_sec(void);
+double frand(void);
+void make_field(int num_stars, struct point **img_pts, int *num_img, struct point **cat_pts, int *num_cat);
+
+int main(int argc, char **argv)
+{
+  int run_all = (argc > 1) && (strcmp(argv[1], "-a") == 0);
+  int field_sizes[] = { 50, 200, 1000 };
+  unsigned int f;
+  int num_mismatch = 0;
+  srand(time(NULL));
+  printf("%6s %6s %6s %12s %8s %12s %12s\n", "stars", "img", "cat", "radius", "match", "grid (s)", "exhaust (s)");
+  for (f=0; f<sizeof(field_sizes)/sizeof(field_sizes[0]); f++)
+  {
+    struct point *img_pts, *cat_pts;
+    int num_img, num_cat;
+    make_field(field_sizes[f], &img_pts, &num_img, &cat_pts, &num_cat);
+    float radius;
+    for (radius=PAT_MATCH_RADIUS/10.0; radius<=0.01; radius*=2.0)
+    {
+      int *map, num_match, *ref_map, ref_num_match;
+      double start = monotonic_sec();
+      FindPointMapping(img_pts, num_img, cat_pts, num_cat, &map, &num_match, radius);
+      double grid_t = monotonic_sec() - start;
+      if (!run_all && (field_sizes[f] > MAX_REF_STARS))
+      {
+        printf("%6d %6d %6d %12.6f %8d %12.6f %12s\n", field_sizes[f], num_img, num_cat, radius, num_match, grid_t, "-");
+        free(map);
+        continue;
+      }
+      start = monotonic_sec();
+      FindPointMappingRef(img_pts, num_img, cat_pts, num_cat, &ref_map, &ref_num_match, radius);
+      double ref_t = monotonic_sec() - start;
+      printf("%6d %6d %6d %12.6f %8d %12.6f %12.6f\n", field_sizes[f], num_img, num_cat, radius, num_match, grid_t, ref_t);
+      if ((num_match != ref_num_match) || (memcmp(map, ref_map, num_img*sizeof(int)) != 0))
+      {
+        printf("  MISMATCH: %d matches, exhaustive search found %d\n", num_match, ref_num_match);
+        num_mismatch++;
+      }
+      free(map);
+      free(ref_map);
+    }
+    free(img_pts);
+    free(cat_pts);
+  }
+  printf("%d mismatches\n", num_mismatch);
+  return num_mismatch > 0;
+}
+
+double monotonic_sec(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+double frand(void)
+{
+  return rand() / ((double)RAND_MAX + 1.0);
+}
+
+/// Catalogue field of num_stars stars, and an image of the same field offset by up to 0.1 degrees, with some stars missing, some spurious detections and positional noise
+void make_field(int num_stars, struct point **img_pts, int *num_img, struct point **cat_pts, int *num_cat)
+{
+  int i;
+  float ra0 = 360.0*frand(), dec0 = -60.0 + 60.0*frand();
+  float off_x = 0.2*frand() - 0.1, off_y = 0.2*frand() - 0.1;
+  *cat_pts = malloc(num_stars*sizeof(struct point));
+  *img_pts = malloc(num_stars*sizeof(struct point));
+  *num_cat = num_stars;
+  *num_img = 0;
+  for (i=0; i<num_stars; i++)
+  {
+    (*cat_pts)[i].x = ra0 + FIELD_SIZE_D*frand();
+    (*cat_pts)[i].y = dec0 + FIELD_SIZE_D*frand();
+    if (frand() < 0.3)
+      continue;
+    (*img_pts)[*num_img].x = (*cat_pts)[i].x + off_x + 2.0/3600.0*(frand()-0.5);
+    (*img_pts)[*num_img].y = (*cat_pts)[i].y + off_y + 2.0/3600.0*(frand()-0.5);
+    (*num_img)++;
+  }
+  for (i=0; (i<num_stars/10) && (*num_img < num_stars); i++)
+  {
+    (*img_pts)[*num_img].x = ra0 + FIELD_SIZE_D*frand();
+    (*img_pts)[*num_img].y = dec0 + FIELD_SIZE_D*frand();
+    (*num_img)++;
+  }
+}
+
+/// The original exhaustive clustering implementation of FindPointMapping, as reference.
+void FindPointMappingRef (struct point *pList1, int nPts1, struct point *pList2, int nPts2, int** nMap, int* nMatch, float radius)
+{
+  struct point *dList;
+  int *dCount, *cList, *cBest;
+  int nDist;
+  int i, j, d, m;
+  int nFound;
+  float dx, dy;
+  int nMax, nPairs, nPairsBest;
+  
+  dList = (struct point*) calloc( nPts1*nPts2, sizeof(struct point) );
+  dCount = (int*) calloc( nPts1*nPts2, sizeof(int) );
+  cList = (int*) calloc( nPts1*nPts2, sizeof(int) );
+  cBest = (int*) calloc( nPts1*nPts2, sizeof(int) );
+  
+  if ((dList == NULL) || (dCount == NULL) || (cList == NULL) || (cBest == NULL))
+  {
+    *nMap = NULL;
+    *nMatch = -1;
+    return;
+  }
+  
+  /* find and cluster all interpoint distances */
+  nDist = 0;
+  for (i=0; i<nPts1; i++)
+  {
+    for (j=0; j<nPts2; j++)
+    {
+      dx = pList1[i].x - pList2[j].x;
+      dy = pList1[i].y - pList2[j].y;
+      
+      nFound = 0;
+      for (d=0; d<nDist; d++)
+      {
+        if ( (fabs(dList[d].x/dCount[d] - dx) < radius) 
+          && (fabs(dList[d].y/dCount[d] - dy) < radius) )
+        {
+          nFound = 1;
+          
+          dList[d].x += dx;
+          dList[d].y += dy;                                       
+          dCount[d]++;
+        }
+      }
+      
+      if (!nFound)
+      {
+        dList[nDist].x = dx;
+        dList[nDist].y = dy;
+        dCount[nDist] = 1;
+        
+        nDist++;
+      }
+    }
+  }
+    
+  /* get means of distance clusters */
+  for (d=0; d<nDist; d++)
+  {
+    dList[d].x /= dCount[d];
+    dList[d].y /= dCount[d];
+  }
+  
+  #ifdef DEBUG
+  for (i=0; i<nDist; i++)
+    printf( "%4d  %9.3f  %9.3f %d\n", i, dList[i].x, dList[i].y, dCount[i] );
+  #endif
+  
+  /* find largest point mapping */
+  nPairsBest = 0;
+  while (1)
+  {
+    m = -1;
+    nMax = 1;
+    for (d=0; d<nDist; d++)
+    {
+      if (nMax < dCount[d])
+      {
+        m = d;
+        nMax = dCount[d];
+      }
+    }
+    
+    /* stop if no more possibilities exist */
+    if (m == -1)
+      break;
+    
+    #ifdef DEBUG
+      printf( "Offset (%f,%f)\n", dList[m].x, dList[m].y );
+      #endif
+      
+      /* only examine this option if it can possibly be larger than the current best */
+      if (dCount[m] > nPairsBest) 
+      {
+        nPairs = 0;
+        for (i=0; i<nPts1; i++)
+        {
+          cList[i] = -1;
+          for (j=0; j<nPts2; j++)
+          {
+            dx = pList1[i].x - pList2[j].x - dList[m].x;
+            dy = pList1[i].y - pList2[j].y - dList[m].y;
+            
+            if ( fabs(dx) < radius && fabs(dy) < radius )
+            {
+              cList[i] = j;
+              nPairs++;
+              break;
+            }
+          }
+        }
+        
+        if (nPairs > nPairsBest)
+        {
+          int* tmp;
+          
+          tmp = cBest;
+          cBest = cList;
+          cList = tmp;
+          
+          nPairsBest = nPairs;
+        }
+      }
+      
+      /* don't try this option again */
+      dCount[m] = 0;
+  }
+  
+  #ifdef DEBUG
+  for (i=0; i<nPts1; i++)
+    printf( "%4d -> %4d\n", i, cBest[i] );
+  #endif
+  
+  if (nPairsBest < 2)
+    *nMatch = 0;
+  else
+    *nMatch = nPairsBest;
+  
+  *nMap = cBest;
+  
+  free( dList );
+  free( dCount );
+  free( cList );
+}
@@ -0,0 +1,159 @@
+/* Compile from local directory with:
+ * gcc -Wall -O2 -I../sep/ ./sep_tiled_bench.c ../sep/analyse.c ../sep/aper.c ../sep/back.c ../sep/convolve.c
+ * ../sep/deblend.c ../sep/extract.c ../sep/lutz.c ../sep/util.c -lm -lpthread -o ./sep_tiled_bench
+ *
+ * Extracts stars from synthetic star fields with sep_extract, sep_extract_ctx (reusing one context) and
+ * sep_extract_tiled, and checks that all three find the same objects (to within MATCH_TOL pixels). Prints the mean
+ * time per frame of each:
+ *   ./sep_tiled_bench [width height [num_threads]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "sep.h"
+
+#define NUM_FRAMES    20
+/// Number of stars per million pixels
+#define STAR_DENSITY  150
+#define MAX_THREADS   16
+#define SKY_LEVEL     100.0
+#define SKY_NOISE     5.0
+#define STAR_SIGMA    1.5
+#define MATCH_TOL     0.5
+
+static double gauss_rand(void)
+{
+  double u1 = (rand()+1.0) / (RAND_MAX+2.0), u2 = (rand()+1.0) / (RAND_MAX+2.0);
+  return sqrt(-2.0*log(u1)) * cos(2.0*M_PI*u2);
+}
+
+static void make_frame(float *img, int width, int height)
+{
+  int i, x, y;
+  for (i=0; i<width*height; i++)
+    img[i] = SKY_LEVEL + SKY_NOISE*gauss_rand();
+  int num_stars = STAR_DENSITY * (width*height/1.0e6);
+  for (i=0; i<num_stars; i++)
+  {
+    double sx = rand() / (RAND_MAX+1.0) * width, sy = rand() / (RAND_MAX+1.0) * height;
+    double flux = 500.0 + 20000.0 * pow(rand() / (RAND_MAX+1.0), 3.0);
+    for (y=(int)sy-8; y<=(int)sy+8; y++)
+      for (x=(int)sx-8; x<=(int)sx+8; x++)
+      {
+        if ((x < 0) || (x >= width) || (y < 0) || (y >= height))
+          continue;
+        img[y*width+x] += flux / (2.0*M_PI*STAR_SIGMA*STAR_SIGMA) * exp(-((x-sx)*(x-sx)+(y-sy)*(y-sy))/(2.0*STAR_SIGMA*STAR_SIGMA));
+      }
+  }
+}
+
+static double elapsed_ms(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec)*1000.0 + (end->tv_nsec - start->tv_nsec)/1.0e6;
+}
+
+/** Number of objects in list a without an object in list b within MATCH_TOL pixels. The faint pixels of deblended
+ * objects are assigned at random, so their centroids differ slightly between serial and tiled extraction. */
+static int count_missing(sepobj *a, int num_a, sepobj *b, int num_b)
+{
+  int i, j, missing = 0;
+  for (i=0; i<num_a; i++)
+  {
+    for (j=0; j<num_b; j++)
+      if ((fabs(a[i].x-b[j].x) < MATCH_TOL) && (fabs(a[i].y-b[j].y) < MATCH_TOL))
+        break;
+    if (j == num_b)
+      missing++;
+  }
+  return missing;
+}
+
+int main(int argc, char **argv)
+{
+  float conv[9] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+  int width = 1024, height = 1024, num_threads = 4;
+  int i, ret, frame, mismatch = 0;
+  double t_plain = 0.0, t_ctx = 0.0, t_tiled = 0.0;
+  struct timespec start, end;
+  sep_context *ctx[MAX_THREADS];
+
+  if (argc >= 3)
+  {
+    width = atoi(argv[1]);
+    height = atoi(argv[2]);
+  }
+  if (argc >= 4)
+    num_threads = atoi(argv[3]);
+  if ((width <= 0) || (height <= 0) || (num_threads <= 0) || (num_threads > MAX_THREADS))
+  {
+    fprintf(stderr, "Invalid arguments.\n");
+    return 2;
+  }
+
+  float *img = malloc(width*height*sizeof(float));
+  for (i=0; i<num_threads; i++)
+    ctx[i] = sep_context_new();
+  srand(12345);
+
+  for (frame=0; frame<NUM_FRAMES; frame++)
+  {
+    sepobj *obj_plain = NULL, *obj_ctx = NULL, *obj_tiled = NULL;
+    int num_plain = 0, num_ctx = 0, num_tiled = 0;
+    make_frame(img, width, height);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = sep_extract(img, NULL, SEP_TFLOAT, SEP_TFLOAT, 0, width, height, SKY_LEVEL+4.0*SKY_NOISE, 5, conv, 3, 3, 32, 0.005, 1, 1.0, &obj_plain, &num_plain);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_plain += elapsed_ms(&start, &end);
+    if (ret != 0)
+    {
+      fprintf(stderr, "sep_extract failed (%d)\n", ret);
+      return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = sep_extract_ctx(ctx[0], img, NULL, SEP_TFLOAT, SEP_TFLOAT, 0, width, height, SKY_LEVEL+4.0*SKY_NOISE, 5, conv, 3, 3, 32, 0.005, 1, 1.0, &obj_ctx, &num_ctx);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_ctx += elapsed_ms(&start, &end);
+    if (ret != 0)
+    {
+      fprintf(stderr, "sep_extract_ctx failed (%d)\n", ret);
+      return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = sep_extract_tiled(ctx, num_threads, img, NULL, SEP_TFLOAT, SEP_TFLOAT, 0, width, height, SKY_LEVEL+4.0*SKY_NOISE, 5, conv, 3, 3, 32, 0.005, 1, 1.0, &obj_tiled, &num_tiled);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    t_tiled += elapsed_ms(&start, &end);
+    if (ret != 0)
+    {
+      fprintf(stderr, "sep_extract_tiled failed (%d)\n", ret);
+      return 1;
+    }
+
+    int missing_ctx = count_missing(obj_plain, num_plain, obj_ctx, num_ctx) + count_missing(obj_ctx, num_ctx, obj_plain, num_plain);
+    int missing_tiled = count_missing(obj_plain, num_plain, obj_tiled, num_tiled) + count_missing(obj_tiled, num_tiled, obj_plain, num_plain);
+    if ((missing_ctx > 0) || (missing_tiled > 0))
+    {
+      printf("Frame %d: %d objects serial, %d with context, %d tiled (%d and %d unmatched)\n", frame, num_plain, num_ctx, num_tiled, missing_ctx, missing_tiled);
+      mismatch++;
+    }
+    sep_freeobjarray(obj_plain, num_plain);
+    sep_freeobjarray(obj_ctx, num_ctx);
+    sep_freeobjarray(obj_tiled, num_tiled);
+  }
+
+  printf("%dx%d pixels, %d frames, %d threads\n", width, height, NUM_FRAMES, num_threads);
+  printf("  sep_extract:        %8.2f ms/frame\n", t_plain / NUM_FRAMES);
+  printf("  sep_extract_ctx:    %8.2f ms/frame\n", t_ctx / NUM_FRAMES);
+  printf("  sep_extract_tiled:  %8.2f ms/frame\n", t_tiled / NUM_FRAMES);
+  printf("  %d frames with mismatched objects\n", mismatch);
+
+  for (i=0; i<num_threads; i++)
+    sep_context_free(ctx[i]);
+  free(img);
+  return mismatch > 0;
+}
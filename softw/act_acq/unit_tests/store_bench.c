@@ -0,0 +1,187 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra ./store_bench.c -lmysqlclient -lm -o ./store_bench
+ *
+ * Benchmarks storage of synthetic full-frame Merlin images in a (local) MySQL/MariaDB database, comparing the
+ * original one-row-per-pixel ccd_img_data insert with the single-row ccd_img_blob insert used by acq_store.
+ * The benchmark creates (and drops) its own scratch tables, so it should be run against a test database:
+ *   ./store_bench <host> <user> <database> [num_images]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <mysql/mysql.h>
+
+#define   WIDTH_PX     407
+#define   HEIGHT_PX    288
+#define   DEF_NUM_IMG  10
+
+int store_rows(MYSQL *conn, unsigned long img_id, float const *img_data);
+int store_blob(MYSQL *conn, unsigned long img_id, float const *img_data);
+double run_bench(MYSQL *conn, int (*store_func)(MYSQL *, unsigned long, float const *), float const *img_data, int num_img);
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    fprintf(stderr, "Usage: %s <host> <user> <database> [num_images]\n", argv[0]);
+    return 1;
+  }
+  int num_img = DEF_NUM_IMG;
+  if ((argc > 4) && ((sscanf(argv[4], "%d", &num_img) != 1) || (num_img <= 0)))
+  {
+    fprintf(stderr, "Invalid number of images specified (%s).\n", argv[4]);
+    return 1;
+  }
+
+  MYSQL *conn = mysql_init(NULL);
+  if (conn == NULL)
+  {
+    fprintf(stderr, "Error initialising MySQL connection handler.\n");
+    return 2;
+  }
+  if (mysql_real_connect(conn, argv[1], argv[2], NULL, argv[3], 0, NULL, 0) == NULL)
+  {
+    fprintf(stderr, "Error establishing connection to MySQL database - %s.\n", mysql_error(conn));
+    mysql_close(conn);
+    return 2;
+  }
+  if (mysql_query(conn, "CREATE TEMPORARY TABLE ccd_img_data (ccd_img_id INT UNSIGNED NOT NULL, x SMALLINT UNSIGNED NOT NULL, y SMALLINT UNSIGNED NOT NULL, value FLOAT NOT NULL);") ||
+      mysql_query(conn, "CREATE TEMPORARY TABLE ccd_img_blob (ccd_img_id INT UNSIGNED NOT NULL PRIMARY KEY, width SMALLINT UNSIGNED NOT NULL, height SMALLINT UNSIGNED NOT NULL, data LONGBLOB NOT NULL);"))
+  {
+    fprintf(stderr, "Failed to create scratch tables - %s.\n", mysql_error(conn));
+    mysql_close(conn);
+    return 2;
+  }
+
+  float *img_data = malloc(WIDTH_PX*HEIGHT_PX*sizeof(float));
+  int i;
+  srand(time(NULL));
+  for (i=0; i<WIDTH_PX*HEIGHT_PX; i++)
+    img_data[i] = 20.0 + (rand() % 200);
+
+  double rows_t = run_bench(conn, store_rows, img_data, num_img);
+  double blob_t = run_bench(conn, store_blob, img_data, num_img);
+  if ((rows_t > 0.0) && (blob_t > 0.0))
+  {
+    printf("%-10s %10s %12s\n", "method", "s/image", "images/s");
+    printf("%-10s %10.4f %12.3f\n", "rows", rows_t/num_img, num_img/rows_t);
+    printf("%-10s %10.4f %12.3f\n", "blob", blob_t/num_img, num_img/blob_t);
+  }
+
+  free(img_data);
+  mysql_close(conn);
+  return 0;
+}
+
+double run_bench(MYSQL *conn, int (*store_func)(MYSQL *, unsigned long, float const *), float const *img_data, int num_img)
+{
+  struct timespec start, end;
+  int i;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<num_img; i++)
+  {
+    mysql_query(conn, "START TRANSACTION;");
+    if (store_func(conn, i+1, img_data) != 0)
+    {
+      mysql_query(conn, "ROLLBACK;");
+      return -1.0;
+    }
+    mysql_query(conn, "COMMIT;");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/// Original acq_store method: one prepared statement execution per image row, three parameters per pixel.
+int store_rows(MYSQL *conn, unsigned long img_id, float const *img_data)
+{
+  char *qrystr = malloc(60 + 22*WIDTH_PX);
+  int len, j, i;
+  MYSQL_STMT *stmt = mysql_stmt_init(conn);
+  len = sprintf(qrystr, "INSERT INTO ccd_img_data (ccd_img_id, x, y, value) VALUES ");
+  for (j=0; j<WIDTH_PX; j++)
+    len += sprintf(&qrystr[len], "(%10lu, ?, ?, ?),", img_id);
+  qrystr[len-1] = ';';
+  if (mysql_stmt_prepare(stmt, qrystr, strlen(qrystr)))
+  {
+    fprintf(stderr, "Failed to prepare row insert statement - %s\n", mysql_stmt_error(stmt));
+    mysql_stmt_close(stmt);
+    free(qrystr);
+    return -1;
+  }
+  free(qrystr);
+
+  unsigned short cur_x[WIDTH_PX], cur_y[WIDTH_PX];
+  float cur_val[WIDTH_PX];
+  MYSQL_BIND bind[3*WIDTH_PX];
+  memset(bind, 0, sizeof(bind));
+  for (j=0; j<WIDTH_PX; j++)
+  {
+    bind[j*3+0].buffer_type = MYSQL_TYPE_SHORT;
+    bind[j*3+0].buffer = (char *)&cur_x[j];
+    bind[j*3+0].is_unsigned = 1;
+    bind[j*3+1].buffer_type = MYSQL_TYPE_SHORT;
+    bind[j*3+1].buffer = (char *)&cur_y[j];
+    bind[j*3+1].is_unsigned = 1;
+    bind[j*3+2].buffer_type = MYSQL_TYPE_FLOAT;
+    bind[j*3+2].buffer = (char *)&cur_val[j];
+    cur_x[j] = j;
+  }
+  mysql_stmt_bind_param(stmt, bind);
+  for (i=0; i<HEIGHT_PX; i++)
+  {
+    for (j=0; j<WIDTH_PX; j++)
+      cur_y[j] = i;
+    memcpy(cur_val, &img_data[i*WIDTH_PX], sizeof(cur_val));
+    if (mysql_stmt_execute(stmt))
+    {
+      fprintf(stderr, "Failed to insert image %lu row %d - %s\n", img_id, i, mysql_stmt_error(stmt));
+      mysql_stmt_close(stmt);
+      return -1;
+    }
+  }
+  mysql_stmt_close(stmt);
+  return 0;
+}
+
+/// Bulk method: the whole image in one ccd_img_blob row, single round trip.
+int store_blob(MYSQL *conn, unsigned long img_id, float const *img_data)
+{
+  const char qrystr[] = "INSERT INTO ccd_img_blob (ccd_img_id, width, height, data) VALUES (?, ?, ?, ?);";
+  MYSQL_STMT *stmt = mysql_stmt_init(conn);
+  if (mysql_stmt_prepare(stmt, qrystr, strlen(qrystr)))
+  {
+    fprintf(stderr, "Failed to prepare blob insert statement - %s\n", mysql_stmt_error(stmt));
+    mysql_stmt_close(stmt);
+    return -1;
+  }
+  unsigned int db_img_id = img_id;
+  unsigned short width = WIDTH_PX, height = HEIGHT_PX;
+  unsigned long data_len = WIDTH_PX*HEIGHT_PX*sizeof(float);
+  MYSQL_BIND bind[4];
+  memset(bind, 0, sizeof(bind));
+  bind[0].buffer_type = MYSQL_TYPE_LONG;
+  bind[0].buffer = (char *)&db_img_id;
+  bind[0].is_unsigned = 1;
+  bind[1].buffer_type = MYSQL_TYPE_SHORT;
+  bind[1].buffer = (char *)&width;
+  bind[1].is_unsigned = 1;
+  bind[2].buffer_type = MYSQL_TYPE_SHORT;
+  bind[2].buffer = (char *)&height;
+  bind[2].is_unsigned = 1;
+  bind[3].buffer_type = MYSQL_TYPE_LONG_BLOB;
+  bind[3].buffer = (char *)img_data;
+  bind[3].buffer_length = data_len;
+  bind[3].length = &data_len;
+  mysql_stmt_bind_param(stmt, bind);
+  if (mysql_stmt_execute(stmt))
+  {
+    fprintf(stderr, "Failed to insert image %lu blob - %s\n", img_id, mysql_stmt_error(stmt));
+    mysql_stmt_close(stmt);
+    return -1;
+  }
+  mysql_stmt_close(stmt);
+  return 0;
+}
@@ -40,6 +40,7 @@
 #include "net_targset.h"
 #include "net_genl.h"
 #include "net_basic.h"
+#include "net_bus.h"
 
 
 //! Main programme loop period.
@@ -73,6 +74,14 @@ int G_listen_sockfd;
 unsigned char G_status_active;
 //! Array of children managed by act_control.
 struct act_prog* G_progs;
+//! Dispatcher that receives messages from all children on a dedicated thread.
+struct net_dispatch *G_dispatch;
+//! Pipe through which the SIGCHLD handler wakes up the main loop.
+int G_sigchld_pipe[2];
+//! Time at which the programmes were launched at start-up (CLOCK_MONOTONIC), used to report the cold-start time.
+struct timespec G_startup_time;
+//! TRUE until all programmes launched at start-up have connected.
+char G_startup_pending;
 
 
 gboolean reg_check_close(gpointer user_data)
@@ -237,6 +246,7 @@ void add_prog(GtkWidget *btn_add_prog, gpointer user_data)
   struct act_prog *new_prog = malloc(sizeof(struct act_prog));
   memset(new_prog, 0, sizeof(struct act_prog));
   new_prog->listen_sockfd = &G_listen_sockfd;
+  new_prog->dispatch = G_dispatch;
   new_prog->hostname = G_hostname;
   new_prog->portname = G_portname;
   new_prog->sqlconfighost = G_sqlserver;
@@ -299,27 +309,57 @@ void add_prog(GtkWidget *btn_add_prog, gpointer user_data)
  *
  * \param signum
  *   Signal number of received system signal
+ *
+ * \return (void)
+ *
+ * Only wakes up the main loop through G_sigchld_pipe - exited children are dealt with by check_children, which
+ * must not be called from a signal handler since it restarts programmes and updates the GUI.
+ */
+void process_sigchld(int signum)
+{
+  if (signum != SIGCHLD)
+    return;
+  int saved_errno = errno;
+  char wake = 0;
+  // if the pipe is full, a wake-up is already pending
+  if (write(G_sigchld_pipe[1], &wake, 1) < 0)
+    wake = 1;
+  errno = saved_errno;
+}
+
+/** \brief Deal with subprogrammes that have exited.
  *
  * \return (void)
  *
  * Algorithm:
- *   -# Process only SIGCHLD, return otherwise.
  *   -# Step through global list of subprogrammes.
+ *     -# Reap processes that were killed (see prog_kill).
+ *     -# Programmes that exited before connecting are reported and not restarted.
  *     -# Ignore subprogrammes that exited normally.
  *     -# Ignore subprogrammes that are still running.
  *     -# All programmes that remain must be restarted.
  *     -# If the restarted subprogramme was processing a stage of an observation, re-send the
  *        observation message.
  */
-void process_sigchld(int signum)
+void check_children(void)
 {
-  if (signum != SIGCHLD)
-    return;
   int i;
 
   act_log_debug(act_log_msg("Processing SIGCHLD"));
   for (i=0; i<G_num_progs; i++)
   {
+    // a killed process is reaped here, since its programme is no longer waited for below
+    if ((G_progs[i].reap_pid > 0) && (waitpid(G_progs[i].reap_pid, NULL, WNOHANG) != 0))
+      G_progs[i].reap_pid = 0;
+    if (G_progs[i].launching)
+    {
+      if (waitpid(G_progs[i].pid, NULL, WNOHANG) == 0)
+        continue;
+      act_log_error(act_log_msg("Programme %s exited before connecting.", G_progs[i].name));
+      G_progs[i].launching = FALSE;
+      G_progs[i].pid = 0;
+      continue;
+    }
     if ((G_progs[i].status == PROGSTAT_STOPPED) || (G_progs[i].status == PROGSTAT_KILLED))
       continue;
     if (waitpid(G_progs[i].pid, NULL, WNOHANG) == 0)
@@ -327,24 +367,75 @@ void process_sigchld(int signum)
     if (G_progs[i].status == PROGSTAT_STOPPING)
     {
       prog_set_status(&G_progs[i], PROGSTAT_STOPPED);
-      return;
+      continue;
     }
 
     act_log_error(act_log_msg("Programme %s has died. Attempting to restart", G_progs[i].name));
     prog_set_status(&G_progs[i], PROGSTAT_KILLED);
-    G_progs[i].sockfd = 0;
+    act_disconnect(&G_progs[i]);
     G_progs[i].pid = 0;
-    if ((!start_prog(&G_progs[i])) < 0)
+    if (!start_prog(&G_progs[i]))
       act_log_error(act_log_msg("Failed to start %s.", G_progs[i].name));
-    return;
   }
 }
 
-void process_sigio(int signum)
+gboolean sigchld_ready(GIOChannel *source, GIOCondition condition, gpointer user_data)
 {
-  if (signum != SIGIO)
-    return;
-  check_prog_messages(G_progs, G_num_progs);
+  (void) source;
+  (void) condition;
+  (void) user_data;
+  char buf[32];
+  while (read(G_sigchld_pipe[0], buf, sizeof(buf)) > 0);
+  check_children();
+  return TRUE;
+}
+
+/** \brief Accept connections from subprogrammes when the listen socket becomes readable.
+ *
+ * Also reports how long it took all programmes launched at start-up to connect.
+ */
+gboolean listen_ready(GIOChannel *source, GIOCondition condition, gpointer user_data)
+{
+  (void) source;
+  (void) user_data;
+  int i;
+  if (G_listen_sockfd <= 0)
+    return FALSE;
+  if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL))
+  {
+    act_log_error(act_log_msg("Error on listen socket. No more programmes can connect."));
+    return FALSE;
+  }
+  if ((accept_progs(G_listen_sockfd, G_progs, G_num_progs) == 0) || (!G_startup_pending))
+    return TRUE;
+  for (i=0; i<G_num_progs; i++)
+  {
+    if (G_progs[i].launching)
+      return TRUE;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  act_log_normal(act_log_msg("All programmes connected %.2f s after start-up.", (now.tv_sec - G_startup_time.tv_sec) + (now.tv_nsec - G_startup_time.tv_nsec)/1.0e9));
+  G_startup_pending = FALSE;
+  return TRUE;
+}
+
+gboolean bus_flush_timeout(gpointer user_data)
+{
+  (void) user_data;
+  bus_flush(G_progs, G_num_progs);
+  return TRUE;
+}
+
+/** \brief Process messages from subprogrammes when the dispatcher signals that messages are waiting.
+ */
+gboolean dispatch_ready(GIOChannel *source, GIOCondition condition, gpointer user_data)
+{
+  (void) source;
+  (void) condition;
+  (void) user_data;
+  check_prog_messages(G_dispatch, G_progs, G_num_progs);
+  return TRUE;
 }
 
 void check_status(struct act_prog *prog)
@@ -357,8 +448,8 @@ void check_status(struct act_prog *prog)
   {
     act_log_normal(act_log_msg("No messages received from %s in %d seconds. Restarting %s.", prog->name, prog->last_stat_timer/1000, prog->name));
     prog_set_status(prog, PROGSTAT_KILLED);
-    close(prog->sockfd);
-    kill(prog->pid, SIGTERM);
+    act_disconnect(prog);
+    prog_kill(prog);
     start_prog(prog);
   }
   else if (prog->last_stat_timer > STAT_REQ_TIMEOUT_MS)
@@ -371,6 +462,7 @@ gboolean reg_checks()
   for (i=0; i<G_num_progs; i++)
   {
 //     check_active_change(&G_progs[i], G_status_active);
+    prog_check_launch(&G_progs[i]);
     check_status(&G_progs[i]);
   }
   return TRUE;
@@ -435,10 +527,17 @@ int main(int argc, char** argv)
   }
   G_status_active = 0;
   act_log_normal(act_log_msg("ACT control listening on port %s (host %s).", G_portname, G_hostname));
+  G_dispatch = net_dispatch_new();
+  if (G_dispatch == NULL)
+  {
+    act_log_error(act_log_msg("Could not start network message dispatcher. Exiting."));
+    return 1;
+  }
 
   init_targcap();
   init_pmtcap();
   init_ccdcap();
+  init_bus();
 
   // GUI stuff
   GtkWidget* wnd_main = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -482,6 +581,7 @@ int main(int argc, char** argv)
   else for (i=0; i<G_num_progs; i++)
   {
     G_progs[i].listen_sockfd = &G_listen_sockfd;
+    G_progs[i].dispatch = G_dispatch;
     G_progs[i].hostname = G_hostname;
     G_progs[i].portname = G_portname;
     G_progs[i].sqlconfighost = G_sqlserver;
@@ -492,26 +592,48 @@ int main(int argc, char** argv)
     g_signal_connect(G_OBJECT(G_progs[i].button),"clicked",G_CALLBACK(prog_button), &G_progs[i]);
 
     G_progs[i].sockfd = 0;
+    G_progs[i].conn = NULL;
     G_progs[i].pid = 0;
+    G_progs[i].reap_pid = 0;
+    G_progs[i].launching = FALSE;
     G_progs[i].status = PROGSTAT_STOPPED;
     memset(&G_progs[i].caps, 0, sizeof(struct act_msg_cap));
   }
 
+  if (pipe(G_sigchld_pipe) != 0)
+  {
+    act_log_error(act_log_msg("Could not create pipe for child exit notifications - %s.", strerror(errno)));
+    return 1;
+  }
+  for (i=0; i<2; i++)
+  {
+    fcntl(G_sigchld_pipe[i], F_SETFL, fcntl(G_sigchld_pipe[i], F_GETFL) | O_NONBLOCK);
+    fcntl(G_sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+  }
+  GIOChannel *sigchld_chan = g_io_channel_unix_new(G_sigchld_pipe[0]);
+  g_io_add_watch(sigchld_chan, G_IO_IN, sigchld_ready, NULL);
+  GIOChannel *listen_chan = g_io_channel_unix_new(G_listen_sockfd);
+  g_io_add_watch(listen_chan, G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL, listen_ready, NULL);
+  GIOChannel *dispatch_chan = g_io_channel_unix_new(net_dispatch_get_notify_fd(G_dispatch));
+  g_io_add_watch(dispatch_chan, G_IO_IN, dispatch_ready, NULL);
+
   signal(SIGCHLD, process_sigchld);
-  signal(SIGIO, process_sigio);
   signal(SIGPIPE, SIG_IGN);
 
-  // Start all sub-programs
+  // Launch all sub-programs - they connect in parallel and are accepted from the main loop (see listen_ready)
+  clock_gettime(CLOCK_MONOTONIC, &G_startup_time);
+  G_startup_pending = FALSE;
   for (i=0; i<G_num_progs; i++)
   {
     if (G_progs[i].active_time != (ACTIVE_TIME_DAY | ACTIVE_TIME_NIGHT))
       continue;
-    if (!start_prog(&G_progs[i]) < 0)
+    if (!start_prog(&G_progs[i]))
     {
       act_log_error(act_log_msg("Error starting programme %s.", G_progs[i].name));
       continue;
     }
-    act_log_normal(act_log_msg("Programme %s successfully started.", G_progs[i].name));
+    act_log_normal(act_log_msg("Programme %s launched.", G_progs[i].name));
+    G_startup_pending = TRUE;
   }
 
   act_log_normal(act_log_msg("Ready. Starting main loop."));
@@ -520,12 +642,14 @@ int main(int argc, char** argv)
     timeout_id = g_timeout_add_seconds(TIMEOUT_PERIOD_MS/1000, reg_checks, NULL);
   else
     timeout_id = g_timeout_add(TIMEOUT_PERIOD_MS, reg_checks, NULL);
+  g_timeout_add(BUS_FLUSH_PERIOD_MS, bus_flush_timeout, NULL);
   g_signal_connect(G_OBJECT(btn_add_prog),"clicked",G_CALLBACK(add_prog), &addprog_objs);
   g_signal_connect(G_OBJECT(btn_quit),"clicked",G_CALLBACK(quit_pressed), (void *)timeout_id);
   g_signal_connect(G_OBJECT(wnd_main),"delete-event",G_CALLBACK(window_close), (void *)timeout_id);
   gtk_widget_show_all(wnd_main);
   gtk_main();
 
+  net_dispatch_free(G_dispatch);
   act_log_normal(act_log_msg("Done. Exiting."));
   act_log_close();
   return 0;
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
@@ -9,6 +10,7 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/wait.h>
+#include <dirent.h>
 
 #include <act_log.h>
 #include <act_ipc.h>
@@ -21,6 +23,8 @@
  * \param prog The programme to which to send the message
  * \param msg The message to send
  * \return TRUE on success, FALSE on error
+ *
+ * Does not block - if the programme is not reading fast enough, the message is queued by the dispatcher.
  */
 unsigned char act_send(struct act_prog *prog, struct act_msg *msg)
 {
@@ -29,35 +33,27 @@ unsigned char act_send(struct act_prog *prog, struct act_msg *msg)
     act_log_error(act_log_msg("Invalid input parameters."));
     return FALSE;
   }
-  if (send(prog->sockfd, msg, sizeof(struct act_msg), 0) == sizeof(struct act_msg))
+  if (prog->conn == NULL)
+  {
+    act_log_error(act_log_msg("Cannot send message to %s - not connected.", prog->name));
+    return FALSE;
+  }
+  if (net_dispatch_send(prog->dispatch, prog->conn, msg) > 0)
     return TRUE;
   act_log_error(act_log_msg("Error sending message to %s (fd %d) - %s.", prog->name, prog->sockfd, strerror(errno)));
   return FALSE;
 }
 
-/** \brief Receive a network message from a programme
- * \param prog The programme from which to receive message
- * \param msg The message structure where the new message will be copied
- * \return TRUE if a message was received, FALSE otherwise
+/** \brief Close the network connection to a programme
+ * \param prog The programme
+ * \return (void)
  */
-unsigned char act_recv(struct act_prog *prog, struct act_msg *msg)
+void act_disconnect(struct act_prog *prog)
 {
-  if ((prog == NULL) || (msg == NULL))
-  {
-    act_log_error(act_log_msg("Invalid input parameters."));
-    return FALSE;
-  }
-  struct act_msg msgbuf;
-  int numbytes;
-  numbytes = recv(prog->sockfd, &msgbuf, sizeof(struct act_msg), MSG_DONTWAIT);
-  if (numbytes == sizeof(struct act_msg))
-  {
-    memcpy(msg, &msgbuf, sizeof(struct act_msg));
-    return TRUE;
-  }
-  if ((numbytes == -1) && (abs(errno) != EAGAIN))
-    act_log_error(act_log_msg("Error receiving message from %s (fd %d) - %s.", prog->name, prog->sockfd, strerror(errno)));
-  return FALSE;
+  if (prog->conn != NULL)
+    net_dispatch_remove(prog->dispatch, prog->conn);
+  prog->conn = NULL;
+  prog->sockfd = 0;
 }
 
 int net_setup(const char *port)
@@ -104,5 +100,95 @@ int net_setup(const char *port)
   
   retval = fcntl(sockfd, F_GETFL, 0);
   fcntl(sockfd, F_SETFL, retval | O_NONBLOCK);
+  // don't let subprogrammes inherit the listen socket
+  fcntl(sockfd, F_SETFD, FD_CLOEXEC);
   return sockfd;
 }
+
+/** \brief Find the socket at the other end of a local TCP connection
+ * \param sockfd An accepted connection
+ * \return Inode number of the peer's socket, 0 if it could not be found (e.g. the peer is on another host)
+ *
+ * Looks up the connection in the kernel's TCP tables. The peer's socket is the one whose local port is the port the
+ * connection came from and whose remote port is the port the connection was accepted on.
+ */
+unsigned long net_peer_inode(int sockfd)
+{
+  struct sockaddr_storage peer_addr, local_addr;
+  socklen_t addr_len;
+  unsigned int peer_port, local_port;
+  const char *tables[] = { "/proc/net/tcp", "/proc/net/tcp6" };
+  char line[256];
+  unsigned long inode = 0;
+  int i;
+
+  addr_len = sizeof(peer_addr);
+  if (getpeername(sockfd, (struct sockaddr *)&peer_addr, &addr_len) != 0)
+    return 0;
+  addr_len = sizeof(local_addr);
+  if (getsockname(sockfd, (struct sockaddr *)&local_addr, &addr_len) != 0)
+    return 0;
+  if ((peer_addr.ss_family == AF_INET) && (local_addr.ss_family == AF_INET))
+  {
+    peer_port = ntohs(((struct sockaddr_in *)&peer_addr)->sin_port);
+    local_port = ntohs(((struct sockaddr_in *)&local_addr)->sin_port);
+  }
+  else if ((peer_addr.ss_family == AF_INET6) && (local_addr.ss_family == AF_INET6))
+  {
+    peer_port = ntohs(((struct sockaddr_in6 *)&peer_addr)->sin6_port);
+    local_port = ntohs(((struct sockaddr_in6 *)&local_addr)->sin6_port);
+  }
+  else
+    return 0;
+
+  // an IPv4 client may have connected to an IPv6 listen socket, so check both tables
+  for (i=0; (i<2) && (inode == 0); i++)
+  {
+    FILE *fp = fopen(tables[i], "r");
+    if (fp == NULL)
+      continue;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+      unsigned int line_local_port, line_rem_port;
+      unsigned long line_inode;
+      if (sscanf(line, " %*d: %*[0-9A-Fa-f]:%x %*[0-9A-Fa-f]:%x %*x %*s %*s %*s %*d %*d %lu", &line_local_port, &line_rem_port, &line_inode) != 3)
+        continue;
+      if ((line_local_port == peer_port) && (line_rem_port == local_port) && (line_inode != 0))
+      {
+        inode = line_inode;
+        break;
+      }
+    }
+    fclose(fp);
+  }
+  return inode;
+}
+
+/** \brief Check whether a process has a given socket open
+ * \param pid Process identifier
+ * \param inode Inode number of the socket (see net_peer_inode)
+ * \return TRUE if one of the process's file descriptors refers to the socket, FALSE otherwise
+ */
+char net_pid_has_socket(int pid, unsigned long inode)
+{
+  char path[64], link[64], sock_name[64];
+  struct dirent *entry;
+  char found = FALSE;
+  snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+  snprintf(sock_name, sizeof(sock_name), "socket:[%lu]", inode);
+  DIR *dir = opendir(path);
+  if (dir == NULL)
+    return FALSE;
+  while ((!found) && ((entry = readdir(dir)) != NULL))
+  {
+    char fd_path[sizeof(path) + 256];
+    snprintf(fd_path, sizeof(fd_path), "%s/%s", path, entry->d_name);
+    ssize_t len = readlink(fd_path, link, sizeof(link)-1);
+    if (len <= 0)
+      continue;
+    link[len] = '\0';
+    found = strcmp(link, sock_name) == 0;
+  }
+  closedir(dir);
+  return found;
+}
@@ -5,7 +5,9 @@
 #include "subprogrammes.h"
 
 unsigned char act_send(struct act_prog *prog, struct act_msg *msg);
-unsigned char act_recv(struct act_prog *prog, struct act_msg *msg);
+void act_disconnect(struct act_prog *prog);
 int net_setup(const char *port);
+unsigned long net_peer_inode(int sockfd);
+char net_pid_has_socket(int pid, unsigned long inode);
 
 #endif
@@ -0,0 +1,210 @@
+#include <string.h>
+#include <act_log.h>
+#include <act_ipc.h>
+#include "net_bus.h"
+#include "net_basic.h"
+#include "subprogrammes.h"
+
+/** \brief Services distributed through the bus, indexed by the bit number of their SERVICE_* flag.
+ *
+ * Time and coordinates are coalesced - a subscriber that is behind only ever gets the latest update - and only go to
+ * programmes that are running or starting up. Environment updates are queued (up to BUS_MAILBOX_LEN), since each may
+ * carry a change in the active time, and go to every connected programme that needs them, whatever its status.
+ */
+static const struct
+{
+  int mtype;
+  unsigned int flag;
+  char coalesce;
+  char running_only;
+} G_bus_services[NUM_SERVICES] =
+{
+  [SERVICE_IDX_TIME] = { MT_TIME, SERVICE_TIME, TRUE, TRUE },
+  [SERVICE_IDX_COORD] = { MT_COORD, SERVICE_COORD, TRUE, TRUE },
+  [SERVICE_IDX_ENVIRON] = { MT_ENVIRON, SERVICE_ENVIRON, FALSE, FALSE }
+};
+
+//! Latest update published for each service, given to programmes when they subscribe
+static struct act_msg G_bus_latest[NUM_SERVICES];
+static char G_bus_have_latest[NUM_SERVICES];
+
+void init_bus()
+{
+  memset(G_bus_latest, 0, sizeof(G_bus_latest));
+  memset(G_bus_have_latest, 0, sizeof(G_bus_have_latest));
+}
+
+static int service_index(int mtype)
+{
+  int i;
+  for (i=0; i<NUM_SERVICES; i++)
+  {
+    if (G_bus_services[i].mtype == mtype)
+      return i;
+  }
+  return -1;
+}
+
+static char is_subscriber(struct act_prog *prog, int service)
+{
+  if ((prog->caps.service_needs & G_bus_services[service].flag) == 0)
+    return FALSE;
+  if ((prog->conn == NULL) || (!net_dispatch_connected(prog->conn)))
+    return FALSE;
+  if (!G_bus_services[service].running_only)
+    return TRUE;
+  return (prog->status == PROGSTAT_RUNNING) || (prog->status == PROGSTAT_STARTUP);
+}
+
+static void mailbox_post(struct bus_mailbox *box, struct act_msg *msg, char coalesce)
+{
+  if ((coalesce) && (box->len > 0))
+  {
+    memcpy(&box->msgs[box->head], msg, sizeof(struct act_msg));
+    box->num_coalesced++;
+    return;
+  }
+  if (box->len == BUS_MAILBOX_LEN)
+  {
+    box->head = (box->head + 1) % BUS_MAILBOX_LEN;
+    box->len--;
+    box->num_dropped++;
+  }
+  memcpy(&box->msgs[(box->head + box->len) % BUS_MAILBOX_LEN], msg, sizeof(struct act_msg));
+  box->len++;
+}
+
+/** \brief Send waiting updates of a service to a subscriber, as far as the subscriber is keeping up.
+ *
+ * Nothing is sent while earlier messages to the subscriber are still waiting in its write queue, or sooner than
+ * its declared maximum rate allows. Whatever is not sent stays in the mailbox, where newer updates replace it.
+ */
+static void deliver(struct act_prog *prog, int service, struct timespec *now)
+{
+  struct bus_mailbox *box = &prog->bus_boxes[service];
+  float max_rate = prog->caps.service_max_rate[service];
+  while (box->len > 0)
+  {
+    if (net_dispatch_tx_pending(prog->conn) > 0)
+      return;
+    if ((max_rate > 0.0) && ((now->tv_sec - box->last_delivery.tv_sec) + (now->tv_nsec - box->last_delivery.tv_nsec)/1.0e9 < 1.0/max_rate))
+      return;
+    if (act_send(prog, &box->msgs[box->head]))
+    {
+      box->num_delivered++;
+      box->last_delivery = *now;
+    }
+    else
+      box->num_dropped++;
+    box->head = (box->head + 1) % BUS_MAILBOX_LEN;
+    box->len--;
+  }
+}
+
+/** \brief Start delivering services to a programme, according to its capabilities message.
+ * \param prog The programme, after its capabilities have been received.
+ * \return (void)
+ *
+ * The programme's mailboxes are emptied and the latest update of each service it needs is queued for it, so that it
+ * does not have to wait for the next update.
+ */
+void bus_subscribe(struct act_prog *prog)
+{
+  if (prog == NULL)
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return;
+  }
+  int i;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  memset(prog->bus_boxes, 0, sizeof(prog->bus_boxes));
+  for (i=0; i<NUM_SERVICES; i++)
+  {
+    if ((!G_bus_have_latest[i]) || (!is_subscriber(prog, i)))
+      continue;
+    mailbox_post(&prog->bus_boxes[i], &G_bus_latest[i], G_bus_services[i].coalesce);
+    deliver(prog, i, &now);
+  }
+}
+
+/** \brief Publish an update of a service (MT_TIME, MT_COORD or MT_ENVIRON message) to all programmes that need it.
+ * \param prog_array Array of all programmes.
+ * \param num_progs Number of elements in prog_array.
+ * \param msg The update.
+ * \return (void)
+ *
+ * Never blocks - the update is sent immediately to subscribers that are keeping up and queued in the mailboxes of
+ * the others (see bus_flush).
+ */
+void bus_publish(struct act_prog *prog_array, int num_progs, struct act_msg *msg)
+{
+  if ((prog_array == NULL) || (msg == NULL))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return;
+  }
+  int i, service = service_index(msg->mtype);
+  if (service < 0)
+  {
+    act_log_error(act_log_msg("Message type %d is not a service.", msg->mtype));
+    return;
+  }
+  memcpy(&G_bus_latest[service], msg, sizeof(struct act_msg));
+  G_bus_have_latest[service] = TRUE;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (i=0; i<num_progs; i++)
+  {
+    if (!is_subscriber(&prog_array[i], service))
+      continue;
+    mailbox_post(&prog_array[i].bus_boxes[service], msg, G_bus_services[service].coalesce);
+    deliver(&prog_array[i], service, &now);
+  }
+}
+
+/** \brief Deliver updates that could not be sent when they were published.
+ * \param prog_array Array of all programmes.
+ * \param num_progs Number of elements in prog_array.
+ * \return (void)
+ *
+ * Called every BUS_FLUSH_PERIOD_MS from the main loop.
+ */
+void bus_flush(struct act_prog *prog_array, int num_progs)
+{
+  if ((prog_array == NULL) && (num_progs > 0))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return;
+  }
+  int i, service;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (i=0; i<num_progs; i++)
+  {
+    for (service=0; service<NUM_SERVICES; service++)
+    {
+      struct bus_mailbox *box = &prog_array[i].bus_boxes[service];
+      if (box->len == 0)
+        continue;
+      if (is_subscriber(&prog_array[i], service))
+        deliver(&prog_array[i], service, &now);
+      else
+        box->len = 0;
+    }
+  }
+}
+
+/** \brief Get a programme's bus counters, summed over all services.
+ */
+void bus_get_counters(struct act_prog *prog, unsigned long *num_delivered, unsigned long *num_coalesced, unsigned long *num_dropped)
+{
+  int i;
+  *num_delivered = *num_coalesced = *num_dropped = 0;
+  for (i=0; i<NUM_SERVICES; i++)
+  {
+    *num_delivered += prog->bus_boxes[i].num_delivered;
+    *num_coalesced += prog->bus_boxes[i].num_coalesced;
+    *num_dropped += prog->bus_boxes[i].num_dropped;
+  }
+}
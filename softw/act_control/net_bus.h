@@ -0,0 +1,35 @@
+#ifndef NET_BUS_H
+#define NET_BUS_H
+
+#include <time.h>
+#include <act_ipc.h>
+
+//! Number of updates of a non-coalesced service (MT_ENVIRON) that can wait for a subscriber
+#define BUS_MAILBOX_LEN      4
+//! Period with which mailboxes are checked for updates that could not be delivered immediately
+#define BUS_FLUSH_PERIOD_MS  50
+
+struct act_prog;
+
+/** \brief Updates of one service waiting to be delivered to one subscriber.
+ *
+ * For coalesced services (time and coordinates) only the latest update is kept. Other services keep up to
+ * BUS_MAILBOX_LEN updates, dropping the oldest when full.
+ */
+struct bus_mailbox
+{
+  struct act_msg msgs[BUS_MAILBOX_LEN];
+  unsigned char head, len;
+  //! Time of the last delivery (CLOCK_MONOTONIC), used to enforce the subscriber's maximum rate
+  struct timespec last_delivery;
+  //! Number of updates sent, replaced by a newer update before they could be sent, and discarded
+  unsigned long num_delivered, num_coalesced, num_dropped;
+};
+
+void init_bus();
+void bus_subscribe(struct act_prog *prog);
+void bus_publish(struct act_prog *prog_array, int num_progs, struct act_msg *msg);
+void bus_flush(struct act_prog *prog_array, int num_progs);
+void bus_get_counters(struct act_prog *prog, unsigned long *num_delivered, unsigned long *num_coalesced, unsigned long *num_dropped);
+
+#endif
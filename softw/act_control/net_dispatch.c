@@ -0,0 +1,520 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <act_log.h>
+#include <act_ipc.h>
+#include "net_dispatch.h"
+
+//! Maximum number of epoll events handled per wake-up of the dispatch thread
+#define MAX_EVENTS            32
+//! Maximum number of reads from one connection per wake-up, so that a flooding programme cannot starve the others
+#define MAX_READS_PER_EVENT   8
+
+static void *dispatch_thread(void *disp_data);
+
+/** \brief Increment an eventfd counter, making it readable.
+ */
+static void wake(int fd)
+{
+  uint64_t one = 1;
+  // fails only if the counter is saturated, in which case the reader is already awake
+  ssize_t ret = write(fd, &one, sizeof(one));
+  (void) ret;
+}
+
+static void conn_free(struct net_conn *conn)
+{
+  pthread_mutex_destroy(&conn->mutex);
+  free(conn->tx_buf);
+  free(conn);
+}
+
+/** \brief Create a dispatcher and start its thread.
+ * \return The new dispatcher, or NULL on error.
+ */
+struct net_dispatch *net_dispatch_new(void)
+{
+  struct epoll_event ev;
+  struct net_dispatch *disp = calloc(1, sizeof(struct net_dispatch));
+  if (disp == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for message dispatcher."));
+    return NULL;
+  }
+  disp->ring = calloc(NET_DISPATCH_RING_LEN, sizeof(struct net_dispatch_item));
+  disp->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  disp->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  disp->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if ((disp->ring == NULL) || (disp->epoll_fd < 0) || (disp->wake_fd < 0) || (disp->notify_fd < 0) || (epoll_ctl(disp->epoll_fd, EPOLL_CTL_ADD, disp->wake_fd, &ev) != 0))
+  {
+    act_log_error(act_log_msg("Failed to set up message dispatcher - %s.", strerror(errno)));
+    goto fail;
+  }
+  pthread_mutex_init(&disp->mutex, NULL);
+  pthread_mutex_init(&disp->ring_mutex, NULL);
+  pthread_cond_init(&disp->ring_space, NULL);
+  disp->next_id = 1;
+  if (pthread_create(&disp->thr, NULL, dispatch_thread, disp) != 0)
+  {
+    act_log_error(act_log_msg("Failed to start message dispatch thread."));
+    pthread_mutex_destroy(&disp->mutex);
+    pthread_mutex_destroy(&disp->ring_mutex);
+    pthread_cond_destroy(&disp->ring_space);
+    goto fail;
+  }
+  return disp;
+
+  fail:
+  if (disp->epoll_fd >= 0)
+    close(disp->epoll_fd);
+  if (disp->wake_fd >= 0)
+    close(disp->wake_fd);
+  if (disp->notify_fd >= 0)
+    close(disp->notify_fd);
+  free(disp->ring);
+  free(disp);
+  return NULL;
+}
+
+/** \brief Stop the dispatch thread, close all connections and free the dispatcher.
+ */
+void net_dispatch_free(struct net_dispatch *disp)
+{
+  if (disp == NULL)
+    return;
+  __atomic_store_n(&disp->exiting, 1, __ATOMIC_RELEASE);
+  // the dispatch thread may be waiting for space in the ring
+  pthread_mutex_lock(&disp->ring_mutex);
+  pthread_cond_broadcast(&disp->ring_space);
+  pthread_mutex_unlock(&disp->ring_mutex);
+  wake(disp->wake_fd);
+  pthread_join(disp->thr, NULL);
+  while (disp->conns != NULL)
+  {
+    struct net_conn *conn = disp->conns;
+    disp->conns = conn->next;
+    close(conn->sockfd);
+    conn_free(conn);
+  }
+  close(disp->epoll_fd);
+  close(disp->wake_fd);
+  close(disp->notify_fd);
+  pthread_mutex_destroy(&disp->mutex);
+  pthread_mutex_destroy(&disp->ring_mutex);
+  pthread_cond_destroy(&disp->ring_space);
+  free(disp->ring);
+  free(disp);
+}
+
+/** \brief Hand a connected socket to the dispatcher.
+ * \param disp The dispatcher.
+ * \param sockfd Socket of the connection. The dispatcher closes it when the connection is removed.
+ * \return The new connection, or NULL on error (the socket is then left open).
+ */
+struct net_conn *net_dispatch_add(struct net_dispatch *disp, int sockfd)
+{
+  struct epoll_event ev;
+  struct net_conn *conn = calloc(1, sizeof(struct net_conn));
+  if (conn == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for connection on socket %d.", sockfd));
+    return NULL;
+  }
+  conn->sockfd = sockfd;
+  act_msg_rx_init(&conn->rx);
+  pthread_mutex_init(&conn->mutex, NULL);
+  fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK);
+
+  pthread_mutex_lock(&disp->mutex);
+  conn->id = disp->next_id++;
+  if (disp->next_id == 0)
+    disp->next_id = 1;
+  conn->next = disp->conns;
+  disp->conns = conn;
+  pthread_mutex_unlock(&disp->mutex);
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.ptr = conn;
+  if (epoll_ctl(disp->epoll_fd, EPOLL_CTL_ADD, sockfd, &ev) == 0)
+    return conn;
+
+  act_log_error(act_log_msg("Failed to add socket %d to message dispatcher - %s.", sockfd, strerror(errno)));
+  // the dispatch thread has never seen this connection, so it can be unlinked and freed right away
+  pthread_mutex_lock(&disp->mutex);
+  struct net_conn **link = &disp->conns;
+  while (*link != conn)
+    link = &(*link)->next;
+  *link = conn->next;
+  pthread_mutex_unlock(&disp->mutex);
+  conn_free(conn);
+  return NULL;
+}
+
+/** \brief Close a connection.
+ *
+ * The connection is closed and freed by the dispatch thread, so conn must not be used after this call. Messages
+ * already received on it may still be passed to the handler in net_dispatch_process.
+ */
+void net_dispatch_remove(struct net_dispatch *disp, struct net_conn *conn)
+{
+  pthread_mutex_lock(&disp->mutex);
+  conn->removed = 1;
+  pthread_mutex_unlock(&disp->mutex);
+  wake(disp->wake_fd);
+}
+
+/** \brief Send a message on a connection without blocking.
+ * \return Number of bytes in the message frame, or -1 on error (errno is ENOBUFS if too much is waiting to be sent
+ *         to this connection already).
+ *
+ * The frame is written immediately if nothing else is waiting to be sent on the connection. Whatever cannot be
+ * written is queued and sent by the dispatch thread once the peer has read enough.
+ */
+int net_dispatch_send(struct net_dispatch *disp, struct net_conn *conn, struct act_msg *msg)
+{
+  char frame[ACT_MSG_MAX_FRAME];
+  int frame_len, num_sent = 0;
+
+  pthread_mutex_lock(&conn->mutex);
+  if ((conn->closed) || (conn->hangup))
+  {
+    pthread_mutex_unlock(&conn->mutex);
+    errno = EPIPE;
+    return -1;
+  }
+  frame_len = act_msg_frame(msg, conn->tx_seq, frame);
+  if (frame_len == 0)
+  {
+    pthread_mutex_unlock(&conn->mutex);
+    errno = EINVAL;
+    return -1;
+  }
+  if (conn->tx_len == 0)
+  {
+    num_sent = send(conn->sockfd, frame, frame_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (num_sent < 0)
+    {
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+      {
+        pthread_mutex_unlock(&conn->mutex);
+        return -1;
+      }
+      num_sent = 0;
+    }
+  }
+  if (num_sent < frame_len)
+  {
+    unsigned int remaining = frame_len - num_sent;
+    // the rest of a partially sent frame must always be queued, otherwise the stream is corrupted
+    if ((num_sent == 0) && (conn->tx_len + remaining > NET_DISPATCH_TX_MAX))
+    {
+      pthread_mutex_unlock(&conn->mutex);
+      errno = ENOBUFS;
+      return -1;
+    }
+    if (conn->tx_len + remaining > conn->tx_size)
+    {
+      unsigned int new_size = conn->tx_size > 0 ? conn->tx_size*2 : 4*ACT_MSG_MAX_FRAME;
+      while (new_size < conn->tx_len + remaining)
+        new_size *= 2;
+      char *new_buf = realloc(conn->tx_buf, new_size);
+      if (new_buf == NULL)
+      {
+        pthread_mutex_unlock(&conn->mutex);
+        errno = ENOMEM;
+        return -1;
+      }
+      conn->tx_buf = new_buf;
+      conn->tx_size = new_size;
+    }
+    memcpy(&conn->tx_buf[conn->tx_len], &frame[num_sent], remaining);
+    if (conn->tx_len == 0)
+    {
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+      ev.data.ptr = conn;
+      epoll_ctl(disp->epoll_fd, EPOLL_CTL_MOD, conn->sockfd, &ev);
+    }
+    conn->tx_len += remaining;
+  }
+  conn->tx_seq++;
+  pthread_mutex_unlock(&conn->mutex);
+  return frame_len;
+}
+
+/** \brief Number of bytes waiting to be sent on a connection.
+ *
+ * Non-zero means the peer is not keeping up with what is sent to it.
+ */
+unsigned int net_dispatch_tx_pending(struct net_conn *conn)
+{
+  pthread_mutex_lock(&conn->mutex);
+  unsigned int tx_len = conn->tx_len;
+  pthread_mutex_unlock(&conn->mutex);
+  return tx_len;
+}
+
+/** \brief Whether the peer of a connection is still connected.
+ *
+ * FALSE as soon as the dispatch thread has seen the peer hang up, which may be well before the disconnection reaches
+ * the handler in net_dispatch_process.
+ */
+char net_dispatch_connected(struct net_conn *conn)
+{
+  pthread_mutex_lock(&conn->mutex);
+  char connected = (!conn->closed) && (!conn->hangup);
+  pthread_mutex_unlock(&conn->mutex);
+  return connected;
+}
+
+/** \brief File descriptor that becomes readable when received messages are waiting for net_dispatch_process.
+ */
+int net_dispatch_get_notify_fd(struct net_dispatch *disp)
+{
+  return disp->notify_fd;
+}
+
+/** \brief Pass all messages received so far to a handler.
+ * \param disp The dispatcher.
+ * \param handler Function called for each message, in the order the messages were received.
+ * \param user_data Passed to the handler.
+ * \return Number of messages processed.
+ *
+ * Must always be called from the same thread (normally the main loop, when notify_fd becomes readable).
+ */
+int net_dispatch_process(struct net_dispatch *disp, net_dispatch_handler handler, void *user_data)
+{
+  uint64_t count;
+  // reset the notification before looking at the ring, so that messages queued from now on notify again
+  ssize_t ret = read(disp->notify_fd, &count, sizeof(count));
+  (void) ret;
+  unsigned int head = disp->ring_head, tail = __atomic_load_n(&disp->ring_tail, __ATOMIC_ACQUIRE);
+  int num_msgs = 0;
+  while (head != tail)
+  {
+    struct net_dispatch_item *item = &disp->ring[head % NET_DISPATCH_RING_LEN];
+    handler(item->conn_id, item->disconnected ? NULL : &item->msg, &item->t_recv, user_data);
+    head++;
+    __atomic_store_n(&disp->ring_head, head, __ATOMIC_RELEASE);
+    num_msgs++;
+  }
+  if (num_msgs > 0)
+  {
+    // ring_head was updated before taking the mutex, so the dispatch thread either sees the space or is waiting
+    pthread_mutex_lock(&disp->ring_mutex);
+    if (disp->ring_waiting)
+      pthread_cond_signal(&disp->ring_space);
+    pthread_mutex_unlock(&disp->ring_mutex);
+  }
+  return num_msgs;
+}
+
+/** \brief Get the next free slot in the ring, waiting for the main loop if the ring is full.
+ * \return The free slot, or NULL if the dispatcher is exiting.
+ */
+static struct net_dispatch_item *ring_reserve(struct net_dispatch *disp)
+{
+  if (disp->ring_tail - __atomic_load_n(&disp->ring_head, __ATOMIC_ACQUIRE) < NET_DISPATCH_RING_LEN)
+    return &disp->ring[disp->ring_tail % NET_DISPATCH_RING_LEN];
+  disp->num_stalls++;
+  wake(disp->notify_fd);
+  pthread_mutex_lock(&disp->ring_mutex);
+  while (disp->ring_tail - __atomic_load_n(&disp->ring_head, __ATOMIC_ACQUIRE) >= NET_DISPATCH_RING_LEN)
+  {
+    if (__atomic_load_n(&disp->exiting, __ATOMIC_ACQUIRE))
+    {
+      disp->ring_waiting = 0;
+      pthread_mutex_unlock(&disp->ring_mutex);
+      return NULL;
+    }
+    disp->ring_waiting = 1;
+    pthread_cond_wait(&disp->ring_space, &disp->ring_mutex);
+  }
+  disp->ring_waiting = 0;
+  pthread_mutex_unlock(&disp->ring_mutex);
+  return &disp->ring[disp->ring_tail % NET_DISPATCH_RING_LEN];
+}
+
+static void ring_commit(struct net_dispatch *disp)
+{
+  __atomic_store_n(&disp->ring_tail, disp->ring_tail + 1, __ATOMIC_RELEASE);
+  disp->num_msgs++;
+}
+
+/** \brief Write as much of a connection's queued frames as the socket accepts.
+ */
+static void conn_flush(struct net_dispatch *disp, struct net_conn *conn)
+{
+  pthread_mutex_lock(&conn->mutex);
+  while (conn->tx_len > 0)
+  {
+    int ret = send(conn->sockfd, conn->tx_buf, conn->tx_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (ret < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+      {
+        act_log_error(act_log_msg("Error sending to socket %d - %s. Discarding %u bytes.", conn->sockfd, strerror(errno), conn->tx_len));
+        conn->tx_len = 0;
+      }
+      break;
+    }
+    memmove(conn->tx_buf, &conn->tx_buf[ret], conn->tx_len - ret);
+    conn->tx_len -= ret;
+  }
+  if (conn->tx_len == 0)
+  {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = conn;
+    epoll_ctl(disp->epoll_fd, EPOLL_CTL_MOD, conn->sockfd, &ev);
+  }
+  pthread_mutex_unlock(&conn->mutex);
+}
+
+/** \brief Read from a ready connection and queue the complete messages received.
+ * \return Number of items queued.
+ */
+static int conn_receive(struct net_dispatch *disp, struct net_conn *conn)
+{
+  struct net_dispatch_item *item;
+  struct timespec t_recv;
+  int i, ret, num_queued = 0;
+  for (i=0; i<MAX_READS_PER_EVENT; i++)
+  {
+    ret = act_msg_rx_fill(&conn->rx, conn->sockfd);
+    if ((ret < 0) && (errno == EINTR))
+      continue;
+    if ((ret < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+      break;
+    if (ret <= 0)
+    {
+      if (ret < 0)
+        act_log_error(act_log_msg("Error receiving from socket %d - %s.", conn->sockfd, strerror(errno)));
+      pthread_mutex_lock(&conn->mutex);
+      conn->closed = 1;
+      pthread_mutex_unlock(&conn->mutex);
+      epoll_ctl(disp->epoll_fd, EPOLL_CTL_DEL, conn->sockfd, NULL);
+      if ((item = ring_reserve(disp)) == NULL)
+        break;
+      item->conn_id = conn->id;
+      item->disconnected = 1;
+      clock_gettime(CLOCK_MONOTONIC, &item->t_recv);
+      ring_commit(disp);
+      num_queued++;
+      break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t_recv);
+    unsigned long num_bad = conn->rx.num_bad, num_lost = conn->rx.num_lost;
+    while ((item = ring_reserve(disp)) != NULL)
+    {
+      if (!act_msg_rx_next(&conn->rx, &item->msg))
+        break;
+      item->conn_id = conn->id;
+      item->disconnected = 0;
+      item->t_recv = t_recv;
+      ring_commit(disp);
+      num_queued++;
+    }
+    if (conn->rx.num_bad != num_bad)
+      act_log_error(act_log_msg("Discarded %lu invalid bytes received on socket %d.", conn->rx.num_bad - num_bad, conn->sockfd));
+    if (conn->rx.num_lost != num_lost)
+      act_log_error(act_log_msg("%lu messages received on socket %d were lost.", conn->rx.num_lost - num_lost, conn->sockfd));
+    if (item == NULL)
+      break;
+  }
+  return num_queued;
+}
+
+/** \brief Close and free connections for which net_dispatch_remove has been called.
+ *
+ * Only called by the dispatch thread between batches of epoll events, so no event can refer to a freed connection.
+ */
+static void remove_conns(struct net_dispatch *disp)
+{
+  struct net_conn **link, *conn;
+  pthread_mutex_lock(&disp->mutex);
+  link = &disp->conns;
+  while ((conn = *link) != NULL)
+  {
+    if (!conn->removed)
+    {
+      link = &conn->next;
+      continue;
+    }
+    *link = conn->next;
+    if (!conn->closed)
+      epoll_ctl(disp->epoll_fd, EPOLL_CTL_DEL, conn->sockfd, NULL);
+    close(conn->sockfd);
+    conn_free(conn);
+  }
+  pthread_mutex_unlock(&disp->mutex);
+}
+
+static void *dispatch_thread(void *disp_data)
+{
+  struct net_dispatch *disp = (struct net_dispatch *)disp_data;
+  struct epoll_event events[MAX_EVENTS];
+  int i, num_events, num_queued;
+  sigset_t sigs;
+
+  // leave signal handling to the main thread
+  sigfillset(&sigs);
+  pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+  while (!__atomic_load_n(&disp->exiting, __ATOMIC_ACQUIRE))
+  {
+    num_events = epoll_wait(disp->epoll_fd, events, MAX_EVENTS, -1);
+    if (num_events < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      act_log_error(act_log_msg("Error waiting for network events - %s. Message dispatch stopped.", strerror(errno)));
+      break;
+    }
+    num_queued = 0;
+    for (i=0; i<num_events; i++)
+    {
+      struct net_conn *conn = (struct net_conn *)events[i].data.ptr;
+      if (conn == NULL)
+      {
+        uint64_t count;
+        ssize_t ret = read(disp->wake_fd, &count, sizeof(count));
+        (void) ret;
+        continue;
+      }
+      if (conn->closed)
+        continue;
+      if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+      {
+        // stop sending right away - what the peer sent before hanging up is still read below
+        pthread_mutex_lock(&conn->mutex);
+        conn->hangup = 1;
+        pthread_mutex_unlock(&conn->mutex);
+      }
+      if (events[i].events & EPOLLOUT)
+        conn_flush(disp, conn);
+      if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        num_queued += conn_receive(disp, conn);
+    }
+    if (num_queued > 0)
+      wake(disp->notify_fd);
+    remove_conns(disp);
+  }
+  return NULL;
+}
@@ -0,0 +1,102 @@
+#ifndef NET_DISPATCH_H
+#define NET_DISPATCH_H
+
+#include <pthread.h>
+#include <time.h>
+#include <act_ipc.h>
+
+//! Number of received messages that can wait to be processed by the main loop
+#define NET_DISPATCH_RING_LEN   1024
+//! Maximum number of bytes that can wait to be sent to a programme before messages to it are dropped
+#define NET_DISPATCH_TX_MAX     65536
+
+/** \brief Network connection to a subprogramme, managed by the dispatch thread.
+ *
+ * Connections are created by net_dispatch_add and only freed by the dispatch thread after net_dispatch_remove, so the
+ * main loop may use its pointer until it calls net_dispatch_remove.
+ */
+struct net_conn
+{
+  //! Socket of the connection
+  int sockfd;
+  //! Unique identifier of the connection - socket numbers are reused, identifiers are not
+  unsigned int id;
+  //! Reassembly buffer for received message frames, only used by the dispatch thread
+  struct act_msg_rx rx;
+  //! Sequence number of the next message frame sent, protected by mutex
+  unsigned int tx_seq;
+  //! Frames waiting to be sent, protected by mutex
+  char *tx_buf;
+  unsigned int tx_len, tx_size;
+  //! Set once the peer has closed the connection
+  char closed;
+  //! Set by the dispatch thread as soon as the peer hangs up (data sent before may still be waiting to be read), protected by mutex
+  char hangup;
+  //! Set by net_dispatch_remove, protected by the dispatcher's mutex
+  char removed;
+  pthread_mutex_t mutex;
+  struct net_conn *next;
+};
+
+//! A received message waiting to be processed by the main loop
+struct net_dispatch_item
+{
+  //! Identifier of the connection on which the message was received
+  unsigned int conn_id;
+  //! TRUE if the peer closed the connection (msg is not valid)
+  char disconnected;
+  //! Time at which the message was received (CLOCK_MONOTONIC)
+  struct timespec t_recv;
+  struct act_msg msg;
+};
+
+/** \brief Handler for received messages, see net_dispatch_process.
+ *
+ * msg is NULL if the peer closed the connection.
+ */
+typedef void (*net_dispatch_handler)(unsigned int conn_id, struct act_msg *msg, struct timespec *t_recv, void *user_data);
+
+/** \brief Dispatcher that receives messages from all subprogramme connections on a dedicated thread.
+ *
+ * The dispatch thread waits on all connections with epoll, reassembles message frames from the ready connections
+ * only and queues the messages in a single-producer/single-consumer ring. The main loop is woken through notify_fd
+ * and processes the queued messages with net_dispatch_process, so message handlers (which update the GUI and send
+ * messages to other programmes) always run on the main thread. Messages sent with net_dispatch_send are written
+ * immediately if possible; whatever does not fit in the socket buffer is queued and written by the dispatch thread.
+ * While the ring is full, the dispatch thread sleeps until net_dispatch_process has freed some of it.
+ */
+struct net_dispatch
+{
+  int epoll_fd;
+  //! Wakes up the dispatch thread (exit and removed connections)
+  int wake_fd;
+  //! Becomes readable when messages are waiting to be processed
+  int notify_fd;
+  pthread_t thr;
+  char exiting;
+  //! Protects conns, next_id and the removed flag of each connection
+  pthread_mutex_t mutex;
+  struct net_conn *conns;
+  unsigned int next_id;
+  //! Ring of received messages - ring_tail is only written by the dispatch thread, ring_head only by the main loop
+  struct net_dispatch_item *ring;
+  unsigned int ring_head, ring_tail;
+  //! The dispatch thread waits on ring_space while the ring is full (ring_waiting set), signalled by the main loop
+  pthread_mutex_t ring_mutex;
+  pthread_cond_t ring_space;
+  char ring_waiting;
+  //! Counters, only written by the dispatch thread
+  unsigned long num_msgs, num_stalls;
+};
+
+struct net_dispatch *net_dispatch_new(void);
+void net_dispatch_free(struct net_dispatch *disp);
+struct net_conn *net_dispatch_add(struct net_dispatch *disp, int sockfd);
+void net_dispatch_remove(struct net_dispatch *disp, struct net_conn *conn);
+int net_dispatch_send(struct net_dispatch *disp, struct net_conn *conn, struct act_msg *msg);
+unsigned int net_dispatch_tx_pending(struct net_conn *conn);
+char net_dispatch_connected(struct net_conn *conn);
+int net_dispatch_get_notify_fd(struct net_dispatch *disp);
+int net_dispatch_process(struct net_dispatch *disp, net_dispatch_handler handler, void *user_data);
+
+#endif
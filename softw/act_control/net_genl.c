@@ -7,6 +7,7 @@
 #include <act_ipc.h>
 #include "net_genl.h"
 #include "net_basic.h"
+#include "net_bus.h"
 #include "net_dataccd.h"
 #include "net_datapmt.h"
 #include "net_targset.h"
@@ -22,33 +23,73 @@ static void process_time(struct act_prog *prog_array, int num_progs, struct act_
 static void process_environ(struct act_prog *prog_array, int num_progs, struct act_msg *msg);
 // static void active_time_change(unsigned char new_active_time, struct act_prog *prog_array, int num_progs);
 
-/** \brief Check for an incoming message from subprogramme.
+struct dispatch_progs
+{
+  struct act_prog *prog_array;
+  int num_progs;
+};
+
+/** \brief Handle a programme closing its network connection.
  *
+ * A programme that is not shutting down is treated as having died: it is marked as killed (so that check_children no
+ * longer waits for it as a live programme), terminated and restarted, as check_status does with one that stops
+ * responding. If the programme has actually exited, check_children reaps it (see prog_kill).
+ */
+static void process_disconnect(struct act_prog *prog)
+{
+  act_log_normal(act_log_msg("%s closed its network connection.", prog->name));
+  act_disconnect(prog);
+  if ((prog->status == PROGSTAT_STOPPING) || (prog->status == PROGSTAT_STOPPED) || (prog->status == PROGSTAT_KILLED))
+    return;
+  act_log_normal(act_log_msg("Restarting %s.", prog->name));
+  prog_set_status(prog, PROGSTAT_KILLED);
+  prog_kill(prog);
+  if (!start_prog(prog))
+    act_log_error(act_log_msg("Failed to start %s.", prog->name));
+}
+
+/** \brief Pass a message received by the dispatcher to the programme that sent it.
+ *
+ * Messages from connections that have since been closed are dropped.
+ */
+static void dispatch_msg(unsigned int conn_id, struct act_msg *msg, struct timespec *t_recv, void *user_data)
+{
+  (void) t_recv;
+  struct dispatch_progs *progs = (struct dispatch_progs *)user_data;
+  int i;
+  for (i=0; i<progs->num_progs; i++)
+  {
+    struct act_prog *prog = &(progs->prog_array[i]);
+    if ((prog->conn == NULL) || (prog->conn->id != conn_id))
+      continue;
+    if (msg != NULL)
+      process_msg(prog, msg, progs->prog_array, progs->num_progs);
+    else
+      process_disconnect(prog);
+    return;
+  }
+}
+
+/** \brief Process the messages received from subprogrammes.
+ *
+ * \param dispatch Dispatcher that receives messages from all programmes
  * \param prog_array Array of programmes managed by act_control
  * \param num_progs Number of elements in prog_array
  *
- * \return Number of messages received
+ * \return Number of messages processed
+ *
+ * Called from the main loop when the dispatcher signals that messages are waiting, so the message handlers (which
+ * update the GUI and send messages to other programmes) run on the main thread.
  */
-int check_prog_messages(struct act_prog *prog_array, int num_progs)
+int check_prog_messages(struct net_dispatch *dispatch, struct act_prog *prog_array, int num_progs)
 {
-  if (prog_array == NULL)
+  if ((dispatch == NULL) || (prog_array == NULL))
   {
     act_log_error(act_log_msg("Invalid input parameters."));
     return 0;
   }
-  int i, num_msgs=0;
-  struct act_msg msgbuf;
-  for (i=0; i<num_progs; i++)
-  {
-    if (prog_array[i].sockfd <= 0)
-      continue;
-    while (act_recv(&(prog_array[i]), &msgbuf))
-    {
-      process_msg(&(prog_array[i]), &msgbuf, prog_array, num_progs);
-      num_msgs++;
-    }
-  }
-  return num_msgs;
+  struct dispatch_progs progs = { prog_array, num_progs };
+  return net_dispatch_process(dispatch, dispatch_msg, &progs);
 }
 
 char send_statreq(struct act_prog *prog)
@@ -154,8 +195,7 @@ static void process_quit(struct act_prog *prog)
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  close(prog->sockfd);
-  prog->sockfd = 0;
+  act_disconnect(prog);
   prog_set_status(prog, PROGSTAT_STOPPED);
 }
 
@@ -164,7 +204,8 @@ static void process_quit(struct act_prog *prog)
  * \param msg_cap The received message structure.
  * \return (void)
  * 
- * Simply copy the MT_CAP message structure to the subprogramme's prog struct.
+ * Copy the MT_CAP message structure to the subprogramme's prog struct and subscribe the programme to the services
+ * it needs.
  */
 static void process_cap(struct act_prog *prog, struct act_msg *msg)
 {
@@ -174,6 +215,7 @@ static void process_cap(struct act_prog *prog, struct act_msg *msg)
     return;
   }
   memcpy(&(prog->caps), &(msg->content.msg_cap), sizeof(struct act_msg_cap));
+  bus_subscribe(prog);
 }
 
 /** \brief Process an MT_STAT message received from a programme.
@@ -205,7 +247,7 @@ static void process_stat(struct act_prog *prog, struct act_msg *msg, struct act_
   {
     act_log_normal(act_log_msg("Received restart request from %s.", prog->name));
     prog_set_status(prog, PROGSTAT_KILLED);
-    kill(prog->pid, SIGTERM);
+    prog_kill(prog);
     if (!start_prog(prog))
       act_log_error(act_log_msg("Programme %s encountered an error and needed to be restarted. It has been stopped, but cannot start up again.", prog->name));
   }
@@ -248,25 +290,12 @@ static void process_guisock(struct act_prog *prog)
  * \param num_progs Number of elements in prog_array.
  * \param msg_coord Received MT_COORD message.
  *
- * Forward MT_COORD message to all running programmes that requires it.
+ * Publish MT_COORD message on the service bus, which forwards it to all running programmes that require it
+ * without waiting for programmes that are behind.
  */
 static void process_coord(struct act_prog *prog_array, int num_progs, struct act_msg *msg)
 {
-  if ((prog_array == NULL) || (msg == NULL))
-  {
-    act_log_error(act_log_msg("Invalid input parameters."));
-    return;
-  }
-  int i;
-  for (i=0; i<num_progs; i++)
-  {
-    if ((prog_array[i].status != PROGSTAT_RUNNING) && (prog_array[i].status != PROGSTAT_STARTUP))
-      continue;
-    if ((prog_array[i].caps.service_needs & SERVICE_COORD) == 0)
-      continue;
-    if (!act_send(&(prog_array[i]), msg))
-      act_log_error(act_log_msg("Error sending telescope coordinates to %s (fd %d).", prog_array[i].name, prog_array[i].sockfd));
-  }
+  bus_publish(prog_array, num_progs, msg);
 }
 
 /** \brief Process received MT_TIME message.
@@ -274,25 +303,12 @@ static void process_coord(struct act_prog *prog_array, int num_progs, struct act
  * \param num_progs Number of elements in prog_array.
  * \param msg_coord Received MT_TIME message.
  *
- * Forward MT_TIME message to all running programmes that requires it.
+ * Publish MT_TIME message on the service bus, which forwards it to all running programmes that require it
+ * without waiting for programmes that are behind.
  */
 static void process_time(struct act_prog *prog_array, int num_progs, struct act_msg *msg)
 {
-  if ((prog_array == NULL) || (msg == NULL))
-  {
-    act_log_error(act_log_msg("Invalid input parameters."));
-    return;
-  }
-  int i;
-  for (i=0; i<num_progs; i++)
-  {
-    if ((prog_array[i].status != PROGSTAT_RUNNING) && (prog_array[i].status != PROGSTAT_STARTUP))
-      continue;
-    if ((prog_array[i].caps.service_needs & SERVICE_TIME) == 0)
-      continue;
-    if (!act_send(&(prog_array[i]), msg))
-      act_log_error(act_log_msg("Error sending time to %s (fd %d).", prog_array[i].name, prog_array[i].sockfd));
-  }
+  bus_publish(prog_array, num_progs, msg);
 }
 
 /** \brief Process received MT_ENVIRON message.
@@ -300,7 +316,8 @@ static void process_time(struct act_prog *prog_array, int num_progs, struct act_
  * \param num_progs Number of elements in prog_array.
  * \param msg_coord Received MT_ENVIRON message.
  *
- * Forward MT_ENVIRON message to all running programmes that require it.
+ * Publish MT_ENVIRON message on the service bus (see process_coord) and start/stop programmes if the active
+ * time changed.
  */
 static void process_environ(struct act_prog *prog_array, int num_progs, struct act_msg *msg)
 {
@@ -310,13 +327,7 @@ static void process_environ(struct act_prog *prog_array, int num_progs, struct a
     return;
   }
   int i;
-  for (i=0; i<num_progs; i++)
-  {
-    if ((prog_array[i].caps.service_needs & SERVICE_ENVIRON) == 0)
-      continue;
-    if (!act_send(&(prog_array[i]), msg))
-      act_log_error(act_log_msg("Error sending situational parameters to %s (fd %d).", prog_array[i].name, prog_array[i].sockfd));
-  }
+  bus_publish(prog_array, num_progs, msg);
   if (*(prog_array[0].status_active) == msg->content.msg_environ.status_active)
     return;
   for (i=0; i<num_progs; i++)
@@ -3,7 +3,7 @@
 
 #include "subprogrammes.h"
 
-int check_prog_messages(struct act_prog *prog_array, int num_progs);
+int check_prog_messages(struct net_dispatch *dispatch, struct act_prog *prog_array, int num_progs);
 char send_statreq(struct act_prog *prog);
 void send_allstop(struct act_prog *prog_array, int num_progs);
 
@@ -4,7 +4,7 @@
 // #include <netinet/in.h>
 // #include <netdb.h>
 // #include <arpa/inet.h>
-// #include <sys/wait.h>
+#include <sys/wait.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
@@ -19,34 +19,37 @@ void progopts_start(gpointer user_data);
 void progopts_close(gpointer user_data);
 void progopts_kill(gpointer user_data);
 
-/** \brief Starts specified subprogramme
- *
- * \param sockfd
- *   File descriptor for UNIX socket on which controller is listening for incoming network connections.
+//! Time to wait for a launched programme to connect before giving up on it
+#define LAUNCH_TIMEOUT_S   10
+
+/** \brief Number of seconds elapsed since the given time (CLOCK_MONOTONIC).
+ */
+static double elapsed_s(struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec)/1.0e9;
+}
+
+/** \brief Launches specified subprogramme
  *
- * \param programe
+ * \param prog
  *   Point to <struct act_prog> that contains all information regarding the corresponding subprogramme.
  *
- * \param port_str
- *   C string containing the port number or port name on which controller is listening for incoming connections.
- *
- * \param config_file
- *   C string containing filename of global configuration file, preferably the global filesystem path to
- *   the file.
- *
  * \return TRUE on success, FALSE on failure.
  *
  * Algorithm:
  *   -# Fork process (duplicates controller, yields child and parent).
- *     - Child (fork() returns non-zero):
+ *     - Child (fork() returns 0):
  *       -# Exec sub-programme (replaces duplicate of controller with specified subprogramme)
  *         - Child executable can be in user's $PATH environment variable, in which case just call the executable
  *         - Path the child executable is specified, in which case concatenate "path" and "executable" and execute.
- *     - Parent (frok() return 0):
- *       -# Wait for network connection from child
- *       -# Start handshake with child by sending "client capabilities request" message.
+ *     - Parent (fork() returns non-zero):
+ *       -# Mark the programme as launching and return immediately.
  *
- * \todo Make the listen fd blocking before accept and non-blocking after
+ * The network connection from the child is accepted later from the main loop (see accept_progs), so starting a
+ * programme never blocks the controller and all programmes can be started in parallel. If the child does not
+ * connect within LAUNCH_TIMEOUT_S seconds, prog_check_launch kills it.
  */
 char start_prog(struct act_prog* prog)
 {
@@ -55,19 +58,18 @@ char start_prog(struct act_prog* prog)
     act_log_error(act_log_msg("Invalid input parameters"));
     return FALSE;
   }
-  act_log_normal(act_log_msg("Test"));
   if ((prog->status != PROGSTAT_STOPPED) && (prog->status != PROGSTAT_KILLED))
   {
-    act_log_normal(act_log_msg("%s is already running."));
+    act_log_normal(act_log_msg("%s is already running.", prog->name));
+    return FALSE;
+  }
+  if (prog->launching)
+  {
+    act_log_normal(act_log_msg("%s is already being started.", prog->name));
     return FALSE;
   }
     
   act_log_normal(act_log_msg("Starting programme %s.", prog->name));
-  socklen_t sin_size;
-  int new_fd = -1;
-  struct sockaddr_storage their_addr;
-  char i;
-
   pid_t childpid = fork();
   if (childpid < 0)
   {
@@ -85,23 +87,73 @@ char start_prog(struct act_prog* prog)
   }
 
   prog->pid = childpid;
-  sin_size = sizeof(their_addr);
-  for (i=0; i<10 && new_fd<0; i++)
+  prog->launching = TRUE;
+  clock_gettime(CLOCK_MONOTONIC, &prog->launch_time);
+  return TRUE;
+}
+
+/** \brief Find the launched programme to which a newly accepted connection belongs.
+ *
+ * \param sockfd
+ *   File descriptor of the accepted connection.
+ *
+ * \param prog_array, num_progs
+ *   Array of all subprogrammes.
+ *
+ * \return The matching programme, or NULL if no programme is waiting for a connection.
+ *
+ * The connection belongs to the programme whose process owns the other end of it. If that cannot be determined
+ * (e.g. the programme runs on another host or the executable is a wrapper that forks the real programme), the
+ * connection is given to the programme that was launched first.
+ */
+static struct act_prog *find_launched_prog(int sockfd, struct act_prog *prog_array, int num_progs)
+{
+  struct act_prog *first = NULL;
+  unsigned long inode = net_peer_inode(sockfd);
+  int i;
+  for (i=0; i<num_progs; i++)
   {
-    new_fd = accept(*(prog->listen_sockfd), (struct sockaddr *)&their_addr, &sin_size);
-    sleep(1);
+    if (!prog_array[i].launching)
+      continue;
+    if ((inode != 0) && (net_pid_has_socket(prog_array[i].pid, inode)))
+      return &prog_array[i];
+    if ((first == NULL) || (prog_array[i].launch_time.tv_sec < first->launch_time.tv_sec) || ((prog_array[i].launch_time.tv_sec == first->launch_time.tv_sec) && (prog_array[i].launch_time.tv_nsec < first->launch_time.tv_nsec)))
+      first = &prog_array[i];
   }
-  if (new_fd == -1)
+  if (first != NULL)
+    act_log_debug(act_log_msg("Could not identify the process connected on socket %d. Assuming it is %s.", sockfd, first->name));
+  return first;
+}
+
+/** \brief Complete the startup of a programme once its network connection has been accepted.
+ *
+ * \param prog
+ *   The programme that connected.
+ *
+ * \param new_fd
+ *   File descriptor of the accepted connection.
+ *
+ * \return (void)
+ *
+ * Algorithm:
+ *   -# Hand the connection to the message dispatcher.
+ *   -# Create the GUI socket for the programme, if it has a GUI region.
+ *   -# Start handshake with child by sending "client capabilities request" message.
+ */
+static void prog_connected(struct act_prog *prog, int new_fd)
+{
+  act_log_normal(act_log_msg("%s connected on socket %d, %.2f s after launch.", prog->name, new_fd, elapsed_s(&prog->launch_time)));
+  prog->launching = FALSE;
+  fcntl(new_fd, F_SETFD, FD_CLOEXEC);
+  prog->conn = net_dispatch_add(prog->dispatch, new_fd);
+  if (prog->conn == NULL)
   {
-    act_log_error(act_log_msg("Timed out while waiting to accept network connection from programme %s - %s", prog->name, strerror(errno)));
-    kill(childpid, SIGTERM);
-    return FALSE;
+    act_log_error(act_log_msg("Could not set up connection to %s. Killing it.", prog->name));
+    close(new_fd);
+    prog_kill(prog);
+    return;
   }
-  act_log_normal(act_log_msg("Child connected on socket %d", new_fd));
   prog->sockfd = new_fd;
-  fcntl(new_fd, F_SETOWN, getpid());
-  int oflags = fcntl(new_fd, F_GETFL);
-  fcntl(new_fd, F_SETFL, oflags | FASYNC);
   prog_set_status(prog, PROGSTAT_STARTUP);
 
   if ((prog->guicoords[0] != prog->guicoords[1]) && (prog->guicoords[2] != prog->guicoords[3]))
@@ -128,13 +180,94 @@ char start_prog(struct act_prog* prog)
   struct act_msg msgbuf;
   memset(&msgbuf, 0, sizeof(struct act_msg));
   msgbuf.mtype = MT_CAP;
-  if (send(new_fd, &msgbuf, sizeof(struct act_msg), 0) < 0)
-    act_log_error(act_log_msg("Could not send capabilities request message to %s - %s", prog->name, strerror(errno)));
+  if (!act_send(prog, &msgbuf))
+    act_log_error(act_log_msg("Could not send capabilities request message to %s", prog->name));
   else
     prog->last_stat_timer = 0;
   act_log_normal(act_log_msg("Done starting %s", prog->name));
-  
-  return TRUE;
+}
+
+/** \brief Accept network connections from launched subprogrammes.
+ *
+ * \param listen_sockfd
+ *   Non-blocking socket on which the controller listens for incoming connections.
+ *
+ * \param prog_array, num_progs
+ *   Array of all subprogrammes.
+ *
+ * \return Number of connections accepted and matched to a programme.
+ *
+ * Called from the main loop whenever the listen socket becomes readable. Accepts all pending connections and
+ * matches each to the programme that made it (see find_launched_prog). Connections that do not belong to any
+ * launched programme are closed.
+ */
+int accept_progs(int listen_sockfd, struct act_prog *prog_array, int num_progs)
+{
+  int new_fd, num_accepted = 0;
+  struct act_prog *prog;
+  while (1)
+  {
+    new_fd = accept(listen_sockfd, NULL, NULL);
+    if (new_fd < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        act_log_error(act_log_msg("Error accepting network connection - %s", strerror(errno)));
+      break;
+    }
+    prog = find_launched_prog(new_fd, prog_array, num_progs);
+    if (prog == NULL)
+    {
+      act_log_error(act_log_msg("Received network connection on socket %d, but no programme is being started. Closing connection.", new_fd));
+      close(new_fd);
+      continue;
+    }
+    prog_connected(prog, new_fd);
+    num_accepted++;
+  }
+  return num_accepted;
+}
+
+/** \brief Give up on a launched programme that has not connected in time.
+ *
+ * \param prog
+ *   The programme to check.
+ *
+ * \return (void)
+ *
+ * Called regularly from the main loop. If the programme was launched more than LAUNCH_TIMEOUT_S seconds ago and
+ * has not connected yet, it is killed.
+ */
+void prog_check_launch(struct act_prog *prog)
+{
+  if (!prog->launching)
+    return;
+  if (elapsed_s(&prog->launch_time) < LAUNCH_TIMEOUT_S)
+    return;
+  act_log_error(act_log_msg("Timed out while waiting to accept network connection from programme %s.", prog->name));
+  prog->launching = FALSE;
+  prog_kill(prog);
+}
+
+/** \brief Terminate a programme's process and remember it, so that check_children reaps it once it has exited.
+ *
+ * \param prog
+ *   The programme whose process must be terminated.
+ *
+ * \return (void)
+ *
+ * By the time the process exits, the programme is no longer launching and its status is STOPPED or KILLED (or it has
+ * already been restarted with a new process), so check_children would not wait for it otherwise.
+ */
+void prog_kill(struct act_prog *prog)
+{
+  if (prog->pid <= 0)
+    return;
+  if ((prog->reap_pid > 0) && (prog->reap_pid != prog->pid) && (waitpid(prog->reap_pid, NULL, WNOHANG) == 0))
+    act_log_error(act_log_msg("Previously killed process %d of %s has not exited yet.", prog->reap_pid, prog->name));
+  kill(prog->pid, SIGTERM);
+  prog->reap_pid = prog->pid;
 }
 
 char close_prog(struct act_prog *prog)
@@ -175,7 +308,7 @@ void prog_active_change(struct act_prog *prog, unsigned char status_active)
     if (start_prog(prog) == 0)
       act_log_error(act_log_msg("Error starting programme %s.", prog->name));
     else
-      act_log_normal(act_log_msg("Programme %s successfully started.", prog->name));
+      act_log_normal(act_log_msg("Programme %s launched.", prog->name));
     return;
   }
   if ((prog->status != PROGSTAT_STARTUP) && (prog->status != PROGSTAT_RUNNING))
@@ -184,8 +317,8 @@ void prog_active_change(struct act_prog *prog, unsigned char status_active)
   {
     act_log_error(act_log_msg("Error closing programme %s - Killing.", prog->name));
     prog_set_status(prog, PROGSTAT_KILLED);
-    close(prog->sockfd);
-    kill(prog->pid, SIGTERM);
+    act_disconnect(prog);
+    prog_kill(prog);
   }
   else
     act_log_normal(act_log_msg("Programme %s successfully closed.", prog->name));
@@ -243,13 +376,19 @@ void prog_button(GtkWidget *btn_progopts, gpointer user_data)
       snprintf(stat_str, sizeof(stat_str), "Unknown - %d", prog->status);
   }
   gtk_table_attach(GTK_TABLE(box_progopts),gtk_label_new(stat_str), 3,6,2,3, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
-  gtk_table_attach(GTK_TABLE(box_progopts),gtk_label_new("LOG N/A"), 0,6,3,4, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
+  gtk_table_attach(GTK_TABLE(box_progopts),gtk_label_new("Service updates"),0,3,3,4, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
+  unsigned long num_delivered, num_coalesced, num_dropped;
+  bus_get_counters(prog, &num_delivered, &num_coalesced, &num_dropped);
+  char bus_str[80];
+  snprintf(bus_str, sizeof(bus_str), "%lu sent, %lu coalesced, %lu dropped", num_delivered, num_coalesced, num_dropped);
+  gtk_table_attach(GTK_TABLE(box_progopts),gtk_label_new(bus_str), 3,6,3,4, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
+  gtk_table_attach(GTK_TABLE(box_progopts),gtk_label_new("LOG N/A"), 0,6,4,5, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
   GtkWidget *btn_close = gtk_button_new_with_label("Close");
-  gtk_table_attach(GTK_TABLE(box_progopts),btn_close, 0,2,4,5, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
+  gtk_table_attach(GTK_TABLE(box_progopts),btn_close, 0,2,5,6, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
   GtkWidget *btn_kill = gtk_button_new_with_label("Kill");
-  gtk_table_attach(GTK_TABLE(box_progopts),btn_kill, 2,4,4,5, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
+  gtk_table_attach(GTK_TABLE(box_progopts),btn_kill, 2,4,5,6, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
   GtkWidget *btn_start = gtk_button_new_with_label("Start");
-  gtk_table_attach(GTK_TABLE(box_progopts),btn_start, 4,6,4,5, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
+  gtk_table_attach(GTK_TABLE(box_progopts),btn_start, 4,6,5,6, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
 
   g_signal_connect_swapped(G_OBJECT(btn_close),"clicked",G_CALLBACK(progopts_close),prog);
   g_signal_connect_swapped(G_OBJECT(btn_kill),"clicked",G_CALLBACK(progopts_kill),prog);
@@ -434,7 +573,6 @@ void progopts_kill(gpointer user_data)
 {
   struct act_prog *prog = (struct act_prog *)user_data;
   prog_set_status(prog, PROGSTAT_KILLED);
-  close(prog->sockfd);
-  prog->sockfd = 0;
-  kill(prog->pid, SIGTERM);
+  act_disconnect(prog);
+  prog_kill(prog);
 }
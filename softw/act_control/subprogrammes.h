@@ -5,6 +5,8 @@
 #include <signal.h>
 #include <time.h>
 #include <act_ipc.h>
+#include "net_dispatch.h"
+#include "net_bus.h"
 
 /** At startup, the main controller populates an array of act_prog structures
   * from the sub-programmes configuration file, as listed in the global 
@@ -27,14 +29,24 @@ struct act_prog
 
   //! Network socket on which child is accepted
   int sockfd;
+  //! Connection to the child, managed by the message dispatcher (NULL if not connected)
+  struct net_conn *conn;
   //! Process identifier of child process
   int pid;
+  //! Process identifier of a child that was killed and has not been reaped yet (0 if none)
+  int reap_pid;
+  //! TRUE while the child has been launched but has not yet connected
+  char launching;
+  //! Time at which the child was launched (CLOCK_MONOTONIC)
+  struct timespec launch_time;
   //! State of execution of child
   unsigned char status;
   //! Time last status was received or quit command was sent
   time_t last_stat_timer;
   //! Message structure that describes the clients capabilities and requirements.
   struct act_msg_cap caps;
+  //! Updates of each service waiting to be delivered to the child (indexed by the bit number of the SERVICE_* flag)
+  struct bus_mailbox bus_boxes[NUM_SERVICES];
   //! GtkButton on act_control form which creates a popup window with options for the child when pressed
   GtkWidget *button;
   //! GtkSocket that contains the GUI for the child on the act_control main window
@@ -42,6 +54,8 @@ struct act_prog
   
   //! Socket on which ACT control listens for incoming connections
   const int *listen_sockfd;
+  //! Dispatcher that handles the network connections of all programmes
+  struct net_dispatch *dispatch;
   //! Hostname of computer on which ACT control is running
   const char *hostname;
   //! Name of port on which ACT control listens of incoming connections
@@ -55,6 +69,9 @@ struct act_prog
 };
 
 char start_prog(struct act_prog* prog);
+int accept_progs(int listen_sockfd, struct act_prog *prog_array, int num_progs);
+void prog_check_launch(struct act_prog *prog);
+void prog_kill(struct act_prog *prog);
 char close_prog(struct act_prog *prog);
 void prog_active_change(struct act_prog *prog, unsigned char status_active);
 void prog_button(GtkWidget *btn_progopts, gpointer user_data);
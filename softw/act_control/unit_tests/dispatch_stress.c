@@ -0,0 +1,228 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra -O2 -I../ -I../../../libs/ ./dispatch_stress.c ../net_dispatch.c ../../../libs/act_ipc.c
+ * ../../../libs/act_log.c -lpthread -o ./dispatch_stress
+ *
+ * Stress test for the act_control message dispatcher. Starts a number of fake clients, each of which floods its
+ * connection with alternating MT_TIME and MT_COORD messages at a fixed rate. The main thread processes the messages
+ * as act_control's main loop does (optionally spending some time on each, to stand in for GUI updates) and, like
+ * act_control, forwards every MT_COORD to all clients. Reports the dispatch latency percentiles (from the time a
+ * client sent a message and from the time the dispatch thread received it, to the time the message was processed),
+ * and checks that no messages were lost or reordered:
+ *   ./dispatch_stress [clients] [messages/s per client] [seconds] [microseconds of work per message]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "net_dispatch.h"
+
+#define MAX_CLIENTS   64
+
+struct client
+{
+  int sockfd;
+  struct net_conn *conn;
+  pthread_t thr;
+  long rate, num_msgs, num_sent;
+  //! Send time of each message, in seconds (CLOCK_MONOTONIC)
+  double *t_send;
+  long num_recv, num_returned;
+};
+
+struct stress
+{
+  struct net_dispatch *disp;
+  struct client clients[MAX_CLIENTS];
+  int num_clients;
+  long work_us;
+  double *lat_send, *lat_recv;
+  long num_lat, max_lat;
+  long num_out_of_order, num_dropped;
+};
+
+static double now_s(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec/1.0e9;
+}
+
+static void *client_thread(void *client_data)
+{
+  struct client *client = (struct client *)client_data;
+  struct act_msg msg;
+  struct timespec next;
+  unsigned int seq = 0;
+  char buf[4096];
+  long period_ns = 1000000000L / client->rate;
+  long i;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (i=0; i<client->num_msgs; i++)
+  {
+    memset(&msg, 0, sizeof(msg));
+    if (i % 2 == 0)
+    {
+      msg.mtype = MT_TIME;
+      msg.content.msg_time.gjd = i;
+    }
+    else
+    {
+      msg.mtype = MT_COORD;
+      msg.content.msg_coord.epoch = i;
+    }
+    client->t_send[i] = now_s();
+    if (act_msg_send(client->sockfd, &msg, &seq) < 0)
+      break;
+    client->num_sent++;
+    // read (and ignore) the coordinates the controller forwards to every client
+    ssize_t ret;
+    while ((ret = recv(client->sockfd, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+      client->num_returned += ret;
+    next.tv_nsec += period_ns;
+    while (next.tv_nsec >= 1000000000L)
+    {
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+  return NULL;
+}
+
+static void handle_msg(unsigned int conn_id, struct act_msg *msg, struct timespec *t_recv, void *user_data)
+{
+  struct stress *stress = (struct stress *)user_data;
+  struct client *client = NULL;
+  double t = now_s();
+  int i;
+  for (i=0; i<stress->num_clients; i++)
+  {
+    if (stress->clients[i].conn->id == conn_id)
+      client = &stress->clients[i];
+  }
+  if ((client == NULL) || (msg == NULL))
+    return;
+  long idx = client->num_recv++;
+  double sent_idx = msg->mtype == MT_TIME ? msg->content.msg_time.gjd : msg->content.msg_coord.epoch;
+  if ((idx >= client->num_msgs) || (sent_idx != idx) || (msg->mtype != (idx % 2 == 0 ? MT_TIME : MT_COORD)))
+  {
+    stress->num_out_of_order++;
+    return;
+  }
+  if (stress->num_lat < stress->max_lat)
+  {
+    stress->lat_send[stress->num_lat] = t - client->t_send[idx];
+    stress->lat_recv[stress->num_lat] = t - (t_recv->tv_sec + t_recv->tv_nsec/1.0e9);
+    stress->num_lat++;
+  }
+  if (msg->mtype == MT_COORD)
+  {
+    for (i=0; i<stress->num_clients; i++)
+    {
+      if (net_dispatch_send(stress->disp, stress->clients[i].conn, msg) < 0)
+        stress->num_dropped++;
+    }
+  }
+  if (stress->work_us > 0)
+  {
+    double end = t + stress->work_us/1.0e6;
+    while (now_s() < end);
+  }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static void print_percentiles(const char *desc, double *lat, long num)
+{
+  qsort(lat, num, sizeof(double), cmp_double);
+  if (num == 0)
+    return;
+  printf("%-24s p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us\n", desc, lat[num/2]*1.0e6, lat[num*9/10]*1.0e6, lat[num*99/100]*1.0e6, lat[num*999/1000]*1.0e6, lat[num-1]*1.0e6);
+}
+
+int main(int argc, char **argv)
+{
+  static struct stress stress;
+  int num_clients = argc > 1 ? atoi(argv[1]) : 8;
+  long rate = argc > 2 ? atol(argv[2]) : 2000;
+  double duration = argc > 3 ? atof(argv[3]) : 5.0;
+  stress.work_us = argc > 4 ? atol(argv[4]) : 0;
+  int i, sv[2];
+
+  if ((num_clients < 1) || (num_clients > MAX_CLIENTS) || (rate < 1) || (duration <= 0.0))
+  {
+    fprintf(stderr, "Invalid arguments\n");
+    return 1;
+  }
+  stress.disp = net_dispatch_new();
+  if (stress.disp == NULL)
+    return 1;
+  stress.num_clients = num_clients;
+  stress.max_lat = (long)(num_clients * rate * duration) + num_clients;
+  stress.lat_send = malloc(stress.max_lat * sizeof(double));
+  stress.lat_recv = malloc(stress.max_lat * sizeof(double));
+  for (i=0; i<num_clients; i++)
+  {
+    struct client *client = &stress.clients[i];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+    {
+      perror("socketpair");
+      return 1;
+    }
+    client->sockfd = sv[0];
+    client->conn = net_dispatch_add(stress.disp, sv[1]);
+    client->rate = rate;
+    client->num_msgs = (long)(rate * duration);
+    client->t_send = malloc(client->num_msgs * sizeof(double));
+  }
+  printf("%d clients, %ld messages/s each, %.1f s, %ld us of work per message\n", num_clients, rate, duration, stress.work_us);
+
+  double t_start = now_s();
+  for (i=0; i<num_clients; i++)
+    pthread_create(&stress.clients[i].thr, NULL, client_thread, &stress.clients[i]);
+
+  // the main loop: wait for the dispatcher's notification and process everything that is waiting
+  struct pollfd pfd = { net_dispatch_get_notify_fd(stress.disp), POLLIN, 0 };
+  long num_expected = 0, num_processed = 0;
+  for (i=0; i<num_clients; i++)
+    num_expected += stress.clients[i].num_msgs;
+  while ((num_processed < num_expected) && (now_s() - t_start < duration + 5.0))
+  {
+    if (poll(&pfd, 1, 100) > 0)
+      num_processed += net_dispatch_process(stress.disp, handle_msg, &stress);
+  }
+  double t_total = now_s() - t_start;
+  for (i=0; i<num_clients; i++)
+    shutdown(stress.clients[i].sockfd, SHUT_RDWR);
+  for (i=0; i<num_clients; i++)
+    pthread_join(stress.clients[i].thr, NULL);
+
+  long num_sent = 0;
+  for (i=0; i<num_clients; i++)
+    num_sent += stress.clients[i].num_sent;
+  printf("%ld messages sent, %ld processed (%.0f messages/s), %ld out of order, %ld forwarded coordinates dropped, %lu ring stalls\n", num_sent, num_processed, num_processed/t_total, stress.num_out_of_order, stress.num_dropped, stress.disp->num_stalls);
+  print_percentiles("client send to handler:", stress.lat_send, stress.num_lat);
+  print_percentiles("dispatch to handler:", stress.lat_recv, stress.num_lat);
+
+  net_dispatch_free(stress.disp);
+  for (i=0; i<num_clients; i++)
+  {
+    close(stress.clients[i].sockfd);
+    free(stress.clients[i].t_send);
+  }
+  free(stress.lat_send);
+  free(stress.lat_recv);
+  return (num_processed != num_sent) || (stress.num_out_of_order != 0);
+}
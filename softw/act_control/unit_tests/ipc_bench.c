@@ -0,0 +1,175 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra -O2 -I../../../libs/ ./ipc_bench.c ../../../libs/act_ipc.c -lpthread -o ./ipc_bench
+ *
+ * Loopback benchmark for the IPC message framing. A reader thread receives messages over a local socket pair
+ * while the main thread sends a stream of MT_TIME and MT_COORD broadcasts (as act_control does every second for
+ * every client), first as fixed-size struct act_msg writes (the old protocol) and then as frames. Prints the bytes
+ * per broadcast and the messages per second for each. Also checks that frames delivered in arbitrary pieces
+ * (down to single bytes) and mixed with garbage are reassembled correctly:
+ *   ./ipc_bench [number of messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "act_ipc.h"
+
+struct reader
+{
+  int sockfd;
+  int framed;
+  long num_msgs, num_bad;
+};
+
+static double elapsed_s(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec)/1.0e9;
+}
+
+static void make_msg(struct act_msg *msg, long i)
+{
+  memset(msg, 0, sizeof(struct act_msg));
+  if (i % 2 == 0)
+  {
+    msg->mtype = MT_TIME;
+    msg->content.msg_time.gjd = 2457000.5 + i;
+  }
+  else
+  {
+    msg->mtype = MT_COORD;
+    msg->content.msg_coord.ra.hours = i % 24;
+  }
+}
+
+static void *reader_thread(void *reader_data)
+{
+  struct reader *reader = (struct reader *)reader_data;
+  struct act_msg msg;
+  if (!reader->framed)
+  {
+    // the old receiver: one recv per message, anything short is dropped
+    while (1)
+    {
+      int ret = recv(reader->sockfd, &msg, sizeof(msg), MSG_WAITALL);
+      if (ret <= 0)
+        break;
+      if (ret == sizeof(msg))
+        reader->num_msgs++;
+      else
+        reader->num_bad++;
+    }
+    return NULL;
+  }
+  struct act_msg_rx *rx = calloc(1, sizeof(struct act_msg_rx));
+  while (1)
+  {
+    unsigned int space;
+    char *buf = act_msg_rx_space(rx, &space);
+    int ret = recv(reader->sockfd, buf, space, 0);
+    if (ret <= 0)
+      break;
+    act_msg_rx_commit(rx, ret);
+    while (act_msg_rx_next(rx, &msg))
+      reader->num_msgs++;
+  }
+  reader->num_bad = rx->num_bad + rx->num_lost;
+  free(rx);
+  return NULL;
+}
+
+static void run(long num_msgs, int framed)
+{
+  int sv[2];
+  struct act_msg msg;
+  struct reader reader = { 0, framed, 0, 0 };
+  struct timespec start, end;
+  pthread_t thr;
+  unsigned int seq = 0;
+  unsigned long num_bytes = 0;
+  long i;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)
+  {
+    perror("socketpair");
+    exit(1);
+  }
+  reader.sockfd = sv[1];
+  pthread_create(&thr, NULL, reader_thread, &reader);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<num_msgs; i++)
+  {
+    make_msg(&msg, i);
+    if (framed)
+      num_bytes += act_msg_send(sv[0], &msg, &seq);
+    else
+      num_bytes += send(sv[0], &msg, sizeof(msg), 0);
+  }
+  shutdown(sv[0], SHUT_WR);
+  pthread_join(thr, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  close(sv[0]);
+  close(sv[1]);
+  printf("%-12s %7.1f bytes/broadcast  %10.0f messages/s  (%ld received, %ld bad)\n", framed ? "framed:" : "fixed-size:", (double)num_bytes/num_msgs, num_msgs/elapsed_s(&start, &end), reader.num_msgs, reader.num_bad);
+}
+
+/// Feed a stream of frames to a reassembly buffer in random-sized pieces, with garbage between some of them
+static int check_reassembly(void)
+{
+  static char stream[200*ACT_MSG_MAX_FRAME];
+  unsigned int len = 0, pos = 0, i, num_sent = 0, num_recv = 0, errors = 0;
+  struct act_msg msg, recv_msg;
+  struct act_msg_rx *rx = calloc(1, sizeof(struct act_msg_rx));
+  for (i=0; i<150; i++)
+  {
+    make_msg(&msg, i);
+    if (i % 10 == 5)
+    {
+      // fixed-size message from an old client, and a stray magic byte
+      memcpy(&stream[len], &msg, sizeof(msg));
+      len += sizeof(msg);
+      stream[len++] = (char)ACT_MSG_MAGIC;
+    }
+    len += act_msg_frame(&msg, i, &stream[len]);
+    num_sent++;
+  }
+  srand(5);
+  while (pos < len)
+  {
+    unsigned int space, chunk = 1 + rand() % (rand() % 2 ? 3 : 500);
+    char *buf = act_msg_rx_space(rx, &space);
+    if (chunk > space)
+      chunk = space;
+    if (chunk > len - pos)
+      chunk = len - pos;
+    memcpy(buf, &stream[pos], chunk);
+    act_msg_rx_commit(rx, chunk);
+    pos += chunk;
+    while (act_msg_rx_next(rx, &recv_msg))
+    {
+      // old-style messages may happen to contain a valid frame, but these test messages do not
+      make_msg(&msg, num_recv);
+      if (memcmp(&msg, &recv_msg, sizeof(msg)) != 0)
+        errors++;
+      num_recv++;
+    }
+  }
+  printf("Reassembly: %u frames sent in random pieces with garbage, %u received, %u corrupted, %lu garbage bytes skipped, %lu lost\n", num_sent, num_recv, errors, rx->num_bad, rx->num_lost);
+  if ((num_recv != num_sent) || (rx->num_lost != 0))
+    errors++;
+  free(rx);
+  return errors;
+}
+
+int main(int argc, char **argv)
+{
+  long num_msgs = argc >= 2 ? atol(argv[1]) : 1000000;
+  printf("Payload sizes: MT_TIME %u, MT_COORD %u, largest %u bytes; header %u bytes; fixed-size message %u bytes\n", act_msg_payload_len(MT_TIME), act_msg_payload_len(MT_COORD), (unsigned)sizeof(union act_msg_data), (unsigned)sizeof(struct act_msg_hdr), (unsigned)sizeof(struct act_msg));
+  run(num_msgs, 0);
+  run(num_msgs, 1);
+  return check_reassembly() != 0;
+}
@@ -0,0 +1,200 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra `pkg-config --cflags gtk+-2.0` -I../ -I../../../libs/ ./launch_bench.c ../net_basic.c
+ * ../../../libs/act_ipc.c ../../../libs/act_log.c `pkg-config --libs gtk+-2.0` -lpthread -o ./launch_bench
+ *
+ * Cold-start benchmark for launching subprogrammes. Forks a set of dummy programmes that take different times to
+ * start up (in reverse order of launch, so that they connect out of order) before connecting to a listen socket, and
+ * measures how long it takes until all of them are connected
+ *  - the old way, launching one programme at a time and polling accept() with sleep(1) after each launch, and
+ *  - the new way, launching all programmes at once and accepting connections as they arrive, matching each to the
+ *    programme that made it through net_peer_inode and net_pid_has_socket.
+ * Each dummy programme sends its index after connecting, so the benchmark also reports how many connections were
+ * given to the wrong programme. Startup times (in seconds) can be given on the command line:
+ *   ./launch_bench [startup time] ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include "net_basic.h"
+
+#define MAX_PROGS   20
+
+struct dummy_prog
+{
+  double startup_s;
+  pid_t pid;
+  int sockfd;
+};
+
+static double elapsed_s(struct timespec *start)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec)/1.0e9;
+}
+
+/// Start up, connect, send own index and stay alive until killed
+static void dummy_main(int index, double startup_s, const char *port)
+{
+  struct addrinfo hints, *servinfo, *p;
+  struct timespec delay = { (time_t)startup_s, (long)((startup_s - (time_t)startup_s)*1.0e9) };
+  int sockfd = -1;
+  char idx = index, buf;
+  nanosleep(&delay, NULL);
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo("localhost", port, &hints, &servinfo) != 0)
+    _exit(1);
+  for (p = servinfo; p != NULL; p = p->ai_next)
+  {
+    if ((sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+      continue;
+    if (connect(sockfd, p->ai_addr, p->ai_addrlen) == 0)
+      break;
+    close(sockfd);
+    sockfd = -1;
+  }
+  freeaddrinfo(servinfo);
+  if (sockfd < 0)
+    _exit(1);
+  if (send(sockfd, &idx, 1, 0) != 1)
+    _exit(1);
+  while (recv(sockfd, &buf, 1, 0) > 0);
+  _exit(0);
+}
+
+static void launch(struct dummy_prog *prog, int index, const char *port)
+{
+  prog->sockfd = -1;
+  prog->pid = fork();
+  if (prog->pid == 0)
+    dummy_main(index, prog->startup_s, port);
+}
+
+/// Check which programme actually made the connection assigned to each programme and shut them all down
+static int finish(struct dummy_prog *progs, int num_progs)
+{
+  int i, num_wrong = 0;
+  char idx;
+  for (i=0; i<num_progs; i++)
+  {
+    if ((progs[i].sockfd < 0) || (recv(progs[i].sockfd, &idx, 1, MSG_WAITALL) != 1) || (idx != i))
+      num_wrong++;
+  }
+  // later programmes inherit the connections of earlier ones, so closing them does not end the programmes
+  for (i=0; i<num_progs; i++)
+  {
+    if (progs[i].sockfd >= 0)
+      close(progs[i].sockfd);
+    kill(progs[i].pid, SIGTERM);
+    waitpid(progs[i].pid, NULL, 0);
+  }
+  return num_wrong;
+}
+
+/// The old start_prog: launch, then poll accept() once a second for up to 10 seconds
+static void run_sequential(int listen_sockfd, const char *port, struct dummy_prog *progs, int num_progs)
+{
+  struct timespec start;
+  int i, j;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<num_progs; i++)
+  {
+    launch(&progs[i], i, port);
+    for (j=0; j<10 && progs[i].sockfd<0; j++)
+    {
+      progs[i].sockfd = accept(listen_sockfd, NULL, NULL);
+      sleep(1);
+    }
+  }
+  double t = elapsed_s(&start);
+  printf("Sequential launch: all programmes connected after %6.2f s, %d connections given to the wrong programme\n", t, finish(progs, num_progs));
+}
+
+/// The new start_prog/accept_progs: launch everything, then accept and match connections as they arrive
+static void run_parallel(int listen_sockfd, const char *port, struct dummy_prog *progs, int num_progs)
+{
+  struct timespec start;
+  struct pollfd pfd = { listen_sockfd, POLLIN, 0 };
+  int i, num_connected = 0, num_unmatched = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<num_progs; i++)
+    launch(&progs[i], i, port);
+  while ((num_connected < num_progs) && (elapsed_s(&start) < 10.0))
+  {
+    if (poll(&pfd, 1, 1000) <= 0)
+      continue;
+    int new_fd;
+    while ((new_fd = accept(listen_sockfd, NULL, NULL)) >= 0)
+    {
+      unsigned long inode = net_peer_inode(new_fd);
+      for (i=0; i<num_progs; i++)
+      {
+        if ((progs[i].sockfd < 0) && (inode != 0) && net_pid_has_socket(progs[i].pid, inode))
+          break;
+      }
+      if (i == num_progs)
+      {
+        num_unmatched++;
+        for (i=0; (i<num_progs) && (progs[i].sockfd >= 0); i++);
+      }
+      if (i < num_progs)
+        progs[i].sockfd = new_fd;
+      num_connected++;
+    }
+  }
+  double t = elapsed_s(&start);
+  printf("Parallel launch:   all programmes connected after %6.2f s, %d connections given to the wrong programme (%d not identified)\n", t, finish(progs, num_progs), num_unmatched);
+}
+
+int main(int argc, char **argv)
+{
+  struct dummy_prog progs[MAX_PROGS];
+  double default_startup_s[] = { 1.5, 1.2, 0.9, 0.6, 0.4, 0.2, 0.1 };
+  int i, num_progs;
+  char port[10];
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+
+  if (argc > 1)
+  {
+    num_progs = argc-1 < MAX_PROGS ? argc-1 : MAX_PROGS;
+    for (i=0; i<num_progs; i++)
+      progs[i].startup_s = atof(argv[i+1]);
+  }
+  else
+  {
+    num_progs = sizeof(default_startup_s)/sizeof(default_startup_s[0]);
+    for (i=0; i<num_progs; i++)
+      progs[i].startup_s = default_startup_s[i];
+  }
+
+  int listen_sockfd = net_setup("0");
+  if ((listen_sockfd < 0) || (getsockname(listen_sockfd, (struct sockaddr *)&addr, &addr_len) != 0))
+  {
+    fprintf(stderr, "Could not set up listen socket\n");
+    return 1;
+  }
+  if (addr.ss_family == AF_INET6)
+    snprintf(port, sizeof(port), "%hu", ntohs(((struct sockaddr_in6 *)&addr)->sin6_port));
+  else
+    snprintf(port, sizeof(port), "%hu", ntohs(((struct sockaddr_in *)&addr)->sin_port));
+  printf("Launching %d programmes, listening on port %s\n", num_progs, port);
+
+  run_sequential(listen_sockfd, port, progs, num_progs);
+  run_parallel(listen_sockfd, port, progs, num_progs);
+  close(listen_sockfd);
+  return 0;
+}
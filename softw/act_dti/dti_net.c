@@ -412,7 +412,15 @@ gint dti_net_send(DtiNet *dti_net, DtiMsg *msg)
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_write_chars (dti_net->net_chan, (gchar *)(&msg->msg), sizeof(struct act_msg), &num_bytes, &error);
+  static unsigned int tx_seq = 0;
+  gchar frame[ACT_MSG_MAX_FRAME];
+  gsize frame_len = act_msg_frame(&msg->msg, tx_seq, frame);
+  if (frame_len == 0)
+  {
+    act_log_error(act_log_msg("Cannot send message with invalid type %hhd.", (&msg->msg)->mtype));
+    return -1;
+  }
+  status = g_io_channel_write_chars (dti_net->net_chan, frame, frame_len, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("Error sending message - %s", error->message));
@@ -424,11 +432,12 @@ gint dti_net_send(DtiNet *dti_net, DtiMsg *msg)
     act_log_error(act_log_msg("Incorrect status returned while attempting to send message over network."));
     return -1;
   }
-  if (num_bytes != sizeof(struct act_msg))
+  if (num_bytes != frame_len)
   {
     act_log_error(act_log_msg("Entire message was not transmitted (%d bytes)", num_bytes));
     return -1;
   }
+  tx_seq++;
   return num_bytes;
 }
 
@@ -473,11 +482,14 @@ static gboolean net_read_ready(GIOChannel *net_chan, GIOCondition cond, gpointer
   (void) cond;
   (void) dti_net;
 //   DtiNet *objs = DTI_NET(dti_net);
+  static struct act_msg_rx net_rx;
   struct act_msg msgbuf;
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_read_chars (net_chan, (gchar *)&msgbuf, sizeof(msgbuf), &num_bytes, &error);
+  unsigned int rx_space;
+  gchar *rx_buf = act_msg_rx_space(&net_rx, &rx_space);
+  status = g_io_channel_read_chars (net_chan, rx_buf, rx_space, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("An error occurred while attempting to read message from network - ", error->message));
@@ -489,12 +501,11 @@ static gboolean net_read_ready(GIOChannel *net_chan, GIOCondition cond, gpointer
     act_log_error(act_log_msg("Incorrect status returned while attempting to read message from network."));
     return TRUE;
   }
-  if (num_bytes != sizeof(msgbuf))
+  act_msg_rx_commit(&net_rx, num_bytes);
+  while (act_msg_rx_next(&net_rx, &msgbuf))
   {
-    act_log_error(act_log_msg("Received message has invalid length: %d", num_bytes));
-    return TRUE;
+    DtiMsg *msg = dti_msg_new(&msgbuf, 0);
+    g_signal_emit(G_OBJECT(dti_net), dti_net_signals[MSG_RECV_SIGNAL], 0, msg);
   }
-  DtiMsg *msg = dti_msg_new(&msgbuf, 0);
-  g_signal_emit(G_OBJECT(dti_net), dti_net_signals[MSG_RECV_SIGNAL], 0, msg);
   return TRUE;
 }
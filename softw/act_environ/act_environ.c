@@ -45,7 +45,15 @@ int net_send(GIOChannel *channel, struct act_msg *msg)
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_write_chars (channel, (gchar *)msg, sizeof(struct act_msg), &num_bytes, &error);
+  static unsigned int tx_seq = 0;
+  gchar frame[ACT_MSG_MAX_FRAME];
+  gsize frame_len = act_msg_frame(msg, tx_seq, frame);
+  if (frame_len == 0)
+  {
+    act_log_error(act_log_msg("Cannot send message with invalid type %hhd.", (msg)->mtype));
+    return -1;
+  }
+  status = g_io_channel_write_chars (channel, frame, frame_len, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("Error sending message - %s", error->message));
@@ -57,11 +65,12 @@ int net_send(GIOChannel *channel, struct act_msg *msg)
     act_log_error(act_log_msg("Incorrect status returned while attempting to send message over network."));
     return -1;
   }
-  if (num_bytes != sizeof(struct act_msg))
+  if (num_bytes != frame_len)
   {
     act_log_error(act_log_msg("Entire message was not transmitted (%d bytes)", num_bytes));
     return -1;
   }
+  tx_seq++;
   return num_bytes;
 }
 
@@ -82,11 +91,14 @@ gboolean read_net_message (GIOChannel *source, GIOCondition condition, gpointer
 {
   (void)condition;
 //   struct formobjects *objs = (struct formobjects *)net_read_data;
+  static struct act_msg_rx net_rx;
   struct act_msg msgbuf;
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_read_chars (source, (gchar *)&msgbuf, sizeof(msgbuf), &num_bytes, &error);
+  unsigned int rx_space;
+  gchar *rx_buf = act_msg_rx_space(&net_rx, &rx_space);
+  status = g_io_channel_read_chars (source, rx_buf, rx_space, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("An error occurred while attempting to read message from network - ", error->message));
@@ -98,134 +110,133 @@ gboolean read_net_message (GIOChannel *source, GIOCondition condition, gpointer
     act_log_error(act_log_msg("Incorrect status returned while attempting to read message from network."));
     return TRUE;
   }
-  if (num_bytes != sizeof(msgbuf))
-  {
-    act_log_error(act_log_msg("Received message has invalid length: %d", num_bytes));
-    return TRUE;
-  }
-  switch (msgbuf.mtype)
+  act_msg_rx_commit(&net_rx, num_bytes);
+  while (act_msg_rx_next(&net_rx, &msgbuf))
   {
-    case MT_QUIT:
-    {
-      gtk_main_quit();
-      break;
-    }
-    case MT_CAP:
+    switch (msgbuf.mtype)
     {
-      struct act_msg_cap *cap_msg = &msgbuf.content.msg_cap;
-      cap_msg->service_provides = SERVICE_ENVIRON;
-      cap_msg->service_needs = SERVICE_TIME | SERVICE_COORD;
-      cap_msg->targset_prov = TARGSET_ENVIRON;
-      cap_msg->datapmt_prov = DATAPMT_ENVIRON;
-      cap_msg->dataccd_prov = DATACCD_ENVIRON;
-      snprintf(cap_msg->version_str,MAX_VERSION_LEN, "%d.%d", MAJOR_VER, MINOR_VER);
-      msgbuf.mtype = MT_CAP;
-      if (net_send(source, &msgbuf) != sizeof(msgbuf))
-        act_log_error(act_log_msg("Failed to send capabilities response message."));
-      break;
-    }
-    case MT_STAT:
-    {
-      if (msgbuf.content.msg_stat.status != 0)
+      case MT_QUIT:
+      {
+        gtk_main_quit();
         break;
-      msgbuf.content.msg_stat.status = PROGSTAT_RUNNING;
-      if (net_send(source, &msgbuf) != sizeof(msgbuf))
-        act_log_error(act_log_msg("Failed to send status response message."));
-      break;
-    }
-    case MT_GUISOCK:
-    {
-      if (msgbuf.content.msg_guisock.gui_socket <= 0)
+      }
+      case MT_CAP:
       {
-        act_log_debug(act_log_msg("Received invalid GUI socket ID (%d)", msgbuf.content.msg_guisock.gui_socket));
+        struct act_msg_cap *cap_msg = &msgbuf.content.msg_cap;
+        cap_msg->service_provides = SERVICE_ENVIRON;
+        cap_msg->service_needs = SERVICE_TIME | SERVICE_COORD;
+        cap_msg->targset_prov = TARGSET_ENVIRON;
+        cap_msg->datapmt_prov = DATAPMT_ENVIRON;
+        cap_msg->dataccd_prov = DATACCD_ENVIRON;
+        snprintf(cap_msg->version_str,MAX_VERSION_LEN, "%d.%d", MAJOR_VER, MINOR_VER);
+        msgbuf.mtype = MT_CAP;
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send capabilities response message."));
         break;
       }
-      GtkWidget *plug = gtk_widget_get_parent(GTK_WIDGET(env_weather));
-      if (plug != NULL)
+      case MT_STAT:
       {
-        gtk_container_remove(GTK_CONTAINER(plug), GTK_WIDGET(env_weather));
-        gtk_widget_destroy(plug);
+        if (msgbuf.content.msg_stat.status != 0)
+          break;
+        msgbuf.content.msg_stat.status = PROGSTAT_RUNNING;
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send status response message."));
+        break;
       }
-      plug = gtk_plug_new(msgbuf.content.msg_guisock.gui_socket);
-      act_log_normal(act_log_msg("Received GUI socket (%d).", msgbuf.content.msg_guisock.gui_socket));
-      gtk_container_add(GTK_CONTAINER(plug),GTK_WIDGET(env_weather));
-      g_signal_connect(G_OBJECT(plug),"destroy",G_CALLBACK(destroy_plug),GTK_WIDGET(env_weather));
-      gtk_widget_show_all(plug);
-      break;
-    }
-    case MT_COORD:
-    {
-      env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
-      break;
-    }
-    case MT_TIME:
-    {
-      env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
-      break;
-    }
-    case MT_ENVIRON:
-    {
-      act_log_debug(act_log_msg("Strange: Received an ENVIRONMENT message. Responding with latest environment message."));
-      env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
-      if (net_send(source, &msgbuf) != sizeof(msgbuf))
-        act_log_error(act_log_msg("Failed to send (unexpected) ENVIRONMENT message response."));
-      break;
-    }
-    case MT_TARG_CAP:
-    {
-      if (msgbuf.content.msg_targcap.targset_stage != TARGSET_ENVIRON)
+      case MT_GUISOCK:
       {
-        msgbuf.content.msg_targcap.targset_stage = TARGSET_ENVIRON;
-        if (net_send(source, &msgbuf) != sizeof(msgbuf))
-          act_log_error(act_log_msg("Failed to send response to TARGCAP request."));
+        if (msgbuf.content.msg_guisock.gui_socket <= 0)
+        {
+          act_log_debug(act_log_msg("Received invalid GUI socket ID (%d)", msgbuf.content.msg_guisock.gui_socket));
+          break;
+        }
+        GtkWidget *plug = gtk_widget_get_parent(GTK_WIDGET(env_weather));
+        if (plug != NULL)
+        {
+          gtk_container_remove(GTK_CONTAINER(plug), GTK_WIDGET(env_weather));
+          gtk_widget_destroy(plug);
+        }
+        plug = gtk_plug_new(msgbuf.content.msg_guisock.gui_socket);
+        act_log_normal(act_log_msg("Received GUI socket (%d).", msgbuf.content.msg_guisock.gui_socket));
+        gtk_container_add(GTK_CONTAINER(plug),GTK_WIDGET(env_weather));
+        g_signal_connect(G_OBJECT(plug),"destroy",G_CALLBACK(destroy_plug),GTK_WIDGET(env_weather));
+        gtk_widget_show_all(plug);
+        break;
       }
-      break;
-    }
-    case MT_TARG_SET:
-    {
-      env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
-      if (net_send(source, &msgbuf) != sizeof(msgbuf))
-        act_log_error(act_log_msg("Failed to send TARGSET response."));
-      break;
-    }
-    case MT_PMT_CAP:
-    {
-      if (msgbuf.content.msg_pmtcap.datapmt_stage != DATAPMT_ENVIRON)
+      case MT_COORD:
       {
-        msgbuf.content.msg_pmtcap.datapmt_stage = DATAPMT_ENVIRON;
-        if (net_send(source, &msgbuf) != sizeof(msgbuf))
-          act_log_error(act_log_msg("Failed to send response to PMTCAP request."));
+        env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
+        break;
       }
-      break;
-    }
-    case MT_DATA_PMT:
-    {
-      env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
-      if (net_send(source, &msgbuf) != sizeof(msgbuf))
-        act_log_error(act_log_msg("Failed to send DATAPMT response."));
-      break;
-    }
-    case MT_CCD_CAP:
-    {
-      if (msgbuf.content.msg_ccdcap.dataccd_stage != DATACCD_ENVIRON)
+      case MT_TIME:
       {
-        msgbuf.content.msg_ccdcap.dataccd_stage = DATACCD_ENVIRON;
-        if (net_send(source, &msgbuf) != sizeof(msgbuf))
-          act_log_error(act_log_msg("Failed to send response to CCDCAP request."));
+        env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
+        break;
+      }
+      case MT_ENVIRON:
+      {
+        act_log_debug(act_log_msg("Strange: Received an ENVIRONMENT message. Responding with latest environment message."));
+        env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send (unexpected) ENVIRONMENT message response."));
+        break;
+      }
+      case MT_TARG_CAP:
+      {
+        if (msgbuf.content.msg_targcap.targset_stage != TARGSET_ENVIRON)
+        {
+          msgbuf.content.msg_targcap.targset_stage = TARGSET_ENVIRON;
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Failed to send response to TARGCAP request."));
+        }
+        break;
+      }
+      case MT_TARG_SET:
+      {
+        env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send TARGSET response."));
+        break;
+      }
+      case MT_PMT_CAP:
+      {
+        if (msgbuf.content.msg_pmtcap.datapmt_stage != DATAPMT_ENVIRON)
+        {
+          msgbuf.content.msg_pmtcap.datapmt_stage = DATAPMT_ENVIRON;
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Failed to send response to PMTCAP request."));
+        }
+        break;
+      }
+      case MT_DATA_PMT:
+      {
+        env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send DATAPMT response."));
+        break;
+      }
+      case MT_CCD_CAP:
+      {
+        if (msgbuf.content.msg_ccdcap.dataccd_stage != DATACCD_ENVIRON)
+        {
+          msgbuf.content.msg_ccdcap.dataccd_stage = DATACCD_ENVIRON;
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Failed to send response to CCDCAP request."));
+        }
+        break;
+      }
+      case MT_DATA_CCD:
+      {
+        env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send DATACCD response."));
+        break;
+      }
+      default:
+      {
+        if (msgbuf.mtype >= MT_INVAL)
+          act_log_error(act_log_msg("Invalid message type received."));
       }
-      break;
-    }
-    case MT_DATA_CCD:
-    {
-      env_weather_process_msg(GTK_WIDGET(env_weather), &msgbuf);
-      if (net_send(source, &msgbuf) != sizeof(msgbuf))
-        act_log_error(act_log_msg("Failed to send DATACCD response."));
-      break;
-    }
-    default:
-    {
-      if (msgbuf.mtype >= MT_INVAL)
-        act_log_error(act_log_msg("Invalid message type received."));
     }
   }
   int new_cond = g_io_channel_get_buffer_condition (source);
@@ -299,7 +310,7 @@ gboolean timeout_check_gui(gpointer check_gui_objs)
   struct act_msg guimsg;
   memset(&guimsg, 0, sizeof(struct act_msg));
   guimsg.mtype = MT_GUISOCK;
-  if (net_send(net_chan, &guimsg) != sizeof(struct act_msg))
+  if (net_send(net_chan, &guimsg) < 0)
     act_log_error(act_log_msg("Error sending GUI socket request message."));
   return TRUE;
 }
@@ -310,7 +321,7 @@ void update_weather(GtkWidget *env_weather, gpointer net_chan)
   memset(&envmsg, 0, sizeof(struct act_msg));
   envmsg.mtype = MT_ENVIRON;
   env_weather_process_msg(env_weather, &envmsg);
-  if (net_send(net_chan, &envmsg) != sizeof(struct act_msg))
+  if (net_send(net_chan, &envmsg) < 0)
     act_log_error(act_log_msg("Error sending environment message."));
 }
 
@@ -135,6 +135,7 @@ static void instance_init(GtkWidget *env_weather)
   convert_D_DMS_alt(SUN_ALT_LIMIT_DEG+1, &objs->all_env.sun_alt);
   convert_H_HMSMS_ra(0.0, &objs->all_env.moon_ra);
   convert_D_DMS_dec(0.0, &objs->all_env.moon_dec);
+  objs->ephem = NULL;
   
   objs->box_main = gtk_table_new(8, 1, FALSE);
   gtk_container_add(GTK_CONTAINER(objs), objs->box_main);
@@ -262,6 +263,8 @@ static void instance_dispose(GObject *env_weather)
     objs->swasp_weath = NULL;
   }
   objs->swasp_ok = FALSE;
+  act_ephem_free(objs->ephem);
+  objs->ephem = NULL;
   
   if (objs->update_to_id != 0)
   {
@@ -541,15 +544,18 @@ static void process_msg_time(EnvWeather *objs, struct act_msg_time *msg_time)
   swasp_weath_set_time(objs->swasp_weath, msg_time->gjd);
   salt_weath_set_time(objs->salt_weath, msg_time->gjd);
   
-  struct rastruct tmp_sun_ra;
-  struct decstruct tmp_sun_dec;
-  calc_sun (msg_time->gjd, NULL, NULL, &tmp_sun_ra, &tmp_sun_dec, NULL);
-  struct hastruct tmp_sun_ha;
-  calc_HAngle (&tmp_sun_ra, &msg_time->sidt, &tmp_sun_ha);
-  struct altstruct tmp_sun_alt;
-  convert_EQUI_ALTAZ (&tmp_sun_ha, &tmp_sun_dec, &tmp_sun_alt, NULL);
-  memcpy(&objs->all_env.sun_alt, &tmp_sun_alt, sizeof(struct altstruct));
-  double sun_alt_d = convert_DMS_D_alt(&tmp_sun_alt);
+  if (!act_ephem_covers(objs->ephem, msg_time->gjd))
+  {
+    act_ephem_free(objs->ephem);
+    objs->ephem = act_ephem_new_night(msg_time->gjd);
+    if (objs->ephem == NULL)
+    {
+      act_log_error(act_log_msg("Failed to calculate ephemeris tables for the night."));
+      return;
+    }
+  }
+  double sun_alt_d = convert_RAD_DEG(act_ephem_sun_alt(objs->ephem, msg_time->gjd));
+  convert_D_DMS_alt(sun_alt_d, &objs->all_env.sun_alt);
   char sun_alt_str[20];
   sprintf(sun_alt_str, "%6.2f°", sun_alt_d);
   gtk_label_set_text(GTK_LABEL(objs->lbl_sunalt), sun_alt_str);
@@ -575,7 +581,10 @@ static void process_msg_time(EnvWeather *objs, struct act_msg_time *msg_time)
   }
   gtk_widget_modify_bg(objs->evb_active_mode, GTK_STATE_NORMAL, &new_col);
   
-  calc_moon_pos (msg_time->gjd/36525.0, &objs->all_env.moon_ra, &objs->all_env.moon_dec);
+  double moon_ra_rad, moon_dec_rad;
+  act_ephem_moon(objs->ephem, msg_time->gjd, &moon_ra_rad, &moon_dec_rad);
+  convert_H_HMSMS_ra(convert_RAD_H(moon_ra_rad), &objs->all_env.moon_ra);
+  convert_D_DMS_dec(convert_RAD_DEG(moon_dec_rad), &objs->all_env.moon_dec);
   char moon_pos_str[40];
   sprintf(moon_pos_str, "%6.2fh %6.2f°", convert_HMSMS_H_ra(&objs->all_env.moon_ra), convert_DMS_D_dec(&objs->all_env.moon_dec));
   gtk_label_set_text(GTK_LABEL(objs->lbl_moonpos), moon_pos_str);
@@ -6,6 +6,7 @@
 #include <gtk/gtkeventbox.h>
 #include <libsoup/soup.h>
 #include <act_ipc.h>
+#include <act_ephem.h>
 #include "swasp_weath.h"
 #include "salt_weath.h"
 
@@ -28,6 +29,7 @@ struct _EnvWeather
   gboolean salt_ok, swasp_ok;
   SaltWeath *salt_weath;
   SwaspWeath *swasp_weath;
+  struct act_ephem *ephem;
 
   GtkWidget *box_main;
   GtkWidget *evb_swasp_stat, *evb_salt_stat;
@@ -60,7 +60,7 @@ struct maninteg_objects
   int userid;
   
   GtkWidget *ent_username, *ent_targname, *chk_sky;
-  GtkWidget *spn_sampling, *spn_prebin, *spn_repeat;
+  GtkWidget *spn_sampling, *spn_prebin, *spn_repeat, *chk_ttag;
   GtkWidget *cmb_filtspec, *cmb_aperspec;
 };
 
@@ -72,6 +72,7 @@ static char G_maninteg_sky = FALSE;
 static double G_maninteg_sampleperiod = 0.001;
 static int G_maninteg_prebin = 1;
 static int G_maninteg_repeat = 1;
+static char G_maninteg_ttag = FALSE;
 static char G_maninteg_filtid = -1;
 static char G_maninteg_aperid = -1;
 static struct act_msg_pmtcap G_pmtcaps;
@@ -81,7 +82,15 @@ char net_send(GIOChannel *channel, struct act_msg *msg)
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_write_chars (channel, (gchar *)msg, sizeof(struct act_msg), &num_bytes, &error);
+  static unsigned int tx_seq = 0;
+  gchar frame[ACT_MSG_MAX_FRAME];
+  gsize frame_len = act_msg_frame(msg, tx_seq, frame);
+  if (frame_len == 0)
+  {
+    act_log_error(act_log_msg("Cannot send message with invalid type %hhd.", (msg)->mtype));
+    return -1;
+  }
+  status = g_io_channel_write_chars (channel, frame, frame_len, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("Error sending message - %s", error->message));
@@ -93,11 +102,12 @@ char net_send(GIOChannel *channel, struct act_msg *msg)
     act_log_error(act_log_msg("Incorrect status returned while attempting to send message over network."));
     return -1;
   }
-  if (num_bytes != sizeof(struct act_msg))
+  if (num_bytes != frame_len)
   {
     act_log_error(act_log_msg("Entire message was not transmitted (%d bytes)", num_bytes));
     return -1;
   }
+  tx_seq++;
   return num_bytes;
 }
 
@@ -217,6 +227,7 @@ void manual_integ_dialog_destroy(gpointer user_data)
   g_object_unref(objs->spn_sampling);
   g_object_unref(objs->spn_prebin);
   g_object_unref(objs->spn_repeat);
+  g_object_unref(objs->chk_ttag);
   g_object_unref(objs->cmb_filtspec);
   g_object_unref(objs->cmb_aperspec);
   free(objs);
@@ -289,6 +300,8 @@ void manual_integ_response(GtkWidget *dialog, int response_id, gpointer user_dat
   pmtinteg->sample_period_s = G_maninteg_sampleperiod = gtk_spin_button_get_value(GTK_SPIN_BUTTON(objs->spn_sampling));
   pmtinteg->prebin = G_maninteg_prebin = gtk_spin_button_get_value(GTK_SPIN_BUTTON(objs->spn_prebin));
   pmtinteg->repetitions = G_maninteg_repeat = gtk_spin_button_get_value(GTK_SPIN_BUTTON(objs->spn_repeat));
+  G_maninteg_ttag = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(objs->chk_ttag));
+  pmtinteg->mode = G_maninteg_ttag ? PMT_MODE_TTAG : PMT_MODE_INTEG;
   memcpy(&pmtinteg->filter, &filter, sizeof(struct filtaper));
   G_maninteg_filtid = filter.db_id;
   memcpy(&pmtinteg->aperture, &aperture, sizeof(struct filtaper));
@@ -501,7 +514,14 @@ void manual_integ_dialog(gpointer user_data)
   gtk_table_attach(GTK_TABLE(box_content), gtk_hseparator_new(), 0, 6, 4, 5, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
   
   gtk_table_attach(GTK_TABLE(box_content), gtk_label_new("Sample period (s)"), 0, 3, 5, 6, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
-  objs->spn_sampling = gtk_spin_button_new_with_range(pmtcaps.min_sample_period_s, pmtcaps.max_sample_period_s, pmtcaps.min_sample_period_s);
+  // Time-tagged photons can be binned with sample periods shorter than the driver's
+  if (pmtcaps.pmt_mode & PMT_MODE_TTAG)
+  {
+    objs->spn_sampling = gtk_spin_button_new_with_range(0.00001, pmtcaps.max_sample_period_s, pmtcaps.min_sample_period_s);
+    gtk_spin_button_set_digits(GTK_SPIN_BUTTON(objs->spn_sampling), 5);
+  }
+  else
+    objs->spn_sampling = gtk_spin_button_new_with_range(pmtcaps.min_sample_period_s, pmtcaps.max_sample_period_s, pmtcaps.min_sample_period_s);
   g_object_ref(objs->spn_sampling);
   gtk_spin_button_set_value(GTK_SPIN_BUTTON(objs->spn_sampling), G_maninteg_sampleperiod);
   gtk_table_attach(GTK_TABLE(box_content), objs->spn_sampling, 3, 6, 5, 6, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
@@ -577,6 +597,12 @@ void manual_integ_dialog(gpointer user_data)
   }
   gtk_table_attach(GTK_TABLE(box_content), objs->cmb_aperspec, 3, 6, 10, 11, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);  
   
+  objs->chk_ttag = gtk_check_button_new_with_label("Time-tag photons");
+  g_object_ref(objs->chk_ttag);
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(objs->chk_ttag), G_maninteg_ttag && (pmtcaps.pmt_mode & PMT_MODE_TTAG));
+  gtk_widget_set_sensitive(objs->chk_ttag, (pmtcaps.pmt_mode & PMT_MODE_TTAG) != 0);
+  gtk_table_attach(GTK_TABLE(box_content), objs->chk_ttag, 0, 6, 11, 12, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
+  
   gtk_widget_show_all(dialog);
   gtk_window_set_keep_above (GTK_WINDOW(dialog), TRUE);
   g_signal_connect(G_OBJECT(dialog), "response", G_CALLBACK(manual_integ_response), objs);
@@ -649,7 +675,9 @@ gboolean timeout_check_phot(gpointer user_data)
   pmt_reg_checks(objs->pmtdetail);
   if ((pmt_probing(objs->pmtdetail->pmt_stat)) && (!pmt_probing(old_pmt_stat)))
     view_probe_start(objs->photview_objs);
-  if ((!pmt_integrating(objs->pmtdetail->pmt_stat)) && (!pmt_data_ready(objs->pmtdetail->pmt_stat)))
+  // A time-tag run that ends without leaving time tags unread still has to be finished off
+  char ttag_pending = (objs->pmtinteg != NULL) && (objs->pmtinteg->mode == PMT_MODE_TTAG) && (!pmt_probing(objs->pmtdetail->pmt_stat));
+  if ((!pmt_integrating(objs->pmtdetail->pmt_stat)) && (!pmt_data_ready(objs->pmtdetail->pmt_stat)) && (!ttag_pending))
   {
     act_log_debug(act_log_msg("Not integrating."));
     view_set_pmtdetail(objs->photview_objs, objs->pmtdetail);
@@ -676,21 +704,12 @@ gboolean timeout_check_phot(gpointer user_data)
   }
   if (num_data > 0)
   {
-    storeinteg(objs->store_objs, objs->pmtinteg, num_data);
-    view_dispinteg(objs->photview_objs, objs->pmtinteg);
-    plot_add_data(objs->plot_objs, objs->pmtinteg);
-    objs->pmtinteg = free_integ_data(objs->pmtinteg);
-    if (objs->pmtinteg == NULL)
-    {
-      integ_check_err(objs, "An unkown error occurred while integrating.");
-      return TRUE;
-    }
-  }
-  if (objs->pmtinteg->done > 0)
-  {
-    act_log_debug(act_log_msg("Strange: Last integration data structure isn't a dummy."));
-    if (!pmt_integrating(objs->pmtdetail->pmt_stat))
-      objs->pmtinteg->done = -1;
+    struct sampring *samples = &objs->pmtdetail->samples;
+    storeinteg(objs->store_objs, samples, objs->pmtinteg, num_data);
+    view_dispinteg(objs->photview_objs, samples, objs->pmtinteg);
+    plot_add_data(objs->plot_objs, samples, objs->pmtinteg);
+    // Every consumer has read the new samples
+    sampring_release(samples, samples->head);
   }
   if (objs->pmtinteg->done == 0)
     view_update_integ(objs->photview_objs, objs->pmtinteg);
@@ -721,6 +740,19 @@ gboolean timeout_check_phot(gpointer user_data)
   return TRUE;
 }
 
+/** \brief Called when the PMT driver reports that its integration data ring is filling up (PMTRING_WAKE_NUM unread
+ * records) or that records were left unread when an integration stopped.
+ *
+ * Drains the ring straight away instead of waiting for the next photometry check, so that no data is lost when the
+ * main loop has been held up.
+ */
+gboolean pmt_ring_ready(GIOChannel *source, GIOCondition condition, gpointer user_data)
+{
+  act_log_debug(act_log_msg("PMT integration data ring needs draining."));
+  timeout_check_phot(user_data);
+  return TRUE;
+}
+
 /** \brief Check for incoming messages over network connection.
  * \param box_main GTK box containing all graphical objects.
  * \param main_embedded Flag indicating whether box_main is embedded in a plug.
@@ -738,11 +770,14 @@ gboolean read_net_message (GIOChannel *source, GIOCondition condition, gpointer
 {
   (void)condition;
   struct formobjects *objs = (struct formobjects *)net_read_data;
+  static struct act_msg_rx net_rx;
   struct act_msg msgbuf;
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_read_chars (source, (gchar *)&msgbuf, sizeof(msgbuf), &num_bytes, &error);
+  unsigned int rx_space;
+  gchar *rx_buf = act_msg_rx_space(&net_rx, &rx_space);
+  status = g_io_channel_read_chars (source, rx_buf, rx_space, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("An error occurred while attempting to read message from network - ", error->message));
@@ -754,193 +789,193 @@ gboolean read_net_message (GIOChannel *source, GIOCondition condition, gpointer
     act_log_error(act_log_msg("Incorrect status returned while attempting to read message from network."));
     return TRUE;
   }
-  if (num_bytes != sizeof(msgbuf))
+  act_msg_rx_commit(&net_rx, num_bytes);
+  while (act_msg_rx_next(&net_rx, &msgbuf))
   {
-    act_log_error(act_log_msg("Received message has invalid length: %d", num_bytes));
-    return TRUE;
-  }
-  switch (msgbuf.mtype)
-  {
-    case MT_QUIT:
-    {
-      gtk_main_quit();
-      break;
-    }
-    case MT_CAP:
-    {
-      struct act_msg_cap *cap_msg = &msgbuf.content.msg_cap;
-      cap_msg->service_provides = 0;
-      cap_msg->service_needs = SERVICE_TIME;
-      cap_msg->targset_prov = 0;
-      cap_msg->datapmt_prov = DATAPMT_PHOTOM;
-      cap_msg->dataccd_prov = 0;
-      snprintf(cap_msg->version_str,MAX_VERSION_LEN, "%d.%d", MAJOR_VER, MINOR_VER);
-      msgbuf.mtype = MT_CAP;
-      if (net_send(source, &msgbuf) < 0)
-        act_log_error(act_log_msg("Failed to send capabilities response message."));
-      break;
-    }
-    case MT_STAT:
-    {
-      if (msgbuf.content.msg_stat.status != 0)
-        break;
-      if (gtk_widget_get_parent(GTK_WIDGET(objs->box_main)) == NULL)
-        msgbuf.content.msg_stat.status = PROGSTAT_STARTUP;
-      else
-        msgbuf.content.msg_stat.status = PROGSTAT_RUNNING;
-      if (net_send(source, &msgbuf) < 0)
-        act_log_error(act_log_msg("Failed to send status response message."));
-      break;
-    }
-    case MT_GUISOCK:
+    switch (msgbuf.mtype)
     {
-      if (gtk_widget_get_parent(GTK_WIDGET(objs->box_main)) != NULL)
+      case MT_QUIT:
       {
-        act_log_debug(act_log_msg("GUI already embedded."));
+        gtk_main_quit();
         break;
       }
-      if (msgbuf.content.msg_guisock.gui_socket == 0)
+      case MT_CAP:
       {
-        act_log_error(act_log_msg("Received 0 GUI socket."));
+        struct act_msg_cap *cap_msg = &msgbuf.content.msg_cap;
+        cap_msg->service_provides = 0;
+        cap_msg->service_needs = SERVICE_TIME;
+        cap_msg->targset_prov = 0;
+        cap_msg->datapmt_prov = DATAPMT_PHOTOM;
+        cap_msg->dataccd_prov = 0;
+        snprintf(cap_msg->version_str,MAX_VERSION_LEN, "%d.%d", MAJOR_VER, MINOR_VER);
+        msgbuf.mtype = MT_CAP;
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send capabilities response message."));
         break;
       }
-      GtkWidget *plug = gtk_widget_get_parent(objs->box_main);
-      if (plug != NULL)
-      {
-        gtk_container_remove(GTK_CONTAINER(plug), objs->box_main);
-        gtk_widget_destroy(plug);
-      }
-      plug = gtk_plug_new(msgbuf.content.msg_guisock.gui_socket);
-      act_log_normal(act_log_msg("Received GUI socket (%d).", msgbuf.content.msg_guisock.gui_socket));
-      gtk_container_add(GTK_CONTAINER(plug),objs->box_main);
-      g_signal_connect(G_OBJECT(plug),"destroy",G_CALLBACK(destroy_plug),objs->box_main);
-      gtk_widget_show_all(plug);
-      break;
-    }
-    case MT_TIME:
-    {
-      struct act_msg_time *msg_time = &msgbuf.content.msg_time;
-      pmt_set_datetime(objs->pmtdetail, &msg_time->unid, &msg_time->unit);
-      view_set_date(objs->photview_objs, &msg_time->unid);
-      break;
-    }
-    case MT_PMT_CAP:
-    {
-      struct act_msg_pmtcap *msg_pmtcap = (struct act_msg_pmtcap *)&msgbuf.content.msg_pmtcap;
-      if (msg_pmtcap->datapmt_stage != DATAPMT_PHOTOM)
+      case MT_STAT:
       {
-        pmt_get_caps(objs->pmtdetail, msg_pmtcap);
+        if (msgbuf.content.msg_stat.status != 0)
+          break;
+        if (gtk_widget_get_parent(GTK_WIDGET(objs->box_main)) == NULL)
+          msgbuf.content.msg_stat.status = PROGSTAT_STARTUP;
+        else
+          msgbuf.content.msg_stat.status = PROGSTAT_RUNNING;
         if (net_send(source, &msgbuf) < 0)
-          act_log_error(act_log_msg("Error sending PMT capabilities response message over network connection."));
-      }
-      else
-        memcpy(&G_pmtcaps, msg_pmtcap, sizeof(struct act_msg_pmtcap));
-      break;
-    }
-    case MT_DATA_PMT:
-    {
-      act_log_debug(act_log_msg("Received DATA_PMT message."));
-      struct act_msg_datapmt *msg_datapmt = (struct act_msg_datapmt *)&msgbuf.content.msg_datapmt;
-      if (msg_datapmt->datapmt_stage != DATAPMT_PHOTOM)
-      {
-        act_log_error(act_log_msg("Observation message with incorrect stage received."));
+          act_log_error(act_log_msg("Failed to send status response message."));
         break;
       }
-      if (msg_datapmt->status != OBSNSTAT_GOOD)
+      case MT_GUISOCK:
       {
-        act_log_debug(act_log_msg("Cancel observation."));
-        if (objs->msg_datapmt != NULL)
+        if (gtk_widget_get_parent(GTK_WIDGET(objs->box_main)) != NULL)
         {
-          free(objs->msg_datapmt);
-          objs->msg_datapmt = NULL;
+          act_log_debug(act_log_msg("GUI already embedded."));
+          break;
         }
-        pmt_cancel_integ(objs->pmtdetail);
-        if (objs->pmtinteg == NULL)
-          act_log_debug(act_log_msg("Strange: PMT observation cancel message was received, but no PMT integration struct is available."));
-        else
+        if (msgbuf.content.msg_guisock.gui_socket == 0)
         {
-          free(objs->pmtinteg);
-          objs->pmtinteg = NULL;
+          act_log_error(act_log_msg("Received 0 GUI socket."));
+          break;
         }
-        if (net_send(source, &msgbuf) < 0)
-          act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
-        break;
-      }
-      if (msg_datapmt->mode_auto == 0)
-      {
-        act_log_debug(act_log_msg("Manual mode"));
-        if (net_send(source, &msgbuf) < 0)
-          act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
-        break;
-      }
-      act_log_debug(act_log_msg("Auto observation."));
-      if ((pmt_integrating(objs->pmtdetail->pmt_stat)))
-      {
-        act_log_error(act_log_msg("An integration is currently underway. Cannot start automatic integration."));
-        msg_datapmt->status = OBSNSTAT_ERR_WAIT;
-        if (net_send(source, &msgbuf) < 0)
-          act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+        GtkWidget *plug = gtk_widget_get_parent(objs->box_main);
+        if (plug != NULL)
+        {
+          gtk_container_remove(GTK_CONTAINER(plug), objs->box_main);
+          gtk_widget_destroy(plug);
+        }
+        plug = gtk_plug_new(msgbuf.content.msg_guisock.gui_socket);
+        act_log_normal(act_log_msg("Received GUI socket (%d).", msgbuf.content.msg_guisock.gui_socket));
+        gtk_container_add(GTK_CONTAINER(plug),objs->box_main);
+        g_signal_connect(G_OBJECT(plug),"destroy",G_CALLBACK(destroy_plug),objs->box_main);
+        gtk_widget_show_all(plug);
         break;
       }
-      view_set_targ_id(objs->photview_objs, msg_datapmt->targ_id, msg_datapmt->targ_name);
-      struct pmtintegstruct pmtinteg =
-      {
-        .targid = msg_datapmt->targ_id,
-        .sky = msg_datapmt->sky,
-        .userid = msg_datapmt->user_id,
-        .sample_period_s = msg_datapmt->sample_period_s,
-        .prebin = msg_datapmt->prebin_num,
-        .repetitions = msg_datapmt->repetitions,
-      };
-      memcpy(&pmtinteg.filter, &msg_datapmt->filter, sizeof(struct filtaper));
-      memcpy(&pmtinteg.aperture, &msg_datapmt->aperture, sizeof(struct filtaper));
-      char pmtinteg_reason[512];
-      act_log_debug(act_log_msg("Checking integ parameters"));
-      if (check_integ_params(objs->pmtdetail, &pmtinteg, pmtinteg_reason) <= 0)
+      case MT_TIME:
       {
-        act_log_error(act_log_msg("Invalid parameters for automatic PMT integration. Reason(s) follow.\n%s", pmtinteg_reason));
-        msg_datapmt->status = OBSNSTAT_ERR_NEXT;
-        if (net_send(source, &msgbuf) < 0)
-          act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+        struct act_msg_time *msg_time = &msgbuf.content.msg_time;
+        pmt_set_datetime(objs->pmtdetail, &msg_time->unid, &msg_time->unit);
+        view_set_date(objs->photview_objs, &msg_time->unid);
         break;
       }
-      act_log_debug(act_log_msg("Starting integ"));
-      if (pmt_start_integ(objs->pmtdetail, &pmtinteg) <= 0)
+      case MT_PMT_CAP:
       {
-        act_log_error(act_log_msg("Failed to start integration."));
-        msg_datapmt->status = OBSNSTAT_ERR_RETRY;
-        if (net_send(source, &msgbuf) < 0)
-          act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+        struct act_msg_pmtcap *msg_pmtcap = (struct act_msg_pmtcap *)&msgbuf.content.msg_pmtcap;
+        if (msg_pmtcap->datapmt_stage != DATAPMT_PHOTOM)
+        {
+          pmt_get_caps(objs->pmtdetail, msg_pmtcap);
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Error sending PMT capabilities response message over network connection."));
+        }
+        else
+          memcpy(&G_pmtcaps, msg_pmtcap, sizeof(struct act_msg_pmtcap));
         break;
       }
-      objs->msg_datapmt = malloc(sizeof(struct act_msg_datapmt));
-      objs->pmtinteg = malloc(sizeof(struct pmtintegstruct));
-      if ((objs->msg_datapmt == NULL) || (objs->pmtinteg == NULL))
+      case MT_DATA_PMT:
       {
-        act_log_error(act_log_msg("Could not allocate memory for message buffer and/or integration structure. Cancelling this integration."));
-        pmt_cancel_integ(objs->pmtdetail);
-        if (objs->pmtinteg != NULL)
+        act_log_debug(act_log_msg("Received DATA_PMT message."));
+        struct act_msg_datapmt *msg_datapmt = (struct act_msg_datapmt *)&msgbuf.content.msg_datapmt;
+        if (msg_datapmt->datapmt_stage != DATAPMT_PHOTOM)
         {
-          free(objs->pmtinteg);
-          objs->pmtinteg = NULL;
+          act_log_error(act_log_msg("Observation message with incorrect stage received."));
+          break;
         }
-        if (objs->msg_datapmt != NULL)
+        if (msg_datapmt->status != OBSNSTAT_GOOD)
         {
-          free(objs->msg_datapmt);
-          objs->msg_datapmt = NULL;
+          act_log_debug(act_log_msg("Cancel observation."));
+          if (objs->msg_datapmt != NULL)
+          {
+            free(objs->msg_datapmt);
+            objs->msg_datapmt = NULL;
+          }
+          pmt_cancel_integ(objs->pmtdetail);
+          if (objs->pmtinteg == NULL)
+            act_log_debug(act_log_msg("Strange: PMT observation cancel message was received, but no PMT integration struct is available."));
+          else
+          {
+            free(objs->pmtinteg);
+            objs->pmtinteg = NULL;
+          }
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+          break;
         }
-        msg_datapmt->status = OBSNSTAT_ERR_RETRY;
-        if (net_send(source, &msgbuf) < 0)
-          act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+        if (msg_datapmt->mode_auto == 0)
+        {
+          act_log_debug(act_log_msg("Manual mode"));
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+          break;
+        }
+        act_log_debug(act_log_msg("Auto observation."));
+        if ((pmt_integrating(objs->pmtdetail->pmt_stat)))
+        {
+          act_log_error(act_log_msg("An integration is currently underway. Cannot start automatic integration."));
+          msg_datapmt->status = OBSNSTAT_ERR_WAIT;
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+          break;
+        }
+        view_set_targ_id(objs->photview_objs, msg_datapmt->targ_id, msg_datapmt->targ_name);
+        struct pmtintegstruct pmtinteg =
+        {
+          .targid = msg_datapmt->targ_id,
+          .sky = msg_datapmt->sky,
+          .userid = msg_datapmt->user_id,
+          .sample_period_s = msg_datapmt->sample_period_s,
+          .prebin = msg_datapmt->prebin_num,
+          .repetitions = msg_datapmt->repetitions,
+          .mode = msg_datapmt->pmt_mode == IPC_PMT_MODE_PHOTTAG ? PMT_MODE_TTAG : PMT_MODE_INTEG,
+        };
+        memcpy(&pmtinteg.filter, &msg_datapmt->filter, sizeof(struct filtaper));
+        memcpy(&pmtinteg.aperture, &msg_datapmt->aperture, sizeof(struct filtaper));
+        char pmtinteg_reason[512];
+        act_log_debug(act_log_msg("Checking integ parameters"));
+        if (check_integ_params(objs->pmtdetail, &pmtinteg, pmtinteg_reason) <= 0)
+        {
+          act_log_error(act_log_msg("Invalid parameters for automatic PMT integration. Reason(s) follow.\n%s", pmtinteg_reason));
+          msg_datapmt->status = OBSNSTAT_ERR_NEXT;
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+          break;
+        }
+        act_log_debug(act_log_msg("Starting integ"));
+        if (pmt_start_integ(objs->pmtdetail, &pmtinteg) <= 0)
+        {
+          act_log_error(act_log_msg("Failed to start integration."));
+          msg_datapmt->status = OBSNSTAT_ERR_RETRY;
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+          break;
+        }
+        objs->msg_datapmt = malloc(sizeof(struct act_msg_datapmt));
+        objs->pmtinteg = malloc(sizeof(struct pmtintegstruct));
+        if ((objs->msg_datapmt == NULL) || (objs->pmtinteg == NULL))
+        {
+          act_log_error(act_log_msg("Could not allocate memory for message buffer and/or integration structure. Cancelling this integration."));
+          pmt_cancel_integ(objs->pmtdetail);
+          if (objs->pmtinteg != NULL)
+          {
+            free(objs->pmtinteg);
+            objs->pmtinteg = NULL;
+          }
+          if (objs->msg_datapmt != NULL)
+          {
+            free(objs->msg_datapmt);
+            objs->msg_datapmt = NULL;
+          }
+          msg_datapmt->status = OBSNSTAT_ERR_RETRY;
+          if (net_send(source, &msgbuf) < 0)
+            act_log_error(act_log_msg("Error sending DATA PMT response message over network connection"));
+          break;
+        }
+        memcpy(objs->msg_datapmt, msg_datapmt, sizeof(struct act_msg_datapmt));
+        memcpy(objs->pmtinteg, &pmtinteg, sizeof(struct pmtintegstruct));
         break;
       }
-      memcpy(objs->msg_datapmt, msg_datapmt, sizeof(struct act_msg_datapmt));
-      memcpy(objs->pmtinteg, &pmtinteg, sizeof(struct pmtintegstruct));
-      break;
+      default:
+        if (msgbuf.mtype >= MT_INVAL)
+          act_log_error(act_log_msg("Invalid message type received."));
     }
-    default:
-      if (msgbuf.mtype >= MT_INVAL)
-        act_log_error(act_log_msg("Invalid message type received."));
   }
   int new_cond = g_io_channel_get_buffer_condition (source);
   if ((new_cond & G_IO_IN) != 0)
@@ -1059,13 +1094,14 @@ int main(int argc, char** argv)
   act_log_open();
   act_log_normal(act_log_msg("Starting"));
   
-  const char *host, *port, *sqlconfig;
+  const char *host, *port, *sqlconfig, *ttagdir;
   gtk_init(&argc, &argv);
   struct arg_str *addrarg = arg_str1("a", "addr", "<str>", "The host to connect to. May be a hostname, IP4 address or IP6 address.");
   struct arg_str *portarg = arg_str1("p", "port", "<str>", "The port to connect to. Must be an unsigned short integer.");
   struct arg_str *sqlconfigarg = arg_str1("s", "sqlconfighost", "<server ip/hostname>", "The hostname or IP address of the SQL server than contains act_control's configuration information");
+  struct arg_str *ttagdirarg = arg_str0("d", "ttagdir", "<directory>", "The directory raw PMT time tag files are written to (default: the current directory).");
   struct arg_end *endargs = arg_end(10);
-  void* argtable[] = {addrarg, portarg, sqlconfigarg, endargs};
+  void* argtable[] = {addrarg, portarg, sqlconfigarg, ttagdirarg, endargs};
   if (arg_nullcheck(argtable) != 0)
     act_log_error(act_log_msg("Argument parsing error: insufficient memory."));
   int argparse_errors = arg_parse(argc,argv,argtable);
@@ -1077,6 +1113,7 @@ int main(int argc, char** argv)
   host = addrarg->sval[0];
   port = portarg->sval[0];
   sqlconfig = sqlconfigarg->sval[0];
+  ttagdir = ttagdirarg->count > 0 ? ttagdirarg->sval[0] : ".";
   arg_freetable(argtable,sizeof(argtable)/sizeof(argtable[0]));
   
   memset(&G_pmtcaps, 0, sizeof(struct act_msg_pmtcap));
@@ -1117,10 +1154,11 @@ int main(int argc, char** argv)
     finish_all(&formobjs);
     return 1;
   }
+  pmt_set_ttag_dir(formobjs.pmtdetail, ttagdir);
   
   GtkWidget *evb_store_stat = gtk_event_box_new();
   gtk_table_attach(GTK_TABLE(formobjs.box_main),evb_store_stat, 1, 2, 0, 1, GTK_FILL|GTK_EXPAND, GTK_FILL, 3, 3);
-  formobjs.store_objs = create_storeinteg(evb_store_stat, formobjs.mysql_conn);
+  formobjs.store_objs = create_storeinteg(evb_store_stat, formobjs.mysql_conn, sqlconfig);
   if (formobjs.store_objs == NULL)
   {
     act_log_error(act_log_msg("Error initialising PMT data storage information structure."));
@@ -1167,7 +1205,11 @@ int main(int argc, char** argv)
   else
     guicheck_to_id = g_timeout_add(GUICHECK_TIMEOUT_PERIOD, timeout_check_gui, &formobjs);
   int net_watch_id = g_io_add_watch(formobjs.net_chan, G_IO_IN, read_net_message, &formobjs);
+  GIOChannel *pmt_chan = g_io_channel_unix_new(formobjs.pmtdetail->pmtdrv_fd);
+  int pmt_watch_id = g_io_add_watch(pmt_chan, G_IO_IN, pmt_ring_ready, &formobjs);
+  g_io_channel_unref(pmt_chan);
   gtk_main();
+  g_source_remove(pmt_watch_id);
   g_source_remove(net_watch_id);
   g_source_remove(photcheck_to_id);
   g_source_remove(guicheck_to_id);
@@ -23,6 +23,7 @@
  */
 
 void update_stat_ind(struct pmtdetailstruct *pmtdetail);
+static void ttag_end_run(struct pmtdetailstruct *pmtdetail);
 
 struct pmtdetailstruct *init_pmtdetail(GtkWidget *container)
 {
@@ -41,11 +42,24 @@ struct pmtdetailstruct *init_pmtdetail(GtkWidget *container)
     return NULL;
   }
   pmtdetail->pmtdrv_fd = pmt_fd;
+  pmtdetail->ttag_dir = NULL;
+  pmtdetail->ttag_started = FALSE;
+  pmtdetail->ttag_fd = NULL;
+  if (pmtring_map(&pmtdetail->ring, pmt_fd) < 0)
+  {
+    close(pmt_fd);
+    free(pmtdetail);
+    return NULL;
+  }
+  unsigned long ring_thresh = PMTRING_WAKE_NUM;
+  if (ioctl(pmt_fd, IOCTL_SET_RING_THRESH, &ring_thresh) < 0)
+    act_log_error(act_log_msg("Failed to set PMT integration data ring wake-up threshold - %s.", strerror(errno)));
   char pmt_stat;
   int ret = read(pmt_fd, &pmt_stat, 1);
   if (ret <= 0)
   {
     act_log_error(act_log_msg("Error reading status from PMT driver - %s.", strerror(ret)));
+    pmtring_unmap(&pmtdetail->ring);
     close(pmt_fd);
     free(pmtdetail);
     return NULL;
@@ -55,23 +69,41 @@ struct pmtdetailstruct *init_pmtdetail(GtkWidget *container)
   if (ret < 0)
   {
     act_log_error(act_log_msg("Failed to get PMT information - %s.", strerror(ret)));
+    pmtring_unmap(&pmtdetail->ring);
     close (pmt_fd);
     free(pmtdetail);
     return NULL;
   }
-  if (pmt_data_ready(pmt_stat))
+  // Time-tag mode is only available with the time tag ring
+  if (pmtring_map_ttag(&pmtdetail->ttag_ring, pmt_fd) < 0)
+    pmtdetail->pmt_info.modes &= ~PMT_MODE_TTAG;
+  else
+  {
+    ring_thresh = PMTRING_TTAG_WAKE_NUM;
+    if (ioctl(pmt_fd, IOCTL_SET_TTAG_THRESH, &ring_thresh) < 0)
+      act_log_error(act_log_msg("Failed to set PMT time tag ring wake-up threshold - %s.", strerror(errno)));
+    pmtring_discard(&pmtdetail->ttag_ring);
+  }
+  if (pmtring_num_unread(&pmtdetail->ring) > 0)
   {
     act_log_debug(act_log_msg("Data found in queue while starting up. Discarding data."));
-    ret = 1;
-    struct pmt_integ_data new_data;
-    while (ret >= 0)
-      ret = ioctl(pmtdetail->pmtdrv_fd, IOCTL_GET_INTEG_DATA, &new_data);
+    pmtring_discard(&pmtdetail->ring);
   }
   struct pmt_integ_data cur_data;
   ret = ioctl(pmt_fd, IOCTL_GET_CUR_INTEG, &cur_data);
   if (ret < 0)
   {
     act_log_error(act_log_msg("Failed to get PMT current data - %s.", strerror(ret)));
+    pmtring_unmap(&pmtdetail->ttag_ring);
+    pmtring_unmap(&pmtdetail->ring);
+    close (pmt_fd);
+    free(pmtdetail);
+    return NULL;
+  }
+  if (sampring_init(&pmtdetail->samples, SAMPRING_LEN) < 0)
+  {
+    pmtring_unmap(&pmtdetail->ttag_ring);
+    pmtring_unmap(&pmtdetail->ring);
     close (pmt_fd);
     free(pmtdetail);
     return NULL;
@@ -124,8 +156,13 @@ void finalise_pmtdetail(struct pmtdetailstruct *pmtdetail)
   if (pmtdetail->pmtdrv_fd >= 0)
   {
     pmt_cancel_integ(pmtdetail);
+    pmtring_unmap(&pmtdetail->ttag_ring);
+    pmtring_unmap(&pmtdetail->ring);
     close(pmtdetail->pmtdrv_fd);
   }
+  sampring_free(&pmtdetail->samples);
+  free(pmtdetail->ttag_dir);
+  pmtdetail->ttag_dir = NULL;
 }
 
 void pmt_reg_checks(struct pmtdetailstruct *pmtdetail)
@@ -229,7 +266,30 @@ int check_integ_params(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct
   unsigned long sample_length = round(pmtinteg->sample_period_s*1000000000.0/pmtdetail->pmt_info.min_sample_period_ns);
 //   unsigned long sample_period_ns = 1000000000/((unsigned long)(1./pmtinteg->sample_period_s));
   act_log_debug(act_log_msg("Sample length: %lu (%lf %lu)", sample_length, pmtinteg->sample_period_s, pmtdetail->pmt_info.min_sample_period_ns));
-  if (sample_length < 1)
+  if (pmtinteg->mode == PMT_MODE_TTAG)
+  {
+    // Time tags are binned by act_pmtphot, so any sample period down to the time resolution is possible, as long as the
+    // bins completed between checks fit in the sample ring
+    if ((pmtdetail->pmt_info.modes & PMT_MODE_TTAG) == 0)
+    {
+      act_log_error(act_log_msg("PMT does not support time-tag mode."));
+      reason_len += snprintf(&reason[reason_len], sizeof(reason)-reason_len-1, "PMT does not support time-tag mode.\n");
+      ret = 0;
+    }
+    else if ((pmtinteg->sample_period_s <= 0.0) || (pmtinteg->sample_period_s*1000000000.0 < pmtdetail->pmt_info.timetag_time_res_ns))
+    {
+      act_log_error(act_log_msg("Invalid sample period for time-tag mode (%lf s, time resolution %lu ns)", pmtinteg->sample_period_s, pmtdetail->pmt_info.timetag_time_res_ns));
+      reason_len += snprintf(&reason[reason_len], sizeof(reason)-reason_len-1, "Invalid sample period.\n");
+      ret = 0;
+    }
+    else if (pmtinteg->sample_period_s*pmtinteg->prebin*1000000000.0 < TTAG_MIN_BIN_NS)
+    {
+      act_log_error(act_log_msg("Time-tag bins too short (%lf s x %lu, minimum %lu ns) - more bins would be completed between checks than the sample ring holds.", pmtinteg->sample_period_s, pmtinteg->prebin, TTAG_MIN_BIN_NS));
+      reason_len += snprintf(&reason[reason_len], sizeof(reason)-reason_len-1, "Sample period too short for time-tag mode.\n");
+      ret = 0;
+    }
+  }
+  else if (sample_length < 1)
   {
     act_log_error(act_log_msg("Invalid sample length (%lu)", sample_length));
     reason_len += snprintf(&reason[reason_len], sizeof(reason)-reason_len-1, "Invalid sample length.\n");
@@ -272,6 +332,23 @@ int pmt_start_integ(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct *pm
     .prebin_num = pmtinteg->prebin,
     .repetitions = pmtinteg->repetitions
   };
+  if (pmtinteg->mode == PMT_MODE_TTAG)
+  {
+    if (pmtdetail->ttag_started)
+      ttag_end_run(pmtdetail);
+    // The driver time-tags photons for long enough to cover all the bins, which act_pmtphot fills
+    pmtdetail->ttag_bin_ns = llround(pmtinteg->sample_period_s*1000000000.0) * pmtinteg->prebin;
+    pmtdetail->ttag_num_bins = pmtinteg->repetitions;
+    pmtdetail->ttag_targid = pmtinteg->targid;
+    pmtdetail->ttag_run_num = __atomic_load_n(&pmtdetail->ttag_ring.hdr->run_num, __ATOMIC_ACQUIRE) + 1;
+    cmd.mode = PMT_MODE_TTAG;
+    cmd.sample_length = (pmtdetail->ttag_bin_ns*pmtdetail->ttag_num_bins + pmtdetail->pmt_info.min_sample_period_ns - 1) / pmtdetail->pmt_info.min_sample_period_ns;
+    cmd.prebin_num = 1;
+    cmd.repetitions = 1;
+    pmtring_discard(&pmtdetail->ttag_ring);
+  }
+  // Records left over from a previous integration don't belong to this one
+  pmtring_discard(&pmtdetail->ring);
   int ret = ioctl(pmtdetail->pmtdrv_fd, IOCTL_INTEG_CMD, &cmd);
   if (ret < 0)
   {
@@ -284,71 +361,216 @@ int pmt_start_integ(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct *pm
   pmtinteg->counts = 0;
   pmtinteg->error = 0;
   pmtinteg->done = 0;
-  pmtinteg->next = NULL;
   memcpy(&pmtinteg->start_unidate, &pmtdetail->cur_unidate, sizeof(struct datestruct));
   memcpy(&pmtinteg->start_unitime, &pmtdetail->cur_unitime, sizeof(struct timestruct));
   return 1;
 }
 
-int pmt_integ_get_data(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct *pmtinteg)
+/** \brief Appends a sample completed by the driver (or binned from time tags) to the sample ring.
+ * \param samples Sample ring - must have space for the sample.
+ * \param pmtinteg Integration the sample belongs to - its start date and time are moved on to the sample's.
+ * \param record Integration data from the driver (or binned from time tags).
+ */
+static void append_integ(struct sampring *samples, struct pmtintegstruct *pmtinteg, struct pmt_integ_data *record)
 {
-  if ((pmtdetail == NULL) || (pmtinteg == NULL))
+  struct timestruct start_time;
+  convert_MS_HMSMS_time(record->start_time_s*1000 + record->start_time_ns/1000000, &start_time);
+  check_systime_discrep(&pmtinteg->start_unidate, &pmtinteg->start_unitime, &start_time);
+  memcpy(&pmtinteg->start_unitime, &start_time, sizeof(struct timestruct));
+  sampring_append(samples, &pmtinteg->start_unidate, &start_time, (double)record->sample_period_ns * record->prebin_num / 1000000000.0, record->counts, record->error);
+  pmtinteg->integt_s = 0.0;
+  pmtinteg->counts = 0;
+  pmtinteg->error = 0;
+}
+
+/// Where bins completed from time tags are appended
+struct ttag_append
+{
+  struct sampring *samples;
+  struct pmtintegstruct *pmtinteg;
+  long num_integ;
+};
+
+/// Refuses the bin if the sample ring is full, so that the binner stops and the time tags stay in the driver's ring.
+static int ttag_append_bin(void *user_data, struct pmt_integ_data *bin)
+{
+  struct ttag_append *append = (struct ttag_append *)user_data;
+  if (sampring_space(append->samples) == 0)
+    return -1;
+  append->num_integ++;
+  append_integ(append->samples, append->pmtinteg, bin);
+  return 0;
+}
+
+static int ttag_discard_bin(void *user_data, struct pmt_integ_data *bin)
+{
+  (void)user_data;
+  (void)bin;
+  return 0;
+}
+
+/// Opens the raw time tag file and prepares the bins once the driver has started the time-tag run.
+static int ttag_start_run(struct pmtdetailstruct *pmtdetail)
+{
+  struct pmt_ring_hdr *hdr = pmtdetail->ttag_ring.hdr;
+  unsigned long start_s = hdr->run_start_s, start_ns = hdr->run_start_ns;
+  time_t start_t = start_s;
+  struct tm start_tm;
+  char filename[512];
+  gmtime_r(&start_t, &start_tm);
+  snprintf(filename, sizeof(filename), "%s/ttag_%04d%02d%02d_%02d%02d%02d_%d.dat", pmtdetail->ttag_dir != NULL ? pmtdetail->ttag_dir : ".", start_tm.tm_year+1900, start_tm.tm_mon+1, start_tm.tm_mday, start_tm.tm_hour, start_tm.tm_min, start_tm.tm_sec, pmtdetail->ttag_targid);
+  pmtdetail->ttag_fd = fopen(filename, "wb");
+  if (pmtdetail->ttag_fd == NULL)
+    act_log_error(act_log_msg("Failed to open raw time tag file %s - %s. Time tags will only be binned.", filename, strerror(errno)));
+  else
+    act_log_normal(act_log_msg("Writing time tags to %s.", filename));
+  if (ttagbin_start(&pmtdetail->ttag_bin, start_s, start_ns, pmtdetail->ttag_bin_ns, pmtdetail->ttag_num_bins, pmtdetail->ttag_fd) < 0)
   {
-    act_log_error(act_log_msg("Invalid input parameters."));
+    if (pmtdetail->ttag_fd != NULL)
+      fclose(pmtdetail->ttag_fd);
+    pmtdetail->ttag_fd = NULL;
     return -1;
   }
+  pmtdetail->ttag_started = TRUE;
+  return 0;
+}
 
-  long num_integ = 0, ret;
-  struct pmtintegstruct *lastinteg = pmtinteg;
-  while (lastinteg->next != NULL)
-    lastinteg = (struct pmtintegstruct *)(lastinteg->next);
-  struct pmtintegstruct *nextinteg = NULL;
+/** \brief Adds the unread time tags to the bins (completed bins are passed to func) and the raw file.
+ * \return 0 if all were added, -1 if func refused a bin (the rest are left in the driver's ring).
+ */
+static int ttag_drain(struct pmtdetailstruct *pmtdetail, ttagbin_func func, void *user_data)
+{
+  struct pmt_ttag_data *ttags;
+  unsigned long num_ttags, num_added, num_lost;
+  int ret = 0;
+  while ((num_ttags = pmtring_peek_ttag(&pmtdetail->ttag_ring, &ttags)) > 0)
+  {
+    num_added = ttagbin_add(&pmtdetail->ttag_bin, ttags, num_ttags, func, user_data);
+    pmtring_release(&pmtdetail->ttag_ring, num_added);
+    if (num_added < num_ttags)
+    {
+      ret = -1;
+      break;
+    }
+  }
+  num_lost = pmtring_num_lost(&pmtdetail->ttag_ring);
+  if (num_lost > 0)
+    act_log_error(act_log_msg("PMT driver discarded %lu time tags because they weren't read in time.", num_lost));
+  return ret;
+}
+
+/// Writes any unread time tags to the raw file (without binning them) and closes it.
+static void ttag_end_run(struct pmtdetailstruct *pmtdetail)
+{
+  ttag_drain(pmtdetail, ttag_discard_bin, NULL);
+  ttagbin_finish(&pmtdetail->ttag_bin, 0, ttag_discard_bin, NULL);
+  if (pmtdetail->ttag_fd != NULL)
+    fclose(pmtdetail->ttag_fd);
+  pmtdetail->ttag_fd = NULL;
+  pmtdetail->ttag_started = FALSE;
+  act_log_normal(act_log_msg("Time-tag run ended: %lu photons time-tagged, %lu outside the binned interval.", pmtdetail->ttag_bin.num_ttags, pmtdetail->ttag_bin.num_outside));
+}
+
+/// pmt_integ_get_data for time-tag runs
+static int ttag_get_data(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct *pmtinteg)
+{
+  struct pmt_ring_hdr *hdr = pmtdetail->ttag_ring.hdr;
+  struct ttag_append append = { .samples = &pmtdetail->samples, .pmtinteg = pmtinteg, .num_integ = 0 };
   struct pmt_integ_data new_data;
   struct timestruct start_time;
-  while (pmt_data_ready(pmtdetail->pmt_stat))
+  unsigned long elapsed_ms, bin_start_ms;
+  unsigned long long bin_start_ns;
+  char ended;
+  int ret;
+  if (!pmtdetail->ttag_started)
   {
-    ret = ioctl(pmtdetail->pmtdrv_fd, IOCTL_GET_INTEG_DATA, &new_data);
-    if (ret < 0)
+    if (__atomic_load_n(&hdr->run_num, __ATOMIC_ACQUIRE) != pmtdetail->ttag_run_num)
     {
-      if ((ret == -EAGAIN) || (ret == -EINVAL))
-      {
-        act_log_debug(act_log_msg("No data available yet."));
-        break;
-      }
-      act_log_error(act_log_msg("Error reading integration data from PMT driver (%d - %s).", ret, strerror(abs(ret))));
-      pmtdetail->pmt_stat |= PMT_STAT_ERR;
-      pmtdetail->error = 0;
-      update_stat_ind(pmtdetail);
-      return -1;
+      // The run hasn't started yet or was cancelled during the probe
+      pmtinteg->done = pmt_integrating(pmtdetail->pmt_stat) || pmt_probing(pmtdetail->pmt_stat) ? 0 : -1;
+      return 0;
     }
-    lastinteg->integt_s = (double)new_data.sample_period_ns * new_data.prebin_num / 1000000000.0;
-    lastinteg->repetitions = new_data.repetitions;
-    lastinteg->counts = new_data.counts;
-    lastinteg->error = new_data.error;
-    convert_MS_HMSMS_time(new_data.start_time_s*1000 + new_data.start_time_ns/1000000, &start_time);
-    check_systime_discrep(&lastinteg->start_unidate, &lastinteg->start_unitime, &start_time);
-    memcpy(&lastinteg->start_unitime, &start_time, sizeof(struct timestruct));
-    lastinteg->done = 1;
-    num_integ++;
-    
-    nextinteg = malloc(sizeof(struct pmtintegstruct));
-    if (nextinteg == NULL)
-    {
-      act_log_error(act_log_msg("Could not allocate space for next integration data."));
+    if (ttag_start_run(pmtdetail) < 0)
       return -1;
-    }
-    memcpy(nextinteg, lastinteg, sizeof(struct pmtintegstruct));
-    nextinteg->next = NULL;
-    nextinteg->done = -1;
-    nextinteg->integt_s = 0.0;
-    nextinteg->repetitions = 0;
-    nextinteg->counts = 0;
-    nextinteg->error = 0;
-    
-    lastinteg->next = nextinteg;
-    lastinteg = nextinteg;
-    
-    pmt_reg_checks(pmtdetail);
+  }
+  if (pmt_integrating(pmtdetail->pmt_stat))
+  {
+    if (ioctl(pmtdetail->pmtdrv_fd, IOCTL_GET_CUR_INTEG, &new_data) < 0)
+      act_log_error(act_log_msg("Failed to get PMT current data - %s.", strerror(errno)));
+    else
+      pmtdetail->ttag_bin.error = new_data.error;
+  }
+  // The run's progress must be read before the time tags it covers
+  ended = __atomic_load_n(&hdr->run_ended, __ATOMIC_ACQUIRE);
+  elapsed_ms = __atomic_load_n(&hdr->run_elapsed_ms, __ATOMIC_ACQUIRE);
+  ret = ttag_drain(pmtdetail, ttag_append_bin, &append);
+  if (ret == 0)
+    ret = ended ? ttagbin_finish(&pmtdetail->ttag_bin, elapsed_ms, ttag_append_bin, &append) : ttagbin_advance(&pmtdetail->ttag_bin, elapsed_ms, ttag_append_bin, &append);
+  if (ret < 0)
+  {
+    // The sample ring is full - the rest are binned once the samples have been consumed
+    pmtinteg->done = 0;
+    return append.num_integ;
+  }
+  if (ended)
+  {
+    ttag_end_run(pmtdetail);
+    pmtinteg->done = -1;
+    return append.num_integ;
+  }
+  // Show the bin that is being filled
+  bin_start_ns = pmtdetail->ttag_bin.bin_end_ns - pmtdetail->ttag_bin.bin_ns;
+  bin_start_ms = (pmtdetail->ttag_bin.start_ns + bin_start_ns) / 1000000ULL;
+  convert_MS_HMSMS_time(bin_start_ms, &start_time);
+  check_systime_discrep(&pmtinteg->start_unidate, &pmtinteg->start_unitime, &start_time);
+  memcpy(&pmtinteg->start_unitime, &start_time, sizeof(struct timestruct));
+  pmtinteg->counts = pmtdetail->ttag_bin.counts;
+  pmtinteg->error = pmtdetail->ttag_bin.error;
+  if (elapsed_ms * 1000000ULL > bin_start_ns)
+    pmtinteg->integt_s = (elapsed_ms * 1000000ULL - bin_start_ns) / 1000000000.0;
+  else
+    pmtinteg->integt_s = 0.0;
+  pmtinteg->done = 0;
+  return append.num_integ;
+}
+
+int pmt_integ_get_data(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct *pmtinteg)
+{
+  if ((pmtdetail == NULL) || (pmtinteg == NULL))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+
+  long num_integ = 0, ret;
+  struct pmt_integ_data new_data, *records;
+  struct timestruct start_time;
+  unsigned long i, num_records, space;
+  if (pmtinteg->mode == PMT_MODE_TTAG)
+  {
+    // The driver doesn't use the integration data ring during a time-tag run
+    pmtring_discard(&pmtdetail->ring);
+    return ttag_get_data(pmtdetail, pmtinteg);
+  }
+  // The status must have been read (pmt_reg_checks) before the ring is drained - if the integration had stopped by
+  // then, the driver has already put its last record in the ring.
+  while (((space = sampring_space(&pmtdetail->samples)) > 0) && ((num_records = pmtring_peek(&pmtdetail->ring, &records)) > 0))
+  {
+    if (num_records > space)
+      num_records = space;
+    for (i=0; i<num_records; i++)
+      append_integ(&pmtdetail->samples, pmtinteg, &records[i]);
+    pmtring_release(&pmtdetail->ring, num_records);
+    num_integ += num_records;
+  }
+  unsigned long num_lost = pmtring_num_lost(&pmtdetail->ring);
+  if (num_lost > 0)
+    act_log_error(act_log_msg("PMT driver discarded %lu integration records because they weren't read in time.", num_lost));
+  if (pmtring_num_unread(&pmtdetail->ring) > 0)
+  {
+    // The rest are read once the samples have been consumed
+    pmtinteg->done = 0;
+    return num_integ;
   }
   if (pmt_integrating(pmtdetail->pmt_stat))
   {
@@ -358,37 +580,20 @@ int pmt_integ_get_data(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct
       act_log_error(act_log_msg("Failed to get PMT current data - %s.", strerror(ret)));
       return num_integ;
     }
-    lastinteg->counts = new_data.counts;
-    lastinteg->error = new_data.error;
+    pmtinteg->counts = new_data.counts;
+    pmtinteg->error = new_data.error;
     convert_MS_HMSMS_time(new_data.start_time_s*1000 + new_data.start_time_ns/1000000, &start_time);
-    check_systime_discrep(&lastinteg->start_unidate, &lastinteg->start_unitime, &start_time);
-    memcpy(&lastinteg->start_unitime, &start_time, sizeof(struct timestruct));
-    lastinteg->integt_s = (double)new_data.sample_period_ns/1000000000.0 + (double)lastinteg->sample_period_s*new_data.prebin_num;
-    lastinteg->done = 0;
+    check_systime_discrep(&pmtinteg->start_unidate, &pmtinteg->start_unitime, &start_time);
+    memcpy(&pmtinteg->start_unitime, &start_time, sizeof(struct timestruct));
+    pmtinteg->integt_s = (double)new_data.sample_period_ns/1000000000.0 + (double)pmtinteg->sample_period_s*new_data.prebin_num;
+    pmtinteg->done = 0;
   }
   else
-    lastinteg->done = -1;
+    pmtinteg->done = -1;
 
   return num_integ;
 }
 
-struct pmtintegstruct *free_integ_data(struct pmtintegstruct *pmtinteg)
-{
-  if (pmtinteg == NULL)
-  {
-    act_log_error(act_log_msg("Invalid input parameters."));
-    return NULL;
-  }
-  struct pmtintegstruct *lastinteg = pmtinteg, *nextinteg = pmtinteg->next;
-  while (nextinteg != NULL)
-  {
-    free(lastinteg);
-    lastinteg = nextinteg;
-    nextinteg = lastinteg->next;
-  }
-  return lastinteg;
-}
-
 void pmt_integ_clear_data(struct pmtdetailstruct *pmtdetail)
 {
   if (pmtdetail == NULL)
@@ -397,6 +602,9 @@ void pmt_integ_clear_data(struct pmtdetailstruct *pmtdetail)
     return;
   }
 
+  pmtring_discard(&pmtdetail->ring);
+  if (pmtdetail->ttag_ring.hdr != NULL)
+    pmtring_discard(&pmtdetail->ttag_ring);
   char pmt_stat;
   int ret = read(pmtdetail->pmtdrv_fd, &pmt_stat, 1);
   if (ret <= 0)
@@ -404,23 +612,7 @@ void pmt_integ_clear_data(struct pmtdetailstruct *pmtdetail)
     act_log_error(act_log_msg("Error reading status from PMT driver - %s.", strerror(ret)));
     return;
   }
-  struct pmt_integ_data new_data;
-  while (pmt_data_ready(pmt_stat))
-  {
-    ret = ioctl(pmtdetail->pmtdrv_fd, IOCTL_GET_INTEG_DATA, &new_data);
-    if (ret < 0)
-    {
-      act_log_error(act_log_msg("Error reading integration data from PMT driver (%d - %s).", ret, strerror(abs(ret))));
-      return;
-    }
-    ret = read(pmtdetail->pmtdrv_fd, &pmt_stat, 1);
-    if (ret <= 0)
-    {
-      act_log_error(act_log_msg("Error reading status from PMT driver - %s.", strerror(ret)));
-      return;
-    }
-  }
-  return;
+  pmtdetail->pmt_stat = pmt_stat;
 }
 
 void pmt_cancel_integ(struct pmtdetailstruct *pmtdetail)
@@ -432,6 +624,21 @@ void pmt_cancel_integ(struct pmtdetailstruct *pmtdetail)
   }
   struct pmt_command cmd = { .mode = 0 };
   ioctl(pmtdetail->pmtdrv_fd, IOCTL_INTEG_CMD, &cmd);
+  // The time tags collected up to the cancellation still go to the raw file
+  if (pmtdetail->ttag_started)
+    ttag_end_run(pmtdetail);
+}
+
+/// Sets the directory raw time tag files are written to (the current directory by default).
+void pmt_set_ttag_dir(struct pmtdetailstruct *pmtdetail, const char *ttag_dir)
+{
+  if ((pmtdetail == NULL) || (ttag_dir == NULL))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return;
+  }
+  free(pmtdetail->ttag_dir);
+  pmtdetail->ttag_dir = strdup(ttag_dir);
 }
 
 void pmt_set_datetime(struct pmtdetailstruct *pmtdetail, struct datestruct *unidate, struct timestruct *unitime)
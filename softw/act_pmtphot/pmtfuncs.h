@@ -7,6 +7,9 @@
 #include <time_driver.h>
 #include <act_ipc.h>
 #include <gtk/gtk.h>
+#include "pmtphot_ring.h"
+#include "pmtphot_ttag.h"
+#include "pmtphot_samples.h"
 
 #define pmt_zero_counts(error)  ((error & PMT_ERR_ZERO) > 0)
 #define pmt_high_counts(error)  ((error & PMT_ERR_WARN) > 0)
@@ -22,11 +25,27 @@
 #define pmt_error(status)       ((status & PMT_STAT_ERR) > 0)
 #define pmt_new_stat(status)    ((status & PMT_STAT_UPDATE) > 0)
 
+/// Shortest time-tag bin (in ns) - a second's worth of bins (the longest between checks for new data) must fit in the sample ring
+#define TTAG_MIN_BIN_NS   ((1000000000UL + SAMPRING_LEN - 1) / SAMPRING_LEN)
+
 struct pmtdetailstruct
 {
   GtkWidget *evb_pmt_stat, *lbl_pmt_stat;
   
   int pmtdrv_fd;
+  struct pmtring ring;
+  /// Completed samples read from the driver (or binned from time tags), waiting for storage, view and plot
+  struct sampring samples;
+  /// Time tag ring and the time-tag run in progress (the number the driver will give the run, bins, raw time tag file)
+  struct pmtring ttag_ring;
+  char *ttag_dir;
+  unsigned long ttag_run_num;
+  char ttag_started;
+  unsigned long long ttag_bin_ns;
+  unsigned long ttag_num_bins;
+  int ttag_targid;
+  struct ttagbin ttag_bin;
+  FILE *ttag_fd;
   char pmt_stat;
   struct pmt_information pmt_info;
 
@@ -44,6 +63,8 @@ struct pmtintegstruct
   int userid;
   struct filtaper filter;
   struct filtaper aperture;
+  /// PMT mode (PMT_MODE_TTAG to time-tag photons and bin them, otherwise integration mode)
+  char mode;
   struct datestruct start_unidate;
   struct timestruct start_unitime;
   double sample_period_s;
@@ -54,8 +75,9 @@ struct pmtintegstruct
   unsigned long counts;
   unsigned char error;
   
+  /// 0 while the integration is in progress (the fields above then describe the sample being integrated), -1 once
+  /// it has finished
   char done;
-  void *next;
 };
 
 struct pmtdetailstruct *init_pmtdetail(GtkWidget *container);
@@ -64,9 +86,9 @@ void pmt_reg_checks(struct pmtdetailstruct *pmtdetail);
 int check_integ_params(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct *pmtinteg, char *reason);
 int pmt_start_integ(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct *pmtinteg);
 int pmt_integ_get_data(struct pmtdetailstruct *pmtdetail, struct pmtintegstruct *pmtinteg);
-struct pmtintegstruct *free_integ_data(struct pmtintegstruct *pmtinteg);
 void pmt_integ_clear_data(struct pmtdetailstruct *pmtdetail);
 void pmt_cancel_integ(struct pmtdetailstruct *pmtdetail);
+void pmt_set_ttag_dir(struct pmtdetailstruct *pmtdetail, const char *ttag_dir);
 void pmt_set_datetime(struct pmtdetailstruct *pmtdetail, struct datestruct *unidate, struct timestruct *unitime);
 void pmt_get_datetime(struct pmtdetailstruct *pmtdetail, struct datestruct *unidate, struct timestruct *unitime);
 const char *pmt_get_id(struct pmtdetailstruct *pmtdetail);
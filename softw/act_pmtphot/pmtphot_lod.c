@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <act_log.h>
+#include "pmtphot_lod.h"
+
+/** \brief Allocates the levels of a pyramid covering 0 to span_s seconds with bottom bins of bin_s seconds.
+ * \return 0 on success, otherwise -1.
+ */
+int lodpyr_init(struct lodpyr *pyr, double span_s, double bin_s)
+{
+  if ((pyr == NULL) || (span_s <= 0.0) || (bin_s <= 0.0))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+  memset(pyr, 0, sizeof(struct lodpyr));
+  pyr->bin_s = bin_s;
+  unsigned long len = ceil(span_s / bin_s), total_len = 0;
+  while (pyr->num_levels < LODPYR_MAX_LEVELS)
+  {
+    pyr->level_len[pyr->num_levels++] = len;
+    total_len += len;
+    if (len == 1)
+      break;
+    len = (len + 1) / 2;
+  }
+  if (len > 1)
+  {
+    act_log_error(act_log_msg("Too many bins requested for level-of-detail pyramid (%f s in bins of %f s).", span_s, bin_s));
+    return -1;
+  }
+  // One block for all the levels, bottom level first
+  pyr->levels[0] = malloc(total_len * sizeof(struct lodbin));
+  if (pyr->levels[0] == NULL)
+  {
+    act_log_error(act_log_msg("Could not allocate space for level-of-detail pyramid."));
+    return -1;
+  }
+  int i;
+  for (i=1; i<pyr->num_levels; i++)
+    pyr->levels[i] = pyr->levels[i-1] + pyr->level_len[i-1];
+  lodpyr_clear(pyr);
+  return 0;
+}
+
+void lodpyr_free(struct lodpyr *pyr)
+{
+  if (pyr == NULL)
+    return;
+  free(pyr->levels[0]);
+  memset(pyr, 0, sizeof(struct lodpyr));
+}
+
+/// Empties all the bins.
+void lodpyr_clear(struct lodpyr *pyr)
+{
+  int i;
+  unsigned long j;
+  for (i=0; i<pyr->num_levels; i++)
+  {
+    for (j=0; j<pyr->level_len[i]; j++)
+      lodbin_clear(&pyr->levels[i][j]);
+  }
+  pyr->t_first_s = pyr->dirty_lo_s = DBL_MAX;
+  pyr->t_last_s = pyr->dirty_hi_s = -DBL_MAX;
+}
+
+char lodpyr_empty(struct lodpyr *pyr)
+{
+  return pyr->t_first_s > pyr->t_last_s;
+}
+
+/** \brief Adds a value at time t_s.
+ * \return 0 on success, -1 if t_s is outside the span of the pyramid.
+ */
+int lodpyr_add(struct lodpyr *pyr, double t_s, float value)
+{
+  if ((t_s < 0.0) || (t_s / pyr->bin_s >= pyr->level_len[0]))
+    return -1;
+  unsigned long idx = t_s / pyr->bin_s;
+  int i;
+  for (i=0; i<pyr->num_levels; i++, idx/=2)
+  {
+    struct lodbin *bin = &pyr->levels[i][idx];
+    // The bins above this one already hold the value if this one did
+    if ((value >= bin->min) && (value <= bin->max))
+      break;
+    if (value < bin->min)
+      bin->min = value;
+    if (value > bin->max)
+      bin->max = value;
+  }
+  if (t_s < pyr->t_first_s)
+    pyr->t_first_s = t_s;
+  if (t_s > pyr->t_last_s)
+    pyr->t_last_s = t_s;
+  if (t_s < pyr->dirty_lo_s)
+    pyr->dirty_lo_s = t_s;
+  if (t_s > pyr->dirty_hi_s)
+    pyr->dirty_hi_s = t_s;
+  return 0;
+}
+
+/** \brief Returns the span in which values were added since the last call.
+ * \return 1 if any values were added, otherwise 0.
+ */
+char lodpyr_take_dirty(struct lodpyr *pyr, double *lo_s, double *hi_s)
+{
+  if (pyr->dirty_lo_s > pyr->dirty_hi_s)
+    return 0;
+  *lo_s = pyr->dirty_lo_s;
+  *hi_s = pyr->dirty_hi_s;
+  pyr->dirty_lo_s = DBL_MAX;
+  pyr->dirty_hi_s = -DBL_MAX;
+  return 1;
+}
+
+/** \brief Reduces the span from t_lo_s to t_hi_s to num_cols columns of equal width.
+ *
+ * Each column gets the range of the bins that overlap it, from the highest level whose bins are no wider than a
+ * column, so a column can include values up to one bin width either side of it. That takes a few bins per column,
+ * however long the span is.
+ */
+void lodpyr_columns(struct lodpyr *pyr, double t_lo_s, double t_hi_s, unsigned long num_cols, struct lodbin *cols)
+{
+  if ((num_cols == 0) || (t_hi_s <= t_lo_s))
+    return;
+  double col_s = (t_hi_s - t_lo_s) / num_cols;
+  int level = 0;
+  while ((level < pyr->num_levels - 1) && (pyr->bin_s * (2UL << level) <= col_s))
+    level++;
+  double bin_s = pyr->bin_s * (1UL << level);
+  struct lodbin *bins = pyr->levels[level];
+  long max_bin = pyr->level_len[level] - 1, bin_lo, bin_hi, j;
+  unsigned long i;
+  for (i=0; i<num_cols; i++)
+  {
+    lodbin_clear(&cols[i]);
+    bin_lo = floor((t_lo_s + i*col_s) / bin_s);
+    bin_hi = ceil((t_lo_s + (i+1)*col_s) / bin_s) - 1;
+    if (bin_lo < 0)
+      bin_lo = 0;
+    if (bin_hi > max_bin)
+      bin_hi = max_bin;
+    for (j=bin_lo; j<=bin_hi; j++)
+    {
+      if (bins[j].min < cols[i].min)
+        cols[i].min = bins[j].min;
+      if (bins[j].max > cols[i].max)
+        cols[i].max = bins[j].max;
+    }
+  }
+}
+
+void lodbin_clear(struct lodbin *bin)
+{
+  bin->min = FLT_MAX;
+  bin->max = -FLT_MAX;
+}
+
+char lodbin_empty(struct lodbin *bin)
+{
+  return bin->min > bin->max;
+}
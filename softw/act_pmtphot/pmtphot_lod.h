@@ -0,0 +1,43 @@
+#ifndef PMTPHOT_LOD
+#define PMTPHOT_LOD
+
+/// Most levels a pyramid can have (enough for 2^31 bins at the bottom)
+#define LODPYR_MAX_LEVELS   32
+
+/// Range of the values in a bin; an empty bin has min > max
+struct lodbin
+{
+  float min, max;
+};
+
+/** \brief Min/max level-of-detail pyramid of values against time.
+ *
+ * Level 0 splits the span from 0 to span_s seconds into bins of bin_s seconds, each holding the range of the values
+ * added in it; every level above halves the number of bins, so bin n of level k covers bins 2n and 2n+1 of level k-1.
+ * All levels are allocated once. Adding a value only touches the bins that contain it (and stops at the first one whose
+ * range doesn't change) and any span can be reduced to a number of display columns from the level whose bins are
+ * closest to the width of a column, so neither depends on how many values have been added.
+ */
+struct lodpyr
+{
+  double bin_s;
+  int num_levels;
+  unsigned long level_len[LODPYR_MAX_LEVELS];
+  struct lodbin *levels[LODPYR_MAX_LEVELS];
+  /// Earliest and latest time a value was added at (t_first_s > t_last_s while the pyramid is empty)
+  double t_first_s, t_last_s;
+  /// Span in which values were added since lodpyr_take_dirty was last called (lo > hi if none)
+  double dirty_lo_s, dirty_hi_s;
+};
+
+int lodpyr_init(struct lodpyr *pyr, double span_s, double bin_s);
+void lodpyr_free(struct lodpyr *pyr);
+void lodpyr_clear(struct lodpyr *pyr);
+char lodpyr_empty(struct lodpyr *pyr);
+int lodpyr_add(struct lodpyr *pyr, double t_s, float value);
+char lodpyr_take_dirty(struct lodpyr *pyr, double *lo_s, double *hi_s);
+void lodpyr_columns(struct lodpyr *pyr, double t_lo_s, double t_hi_s, unsigned long num_cols, struct lodbin *cols);
+void lodbin_clear(struct lodbin *bin);
+char lodbin_empty(struct lodbin *bin);
+
+#endif
@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <act_log.h>
+#include "pmtphot_model.h"
+
+static void phot_model_instance_init(GObject *phot_model);
+static void phot_model_class_init(PhotModelClass *klass);
+static void phot_model_tree_model_init(GtkTreeModelIface *iface);
+static void phot_model_instance_dispose(GObject *phot_model);
+static GtkTreeModelFlags phot_model_get_flags(GtkTreeModel *tree_model);
+static gint phot_model_get_n_columns(GtkTreeModel *tree_model);
+static GType phot_model_get_column_type(GtkTreeModel *tree_model, gint index);
+static gboolean phot_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path);
+static GtkTreePath *phot_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static void phot_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value);
+static gboolean phot_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gboolean phot_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent);
+static gboolean phot_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gint phot_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter);
+static gboolean phot_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n);
+static gboolean phot_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child);
+static void row_inserted(PhotModel *model, unsigned long num);
+static void row_changed(PhotModel *model, unsigned long num);
+static void first_row_deleted(PhotModel *model);
+
+GType phot_model_get_type(void)
+{
+  static GType phot_model_type = 0;
+
+  if (!phot_model_type)
+  {
+    const GTypeInfo phot_model_info =
+    {
+      sizeof (PhotModelClass),
+      NULL, /* base_init */
+      NULL, /* base_finalize */
+      (GClassInitFunc) phot_model_class_init,
+      NULL, /* class_finalize */
+      NULL, /* class_data */
+      sizeof (PhotModel),
+      0,
+      (GInstanceInitFunc) phot_model_instance_init,
+      NULL
+    };
+    const GInterfaceInfo tree_model_info =
+    {
+      (GInterfaceInitFunc) phot_model_tree_model_init,
+      NULL, /* interface_finalize */
+      NULL  /* interface_data */
+    };
+
+    phot_model_type = g_type_register_static (G_TYPE_OBJECT, "PhotModel", &phot_model_info, 0);
+    g_type_add_interface_static (phot_model_type, GTK_TYPE_TREE_MODEL, &tree_model_info);
+  }
+
+  return phot_model_type;
+}
+
+PhotModel *phot_model_new(void)
+{
+  PhotModel *model = g_object_new (phot_model_get_type(), NULL);
+  if (viewrows_init(&model->rows) < 0)
+  {
+    g_object_unref(model);
+    return NULL;
+  }
+  return model;
+}
+
+/// Returns the current line (the last row), or NULL if there are no rows.
+struct viewrow *phot_model_last(PhotModel *model)
+{
+  return viewrows_last(&model->rows);
+}
+
+unsigned long phot_model_add_label(PhotModel *model, const char *text)
+{
+  return viewrows_add_label(&model->rows, text);
+}
+
+/// Appends an empty row as the current line.
+void phot_model_append(PhotModel *model, char linetype, unsigned long label)
+{
+  if (viewrows_append(&model->rows, linetype, label))
+    first_row_deleted(model);
+  row_inserted(model, model->rows.head - 1);
+}
+
+/// Inserts a comment line before the current line.
+void phot_model_insert_comment(PhotModel *model, const char *comment, char warn, char err)
+{
+  unsigned long label = viewrows_add_label(&model->rows, comment);
+  int had_rows = viewrows_num(&model->rows) > 0;
+  if (viewrows_insert_before_last(&model->rows, LINETYPE_COMMENT, label, warn, err))
+    first_row_deleted(model);
+  // The comment took over the current line's row and the current line moved to a new row at the end
+  if (had_rows)
+    row_changed(model, model->rows.head - 2);
+  row_inserted(model, model->rows.head - 1);
+}
+
+/// Tells the view that the current line has changed.
+void phot_model_last_changed(PhotModel *model)
+{
+  if (viewrows_num(&model->rows) > 0)
+    row_changed(model, model->rows.head - 1);
+}
+
+/** \brief Adds a completed sample to the current line, which must be an integration line.
+ *
+ * Once the line holds decim samples, the next line (for the same integration) is appended. The view isn't told about
+ * changes to a line that isn't complete yet - call phot_model_last_changed once the samples have been added.
+ */
+void phot_model_add_sample(PhotModel *model, struct timestruct *start_unitime, double integt_s, unsigned long counts, char warn, char err, unsigned long decim)
+{
+  if (!viewrows_add_sample(&model->rows, start_unitime, integt_s, counts, warn, err, decim))
+    return;
+  unsigned long label = viewrows_last(&model->rows)->label;
+  phot_model_last_changed(model);
+  phot_model_append(model, LINETYPE_INTEG, label);
+}
+
+static void row_inserted(PhotModel *model, unsigned long num)
+{
+  GtkTreeIter iter = { .stamp = model->stamp, .user_data = GSIZE_TO_POINTER(num) };
+  GtkTreePath *path = gtk_tree_path_new_from_indices(num - model->rows.first, -1);
+  gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+  gtk_tree_path_free(path);
+}
+
+static void row_changed(PhotModel *model, unsigned long num)
+{
+  GtkTreeIter iter = { .stamp = model->stamp, .user_data = GSIZE_TO_POINTER(num) };
+  GtkTreePath *path = gtk_tree_path_new_from_indices(num - model->rows.first, -1);
+  gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+  gtk_tree_path_free(path);
+}
+
+static void first_row_deleted(PhotModel *model)
+{
+  GtkTreePath *path = gtk_tree_path_new_from_indices(0, -1);
+  gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+  gtk_tree_path_free(path);
+}
+
+static void phot_model_instance_init(GObject *phot_model)
+{
+  PhotModel *model = PHOT_MODEL(phot_model);
+  model->stamp = g_random_int();
+  model->rows.rows = NULL;
+  model->rows.labels = NULL;
+}
+
+static void phot_model_class_init(PhotModelClass *klass)
+{
+  G_OBJECT_CLASS(klass)->dispose = phot_model_instance_dispose;
+}
+
+static void phot_model_tree_model_init(GtkTreeModelIface *iface)
+{
+  iface->get_flags = phot_model_get_flags;
+  iface->get_n_columns = phot_model_get_n_columns;
+  iface->get_column_type = phot_model_get_column_type;
+  iface->get_iter = phot_model_get_iter;
+  iface->get_path = phot_model_get_path;
+  iface->get_value = phot_model_get_value;
+  iface->iter_next = phot_model_iter_next;
+  iface->iter_children = phot_model_iter_children;
+  iface->iter_has_child = phot_model_iter_has_child;
+  iface->iter_n_children = phot_model_iter_n_children;
+  iface->iter_nth_child = phot_model_iter_nth_child;
+  iface->iter_parent = phot_model_iter_parent;
+}
+
+static void phot_model_instance_dispose(GObject *phot_model)
+{
+  PhotModel *model = PHOT_MODEL(phot_model);
+  viewrows_free(&model->rows);
+}
+
+static GtkTreeModelFlags phot_model_get_flags(GtkTreeModel *tree_model)
+{
+  (void)tree_model;
+  return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint phot_model_get_n_columns(GtkTreeModel *tree_model)
+{
+  (void)tree_model;
+  return PHOT_MODEL_NUMCOLS;
+}
+
+static GType phot_model_get_column_type(GtkTreeModel *tree_model, gint index)
+{
+  (void)tree_model;
+  switch (index)
+  {
+    case PHOT_MODEL_TEXT:
+      return G_TYPE_STRING;
+    case PHOT_MODEL_LINETYPE:
+    case PHOT_MODEL_WARN:
+    case PHOT_MODEL_ERR:
+      return G_TYPE_INT;
+    default:
+      return G_TYPE_INVALID;
+  }
+}
+
+static gboolean phot_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+  if (gtk_tree_path_get_depth(path) != 1)
+    return FALSE;
+  gint index = gtk_tree_path_get_indices(path)[0];
+  return phot_model_iter_nth_child(tree_model, iter, NULL, index);
+}
+
+static GtkTreePath *phot_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  PhotModel *model = PHOT_MODEL(tree_model);
+  g_return_val_if_fail(iter->stamp == model->stamp, NULL);
+  return gtk_tree_path_new_from_indices(GPOINTER_TO_SIZE(iter->user_data) - model->rows.first, -1);
+}
+
+static void phot_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value)
+{
+  PhotModel *model = PHOT_MODEL(tree_model);
+  g_value_init(value, phot_model_get_column_type(tree_model, column));
+  if (iter->stamp != model->stamp)
+    return;
+  unsigned long num = GPOINTER_TO_SIZE(iter->user_data);
+  struct viewrow *row = viewrows_get(&model->rows, num);
+  if (row == NULL)
+    return;
+  switch (column)
+  {
+    case PHOT_MODEL_LINETYPE:
+      g_value_set_int(value, row->linetype);
+      break;
+    case PHOT_MODEL_WARN:
+      g_value_set_int(value, row->warn);
+      break;
+    case PHOT_MODEL_ERR:
+      g_value_set_int(value, row->err);
+      break;
+    case PHOT_MODEL_TEXT:
+    {
+      char line[VIEWROWS_LINE_SIZE];
+      if (viewrows_format(&model->rows, num, line, sizeof(line)) >= 0)
+        g_value_set_string(value, line);
+      break;
+    }
+    default:
+      act_log_error(act_log_msg("Invalid photometry view column (%d).", column));
+  }
+}
+
+static gboolean phot_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  PhotModel *model = PHOT_MODEL(tree_model);
+  unsigned long num = GPOINTER_TO_SIZE(iter->user_data) + 1;
+  if ((iter->stamp != model->stamp) || (viewrows_get(&model->rows, num) == NULL))
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+  iter->user_data = GSIZE_TO_POINTER(num);
+  return TRUE;
+}
+
+static gboolean phot_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent)
+{
+  return phot_model_iter_nth_child(tree_model, iter, parent, 0);
+}
+
+static gboolean phot_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  (void)tree_model;
+  (void)iter;
+  return FALSE;
+}
+
+static gint phot_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  PhotModel *model = PHOT_MODEL(tree_model);
+  if (iter != NULL)
+    return 0;
+  return viewrows_num(&model->rows);
+}
+
+static gboolean phot_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n)
+{
+  PhotModel *model = PHOT_MODEL(tree_model);
+  if ((parent != NULL) || (n < 0) || ((unsigned long)n >= viewrows_num(&model->rows)))
+    return FALSE;
+  iter->stamp = model->stamp;
+  iter->user_data = GSIZE_TO_POINTER(model->rows.first + n);
+  return TRUE;
+}
+
+static gboolean phot_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+  (void)tree_model;
+  (void)iter;
+  (void)child;
+  return FALSE;
+}
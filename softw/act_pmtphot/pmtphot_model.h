@@ -0,0 +1,57 @@
+#ifndef __PMTPHOT_MODEL_H__
+#define __PMTPHOT_MODEL_H__
+
+#include <gtk/gtk.h>
+#include "pmtphot_viewrows.h"
+
+G_BEGIN_DECLS
+
+#define PHOT_MODEL_TYPE              (phot_model_get_type())
+#define PHOT_MODEL(objs)             (G_TYPE_CHECK_INSTANCE_CAST ((objs), PHOT_MODEL_TYPE, PhotModel))
+#define PHOT_MODEL_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), PHOT_MODEL_TYPE, PhotModelClass))
+#define IS_PHOT_MODEL(objs)          (G_TYPE_CHECK_INSTANCE_TYPE ((objs), PHOT_MODEL_TYPE))
+#define IS_PHOT_MODEL_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), PHOT_MODEL_TYPE))
+
+/// Columns of the model - the text of a row is only produced when the column is read
+enum
+{
+  PHOT_MODEL_LINETYPE = 0,
+  PHOT_MODEL_TEXT,
+  PHOT_MODEL_WARN,
+  PHOT_MODEL_ERR,
+  PHOT_MODEL_NUMCOLS
+};
+
+typedef struct _PhotModel       PhotModel;
+typedef struct _PhotModelClass  PhotModelClass;
+
+/** \brief List-only GtkTreeModel over the rows of the photometry view (struct viewrows).
+ *
+ * Rows are changed through the phot_model_* functions, which emit the signals the tree view needs. The iter of a row
+ * holds its row number, so a path's index is the row number less the number of the first row kept.
+ */
+struct _PhotModel
+{
+  GObject parent;
+
+  gint stamp;
+  struct viewrows rows;
+};
+
+struct _PhotModelClass
+{
+  GObjectClass parent_class;
+};
+
+GType phot_model_get_type(void);
+PhotModel *phot_model_new(void);
+struct viewrow *phot_model_last(PhotModel *model);
+unsigned long phot_model_add_label(PhotModel *model, const char *text);
+void phot_model_append(PhotModel *model, char linetype, unsigned long label);
+void phot_model_insert_comment(PhotModel *model, const char *comment, char warn, char err);
+void phot_model_last_changed(PhotModel *model);
+void phot_model_add_sample(PhotModel *model, struct timestruct *start_unitime, double integt_s, unsigned long counts, char warn, char err, unsigned long decim);
+
+G_END_DECLS
+
+#endif  /* __PMTPHOT_MODEL_H__ */
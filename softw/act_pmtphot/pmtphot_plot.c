@@ -1,22 +1,69 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
 #include <gtk/gtk.h>
+#include <cairo-pdf.h>
 #include <act_log.h>
 #include "pmtphot_plot.h"
 #include "pmtfuncs.h"
 
+/// Seconds in the fractional JD the plot covers, and width of the finest bins of its level-of-detail pyramids
+#define PLOT_SPAN_S         86400.0
+#define PLOT_BIN_S          0.125
+/// Narrowest span shown - the span shown while following new samples starts here and doubles as they reach its end
+#define PLOT_MIN_SPAN_S     600.0
+#define PLOT_MARGIN_LEFT    70
+#define PLOT_MARGIN_RIGHT   10
+#define PLOT_MARGIN_TOP     10
+#define PLOT_MARGIN_BOTTOM  40
+/// Size of plots saved as PDF (A4 landscape, in points)
+#define PLOT_PDF_WIDTH      842
+#define PLOT_PDF_HEIGHT     595
+
+struct plotcolours
+{
+  double bg[3], fg[3], grid[3], data[3];
+};
+
+static const struct plotcolours G_screen_colours =
+{
+  .bg = { 0.0, 0.0, 0.0 },
+  .fg = { 0.0, 1.0, 0.0 },
+  .grid = { 0.0, 0.35, 0.0 },
+  .data = { 1.0, 1.0, 0.0 }
+};
+
+static const struct plotcolours G_print_colours =
+{
+  .bg = { 1.0, 1.0, 1.0 },
+  .fg = { 0.0, 0.0, 0.0 },
+  .grid = { 0.8, 0.8, 0.8 },
+  .data = { 0.0, 0.0, 0.6 }
+};
+
 void plot_all_toggled(gpointer user_data);
 void plot_star_toggled(gpointer user_data);
 void plot_box_show(gpointer user_data);
-void plot_box_hide(gpointer user_data);
-void plot_socket_realized(GtkWidget *sck_plot, gpointer user_data);
+gboolean plot_configure(gpointer user_data);
+gboolean plot_expose(gpointer user_data, GdkEventExpose *event);
+gboolean plot_scroll(gpointer user_data, GdkEventScroll *event);
+gboolean plot_button_press(gpointer user_data, GdkEventButton *event);
 void save_plot_pdf(GtkWidget *btn_save_plot_pdf, gpointer user_data);
 void save_plot_dialog_response(GtkWidget* dialog, gint response_id, gpointer user_data);
 void disp_plot_help(GtkWidget *btn_plothelp);
-// gboolean plot_box_keypress(GtkWidget *widget, GdkEvent *event, gpointer user_data);
+static double plot_time_s(struct timestruct *unitime);
+static struct lodpyr *plot_lod(struct plotobjects *objs);
+static void plot_add_point(struct plotobjects *objs, double t_s, unsigned long counts, char star);
+static char plot_follow_view(struct plotobjects *objs);
+static void plot_update(struct plotobjects *objs);
+static void plot_redraw_all(struct plotobjects *objs);
+static void autoscale(struct lodbin *cols, unsigned long num_cols, double *y_lo, double *y_hi);
+static void draw_columns(cairo_t *cr, struct lodbin *cols, unsigned long col_lo, unsigned long col_hi, int height, double y_lo, double y_hi, const struct plotcolours *colours);
+static void draw_axes(cairo_t *cr, int width, int height, double view_lo_s, double view_hi_s, double y_lo, double y_hi, const struct plotcolours *colours);
+static double tick_step(double span, int max_ticks);
 
 struct plotobjects *create_plotobjs(GtkWidget *container)
 {
@@ -33,39 +80,28 @@ struct plotobjects *create_plotobjs(GtkWidget *container)
   }
   
   objs->cur_targ_id = 0;
-  sprintf(objs->plotdata_filename,"/tmp/act_plotXXXXXX");
-  int tmp_plot_fd = mkstemp(objs->plotdata_filename);
-  if (tmp_plot_fd <= 0)
-  {
-    act_log_error(act_log_msg("Could not get file descriptor for temporary file to store plot data."));
-    free(objs);
-    return NULL;
-  }
-  act_log_debug(act_log_msg("Saving plot data to %s", objs->plotdata_filename));
-  objs->plotdata_fp = fdopen(tmp_plot_fd, "a");
-  if (objs->plotdata_fp == NULL)
+  objs->samp_cursor = 0;
+  objs->data_surf = NULL;
+  objs->cols = NULL;
+  objs->num_cols = 0;
+  objs->view_lo_s = 0.0;
+  objs->view_hi_s = PLOT_MIN_SPAN_S;
+  objs->y_lo = 0.0;
+  objs->y_hi = 1.0;
+  objs->follow = TRUE;
+  if (lodpyr_init(&objs->lod_all, PLOT_SPAN_S, PLOT_BIN_S) < 0)
   {
-    act_log_error(act_log_msg("Could not get file pointer for temporary file to store plot data."));
+    act_log_error(act_log_msg("Could not create plot data pyramid."));
     free(objs);
     return NULL;
   }
-  
-  objs->gnuplot_fp = popen("gnuplot -background 'black' 2> /dev/null", "w");
-  if (objs->gnuplot_fp == NULL)
+  if (lodpyr_init(&objs->lod_star, PLOT_SPAN_S, PLOT_BIN_S) < 0)
   {
-    act_log_error(act_log_msg("Could not start GNUplot with pipe."));
-    fclose(objs->plotdata_fp);
+    act_log_error(act_log_msg("Could not create plot data pyramid."));
+    lodpyr_free(&objs->lod_all);
     free(objs);
     return NULL;
   }
-  fprintf(objs->gnuplot_fp, "set term dumb\n");
-  fprintf(objs->gnuplot_fp, "set nokey\n");
-  fprintf(objs->gnuplot_fp, "set border linecolor rgb 'green'\n");
-  fprintf(objs->gnuplot_fp, "set style line 1 pt 13\n");
-  fprintf(objs->gnuplot_fp, "set grid lc 2\n");
-  fprintf(objs->gnuplot_fp, "set xlabel 'Frac. JD' textcolor rgb 'green' font ',15'\n");
-  fprintf(objs->gnuplot_fp, "set ylabel 'Counts' textcolor rgb 'green' font ',15'\n");
-  fflush(objs->gnuplot_fp);
   
   GtkWidget *box_plot = gtk_table_new(3,2,FALSE);
   gtk_container_add(GTK_CONTAINER(container),box_plot);
@@ -83,10 +119,14 @@ struct plotobjects *create_plotobjs(GtkWidget *container)
   g_object_ref(objs->evb_plot_box);
   gtk_table_attach(GTK_TABLE(box_plot),objs->evb_plot_box,0,2,1,2,GTK_FILL|GTK_EXPAND,GTK_FILL|GTK_EXPAND,3,3);
   g_signal_connect_swapped(G_OBJECT(objs->evb_plot_box),"show",G_CALLBACK(plot_box_show),objs);
-  g_signal_connect_swapped(G_OBJECT(objs->evb_plot_box),"hide",G_CALLBACK(plot_box_hide),objs);
-//   g_signal_connect(G_OBJECT(objs->evb_plot_box), "key-press-event", G_CALLBACK(plot_box_keypress), objs);
-//   int plot_events = gtk_widget_get_events(objs->evb_plot_box);
-//   gtk_widget_set_events(objs->evb_plot_box, plot_events & (~(GDK_KEY_PRESS_MASK | GDK_KEY_RELEASE_MASK)));
+  objs->dra_plot = gtk_drawing_area_new();
+  gtk_widget_set_size_request(objs->dra_plot, 400, 300);
+  gtk_widget_add_events(objs->dra_plot, GDK_BUTTON_PRESS_MASK | GDK_SCROLL_MASK);
+  g_signal_connect_swapped(G_OBJECT(objs->dra_plot), "configure-event", G_CALLBACK(plot_configure), objs);
+  g_signal_connect_swapped(G_OBJECT(objs->dra_plot), "expose-event", G_CALLBACK(plot_expose), objs);
+  g_signal_connect_swapped(G_OBJECT(objs->dra_plot), "scroll-event", G_CALLBACK(plot_scroll), objs);
+  g_signal_connect_swapped(G_OBJECT(objs->dra_plot), "button-press-event", G_CALLBACK(plot_button_press), objs);
+  gtk_container_add(GTK_CONTAINER(objs->evb_plot_box),objs->dra_plot);
   
   objs->btn_save_plot_pdf = gtk_button_new_with_label("Save PDF");
   g_object_ref(objs->btn_save_plot_pdf);
@@ -108,12 +148,16 @@ void finalise_plotobjs(struct plotobjects *objs)
     return;
   }
   gtk_widget_hide_all(objs->evb_plot_box);
-  fclose(objs->plotdata_fp);
-  objs->plotdata_fp = NULL;
-  fprintf(objs->gnuplot_fp,"exit\n");
-  fflush(objs->gnuplot_fp);
-  pclose(objs->gnuplot_fp);
-  objs->gnuplot_fp = NULL;
+  if (objs->data_surf != NULL)
+  {
+    cairo_surface_destroy(objs->data_surf);
+    objs->data_surf = NULL;
+  }
+  free(objs->cols);
+  objs->cols = NULL;
+  objs->num_cols = 0;
+  lodpyr_free(&objs->lod_all);
+  lodpyr_free(&objs->lod_star);
   g_object_unref(objs->btn_plot_all);
   g_object_unref(objs->btn_plot_star);
 }
@@ -125,29 +169,16 @@ void plot_set_pmtdetail(struct plotobjects *objs, struct pmtdetailstruct *pmtdet
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  if (objs->plotdata_fp == NULL)
-  {
-    act_log_error(act_log_msg("Plot data file not available."));
-    return;
-  }
   if (pmt_integrating(pmtdetail->pmt_stat))
   {
     act_log_debug(act_log_msg("Currently integrating, so will not plot estimated count rate."));
     return;
   }
-  objs->cur_targ_id = 0;
-  double tmp_time = convert_HMSMS_H_time(&pmtdetail->cur_unitime) / 24.0;
-  if (tmp_time < 0.5)
-    tmp_time += 0.5;
-  fprintf(objs->plotdata_fp, "%10.7f\t%15lu\t%d\n", tmp_time, pmtdetail->est_counts_s, 0);
-  fflush(objs->plotdata_fp);
-  if ((gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(objs->btn_plot_all))) || (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(objs->btn_plot_star))))
-  {
-    fprintf(objs->gnuplot_fp,"replot\n");
-    fflush(objs->gnuplot_fp);
-  }
+  plot_add_point(objs, plot_time_s(&pmtdetail->cur_unitime), pmtdetail->est_counts_s, FALSE);
+  plot_update(objs);
 }
 
+/// Starts a new star plot if targ_id isn't the target currently plotted.
 void plot_set_targid(struct plotobjects *objs, int targ_id)
 {
   if (objs == NULL)
@@ -155,44 +186,31 @@ void plot_set_targid(struct plotobjects *objs, int targ_id)
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
+  if (targ_id == objs->cur_targ_id)
+    return;
   objs->cur_targ_id = targ_id;
+  lodpyr_clear(&objs->lod_star);
+  if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(objs->btn_plot_star)))
+    plot_redraw_all(objs);
 }
 
-void plot_add_data(struct plotobjects *objs, struct pmtintegstruct *pmtinteg)
+void plot_add_data(struct plotobjects *objs, struct sampring *samples, struct pmtintegstruct *pmtinteg)
 {
-  if ((objs == NULL) || (pmtinteg == NULL))
+  if ((objs == NULL) || (samples == NULL) || (pmtinteg == NULL))
   {
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  if ((objs->gnuplot_fp == NULL) || (objs->plotdata_fp == NULL))
-  {
-    act_log_error(act_log_msg("GNUplot pipe pointer or plot data file pointer invalid."));
-    return;
-  }
   
-  struct pmtintegstruct *lastinteg = pmtinteg;
-  char done = lastinteg->done;
-  double tmp_time;
-  while (done > 0)
+  plot_set_targid(objs, pmtinteg->targid);
+  unsigned long i, slot, num;
+  while ((num = sampring_peek(samples, &objs->samp_cursor, &slot)) > 0)
   {
-    tmp_time = convert_HMSMS_H_time(&lastinteg->start_unitime) / 24.0;
-    if (tmp_time < 0.5)
-      tmp_time += 0.5;
-    fprintf(objs->plotdata_fp, "%10.7f\t%15lu\t%d\n", tmp_time, pmtinteg->counts, pmtinteg->targid);
-    if (lastinteg->next != NULL)
-    {
-      lastinteg = (struct pmtintegstruct *)lastinteg->next;
-      done = lastinteg->done;
-    }
-    else
-      done = 0;
+    for (i=slot; i<slot+num; i++)
+      plot_add_point(objs, plot_time_s(&samples->start_unitime[i]), samples->counts[i], TRUE);
+    objs->samp_cursor += num;
   }
-  
-  fflush(objs->plotdata_fp);
-  objs->cur_targ_id = lastinteg->targid;
-  fprintf(objs->gnuplot_fp,"replot\n");
-  fflush(objs->gnuplot_fp);
+  plot_update(objs);
 }
 
 void plot_all_toggled(gpointer user_data)
@@ -215,11 +233,10 @@ void plot_all_toggled(gpointer user_data)
   act_log_debug(act_log_msg("Plot all toggled"));
   gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(objs->btn_plot_star),FALSE);
   if (!gtk_widget_get_visible(objs->evb_plot_box))
-    gtk_widget_show(objs->evb_plot_box);
+    gtk_widget_show_all(objs->evb_plot_box);
   gtk_widget_show(objs->btn_save_plot_pdf);
   gtk_widget_show(objs->btn_plothelp);
-  fprintf(objs->gnuplot_fp,"plot '%s' w lp ls 1\n", objs->plotdata_filename);
-  fflush(objs->gnuplot_fp);
+  plot_redraw_all(objs);
 }
 
 void plot_star_toggled(gpointer user_data)
@@ -242,11 +259,10 @@ void plot_star_toggled(gpointer user_data)
   act_log_debug(act_log_msg("Plot star toggled."));
   gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(objs->btn_plot_all),FALSE);
   if (!gtk_widget_get_visible(objs->evb_plot_box))
-    gtk_widget_show(objs->evb_plot_box);
+    gtk_widget_show_all(objs->evb_plot_box);
   gtk_widget_show(objs->btn_save_plot_pdf);
   gtk_widget_show(objs->btn_plothelp);
-  fprintf(objs->gnuplot_fp,"plot '%s' using 1:($3==%d?$2:1/0) w lp ls 1\n", objs->plotdata_filename, objs->cur_targ_id);
-  fflush(objs->gnuplot_fp);
+  plot_redraw_all(objs);
 }
 
 void plot_box_show(gpointer user_data)
@@ -263,62 +279,110 @@ void plot_box_show(gpointer user_data)
     gtk_widget_hide_all(objs->evb_plot_box);
     gtk_widget_hide(objs->btn_save_plot_pdf);
     gtk_widget_hide(objs->btn_plothelp);
-    return;
-  }
-  act_log_debug(act_log_msg("Creating plot box"));
-  GtkWidget *sck_plot = gtk_bin_get_child(GTK_BIN(objs->evb_plot_box));
-  if (sck_plot != NULL)
-  {
-    act_log_error(act_log_msg("Strange - plot socket container already contains a plot socket. Removing old socket and creating a new one."));
-    gtk_widget_destroy(sck_plot);
   }
-  sck_plot = gtk_socket_new();
-  g_signal_connect(G_OBJECT(sck_plot),"realize",G_CALLBACK(plot_socket_realized),user_data);
-  gtk_container_add(GTK_CONTAINER(objs->evb_plot_box),sck_plot);
-  gtk_widget_set_size_request(sck_plot, 400, 300);
-  gtk_widget_show_all(objs->evb_plot_box);
 }
 
-void plot_box_hide(gpointer user_data)
+gboolean plot_configure(gpointer user_data)
 {
-  if (user_data == NULL)
+  struct plotobjects *objs = (struct plotobjects *)user_data;
+  int width = objs->dra_plot->allocation.width - PLOT_MARGIN_LEFT - PLOT_MARGIN_RIGHT;
+  int height = objs->dra_plot->allocation.height - PLOT_MARGIN_TOP - PLOT_MARGIN_BOTTOM;
+  if (width < 1)
+    width = 1;
+  if (height < 1)
+    height = 1;
+  if ((objs->data_surf != NULL) && (cairo_image_surface_get_width(objs->data_surf) == width) && (cairo_image_surface_get_height(objs->data_surf) == height))
+    return TRUE;
+  struct lodbin *cols = realloc(objs->cols, width * sizeof(struct lodbin));
+  if (cols == NULL)
   {
-    act_log_error(act_log_msg("Invalid input parameters."));
-    return;
+    act_log_error(act_log_msg("Could not allocate space for plot columns."));
+    return TRUE;
   }
-  act_log_debug(act_log_msg("Hiding plot box"));
+  objs->cols = cols;
+  objs->num_cols = width;
+  if (objs->data_surf != NULL)
+    cairo_surface_destroy(objs->data_surf);
+  objs->data_surf = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+  plot_redraw_all(objs);
+  return TRUE;
+}
+
+gboolean plot_expose(gpointer user_data, GdkEventExpose *event)
+{
   struct plotobjects *objs = (struct plotobjects *)user_data;
-  fprintf(objs->gnuplot_fp, "set term dumb\n");
-  fflush(objs->gnuplot_fp);
-  GtkWidget *sck_plot = gtk_bin_get_child(GTK_BIN(objs->evb_plot_box));
-  if (sck_plot != NULL)
-    gtk_widget_destroy(sck_plot);
+  if (objs->data_surf == NULL)
+    return TRUE;
+  int width = objs->dra_plot->allocation.width, height = objs->dra_plot->allocation.height;
+  cairo_t *cr = gdk_cairo_create(objs->dra_plot->window);
+  gdk_cairo_region(cr, event->region);
+  cairo_clip(cr);
+  cairo_set_source_rgb(cr, G_screen_colours.bg[0], G_screen_colours.bg[1], G_screen_colours.bg[2]);
+  cairo_paint(cr);
+  cairo_set_source_surface(cr, objs->data_surf, PLOT_MARGIN_LEFT, PLOT_MARGIN_TOP);
+  cairo_rectangle(cr, PLOT_MARGIN_LEFT, PLOT_MARGIN_TOP, cairo_image_surface_get_width(objs->data_surf), cairo_image_surface_get_height(objs->data_surf));
+  cairo_fill(cr);
+  draw_axes(cr, width, height, objs->view_lo_s, objs->view_hi_s, objs->y_lo, objs->y_hi, &G_screen_colours);
+  cairo_destroy(cr);
+  return TRUE;
 }
 
-void plot_socket_realized(GtkWidget *sck_plot, gpointer user_data)
+/// Zooms in (scroll up) and out (scroll down) around the pointer, or pans with Shift held or with sideways scrolling.
+gboolean plot_scroll(gpointer user_data, GdkEventScroll *event)
 {
-  if (user_data == NULL)
-  {
-    act_log_error(act_log_msg("Invalid input parameters."));
-    return;
-  }
-  act_log_debug(act_log_msg("Plot box realized"));
   struct plotobjects *objs = (struct plotobjects *)user_data;
-  gtk_widget_set_can_focus (sck_plot, TRUE);
-  gtk_widget_grab_focus(sck_plot);
-  int width, height;
-  width = sck_plot->allocation.width;
-  height = sck_plot->allocation.height;
-  int sock_id = gtk_socket_get_id(GTK_SOCKET(sck_plot));
-  if (sock_id <= 0)
+  if (objs->num_cols == 0)
+    return TRUE;
+  double span_s = objs->view_hi_s - objs->view_lo_s, shift_s = 0.0, factor = 1.0;
+  switch (event->direction)
   {
-    act_log_error(act_log_msg("Could not get identifier for plot socket."));
-    return;
+    case GDK_SCROLL_UP:
+      if (event->state & GDK_SHIFT_MASK)
+        shift_s = -0.1 * span_s;
+      else
+        factor = 0.5;
+      break;
+    case GDK_SCROLL_DOWN:
+      if (event->state & GDK_SHIFT_MASK)
+        shift_s = 0.1 * span_s;
+      else
+        factor = 2.0;
+      break;
+    case GDK_SCROLL_LEFT:
+      shift_s = -0.1 * span_s;
+      break;
+    case GDK_SCROLL_RIGHT:
+      shift_s = 0.1 * span_s;
+      break;
+    default:
+      return FALSE;
   }
-  act_log_debug(act_log_msg("Plot window ID: %d (%x)", sock_id, sock_id));
-  fprintf(objs->gnuplot_fp,"set term x11 window \"%x\" noraise size %d,%d\n", sock_id, width, height);
-  fprintf(objs->gnuplot_fp,"replot\n");
-  fflush(objs->gnuplot_fp);
+  // Zooming in stops at a few of the finest bins per column
+  if (span_s * factor < 4 * PLOT_BIN_S * objs->num_cols)
+    factor = 4 * PLOT_BIN_S * objs->num_cols / span_s;
+  if (span_s * factor > PLOT_SPAN_S)
+    factor = PLOT_SPAN_S / span_s;
+  double ptr_s = objs->view_lo_s + (event->x - PLOT_MARGIN_LEFT) / objs->num_cols * span_s;
+  if (ptr_s < objs->view_lo_s)
+    ptr_s = objs->view_lo_s;
+  if (ptr_s > objs->view_hi_s)
+    ptr_s = objs->view_hi_s;
+  objs->view_lo_s = ptr_s - (ptr_s - objs->view_lo_s) * factor + shift_s;
+  objs->view_hi_s = ptr_s + (objs->view_hi_s - ptr_s) * factor + shift_s;
+  objs->follow = FALSE;
+  plot_redraw_all(objs);
+  return TRUE;
+}
+
+/// A right-click goes back to showing the whole run and following new samples.
+gboolean plot_button_press(gpointer user_data, GdkEventButton *event)
+{
+  struct plotobjects *objs = (struct plotobjects *)user_data;
+  if (event->button != 3)
+    return FALSE;
+  objs->follow = TRUE;
+  plot_redraw_all(objs);
+  return TRUE;
 }
 
 void save_plot_pdf(GtkWidget *btn_save_plot_pdf, gpointer user_data)
@@ -352,26 +416,31 @@ void save_plot_dialog_response(GtkWidget* dialog, gint response_id, gpointer use
   struct plotobjects *objs = (struct plotobjects *)user_data;
   char *filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER (dialog));
   
-  fprintf(objs->gnuplot_fp, "set term pdf enhanced size 29.7cm,21cm\n");
-  fprintf(objs->gnuplot_fp, "set output '%s'\n", filename);
-  fprintf(objs->gnuplot_fp, "set border\n");
-  fprintf(objs->gnuplot_fp, "set style line 1 pt 13\n");
-  fprintf(objs->gnuplot_fp, "set xlabel 'Frac. JD' textcolor rgb 'black' font ',12'\n");
-  fprintf(objs->gnuplot_fp, "set ylabel 'Counts' textcolor rgb 'black' font ',12'\n");
-  fprintf(objs->gnuplot_fp, "replot\n");
-  if (gtk_widget_get_visible(objs->evb_plot_box))
+  int num_cols = PLOT_PDF_WIDTH - PLOT_MARGIN_LEFT - PLOT_MARGIN_RIGHT, height = PLOT_PDF_HEIGHT - PLOT_MARGIN_TOP - PLOT_MARGIN_BOTTOM;
+  struct lodbin *cols = malloc(num_cols * sizeof(struct lodbin));
+  cairo_surface_t *pdf_surf = cairo_pdf_surface_create(filename, PLOT_PDF_WIDTH, PLOT_PDF_HEIGHT);
+  if ((cols == NULL) || (cairo_surface_status(pdf_surf) != CAIRO_STATUS_SUCCESS))
+    act_log_error(act_log_msg("Could not save plot to %s.", filename));
+  else
   {
-    gtk_widget_hide_all(objs->evb_plot_box);
-    gtk_widget_show_all(objs->evb_plot_box);
-    fprintf(objs->gnuplot_fp, "set output\n");
+    if (objs->follow)
+      plot_follow_view(objs);
+    double y_lo, y_hi;
+    lodpyr_columns(plot_lod(objs), objs->view_lo_s, objs->view_hi_s, num_cols, cols);
+    autoscale(cols, num_cols, &y_lo, &y_hi);
+    cairo_t *cr = cairo_create(pdf_surf);
+    cairo_set_source_rgb(cr, G_print_colours.bg[0], G_print_colours.bg[1], G_print_colours.bg[2]);
+    cairo_paint(cr);
+    cairo_save(cr);
+    cairo_translate(cr, PLOT_MARGIN_LEFT, PLOT_MARGIN_TOP);
+    draw_columns(cr, cols, 0, num_cols, height, y_lo, y_hi, &G_print_colours);
+    cairo_restore(cr);
+    draw_axes(cr, PLOT_PDF_WIDTH, PLOT_PDF_HEIGHT, objs->view_lo_s, objs->view_hi_s, y_lo, y_hi, &G_print_colours);
+    cairo_destroy(cr);
   }
-  else
-    fprintf(objs->gnuplot_fp, "set term dumb\n");
-  fprintf(objs->gnuplot_fp, "set border linecolor rgb 'green'\n");
-  fprintf(objs->gnuplot_fp, "set style line 1 pt 13\n");
-  fprintf(objs->gnuplot_fp, "set xlabel 'Frac. JD' textcolor rgb 'green' font ',15'\n");
-  fprintf(objs->gnuplot_fp, "set ylabel 'Counts' textcolor rgb 'green' font ',15'\n");
-  fflush(objs->gnuplot_fp);
+  // Destroying the surface finishes the file
+  cairo_surface_destroy(pdf_surf);
+  free(cols);
   
   g_free (filename);
   gtk_widget_destroy(dialog);
@@ -381,48 +450,258 @@ void disp_plot_help(GtkWidget *btn_plothelp)
 {
   GtkWidget *plot_help_dialog = gtk_message_dialog_new(GTK_WINDOW(gtk_widget_get_toplevel(btn_plothelp)), GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_INFO, GTK_BUTTONS_CLOSE, "Interactive Plot Window Help");
   gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(plot_help_dialog),
-  "Plotting is done with the assistance of GNUplot (www.gnuplot.info).\n\n\
-  All the interactive features provided by GNUplot are available in the plot \
-  window. A brief description of the most commonly used features follows here.\n\n\
-  When moving the cursor over the plot window, the X and Y coordinates of the \
-  pointer are displayed in the bottom-left corner.\n\n\
-  Zoom in and out by holding the Ctrl key while scrolling (with the mouse wheel) \
-  up and down, respectively.\n\n\
-  Alternatively, select a zooming region by right-clicking in one corner of the \
-  desired region, moving to the opposite corner and left-clicking.\n\n\
-  The plot can be panned up and down (Y-direction) with the mouse wheel \
-  and panned left and right (X-direction) with the mouse wheel while holding Shift.\n\n\
-  'a' key : Activate autoscale (undo zoom/pan).\n\n\
-  'b' key : Toggle border visibility.\n\n\
-  'g' key : Toggle grid visibility.\n\n\
-  'r' key : Toggle ruler.\n\n\
-  'l' key : Toggle logarithmic Y-axis scale.");
+  "The plot shows the counts of each sample against fractional JD - all samples \
+  (including the estimated count rate while idle) with 'Plot All', or only the \
+  samples of the current target with 'Plot Star'.\n\n\
+  Where a screen column covers several samples, it shows the range of their counts.\n\n\
+  While the whole run is shown, the plot grows to include new samples.\n\n\
+  Zoom in and out around the pointer by scrolling (with the mouse wheel) up \
+  and down, respectively.\n\n\
+  The plot can be panned left and right with the mouse wheel while holding Shift.\n\n\
+  Right-click to show the whole run again (undo zoom/pan).\n\n\
+  The counts axis is always scaled to the samples shown.");
   gtk_widget_show_all(plot_help_dialog);
   g_signal_connect_swapped(G_OBJECT(plot_help_dialog), "response", G_CALLBACK(gtk_widget_destroy), plot_help_dialog);
 }
 
-/*gboolean plot_box_keypress(GtkWidget *widget, GdkEvent *event, gpointer user_data)
+/// Returns seconds into the fractional JD (from 12:00 UT) at which a sample was taken.
+static double plot_time_s(struct timestruct *unitime)
 {
-  struct plotobjects *objs = (struct plotobjects *)user_data;
-  switch(event->keyval)
+  double frac_jd = convert_HMSMS_H_time(unitime) / 24.0 + 0.5;
+  if (frac_jd >= 1.0)
+    frac_jd -= 1.0;
+  return frac_jd * PLOT_SPAN_S;
+}
+
+static struct lodpyr *plot_lod(struct plotobjects *objs)
+{
+  if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(objs->btn_plot_star)))
+    return &objs->lod_star;
+  return &objs->lod_all;
+}
+
+static void plot_add_point(struct plotobjects *objs, double t_s, unsigned long counts, char star)
+{
+  // Samples more than half a day before the last sample belong to the next fractional JD
+  if ((!lodpyr_empty(&objs->lod_all)) && (t_s < objs->lod_all.t_last_s - PLOT_SPAN_S / 2.0))
   {
-    case GDK_KEY_a:
-      fprintf(objs->gnuplot_fp, "set border linecolor rgb 'green'\n");
-      fprintf(objs->gnuplot_fp, "set style line 1 pt 13 lc 2\n");
-      break;
-    case GDK_KEY_g:
-      break;
-    case GDK_KEY_Left:
-      break;
-    case GDK_KEY_Right:
-      break;
-    case GDK_KEY_Up:
-      break;
-    case GDK_KEY_Down:
-      break;
-    default:
-      act_log_debug(act_log_msg("Invalid key pressed."));
-      break;
+    act_log_normal(act_log_msg("New fractional JD started. Clearing plot."));
+    lodpyr_clear(&objs->lod_all);
+    lodpyr_clear(&objs->lod_star);
+    objs->follow = TRUE;
   }
-  return TRUE;
-}*/
+  lodpyr_add(&objs->lod_all, t_s, counts);
+  if (star)
+    lodpyr_add(&objs->lod_star, t_s, counts);
+}
+
+/** \brief Sets the span shown to the whole run, from the first sample to a span that doubles as samples reach its end.
+ * \return 1 if the span shown changed, otherwise 0.
+ */
+static char plot_follow_view(struct plotobjects *objs)
+{
+  struct lodpyr *lod = plot_lod(objs);
+  if (lodpyr_empty(lod))
+    return 0;
+  double span_s = PLOT_MIN_SPAN_S;
+  while (lod->t_first_s + span_s <= lod->t_last_s)
+    span_s *= 2.0;
+  if ((objs->view_lo_s == lod->t_first_s) && (objs->view_hi_s == lod->t_first_s + span_s))
+    return 0;
+  objs->view_lo_s = lod->t_first_s;
+  objs->view_hi_s = lod->t_first_s + span_s;
+  return 1;
+}
+
+/** \brief Draws the samples added since the last update.
+ *
+ * Only the columns the new samples fall in (and their neighbours, which are joined to them) are redrawn. The whole data
+ * area is only redrawn if the span shown has to grow or the counts no longer fit, which doesn't depend on the length of
+ * the run either.
+ */
+static void plot_update(struct plotobjects *objs)
+{
+  if ((objs->data_surf == NULL) || (!gtk_widget_get_visible(objs->evb_plot_box)))
+    return;
+  double dirty_lo_s, dirty_hi_s;
+  if (!lodpyr_take_dirty(plot_lod(objs), &dirty_lo_s, &dirty_hi_s))
+    return;
+  if ((objs->follow) && (plot_follow_view(objs)))
+  {
+    plot_redraw_all(objs);
+    return;
+  }
+  double col_s = (objs->view_hi_s - objs->view_lo_s) / objs->num_cols;
+  long col_lo = floor((dirty_lo_s - objs->view_lo_s) / col_s) - 1, col_hi = floor((dirty_hi_s - objs->view_lo_s) / col_s) + 2;
+  if ((col_hi < 0) || (col_lo >= (long)objs->num_cols))
+    return;
+  if (col_lo < 0)
+    col_lo = 0;
+  if (col_hi >= (long)objs->num_cols)
+    col_hi = objs->num_cols - 1;
+  lodpyr_columns(plot_lod(objs), objs->view_lo_s + col_lo*col_s, objs->view_lo_s + (col_hi+1)*col_s, col_hi - col_lo + 1, &objs->cols[col_lo]);
+  long i;
+  for (i=col_lo; i<=col_hi; i++)
+  {
+    if ((!lodbin_empty(&objs->cols[i])) && ((objs->cols[i].min < objs->y_lo) || (objs->cols[i].max > objs->y_hi)))
+    {
+      plot_redraw_all(objs);
+      return;
+    }
+  }
+  // The first column recalculated is only needed to join the next one to
+  cairo_t *cr = cairo_create(objs->data_surf);
+  draw_columns(cr, objs->cols, col_lo + 1, col_hi + 1, cairo_image_surface_get_height(objs->data_surf), objs->y_lo, objs->y_hi, &G_screen_colours);
+  cairo_destroy(cr);
+  gtk_widget_queue_draw_area(objs->dra_plot, PLOT_MARGIN_LEFT + col_lo + 1, PLOT_MARGIN_TOP, col_hi - col_lo, cairo_image_surface_get_height(objs->data_surf));
+}
+
+/// Redraws the whole data area and the axes, for a new span, counts scale, size or set of samples.
+static void plot_redraw_all(struct plotobjects *objs)
+{
+  if (objs->data_surf == NULL)
+    return;
+  struct lodpyr *lod = plot_lod(objs);
+  double dirty_lo_s, dirty_hi_s;
+  lodpyr_take_dirty(lod, &dirty_lo_s, &dirty_hi_s);
+  if (objs->follow)
+    plot_follow_view(objs);
+  lodpyr_columns(lod, objs->view_lo_s, objs->view_hi_s, objs->num_cols, objs->cols);
+  autoscale(objs->cols, objs->num_cols, &objs->y_lo, &objs->y_hi);
+  cairo_t *cr = cairo_create(objs->data_surf);
+  draw_columns(cr, objs->cols, 0, objs->num_cols, cairo_image_surface_get_height(objs->data_surf), objs->y_lo, objs->y_hi, &G_screen_colours);
+  cairo_destroy(cr);
+  gtk_widget_queue_draw(objs->dra_plot);
+}
+
+/// Finds a counts range that includes all the columns, with a margin so that a slow rise doesn't rescale every update.
+static void autoscale(struct lodbin *cols, unsigned long num_cols, double *y_lo, double *y_hi)
+{
+  struct lodbin range;
+  lodbin_clear(&range);
+  unsigned long i;
+  for (i=0; i<num_cols; i++)
+  {
+    if (cols[i].min < range.min)
+      range.min = cols[i].min;
+    if (cols[i].max > range.max)
+      range.max = cols[i].max;
+  }
+  if (lodbin_empty(&range))
+  {
+    *y_lo = 0.0;
+    *y_hi = 1.0;
+    return;
+  }
+  double margin = (range.max - range.min) * 0.1;
+  if (margin <= 0.0)
+    margin = 1.0;
+  *y_lo = range.min - margin;
+  *y_hi = range.max + margin;
+}
+
+/** \brief Draws columns col_lo to col_hi-1 of the data area (height pixels high, with its origin at the top left).
+ *
+ * Each column is a bar over the range of its counts, stretched to meet the previous column so the samples read as a
+ * line.
+ */
+static void draw_columns(cairo_t *cr, struct lodbin *cols, unsigned long col_lo, unsigned long col_hi, int height, double y_lo, double y_hi, const struct plotcolours *colours)
+{
+  cairo_set_source_rgb(cr, colours->bg[0], colours->bg[1], colours->bg[2]);
+  cairo_rectangle(cr, col_lo, 0, col_hi - col_lo, height);
+  cairo_fill(cr);
+  cairo_set_source_rgb(cr, colours->data[0], colours->data[1], colours->data[2]);
+  double scale = (height - 1) / (y_hi - y_lo), top, bottom, y_top, y_bottom;
+  unsigned long i;
+  for (i=col_lo; i<col_hi; i++)
+  {
+    if (lodbin_empty(&cols[i]))
+      continue;
+    top = cols[i].max;
+    bottom = cols[i].min;
+    if ((i > 0) && (!lodbin_empty(&cols[i-1])))
+    {
+      if (cols[i-1].min > top)
+        top = cols[i-1].min;
+      if (cols[i-1].max < bottom)
+        bottom = cols[i-1].max;
+    }
+    y_top = floor((y_hi - top) * scale);
+    y_bottom = floor((y_hi - bottom) * scale);
+    cairo_rectangle(cr, i, y_top, 1, y_bottom - y_top + 1);
+  }
+  cairo_fill(cr);
+}
+
+/// Draws the grid, the border and the labelled axes around a data area placed inside the plot margins.
+static void draw_axes(cairo_t *cr, int width, int height, double view_lo_s, double view_hi_s, double y_lo, double y_hi, const struct plotcolours *colours)
+{
+  int plot_width = width - PLOT_MARGIN_LEFT - PLOT_MARGIN_RIGHT, plot_height = height - PLOT_MARGIN_TOP - PLOT_MARGIN_BOTTOM;
+  double jd_lo = view_lo_s / PLOT_SPAN_S, jd_hi = view_hi_s / PLOT_SPAN_S, step, val, pos;
+  int decimals;
+  char label[30];
+  cairo_text_extents_t extents;
+  cairo_set_line_width(cr, 1.0);
+  cairo_set_font_size(cr, 11.0);
+
+  step = tick_step(jd_hi - jd_lo, plot_width / 100);
+  decimals = step < 1.0 ? ceil(-log10(step)) : 0;
+  for (val=ceil(jd_lo/step)*step; val<=jd_hi; val+=step)
+  {
+    pos = floor(PLOT_MARGIN_LEFT + (val - jd_lo) / (jd_hi - jd_lo) * plot_width) + 0.5;
+    cairo_set_source_rgb(cr, colours->grid[0], colours->grid[1], colours->grid[2]);
+    cairo_move_to(cr, pos, PLOT_MARGIN_TOP);
+    cairo_line_to(cr, pos, PLOT_MARGIN_TOP + plot_height);
+    cairo_stroke(cr);
+    snprintf(label, sizeof(label), "%.*f", decimals, val);
+    cairo_text_extents(cr, label, &extents);
+    cairo_set_source_rgb(cr, colours->fg[0], colours->fg[1], colours->fg[2]);
+    cairo_move_to(cr, pos - extents.width / 2.0, PLOT_MARGIN_TOP + plot_height + 15);
+    cairo_show_text(cr, label);
+  }
+
+  step = tick_step(y_hi - y_lo, plot_height / 40);
+  decimals = step < 1.0 ? ceil(-log10(step)) : 0;
+  for (val=ceil(y_lo/step)*step; val<=y_hi; val+=step)
+  {
+    pos = floor(PLOT_MARGIN_TOP + (y_hi - val) / (y_hi - y_lo) * (plot_height - 1)) + 0.5;
+    cairo_set_source_rgb(cr, colours->grid[0], colours->grid[1], colours->grid[2]);
+    cairo_move_to(cr, PLOT_MARGIN_LEFT, pos);
+    cairo_line_to(cr, PLOT_MARGIN_LEFT + plot_width, pos);
+    cairo_stroke(cr);
+    snprintf(label, sizeof(label), "%.*f", decimals, val);
+    cairo_text_extents(cr, label, &extents);
+    cairo_set_source_rgb(cr, colours->fg[0], colours->fg[1], colours->fg[2]);
+    cairo_move_to(cr, PLOT_MARGIN_LEFT - extents.width - 5, pos + extents.height / 2.0);
+    cairo_show_text(cr, label);
+  }
+
+  cairo_set_source_rgb(cr, colours->fg[0], colours->fg[1], colours->fg[2]);
+  cairo_rectangle(cr, PLOT_MARGIN_LEFT - 0.5, PLOT_MARGIN_TOP - 0.5, plot_width + 1, plot_height + 1);
+  cairo_stroke(cr);
+  cairo_set_font_size(cr, 13.0);
+  cairo_text_extents(cr, "Frac. JD", &extents);
+  cairo_move_to(cr, PLOT_MARGIN_LEFT + (plot_width - extents.width) / 2.0, height - 5);
+  cairo_show_text(cr, "Frac. JD");
+  cairo_text_extents(cr, "Counts", &extents);
+  cairo_save(cr);
+  cairo_move_to(cr, 15, PLOT_MARGIN_TOP + (plot_height + extents.width) / 2.0);
+  cairo_rotate(cr, -G_PI / 2.0);
+  cairo_show_text(cr, "Counts");
+  cairo_restore(cr);
+}
+
+/// Returns a tick spacing of 1, 2 or 5 times a power of ten that gives at most max_ticks ticks over span.
+static double tick_step(double span, int max_ticks)
+{
+  if (max_ticks < 1)
+    max_ticks = 1;
+  double raw = span / max_ticks, mag = pow(10.0, floor(log10(raw))), norm = raw / mag;
+  if (norm <= 1.0)
+    return mag;
+  if (norm <= 2.0)
+    return 2.0 * mag;
+  if (norm <= 5.0)
+    return 5.0 * mag;
+  return 10.0 * mag;
+}
@@ -4,22 +4,33 @@
 #include <stdio.h>
 #include <gtk/gtk.h>
 #include "pmtfuncs.h"
+#include "pmtphot_lod.h"
 
 struct plotobjects
 {
   GtkWidget *btn_plot_all, *btn_plot_star;
-  GtkWidget *evb_plot_box;
+  GtkWidget *evb_plot_box, *dra_plot;
   GtkWidget *btn_save_plot_pdf, *btn_plothelp;
-  FILE *gnuplot_fp;
-  FILE *plotdata_fp;
-  char plotdata_filename[100];
+  /// Counts of all samples and of the samples of the current target, against seconds into the fractional JD
+  struct lodpyr lod_all, lod_star;
+  /// Data area of the plot, to which only the columns that have changed are redrawn
+  cairo_surface_t *data_surf;
+  /// One column of the data area per pixel
+  struct lodbin *cols;
+  unsigned long num_cols;
+  /// Span shown: seconds into the fractional JD and counts
+  double view_lo_s, view_hi_s, y_lo, y_hi;
+  /// Whether the span shown grows to include new samples (until the user zooms or pans)
+  char follow;
   int cur_targ_id;
+  /// Cursor in the PMT sample ring
+  unsigned long samp_cursor;
 };
 
 struct plotobjects *create_plotobjs(GtkWidget *container);
 void finalise_plotobjs(struct plotobjects *objs);
 void plot_set_pmtdetail(struct plotobjects *objs, struct pmtdetailstruct *pmtdetail);
 void plot_set_targid(struct plotobjects *objs, int targ_id);
-void plot_add_data(struct plotobjects *objs, struct pmtintegstruct *pmtinteg);
+void plot_add_data(struct plotobjects *objs, struct sampring *samples, struct pmtintegstruct *pmtinteg);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <act_log.h>
+#include "pmtphot_ring.h"
+
+/** \brief Maps the PMT driver's integration data ring.
+ * \param ring Ring structure to initialise.
+ * \param pmtdrv_fd File descriptor of the open PMT character device.
+ * \return 0 on success, otherwise -1.
+ */
+int pmtring_map(struct pmtring *ring, int pmtdrv_fd)
+{
+  if (ring == NULL)
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+  void *map = mmap(NULL, PMT_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, pmtdrv_fd, 0);
+  if (map == MAP_FAILED)
+  {
+    act_log_error(act_log_msg("Failed to map PMT integration data ring - %s.", strerror(errno)));
+    memset(ring, 0, sizeof(struct pmtring));
+    return -1;
+  }
+  pmtring_attach(ring, map);
+  ring->map = map;
+  ring->map_size = PMT_RING_SIZE;
+  return 0;
+}
+
+/** \brief Maps the PMT driver's time tag ring.
+ * \param ring Ring structure to initialise.
+ * \param pmtdrv_fd File descriptor of the open PMT character device.
+ * \return 0 on success, otherwise -1.
+ */
+int pmtring_map_ttag(struct pmtring *ring, int pmtdrv_fd)
+{
+  if (ring == NULL)
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+  void *map = mmap(NULL, PMT_TTAG_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, pmtdrv_fd, PMT_TTAG_RING_OFFSET);
+  if (map == MAP_FAILED)
+  {
+    act_log_error(act_log_msg("Failed to map PMT time tag ring - %s.", strerror(errno)));
+    memset(ring, 0, sizeof(struct pmtring));
+    return -1;
+  }
+  pmtring_attach_ttag(ring, map);
+  ring->map = map;
+  ring->map_size = PMT_TTAG_RING_SIZE;
+  return 0;
+}
+
+void pmtring_unmap(struct pmtring *ring)
+{
+  if ((ring == NULL) || (ring->map == NULL))
+    return;
+  munmap(ring->map, ring->map_size);
+  memset(ring, 0, sizeof(struct pmtring));
+}
+
+/** \brief Reads the integration data ring in a memory block laid out like the driver's mapping.
+ *
+ * The block is not unmapped by pmtring_unmap.
+ */
+void pmtring_attach(struct pmtring *ring, void *mem)
+{
+  ring->map = NULL;
+  ring->map_size = 0;
+  ring->len = PMT_RING_LEN;
+  ring->hdr = (struct pmt_ring_hdr *)mem;
+  ring->data = (struct pmt_integ_data *)((char *)mem + PMT_RING_HDR_SIZE);
+  ring->ttags = NULL;
+  ring->num_lost_seen = ring->hdr->num_lost;
+}
+
+/// Reads the time tag ring in a memory block laid out like the driver's mapping (see pmtring_attach).
+void pmtring_attach_ttag(struct pmtring *ring, void *mem)
+{
+  ring->map = NULL;
+  ring->map_size = 0;
+  ring->len = PMT_TTAG_RING_LEN;
+  ring->hdr = (struct pmt_ring_hdr *)mem;
+  ring->data = NULL;
+  ring->ttags = (struct pmt_ttag_data *)((char *)mem + PMT_RING_HDR_SIZE);
+  ring->num_lost_seen = ring->hdr->num_lost;
+}
+
+unsigned long pmtring_num_unread(struct pmtring *ring)
+{
+  return (__u32)(__atomic_load_n(&ring->hdr->prod_idx, __ATOMIC_ACQUIRE) - ring->hdr->cons_idx);
+}
+
+/// Number of unread records that are contiguous in the ring, from slot *slot onward.
+static unsigned long peek_slots(struct pmtring *ring, unsigned long *slot)
+{
+  // Acquire the producer index, so that the records it covers are complete - the indices are 32 bits and wrap
+  __u32 cons_idx = ring->hdr->cons_idx;
+  unsigned long num = (__u32)(__atomic_load_n(&ring->hdr->prod_idx, __ATOMIC_ACQUIRE) - cons_idx);
+  *slot = cons_idx % ring->len;
+  if (num > ring->len - *slot)
+    num = ring->len - *slot;
+  return num;
+}
+
+/** \brief Finds the unread records that are contiguous in the ring.
+ * \param ring Integration data ring.
+ * \param records Set to the oldest unread record.
+ * \return Number of records from *records onward that may be read.
+ *
+ * When the unread records wrap around the end of the ring, only those up to the end are returned; the rest are
+ * returned by the next call after pmtring_release.
+ */
+unsigned long pmtring_peek(struct pmtring *ring, struct pmt_integ_data **records)
+{
+  unsigned long slot, num = peek_slots(ring, &slot);
+  *records = &ring->data[slot];
+  return num;
+}
+
+/// Finds the unread time tags that are contiguous in the time tag ring (see pmtring_peek).
+unsigned long pmtring_peek_ttag(struct pmtring *ring, struct pmt_ttag_data **ttags)
+{
+  unsigned long slot, num = peek_slots(ring, &slot);
+  *ttags = &ring->ttags[slot];
+  return num;
+}
+
+/** \brief Hands the slots of the oldest num unread records back to the producer.
+ *
+ * The records must not be accessed afterwards.
+ */
+void pmtring_release(struct pmtring *ring, unsigned long num)
+{
+  __atomic_store_n(&ring->hdr->cons_idx, ring->hdr->cons_idx + num, __ATOMIC_RELEASE);
+}
+
+/// Discards all unread records.
+void pmtring_discard(struct pmtring *ring)
+{
+  __atomic_store_n(&ring->hdr->cons_idx, __atomic_load_n(&ring->hdr->prod_idx, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+/** \brief Number of records the producer discarded because the ring was full, since the last call.
+ *
+ * The driver resets its count when an integration starts.
+ */
+unsigned long pmtring_num_lost(struct pmtring *ring)
+{
+  unsigned long num_lost = __atomic_load_n(&ring->hdr->num_lost, __ATOMIC_RELAXED);
+  if (num_lost < ring->num_lost_seen)
+    ring->num_lost_seen = 0;
+  unsigned long num_new = num_lost - ring->num_lost_seen;
+  ring->num_lost_seen = num_lost;
+  return num_new;
+}
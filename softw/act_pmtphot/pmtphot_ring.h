@@ -0,0 +1,48 @@
+#ifndef PMTPHOT_RING
+#define PMTPHOT_RING
+
+#include <pmt_driver.h>
+
+/// Number of unread records at which the PMT driver wakes up act_pmtphot (about 4 s at 1 ms sampling)
+#define PMTRING_WAKE_NUM   (PMT_RING_LEN/2)
+/// Number of unread time tags at which the PMT driver wakes up act_pmtphot (about 1 s at 1 million photons per second)
+#define PMTRING_TTAG_WAKE_NUM   (PMT_TTAG_RING_LEN/2)
+
+/** \brief Reader's view of the PMT driver's integration data ring.
+ *
+ * The ring is normally the driver's, mapped with pmtring_map, but any memory block of PMT_RING_SIZE bytes laid out the
+ * same way can be attached with pmtring_attach (the unit tests use this to stand in for the driver). Records are read
+ * in place: pmtring_peek returns the unread records that are contiguous in memory and pmtring_release hands their
+ * slots back to the producer.
+ *
+ * The time tag ring is read in the same way, after mapping it with pmtring_map_ttag (or attaching it with
+ * pmtring_attach_ttag), with pmtring_peek_ttag instead of pmtring_peek.
+ */
+struct pmtring
+{
+  void *map;
+  size_t map_size;
+  /// Number of slots in the ring
+  unsigned long len;
+  struct pmt_ring_hdr *hdr;
+  /// Slots of the integration data ring (NULL for the time tag ring)
+  struct pmt_integ_data *data;
+  /// Slots of the time tag ring (NULL for the integration data ring)
+  struct pmt_ttag_data *ttags;
+  /// Value of num_lost in the header when pmtring_num_lost was last called
+  unsigned long num_lost_seen;
+};
+
+int pmtring_map(struct pmtring *ring, int pmtdrv_fd);
+int pmtring_map_ttag(struct pmtring *ring, int pmtdrv_fd);
+void pmtring_unmap(struct pmtring *ring);
+void pmtring_attach(struct pmtring *ring, void *mem);
+void pmtring_attach_ttag(struct pmtring *ring, void *mem);
+unsigned long pmtring_num_unread(struct pmtring *ring);
+unsigned long pmtring_peek(struct pmtring *ring, struct pmt_integ_data **records);
+unsigned long pmtring_peek_ttag(struct pmtring *ring, struct pmt_ttag_data **ttags);
+void pmtring_release(struct pmtring *ring, unsigned long num);
+void pmtring_discard(struct pmtring *ring);
+unsigned long pmtring_num_lost(struct pmtring *ring);
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+#include <act_log.h>
+#include "pmtphot_samples.h"
+
+/** \brief Allocates the columns of an empty sample ring.
+ * \param ring Sample ring to initialise.
+ * \param len Number of samples the ring holds.
+ * \return 0 on success, otherwise -1.
+ */
+int sampring_init(struct sampring *ring, unsigned long len)
+{
+  if ((ring == NULL) || (len == 0))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+  memset(ring, 0, sizeof(struct sampring));
+  ring->start_unidate = malloc(len * sizeof(struct datestruct));
+  ring->start_unitime = malloc(len * sizeof(struct timestruct));
+  ring->integt_s = malloc(len * sizeof(double));
+  ring->counts = malloc(len * sizeof(unsigned long));
+  ring->error = malloc(len * sizeof(unsigned char));
+  if ((ring->start_unidate == NULL) || (ring->start_unitime == NULL) || (ring->integt_s == NULL) || (ring->counts == NULL) || (ring->error == NULL))
+  {
+    act_log_error(act_log_msg("Could not allocate space for PMT sample ring."));
+    sampring_free(ring);
+    return -1;
+  }
+  ring->len = len;
+  return 0;
+}
+
+void sampring_free(struct sampring *ring)
+{
+  if (ring == NULL)
+    return;
+  free(ring->start_unidate);
+  free(ring->start_unitime);
+  free(ring->integt_s);
+  free(ring->counts);
+  free(ring->error);
+  memset(ring, 0, sizeof(struct sampring));
+}
+
+/// Returns the number of samples that can be appended before slots have to be released.
+unsigned long sampring_space(struct sampring *ring)
+{
+  return ring->len - (ring->head - ring->tail);
+}
+
+/** \brief Appends a completed sample.
+ * \return 0 on success, -1 if the ring is full (the sample is not appended).
+ */
+int sampring_append(struct sampring *ring, struct datestruct *start_unidate, struct timestruct *start_unitime, double integt_s, unsigned long counts, unsigned char error)
+{
+  if (ring->head - ring->tail >= ring->len)
+    return -1;
+  unsigned long slot = ring->head % ring->len;
+  memcpy(&ring->start_unidate[slot], start_unidate, sizeof(struct datestruct));
+  memcpy(&ring->start_unitime[slot], start_unitime, sizeof(struct timestruct));
+  ring->integt_s[slot] = integt_s;
+  ring->counts[slot] = counts;
+  ring->error[slot] = error;
+  ring->head++;
+  return 0;
+}
+
+/** \brief Finds the samples a consumer hasn't read yet.
+ * \param ring Sample ring.
+ * \param cursor Consumer's cursor - moved to the oldest sample kept if it has fallen behind.
+ * \param slot Set to the slot of the first unread sample.
+ * \return Number of unread samples in consecutive slots from *slot (0 if the consumer is up to date). The caller moves
+ *         its cursor on by however many of these it reads.
+ */
+unsigned long sampring_peek(struct sampring *ring, unsigned long *cursor, unsigned long *slot)
+{
+  if (ring->head - *cursor > ring->head - ring->tail)
+    *cursor = ring->tail;
+  unsigned long num = ring->head - *cursor;
+  *slot = *cursor % ring->len;
+  if (num > ring->len - *slot)
+    num = ring->len - *slot;
+  return num;
+}
+
+/// Hands back the slots of all samples before cursor, once every consumer has read them.
+void sampring_release(struct sampring *ring, unsigned long cursor)
+{
+  if (cursor - ring->tail <= ring->head - ring->tail)
+    ring->tail = cursor;
+}
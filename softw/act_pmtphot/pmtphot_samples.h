@@ -0,0 +1,42 @@
+#ifndef PMTPHOT_SAMPLES
+#define PMTPHOT_SAMPLES
+
+#include <act_timecoord.h>
+
+/// Number of samples the sample ring holds (over 2 minutes at 1 ms sampling)
+#define SAMPRING_LEN   131072
+
+/** \brief Completed PMT samples, stored column by column in a ring that is allocated once.
+ *
+ * pmt_integ_get_data appends every sample it reads from the driver to the columns, so there is no allocation per
+ * sample. Each consumer (storage, view, plot) keeps its own cursor: the number of the next sample it will read, where
+ * sample n is in slot n % len of every column. sampring_peek returns the slot and number of the consumer's unread
+ * samples that are contiguous in the columns; the consumer then moves its cursor past them. Once every consumer has read
+ * the samples, the owner hands their slots back with sampring_release. A cursor that has fallen behind the oldest sample
+ * kept skips ahead to it.
+ *
+ * Parameters that are the same for all samples of an integration (target, filter, aperture, etc.) are not repeated per
+ * sample, they are in the integration's struct pmtintegstruct.
+ */
+struct sampring
+{
+  /// Number of slots in the ring
+  unsigned long len;
+  /// Number of the oldest sample kept and of the next sample to be appended
+  unsigned long tail, head;
+  /// Columns: universal date and time the sample started, integration time, counts, error code (see PMT Error bits)
+  struct datestruct *start_unidate;
+  struct timestruct *start_unitime;
+  double *integt_s;
+  unsigned long *counts;
+  unsigned char *error;
+};
+
+int sampring_init(struct sampring *ring, unsigned long len);
+void sampring_free(struct sampring *ring);
+unsigned long sampring_space(struct sampring *ring);
+int sampring_append(struct sampring *ring, struct datestruct *start_unidate, struct timestruct *start_unitime, double integt_s, unsigned long counts, unsigned char error);
+unsigned long sampring_peek(struct sampring *ring, unsigned long *cursor, unsigned long *slot);
+void sampring_release(struct sampring *ring, unsigned long cursor);
+
+#endif
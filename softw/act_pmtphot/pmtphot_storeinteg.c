@@ -11,13 +11,11 @@
 #include "pmtphot_storeinteg.h"
 #include "pmtfuncs.h"
 
-#define PMTPHOT_LINE_LENGTH  180
-
 char *get_bak_store_dir(MYSQL *conn);
 
-struct storeinteg_objects *create_storeinteg(GtkWidget *container, MYSQL *conn)
+struct storeinteg_objects *create_storeinteg(GtkWidget *container, MYSQL *conn, const char *sqlhost)
 {
-  if ((container == NULL) || (conn == NULL))
+  if ((container == NULL) || (conn == NULL) || (sqlhost == NULL))
   {
     act_log_error(act_log_msg("Invalid input parameter."));
     return NULL;
@@ -85,6 +83,16 @@ struct storeinteg_objects *create_storeinteg(GtkWidget *container, MYSQL *conn)
     return NULL;
   }
   act_log_debug(act_log_msg("Backup photometry storage file: %s", tmp_phot_filename));
+  free(phot_bak_dir);
+  objs->status = STOREQUEUE_STAT_NONE;
+  objs->samp_cursor = 0;
+  objs->queue = storequeue_new(sqlhost, "act_pmtphot", "act", objs->bak_phot_fd);
+  if (objs->queue == NULL)
+  {
+    act_log_error(act_log_msg("Could not start photometry storage queue."));
+    fclose(objs->bak_phot_fd);
+    return NULL;
+  }
   return objs;
 }
 
@@ -96,91 +104,56 @@ void finalise_storeinteg(struct storeinteg_objects *objs)
     return;
   }
   objs->mysql_conn = NULL;
+  // Stores the samples that are still queued, so the backup file must still be open
+  storequeue_free(objs->queue);
+  objs->queue = NULL;
   fclose(objs->bak_phot_fd);
   objs->bak_phot_fd = NULL;
   g_object_unref(objs->evb_store_stat);
   g_object_unref(objs->lbl_store_stat);
 }
 
-void storeinteg(struct storeinteg_objects *objs, struct pmtintegstruct *pmtinteg, int num_buffered)
+/** \brief Queues the samples in the sample ring that haven't been stored yet for storage by the photometry store queue's thread and updates the storage status
+ * indicator.
+ *
+ * Returns without waiting for the database, so it is safe to call from the GUI thread at any sampling rate.
+ */
+void storeinteg(struct storeinteg_objects *objs, struct sampring *samples, struct pmtintegstruct *pmtinteg, int num_buffered)
 {
-  if ((objs == NULL) || (pmtinteg == NULL))
+  if ((objs == NULL) || (samples == NULL) || (pmtinteg == NULL))
   {
     act_log_error(act_log_msg("Invalid input parameters. This should not have happened. Data will be lost."));
     return;
   }
   
-  struct pmtintegstruct *lastinteg = pmtinteg;
-  char done = lastinteg->done;
-  char *qrystr = malloc(180 + num_buffered*PMTPHOT_LINE_LENGTH);
-  int num_written = 0;
-  unsigned long qrylen;
-  qrylen = sprintf(qrystr, "INSERT INTO pmt_phot_raw (modnum, start_date, start_time_h, integt_s, pmt_filt_id, pmt_aper_id, counts, warn, err) VALUES ");
-  while (done > 0)
-  {
-    if (qrylen + PMTPHOT_LINE_LENGTH < sizeof(qrystr))
-    {
-      act_log_debug(act_log_msg("Extending query string."));
-      char *tmpstr = malloc(2*sizeof(qrystr));
-      if (tmpstr != NULL)
-      {
-        sprintf(tmpstr, "%s", qrystr);
-        free(qrystr);
-        qrystr = tmpstr;
-      }
-      else
-      {
-        act_log_error(act_log_msg("Failed to allocate space for extended query string. Data will be lost."));
-        break;
-      }
-    }
-    qrylen += sprintf(&qrystr[qrylen], "(%11d, \"%04hd-%02hhd-%02hhd\", %15.10lf, %15.10lf, %11d, %11d, %11lu, %3hhu, %3hhu), ", 1, lastinteg->start_unidate.year, lastinteg->start_unidate.month+1, lastinteg->start_unidate.day+1, convert_HMSMS_H_time(&lastinteg->start_unitime), lastinteg->integt_s, lastinteg->filter.db_id, lastinteg->aperture.db_id, lastinteg->counts, pmt_noncrit_err(lastinteg->error), pmt_crit_err(lastinteg->error));
-    num_written++;
-    if (lastinteg->next != NULL)
-    {
-      lastinteg = lastinteg->next;
-      done = lastinteg->done;
-    }
-    else
-      done = 0;
-  }
-  if (num_written != num_buffered)
-    act_log_error(act_log_msg("Error: Incorrect number of data written to query string (%d data, %d written).", num_buffered, num_written));
-  qrylen -= 2;
-  qrystr[qrylen] = '\0';
-  if (mysql_query(objs->mysql_conn, qrystr) == 0)
-  {
-    GdkColor stat_col;
-    gdk_color_parse("#00AA00", &stat_col);
-    gtk_widget_modify_bg(objs->evb_store_stat, GTK_STATE_NORMAL, &stat_col);
-    gtk_label_set_text(GTK_LABEL(objs->lbl_store_stat),"STORE OK");
-    return;
-  }
-  
-  act_log_error(act_log_msg("Failed to save photometry to SQL database - %s", mysql_error(objs->mysql_conn)));
+  int num_queued = storequeue_append(objs->queue, samples, &objs->samp_cursor, pmtinteg);
+  if (num_queued != num_buffered)
+    act_log_error(act_log_msg("Error: Incorrect number of data queued for storage (%d data, %d queued).", num_buffered, num_queued));
   
-  if (objs->bak_phot_fd != NULL)
+  // The status reflects the most recent batch the storage thread finished
+  int status = storequeue_get_status(objs->queue);
+  if (status == objs->status)
+    return;
+  objs->status = status;
+  GdkColor stat_col;
+  switch (status)
   {
-    act_log_error(act_log_msg("Attempting to save to backup file."));
-    if (fprintf(objs->bak_phot_fd,"%s\n",qrystr) > 0)
-    {
-      fflush(objs->bak_phot_fd);
-      GdkColor stat_col;
+    case STOREQUEUE_STAT_OK:
+      gdk_color_parse("#00AA00", &stat_col);
+      gtk_label_set_text(GTK_LABEL(objs->lbl_store_stat),"STORE OK");
+      break;
+    case STOREQUEUE_STAT_BACKUP:
       gdk_color_parse("#AAAA00", &stat_col);
-      gtk_widget_modify_bg(objs->evb_store_stat, GTK_STATE_NORMAL, &stat_col);
       gtk_label_set_text(GTK_LABEL(objs->lbl_store_stat),"STORE BACKUP");
+      break;
+    case STOREQUEUE_STAT_LOG:
+      gdk_color_parse("#AA0000", &stat_col);
+      gtk_label_set_text(GTK_LABEL(objs->lbl_store_stat),"STORE LOG");
+      break;
+    default:
       return;
-    }
-    act_log_error(act_log_msg("Failed to save photometry to backup file."));
   }
-  
-  act_log_error(act_log_msg("Saving PMT photometry to log - starting here."));
-  act_log_error(act_log_msg(qrystr));
-  act_log_error(act_log_msg("PMT photometry entries end here."));
-  GdkColor stat_col;
-  gdk_color_parse("#AA0000", &stat_col);
   gtk_widget_modify_bg(objs->evb_store_stat, GTK_STATE_NORMAL, &stat_col);
-  gtk_label_set_text(GTK_LABEL(objs->lbl_store_stat),"STORE LOG");
 }
 
 char *get_bak_store_dir(MYSQL *conn)
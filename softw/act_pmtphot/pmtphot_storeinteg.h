@@ -4,16 +4,21 @@
 #include <gtk/gtk.h>
 #include <mysql/mysql.h>
 #include "pmtfuncs.h"
+#include "pmtphot_storequeue.h"
 
 struct storeinteg_objects
 {
   MYSQL *mysql_conn;
   FILE *bak_phot_fd;
+  struct storequeue *queue;
+  /// Cursor in the PMT sample ring
+  unsigned long samp_cursor;
+  int status;
   GtkWidget *evb_store_stat, *lbl_store_stat;
 };
 
-struct storeinteg_objects *create_storeinteg(GtkWidget *container, MYSQL *conn);
+struct storeinteg_objects *create_storeinteg(GtkWidget *container, MYSQL *conn, const char *sqlhost);
 void finalise_storeinteg(struct storeinteg_objects *objs);
-void storeinteg(struct storeinteg_objects *objs, struct pmtintegstruct *pmtinteg, int num_buffered);
+void storeinteg(struct storeinteg_objects *objs, struct sampring *samples, struct pmtintegstruct *pmtinteg, int num_buffered);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <mysql/mysql.h>
+#include <act_log.h>
+#include <act_timecoord.h>
+#include "pmtphot_storequeue.h"
+
+/// Parameters bound per sample (modnum is a constant in the statement)
+#define STOREQUEUE_NUM_PARAMS  8
+#define STOREQUEUE_INSERT_HEAD "INSERT INTO pmt_phot_raw (modnum, start_date, start_time_h, integt_s, pmt_filt_id, pmt_aper_id, counts, warn, err) VALUES "
+#define STOREQUEUE_INSERT_ROW  "(1,?,?,?,?,?,?,?,?)"
+
+static void *writer_thread(void *storequeue);
+
+static double monotonic_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1.0e9;
+}
+
+/// Converts the sample in the given slot of the sample ring, which belongs to the integration pmtinteg.
+static void sample_from_ring(struct sampring *samples, unsigned long slot, struct pmtintegstruct *pmtinteg, struct storequeue_sample *sample)
+{
+  memset(&sample->start_date, 0, sizeof(MYSQL_TIME));
+  sample->start_date.year = samples->start_unidate[slot].year;
+  sample->start_date.month = samples->start_unidate[slot].month+1;
+  sample->start_date.day = samples->start_unidate[slot].day+1;
+  sample->start_date.time_type = MYSQL_TIMESTAMP_DATE;
+  sample->start_time_h = convert_HMSMS_H_time(&samples->start_unitime[slot]);
+  sample->integt_s = samples->integt_s[slot];
+  sample->filt_id = pmtinteg->filter.db_id;
+  sample->aper_id = pmtinteg->aperture.db_id;
+  sample->counts = samples->counts[slot];
+  sample->warn = pmt_noncrit_err(samples->error[slot]);
+  sample->err = pmt_crit_err(samples->error[slot]);
+}
+
+static int sample_to_str(struct storequeue_sample const *sample, char *str, size_t len)
+{
+  return snprintf(str, len, "(%11d, \"%04u-%02u-%02u\", %15.10lf, %15.10lf, %11d, %11d, %11llu, %3hhd, %3hhd)", 1, sample->start_date.year, sample->start_date.month, sample->start_date.day, sample->start_time_h, sample->integt_s, sample->filt_id, sample->aper_id, sample->counts, sample->warn, sample->err);
+}
+
+/** \brief Writes samples to the backup file as a single INSERT statement.
+ * \return 0 on success, otherwise -1.
+ */
+static int backup_samples(struct storequeue *queue, struct storequeue_sample const *samples, int num)
+{
+  if ((queue->bak_fd == NULL) || (num <= 0))
+    return -1;
+  char row[180];
+  int i, ret = 0;
+  pthread_mutex_lock(&queue->bak_mutex);
+  if (fprintf(queue->bak_fd, "%s", STOREQUEUE_INSERT_HEAD) < 0)
+    ret = -1;
+  for (i=0; (i<num) && (ret == 0); i++)
+  {
+    sample_to_str(&samples[i], row, sizeof(row));
+    if (fprintf(queue->bak_fd, i < num-1 ? "%s, " : "%s\n", row) < 0)
+      ret = -1;
+  }
+  if (fflush(queue->bak_fd) != 0)
+    ret = -1;
+  pthread_mutex_unlock(&queue->bak_mutex);
+  return ret;
+}
+
+static void log_samples(struct storequeue_sample const *samples, int num)
+{
+  char row[180];
+  int i;
+  act_log_error(act_log_msg("Saving PMT photometry to log - starting here."));
+  for (i=0; i<num; i++)
+  {
+    sample_to_str(&samples[i], row, sizeof(row));
+    act_log_error(act_log_msg("%s", row));
+  }
+  act_log_error(act_log_msg("PMT photometry entries end here."));
+}
+
+/** \brief Saves samples that could not be stored in the database to the backup file, or failing that to the log.
+ * \return STOREQUEUE_STAT_BACKUP or STOREQUEUE_STAT_LOG.
+ */
+static int save_fallback(struct storequeue *queue, struct storequeue_sample const *samples, int num)
+{
+  if (backup_samples(queue, samples, num) == 0)
+    return STOREQUEUE_STAT_BACKUP;
+  act_log_error(act_log_msg("Failed to save photometry to backup file."));
+  log_samples(samples, num);
+  return STOREQUEUE_STAT_LOG;
+}
+
+static void count_fallback(struct storequeue *queue, int status, int num)
+{
+  pthread_mutex_lock(&queue->mutex);
+  if (status == STOREQUEUE_STAT_BACKUP)
+    queue->stats.num_backup += num;
+  else
+    queue->stats.num_logged += num;
+  queue->status = status;
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+/** \brief Creates the photometry store queue and starts its writer thread.
+ * \param sqlhost Database server.
+ * \param sqluser Database user name.
+ * \param sqldb Database containing pmt_phot_raw.
+ * \param bak_fd Backup file for samples that can't be stored in the database (may be NULL). Must remain open until
+ *               storequeue_free returns.
+ * \return Store queue, or NULL on error.
+ */
+struct storequeue *storequeue_new(const char *sqlhost, const char *sqluser, const char *sqldb, FILE *bak_fd)
+{
+  struct storequeue *queue = calloc(1, sizeof(struct storequeue));
+  if (queue == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for photometry store queue."));
+    return NULL;
+  }
+  queue->sqlhost = strdup(sqlhost);
+  queue->sqluser = strdup(sqluser);
+  queue->sqldb = strdup(sqldb);
+  queue->bak_fd = bak_fd;
+  queue->queue = malloc(STOREQUEUE_LEN*sizeof(struct storequeue_sample));
+  queue->batch = malloc(STOREQUEUE_BATCH*sizeof(struct storequeue_sample));
+  queue->batch_bind = calloc(STOREQUEUE_BATCH*STOREQUEUE_NUM_PARAMS, sizeof(MYSQL_BIND));
+  if ((queue->sqlhost == NULL) || (queue->sqluser == NULL) || (queue->sqldb == NULL) || (queue->queue == NULL) || (queue->batch == NULL) || (queue->batch_bind == NULL))
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for photometry store queue."));
+    free(queue->sqlhost);
+    free(queue->sqluser);
+    free(queue->sqldb);
+    free(queue->queue);
+    free(queue->batch);
+    free(queue->batch_bind);
+    free(queue);
+    return NULL;
+  }
+
+  // The parameters of every insert statement are bound to the rows of batch, so filling batch is all that is needed
+  // before executing a statement
+  int i;
+  for (i=0; i<STOREQUEUE_BATCH; i++)
+  {
+    struct storequeue_sample *sample = &queue->batch[i];
+    MYSQL_BIND *bind = &queue->batch_bind[i*STOREQUEUE_NUM_PARAMS];
+    bind[0].buffer_type = MYSQL_TYPE_DATE;
+    bind[0].buffer = &sample->start_date;
+    bind[1].buffer_type = MYSQL_TYPE_DOUBLE;
+    bind[1].buffer = &sample->start_time_h;
+    bind[2].buffer_type = MYSQL_TYPE_DOUBLE;
+    bind[2].buffer = &sample->integt_s;
+    bind[3].buffer_type = MYSQL_TYPE_LONG;
+    bind[3].buffer = &sample->filt_id;
+    bind[4].buffer_type = MYSQL_TYPE_LONG;
+    bind[4].buffer = &sample->aper_id;
+    bind[5].buffer_type = MYSQL_TYPE_LONGLONG;
+    bind[5].buffer = &sample->counts;
+    bind[5].is_unsigned = 1;
+    bind[6].buffer_type = MYSQL_TYPE_TINY;
+    bind[6].buffer = &sample->warn;
+    bind[7].buffer_type = MYSQL_TYPE_TINY;
+    bind[7].buffer = &sample->err;
+  }
+
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&queue->cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_mutex_init(&queue->bak_mutex, NULL);
+  int ret = pthread_create(&queue->thr, NULL, writer_thread, queue);
+  if (ret != 0)
+  {
+    act_log_error(act_log_msg("Failed to start photometry storage thread - %s.", strerror(ret)));
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_mutex_destroy(&queue->bak_mutex);
+    free(queue->sqlhost);
+    free(queue->sqluser);
+    free(queue->sqldb);
+    free(queue->queue);
+    free(queue->batch);
+    free(queue->batch_bind);
+    free(queue);
+    return NULL;
+  }
+  return queue;
+}
+
+/** \brief Stores all queued samples, stops the writer thread and frees the queue.
+ */
+void storequeue_free(struct storequeue *queue)
+{
+  if (queue == NULL)
+    return;
+  pthread_mutex_lock(&queue->mutex);
+  queue->exiting = 1;
+  pthread_cond_signal(&queue->cond);
+  pthread_mutex_unlock(&queue->mutex);
+  pthread_join(queue->thr, NULL);
+  pthread_cond_destroy(&queue->cond);
+  pthread_mutex_destroy(&queue->mutex);
+  pthread_mutex_destroy(&queue->bak_mutex);
+  free(queue->sqlhost);
+  free(queue->sqluser);
+  free(queue->sqldb);
+  free(queue->queue);
+  free(queue->batch);
+  free(queue->batch_bind);
+  free(queue);
+}
+
+/** \brief Queues the completed samples in the sample ring for storage.
+ * \param queue Store queue.
+ * \param samples Sample ring.
+ * \param cursor Store queue's cursor in the sample ring - moved on past the samples taken.
+ * \param pmtinteg Integration the samples belong to.
+ * \return Number of samples taken.
+ *
+ * Never waits for the database. If the queue is full, the samples that don't fit are written to the backup file
+ * directly.
+ */
+int storequeue_append(struct storequeue *queue, struct sampring *samples, unsigned long *cursor, struct pmtintegstruct *pmtinteg)
+{
+  if ((queue == NULL) || (samples == NULL) || (cursor == NULL) || (pmtinteg == NULL))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+  unsigned long i, slot, num;
+  int num_queued = 0;
+  pthread_mutex_lock(&queue->mutex);
+  while ((queue->queue_depth < STOREQUEUE_LEN) && ((num = sampring_peek(samples, cursor, &slot)) > 0))
+  {
+    if (num > STOREQUEUE_LEN - queue->queue_depth)
+      num = STOREQUEUE_LEN - queue->queue_depth;
+    for (i=0; i<num; i++)
+    {
+      sample_from_ring(samples, slot+i, pmtinteg, &queue->queue[(queue->queue_head + queue->queue_depth) % STOREQUEUE_LEN]);
+      queue->queue_depth++;
+    }
+    num_queued += num;
+    *cursor += num;
+  }
+  queue->stats.num_queued += num_queued;
+  if (queue->queue_depth > queue->stats.max_depth)
+    queue->stats.max_depth = queue->queue_depth;
+  if (queue->queue_depth >= STOREQUEUE_BATCH)
+    pthread_cond_signal(&queue->cond);
+  pthread_mutex_unlock(&queue->mutex);
+  if (sampring_peek(samples, cursor, &slot) == 0)
+    return num_queued;
+
+  act_log_error(act_log_msg("Photometry store queue is full (%d samples). Saving samples to backup file.", STOREQUEUE_LEN));
+  struct storequeue_sample overflow[STOREQUEUE_BATCH];
+  while ((num = sampring_peek(samples, cursor, &slot)) > 0)
+  {
+    if (num > STOREQUEUE_BATCH)
+      num = STOREQUEUE_BATCH;
+    for (i=0; i<num; i++)
+      sample_from_ring(samples, slot+i, pmtinteg, &overflow[i]);
+    count_fallback(queue, save_fallback(queue, overflow, num), num);
+    num_queued += num;
+    *cursor += num;
+  }
+  return num_queued;
+}
+
+/** \brief Returns where the most recent samples went (one of the STOREQUEUE_STAT_* values).
+ */
+int storequeue_get_status(struct storequeue *queue)
+{
+  pthread_mutex_lock(&queue->mutex);
+  int status = queue->status;
+  pthread_mutex_unlock(&queue->mutex);
+  return status;
+}
+
+void storequeue_get_stats(struct storequeue *queue, struct storequeue_stats *stats)
+{
+  pthread_mutex_lock(&queue->mutex);
+  memcpy(stats, &queue->stats, sizeof(struct storequeue_stats));
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+static void writer_disconnect(struct storequeue *queue)
+{
+  if (queue->batch_stmt != NULL)
+  {
+    mysql_stmt_close(queue->batch_stmt);
+    queue->batch_stmt = NULL;
+  }
+  if (queue->conn != NULL)
+  {
+    mysql_close(queue->conn);
+    queue->conn = NULL;
+  }
+}
+
+/** \brief Connects the writer thread to the database, unless it tried too recently.
+ * \return 1 if connected, otherwise 0.
+ */
+static int writer_connect(struct storequeue *queue)
+{
+  if (queue->conn != NULL)
+    return 1;
+  time_t now = time(NULL);
+  if (now - queue->last_connect_t < STOREQUEUE_RETRY_S)
+    return 0;
+  queue->last_connect_t = now;
+  queue->conn = mysql_init(NULL);
+  if (queue->conn == NULL)
+  {
+    act_log_error(act_log_msg("Error initialising MySQL connection handler for photometry storage."));
+    return 0;
+  }
+  if (mysql_real_connect(queue->conn, queue->sqlhost, queue->sqluser, NULL, queue->sqldb, 0, NULL, 0) == NULL)
+  {
+    act_log_error(act_log_msg("Error connecting to MySQL database for photometry storage - %s.", mysql_error(queue->conn)));
+    mysql_close(queue->conn);
+    queue->conn = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+/** \brief Prepares a statement that inserts num samples, with its parameters bound to the first num rows of batch.
+ */
+static MYSQL_STMT *prepare_insert(struct storequeue *queue, int num)
+{
+  size_t row_len = strlen(STOREQUEUE_INSERT_ROW) + 1, head_len = strlen(STOREQUEUE_INSERT_HEAD);
+  char *qrystr = malloc(head_len + num*row_len + 1);
+  if (qrystr == NULL)
+    return NULL;
+  memcpy(qrystr, STOREQUEUE_INSERT_HEAD, head_len);
+  size_t qrylen = head_len;
+  int i;
+  for (i=0; i<num; i++)
+  {
+    memcpy(&qrystr[qrylen], STOREQUEUE_INSERT_ROW ",", row_len);
+    qrylen += row_len;
+  }
+  qrystr[--qrylen] = '\0';
+
+  MYSQL_STMT *stmt = mysql_stmt_init(queue->conn);
+  if (stmt == NULL)
+  {
+    act_log_error(act_log_msg("Failed to create photometry insert statement - %s.", mysql_error(queue->conn)));
+    free(qrystr);
+    return NULL;
+  }
+  if ((mysql_stmt_prepare(stmt, qrystr, qrylen) != 0) || (mysql_stmt_bind_param(stmt, queue->batch_bind)))
+  {
+    act_log_error(act_log_msg("Failed to prepare photometry insert statement - %s.", mysql_stmt_error(stmt)));
+    mysql_stmt_close(stmt);
+    stmt = NULL;
+  }
+  free(qrystr);
+  return stmt;
+}
+
+/** \brief Inserts the first num samples in batch into pmt_phot_raw.
+ * \return 0 on success, otherwise -1 (in which case the connection is closed and retried later).
+ *
+ * Full batches use a statement that is prepared once per connection; partial batches (only when the queue is flushed)
+ * prepare a statement of their own.
+ */
+static int insert_batch(struct storequeue *queue, int num)
+{
+  if (!writer_connect(queue))
+    return -1;
+  MYSQL_STMT *stmt;
+  if (num == STOREQUEUE_BATCH)
+  {
+    if (queue->batch_stmt == NULL)
+      queue->batch_stmt = prepare_insert(queue, num);
+    stmt = queue->batch_stmt;
+  }
+  else
+    stmt = prepare_insert(queue, num);
+  if (stmt == NULL)
+  {
+    writer_disconnect(queue);
+    return -1;
+  }
+  int ret = mysql_stmt_execute(stmt);
+  if (ret != 0)
+    act_log_error(act_log_msg("Failed to save photometry to SQL database - %s", mysql_stmt_error(stmt)));
+  if (stmt != queue->batch_stmt)
+    mysql_stmt_close(stmt);
+  if (ret != 0)
+  {
+    writer_disconnect(queue);
+    return -1;
+  }
+  return 0;
+}
+
+/** \brief Takes up to STOREQUEUE_BATCH samples from the queue into batch.
+ *
+ * Waits until a full batch is available, the oldest waiting sample is STOREQUEUE_FLUSH_MS old or the queue is
+ * exiting. Must be called with mutex held.
+ * \return Number of samples taken, 0 if the queue is exiting and empty.
+ */
+static int take_batch(struct storequeue *queue)
+{
+  struct timespec deadline;
+  char have_deadline = 0;
+  while ((!queue->exiting) && (queue->queue_depth < STOREQUEUE_BATCH))
+  {
+    if (queue->queue_depth == 0)
+    {
+      have_deadline = 0;
+      pthread_cond_wait(&queue->cond, &queue->mutex);
+      continue;
+    }
+    if (!have_deadline)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_sec += STOREQUEUE_FLUSH_MS / 1000;
+      deadline.tv_nsec += (STOREQUEUE_FLUSH_MS % 1000) * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L)
+      {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      have_deadline = 1;
+    }
+    if (pthread_cond_timedwait(&queue->cond, &queue->mutex, &deadline) == ETIMEDOUT)
+      break;
+  }
+  unsigned int num = queue->queue_depth < STOREQUEUE_BATCH ? queue->queue_depth : STOREQUEUE_BATCH;
+  unsigned int first = STOREQUEUE_LEN - queue->queue_head < num ? STOREQUEUE_LEN - queue->queue_head : num;
+  memcpy(queue->batch, &queue->queue[queue->queue_head], first*sizeof(struct storequeue_sample));
+  memcpy(&queue->batch[first], queue->queue, (num-first)*sizeof(struct storequeue_sample));
+  queue->queue_head = (queue->queue_head + num) % STOREQUEUE_LEN;
+  queue->queue_depth -= num;
+  return num;
+}
+
+static void *writer_thread(void *storequeue)
+{
+  struct storequeue *queue = (struct storequeue *)storequeue;
+  mysql_thread_init();
+  pthread_mutex_lock(&queue->mutex);
+  while (1)
+  {
+    int num = take_batch(queue);
+    if (num == 0)
+      break;
+    pthread_mutex_unlock(&queue->mutex);
+
+    double start_s = monotonic_s();
+    int status = STOREQUEUE_STAT_OK;
+    if (insert_batch(queue, num) != 0)
+      status = save_fallback(queue, queue->batch, num);
+    double insert_s = monotonic_s() - start_s;
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->status = status;
+    if (status == STOREQUEUE_STAT_OK)
+    {
+      queue->stats.num_stored += num;
+      if (insert_s > queue->stats.max_insert_s)
+        queue->stats.max_insert_s = insert_s;
+    }
+    else if (status == STOREQUEUE_STAT_BACKUP)
+      queue->stats.num_backup += num;
+    else
+      queue->stats.num_logged += num;
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  writer_disconnect(queue);
+  mysql_thread_end();
+  return NULL;
+}
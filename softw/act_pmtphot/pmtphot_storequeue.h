@@ -0,0 +1,85 @@
+#ifndef PMTPHOT_STOREQUEUE
+#define PMTPHOT_STOREQUEUE
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <mysql/mysql.h>
+#include "pmtfuncs.h"
+
+/// Maximum number of samples waiting to be stored (about a minute at 1 ms sampling)
+#define STOREQUEUE_LEN        65536
+/// Number of samples inserted by one execution of the prepared statement
+#define STOREQUEUE_BATCH      500
+/// A partial batch is stored once its oldest sample has waited this long (ms)
+#define STOREQUEUE_FLUSH_MS   2000
+/// Minimum interval between attempts to reconnect to the database (s)
+#define STOREQUEUE_RETRY_S    10
+
+/// Where the most recent batch of samples went
+enum
+{
+  STOREQUEUE_STAT_NONE = 0,
+  STOREQUEUE_STAT_OK,
+  STOREQUEUE_STAT_BACKUP,
+  STOREQUEUE_STAT_LOG
+};
+
+/// A PMT sample as it is stored in pmt_phot_raw
+struct storequeue_sample
+{
+  MYSQL_TIME start_date;
+  double start_time_h, integt_s;
+  int filt_id, aper_id;
+  unsigned long long counts;
+  signed char warn, err;
+};
+
+struct storequeue_stats
+{
+  unsigned long num_queued, num_stored, num_backup, num_logged;
+  unsigned int max_depth;
+  /// Longest time taken to insert one batch (s)
+  double max_insert_s;
+};
+
+/** \brief Stores PMT samples in pmt_phot_raw from a dedicated thread.
+ *
+ * Samples are converted to struct storequeue_sample and appended to a bounded ring, so that the caller never waits for
+ * the database. The writer thread has its own connection and inserts STOREQUEUE_BATCH samples at a time with a
+ * multi-row prepared statement whose parameters are bound once to the columns of batch. Samples that can't be stored
+ * (or queued) are written to the backup file as SQL text, and failing that to the log.
+ */
+struct storequeue
+{
+  char *sqlhost, *sqluser, *sqldb;
+  FILE *bak_fd;
+  pthread_t thr;
+
+  /// Bounded ring of samples, protected by mutex
+  struct storequeue_sample *queue;
+  unsigned int queue_head, queue_depth;
+  char exiting;
+  /// Counters and status, protected by mutex
+  struct storequeue_stats stats;
+  int status;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  /// Serialises writes to bak_fd
+  pthread_mutex_t bak_mutex;
+
+  /// Used only by the writer thread
+  MYSQL *conn;
+  MYSQL_STMT *batch_stmt;
+  MYSQL_BIND *batch_bind;
+  struct storequeue_sample *batch;
+  time_t last_connect_t;
+};
+
+struct storequeue *storequeue_new(const char *sqlhost, const char *sqluser, const char *sqldb, FILE *bak_fd);
+void storequeue_free(struct storequeue *queue);
+int storequeue_append(struct storequeue *queue, struct sampring *samples, unsigned long *cursor, struct pmtintegstruct *pmtinteg);
+int storequeue_get_status(struct storequeue *queue);
+void storequeue_get_stats(struct storequeue *queue, struct storequeue_stats *stats);
+
+#endif
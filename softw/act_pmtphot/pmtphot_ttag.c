@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <act_log.h>
+#include "pmtphot_ttag.h"
+
+/** \brief Prepares the binner for a time-tag run.
+ * \param bin Binner to initialise.
+ * \param start_s Universal time at which the run started (seconds component).
+ * \param start_ns Universal time at which the run started (nanoseconds component).
+ * \param bin_ns Width of each bin in nanoseconds.
+ * \param num_bins Number of bins.
+ * \param raw_fd File the time tags are written to (may be NULL).
+ * \return 0 on success, otherwise -1.
+ */
+int ttagbin_start(struct ttagbin *bin, unsigned long start_s, unsigned long start_ns, unsigned long long bin_ns, unsigned long num_bins, FILE *raw_fd)
+{
+  if ((bin == NULL) || (bin_ns == 0))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+  memset(bin, 0, sizeof(struct ttagbin));
+  bin->start_ns = start_s * 1000000000ULL + start_ns;
+  bin->bin_ns = bin_ns;
+  bin->num_bins = num_bins;
+  bin->bin_end_ns = bin_ns;
+  if (raw_fd == NULL)
+    return 0;
+  bin->raw_buf = malloc(TTAGBIN_RAW_CHUNK * sizeof(unsigned long long));
+  if (bin->raw_buf == NULL)
+  {
+    act_log_error(act_log_msg("Could not allocate space for raw time tag buffer."));
+    return -1;
+  }
+  bin->raw_fd = raw_fd;
+  return 0;
+}
+
+/// Passes the current bin, covering period_ns, to func and moves on to the next bin, unless func refuses it (-1).
+static int complete_bin(struct ttagbin *bin, unsigned long long period_ns, ttagbin_func func, void *user_data)
+{
+  struct pmt_integ_data data;
+  unsigned long long bin_start_ns = bin->start_ns + bin->bin_end_ns - bin->bin_ns;
+  data.start_time_s = bin_start_ns / 1000000000ULL;
+  data.start_time_ns = bin_start_ns % 1000000000ULL;
+  data.sample_period_ns = period_ns;
+  data.prebin_num = 1;
+  data.repetitions = bin->bin_idx + 1;
+  data.counts = bin->counts;
+  data.error = bin->error;
+  if (func(user_data, &data) < 0)
+    return -1;
+  bin->bin_idx++;
+  bin->bin_end_ns += bin->bin_ns;
+  bin->counts = 0;
+  return 0;
+}
+
+static void write_raw(struct ttagbin *bin, struct pmt_ttag_data *ttags, unsigned long num)
+{
+  unsigned long i, chunk, done = 0;
+  while ((done < num) && (!bin->raw_err))
+  {
+    chunk = num - done;
+    if (chunk > TTAGBIN_RAW_CHUNK)
+      chunk = TTAGBIN_RAW_CHUNK;
+    for (i=0; i<chunk; i++)
+      bin->raw_buf[i] = ttags[done+i].time_s * 1000000000ULL + ttags[done+i].time_ns;
+    if (fwrite(bin->raw_buf, sizeof(unsigned long long), chunk, bin->raw_fd) != chunk)
+    {
+      act_log_error(act_log_msg("Failed to write time tags to raw file - %s. No further time tags will be written.", strerror(errno)));
+      bin->raw_err = 1;
+    }
+    done += chunk;
+  }
+}
+
+/** \brief Adds time tags (in order of arrival) to the bins and the raw file.
+ * \param bin Binner.
+ * \param ttags Time tags.
+ * \param num Number of time tags.
+ * \param func Called for every bin completed.
+ * \param user_data Passed to func.
+ * \return Number of time tags taken - less than num if func refused a bin, in which case the rest must be added again
+ *         once there is room.
+ */
+unsigned long ttagbin_add(struct ttagbin *bin, struct pmt_ttag_data *ttags, unsigned long num, ttagbin_func func, void *user_data)
+{
+  unsigned long i;
+  unsigned long long ttag_ns;
+  for (i=0; i<num; i++)
+  {
+    ttag_ns = ttags[i].time_s * 1000000000ULL + ttags[i].time_ns;
+    if (ttag_ns < bin->start_ns)
+    {
+      bin->num_outside++;
+      continue;
+    }
+    ttag_ns -= bin->start_ns;
+    while ((ttag_ns >= bin->bin_end_ns) && (bin->bin_idx < bin->num_bins))
+    {
+      if (complete_bin(bin, bin->bin_ns, func, user_data) < 0)
+        break;
+    }
+    if ((ttag_ns >= bin->bin_end_ns) && (bin->bin_idx < bin->num_bins))
+      break;
+    if (bin->bin_idx >= bin->num_bins)
+    {
+      bin->num_outside++;
+      continue;
+    }
+    bin->counts++;
+  }
+  bin->num_ttags += i;
+  if (bin->raw_fd != NULL)
+    write_raw(bin, ttags, i);
+  return i;
+}
+
+/** \brief Completes the bins that end within the first elapsed_ms milliseconds of the run.
+ *
+ * Must only be called once all photons that arrived during that time have been added, i.e. with the driver's
+ * run_elapsed_ms read before the time tags.
+ * \return 0 on success, -1 if func refused a bin.
+ */
+int ttagbin_advance(struct ttagbin *bin, unsigned long elapsed_ms, ttagbin_func func, void *user_data)
+{
+  unsigned long long elapsed_ns = elapsed_ms * 1000000ULL;
+  while ((bin->bin_end_ns <= elapsed_ns) && (bin->bin_idx < bin->num_bins))
+  {
+    if (complete_bin(bin, bin->bin_ns, func, user_data) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/** \brief Completes the bins once the run has ended after elapsed_ms milliseconds.
+ *
+ * If the run was cancelled part of the way through a bin, that bin is completed with a shorter sample period. The raw
+ * file is flushed, but not closed.
+ * \return 0 on success, -1 if func refused a bin (the binner is left as it was, to be finished again once there is
+ *         room).
+ */
+int ttagbin_finish(struct ttagbin *bin, unsigned long elapsed_ms, ttagbin_func func, void *user_data)
+{
+  unsigned long long elapsed_ns = elapsed_ms * 1000000ULL;
+  if (ttagbin_advance(bin, elapsed_ms, func, user_data) < 0)
+    return -1;
+  if ((bin->bin_idx < bin->num_bins) && (elapsed_ns > bin->bin_end_ns - bin->bin_ns))
+  {
+    if (complete_bin(bin, elapsed_ns - (bin->bin_end_ns - bin->bin_ns), func, user_data) < 0)
+      return -1;
+  }
+  if (bin->raw_fd != NULL)
+  {
+    if ((fflush(bin->raw_fd) != 0) && (!bin->raw_err))
+      act_log_error(act_log_msg("Failed to write time tags to raw file - %s.", strerror(errno)));
+    bin->raw_fd = NULL;
+  }
+  free(bin->raw_buf);
+  bin->raw_buf = NULL;
+  return 0;
+}
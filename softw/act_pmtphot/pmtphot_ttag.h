@@ -0,0 +1,52 @@
+#ifndef PMTPHOT_TTAG
+#define PMTPHOT_TTAG
+
+#include <stdio.h>
+#include <pmt_driver.h>
+
+/// Number of time tags converted and written to the raw file at a time
+#define TTAGBIN_RAW_CHUNK   65536
+
+/// Called for every bin the binner completes; returns 0 if it took the bin or -1 if there is no room for it yet
+typedef int (*ttagbin_func)(void *user_data, struct pmt_integ_data *bin);
+
+/** \brief Bins photon time tags into samples and writes them to a raw file as they are read.
+ *
+ * The bins are num_bins consecutive intervals of bin_ns nanoseconds from the start of the time-tag run, which need not
+ * be a multiple of the PMT driver's 1 ms sample period. Time tags must be added in order of arrival. A bin is completed
+ * (and passed to the caller's ttagbin_func as a struct pmt_integ_data) as soon as a later time tag arrives or
+ * ttagbin_advance is told that the run has progressed beyond its end, so empty bins are reported as well. If the
+ * ttagbin_func refuses a bin, the binner stops where it is (without taking the time tag that completed the bin) and
+ * hands the same bin over again on the next call, so the caller can leave the remaining time tags where they are until
+ * it has room.
+ *
+ * Every time tag (including any outside the binned interval) is written to raw_fd, if it isn't NULL, as an unsigned
+ * 64-bit integer in native byte order: nanoseconds since the Unix epoch.
+ */
+struct ttagbin
+{
+  /// Start of the first bin and width of the bins, in nanoseconds since the Unix epoch
+  unsigned long long start_ns, bin_ns;
+  unsigned long num_bins;
+  /// Number of bins completed so far and end of the current bin relative to start_ns
+  unsigned long bin_idx;
+  unsigned long long bin_end_ns;
+  /// Photons counted so far in the current bin
+  unsigned long counts;
+  /// Error code given to the bins (see PMT Error bits)
+  unsigned char error;
+  /// Number of time tags added and number that fell outside the binned interval
+  unsigned long num_ttags, num_outside;
+
+  FILE *raw_fd;
+  unsigned long long *raw_buf;
+  /// Set if writing to raw_fd failed (no further writes are attempted)
+  char raw_err;
+};
+
+int ttagbin_start(struct ttagbin *bin, unsigned long start_s, unsigned long start_ns, unsigned long long bin_ns, unsigned long num_bins, FILE *raw_fd);
+unsigned long ttagbin_add(struct ttagbin *bin, struct pmt_ttag_data *ttags, unsigned long num, ttagbin_func func, void *user_data);
+int ttagbin_advance(struct ttagbin *bin, unsigned long elapsed_ms, ttagbin_func func, void *user_data);
+int ttagbin_finish(struct ttagbin *bin, unsigned long elapsed_ms, ttagbin_func func, void *user_data);
+
+#endif
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <gtk/gtk.h>
 #include <mysql/mysql.h>
 #include <act_timecoord.h>
@@ -9,28 +10,9 @@
 
 enum
 {
-  LINETYPE_COMMENT = 0,
-  LINETYPE_IDLE,
-  LINETYPE_PROBE,
-  LINETYPE_TARGNAME,
-  LINETYPE_INTEG
-};
-
-enum
-{
-  PHOTSTORE_LINETYPE = 0,
-  PHOTSTORE_COMMENT,
-  PHOTSTORE_TARGNAME,
-  PHOTSTORE_STARTDATE,
-  PHOTSTORE_STARTTIME,
-  PHOTSTORE_INTEGT_S,
-  PHOTSTORE_FILTNAME,
-  PHOTSTORE_APERNAME,
-  PHOTSTORE_SKY,
-  PHOTSTORE_COUNTS,
-  PHOTSTORE_WARN,
-  PHOTSTORE_ERR,
-  PHOTSTORE_NUMCOLS
+  DECIMSTORE_NUM = 0,
+  DECIMSTORE_NAME,
+  DECIMSTORE_NUMCOLS
 };
 
 void render_line (GtkTreeViewColumn *tree_column, GtkCellRenderer *cell, GtkTreeModel *tree_model, GtkTreeIter *iter, gpointer data);
@@ -41,6 +23,8 @@ void view_set_zero_counts(struct viewobjects *objs, char zero_counts_err);
 void view_set_overflow(struct viewobjects *objs, char overflow_err);
 void view_set_overillum(struct viewobjects *objs, char overillum_err);
 void view_row_inserted(GtkTreeModel *phot_store, GtkTreePath *path, GtkTreeIter *iter, gpointer user_data);
+void view_decim_changed(GtkWidget *cmb_decim, gpointer user_data);
+static void set_idle(struct viewobjects *objs);
 
 struct viewobjects *create_view_objects(GtkWidget *container)
 {
@@ -59,6 +43,9 @@ struct viewobjects *create_view_objects(GtkWidget *container)
   objs->high_counts_warn = objs->time_sync_warn = 0;
   objs->overflow_err = 0;
   objs->zero_counts_err = objs->overillum_err = 0;
+  objs->samp_cursor = 0;
+  objs->decim_sel = 0;
+  objs->decim_auto = 1;
 
   time_t systime_sec = time(NULL);
   struct tm *timedate = gmtime(&systime_sec);
@@ -66,20 +53,47 @@ struct viewobjects *create_view_objects(GtkWidget *container)
   objs->unidate.month = timedate->tm_mon;
   objs->unidate.day = timedate->tm_mday-1;
 
-  objs->phot_store = GTK_TREE_MODEL(gtk_tree_store_new(PHOTSTORE_NUMCOLS, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_FLOAT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, G_TYPE_INT, G_TYPE_INT, G_TYPE_INT));
-  g_object_ref(objs->phot_store);
-  gtk_tree_store_append(GTK_TREE_STORE(objs->phot_store),&objs->targ_iter,NULL);
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &objs->targ_iter, PHOTSTORE_LINETYPE, LINETYPE_COMMENT, PHOTSTORE_COMMENT, "ACT Photometry", -1);
-  gtk_tree_store_append(GTK_TREE_STORE(objs->phot_store),&objs->targ_iter,NULL);
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &objs->targ_iter, PHOTSTORE_LINETYPE, LINETYPE_IDLE, PHOTSTORE_COUNTS, 0, -1);
-  objs->cur_iter = &objs->targ_iter;
+  objs->phot_model = phot_model_new();
+  if (objs->phot_model == NULL)
+  {
+    act_log_error(act_log_msg("Could not create photometry view model."));
+    free(objs);
+    return NULL;
+  }
+  phot_model_append(objs->phot_model, LINETYPE_COMMENT, phot_model_add_label(objs->phot_model, "ACT Photometry"));
+  phot_model_append(objs->phot_model, LINETYPE_IDLE, 0);
+
+  GtkWidget *box_photview = gtk_table_new(2, 2, FALSE);
+  gtk_container_add(GTK_CONTAINER(container),box_photview);
+  gtk_table_attach(GTK_TABLE(box_photview), gtk_label_new("Samples per line"), 0, 1, 0, 1, GTK_FILL, GTK_FILL, 3, 3);
+  GtkListStore *decim_store = gtk_list_store_new(DECIMSTORE_NUMCOLS, G_TYPE_ULONG, G_TYPE_STRING);
+  GtkTreeIter iter;
+  gtk_list_store_append(decim_store, &iter);
+  gtk_list_store_set(decim_store, &iter, DECIMSTORE_NUM, (gulong)0, DECIMSTORE_NAME, "Auto (1 s)", -1);
+  unsigned long decim;
+  char decim_str[20];
+  for (decim=1; decim<=1000; decim*=10)
+  {
+    snprintf(decim_str, sizeof(decim_str), "%lu", decim);
+    gtk_list_store_append(decim_store, &iter);
+    gtk_list_store_set(decim_store, &iter, DECIMSTORE_NUM, decim, DECIMSTORE_NAME, decim_str, -1);
+  }
+  objs->cmb_decim = gtk_combo_box_new_with_model(GTK_TREE_MODEL(decim_store));
+  g_object_unref(decim_store);
+  GtkCellRenderer *cel_decim = gtk_cell_renderer_text_new();
+  gtk_cell_layout_pack_start(GTK_CELL_LAYOUT(objs->cmb_decim), cel_decim, TRUE);
+  gtk_cell_layout_set_attributes(GTK_CELL_LAYOUT(objs->cmb_decim), cel_decim, "text", DECIMSTORE_NAME, NULL);
+  gtk_combo_box_set_active(GTK_COMBO_BOX(objs->cmb_decim),0);
+  g_signal_connect(G_OBJECT(objs->cmb_decim), "changed", G_CALLBACK(view_decim_changed), objs);
+  gtk_table_attach(GTK_TABLE(box_photview), objs->cmb_decim, 1, 2, 0, 1, GTK_FILL|GTK_EXPAND, GTK_FILL, 3, 3);
 
   GtkWidget *scr_photview = gtk_scrolled_window_new(NULL,NULL);
   gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scr_photview), GTK_POLICY_NEVER, GTK_POLICY_ALWAYS);
-  gtk_container_add(GTK_CONTAINER(container),scr_photview);
-  objs->trv_photview = gtk_tree_view_new_with_model(objs->phot_store);
+  gtk_table_attach(GTK_TABLE(box_photview), scr_photview, 0, 2, 1, 2, GTK_FILL|GTK_EXPAND, GTK_FILL|GTK_EXPAND, 3, 3);
+  objs->trv_photview = gtk_tree_view_new_with_model(GTK_TREE_MODEL(objs->phot_model));
   g_object_ref(objs->trv_photview);
   gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(objs->trv_photview), FALSE);
+  // Only the visible rows are read from the model (and formatted), since all rows have the same height
   gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(objs->trv_photview), TRUE);
   gtk_container_add(GTK_CONTAINER(scr_photview),objs->trv_photview);
   GtkTreeViewColumn * col_phot_line =  gtk_tree_view_column_new ();
@@ -89,7 +103,7 @@ struct viewobjects *create_view_objects(GtkWidget *container)
   gtk_tree_view_column_pack_start (col_phot_line, rnd_phot_line, TRUE);
   gtk_tree_view_column_set_cell_data_func (col_phot_line, rnd_phot_line, render_line, objs, NULL);
   
-  g_signal_connect(G_OBJECT(objs->phot_store), "row-inserted", G_CALLBACK(view_row_inserted), objs->trv_photview);
+  g_signal_connect(G_OBJECT(objs->phot_model), "row-inserted", G_CALLBACK(view_row_inserted), objs->trv_photview);
   
   return objs;
 }
@@ -102,9 +116,9 @@ void finalise_view_objects(struct viewobjects *objs)
     return;
   }
   objs->targ_id = -1;
-  g_object_unref(objs->phot_store);
   g_object_unref(objs->trv_photview);
-  objs->cur_iter = NULL;
+  g_object_unref(objs->phot_model);
+  objs->phot_model = NULL;
 }
 
 void view_set_pmtdetail(struct viewobjects *objs, struct pmtdetailstruct *pmtdetail)
@@ -140,39 +154,25 @@ void view_set_targ_id(struct viewobjects *objs, int targ_id, const char *targ_na
   if (targ_id == 0)
   {
     act_log_debug(act_log_msg("targ_id == 0"));
-    gtk_tree_store_append(GTK_TREE_STORE(objs->phot_store),&objs->targ_iter,NULL);
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &objs->targ_iter, PHOTSTORE_LINETYPE, LINETYPE_IDLE, PHOTSTORE_COUNTS, 0, -1);
-    objs->cur_iter = &objs->targ_iter;
+    phot_model_append(objs->phot_model, LINETYPE_IDLE, 0);
     return;
   }
   
   char *datestr = date_to_str(&objs->unidate);
-  if (datestr == NULL)
-  {
-    datestr = malloc(10);
-    sprintf(datestr, "N/A");
-  }
-  gint cur_linetype;
-  gtk_tree_model_get (objs->phot_store, objs->cur_iter, PHOTSTORE_LINETYPE, &cur_linetype, -1);
-  if (cur_linetype != LINETYPE_IDLE)
+  char targ_str[VIEWROWS_LABEL_SIZE];
+  snprintf(targ_str, sizeof(targ_str), "%s (%s)", targ_name != NULL ? targ_name : "Unspecified", datestr != NULL ? datestr : "N/A");
+  free(datestr);
+  unsigned long label = phot_model_add_label(objs->phot_model, targ_str);
+  struct viewrow *last = phot_model_last(objs->phot_model);
+  if ((last != NULL) && (last->linetype == LINETYPE_IDLE))
   {
-    GtkTreePath *targ_path = gtk_tree_model_get_path(GTK_TREE_MODEL(objs->phot_store), &objs->targ_iter);
-    gtk_tree_view_collapse_row (GTK_TREE_VIEW(objs->trv_photview), targ_path);
-    gtk_tree_path_free(targ_path);
-    gtk_tree_store_append (GTK_TREE_STORE(objs->phot_store), &objs->targ_iter, NULL);
+    last->linetype = LINETYPE_TARGNAME;
+    last->label = label;
+    phot_model_last_changed(objs->phot_model);
   }
-  if (targ_name != NULL)
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &objs->targ_iter, PHOTSTORE_LINETYPE, LINETYPE_TARGNAME, PHOTSTORE_TARGNAME, targ_name, PHOTSTORE_STARTDATE, datestr, -1);
   else
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &objs->targ_iter, PHOTSTORE_LINETYPE, LINETYPE_TARGNAME, PHOTSTORE_TARGNAME, "Unspecified", PHOTSTORE_STARTDATE, datestr, -1);
-  free(datestr);
-  
-  GtkTreePath *targ_path = gtk_tree_model_get_path(GTK_TREE_MODEL(objs->phot_store), &objs->targ_iter);
-  gtk_tree_view_expand_row (GTK_TREE_VIEW(objs->trv_photview), targ_path, TRUE);
-  gtk_tree_path_free(targ_path);
-  gtk_tree_store_append(GTK_TREE_STORE(objs->phot_store),&objs->integ_iter,&objs->targ_iter);
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &objs->integ_iter, PHOTSTORE_LINETYPE, LINETYPE_IDLE, PHOTSTORE_COUNTS, 0, -1);
-  objs->cur_iter = &objs->integ_iter;
+    phot_model_append(objs->phot_model, LINETYPE_TARGNAME, label);
+  phot_model_append(objs->phot_model, LINETYPE_IDLE, 0);
 }
 
 void view_set_date(struct viewobjects *objs, struct datestruct *unidate)
@@ -192,7 +192,11 @@ void view_probe_start(struct viewobjects *objs)
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_LINETYPE, LINETYPE_PROBE, -1);
+  struct viewrow *last = phot_model_last(objs->phot_model);
+  if (last == NULL)
+    return;
+  last->linetype = LINETYPE_PROBE;
+  phot_model_last_changed(objs->phot_model);
 }
 
 void view_integ_start(struct viewobjects *objs, struct pmtintegstruct *pmtinteg)
@@ -202,24 +206,31 @@ void view_integ_start(struct viewobjects *objs, struct pmtintegstruct *pmtinteg)
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  GtkTreeIter tmp_iter;
-  if (!gtk_tree_model_iter_parent(GTK_TREE_MODEL(objs->phot_store), &tmp_iter, objs->cur_iter))
+  if (objs->targ_id <= 0)
     view_set_targ_id(objs, 1, "ACT_ANY");
-  gint cur_linetype;
-  gtk_tree_model_get (objs->phot_store, objs->cur_iter, PHOTSTORE_LINETYPE, &cur_linetype, -1);
-  if ((cur_linetype != LINETYPE_IDLE) && (cur_linetype != LINETYPE_PROBE))
-  {
-    gtk_tree_store_append (GTK_TREE_STORE(objs->phot_store), &objs->integ_iter, &objs->targ_iter);
-    objs->cur_iter = &objs->integ_iter;
-  }
-  
-  char *timestr = time_to_str(&pmtinteg->start_unitime);
-  if (timestr == NULL)
-  {
-    timestr = malloc(5);
-    sprintf(timestr, "N/A");
-  }
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_LINETYPE, LINETYPE_INTEG, PHOTSTORE_STARTTIME, timestr, PHOTSTORE_FILTNAME, pmtinteg->filter.name, PHOTSTORE_APERNAME, pmtinteg->aperture.name, PHOTSTORE_COUNTS, 0, -1);
+  char integ_str[VIEWROWS_LABEL_SIZE];
+  snprintf(integ_str, sizeof(integ_str), "%5s %5s  %c", pmtinteg->filter.name, pmtinteg->aperture.name, pmtinteg->sky ? ' ' : '*');
+  unsigned long label = phot_model_add_label(objs->phot_model, integ_str);
+  // An integration line that hasn't received any samples yet is taken over too
+  struct viewrow *last = phot_model_last(objs->phot_model);
+  if ((last == NULL) || ((last->linetype != LINETYPE_IDLE) && (last->linetype != LINETYPE_PROBE) && ((last->linetype != LINETYPE_INTEG) || (last->num_samples > 0))))
+  {
+    phot_model_append(objs->phot_model, LINETYPE_INTEG, label);
+    last = phot_model_last(objs->phot_model);
+  }
+  last->linetype = LINETYPE_INTEG;
+  last->label = label;
+  last->num_samples = 0;
+  last->integt_s = 0.0;
+  last->counts_max = 0;
+  memcpy(&last->start_unitime, &pmtinteg->start_unitime, sizeof(struct timestruct));
+  phot_model_last_changed(objs->phot_model);
+
+  double line_period_s = pmtinteg->sample_period_s * pmtinteg->prebin;
+  if (line_period_s <= 0.0)
+    objs->decim_auto = 1;
+  else
+    objs->decim_auto = ceil(1.0 / line_period_s);
 }
 
 void view_integ_cancelled(struct viewobjects *objs)
@@ -229,7 +240,7 @@ void view_integ_cancelled(struct viewobjects *objs)
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_LINETYPE, LINETYPE_IDLE, PHOTSTORE_COUNTS, 0, -1);
+  set_idle(objs);
 }
 
 void view_integ_complete(struct viewobjects *objs)
@@ -239,7 +250,7 @@ void view_integ_complete(struct viewobjects *objs)
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_LINETYPE, LINETYPE_IDLE, PHOTSTORE_COUNTS, 0,  -1);
+  set_idle(objs);
 }
 
 void view_integ_error(struct viewobjects *objs, const char* msg)
@@ -249,57 +260,29 @@ void view_integ_error(struct viewobjects *objs, const char* msg)
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  GtkTreeIter iter;
-  if (gtk_tree_model_iter_has_child (objs->phot_store,&objs->targ_iter))
-    gtk_tree_store_append (GTK_TREE_STORE(objs->phot_store), &iter, &objs->targ_iter);
-  else
-    gtk_tree_store_append (GTK_TREE_STORE(objs->phot_store), &iter, NULL);
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &iter, PHOTSTORE_LINETYPE, LINETYPE_COMMENT, PHOTSTORE_ERR, 1, PHOTSTORE_COMMENT, msg, -1);
+  phot_model_insert_comment(objs->phot_model, msg, 0, 1);
 }
 
-void view_dispinteg(struct viewobjects *objs, struct pmtintegstruct *pmtinteg)
+void view_dispinteg(struct viewobjects *objs, struct sampring *samples, struct pmtintegstruct *pmtinteg)
 {
-  if ((objs == NULL) || (pmtinteg == NULL))
+  if ((objs == NULL) || (samples == NULL) || (pmtinteg == NULL))
   {
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
   
-  gint cur_linetype;
-  gtk_tree_model_get (objs->phot_store, objs->cur_iter, PHOTSTORE_LINETYPE, &cur_linetype, -1);
-  if (cur_linetype != LINETYPE_INTEG)
+  struct viewrow *last = phot_model_last(objs->phot_model);
+  if ((last == NULL) || (last->linetype != LINETYPE_INTEG))
     view_integ_start(objs, pmtinteg);
-  struct pmtintegstruct *lastinteg = pmtinteg;
-  char done = lastinteg->done, *timestr;
-  while (done > 0)
+  unsigned long decim = objs->decim_sel > 0 ? objs->decim_sel : objs->decim_auto;
+  unsigned long i, slot, num;
+  while ((num = sampring_peek(samples, &objs->samp_cursor, &slot)) > 0)
   {
-    timestr = time_to_str(&pmtinteg->start_unitime);
-    if (timestr == NULL)
-    {
-      timestr = malloc(5);
-      sprintf(timestr, "N/A");
-    }
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_LINETYPE, LINETYPE_INTEG, PHOTSTORE_STARTTIME, timestr, PHOTSTORE_INTEGT_S, lastinteg->integt_s, PHOTSTORE_FILTNAME, lastinteg->filter.name, PHOTSTORE_APERNAME, lastinteg->aperture.name, PHOTSTORE_SKY, lastinteg->sky, PHOTSTORE_COUNTS, lastinteg->counts, PHOTSTORE_ERR, pmt_crit_err(lastinteg->error), PHOTSTORE_WARN, pmt_noncrit_err(lastinteg->error), -1);
-    free(timestr);
-    gtk_tree_store_append (GTK_TREE_STORE(objs->phot_store), &objs->integ_iter, &objs->targ_iter);
-    objs->cur_iter = &objs->integ_iter;
-    if (lastinteg->next != NULL)
-    {
-      lastinteg = (struct pmtintegstruct *)lastinteg->next;
-      done = lastinteg->done;
-    }
-    else
-      done = 0;
+    for (i=slot; i<slot+num; i++)
+      phot_model_add_sample(objs->phot_model, &samples->start_unitime[i], samples->integt_s[i], samples->counts[i], pmt_noncrit_err(samples->error[i]), pmt_crit_err(samples->error[i]), decim);
+    objs->samp_cursor += num;
   }
-
-  timestr = time_to_str(&pmtinteg->start_unitime);
-  if (timestr == NULL)
-  {
-    timestr = malloc(5);
-    sprintf(timestr, "N/A");
-  }
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_LINETYPE, LINETYPE_INTEG, PHOTSTORE_STARTTIME, timestr, PHOTSTORE_FILTNAME, pmtinteg->filter.name, PHOTSTORE_APERNAME, pmtinteg->aperture.name, PHOTSTORE_COUNTS, 0, -1);
-  free(timestr);
+  phot_model_last_changed(objs->phot_model);
 }
 
 void view_update_integ(struct viewobjects *objs, struct pmtintegstruct *pmtinteg)
@@ -309,109 +292,49 @@ void view_update_integ(struct viewobjects *objs, struct pmtintegstruct *pmtinteg
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  
-//   gint linetype = PHOTSTORE_LINETYPE;
-//   gtk_tree_model_get (objs->phot_store, objs->cur_iter, PHOTSTORE_LINETYPE, &cur_linetype, -1);
-/*  if (cur_linetype != LINETYPE_INTEG)
-  {
-    act_log_debug(act_log_msg("No integration is in progress."));
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_INTEGT_S, pmtinteg->integt_s, PHOTSTORE_COUNTS, pmtinteg->counts, PHOTSTORE_ERR, pmt_crit_err(pmtinteg->error), PHOTSTORE_WARN, pmt_noncrit_err(pmtinteg->error), -1);
-  }*/
-  
-//   gint counts;
-//   gtk_tree_model_get (objs->phot_store, objs->cur_iter, PHOTSTORE_COUNTS, &counts, -1);
-//   if (counts == 0)
-//   {
-//     gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_INTEGT_S, integinfo->integt_elapsed_ms/1000.0, PHOTSTORE_COUNTS, integinfo->counts, -1);
-//     return;
-//   }
-
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_LINETYPE, LINETYPE_INTEG, PHOTSTORE_INTEGT_S, pmtinteg->integt_s, PHOTSTORE_COUNTS, pmtinteg->counts, PHOTSTORE_ERR, pmt_crit_err(pmtinteg->error), PHOTSTORE_WARN, pmt_noncrit_err(pmtinteg->error), -1);
+  // Only a line that hasn't received any samples yet shows the sample being integrated
+  struct viewrow *last = phot_model_last(objs->phot_model);
+  if ((last == NULL) || (last->linetype != LINETYPE_INTEG) || (last->num_samples > 0))
+    return;
+  memcpy(&last->start_unitime, &pmtinteg->start_unitime, sizeof(struct timestruct));
+  last->integt_s = pmtinteg->integt_s;
+  last->counts_max = pmtinteg->counts;
+  last->err = pmt_crit_err(pmtinteg->error);
+  last->warn = pmt_noncrit_err(pmtinteg->error);
+  phot_model_last_changed(objs->phot_model);
 }
 
-void render_line (GtkTreeViewColumn *col_phot_line, GtkCellRenderer *rnd_phot_line, GtkTreeModel *phot_store, GtkTreeIter *iter, gpointer user_data)
+void render_line (GtkTreeViewColumn *col_phot_line, GtkCellRenderer *rnd_phot_line, GtkTreeModel *phot_model, GtkTreeIter *iter, gpointer user_data)
 {
   (void) col_phot_line;
   (void) user_data;
-  gint linetype;
-  gtk_tree_model_get(phot_store, iter, PHOTSTORE_LINETYPE, &linetype, -1);
+  gint linetype, warn, err;
+  gchar *line;
+  gtk_tree_model_get(phot_model, iter, PHOT_MODEL_LINETYPE, &linetype, PHOT_MODEL_TEXT, &line, PHOT_MODEL_WARN, &warn, PHOT_MODEL_ERR, &err, -1);
+  const char *colour = "#000000";
+  if (err)
+    colour = "#AA0000";
+  else if (warn)
+    colour = "#AAAA00";
   switch(linetype)
   {
     case LINETYPE_COMMENT:
-    {
-      gint warn, err;
-      gchar *comment;
-      gtk_tree_model_get(phot_store, iter, PHOTSTORE_COMMENT, &comment, PHOTSTORE_WARN, &warn, PHOTSTORE_ERR, &err, -1);
-      if (err)
-        g_object_set(rnd_phot_line, "foreground", "#AA0000", "weight", 600, "style", PANGO_STYLE_NORMAL, "text", comment, NULL);
-      else if (warn)
-        g_object_set(rnd_phot_line, "foreground", "#AAAA00", "weight", 600, "style", PANGO_STYLE_NORMAL, "text", comment, NULL);
-      else
-        g_object_set(rnd_phot_line, "foreground", "#000000", "weight", 600, "style", PANGO_STYLE_NORMAL, "text", comment, NULL);
-      g_free(comment);
+      g_object_set(rnd_phot_line, "foreground", colour, "weight", 600, "style", PANGO_STYLE_NORMAL, "text", line, NULL);
       break;
-    }
     case LINETYPE_IDLE:
-    {
-      gint warn, err, counts;
-      gtk_tree_model_get(phot_store, iter, PHOTSTORE_WARN, &warn, PHOTSTORE_ERR, &err, PHOTSTORE_COUNTS, &counts, -1);
-      char line[60];
-      snprintf(line, 59, "Idle (%d counts/sec)", counts);
-      if (err)
-        g_object_set(rnd_phot_line, "foreground", "#AA0000", "weight", 400, "style", PANGO_STYLE_ITALIC, "text", line, NULL);
-      else if (warn)
-        g_object_set(rnd_phot_line, "foreground", "#AAAA00", "weight", 400, "style", PANGO_STYLE_ITALIC, "text", line, NULL);
-      else
-        g_object_set(rnd_phot_line, "foreground", "#000000", "weight", 400, "style", PANGO_STYLE_ITALIC, "text", line, NULL);
-      break;
-    }
     case LINETYPE_PROBE:
-    {
-      gint warn, err, counts;
-      gtk_tree_model_get(phot_store, iter, PHOTSTORE_WARN, &warn, PHOTSTORE_ERR, &err, PHOTSTORE_COUNTS, &counts, -1);
-      char line[60];
-      snprintf(line, 59, "Probing (%d counts/sec)", counts);
-      if (err)
-        g_object_set(rnd_phot_line, "foreground", "#AA0000", "weight", 400, "style", PANGO_STYLE_ITALIC, "text", line, NULL);
-      else if (warn)
-        g_object_set(rnd_phot_line, "foreground", "#AAAA00", "weight", 400, "style", PANGO_STYLE_ITALIC, "text", line, NULL);
-      else
-        g_object_set(rnd_phot_line, "foreground", "#000000", "weight", 400, "style", PANGO_STYLE_ITALIC, "text", line, NULL);
+      g_object_set(rnd_phot_line, "foreground", colour, "weight", 400, "style", PANGO_STYLE_ITALIC, "text", line, NULL);
       break;
-    }
     case LINETYPE_TARGNAME:
-    {
-      gchar *targname, *datestr;
-      gtk_tree_model_get(phot_store, iter, PHOTSTORE_TARGNAME, &targname, PHOTSTORE_STARTDATE, &datestr, -1);
-      char line[60];
-      snprintf(line, 59, "%s (%s)", targname, datestr);
-      g_free(targname);
-      g_free(datestr);
       g_object_set(rnd_phot_line, "foreground", "#000000", "weight", 500, "style", PANGO_STYLE_NORMAL, "text", line, NULL);
       break;
-    }
     case LINETYPE_INTEG:
-    {
-      gint counts, sky, err, warn;
-      gfloat integt_s;
-      gchar *starttime, *filtname, *apername;
-      gtk_tree_model_get(phot_store, iter, PHOTSTORE_STARTTIME, &starttime, PHOTSTORE_INTEGT_S, &integt_s, PHOTSTORE_FILTNAME, &filtname, PHOTSTORE_APERNAME, &apername, PHOTSTORE_SKY, &sky, PHOTSTORE_COUNTS, &counts, PHOTSTORE_WARN, &warn, PHOTSTORE_ERR, &err, -1);
-      char line[60];
-      snprintf(line, 59, "%s %10.3f  %5s %5s  %c  %15d", starttime, integt_s, filtname, apername, sky ? ' ' : '*', counts);
-      g_free(starttime);
-      g_free(filtname);
-      g_free(apername);
-      if (err)
-        g_object_set(rnd_phot_line, "foreground", "#AA0000", "weight", 400, "style", PANGO_STYLE_NORMAL, "text", line, NULL);
-      else if (warn)
-        g_object_set(rnd_phot_line, "foreground", "#AAAA00", "weight", 400, "style", PANGO_STYLE_NORMAL, "text", line, NULL);
-      else
-        g_object_set(rnd_phot_line, "foreground", "#000000", "weight", 400, "style", PANGO_STYLE_NORMAL, "text", line, NULL);
+      g_object_set(rnd_phot_line, "foreground", colour, "weight", 400, "style", PANGO_STYLE_NORMAL, "text", line, NULL);
       break;
-    }
     default:
       act_log_error(act_log_msg("Invalid line type."));
   }
+  g_free(line);
 }
 
 void view_set_idle_countrate(struct viewobjects *objs, unsigned long countrate)
@@ -421,11 +344,13 @@ void view_set_idle_countrate(struct viewobjects *objs, unsigned long countrate)
     act_log_error(act_log_msg("Invalid input parameters."));
     return;
   }
-  gint linetype;
-  gtk_tree_model_get(objs->phot_store, objs->cur_iter, PHOTSTORE_LINETYPE, &linetype, -1);
-  if ((linetype != LINETYPE_IDLE) && (linetype != LINETYPE_PROBE))
+  struct viewrow *last = phot_model_last(objs->phot_model);
+  if ((last == NULL) || ((last->linetype != LINETYPE_IDLE) && (last->linetype != LINETYPE_PROBE)))
     return;
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_COUNTS, countrate, -1);
+  if (last->counts_max == countrate)
+    return;
+  last->counts_max = countrate;
+  phot_model_last_changed(objs->phot_model);
 }
 
 void view_set_high_counts(struct viewobjects *objs, char high_counts_warn)
@@ -437,13 +362,10 @@ void view_set_high_counts(struct viewobjects *objs, char high_counts_warn)
   }
   if (objs->high_counts_warn == high_counts_warn)
     return;
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_WARN, high_counts_warn > 0, -1);
+  phot_model_last(objs->phot_model)->warn = high_counts_warn > 0;
+  phot_model_last_changed(objs->phot_model);
   if (high_counts_warn > 0)
-  {
-    GtkTreeIter new_iter;
-    gtk_tree_store_insert_before (GTK_TREE_STORE(objs->phot_store), &new_iter, NULL, objs->cur_iter);
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &new_iter, PHOTSTORE_LINETYPE, LINETYPE_COMMENT, PHOTSTORE_COMMENT, "High count rate", PHOTSTORE_WARN, 1, -1);
-  }
+    phot_model_insert_comment(objs->phot_model, "High count rate", 1, 0);
   objs->high_counts_warn = high_counts_warn;
 }
 
@@ -456,13 +378,10 @@ void view_set_time_sync(struct viewobjects *objs, char time_sync_warn)
   }
   if (objs->time_sync_warn == time_sync_warn)
     return;
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_WARN, time_sync_warn > 0, -1);
+  phot_model_last(objs->phot_model)->warn = time_sync_warn > 0;
+  phot_model_last_changed(objs->phot_model);
   if (time_sync_warn > 0)
-  {
-    GtkTreeIter new_iter;
-    gtk_tree_store_insert_before (GTK_TREE_STORE(objs->phot_store), &new_iter, NULL, objs->cur_iter);
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &new_iter, PHOTSTORE_LINETYPE, LINETYPE_COMMENT, PHOTSTORE_COMMENT, "Time sync loss", PHOTSTORE_WARN, 1, -1);
-  }
+    phot_model_insert_comment(objs->phot_model, "Time sync loss", 1, 0);
   objs->time_sync_warn = time_sync_warn;
 }
 
@@ -475,13 +394,10 @@ void view_set_zero_counts(struct viewobjects *objs, char zero_counts_err)
   }
   if (objs->zero_counts_err == zero_counts_err)
     return;
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_ERR, zero_counts_err > 0, -1);
+  phot_model_last(objs->phot_model)->err = zero_counts_err > 0;
+  phot_model_last_changed(objs->phot_model);
   if (zero_counts_err > 0)
-  {
-    GtkTreeIter new_iter;
-    gtk_tree_store_insert_before (GTK_TREE_STORE(objs->phot_store), &new_iter, NULL, objs->cur_iter);
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &new_iter, PHOTSTORE_LINETYPE, LINETYPE_COMMENT, PHOTSTORE_COMMENT, "Zero counts", PHOTSTORE_ERR, 1, -1);
-  }
+    phot_model_insert_comment(objs->phot_model, "Zero counts", 0, 1);
   objs->zero_counts_err = zero_counts_err;
 }
 
@@ -494,13 +410,10 @@ void view_set_overflow(struct viewobjects *objs, char overflow_err)
   }
   if (objs->overflow_err == overflow_err)
     return;
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_ERR, overflow_err > 0, -1);
+  phot_model_last(objs->phot_model)->err = overflow_err > 0;
+  phot_model_last_changed(objs->phot_model);
   if (overflow_err > 0)
-  {
-    GtkTreeIter new_iter;
-    gtk_tree_store_insert_before (GTK_TREE_STORE(objs->phot_store), &new_iter, NULL, objs->cur_iter);
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &new_iter, PHOTSTORE_LINETYPE, LINETYPE_COMMENT, PHOTSTORE_COMMENT, "OVERFLOW", PHOTSTORE_ERR, 1, -1);
-  }
+    phot_model_insert_comment(objs->phot_model, "OVERFLOW", 0, 1);
   objs->overflow_err = overflow_err;
 }
 
@@ -513,13 +426,10 @@ void view_set_overillum(struct viewobjects *objs, char overillum_err)
   }
   if (objs->overillum_err == overillum_err)
     return;
-  gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), objs->cur_iter, PHOTSTORE_ERR, overillum_err > 0, -1);
+  phot_model_last(objs->phot_model)->err = overillum_err > 0;
+  phot_model_last_changed(objs->phot_model);
   if (overillum_err > 0)
-  {
-    GtkTreeIter new_iter;
-    gtk_tree_store_insert_before (GTK_TREE_STORE(objs->phot_store), &new_iter, NULL, objs->cur_iter);
-    gtk_tree_store_set(GTK_TREE_STORE(objs->phot_store), &new_iter, PHOTSTORE_LINETYPE, LINETYPE_COMMENT, PHOTSTORE_COMMENT, "OVERILLUMINATION", PHOTSTORE_ERR, 1, -1);
-  }
+    phot_model_insert_comment(objs->phot_model, "OVERILLUMINATION", 0, 1);
   objs->overillum_err = overillum_err;
 }
 
@@ -538,3 +448,34 @@ void view_row_inserted(GtkTreeModel *phot_store, GtkTreePath *path, GtkTreeIter
     gtk_adjustment_set_value(adjustment, upper);
 }
 
+
+void view_decim_changed(GtkWidget *cmb_decim, gpointer user_data)
+{
+  struct viewobjects *objs = (struct viewobjects *)user_data;
+  GtkTreeModel *decim_store = gtk_combo_box_get_model(GTK_COMBO_BOX(cmb_decim));
+  GtkTreeIter iter;
+  if (!gtk_combo_box_get_active_iter(GTK_COMBO_BOX(cmb_decim), &iter))
+  {
+    objs->decim_sel = 0;
+    return;
+  }
+  gulong decim_sel;
+  gtk_tree_model_get(decim_store, &iter, DECIMSTORE_NUM, &decim_sel, -1);
+  objs->decim_sel = decim_sel;
+}
+
+/// Shows the current line as idle, moving on to a new line if it holds samples of the integration that has ended.
+static void set_idle(struct viewobjects *objs)
+{
+  struct viewrow *last = phot_model_last(objs->phot_model);
+  if ((last != NULL) && (last->linetype == LINETYPE_INTEG) && (last->num_samples > 0))
+  {
+    phot_model_append(objs->phot_model, LINETYPE_IDLE, 0);
+    return;
+  }
+  if (last == NULL)
+    return;
+  last->linetype = LINETYPE_IDLE;
+  last->counts_max = 0;
+  phot_model_last_changed(objs->phot_model);
+}
@@ -5,6 +5,7 @@
 #include <mysql/mysql.h>
 #include <act_timecoord.h>
 #include "pmtfuncs.h"
+#include "pmtphot_model.h"
 
 struct viewobjects
 {
@@ -12,9 +13,15 @@ struct viewobjects
   struct datestruct unidate;
   char high_counts_warn, time_sync_warn, zero_counts_err, overflow_err, overillum_err;
 
-  GtkTreeModel *phot_store;
-  GtkTreeIter targ_iter, integ_iter, *cur_iter;
-  GtkWidget *trv_photview;
+  /// Lines of the view, kept in a bounded ring so the view costs the same at the end of a long run as at the start
+  PhotModel *phot_model;
+  GtkWidget *trv_photview, *cmb_decim;
+  /// Samples summarised per integration line: the selected number, or 0 to show about a second per line
+  unsigned long decim_sel;
+  /// Samples in about a second of the integration underway
+  unsigned long decim_auto;
+  /// Cursor in the PMT sample ring
+  unsigned long samp_cursor;
 };
 
 struct viewobjects *create_view_objects(GtkWidget *container);
@@ -27,7 +34,7 @@ void view_integ_start(struct viewobjects *objs, struct pmtintegstruct *pmtinteg)
 void view_integ_cancelled(struct viewobjects *objs);
 void view_integ_complete(struct viewobjects *objs);
 void view_integ_error(struct viewobjects *objs, const char* msg);
-void view_dispinteg(struct viewobjects *objs, struct pmtintegstruct *pmtinteg);
+void view_dispinteg(struct viewobjects *objs, struct sampring *samples, struct pmtintegstruct *pmtinteg);
 void view_update_integ(struct viewobjects *objs, struct pmtintegstruct *pmtinteg);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <act_log.h>
+#include "pmtphot_viewrows.h"
+
+/** \brief Allocates an empty set of view rows.
+ * \return 0 on success, otherwise -1.
+ */
+int viewrows_init(struct viewrows *rows)
+{
+  if (rows == NULL)
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+  memset(rows, 0, sizeof(struct viewrows));
+  rows->rows = malloc(VIEWROWS_LEN * sizeof(struct viewrow));
+  rows->labels = malloc(VIEWROWS_LABEL_LEN * VIEWROWS_LABEL_SIZE);
+  if ((rows->rows == NULL) || (rows->labels == NULL))
+  {
+    act_log_error(act_log_msg("Could not allocate space for photometry view rows."));
+    viewrows_free(rows);
+    return -1;
+  }
+  return 0;
+}
+
+void viewrows_free(struct viewrows *rows)
+{
+  if (rows == NULL)
+    return;
+  free(rows->rows);
+  free(rows->labels);
+  memset(rows, 0, sizeof(struct viewrows));
+}
+
+unsigned long viewrows_num(struct viewrows *rows)
+{
+  return rows->head - rows->first;
+}
+
+/// Returns row number num, or NULL if it isn't kept.
+struct viewrow *viewrows_get(struct viewrows *rows, unsigned long num)
+{
+  if (num - rows->first >= rows->head - rows->first)
+    return NULL;
+  return &rows->rows[num % VIEWROWS_LEN];
+}
+
+/// Returns the current line, or NULL if there are no rows yet.
+struct viewrow *viewrows_last(struct viewrows *rows)
+{
+  if (rows->head == rows->first)
+    return NULL;
+  return &rows->rows[(rows->head - 1) % VIEWROWS_LEN];
+}
+
+/// Stores text (truncated to VIEWROWS_LABEL_SIZE-1 characters) as a new label and returns its number.
+unsigned long viewrows_add_label(struct viewrows *rows, const char *text)
+{
+  snprintf(rows->labels[rows->label_head % VIEWROWS_LABEL_LEN], VIEWROWS_LABEL_SIZE, "%s", text != NULL ? text : "");
+  return rows->label_head++;
+}
+
+/// Returns the text of a label, or an empty string if it has since been overwritten.
+const char *viewrows_get_label(struct viewrows *rows, unsigned long label)
+{
+  if (rows->label_head - label - 1 >= VIEWROWS_LABEL_LEN)
+    return "";
+  return rows->labels[label % VIEWROWS_LABEL_LEN];
+}
+
+/** \brief Appends an empty row, which becomes the current line.
+ * \return 1 if the first row had to be dropped to make space, otherwise 0.
+ */
+int viewrows_append(struct viewrows *rows, char linetype, unsigned long label)
+{
+  int dropped = 0;
+  if (rows->head - rows->first >= VIEWROWS_LEN)
+  {
+    rows->first++;
+    dropped = 1;
+  }
+  struct viewrow *row = &rows->rows[rows->head % VIEWROWS_LEN];
+  memset(row, 0, sizeof(struct viewrow));
+  row->linetype = linetype;
+  row->label = label;
+  rows->head++;
+  return dropped;
+}
+
+/** \brief Inserts a row (a comment, normally) before the current line.
+ *
+ * The current line moves to a new row at the end and the inserted row takes over its row number.
+ * \return 1 if the first row had to be dropped to make space, otherwise 0.
+ */
+int viewrows_insert_before_last(struct viewrows *rows, char linetype, unsigned long label, char warn, char err)
+{
+  struct viewrow *last = viewrows_last(rows), tmp_row;
+  if (last == NULL)
+  {
+    int dropped = viewrows_append(rows, linetype, label);
+    last = viewrows_last(rows);
+    last->warn = warn;
+    last->err = err;
+    return dropped;
+  }
+  memcpy(&tmp_row, last, sizeof(struct viewrow));
+  memset(last, 0, sizeof(struct viewrow));
+  last->linetype = linetype;
+  last->label = label;
+  last->warn = warn;
+  last->err = err;
+  // The new slot can't be the one just overwritten, because the ring holds more than one row
+  int dropped = viewrows_append(rows, tmp_row.linetype, tmp_row.label);
+  memcpy(viewrows_last(rows), &tmp_row, sizeof(struct viewrow));
+  return dropped;
+}
+
+/** \brief Adds a completed sample to the current line, which must be an integration line.
+ * \param decim Number of samples shown in one line.
+ * \return 1 if the line now holds decim samples (the caller should append the next line), otherwise 0.
+ */
+int viewrows_add_sample(struct viewrows *rows, struct timestruct *start_unitime, double integt_s, unsigned long counts, char warn, char err, unsigned long decim)
+{
+  struct viewrow *row = viewrows_last(rows);
+  if ((row == NULL) || (row->linetype != LINETYPE_INTEG))
+    return 0;
+  if (row->num_samples == 0)
+  {
+    memcpy(&row->start_unitime, start_unitime, sizeof(struct timestruct));
+    row->integt_s = integt_s;
+    row->counts_min = row->counts_max = counts;
+    row->counts_sum = counts;
+    row->warn = warn;
+    row->err = err;
+  }
+  else
+  {
+    row->integt_s += integt_s;
+    if (counts < row->counts_min)
+      row->counts_min = counts;
+    if (counts > row->counts_max)
+      row->counts_max = counts;
+    row->counts_sum += counts;
+    row->warn |= warn;
+    row->err |= err;
+  }
+  row->num_samples++;
+  return row->num_samples >= decim;
+}
+
+/** \brief Produces the text of row number num.
+ * \return Length of the text, or -1 if the row isn't kept.
+ */
+int viewrows_format(struct viewrows *rows, unsigned long num, char *line, size_t len)
+{
+  struct viewrow *row = viewrows_get(rows, num);
+  if (row == NULL)
+    return -1;
+  struct timestruct *start = &row->start_unitime;
+  switch (row->linetype)
+  {
+    case LINETYPE_IDLE:
+      return snprintf(line, len, "Idle (%lu counts/sec)", row->counts_max);
+    case LINETYPE_PROBE:
+      return snprintf(line, len, "Probing (%lu counts/sec)", row->counts_max);
+    case LINETYPE_INTEG:
+      if (row->num_samples <= 1)
+        return snprintf(line, len, "%2hhu:%02hhu:%02hhu.%03hu %10.3f  %s  %15lu", start->hours, start->minutes, start->seconds, start->milliseconds, row->integt_s, viewrows_get_label(rows, row->label), row->counts_max);
+      return snprintf(line, len, "%2hhu:%02hhu:%02hhu.%03hu %10.3f  %s  %15.1f  (%lu - %lu)", start->hours, start->minutes, start->seconds, start->milliseconds, row->integt_s, viewrows_get_label(rows, row->label), row->counts_sum / row->num_samples, row->counts_min, row->counts_max);
+    default:
+      return snprintf(line, len, "%s", viewrows_get_label(rows, row->label));
+  }
+}
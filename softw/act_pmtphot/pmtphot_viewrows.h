@@ -0,0 +1,70 @@
+#ifndef PMTPHOT_VIEWROWS
+#define PMTPHOT_VIEWROWS
+
+#include <stddef.h>
+#include <act_timecoord.h>
+
+/// Number of display rows kept (18 hours of 1 s rows)
+#define VIEWROWS_LEN          65536
+/// Number of labels (target names, comments, filter/aperture of an integration) kept
+#define VIEWROWS_LABEL_LEN    1024
+#define VIEWROWS_LABEL_SIZE   80
+/// Longest line viewrows_format produces
+#define VIEWROWS_LINE_SIZE    120
+
+enum
+{
+  LINETYPE_COMMENT = 0,
+  LINETYPE_IDLE,
+  LINETYPE_PROBE,
+  LINETYPE_TARGNAME,
+  LINETYPE_INTEG
+};
+
+/** \brief A line of the photometry view.
+ *
+ * An integration line summarises num_samples consecutive samples: start of the first, total integration time and the
+ * minimum, maximum and mean counts. While num_samples is 0 the line shows the sample being integrated, with its counts
+ * in counts_max. Idle and probe lines show the count rate in counts_max.
+ */
+struct viewrow
+{
+  /// Label with the text of comment and target lines or the filter, aperture and sky flag of integration lines
+  unsigned long label;
+  struct timestruct start_unitime;
+  char linetype, warn, err;
+  unsigned long num_samples;
+  double integt_s;
+  unsigned long counts_min, counts_max;
+  double counts_sum;
+};
+
+/** \brief The lines of the photometry view, in a ring of VIEWROWS_LEN rows allocated once.
+ *
+ * Rows are numbered from when the view was created; row n is in slot n % VIEWROWS_LEN and the rows from first to
+ * head-1 are kept. The last row is the current line: the one the idle count rate or the sample being integrated is
+ * shown in, which samples are added to and which comments are inserted before. Once the ring is full, appending a row
+ * drops the first. Text is only produced when a row is formatted for display, so the memory used and the cost of adding
+ * a sample don't depend on how long the view has been running.
+ */
+struct viewrows
+{
+  struct viewrow *rows;
+  unsigned long first, head;
+  char (*labels)[VIEWROWS_LABEL_SIZE];
+  unsigned long label_head;
+};
+
+int viewrows_init(struct viewrows *rows);
+void viewrows_free(struct viewrows *rows);
+unsigned long viewrows_num(struct viewrows *rows);
+struct viewrow *viewrows_get(struct viewrows *rows, unsigned long num);
+struct viewrow *viewrows_last(struct viewrows *rows);
+unsigned long viewrows_add_label(struct viewrows *rows, const char *text);
+const char *viewrows_get_label(struct viewrows *rows, unsigned long label);
+int viewrows_append(struct viewrows *rows, char linetype, unsigned long label);
+int viewrows_insert_before_last(struct viewrows *rows, char linetype, unsigned long label, char warn, char err);
+int viewrows_add_sample(struct viewrows *rows, struct timestruct *start_unitime, double integt_s, unsigned long counts, char warn, char err, unsigned long decim);
+int viewrows_format(struct viewrows *rows, unsigned long num, char *line, size_t len);
+
+#endif
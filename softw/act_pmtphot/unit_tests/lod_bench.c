@@ -0,0 +1,258 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra -O2 -I../ -I../../../libs/ ./lod_bench.c ../pmtphot_lod.c ../../../libs/act_positastro.c
+ * ../../../libs/act_timecoord.c ../../../libs/act_log.c -lpthread -lm -o ./lod_bench
+ *
+ * Benchmarks the level-of-detail pyramid behind the light-curve plot (pmtphot_lod) over one night of PMT samples, fed
+ * in batches as act_pmtphot reads them (check_ms worth of samples per check). After every check the columns of a plot
+ * num_cols wide that the new samples fall in are recalculated, as the plot does while it follows the run, and every
+ * hour the whole plot is recalculated (as for a zoom) and compared with what a full replot costs: a pass over every
+ * sample so far, which is the least gnuplot's replot has to do. Then checks, for a number of spans from the whole night
+ * down to a few seconds, that every column covers the counts of the samples inside it and nothing beyond one bin
+ * either side, and that values outside the pyramid are refused. Prints PASSED or FAILED.
+ *   ./lod_bench [hours] [rate_hz] [check_ms]
+ * (defaults 12 h, 1000 Hz and 1000 ms, i.e. 43.2 million samples).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include "pmtphot_lod.h"
+
+#define DEF_NUM_HOURS   12
+#define DEF_RATE_HZ     1000
+#define DEF_CHECK_MS    1000
+/// Same span and bins as the plot
+#define SPAN_S          86400.0
+#define BIN_S           0.125
+/// Samples start at 18:00 UT, a quarter of the way into the fractional JD
+#define START_S         21600.0
+#define NUM_COLS        800
+#define NUM_SPANS       8
+
+static double diff_s(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/// Counts of sample n - a slow variation with noise, so that every bin has a different range
+static float sample_counts(unsigned long n, int rate_hz)
+{
+  unsigned long noise = ((n * 2654435761UL) & 0xFFFFFFFFUL) >> 22;
+  return 1000.0 + 300.0 * sin(n / (600.0 * rate_hz) * 2.0 * M_PI) + noise;
+}
+
+static double sample_time(unsigned long n, int rate_hz)
+{
+  return START_S + (double)n / rate_hz;
+}
+
+/// Reduces samples 0 to num_samples-1 to columns the way a replot has to, by visiting every sample.
+static void replot_columns(unsigned long num_samples, int rate_hz, double t_lo_s, double t_hi_s, struct lodbin *cols)
+{
+  double col_s = (t_hi_s - t_lo_s) / NUM_COLS;
+  unsigned long i;
+  long col;
+  for (i=0; i<NUM_COLS; i++)
+    lodbin_clear(&cols[i]);
+  for (i=0; i<num_samples; i++)
+  {
+    col = floor((sample_time(i, rate_hz) - t_lo_s) / col_s);
+    if ((col < 0) || (col >= NUM_COLS))
+      continue;
+    float counts = sample_counts(i, rate_hz);
+    if (counts < cols[col].min)
+      cols[col].min = counts;
+    if (counts > cols[col].max)
+      cols[col].max = counts;
+  }
+}
+
+/** \brief Checks the columns of a span against the samples.
+ *
+ * Each column must cover the counts of the samples inside it (inner) and stay within the counts of the samples inside
+ * it or less than one bin of the level it was taken from either side of it (outer).
+ */
+static int check_span(struct lodpyr *pyr, unsigned long num_samples, int rate_hz, double t_lo_s, double t_hi_s)
+{
+  struct lodbin cols[NUM_COLS], inner[NUM_COLS], outer[NUM_COLS];
+  lodpyr_columns(pyr, t_lo_s, t_hi_s, NUM_COLS, cols);
+  double col_s = (t_hi_s - t_lo_s) / NUM_COLS, level_bin_s = BIN_S;
+  while ((level_bin_s * 2.0 <= col_s) && (level_bin_s * 2.0 < SPAN_S))
+    level_bin_s *= 2.0;
+  unsigned long i;
+  long col, col_first, col_last;
+  for (i=0; i<NUM_COLS; i++)
+  {
+    lodbin_clear(&inner[i]);
+    lodbin_clear(&outer[i]);
+  }
+  for (i=0; i<num_samples; i++)
+  {
+    double t_s = sample_time(i, rate_hz);
+    if ((t_s < t_lo_s - level_bin_s) || (t_s >= t_hi_s + level_bin_s))
+      continue;
+    float counts = sample_counts(i, rate_hz);
+    col = floor((t_s - t_lo_s) / col_s);
+    if ((col >= 0) && (col < NUM_COLS))
+    {
+      if (counts < inner[col].min)
+        inner[col].min = counts;
+      if (counts > inner[col].max)
+        inner[col].max = counts;
+    }
+    col_first = floor((t_s - level_bin_s - t_lo_s) / col_s);
+    col_last = floor((t_s + level_bin_s - t_lo_s) / col_s);
+    for (col=col_first<0 ? 0 : col_first; (col<=col_last) && (col<NUM_COLS); col++)
+    {
+      if (counts < outer[col].min)
+        outer[col].min = counts;
+      if (counts > outer[col].max)
+        outer[col].max = counts;
+    }
+  }
+  for (i=0; i<NUM_COLS; i++)
+  {
+    if ((!lodbin_empty(&inner[i])) && ((cols[i].min > inner[i].min) || (cols[i].max < inner[i].max)))
+    {
+      printf("  Column %lu of span %.3f - %.3f s (%.2f - %.2f) doesn't cover its samples (%.2f - %.2f).\n", i, t_lo_s, t_hi_s, cols[i].min, cols[i].max, inner[i].min, inner[i].max);
+      return -1;
+    }
+    if ((!lodbin_empty(&cols[i])) && ((cols[i].min < outer[i].min) || (cols[i].max > outer[i].max)))
+    {
+      printf("  Column %lu of span %.3f - %.3f s (%.2f - %.2f) goes beyond its neighbouring bins (%.2f - %.2f).\n", i, t_lo_s, t_hi_s, cols[i].min, cols[i].max, outer[i].min, outer[i].max);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  int num_hours = DEF_NUM_HOURS, rate_hz = DEF_RATE_HZ, check_ms = DEF_CHECK_MS;
+  if ((argc > 1) && ((sscanf(argv[1], "%d", &num_hours) != 1) || (num_hours <= 0) || (num_hours > 18)))
+  {
+    printf("Invalid number of hours: %s\n", argv[1]);
+    return 1;
+  }
+  if ((argc > 2) && ((sscanf(argv[2], "%d", &rate_hz) != 1) || (rate_hz <= 0)))
+  {
+    printf("Invalid sample rate: %s\n", argv[2]);
+    return 1;
+  }
+  if ((argc > 3) && ((sscanf(argv[3], "%d", &check_ms) != 1) || (check_ms <= 0)))
+  {
+    printf("Invalid check interval: %s\n", argv[3]);
+    return 1;
+  }
+  unsigned long num_samples = (unsigned long)num_hours * 3600 * rate_hz;
+  printf("%lu samples (%d h at %d Hz), checked every %d ms, plot %d columns wide\n", num_samples, num_hours, rate_hz, check_ms, NUM_COLS);
+
+  struct lodpyr pyr;
+  if (lodpyr_init(&pyr, SPAN_S, BIN_S) < 0)
+  {
+    printf("Could not allocate pyramid.\n");
+    return 1;
+  }
+  int ret = 0;
+  if ((lodpyr_add(&pyr, -1.0, 1.0) != -1) || (lodpyr_add(&pyr, SPAN_S, 1.0) != -1) || (!lodpyr_empty(&pyr)))
+  {
+    printf("Values outside the pyramid accepted.\n");
+    ret = 1;
+  }
+
+  struct lodbin cols[NUM_COLS], zoom_cols[NUM_COLS], replot_cols[NUM_COLS];
+  unsigned long batch = (unsigned long)rate_hz * check_ms / 1000, n = 0, i, hour = 0;
+  if (batch == 0)
+    batch = 1;
+  double check_s, total_s = 0.0, slowest_s = 0.0, view_lo_s = START_S, view_hi_s = START_S + 600.0, dirty_lo_s, dirty_hi_s;
+  struct timespec start, end;
+  lodpyr_columns(&pyr, view_lo_s, view_hi_s, NUM_COLS, cols);
+  while (n < num_samples)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i=0; (i<batch) && (n<num_samples); i++, n++)
+      lodpyr_add(&pyr, sample_time(n, rate_hz), sample_counts(n, rate_hz));
+    // As the plot does while following the run: grow the span when it's reached, otherwise redo the new columns
+    if (lodpyr_take_dirty(&pyr, &dirty_lo_s, &dirty_hi_s))
+    {
+      if (pyr.t_last_s >= view_hi_s)
+      {
+        while (pyr.t_last_s >= view_hi_s)
+          view_hi_s = view_lo_s + 2.0 * (view_hi_s - view_lo_s);
+        lodpyr_columns(&pyr, view_lo_s, view_hi_s, NUM_COLS, cols);
+      }
+      else
+      {
+        double col_s = (view_hi_s - view_lo_s) / NUM_COLS;
+        long col_lo = floor((dirty_lo_s - view_lo_s) / col_s) - 1, col_hi = floor((dirty_hi_s - view_lo_s) / col_s) + 2;
+        if (col_lo < 0)
+          col_lo = 0;
+        if (col_hi >= NUM_COLS)
+          col_hi = NUM_COLS - 1;
+        lodpyr_columns(&pyr, view_lo_s + col_lo*col_s, view_lo_s + (col_hi+1)*col_s, col_hi - col_lo + 1, &cols[col_lo]);
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    check_s = diff_s(&start, &end);
+    total_s += check_s;
+    if (check_s > slowest_s)
+      slowest_s = check_s;
+
+    if (n / (3600UL * rate_hz) > hour)
+    {
+      hour = n / (3600UL * rate_hz);
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      lodpyr_columns(&pyr, START_S, sample_time(n, rate_hz), NUM_COLS, zoom_cols);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      double zoom_s = diff_s(&start, &end);
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      replot_columns(n, rate_hz, START_S, sample_time(n, rate_hz), replot_cols);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      printf("  After %2lu h: whole plot from pyramid %8.3f ms, full replot %9.3f ms\n", hour, zoom_s * 1e3, diff_s(&start, &end) * 1e3);
+    }
+  }
+  // The incremental columns must match a plot worked out from scratch
+  struct lodbin fresh_cols[NUM_COLS];
+  lodpyr_columns(&pyr, view_lo_s, view_hi_s, NUM_COLS, fresh_cols);
+  for (i=0; i<NUM_COLS; i++)
+  {
+    if ((cols[i].min != fresh_cols[i].min) || (cols[i].max != fresh_cols[i].max))
+    {
+      printf("Column %lu drawn incrementally (%.2f - %.2f) differs from whole plot (%.2f - %.2f).\n", i, cols[i].min, cols[i].max, fresh_cols[i].min, fresh_cols[i].max);
+      ret = 1;
+      break;
+    }
+  }
+  printf("Incremental update: %.1f ns/sample, slowest check %.3f ms - %s\n", total_s * 1e9 / num_samples, slowest_s * 1e3, ret == 0 ? "OK" : "FAILED");
+
+  int span_ret = 0;
+
+  double t_end_s = sample_time(num_samples, rate_hz), span_s = t_end_s - START_S;
+  for (i=0; i<NUM_SPANS; i++)
+  {
+    // Spans shrinking by 4 each time, around a point that moves through the night, ending off the end of the samples
+    double t_lo_s = START_S + (t_end_s - START_S - span_s) * i / (NUM_SPANS - 1) + span_s / 3.0 * (i == NUM_SPANS - 1);
+    if (check_span(&pyr, num_samples, rate_hz, t_lo_s, t_lo_s + span_s) < 0)
+      span_ret = ret = 1;
+    span_s /= 4.0;
+  }
+  printf("Column ranges for %d spans: %s\n", NUM_SPANS, span_ret == 0 ? "OK" : "FAILED");
+
+  lodpyr_clear(&pyr);
+  lodpyr_columns(&pyr, START_S, t_end_s, NUM_COLS, cols);
+  for (i=0; i<NUM_COLS; i++)
+  {
+    if (!lodbin_empty(&cols[i]))
+    {
+      printf("Pyramid not empty after clearing.\n");
+      ret = 1;
+      break;
+    }
+  }
+  lodpyr_free(&pyr);
+  printf("%s\n", ret == 0 ? "PASSED" : "FAILED");
+  return ret;
+}
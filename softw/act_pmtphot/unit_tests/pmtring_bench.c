@@ -0,0 +1,370 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra -O2 -I../ -I../../../libs/ -I../../../drivers/pmt_driver/ ./pmtring_bench.c ../pmtphot_ring.c
+ * ../../../libs/act_log.c -lpthread -o ./pmtring_bench
+ *
+ * Tests and benchmarks reading PMT integration records through the driver's mapped ring (pmtphot_ring) without the
+ * PMT hardware or driver. A producer thread stands in for the driver: it fills an anonymous shared mapping laid out
+ * like the driver's ring exactly the way ring_push in pmt_driver.c does, and emulates the driver's poll() with an
+ * eventfd that is signalled when the number of unread records reaches the wake-up threshold.
+ *  - Overflow: records produced while the ring is full must be discarded and counted, the rest read in order.
+ *  - Drain rate: the producer runs unpaced (waiting instead of discarding when the ring is full) and the reader
+ *    drains batches with pmtring_peek/pmtring_release. For comparison the same number of records is passed through a
+ *    pipe with one write and one read per record, like the previous IOCTL_GET_INTEG_DATA per record.
+ *  - Latency: the producer runs paced at rate_hz for the given number of seconds; the reader sleeps in poll() and
+ *    reports the time from a record being published to it being read (mean, 99th percentile and worst case).
+ * Every record must arrive exactly once and in order. Prints PASSED or FAILED.
+ *   ./pmtring_bench [seconds] [rate_hz] [wake_thresh]
+ * (defaults 10 s, 1000 Hz and 1 record).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "pmtphot_ring.h"
+
+#define DEF_NUM_SEC       10
+#define DEF_RATE_HZ       1000
+#define DEF_WAKE_THRESH   1
+#define NUM_DRAIN         20000000UL
+#define NUM_PIPE          1000000UL
+#define NUM_OVERFLOW      100
+
+/// Stand-in for the PMT driver's side of the ring
+struct sim_driver
+{
+  void *mem;
+  struct pmt_ring_hdr *hdr;
+  struct pmt_integ_data *data;
+  int efd;
+  unsigned long thresh;
+  /// Set once the producer is done (like the end of an integration)
+  char done;
+  /// Producer settings
+  unsigned long num_records;
+  int rate_hz;
+  char block_when_full;
+};
+
+static unsigned long long now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sim_wake(struct sim_driver *drv)
+{
+  unsigned long long one = 1;
+  if (write(drv->efd, &one, sizeof(one)) != sizeof(one))
+    fprintf(stderr, "Failed to signal reader - %s\n", strerror(errno));
+}
+
+/// Same as ring_push in pmt_driver.c, with the kernel barriers replaced by the equivalent atomics
+static int sim_push(struct sim_driver *drv, struct pmt_integ_data *data)
+{
+  __u32 prod_idx = drv->hdr->prod_idx;
+  __u32 cons_idx = __atomic_load_n(&drv->hdr->cons_idx, __ATOMIC_ACQUIRE);
+  if ((__u32)(prod_idx - cons_idx) >= PMT_RING_LEN)
+  {
+    __atomic_store_n(&drv->hdr->num_lost, drv->hdr->num_lost + 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+  memcpy(&drv->data[prod_idx % PMT_RING_LEN], data, sizeof(struct pmt_integ_data));
+  __atomic_store_n(&drv->hdr->prod_idx, prod_idx + 1, __ATOMIC_RELEASE);
+  // The driver wakes poll() on every record past the threshold; an eventfd only needs to be signalled once
+  if ((__u32)(prod_idx + 1 - cons_idx) == drv->thresh)
+    sim_wake(drv);
+  return 0;
+}
+
+/// Same conditions as pmt_poll in pmt_driver.c
+static void sim_poll(struct sim_driver *drv, struct pmtring *ring)
+{
+  unsigned long long val;
+  struct pollfd pfd = { .fd = drv->efd, .events = POLLIN };
+  while (1)
+  {
+    // Once the producer is done, any unread record makes the ring readable
+    if ((pmtring_num_unread(ring) >= drv->thresh) || __atomic_load_n(&drv->done, __ATOMIC_ACQUIRE))
+      return;
+    if (poll(&pfd, 1, 1000) > 0)
+    {
+      if (read(drv->efd, &val, sizeof(val)) != sizeof(val))
+        fprintf(stderr, "Failed to read wake-up - %s\n", strerror(errno));
+    }
+  }
+}
+
+/// Integration records carry their sequence number in counts and their publication time in start_time_s/ns
+static void *producer_thread(void *arg)
+{
+  struct sim_driver *drv = (struct sim_driver *)arg;
+  struct pmt_integ_data rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.sample_period_ns = drv->rate_hz > 0 ? 1000000000UL / drv->rate_hz : 1000000;
+  rec.prebin_num = 1;
+  unsigned long i;
+  unsigned long long start = now_ns();
+  for (i=0; i<drv->num_records; i++)
+  {
+    if (drv->rate_hz > 0)
+    {
+      unsigned long long due = start + i * 1000000000ULL / drv->rate_hz;
+      struct timespec ts = { .tv_sec = due / 1000000000ULL, .tv_nsec = due % 1000000000ULL };
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+    unsigned long long stamp = now_ns();
+    rec.start_time_s = stamp / 1000000000ULL;
+    rec.start_time_ns = stamp % 1000000000ULL;
+    rec.counts = i;
+    rec.repetitions = i;
+    if (drv->block_when_full)
+      while ((__u32)(drv->hdr->prod_idx - __atomic_load_n(&drv->hdr->cons_idx, __ATOMIC_ACQUIRE)) >= PMT_RING_LEN)
+        sched_yield();
+    sim_push(drv, &rec);
+  }
+  __atomic_store_n(&drv->done, 1, __ATOMIC_RELEASE);
+  sim_wake(drv);
+  return NULL;
+}
+
+static int sim_init(struct sim_driver *drv, unsigned long thresh)
+{
+  memset(drv, 0, sizeof(struct sim_driver));
+  drv->mem = mmap(NULL, PMT_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (drv->mem == MAP_FAILED)
+    return -1;
+  drv->hdr = (struct pmt_ring_hdr *)drv->mem;
+  drv->data = (struct pmt_integ_data *)((char *)drv->mem + PMT_RING_HDR_SIZE);
+  drv->efd = eventfd(0, 0);
+  if (drv->efd < 0)
+  {
+    munmap(drv->mem, PMT_RING_SIZE);
+    return -1;
+  }
+  drv->thresh = thresh;
+  return 0;
+}
+
+static void sim_free(struct sim_driver *drv)
+{
+  close(drv->efd);
+  munmap(drv->mem, PMT_RING_SIZE);
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+  return x < y ? -1 : x > y;
+}
+
+static int test_overflow(void)
+{
+  struct sim_driver drv;
+  struct pmtring ring;
+  struct pmt_integ_data rec, *records;
+  unsigned long i, num, next = 0;
+  if (sim_init(&drv, PMT_RING_LEN) != 0)
+    return 1;
+  pmtring_attach(&ring, drv.mem);
+  memset(&rec, 0, sizeof(rec));
+  for (i=0; i<PMT_RING_LEN+NUM_OVERFLOW; i++)
+  {
+    rec.counts = i;
+    sim_push(&drv, &rec);
+  }
+  int failed = pmtring_num_lost(&ring) != NUM_OVERFLOW;
+  while ((num = pmtring_peek(&ring, &records)) > 0)
+  {
+    for (i=0; i<num; i++)
+      if (records[i].counts != next++)
+        failed = 1;
+    pmtring_release(&ring, num);
+  }
+  failed |= next != PMT_RING_LEN;
+  // Once there is space again, records are accepted (and the ring wraps around)
+  for (i=0; i<PMT_RING_LEN/2*3; i++)
+  {
+    rec.counts = i;
+    failed |= sim_push(&drv, &rec) != 0;
+    if (pmtring_peek(&ring, &records) == 0)
+      failed = 1;
+    else
+    {
+      failed |= records[0].counts != i;
+      pmtring_release(&ring, 1);
+    }
+  }
+  failed |= (pmtring_num_unread(&ring) != 0) || (pmtring_num_lost(&ring) != 0);
+  printf("Overflow: %s\n", failed ? "FAILED" : "OK");
+  sim_free(&drv);
+  return failed;
+}
+
+static int test_drain(unsigned long thresh)
+{
+  struct sim_driver drv;
+  struct pmtring ring;
+  struct pmt_integ_data *records;
+  unsigned long i, num, next = 0, num_batches = 0, max_batch = 0;
+  unsigned long long sum = 0;
+  pthread_t thr;
+  int failed = 0;
+  if (sim_init(&drv, thresh) != 0)
+    return 1;
+  pmtring_attach(&ring, drv.mem);
+  drv.num_records = NUM_DRAIN;
+  drv.block_when_full = 1;
+  unsigned long long start = now_ns();
+  pthread_create(&thr, NULL, producer_thread, &drv);
+  while (next < NUM_DRAIN)
+  {
+    sim_poll(&drv, &ring);
+    while ((num = pmtring_peek(&ring, &records)) > 0)
+    {
+      for (i=0; i<num; i++)
+      {
+        if (records[i].counts != next++)
+          failed = 1;
+        sum += records[i].counts;
+      }
+      pmtring_release(&ring, num);
+      num_batches++;
+      if (num > max_batch)
+        max_batch = num;
+    }
+    if ((next < NUM_DRAIN) && __atomic_load_n(&drv.done, __ATOMIC_ACQUIRE) && (pmtring_num_unread(&ring) == 0))
+      break;
+  }
+  double elapsed_s = (now_ns() - start) / 1.0e9;
+  pthread_join(thr, NULL);
+  failed |= (next != NUM_DRAIN) || (sum != (unsigned long long)NUM_DRAIN*(NUM_DRAIN-1)/2);
+  printf("Mapped ring (unpaced):   %9lu records  %7.3f s  %11.0f records/s  %lu batches, largest %lu  %s\n", next, elapsed_s, next / elapsed_s, num_batches, max_batch, failed ? "FAILED" : "OK");
+  sim_free(&drv);
+  return failed;
+}
+
+static void *pipe_writer(void *arg)
+{
+  int fd = *(int *)arg;
+  struct pmt_integ_data rec;
+  memset(&rec, 0, sizeof(rec));
+  unsigned long i;
+  for (i=0; i<NUM_PIPE; i++)
+  {
+    rec.counts = i;
+    if (write(fd, &rec, sizeof(rec)) != sizeof(rec))
+      break;
+  }
+  return NULL;
+}
+
+static int test_pipe(void)
+{
+  int fds[2];
+  pthread_t thr;
+  struct pmt_integ_data rec;
+  unsigned long next = 0;
+  int failed = 0;
+  if (pipe(fds) != 0)
+    return 1;
+  unsigned long long start = now_ns();
+  pthread_create(&thr, NULL, pipe_writer, &fds[1]);
+  while ((next < NUM_PIPE) && (read(fds[0], &rec, sizeof(rec)) == sizeof(rec)))
+    if (rec.counts != next++)
+      failed = 1;
+  double elapsed_s = (now_ns() - start) / 1.0e9;
+  pthread_join(thr, NULL);
+  close(fds[0]);
+  close(fds[1]);
+  failed |= next != NUM_PIPE;
+  printf("Syscall per record:      %9lu records  %7.3f s  %11.0f records/s  %s\n", next, elapsed_s, next / elapsed_s, failed ? "FAILED" : "OK");
+  return failed;
+}
+
+static int test_latency(int num_sec, int rate_hz, unsigned long thresh)
+{
+  struct sim_driver drv;
+  struct pmtring ring;
+  struct pmt_integ_data *records;
+  unsigned long i, num, next = 0, num_wakes = 0, num_records = (unsigned long)num_sec * rate_hz;
+  pthread_t thr;
+  int failed = 0;
+  unsigned long long *latency = malloc(num_records * sizeof(unsigned long long));
+  if ((latency == NULL) || (sim_init(&drv, thresh) != 0))
+  {
+    free(latency);
+    return 1;
+  }
+  pmtring_attach(&ring, drv.mem);
+  drv.num_records = num_records;
+  drv.rate_hz = rate_hz;
+  pthread_create(&thr, NULL, producer_thread, &drv);
+  while (next < num_records)
+  {
+    sim_poll(&drv, &ring);
+    num_wakes++;
+    while ((num = pmtring_peek(&ring, &records)) > 0)
+    {
+      unsigned long long read_ns = now_ns();
+      for (i=0; (i<num) && (next < num_records); i++)
+      {
+        if (records[i].counts != next)
+          failed = 1;
+        latency[next++] = read_ns - (records[i].start_time_s * 1000000000ULL + records[i].start_time_ns);
+      }
+      pmtring_release(&ring, num);
+    }
+    if ((next < num_records) && __atomic_load_n(&drv.done, __ATOMIC_ACQUIRE) && (pmtring_num_unread(&ring) == 0))
+      break;
+  }
+  pthread_join(thr, NULL);
+  failed |= (next != num_records) || (pmtring_num_lost(&ring) != 0);
+  if (next > 0)
+  {
+    unsigned long long sum = 0;
+    for (i=0; i<next; i++)
+      sum += latency[i];
+    qsort(latency, next, sizeof(unsigned long long), cmp_ull);
+    printf("Mapped ring (%d Hz, threshold %lu): %lu records  %lu wake-ups  latency mean %.3f ms  p99 %.3f ms  max %.3f ms  %s\n", rate_hz, thresh, next, num_wakes, sum / (double)next / 1.0e6, latency[next*99/100] / 1.0e6, latency[next-1] / 1.0e6, failed ? "FAILED" : "OK");
+  }
+  free(latency);
+  sim_free(&drv);
+  return failed;
+}
+
+int main(int argc, char **argv)
+{
+  int num_sec = DEF_NUM_SEC, rate_hz = DEF_RATE_HZ;
+  unsigned long thresh = DEF_WAKE_THRESH;
+  if ((argc > 1) && ((sscanf(argv[1], "%d", &num_sec) != 1) || (num_sec <= 0)))
+  {
+    fprintf(stderr, "Invalid number of seconds specified (%s).\n", argv[1]);
+    return 1;
+  }
+  if ((argc > 2) && ((sscanf(argv[2], "%d", &rate_hz) != 1) || (rate_hz <= 0)))
+  {
+    fprintf(stderr, "Invalid sample rate specified (%s).\n", argv[2]);
+    return 1;
+  }
+  if ((argc > 3) && ((sscanf(argv[3], "%lu", &thresh) != 1) || (thresh < 1) || (thresh > PMT_RING_LEN)))
+  {
+    fprintf(stderr, "Invalid wake-up threshold specified (%s).\n", argv[3]);
+    return 1;
+  }
+
+  int failed = test_overflow();
+  failed |= test_drain(PMTRING_WAKE_NUM);
+  failed |= test_pipe();
+  failed |= test_latency(num_sec, rate_hz, thresh);
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
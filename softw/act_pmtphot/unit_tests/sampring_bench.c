@@ -0,0 +1,379 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra -O2 -I../ -I../../../libs/ -I../../../drivers/pmt_driver/ ./sampring_bench.c ../pmtphot_samples.c
+ * ../../../libs/act_positastro.c ../../../libs/act_timecoord.c ../../../libs/act_log.c -lpthread -lm -o ./sampring_bench
+ *
+ * Benchmarks passing one night of PMT samples from pmt_integ_get_data to its consumers (storage, view and plot):
+ *  - through the previous linked list, with one malloc'd struct pmtintegstruct per sample which every consumer walks
+ *    and free_integ_data then frees node by node,
+ *  - through the sample ring (pmtphot_samples), with one cursor per consumer and the slots released after each check.
+ * Both paths get the same records, batched as act_pmtphot reads them (check_ms worth of samples per check), and the
+ * consumers do the same work on each sample, so the difference is only in how the samples are held. Reports the total
+ * and per-sample time and the slowest check, and verifies that both paths deliver every sample to every consumer with
+ * the same contents. Also checks that a full ring refuses samples, that a consumer that falls behind skips to the oldest
+ * sample kept and that unread samples are returned in two parts where they wrap. Prints PASSED or FAILED.
+ *   ./sampring_bench [hours] [rate_hz] [check_ms]
+ * (defaults 12 h, 1000 Hz and 1000 ms, i.e. 43.2 million samples).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pmt_driver.h>
+#include <act_timecoord.h>
+#include <act_positastro.h>
+#include "pmtphot_samples.h"
+
+#define DEF_NUM_HOURS   12
+#define DEF_RATE_HZ     1000
+#define DEF_CHECK_MS    1000
+
+/// The fields of the previous struct pmtintegstruct (without GTK and IPC types)
+struct listinteg
+{
+  int targid;
+  char sky;
+  int userid;
+  int filt_id, aper_id;
+  char filt_name[20], aper_name[20];
+  char mode;
+  struct datestruct start_unidate;
+  struct timestruct start_unitime;
+  double sample_period_s;
+  unsigned long prebin;
+  double integt_s;
+  double dead_time_s;
+  unsigned long repetitions;
+  unsigned long counts;
+  unsigned char error;
+  char done;
+  void *next;
+};
+
+/// What the consumers make of the samples - the same for both paths
+struct consumers
+{
+  /// Storage: samples converted like sample_from_ring, into a queue that is reused
+  struct
+  {
+    int year, month, day;
+    double start_time_h, integt_s;
+    int filt_id, aper_id;
+    unsigned long long counts;
+    signed char warn, err;
+  } store[4096];
+  unsigned long num_stored;
+  /// View: start time formatted for the row
+  unsigned long num_viewed, view_chars;
+  /// Plot: fraction of a day and counts
+  unsigned long num_plotted;
+  double plot_sum;
+  unsigned long long counts_sum;
+};
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+/// Driver record number i: rate_hz samples per second from 20:00 UT on 11 May 2015 with pseudo-random counts
+static void make_record(unsigned long i, int rate_hz, struct pmt_integ_data *rec)
+{
+  unsigned long long start_ns = 1431374400ULL*1000000000ULL + i * (1000000000ULL / rate_hz);
+  unsigned long x = i * 2654435761UL + 1;
+  x ^= x >> 13;
+  rec->start_time_s = start_ns / 1000000000ULL;
+  rec->start_time_ns = start_ns % 1000000000ULL;
+  rec->sample_period_ns = 1000000000UL / rate_hz;
+  rec->prebin_num = 1;
+  rec->repetitions = i;
+  rec->counts = 1000 + x % 200;
+  rec->error = (x % 1000) == 0 ? PMT_ERR_WARN : 0;
+}
+
+static void store_sample(struct consumers *cons, struct datestruct *unidate, struct timestruct *unitime, double integt_s, int filt_id, int aper_id, unsigned long counts, unsigned char error)
+{
+  unsigned long idx = cons->num_stored++ % 4096;
+  cons->store[idx].year = unidate->year;
+  cons->store[idx].month = unidate->month+1;
+  cons->store[idx].day = unidate->day+1;
+  cons->store[idx].start_time_h = convert_HMSMS_H_time(unitime);
+  cons->store[idx].integt_s = integt_s;
+  cons->store[idx].filt_id = filt_id;
+  cons->store[idx].aper_id = aper_id;
+  cons->store[idx].counts = counts;
+  cons->store[idx].warn = (error & (~PMT_CRIT_ERR_MASK)) > 0;
+  cons->store[idx].err = (error & PMT_CRIT_ERR_MASK) > 0;
+  cons->counts_sum += counts;
+}
+
+static void view_sample(struct consumers *cons, struct timestruct *unitime)
+{
+  char timestr[15];
+  cons->view_chars += snprintf(timestr, sizeof(timestr), "%2hhu:%02hhu:%02hhu.%03hu", unitime->hours, unitime->minutes, unitime->seconds, unitime->milliseconds);
+  cons->num_viewed++;
+}
+
+static void plot_sample(struct consumers *cons, struct timestruct *unitime, unsigned long counts)
+{
+  double tmp_time = convert_HMSMS_H_time(unitime) / 24.0;
+  if (tmp_time < 0.5)
+    tmp_time += 0.5;
+  cons->plot_sum += tmp_time * counts;
+  cons->num_plotted++;
+}
+
+/// The previous append_integ: fills in the dummy at the end of the list and appends a new dummy
+static int list_append(struct listinteg **lastinteg, struct pmt_integ_data *record)
+{
+  struct listinteg *nextinteg, *curinteg = *lastinteg;
+  struct timestruct start_time;
+  curinteg->integt_s = (double)record->sample_period_ns * record->prebin_num / 1000000000.0;
+  curinteg->repetitions = record->repetitions;
+  curinteg->counts = record->counts;
+  curinteg->error = record->error;
+  convert_MS_HMSMS_time((record->start_time_s % 86400)*1000 + record->start_time_ns/1000000, &start_time);
+  check_systime_discrep(&curinteg->start_unidate, &curinteg->start_unitime, &start_time);
+  memcpy(&curinteg->start_unitime, &start_time, sizeof(struct timestruct));
+  curinteg->done = 1;
+  nextinteg = malloc(sizeof(struct listinteg));
+  if (nextinteg == NULL)
+    return -1;
+  memcpy(nextinteg, curinteg, sizeof(struct listinteg));
+  nextinteg->next = NULL;
+  nextinteg->done = -1;
+  nextinteg->integt_s = 0.0;
+  nextinteg->repetitions = 0;
+  nextinteg->counts = 0;
+  nextinteg->error = 0;
+  curinteg->next = nextinteg;
+  *lastinteg = nextinteg;
+  return 0;
+}
+
+/// The previous free_integ_data: frees every node but the last and returns it
+static struct listinteg *list_free(struct listinteg *pmtinteg)
+{
+  struct listinteg *lastinteg = pmtinteg, *nextinteg = pmtinteg->next;
+  while (nextinteg != NULL)
+  {
+    free(lastinteg);
+    lastinteg = nextinteg;
+    nextinteg = lastinteg->next;
+  }
+  return lastinteg;
+}
+
+static double run_list(unsigned long num_samples, int rate_hz, unsigned long batch, struct consumers *cons, double *max_check_s)
+{
+  struct listinteg *pmtinteg = calloc(1, sizeof(struct listinteg)), *lastinteg, *cur;
+  struct pmt_integ_data rec;
+  unsigned long i = 0, j;
+  pmtinteg->filt_id = 3;
+  pmtinteg->aper_id = 2;
+  pmtinteg->start_unidate.year = 2015;
+  pmtinteg->start_unidate.month = 4;
+  pmtinteg->start_unidate.day = 10;
+  convert_MS_HMSMS_time(20*3600000, &pmtinteg->start_unitime);
+  *max_check_s = 0.0;
+  double start_s = now_s();
+  while (i < num_samples)
+  {
+    double check_s = now_s();
+    lastinteg = pmtinteg;
+    for (j=0; (j<batch) && (i<num_samples); j++, i++)
+    {
+      make_record(i, rate_hz, &rec);
+      if (list_append(&lastinteg, &rec) < 0)
+      {
+        fprintf(stderr, "Out of memory.\n");
+        exit(2);
+      }
+    }
+    for (cur = pmtinteg; (cur != NULL) && (cur->done > 0); cur = cur->next)
+      store_sample(cons, &cur->start_unidate, &cur->start_unitime, cur->integt_s, cur->filt_id, cur->aper_id, cur->counts, cur->error);
+    for (cur = pmtinteg; (cur != NULL) && (cur->done > 0); cur = cur->next)
+      view_sample(cons, &cur->start_unitime);
+    for (cur = pmtinteg; (cur != NULL) && (cur->done > 0); cur = cur->next)
+      plot_sample(cons, &cur->start_unitime, cur->counts);
+    pmtinteg = list_free(pmtinteg);
+    check_s = now_s() - check_s;
+    if (check_s > *max_check_s)
+      *max_check_s = check_s;
+  }
+  free(pmtinteg);
+  return now_s() - start_s;
+}
+
+/// The new append_integ in pmtfuncs.c
+static void ring_append(struct sampring *samples, struct listinteg *pmtinteg, struct pmt_integ_data *record)
+{
+  struct timestruct start_time;
+  convert_MS_HMSMS_time((record->start_time_s % 86400)*1000 + record->start_time_ns/1000000, &start_time);
+  check_systime_discrep(&pmtinteg->start_unidate, &pmtinteg->start_unitime, &start_time);
+  memcpy(&pmtinteg->start_unitime, &start_time, sizeof(struct timestruct));
+  sampring_append(samples, &pmtinteg->start_unidate, &start_time, (double)record->sample_period_ns * record->prebin_num / 1000000000.0, record->counts, record->error);
+  pmtinteg->integt_s = 0.0;
+  pmtinteg->counts = 0;
+  pmtinteg->error = 0;
+}
+
+static double run_ring(unsigned long num_samples, int rate_hz, unsigned long batch, struct consumers *cons, double *max_check_s)
+{
+  struct sampring samples;
+  struct listinteg pmtinteg;
+  struct pmt_integ_data rec;
+  unsigned long i = 0, j, k, slot, num, store_cursor = 0, view_cursor = 0, plot_cursor = 0;
+  if (sampring_init(&samples, SAMPRING_LEN) < 0)
+    exit(2);
+  memset(&pmtinteg, 0, sizeof(pmtinteg));
+  pmtinteg.filt_id = 3;
+  pmtinteg.aper_id = 2;
+  pmtinteg.start_unidate.year = 2015;
+  pmtinteg.start_unidate.month = 4;
+  pmtinteg.start_unidate.day = 10;
+  convert_MS_HMSMS_time(20*3600000, &pmtinteg.start_unitime);
+  *max_check_s = 0.0;
+  double start_s = now_s();
+  while (i < num_samples)
+  {
+    double check_s = now_s();
+    for (j=0; (j<batch) && (i<num_samples) && (sampring_space(&samples) > 0); j++, i++)
+    {
+      make_record(i, rate_hz, &rec);
+      ring_append(&samples, &pmtinteg, &rec);
+    }
+    while ((num = sampring_peek(&samples, &store_cursor, &slot)) > 0)
+    {
+      for (k=slot; k<slot+num; k++)
+        store_sample(cons, &samples.start_unidate[k], &samples.start_unitime[k], samples.integt_s[k], pmtinteg.filt_id, pmtinteg.aper_id, samples.counts[k], samples.error[k]);
+      store_cursor += num;
+    }
+    while ((num = sampring_peek(&samples, &view_cursor, &slot)) > 0)
+    {
+      for (k=slot; k<slot+num; k++)
+        view_sample(cons, &samples.start_unitime[k]);
+      view_cursor += num;
+    }
+    while ((num = sampring_peek(&samples, &plot_cursor, &slot)) > 0)
+    {
+      for (k=slot; k<slot+num; k++)
+        plot_sample(cons, &samples.start_unitime[k], samples.counts[k]);
+      plot_cursor += num;
+    }
+    sampring_release(&samples, samples.head);
+    check_s = now_s() - check_s;
+    if (check_s > *max_check_s)
+      *max_check_s = check_s;
+  }
+  sampring_free(&samples);
+  return now_s() - start_s;
+}
+
+static void report(const char *name, unsigned long num_samples, double elapsed_s, double max_check_s)
+{
+  printf("%-22s %10lu samples  %8.3f s  %7.1f ns/sample  %12.0f samples/s  slowest check %7.3f ms\n", name, num_samples, elapsed_s, elapsed_s*1.0e9/num_samples, num_samples/elapsed_s, max_check_s*1000.0);
+}
+
+/// A full ring must refuse samples, a consumer that has been overtaken must skip to the oldest sample kept and the
+/// unread samples must be returned in two parts where they wrap around the end of the columns.
+static int test_lapped(void)
+{
+  struct sampring samples;
+  struct datestruct unidate = { .day = 10, .month = 4, .year = 2015 };
+  struct timestruct unitime;
+  unsigned long i, slot, num, cursor = 0, len = 16;
+  int ret = 0;
+  if (sampring_init(&samples, len) < 0)
+    return 1;
+  memset(&unitime, 0, sizeof(unitime));
+  for (i=0; i<len; i++)
+    if (sampring_append(&samples, &unidate, &unitime, 0.001, i, 0) < 0)
+      ret = 1;
+  if ((sampring_space(&samples) != 0) || (sampring_append(&samples, &unidate, &unitime, 0.001, i, 0) == 0))
+    ret = 1;
+  // Samples 0 to 9 are handed back, 16 to 25 go into their slots
+  sampring_release(&samples, 10);
+  for (i=len; i<len+10; i++)
+    if (sampring_append(&samples, &unidate, &unitime, 0.001, i, 0) < 0)
+      ret = 1;
+  // Releasing beyond the newest sample must be ignored
+  sampring_release(&samples, samples.head + 1);
+  if ((samples.tail != 10) || (samples.head != 26))
+    ret = 1;
+  // The consumer still at sample 0 resumes at sample 10 - slots 10 to 15, then 0 to 9
+  num = sampring_peek(&samples, &cursor, &slot);
+  if ((cursor != 10) || (slot != 10) || (num != 6) || (samples.counts[slot] != 10))
+    ret = 1;
+  cursor += num;
+  num = sampring_peek(&samples, &cursor, &slot);
+  if ((slot != 0) || (num != 10) || (samples.counts[slot] != 16) || (samples.counts[slot+num-1] != 25))
+    ret = 1;
+  cursor += num;
+  if (sampring_peek(&samples, &cursor, &slot) != 0)
+    ret = 1;
+  sampring_free(&samples);
+  printf("Full and lapped ring: %s\n", ret == 0 ? "OK" : "FAILED");
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  int num_hours = DEF_NUM_HOURS, rate_hz = DEF_RATE_HZ, check_ms = DEF_CHECK_MS;
+  if ((argc > 1) && ((sscanf(argv[1], "%d", &num_hours) != 1) || (num_hours <= 0)))
+  {
+    fprintf(stderr, "Invalid number of hours specified (%s).\n", argv[1]);
+    return 1;
+  }
+  if ((argc > 2) && ((sscanf(argv[2], "%d", &rate_hz) != 1) || (rate_hz <= 0) || (rate_hz > 1000000)))
+  {
+    fprintf(stderr, "Invalid sample rate specified (%s).\n", argv[2]);
+    return 1;
+  }
+  if ((argc > 3) && ((sscanf(argv[3], "%d", &check_ms) != 1) || (check_ms <= 0)))
+  {
+    fprintf(stderr, "Invalid check interval specified (%s).\n", argv[3]);
+    return 1;
+  }
+  unsigned long num_samples = (unsigned long)num_hours * 3600 * rate_hz;
+  unsigned long batch = (unsigned long)rate_hz * check_ms / 1000;
+  if (batch == 0)
+    batch = 1;
+  if (batch > SAMPRING_LEN)
+  {
+    fprintf(stderr, "More samples per check (%lu) than the sample ring holds (%d).\n", batch, SAMPRING_LEN);
+    return 1;
+  }
+  printf("%lu samples at %d Hz, %lu per check\n", num_samples, rate_hz, batch);
+
+  int ret = test_lapped();
+  struct consumers *list_cons = calloc(1, sizeof(struct consumers)), *ring_cons = calloc(1, sizeof(struct consumers));
+  double list_max_s, ring_max_s;
+  double list_s = run_list(num_samples, rate_hz, batch, list_cons, &list_max_s);
+  report("linked list", num_samples, list_s, list_max_s);
+  double ring_s = run_ring(num_samples, rate_hz, batch, ring_cons, &ring_max_s);
+  report("sample ring", num_samples, ring_s, ring_max_s);
+  printf("Sample ring speed-up: %.2fx\n", list_s / ring_s);
+
+  if ((list_cons->num_stored != num_samples) || (list_cons->num_viewed != num_samples) || (list_cons->num_plotted != num_samples))
+  {
+    printf("Linked list lost samples (%lu stored, %lu viewed, %lu plotted).\n", list_cons->num_stored, list_cons->num_viewed, list_cons->num_plotted);
+    ret = 1;
+  }
+  if ((ring_cons->num_stored != num_samples) || (ring_cons->num_viewed != num_samples) || (ring_cons->num_plotted != num_samples))
+  {
+    printf("Sample ring lost samples (%lu stored, %lu viewed, %lu plotted).\n", ring_cons->num_stored, ring_cons->num_viewed, ring_cons->num_plotted);
+    ret = 1;
+  }
+  if ((list_cons->counts_sum != ring_cons->counts_sum) || (list_cons->view_chars != ring_cons->view_chars) || (list_cons->plot_sum != ring_cons->plot_sum) || (memcmp(list_cons->store, ring_cons->store, sizeof(list_cons->store)) != 0))
+  {
+    printf("Consumers got different samples from the linked list and the sample ring.\n");
+    ret = 1;
+  }
+  free(list_cons);
+  free(ring_cons);
+  printf("%s\n", ret == 0 ? "PASSED" : "FAILED");
+  return ret;
+}
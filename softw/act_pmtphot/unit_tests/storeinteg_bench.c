@@ -0,0 +1,239 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra `pkg-config --cflags gtk+-2.0` -I../ -I../../../libs/ -I../../../drivers/pmt_driver/
+ * -I../../../drivers/time_driver/ ./storeinteg_bench.c ../pmtphot_storequeue.c ../pmtphot_samples.c ../../../libs/act_log.c
+ * ../../../libs/act_timecoord.c -lmysqlclient -lpthread -lm -o ./storeinteg_bench
+ *
+ * Benchmarks storage of PMT samples in pmt_phot_raw on a (local) MySQL/MariaDB server:
+ *  - the previous storeinteg, which built one INSERT string with sprintf and sent it with a synchronous mysql_query,
+ *  - the store queue, unpaced, to find the sustained rate its writer thread can store samples at,
+ *  - the store queue paced like act_pmtphot (rate_hz samples appended once a second) for the given number of seconds,
+ *    reporting the longest append call, the deepest the queue got and whether any samples had to go to the backup file.
+ * The benchmark creates (and drops) pmt_phot_raw itself and refuses to run if it already exists, so it should be run
+ * against a test database:
+ *   ./storeinteg_bench <host> <user> <database> [seconds] [rate_hz]
+ * (defaults 60 s and 1000 Hz).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <mysql/mysql.h>
+#include "pmtphot_storequeue.h"
+
+#define DEF_NUM_SEC   60
+#define DEF_RATE_HZ   1000
+#define LINE_LENGTH   180
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+/// One second of samples at rate_hz in the sample ring, belonging to the integration pmtinteg
+static int make_samples(struct sampring *samples, struct pmtintegstruct *pmtinteg, int rate_hz)
+{
+  struct timestruct start_unitime;
+  int i;
+  if (sampring_init(samples, rate_hz) < 0)
+    return -1;
+  memset(pmtinteg, 0, sizeof(struct pmtintegstruct));
+  pmtinteg->filter.db_id = 3;
+  pmtinteg->aperture.db_id = 2;
+  pmtinteg->start_unidate.year = 2015;
+  pmtinteg->start_unidate.month = 4;
+  pmtinteg->start_unidate.day = 11;
+  pmtinteg->sample_period_s = 1.0/rate_hz;
+  for (i=0; i<rate_hz; i++)
+  {
+    convert_MS_HMSMS_time(20*3600000 + i*1000/rate_hz, &start_unitime);
+    sampring_append(samples, &pmtinteg->start_unidate, &start_unitime, 1.0/rate_hz, 1000 + rand() % 200, 0);
+  }
+  return 0;
+}
+
+/// The previous storeinteg (with its buffer growth check corrected)
+static int old_storeinteg(MYSQL *conn, struct sampring *samples, struct pmtintegstruct *pmtinteg, int num)
+{
+  char *qrystr = malloc(180 + num*LINE_LENGTH);
+  unsigned long qrylen = sprintf(qrystr, "INSERT INTO pmt_phot_raw (modnum, start_date, start_time_h, integt_s, pmt_filt_id, pmt_aper_id, counts, warn, err) VALUES ");
+  int i;
+  for (i=0; i<num; i++)
+    qrylen += sprintf(&qrystr[qrylen], "(%11d, \"%04hd-%02hhd-%02hhd\", %15.10lf, %15.10lf, %11d, %11d, %11lu, %3hhu, %3hhu), ", 1, samples->start_unidate[i].year, samples->start_unidate[i].month+1, samples->start_unidate[i].day+1, convert_HMSMS_H_time(&samples->start_unitime[i]), samples->integt_s[i], pmtinteg->filter.db_id, pmtinteg->aperture.db_id, samples->counts[i], pmt_noncrit_err(samples->error[i]), pmt_crit_err(samples->error[i]));
+  qrylen -= 2;
+  qrystr[qrylen] = '\0';
+  int ret = mysql_query(conn, qrystr);
+  if (ret != 0)
+    fprintf(stderr, "Old storeinteg insert failed - %s\n", mysql_error(conn));
+  free(qrystr);
+  return ret;
+}
+
+static unsigned long count_rows(MYSQL *conn)
+{
+  unsigned long num = 0;
+  if (mysql_query(conn, "SELECT COUNT(*) FROM pmt_phot_raw;") != 0)
+    return 0;
+  MYSQL_RES *result = mysql_store_result(conn);
+  if (result == NULL)
+    return 0;
+  MYSQL_ROW row = mysql_fetch_row(result);
+  if (row != NULL)
+    num = strtoul(row[0], NULL, 10);
+  mysql_free_result(result);
+  return num;
+}
+
+/// Waits until the writer thread has dealt with every queued sample
+static void wait_drained(struct storequeue *queue, struct storequeue_stats *stats)
+{
+  while (1)
+  {
+    storequeue_get_stats(queue, stats);
+    if (stats->num_stored + stats->num_backup + stats->num_logged >= stats->num_queued)
+      return;
+    usleep(1000);
+  }
+}
+
+static void report_queue(const char *name, struct storequeue_stats *stats, double elapsed_s)
+{
+  printf("%-24s %9lu samples  %8.3f s  %10.0f samples/s  max depth %5u  max insert %7.2f ms  backup %lu  log %lu\n", name, stats->num_stored, elapsed_s, stats->num_stored / elapsed_s, stats->max_depth, stats->max_insert_s*1000.0, stats->num_backup, stats->num_logged);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 4)
+  {
+    fprintf(stderr, "Usage: %s <host> <user> <database> [seconds] [rate_hz]\n", argv[0]);
+    return 1;
+  }
+  int num_sec = DEF_NUM_SEC, rate_hz = DEF_RATE_HZ;
+  if ((argc > 4) && ((sscanf(argv[4], "%d", &num_sec) != 1) || (num_sec <= 0)))
+  {
+    fprintf(stderr, "Invalid number of seconds specified (%s).\n", argv[4]);
+    return 1;
+  }
+  if ((argc > 5) && ((sscanf(argv[5], "%d", &rate_hz) != 1) || (rate_hz <= 0)))
+  {
+    fprintf(stderr, "Invalid sample rate specified (%s).\n", argv[5]);
+    return 1;
+  }
+
+  MYSQL *conn = mysql_init(NULL);
+  if (conn == NULL)
+  {
+    fprintf(stderr, "Error initialising MySQL connection handler.\n");
+    return 2;
+  }
+  if (mysql_real_connect(conn, argv[1], argv[2], NULL, argv[3], 0, NULL, 0) == NULL)
+  {
+    fprintf(stderr, "Error establishing connection to MySQL database - %s.\n", mysql_error(conn));
+    mysql_close(conn);
+    return 2;
+  }
+  // Not a temporary table, because the store queue uses its own connection
+  if (mysql_query(conn, "CREATE TABLE pmt_phot_raw (pmt_phot_id INT UNSIGNED NOT NULL AUTO_INCREMENT PRIMARY KEY, modnum INT NOT NULL, start_date DATE NOT NULL, start_time_h DOUBLE NOT NULL, integt_s DOUBLE NOT NULL, pmt_filt_id INT NOT NULL, pmt_aper_id INT NOT NULL, counts INT UNSIGNED NOT NULL, warn TINYINT NOT NULL, err TINYINT NOT NULL);"))
+  {
+    fprintf(stderr, "Failed to create scratch pmt_phot_raw table (it must not exist yet) - %s.\n", mysql_error(conn));
+    mysql_close(conn);
+    return 2;
+  }
+
+  srand(time(NULL));
+  struct sampring samples;
+  struct pmtintegstruct pmtinteg;
+  if (make_samples(&samples, &pmtinteg, rate_hz) < 0)
+  {
+    mysql_query(conn, "DROP TABLE pmt_phot_raw;");
+    mysql_close(conn);
+    return 2;
+  }
+  FILE *bak_fd = tmpfile();
+  int i, ret = 0;
+  unsigned long expected = 0, cursor;
+
+  double start_s = now_s();
+  for (i=0; i<num_sec; i++)
+    if (old_storeinteg(conn, &samples, &pmtinteg, rate_hz) != 0)
+      break;
+  double elapsed_s = now_s() - start_s;
+  printf("%-24s %9lu samples  %8.3f s  %10.0f samples/s\n", "sprintf + mysql_query", (unsigned long)i*rate_hz, elapsed_s, i*rate_hz / elapsed_s);
+  expected += (unsigned long)i*rate_hz;
+
+  struct storequeue_stats stats;
+  struct storequeue *queue = storequeue_new(argv[1], argv[2], argv[3], bak_fd);
+  if (queue == NULL)
+  {
+    ret = 3;
+    goto cleanup;
+  }
+  start_s = now_s();
+  for (i=0; i<num_sec; i++)
+  {
+    // Don't let the unpaced producer overflow the queue - the point is the writer's rate
+    storequeue_get_stats(queue, &stats);
+    while (stats.num_queued - stats.num_stored - stats.num_backup - stats.num_logged + rate_hz > STOREQUEUE_LEN)
+    {
+      usleep(1000);
+      storequeue_get_stats(queue, &stats);
+    }
+    cursor = samples.tail;
+    storequeue_append(queue, &samples, &cursor, &pmtinteg);
+  }
+  // Freeing the queue stores the last partial batch without waiting for STOREQUEUE_FLUSH_MS
+  storequeue_get_stats(queue, &stats);
+  storequeue_free(queue);
+  elapsed_s = now_s() - start_s;
+  stats.num_stored = count_rows(conn) - expected;
+  report_queue("store queue (unpaced)", &stats, elapsed_s);
+  expected += stats.num_stored;
+
+  queue = storequeue_new(argv[1], argv[2], argv[3], bak_fd);
+  if (queue == NULL)
+  {
+    ret = 3;
+    goto cleanup;
+  }
+  double max_append_s = 0.0;
+  start_s = now_s();
+  for (i=0; i<num_sec; i++)
+  {
+    double append_s = now_s();
+    cursor = samples.tail;
+    storequeue_append(queue, &samples, &cursor, &pmtinteg);
+    append_s = now_s() - append_s;
+    if (append_s > max_append_s)
+      max_append_s = append_s;
+    double next_s = start_s + i + 1 - now_s();
+    if (next_s > 0.0)
+      usleep(next_s * 1e6);
+  }
+  wait_drained(queue, &stats);
+  elapsed_s = now_s() - start_s;
+  storequeue_free(queue);
+  report_queue("store queue (paced)", &stats, elapsed_s);
+  printf("Longest append call while paced: %.3f ms\n", max_append_s*1000.0);
+  expected += stats.num_stored;
+  if ((stats.num_stored != (unsigned long)num_sec*rate_hz) || (stats.num_backup != 0) || (stats.num_logged != 0))
+  {
+    printf("Paced store queue did not keep up (%lu of %lu samples stored).\n", stats.num_stored, (unsigned long)num_sec*rate_hz);
+    ret = 4;
+  }
+  if (count_rows(conn) != expected)
+  {
+    printf("pmt_phot_raw contains %lu rows, %lu expected.\n", count_rows(conn), expected);
+    ret = 4;
+  }
+
+cleanup:
+  if (mysql_query(conn, "DROP TABLE pmt_phot_raw;"))
+    fprintf(stderr, "Failed to drop scratch pmt_phot_raw table - %s.\n", mysql_error(conn));
+  mysql_close(conn);
+  fclose(bak_fd);
+  sampring_free(&samples);
+  return ret;
+}
@@ -0,0 +1,440 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra -O2 -I../ -I../../../libs/ -I../../../drivers/pmt_driver/ ./ttag_bench.c ../pmtphot_ring.c
+ * ../pmtphot_ttag.c ../../../libs/act_log.c -lpthread -lm -o ./ttag_bench
+ *
+ * Tests and benchmarks PMT time-tag mode (pmtphot_ring and pmtphot_ttag) without a time-tagging front end or the PMT
+ * driver. A generator thread stands in for both: it produces photons with Poisson statistics (exponentially
+ * distributed intervals) and fills an anonymous shared mapping laid out like the driver's time tag ring exactly the
+ * way pmt_ttag_add in pmt_driver.c does, advancing the run's progress every millisecond like check_ttag. The driver's
+ * poll() is emulated with an eventfd. The reader does what act_pmtphot does for a time-tag run: it bins the time tags
+ * into bin_us bins and writes them all to a raw file (a temporary file). Like act_pmtphot's sample ring, the reader
+ * takes at most SAMPRING_LEN bins per wake-up; once it has that many it stops and leaves the rest of the time tags in
+ * the ring until the next wake-up.
+ *  - Binner: a few hand-placed time tags, including empty bins, time tags outside the binned interval and a run
+ *    cancelled part of the way through a bin, then the same time tags with room for only one bin per call.
+ *  - Real time: for photon rates from 10 kHz to 4 MHz the generator runs paced (one millisecond of photons per
+ *    millisecond) for the given number of seconds and the reader only wakes up when the ring is half full or once a
+ *    second. No time tag may be lost, every bin must be reported, the bins must add up to the number of photons, the
+ *    raw file must hold every time tag, and the bins' mean and variance must match Poisson statistics. This is done
+ *    with bin_us bins and again with SHORT_BIN_US bins, close to the shortest act_pmtphot accepts (TTAG_MIN_BIN_NS).
+ *  - Throughput: the generator runs unpaced (waiting instead of discarding when the ring is full) to find the rate
+ *    the reader can sustain.
+ * Prints PASSED or FAILED.
+ *   ./ttag_bench [seconds] [bin_us]
+ * (defaults 5 s and 100 us).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "pmtphot_ring.h"
+#include "pmtphot_ttag.h"
+#include "pmtphot_samples.h"
+
+#define DEF_NUM_SEC      5
+#define DEF_BIN_US       100
+/// The unpaced run lasts one (simulated) second at this photon rate
+#define THROUGHPUT_HZ    50000000.0
+/// Sub-10 us bins, so that almost a sample ring's worth of bins is completed between the reader's once-a-second checks
+#define SHORT_BIN_US     8
+
+static const double G_rates_hz[] = { 10000.0, 100000.0, 1000000.0, 4000000.0 };
+
+/// Stand-in for the time-tagging front end and the PMT driver's side of the time tag ring
+struct sim_driver
+{
+  void *mem;
+  struct pmt_ring_hdr *hdr;
+  struct pmt_ttag_data *ttags;
+  int efd;
+  unsigned long thresh;
+  /// Generator settings
+  double rate_hz;
+  unsigned long duration_ms;
+  char paced;
+  /// Number of photons generated within the run (the generator stops at the end of the run)
+  unsigned long num_photons;
+  unsigned long max_unread;
+  unsigned long long rng;
+};
+
+static unsigned long long now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/// Uniform deviate in (0,1] (xorshift64*)
+static double sim_uniform(struct sim_driver *drv)
+{
+  drv->rng ^= drv->rng >> 12;
+  drv->rng ^= drv->rng << 25;
+  drv->rng ^= drv->rng >> 27;
+  return ((drv->rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0) + (1.0 / 9007199254740992.0);
+}
+
+static void sim_wake(struct sim_driver *drv)
+{
+  unsigned long long one = 1;
+  if (write(drv->efd, &one, sizeof(one)) != sizeof(one))
+    fprintf(stderr, "Failed to signal reader - %s\n", strerror(errno));
+}
+
+/// Same as pmt_ttag_add in pmt_driver.c, with the kernel barriers replaced by the equivalent atomics
+static void sim_ttag_add(struct sim_driver *drv, unsigned long time_s, unsigned long time_ns)
+{
+  __u32 prod_idx = drv->hdr->prod_idx;
+  __u32 cons_idx = __atomic_load_n(&drv->hdr->cons_idx, __ATOMIC_ACQUIRE);
+  if ((__u32)(prod_idx - cons_idx) >= PMT_TTAG_RING_LEN)
+  {
+    __atomic_store_n(&drv->hdr->num_lost, drv->hdr->num_lost + 1, __ATOMIC_RELAXED);
+    return;
+  }
+  drv->ttags[prod_idx % PMT_TTAG_RING_LEN].time_s = time_s;
+  drv->ttags[prod_idx % PMT_TTAG_RING_LEN].time_ns = time_ns;
+  __atomic_store_n(&drv->hdr->prod_idx, prod_idx + 1, __ATOMIC_RELEASE);
+  if ((__u32)(prod_idx + 1 - cons_idx) > drv->max_unread)
+    drv->max_unread = (__u32)(prod_idx + 1 - cons_idx);
+  if ((__u32)(prod_idx + 1 - cons_idx) == drv->thresh)
+    sim_wake(drv);
+}
+
+/// Generates a run of duration_ms milliseconds, like the front end and check_ttag in pmt_driver.c
+static void *generator_thread(void *arg)
+{
+  struct sim_driver *drv = (struct sim_driver *)arg;
+  struct pmt_ring_hdr *hdr = drv->hdr;
+  unsigned long long run_start_ns = hdr->run_start_s * 1000000000ULL + hdr->run_start_ns, ttag_ns;
+  double mean_interval_ns = 1.0e9 / drv->rate_hz;
+  double next_ns = -log(sim_uniform(drv)) * mean_interval_ns;
+  unsigned long ms;
+  unsigned long long start = now_ns();
+  for (ms=1; ms<=drv->duration_ms; ms++)
+  {
+    while (next_ns < ms * 1000000.0)
+    {
+      ttag_ns = run_start_ns + (unsigned long long)next_ns;
+      if (!drv->paced)
+        while ((__u32)(hdr->prod_idx - __atomic_load_n(&hdr->cons_idx, __ATOMIC_ACQUIRE)) >= PMT_TTAG_RING_LEN)
+          sched_yield();
+      sim_ttag_add(drv, ttag_ns / 1000000000ULL, ttag_ns % 1000000000ULL);
+      drv->num_photons++;
+      next_ns += -log(sim_uniform(drv)) * mean_interval_ns;
+    }
+    if (drv->paced)
+    {
+      unsigned long long due = start + ms * 1000000ULL;
+      struct timespec ts = { .tv_sec = due / 1000000000ULL, .tv_nsec = due % 1000000000ULL };
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+    // check_ttag allows the front end a millisecond to report photons; the generator reports them straight away
+    __atomic_store_n(&hdr->run_elapsed_ms, ms, __ATOMIC_RELEASE);
+    if ((__u32)(hdr->prod_idx - __atomic_load_n(&hdr->cons_idx, __ATOMIC_ACQUIRE)) >= drv->thresh)
+      sim_wake(drv);
+  }
+  __atomic_store_n(&hdr->run_ended, 1, __ATOMIC_RELEASE);
+  sim_wake(drv);
+  return NULL;
+}
+
+static int sim_init(struct sim_driver *drv, unsigned long thresh)
+{
+  memset(drv, 0, sizeof(struct sim_driver));
+  drv->mem = mmap(NULL, PMT_TTAG_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (drv->mem == MAP_FAILED)
+    return -1;
+  drv->hdr = (struct pmt_ring_hdr *)drv->mem;
+  drv->ttags = (struct pmt_ttag_data *)((char *)drv->mem + PMT_RING_HDR_SIZE);
+  drv->efd = eventfd(0, 0);
+  if (drv->efd < 0)
+  {
+    munmap(drv->mem, PMT_TTAG_RING_SIZE);
+    return -1;
+  }
+  drv->thresh = thresh;
+  drv->rng = 0x9E3779B97F4A7C15ULL ^ now_ns();
+  // Like start_integ: the run starts on a millisecond boundary
+  drv->hdr->run_start_s = time(NULL);
+  drv->hdr->run_start_ns = 0;
+  drv->hdr->run_num = 1;
+  return 0;
+}
+
+static void sim_free(struct sim_driver *drv)
+{
+  close(drv->efd);
+  munmap(drv->mem, PMT_TTAG_RING_SIZE);
+}
+
+/// Bins reported by the binner
+struct bin_record
+{
+  unsigned long num_bins, counts_sum;
+  unsigned long long expect_start_ns, bin_ns;
+  unsigned long *counts;
+  unsigned long long *periods;
+  unsigned long max_bins;
+  /// Bins taken since the last wake-up and the most that may be (0 for no limit), number of wake-ups cut short
+  unsigned long pass_bins, pass_space, num_deferred;
+  char failed;
+};
+
+static int record_bin(void *user_data, struct pmt_integ_data *bin)
+{
+  struct bin_record *rec = (struct bin_record *)user_data;
+  unsigned long long start_ns = bin->start_time_s * 1000000000ULL + bin->start_time_ns;
+  if ((rec->pass_space > 0) && (rec->pass_bins >= rec->pass_space))
+    return -1;
+  rec->pass_bins++;
+  if ((start_ns != rec->expect_start_ns) || (bin->repetitions != rec->num_bins + 1) || (bin->prebin_num != 1) || (rec->num_bins >= rec->max_bins))
+  {
+    rec->failed = 1;
+    return 0;
+  }
+  rec->counts[rec->num_bins] = bin->counts;
+  if (rec->periods != NULL)
+    rec->periods[rec->num_bins] = bin->sample_period_ns;
+  rec->counts_sum += bin->counts;
+  rec->num_bins++;
+  rec->expect_start_ns += rec->bin_ns;
+  return 0;
+}
+
+static int test_binner(void)
+{
+  // Four bins of 250 us from t0 = 1000 s
+  unsigned long counts[4];
+  unsigned long long periods[4];
+  struct bin_record rec = { .expect_start_ns = 1000000000000ULL, .bin_ns = 250000, .counts = counts, .periods = periods, .max_bins = 4 };
+  struct pmt_ttag_data ttags[] = { {999, 999999999}, {1000, 0}, {1000, 249999}, {1000, 250000}, {1000, 520000}, {1000, 540000}, {1000, 760000}, {1000, 1000000} };
+  struct ttagbin bin;
+  FILE *raw_fd = tmpfile();
+  int failed = ttagbin_start(&bin, 1000, 0, 250000, 4, raw_fd) != 0;
+  // The first two time tags complete nothing; the fourth completes the first bin
+  ttagbin_add(&bin, ttags, 3, record_bin, &rec);
+  failed |= rec.num_bins != 0;
+  ttagbin_add(&bin, &ttags[3], 1, record_bin, &rec);
+  failed |= (rec.num_bins != 1) || (counts[0] != 2);
+  // Progress alone completes the (all but empty) second bin
+  ttagbin_advance(&bin, 0, record_bin, &rec);
+  failed |= rec.num_bins != 1;
+  ttagbin_add(&bin, &ttags[4], 2, record_bin, &rec);
+  ttagbin_advance(&bin, 0, record_bin, &rec);
+  failed |= rec.num_bins != 2;
+  // A time tag after the last bin completes it, but isn't counted
+  ttagbin_add(&bin, &ttags[6], 2, record_bin, &rec);
+  failed |= rec.num_bins != 4;
+  ttagbin_finish(&bin, 1, record_bin, &rec);
+  failed |= (rec.num_bins != 4) || (counts[1] != 1) || (counts[2] != 2) || (counts[3] != 1) || (periods[3] != 250000);
+  failed |= (bin.num_ttags != 8) || (bin.num_outside != 2) || rec.failed;
+  // The raw file holds every time tag, including those outside the bins
+  unsigned long long raw[9];
+  rewind(raw_fd);
+  failed |= (fread(raw, sizeof(unsigned long long), 9, raw_fd) != 8) || (raw[0] != 999999999999ULL) || (raw[7] != 1000001000000ULL);
+  fclose(raw_fd);
+
+  // A cancelled run completes the partial bin with a shorter sample period
+  memset(&rec, 0, sizeof(rec));
+  rec.expect_start_ns = 1000000000000ULL;
+  rec.bin_ns = 2500000;
+  rec.counts = counts;
+  rec.periods = periods;
+  rec.max_bins = 4;
+  failed |= ttagbin_start(&bin, 1000, 0, 2500000, 4, NULL) != 0;
+  ttagbin_finish(&bin, 6, record_bin, &rec);
+  failed |= (rec.num_bins != 3) || (periods[1] != 2500000) || (periods[2] != 1000000) || rec.failed;
+
+  // With room for one bin per call, the binner stops at the time tag that completes a second bin and takes it (and
+  // the ones after it) on a later call, ending up with the same bins
+  memset(&rec, 0, sizeof(rec));
+  rec.expect_start_ns = 1000000000000ULL;
+  rec.bin_ns = 250000;
+  rec.counts = counts;
+  rec.periods = periods;
+  rec.max_bins = 4;
+  rec.pass_space = 1;
+  unsigned long num_added = 0, num_calls = 0;
+  failed |= ttagbin_start(&bin, 1000, 0, 250000, 4, NULL) != 0;
+  while ((num_added < 8) && (num_calls < 20))
+  {
+    rec.pass_bins = 0;
+    num_added += ttagbin_add(&bin, &ttags[num_added], 8 - num_added, record_bin, &rec);
+    num_calls++;
+  }
+  // Only the first bin fits in the first call, which stops at the fifth time tag (completing the second bin)
+  failed |= (num_added != 8) || (num_calls != 4) || (rec.num_bins != 4);
+  rec.pass_bins = 1;
+  failed |= ttagbin_finish(&bin, 1, record_bin, &rec) != 0;
+  failed |= (counts[0] != 2) || (counts[1] != 1) || (counts[2] != 2) || (counts[3] != 1) || (bin.num_ttags != 8) || (bin.num_outside != 2) || rec.failed;
+  // A refused bin leaves a cancelled run unfinished until there is room
+  memset(&rec, 0, sizeof(rec));
+  rec.expect_start_ns = 1000000000000ULL;
+  rec.bin_ns = 2500000;
+  rec.counts = counts;
+  rec.periods = periods;
+  rec.max_bins = 4;
+  rec.pass_space = 2;
+  failed |= ttagbin_start(&bin, 1000, 0, 2500000, 4, NULL) != 0;
+  failed |= (ttagbin_finish(&bin, 6, record_bin, &rec) != -1) || (rec.num_bins != 2);
+  rec.pass_bins = 0;
+  failed |= (ttagbin_finish(&bin, 6, record_bin, &rec) != 0) || (rec.num_bins != 3) || (periods[2] != 1000000) || rec.failed;
+  printf("Binner: %s\n", failed ? "FAILED" : "OK");
+  return failed;
+}
+
+/// Reads the run the way act_pmtphot's ttag_get_data does, waking up like its poll() watch and 1 s timer
+static int read_run(struct sim_driver *drv, struct pmtring *ring, struct ttagbin *bin, struct bin_record *rec, unsigned long *num_wakes)
+{
+  struct pmt_ttag_data *ttags;
+  struct pollfd pfd = { .fd = drv->efd, .events = POLLIN };
+  unsigned long long val;
+  unsigned long num, num_added, elapsed_ms;
+  char ended = 0, finished = 0, stopped;
+  while (!finished)
+  {
+    if (poll(&pfd, 1, 1000) > 0)
+    {
+      if (read(drv->efd, &val, sizeof(val)) != sizeof(val))
+        fprintf(stderr, "Failed to read wake-up - %s\n", strerror(errno));
+    }
+    (*num_wakes)++;
+    // The sample ring is emptied after every check
+    rec->pass_bins = 0;
+    stopped = 0;
+    ended = __atomic_load_n(&ring->hdr->run_ended, __ATOMIC_ACQUIRE);
+    elapsed_ms = __atomic_load_n(&ring->hdr->run_elapsed_ms, __ATOMIC_ACQUIRE);
+    while ((!stopped) && ((num = pmtring_peek_ttag(ring, &ttags)) > 0))
+    {
+      num_added = ttagbin_add(bin, ttags, num, record_bin, rec);
+      pmtring_release(ring, num_added);
+      stopped = num_added < num;
+    }
+    if (!stopped)
+      stopped = (ended ? ttagbin_finish(bin, elapsed_ms, record_bin, rec) : ttagbin_advance(bin, elapsed_ms, record_bin, rec)) < 0;
+    if (stopped)
+      rec->num_deferred++;
+    else
+      finished = ended;
+  }
+  return rec->failed;
+}
+
+static int test_realtime(double rate_hz, int num_sec, unsigned long bin_us)
+{
+  struct sim_driver drv;
+  struct pmtring ring;
+  struct ttagbin bin;
+  pthread_t thr;
+  unsigned long i, num_wakes = 0, num_bins = num_sec * 1000000UL / bin_us;
+  int failed = 0;
+  struct bin_record rec = { .bin_ns = bin_us * 1000ULL, .max_bins = num_bins, .pass_space = SAMPRING_LEN };
+  rec.counts = malloc(num_bins * sizeof(unsigned long));
+  FILE *raw_fd = tmpfile();
+  if ((rec.counts == NULL) || (raw_fd == NULL) || (sim_init(&drv, PMTRING_TTAG_WAKE_NUM) != 0))
+  {
+    free(rec.counts);
+    return 1;
+  }
+  pmtring_attach_ttag(&ring, drv.mem);
+  drv.rate_hz = rate_hz;
+  drv.duration_ms = num_sec * 1000UL;
+  drv.paced = 1;
+  rec.expect_start_ns = drv.hdr->run_start_s * 1000000000ULL;
+  failed |= ttagbin_start(&bin, drv.hdr->run_start_s, drv.hdr->run_start_ns, bin_us * 1000ULL, num_bins, raw_fd) != 0;
+  unsigned long long start = now_ns();
+  pthread_create(&thr, NULL, generator_thread, &drv);
+  failed |= read_run(&drv, &ring, &bin, &rec, &num_wakes);
+  double elapsed_s = (now_ns() - start) / 1.0e9;
+  pthread_join(thr, NULL);
+
+  unsigned long num_lost = pmtring_num_lost(&ring);
+  long raw_size = ftell(raw_fd);
+  failed |= (num_lost != 0) || (rec.num_bins != num_bins) || (rec.counts_sum != drv.num_photons) || (bin.num_ttags != drv.num_photons) || (bin.num_outside != 0);
+  failed |= raw_size != (long)(drv.num_photons * sizeof(unsigned long long));
+  // Poisson statistics: the mean within 5 standard errors and the variance/mean ratio within 5 % of 1
+  double mean = 0.0, var = 0.0, expected = rate_hz * bin_us / 1.0e6;
+  for (i=0; i<rec.num_bins; i++)
+    mean += rec.counts[i];
+  mean /= rec.num_bins > 0 ? rec.num_bins : 1;
+  for (i=0; i<rec.num_bins; i++)
+    var += (rec.counts[i] - mean) * (rec.counts[i] - mean);
+  var /= rec.num_bins > 1 ? rec.num_bins - 1 : 1;
+  failed |= fabs(mean - expected) > 5.0 * sqrt(expected / num_bins);
+  failed |= fabs(var / mean - 1.0) > 0.05;
+  printf("%8.0f Hz, %3lu us bins:  %9lu photons  %7lu bins  lost %lu  wake-ups %lu (%lu cut short)  ring max %4.1f %%  mean %.3f (%.3f)  var/mean %.4f  %.2f s  %s\n", rate_hz, bin_us, drv.num_photons, rec.num_bins, num_lost, num_wakes, rec.num_deferred, 100.0 * drv.max_unread / PMT_TTAG_RING_LEN, mean, expected, var / mean, elapsed_s, failed ? "FAILED" : "OK");
+  fclose(raw_fd);
+  free(rec.counts);
+  sim_free(&drv);
+  return failed;
+}
+
+static int test_throughput(unsigned long bin_us)
+{
+  struct sim_driver drv;
+  struct pmtring ring;
+  struct ttagbin bin;
+  pthread_t thr;
+  unsigned long num_wakes = 0;
+  int failed = 0;
+  unsigned long duration_ms = 1000, num_bins = duration_ms * 1000UL / bin_us;
+  struct bin_record rec = { .bin_ns = bin_us * 1000ULL, .max_bins = num_bins, .pass_space = SAMPRING_LEN };
+  rec.counts = malloc(num_bins * sizeof(unsigned long));
+  FILE *raw_fd = tmpfile();
+  if ((rec.counts == NULL) || (raw_fd == NULL) || (sim_init(&drv, PMTRING_TTAG_WAKE_NUM) != 0))
+  {
+    free(rec.counts);
+    return 1;
+  }
+  pmtring_attach_ttag(&ring, drv.mem);
+  drv.rate_hz = THROUGHPUT_HZ;
+  drv.duration_ms = duration_ms;
+  rec.expect_start_ns = drv.hdr->run_start_s * 1000000000ULL;
+  failed |= ttagbin_start(&bin, drv.hdr->run_start_s, drv.hdr->run_start_ns, bin_us * 1000ULL, num_bins, raw_fd) != 0;
+  unsigned long long start = now_ns();
+  pthread_create(&thr, NULL, generator_thread, &drv);
+  failed |= read_run(&drv, &ring, &bin, &rec, &num_wakes);
+  double elapsed_s = (now_ns() - start) / 1.0e9;
+  pthread_join(thr, NULL);
+  failed |= (pmtring_num_lost(&ring) != 0) || (rec.num_bins != num_bins) || (rec.counts_sum != drv.num_photons);
+  failed |= ftell(raw_fd) != (long)(drv.num_photons * sizeof(unsigned long long));
+  printf("Unpaced:               %9lu photons  %7lu bins  wake-ups %lu  %.3f s  %11.0f photons/s  %s\n", drv.num_photons, rec.num_bins, num_wakes, elapsed_s, drv.num_photons / elapsed_s, failed ? "FAILED" : "OK");
+  fclose(raw_fd);
+  free(rec.counts);
+  sim_free(&drv);
+  return failed;
+}
+
+int main(int argc, char **argv)
+{
+  int num_sec = DEF_NUM_SEC;
+  unsigned long bin_us = DEF_BIN_US, i;
+  if ((argc > 1) && ((sscanf(argv[1], "%d", &num_sec) != 1) || (num_sec <= 0)))
+  {
+    fprintf(stderr, "Invalid number of seconds specified (%s).\n", argv[1]);
+    return 1;
+  }
+  if ((argc > 2) && ((sscanf(argv[2], "%lu", &bin_us) != 1) || (bin_us < 1) || (1000000UL % bin_us != 0)))
+  {
+    fprintf(stderr, "Invalid bin width specified (%s) - must divide 1 s.\n", argv[2]);
+    return 1;
+  }
+
+  int failed = test_binner();
+  for (i=0; i<sizeof(G_rates_hz)/sizeof(G_rates_hz[0]); i++)
+    failed |= test_realtime(G_rates_hz[i], num_sec, bin_us);
+  for (i=0; i<sizeof(G_rates_hz)/sizeof(G_rates_hz[0]); i++)
+    failed |= test_realtime(G_rates_hz[i], num_sec, SHORT_BIN_US);
+  failed |= test_throughput(bin_us);
+  printf("%s\n", failed ? "FAILED" : "PASSED");
+  return failed;
+}
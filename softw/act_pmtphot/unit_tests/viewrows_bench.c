@@ -0,0 +1,248 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra -O2 -I../ -I../../../libs/ ./viewrows_bench.c ../pmtphot_viewrows.c ../../../libs/act_positastro.c
+ * ../../../libs/act_timecoord.c ../../../libs/act_log.c -lpthread -lm -o ./viewrows_bench
+ *
+ * Benchmarks the lines of the photometry view (pmtphot_viewrows) over one night of PMT samples, fed in batches as
+ * act_pmtphot reads them (check_ms worth of samples per check), once for each number of samples per line. After every
+ * check the visible page of lines is formatted, as the tree view does when it redraws. Reports the per-sample and
+ * slowest-check times and verifies that the number of lines kept stays bounded, that the last complete line holds the
+ * right start time, minimum, maximum and mean counts and that its text is produced. Also checks inserting comments
+ * before the current line, dropping the oldest lines once the ring is full and labels that have been overwritten.
+ * Prints PASSED or FAILED.
+ *   ./viewrows_bench [hours] [rate_hz] [check_ms]
+ * (defaults 12 h, 1000 Hz and 1000 ms, i.e. 43.2 million samples).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <act_timecoord.h>
+#include "pmtphot_viewrows.h"
+
+#define DEF_NUM_HOURS   12
+#define DEF_RATE_HZ     1000
+#define DEF_CHECK_MS    1000
+/// Lines visible in the view
+#define PAGE_ROWS       40
+
+static double diff_s(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/// Counts of sample n - a ramp with a period that isn't a multiple of any decimation, so the line statistics differ
+static unsigned long sample_counts(unsigned long n)
+{
+  return 1000 + (n * 7) % 997;
+}
+
+static void sample_time(unsigned long n, int rate_hz, struct timestruct *unitime)
+{
+  unsigned long msec = (n * 1000 / rate_hz) % (24*3600*1000UL);
+  unitime->hours = msec / 3600000;
+  unitime->minutes = (msec / 60000) % 60;
+  unitime->seconds = (msec / 1000) % 60;
+  unitime->milliseconds = msec % 1000;
+}
+
+static int run_decim(unsigned long num_samples, int rate_hz, int check_ms, unsigned long decim)
+{
+  struct viewrows rows;
+  if (viewrows_init(&rows) < 0)
+  {
+    printf("Could not allocate view rows.\n");
+    return -1;
+  }
+  viewrows_append(&rows, LINETYPE_COMMENT, viewrows_add_label(&rows, "ACT Photometry"));
+  viewrows_append(&rows, LINETYPE_INTEG, viewrows_add_label(&rows, "    U   ap1   "));
+
+  unsigned long batch = (unsigned long)rate_hz * check_ms / 1000, n = 0, i, max_rows = 0;
+  if (batch == 0)
+    batch = 1;
+  double integt_s = 1.0 / rate_hz, total_s = 0.0, slowest_s = 0.0, sum_len = 0.0;
+  struct timestruct unitime;
+  char line[VIEWROWS_LINE_SIZE];
+  struct timespec start, end;
+  while (n < num_samples)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i=0; (i<batch) && (n<num_samples); i++, n++)
+    {
+      sample_time(n, rate_hz, &unitime);
+      if (viewrows_add_sample(&rows, &unitime, integt_s, sample_counts(n), 0, 0, decim))
+        viewrows_append(&rows, LINETYPE_INTEG, viewrows_last(&rows)->label);
+    }
+    for (i=rows.head > PAGE_ROWS ? rows.head - PAGE_ROWS : 0; i<rows.head; i++)
+    {
+      int len = viewrows_format(&rows, i, line, sizeof(line));
+      if (len > 0)
+        sum_len += len;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double check_s = diff_s(&start, &end);
+    total_s += check_s;
+    if (check_s > slowest_s)
+      slowest_s = check_s;
+    if (viewrows_num(&rows) > max_rows)
+      max_rows = viewrows_num(&rows);
+  }
+
+  int ret = 0;
+  if (max_rows > VIEWROWS_LEN)
+  {
+    printf("  %lu lines kept, more than the %d allowed.\n", max_rows, VIEWROWS_LEN);
+    ret = -1;
+  }
+  unsigned long expect_rows = 2 + num_samples / decim;
+  if ((rows.head != expect_rows) || (viewrows_num(&rows) != (expect_rows < VIEWROWS_LEN ? expect_rows : VIEWROWS_LEN)))
+  {
+    printf("  %lu lines produced (%lu kept), expected %lu.\n", rows.head, viewrows_num(&rows), expect_rows);
+    ret = -1;
+  }
+
+  // The last complete line holds samples first..first+decim-1
+  unsigned long first = (num_samples / decim - 1) * decim, min = -1UL, max = 0;
+  double sum = 0.0;
+  for (i=first; i<first+decim; i++)
+  {
+    unsigned long counts = sample_counts(i);
+    if (counts < min)
+      min = counts;
+    if (counts > max)
+      max = counts;
+    sum += counts;
+  }
+  sample_time(first, rate_hz, &unitime);
+  struct viewrow *row = viewrows_get(&rows, rows.head - 2);
+  if ((row == NULL) || (row->num_samples != decim) || (row->counts_min != min) || (row->counts_max != max) || (row->counts_sum != sum) || (memcmp(&row->start_unitime, &unitime, sizeof(struct timestruct)) != 0))
+  {
+    printf("  Last complete line does not hold the right samples.\n");
+    ret = -1;
+  }
+  else if (viewrows_format(&rows, rows.head - 2, line, sizeof(line)) <= 0)
+  {
+    printf("  Could not format last complete line.\n");
+    ret = -1;
+  }
+  else
+    printf("  Last line: %s\n", line);
+
+  printf("%6lu samples/line: %10lu lines, %5lu kept, %7.1f ns/sample, slowest check %8.3f ms, %.0f chars formatted - %s\n", decim, rows.head, viewrows_num(&rows), total_s * 1e9 / num_samples, slowest_s * 1e3, sum_len, ret == 0 ? "OK" : "FAILED");
+  viewrows_free(&rows);
+  return ret;
+}
+
+static int test_comments(void)
+{
+  struct viewrows rows;
+  if (viewrows_init(&rows) < 0)
+  {
+    printf("Could not allocate view rows.\n");
+    return -1;
+  }
+  int ret = 0;
+  struct timestruct unitime = { .hours = 1, .minutes = 2, .seconds = 3, .milliseconds = 4 };
+  char line[VIEWROWS_LINE_SIZE];
+
+  // A comment goes in before the current line, which keeps its samples
+  viewrows_append(&rows, LINETYPE_INTEG, viewrows_add_label(&rows, "    V   ap2   "));
+  viewrows_add_sample(&rows, &unitime, 1.0, 10, 0, 0, 3);
+  viewrows_add_sample(&rows, &unitime, 1.0, 30, 0, 0, 3);
+  viewrows_insert_before_last(&rows, LINETYPE_COMMENT, viewrows_add_label(&rows, "High count rate"), 1, 0);
+  struct viewrow *row = viewrows_get(&rows, 0);
+  if ((viewrows_num(&rows) != 2) || (row->linetype != LINETYPE_COMMENT) || (!row->warn) || (viewrows_format(&rows, 0, line, sizeof(line)) <= 0) || (strcmp(line, "High count rate") != 0))
+  {
+    printf("Comment not inserted before the current line.\n");
+    ret = -1;
+  }
+  row = viewrows_last(&rows);
+  if ((row->linetype != LINETYPE_INTEG) || (row->num_samples != 2) || (row->counts_min != 10) || (row->counts_max != 30))
+  {
+    printf("Current line lost its samples when a comment was inserted.\n");
+    ret = -1;
+  }
+  if ((!viewrows_add_sample(&rows, &unitime, 1.0, 20, 0, 1, 3)) || (!row->err) || (row->counts_sum != 60.0))
+  {
+    printf("Current line not completed after a comment was inserted.\n");
+    ret = -1;
+  }
+  viewrows_format(&rows, 1, line, sizeof(line));
+  printf("  Line after comment: %s\n", line);
+
+  // Once the ring is full, the oldest line goes
+  unsigned long i;
+  for (i=viewrows_num(&rows); i<VIEWROWS_LEN; i++)
+    viewrows_append(&rows, LINETYPE_IDLE, 0);
+  if (viewrows_append(&rows, LINETYPE_IDLE, 0) != 1)
+  {
+    printf("Oldest line not dropped from full ring.\n");
+    ret = -1;
+  }
+  if ((viewrows_num(&rows) != VIEWROWS_LEN) || (viewrows_get(&rows, 0) != NULL) || (viewrows_get(&rows, 1) == NULL) || (viewrows_format(&rows, 0, line, sizeof(line)) != -1))
+  {
+    printf("Wrong lines kept in full ring.\n");
+    ret = -1;
+  }
+  if ((viewrows_insert_before_last(&rows, LINETYPE_COMMENT, viewrows_add_label(&rows, "OVERFLOW"), 0, 1) != 1) || (viewrows_get(&rows, 1) != NULL) || (viewrows_last(&rows)->linetype != LINETYPE_IDLE))
+  {
+    printf("Comment not inserted correctly in full ring.\n");
+    ret = -1;
+  }
+
+  // Labels that have since been overwritten come back empty
+  unsigned long label = viewrows_add_label(&rows, "target");
+  for (i=0; i<VIEWROWS_LABEL_LEN-1; i++)
+    viewrows_add_label(&rows, "other");
+  if (strcmp(viewrows_get_label(&rows, label), "target") != 0)
+  {
+    printf("Label lost before it was overwritten.\n");
+    ret = -1;
+  }
+  viewrows_add_label(&rows, "other");
+  if (strcmp(viewrows_get_label(&rows, label), "") != 0)
+  {
+    printf("Overwritten label not cleared.\n");
+    ret = -1;
+  }
+
+  printf("Comments, full ring and labels: %s\n", ret == 0 ? "OK" : "FAILED");
+  viewrows_free(&rows);
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  int num_hours = DEF_NUM_HOURS, rate_hz = DEF_RATE_HZ, check_ms = DEF_CHECK_MS;
+  if ((argc > 1) && ((sscanf(argv[1], "%d", &num_hours) != 1) || (num_hours <= 0)))
+  {
+    printf("Invalid number of hours: %s\n", argv[1]);
+    return 1;
+  }
+  if ((argc > 2) && ((sscanf(argv[2], "%d", &rate_hz) != 1) || (rate_hz <= 0)))
+  {
+    printf("Invalid sample rate: %s\n", argv[2]);
+    return 1;
+  }
+  if ((argc > 3) && ((sscanf(argv[3], "%d", &check_ms) != 1) || (check_ms <= 0)))
+  {
+    printf("Invalid check interval: %s\n", argv[3]);
+    return 1;
+  }
+  unsigned long num_samples = (unsigned long)num_hours * 3600 * rate_hz;
+  printf("%lu samples (%d h at %d Hz), checked every %d ms, %d lines visible\n", num_samples, num_hours, rate_hz, check_ms, PAGE_ROWS);
+
+  int ret = 0;
+  unsigned long decim;
+  for (decim=1; decim<=1000; decim*=10)
+  {
+    if (num_samples / decim < 1)
+      break;
+    if (run_decim(num_samples, rate_hz, check_ms, decim) < 0)
+      ret = 1;
+  }
+  if (test_comments() < 0)
+    ret = 1;
+  printf("%s\n", ret == 0 ? "PASSED" : "FAILED");
+  return ret;
+}
@@ -8,13 +8,22 @@
 #include <act_log.h>
 #include <act_ipc.h>
 #include <act_positastro.h>
+#include <act_site.h>
+#include "sched_plan.h"
+#include "sched_prefetch.h"
 
 #define GUICHECK_TIMEOUT_PERIOD    3
 #define OBSN_WAIT_TIMEOUT          60
 #define SCHED_IDLE_TIMEOUT         10
+/// Minimum time between reloads of the observing queue while nothing can be observed (seconds)
+#define SCHED_RELOAD_PERIOD        600
+/// Maximum rate at which telescope coordinates are needed (per second) - only used to estimate slew times
+#define SCHED_COORD_MAX_RATE       0.2
+/// Estimated CCD readout time (seconds), added to each CCD exposure when estimating the duration of a block
+#define SCHED_CCD_READOUT_S        5.0
 
-/// Converts time in seconds since the UNIX epoch to fractional number of years (for coordinates epoch)
-#define SEC_TO_YEAR(sec)   (1970 + sec/(float)31556926)
+/// Converts time in seconds since the UNIX epoch to Julian date
+#define SEC_TO_JD(sec)     (2440587.5 + sec/86400.0)
 
 struct formobjects
 {
@@ -24,6 +33,18 @@ struct formobjects
   struct act_msg *cur_msg;
   gulong cur_obsnid, cur_blockid;
   guchar cur_block_stat;
+  struct sched_plan *plan;
+  time_t plan_load_time;
+  struct act_msg_targcap targcap;
+  double tel_ha_h, tel_dec_d;
+  struct sched_prefetch *prefetch;
+  //! Message type of the current (or last) observation
+  int cur_obsntype;
+  //! Time at which the last observation ended (CLOCK_MONOTONIC), for the turnaround statistics
+  struct timespec obsn_end_time;
+  char obsn_ended;
+  unsigned long num_turnarounds;
+  double turnaround_sum_ms, turnaround_max_ms;
 };
 
 GIOChannel *setup_net(const char* host, const char* port);
@@ -34,16 +55,16 @@ void destroy_plug(GtkWidget *plug, gpointer user_data);
 void request_guisock(GIOChannel *channel);
 void cancel_cur(gpointer user_data);
 float cur_epoch(void);
+double cur_jd(void);
 void targset_finish(struct formobjects *objs, struct act_msg_targset *msg_targset);
 void datapmt_finish(struct formobjects *objs, struct act_msg_datapmt *msg_datapmt);
 void dataccd_finish(struct formobjects *objs, struct act_msg_dataccd *msg_dataccd);
 void update_block(struct formobjects *objs);
 void sched_next(struct formobjects *objs);
 unsigned char sched_next_block(struct formobjects *objs);
-unsigned char sched_next_obsn(struct formobjects *objs);
-unsigned char sched_next_targset(struct formobjects *objs, int targset_id);
-unsigned char sched_next_datapmt(struct formobjects *objs, int datapmt_id);
-unsigned char sched_next_dataccd(struct formobjects *objs, int dataccd_id);
+struct sched_plan *sched_load_plan(MYSQL *mysql_conn, double start_jd, float epoch);
+int sched_simulate(const char *sqlconfig, const char *date_str);
+char sched_next_obsn(struct formobjects *objs);
 gboolean sched_idle(gpointer user_data);
 gboolean delayed_obsn_retry(gpointer user_data);
 void update_schedstat(struct formobjects *objs, unsigned char stat);
@@ -55,13 +76,14 @@ int main(int argc, char** argv)
   act_log_open();
   act_log_normal(act_log_msg("Starting"));
   
-  const char *host, *port, *sqlconfig;
-  gtk_init(&argc, &argv);
-  struct arg_str *addrarg = arg_str1("a", "addr", "<str>", "The host to connect to. May be a hostname, IP4 address or IP6 address.");
-  struct arg_str *portarg = arg_str1("p", "port", "<str>", "The port to connect to. Must be an unsigned short integer.");
+  const char *host, *port, *sqlconfig, *simdate;
+  gboolean have_gui = gtk_init_check(&argc, &argv);
+  struct arg_str *addrarg = arg_str0("a", "addr", "<str>", "The host to connect to. May be a hostname, IP4 address or IP6 address.");
+  struct arg_str *portarg = arg_str0("p", "port", "<str>", "The port to connect to. Must be an unsigned short integer.");
   struct arg_str *sqlconfigarg = arg_str1("s", "sqlconfighost", "<server ip/hostname>", "The hostname or IP address of the SQL server than contains act_control's configuration information");
+  struct arg_str *simarg = arg_str0("n", "simulate", "<yyyy-mm-dd>", "Do not connect to act_control, but replay the pending observing queue over the night starting on the given (local) date and report the scheduled and idle time.");
   struct arg_end *endargs = arg_end(10);
-  void* argtable[] = {addrarg, portarg, sqlconfigarg, endargs};
+  void* argtable[] = {addrarg, portarg, sqlconfigarg, simarg, endargs};
   if (arg_nullcheck(argtable) != 0)
     act_log_error(act_log_msg("Argument parsing error: insufficient memory."));
   int argparse_errors = arg_parse(argc,argv,argtable);
@@ -70,13 +92,29 @@ int main(int argc, char** argv)
     arg_print_errors(stderr,endargs,argv[0]);
     return 1;
   }
-  host = addrarg->sval[0];
-  port = portarg->sval[0];
+  if ((simarg->count == 0) && ((addrarg->count == 0) || (portarg->count == 0)))
+  {
+    fprintf(stderr, "%s: the address and port of act_control are required unless --simulate is given\n", argv[0]);
+    return 1;
+  }
+  host = addrarg->count > 0 ? addrarg->sval[0] : NULL;
+  port = portarg->count > 0 ? portarg->sval[0] : NULL;
   sqlconfig = sqlconfigarg->sval[0];
+  simdate = simarg->count > 0 ? simarg->sval[0] : NULL;
   arg_freetable(argtable,sizeof(argtable)/sizeof(argtable[0]));
   
+  if (simdate != NULL)
+    return sched_simulate(sqlconfig, simdate);
+  if (!have_gui)
+  {
+    act_log_error(act_log_msg("Failed to initialise GTK."));
+    return 1;
+  }
+  
   struct formobjects formobjs;
   memset(&formobjs, 0, sizeof(struct formobjects));
+  formobjs.tel_ha_h = 0.0;
+  formobjs.tel_dec_d = LATITUDE;
   
   formobjs.net_chan = setup_net(host, port);
   if (formobjs.net_chan == NULL)
@@ -98,6 +136,14 @@ int main(int argc, char** argv)
     g_io_channel_unref(formobjs.net_chan);
     return 1;
   }
+  formobjs.prefetch = sched_prefetch_new(sqlconfig);
+  if (formobjs.prefetch == NULL)
+  {
+    act_log_error(act_log_msg("Error starting observation prefetch thread."));
+    mysql_close(formobjs.mysql_conn);
+    g_io_channel_unref(formobjs.net_chan);
+    return 1;
+  }
 
   formobjs.box_main = gtk_table_new(1,3,FALSE);
   formobjs.lbl_schedline = gtk_label_new("");
@@ -123,6 +169,9 @@ int main(int argc, char** argv)
   g_source_remove(net_watch_id);
   g_source_remove(guicheck_to_id);
   g_io_channel_unref(formobjs.net_chan);
+  sched_plan_free(formobjs.plan);
+  sched_prefetch_free(formobjs.prefetch);
+  mysql_close(formobjs.mysql_conn);
   act_log_normal(act_log_msg("Exiting"));
   return 0;
 }
@@ -193,11 +242,14 @@ gboolean read_net_message (GIOChannel *source, GIOCondition condition, gpointer
 {
   (void)condition;
   struct formobjects *objs = (struct formobjects *)net_read_data;
+  static struct act_msg_rx net_rx;
   struct act_msg msgbuf;
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_read_chars (source, (gchar *)&msgbuf, sizeof(msgbuf), &num_bytes, &error);
+  unsigned int rx_space;
+  gchar *rx_buf = act_msg_rx_space(&net_rx, &rx_space);
+  status = g_io_channel_read_chars (source, rx_buf, rx_space, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("An error occurred while attempting to read message from network - ", error->message));
@@ -209,129 +261,146 @@ gboolean read_net_message (GIOChannel *source, GIOCondition condition, gpointer
     act_log_error(act_log_msg("Incorrect status returned while attempting to read message from network."));
     return TRUE;
   }
-  if (num_bytes != sizeof(msgbuf))
+  act_msg_rx_commit(&net_rx, num_bytes);
+  while (act_msg_rx_next(&net_rx, &msgbuf))
   {
-    act_log_error(act_log_msg("Received message has invalid length: %d", num_bytes));
-    return TRUE;
-  }
-  switch (msgbuf.mtype)
-  {
-    case MT_QUIT:
-    {
-      gtk_main_quit();
-      break;
-    }
-    case MT_CAP:
-    {
-      struct act_msg_cap *cap_msg = &msgbuf.content.msg_cap;
-      cap_msg->service_provides = 0;
-      cap_msg->service_needs = 0;
-      cap_msg->targset_prov = TARGSET_SCHED_PRE | TARGSET_SCHED_POST;
-      cap_msg->datapmt_prov = DATAPMT_SCHED_PRE | DATAPMT_SCHED_POST;
-      cap_msg->dataccd_prov = DATACCD_SCHED_PRE | DATACCD_SCHED_POST;
-      snprintf(cap_msg->version_str,MAX_VERSION_LEN, "%d.%d", MAJOR_VER, MINOR_VER);
-      msgbuf.mtype = MT_CAP;
-      if (net_send(source, &msgbuf) < 0)
-        act_log_error(act_log_msg("Failed to send capabilities response message."));
-      break;
-    }
-    case MT_STAT:
-    {
-      if (msgbuf.content.msg_stat.status != 0)
-        break;
-      if (gtk_widget_get_parent(GTK_WIDGET(objs->box_main)) == NULL)
-        msgbuf.content.msg_stat.status = PROGSTAT_STARTUP;
-      else
-        msgbuf.content.msg_stat.status = PROGSTAT_RUNNING;
-      if (net_send(source, &msgbuf) < 0)
-        act_log_error(act_log_msg("Failed to send status response message."));
-      break;
-    }
-    case MT_GUISOCK:
+    switch (msgbuf.mtype)
     {
-      if (gtk_widget_get_parent(GTK_WIDGET(objs->box_main)) != NULL)
+      case MT_QUIT:
       {
-        act_log_debug(act_log_msg("GUI already embedded."));
+        gtk_main_quit();
         break;
       }
-      if (msgbuf.content.msg_guisock.gui_socket == 0)
+      case MT_CAP:
       {
-        act_log_error(act_log_msg("Received 0 GUI socket."));
+        struct act_msg_cap *cap_msg = &msgbuf.content.msg_cap;
+        cap_msg->service_provides = 0;
+        cap_msg->service_needs = SERVICE_COORD;
+        memset(cap_msg->service_max_rate, 0, sizeof(cap_msg->service_max_rate));
+        cap_msg->service_max_rate[SERVICE_IDX_COORD] = SCHED_COORD_MAX_RATE;
+        cap_msg->targset_prov = TARGSET_SCHED_PRE | TARGSET_SCHED_POST;
+        cap_msg->datapmt_prov = DATAPMT_SCHED_PRE | DATAPMT_SCHED_POST;
+        cap_msg->dataccd_prov = DATACCD_SCHED_PRE | DATACCD_SCHED_POST;
+        snprintf(cap_msg->version_str,MAX_VERSION_LEN, "%d.%d", MAJOR_VER, MINOR_VER);
+        msgbuf.mtype = MT_CAP;
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send capabilities response message."));
         break;
       }
-      GtkWidget *plug = gtk_widget_get_parent(objs->box_main);
-      if (plug != NULL)
+      case MT_STAT:
       {
-        gtk_container_remove(GTK_CONTAINER(plug), objs->box_main);
-        gtk_widget_destroy(plug);
+        if (msgbuf.content.msg_stat.status != 0)
+          break;
+        if (gtk_widget_get_parent(GTK_WIDGET(objs->box_main)) == NULL)
+          msgbuf.content.msg_stat.status = PROGSTAT_STARTUP;
+        else
+          msgbuf.content.msg_stat.status = PROGSTAT_RUNNING;
+        if (net_send(source, &msgbuf) < 0)
+          act_log_error(act_log_msg("Failed to send status response message."));
+        break;
       }
-      plug = gtk_plug_new(msgbuf.content.msg_guisock.gui_socket);
-      act_log_normal(act_log_msg("Received GUI socket (%d).", msgbuf.content.msg_guisock.gui_socket));
-      gtk_container_add(GTK_CONTAINER(plug),objs->box_main);
-      g_signal_connect(G_OBJECT(plug),"destroy",G_CALLBACK(destroy_plug),objs->box_main);
-      gtk_widget_show_all(plug);
-      break;
-    }
-    case MT_TARG_SET:
-    {
-      struct act_msg_targset *msg_targset = (struct act_msg_targset *)&msgbuf.content.msg_targset;
-      if (msg_targset->targset_stage == TARGSET_SCHED_PRE)
+      case MT_GUISOCK:
       {
-        act_log_debug(act_log_msg("Received a TARGSET_SCHED_PRE message. Another programme probably requested this. Passing message along."));
-        if (net_send(objs->net_chan, &msgbuf) < 0)
-          act_log_error(act_log_msg("Failed to pass along TARGSET_SCHED_PRE message."));
+        if (gtk_widget_get_parent(GTK_WIDGET(objs->box_main)) != NULL)
+        {
+          act_log_debug(act_log_msg("GUI already embedded."));
+          break;
+        }
+        if (msgbuf.content.msg_guisock.gui_socket == 0)
+        {
+          act_log_error(act_log_msg("Received 0 GUI socket."));
+          break;
+        }
+        GtkWidget *plug = gtk_widget_get_parent(objs->box_main);
+        if (plug != NULL)
+        {
+          gtk_container_remove(GTK_CONTAINER(plug), objs->box_main);
+          gtk_widget_destroy(plug);
+        }
+        plug = gtk_plug_new(msgbuf.content.msg_guisock.gui_socket);
+        act_log_normal(act_log_msg("Received GUI socket (%d).", msgbuf.content.msg_guisock.gui_socket));
+        gtk_container_add(GTK_CONTAINER(plug),objs->box_main);
+        g_signal_connect(G_OBJECT(plug),"destroy",G_CALLBACK(destroy_plug),objs->box_main);
+        gtk_widget_show_all(plug);
         break;
       }
-      if (msg_targset->targset_stage == TARGSET_SCHED_POST)
+      case MT_COORD:
       {
-        act_log_debug(act_log_msg("Received TARGET_SET_POST message."));
-        targset_finish(objs, msg_targset);
+        objs->tel_ha_h = convert_HMSMS_H_ha(&msgbuf.content.msg_coord.ha);
+        objs->tel_dec_d = convert_DMS_D_dec(&msgbuf.content.msg_coord.dec);
         break;
       }
-      act_log_error(act_log_msg("Invalid TARGSET stage: %hhu. Ignoring.", msg_targset->targset_stage));
-      break;
-    }
-    case MT_DATA_PMT:
-    {
-      struct act_msg_datapmt *msg_datapmt = (struct act_msg_datapmt *)&msgbuf.content.msg_datapmt;
-      if (msg_datapmt->datapmt_stage == DATAPMT_SCHED_PRE)
+      case MT_TARG_CAP:
       {
-        act_log_debug(act_log_msg("Received a DATAPMT_SCHED_PRE message. Another programme probably requested this. Passing message along."));
-        if (net_send(objs->net_chan, &msgbuf) < 0)
-          act_log_error(act_log_msg("Failed to pass along DATAPMT_SCHED_PRE message."));
+        // Only the merged telescope limits sent out by act_control are of interest, act_sched imposes no limits itself
+        if (msgbuf.content.msg_targcap.targset_stage == 0)
+          break;
+        memcpy(&objs->targcap, &msgbuf.content.msg_targcap, sizeof(struct act_msg_targcap));
+        if (objs->plan != NULL)
+          sched_plan_set_limits(objs->plan, &objs->targcap);
         break;
       }
-      if (msg_datapmt->datapmt_stage == DATAPMT_SCHED_POST)
+      case MT_TARG_SET:
       {
-        act_log_debug(act_log_msg("Observation complete message received."));
-        datapmt_finish(objs, msg_datapmt);
+        struct act_msg_targset *msg_targset = (struct act_msg_targset *)&msgbuf.content.msg_targset;
+        if (msg_targset->targset_stage == TARGSET_SCHED_PRE)
+        {
+          act_log_debug(act_log_msg("Received a TARGSET_SCHED_PRE message. Another programme probably requested this. Passing message along."));
+          if (net_send(objs->net_chan, &msgbuf) < 0)
+            act_log_error(act_log_msg("Failed to pass along TARGSET_SCHED_PRE message."));
+          break;
+        }
+        if (msg_targset->targset_stage == TARGSET_SCHED_POST)
+        {
+          act_log_debug(act_log_msg("Received TARGET_SET_POST message."));
+          targset_finish(objs, msg_targset);
+          break;
+        }
+        act_log_error(act_log_msg("Invalid TARGSET stage: %hhu. Ignoring.", msg_targset->targset_stage));
         break;
       }
-      act_log_error(act_log_msg("Invalid DATAPMT stage: %hhu. Ignoring.", msg_datapmt->datapmt_stage));
-      break;
-    }
-    case MT_DATA_CCD:
-    {
-      struct act_msg_dataccd *msg_dataccd = (struct act_msg_dataccd *)&msgbuf.content.msg_dataccd;
-      if (msg_dataccd->dataccd_stage == DATACCD_SCHED_PRE)
+      case MT_DATA_PMT:
       {
-        act_log_debug(act_log_msg("Received a DATACCD_SCHED_PRE message. Another programme probably requested this. Passing message along."));
-        if (net_send(objs->net_chan, &msgbuf) < 0)
-          act_log_error(act_log_msg("Failed to pass along DATACCD_SCHED_PRE message."));
+        struct act_msg_datapmt *msg_datapmt = (struct act_msg_datapmt *)&msgbuf.content.msg_datapmt;
+        if (msg_datapmt->datapmt_stage == DATAPMT_SCHED_PRE)
+        {
+          act_log_debug(act_log_msg("Received a DATAPMT_SCHED_PRE message. Another programme probably requested this. Passing message along."));
+          if (net_send(objs->net_chan, &msgbuf) < 0)
+            act_log_error(act_log_msg("Failed to pass along DATAPMT_SCHED_PRE message."));
+          break;
+        }
+        if (msg_datapmt->datapmt_stage == DATAPMT_SCHED_POST)
+        {
+          act_log_debug(act_log_msg("Observation complete message received."));
+          datapmt_finish(objs, msg_datapmt);
+          break;
+        }
+        act_log_error(act_log_msg("Invalid DATAPMT stage: %hhu. Ignoring.", msg_datapmt->datapmt_stage));
         break;
       }
-      if (msg_dataccd->dataccd_stage == DATACCD_SCHED_POST)
+      case MT_DATA_CCD:
       {
-        act_log_debug(act_log_msg("Observation complete message received."));
-        dataccd_finish(objs, msg_dataccd);
+        struct act_msg_dataccd *msg_dataccd = (struct act_msg_dataccd *)&msgbuf.content.msg_dataccd;
+        if (msg_dataccd->dataccd_stage == DATACCD_SCHED_PRE)
+        {
+          act_log_debug(act_log_msg("Received a DATACCD_SCHED_PRE message. Another programme probably requested this. Passing message along."));
+          if (net_send(objs->net_chan, &msgbuf) < 0)
+            act_log_error(act_log_msg("Failed to pass along DATACCD_SCHED_PRE message."));
+          break;
+        }
+        if (msg_dataccd->dataccd_stage == DATACCD_SCHED_POST)
+        {
+          act_log_debug(act_log_msg("Observation complete message received."));
+          dataccd_finish(objs, msg_dataccd);
+          break;
+        }
+        act_log_error(act_log_msg("Invalid DATACCD stage: %hhu. Ignoring.", msg_dataccd->dataccd_stage));
         break;
       }
-      act_log_error(act_log_msg("Invalid DATACCD stage: %hhu. Ignoring.", msg_dataccd->dataccd_stage));
-      break;
+      default:
+        if (msgbuf.mtype >= MT_INVAL)
+          act_log_error(act_log_msg("Invalid message type received."));
     }
-    default:
-      if (msgbuf.mtype >= MT_INVAL)
-        act_log_error(act_log_msg("Invalid message type received."));
   }
   int new_cond = g_io_channel_get_buffer_condition (source);
   if ((new_cond & G_IO_IN) != 0)
@@ -344,7 +413,15 @@ char net_send(GIOChannel *channel, struct act_msg *msg)
   gsize num_bytes;
   int status;
   GError *error = NULL;
-  status = g_io_channel_write_chars (channel, (gchar *)msg, sizeof(struct act_msg), &num_bytes, &error);
+  static unsigned int tx_seq = 0;
+  gchar frame[ACT_MSG_MAX_FRAME];
+  gsize frame_len = act_msg_frame(msg, tx_seq, frame);
+  if (frame_len == 0)
+  {
+    act_log_error(act_log_msg("Cannot send message with invalid type %hhd.", (msg)->mtype));
+    return -1;
+  }
+  status = g_io_channel_write_chars (channel, frame, frame_len, &num_bytes, &error);
   if (error != NULL)
   {
     act_log_error(act_log_msg("Error sending message - %s", error->message));
@@ -356,11 +433,12 @@ char net_send(GIOChannel *channel, struct act_msg *msg)
     act_log_error(act_log_msg("Incorrect status returned while attempting to send message over network."));
     return -1;
   }
-  if (num_bytes != sizeof(struct act_msg))
+  if (num_bytes != frame_len)
   {
     act_log_error(act_log_msg("Entire message was not transmitted (%d bytes)", num_bytes));
     return -1;
   }
+  tx_seq++;
   return num_bytes;
 }
 
@@ -424,6 +502,12 @@ float cur_epoch(void)
   return SEC_TO_YEAR(unix_time);
 }
 
+double cur_jd(void)
+{
+  time_t unix_time = time(NULL);
+  return SEC_TO_JD(unix_time);
+}
+
 void targset_finish(struct formobjects *objs, struct act_msg_targset *msg_targset)
 {
   if (objs->cur_msg == NULL)
@@ -480,9 +564,12 @@ void targset_finish(struct formobjects *objs, struct act_msg_targset *msg_targse
     act_log_debug(act_log_msg("Received target set message, but DONE flag not set (status %hhu). Updating DB and selecting next queue item.", msg_targset->status));
   free(objs->cur_msg);
   objs->cur_msg = NULL;
+  clock_gettime(CLOCK_MONOTONIC, &objs->obsn_end_time);
+  objs->obsn_ended = TRUE;
   char qrystr[256];
   sprintf(qrystr, "UPDATE sched_targset SET status=%hhu WHERE id=%lu;", msg_targset->status, objs->cur_obsnid);
-  if (mysql_query(objs->mysql_conn, qrystr) != 0)
+  sched_prefetch_update(objs->prefetch, qrystr);
+  if (sched_prefetch_flush(objs->prefetch) < 0)
   {
     act_log_error(act_log_msg("Failed to set db status for completed target set."));
     return;
@@ -537,9 +624,12 @@ void datapmt_finish(struct formobjects *objs, struct act_msg_datapmt *msg_datapm
   free(objs->cur_msg);
   msg_datapmt->status = OBSNSTAT_GOOD;
   objs->cur_msg = NULL;
+  clock_gettime(CLOCK_MONOTONIC, &objs->obsn_end_time);
+  objs->obsn_ended = TRUE;
   char qrystr[256];
   sprintf(qrystr, "UPDATE sched_datapmt SET status=%hhu WHERE id=%lu;", msg_datapmt->status, objs->cur_obsnid);
-  if (mysql_query(objs->mysql_conn, qrystr) != 0)
+  sched_prefetch_update(objs->prefetch, qrystr);
+  if (sched_prefetch_flush(objs->prefetch) < 0)
   {
     act_log_error(act_log_msg("Failed to set db status for completed Data PMT."));
     return;
@@ -590,9 +680,12 @@ void dataccd_finish(struct formobjects *objs, struct act_msg_dataccd *msg_datacc
     act_log_debug(act_log_msg("Received Data CCD message, but DONE flag not set (status %hhu). Updating DB and selecting next queue item."));
   free(objs->cur_msg);
   objs->cur_msg = NULL;
+  clock_gettime(CLOCK_MONOTONIC, &objs->obsn_end_time);
+  objs->obsn_ended = TRUE;
   char qrystr[256];
   sprintf(qrystr, "UPDATE sched_dataccd SET status=%hhu WHERE id=%lu;", msg_dataccd->status, objs->cur_obsnid);
-  if (mysql_query(objs->mysql_conn, qrystr) != 0)
+  sched_prefetch_update(objs->prefetch, qrystr);
+  if (sched_prefetch_flush(objs->prefetch) < 0)
   {
     act_log_error(act_log_msg("Failed to set db status for completed Data CCD."));
     return;
@@ -609,11 +702,7 @@ void update_block(struct formobjects *objs)
   }
   char qrystr[256];
   sprintf(qrystr, "UPDATE sched_blocks SET status=%hhu WHERE id=%lu;", objs->cur_block_stat, objs->cur_blockid);
-  if (mysql_query(objs->mysql_conn, qrystr) != 0)
-  {
-    act_log_error(act_log_msg("Failed to set db status for completed block %lu.", objs->cur_blockid));
-    return;
-  }
+  sched_prefetch_update(objs->prefetch, qrystr);
 }
 
 void sched_next(struct formobjects *objs)
@@ -640,16 +729,22 @@ void sched_next(struct formobjects *objs)
     }
     act_log_debug(act_log_msg("New block."));
   }
-  ret = sched_next_obsn(objs);
-  if (!ret)
+  char obsn_ret = sched_next_obsn(objs);
+  if (obsn_ret < 0)
+  {
+    act_log_error(act_log_msg("Failed to retrieve next observation of block %lu. Retrying later.", objs->cur_blockid));
+    g_timeout_add_seconds(SCHED_IDLE_TIMEOUT, sched_idle, objs);
+    update_schedstat(objs, 0);
+    return;
+  }
+  if (obsn_ret == 0)
   {
     update_block(objs);
+    // the block is removed from the plan, so this cannot select it again
+    sched_plan_block_done(objs->plan, objs->cur_blockid);
     objs->cur_blockid = 0;
     objs->cur_block_stat = 0;
-    if (objs->cur_obsnid != 0)
-      g_timeout_add_seconds(SCHED_IDLE_TIMEOUT, sched_idle, objs);
-    else
-      sched_next(objs);
+    sched_next(objs);
     return;
   }
   ret = net_send(objs->net_chan, objs->cur_msg);
@@ -662,407 +757,206 @@ void sched_next(struct formobjects *objs)
     update_schedstat(objs, 0);
     return;
   }
+  if (objs->obsn_ended)
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double turnaround_ms = (now.tv_sec - objs->obsn_end_time.tv_sec)*1000.0 + (now.tv_nsec - objs->obsn_end_time.tv_nsec)/1.0e6;
+    objs->num_turnarounds++;
+    objs->turnaround_sum_ms += turnaround_ms;
+    if (turnaround_ms > objs->turnaround_max_ms)
+      objs->turnaround_max_ms = turnaround_ms;
+    act_log_normal(act_log_msg("Observation turnaround %.1f ms (mean %.1f ms, maximum %.1f ms over %lu observations).", turnaround_ms, objs->turnaround_sum_ms/objs->num_turnarounds, objs->turnaround_max_ms, objs->num_turnarounds));
+    objs->obsn_ended = FALSE;
+  }
+  // look up the following observation while this one executes
+  sched_prefetch_request(objs->prefetch, objs->cur_blockid, objs->cur_obsntype, objs->cur_obsnid);
   update_schedstat(objs, OBSNSTAT_GOOD);
   update_schedline(objs);
 }
 
-unsigned char sched_next_block(struct formobjects *objs)
+/** \brief Get the next observation of the current block, prefetched while the previous observation executed.
+ * \param objs Programme objects.
+ * \return 1 if an observation was found (stored in objs->cur_msg), 0 if the block has no more pending observations,
+ * \return <0 on database error.
+ */
+char sched_next_obsn(struct formobjects *objs)
 {
-  act_log_debug(act_log_msg("Scheduling next block."));
-  MYSQL_RES *result;
-  mysql_query(objs->mysql_conn,"SELECT sched_blocks.id FROM sched_blocks INNER JOIN sched_block_seq ON sched_block_seq.block_id=sched_blocks.id INNER JOIN (SELECT block_seq_id FROM sched_targset UNION SELECT block_seq_id FROM sched_datapmt UNION SELECT block_seq_id FROM sched_dataccd) AS obsn_list ON obsn_list.block_seq_id=sched_block_seq.id WHERE sched_blocks.status=0 ORDER BY sched_blocks.priority ASC LIMIT 1;");
-  result = mysql_store_result(objs->mysql_conn);
-  if (result == NULL)
-  {
-    act_log_error(act_log_msg("Could not retrieve next schedule block identifier - %s.", mysql_error(objs->mysql_conn)));
-    return 0;
-  }
-  act_log_debug(act_log_msg("Results retrieved"));
-  
-  int rowcount = mysql_num_rows(result);
-  if (rowcount != 1)
+  struct act_msg *msg = malloc(sizeof(struct act_msg));
+  if (msg == NULL)
   {
-    act_log_debug(act_log_msg("Observing queue is empty."));
-    return 0;
+    act_log_error(act_log_msg("Failed to allocate memory for observation message."));
+    return -1;
   }
-  act_log_debug(act_log_msg("1 row retrieved"));
-  
-  MYSQL_ROW row = mysql_fetch_row(result);
-  int blockid;
-  if (sscanf(row[0], "%d", &blockid) != 1)
+  unsigned long obsnid;
+  char prefetched;
+  char ret = sched_prefetch_get(objs->prefetch, objs->cur_blockid, objs->cur_obsntype, objs->cur_obsnid, msg, &obsnid, &prefetched);
+  if (ret <= 0)
   {
-    act_log_error(act_log_msg("Failed to parse identifier for next schedule block (%s).", row[0]));
-    mysql_free_result(result);
-    return 0;
+    free(msg);
+    return ret;
   }
-  act_log_debug(act_log_msg("Next block id: %d\n", blockid));
-  mysql_free_result(result);
-  objs->cur_blockid = blockid;
-  objs->cur_block_stat = 0;
+  act_log_debug(act_log_msg("Next observation: type %hhd ID %lu (%s).", msg->mtype, obsnid, prefetched ? "prefetched" : "not prefetched"));
+  objs->cur_msg = msg;
+  objs->cur_obsnid = obsnid;
+  objs->cur_obsntype = msg->mtype;
   return 1;
 }
 
-unsigned char sched_next_obsn(struct formobjects *objs)
-{
-  act_log_debug(act_log_msg("Selecting new observation."));  
-  char qrystr[512];
-  sprintf(qrystr, "SELECT obsn_queue.id,obsn_queue.obsntype FROM (SELECT id,block_seq_id,status,1 AS obsntype FROM sched_targset UNION SELECT id,block_seq_id,status,2 AS obsntype FROM sched_dataccd UNION SELECT id,block_seq_id,status,3 AS obsntype FROM sched_datapmt) AS obsn_queue INNER JOIN sched_block_seq ON sched_block_seq.id=obsn_queue.block_seq_id WHERE sched_block_seq.block_id=%ld AND obsn_queue.status=0 ORDER BY sched_block_seq.seqnum LIMIT 1;", objs->cur_blockid);
-  MYSQL_RES *result;
-  mysql_query(objs->mysql_conn,qrystr);
-  result = mysql_store_result(objs->mysql_conn);
-  if (result == NULL)
-  {
-    act_log_error(act_log_msg("Could not retrieve next schedule item identifier - %s.", mysql_error(objs->mysql_conn)));
-    return 0;
-  }
-  act_log_debug(act_log_msg("Results retrieved"));
-  
-  int rowcount = mysql_num_rows(result);
-  if (rowcount != 1)
-  {
-    act_log_debug(act_log_msg("Queue empty for observing block %d", objs->cur_blockid));
-    return 0;
-  }
-  act_log_debug(act_log_msg("1 new observation"));
-  
-  MYSQL_ROW row = mysql_fetch_row(result);
-  int obsntype, obsnid;
-  if (sscanf(row[1], "%d", &obsntype) != 1)
-  {
-    act_log_error(act_log_msg("Failed to parse observation type information for next schedule item (%s).", row[2]));
-    mysql_free_result(result);
-    return 0;
-  }
-  if (sscanf(row[0], "%d", &obsnid) != 1)
-  {
-    act_log_error(act_log_msg("Failed to parse observation identifier for next schedule item (%s).", row[0]));
-    mysql_free_result(result);
-    return 0;
-  }
-  act_log_debug(act_log_msg("New observation type: %d ID: %d", obsntype, obsnid));
-  mysql_free_result(result);
-  unsigned char ret = 0;
-  switch(obsntype)
-  {
-    case 1:
-      ret = sched_next_targset(objs, obsnid);
-      break;
-    case 2:
-      ret = sched_next_dataccd(objs, obsnid);
-      break;
-    case 3:
-      ret = sched_next_datapmt(objs, obsnid);
-      break;
-    default:
-      act_log_error(act_log_msg("Next schedule item has invalid observation type (%d). Skipping this item.", obsntype));
-      ret = 0;
-  }
-  return ret;
-}
-
-unsigned char sched_next_targset(struct formobjects *objs, int targset_id)
+/** \brief Choose the next observing block with the scheduling engine (see sched_plan.h).
+ * \param objs Programme objects.
+ * \return 1 if a block was chosen (stored in objs->cur_blockid), 0 if no block can be observed now.
+ *
+ * The pending queue is loaded into memory when no plan covers the current time, or when nothing can be observed and
+ * the queue has not been reloaded in SCHED_RELOAD_PERIOD seconds (to pick up blocks added to the queue in the mean
+ * time). Otherwise the existing plan is used and completed blocks are simply removed from it.
+ */
+unsigned char sched_next_block(struct formobjects *objs)
 {
-  act_log_debug(act_log_msg("Selecting next target set."));
-  MYSQL_RES *result;
-  char qrystr[512];
-  sprintf(qrystr, "SELECT mode_auto, sched_blocks.targ_id, star_names.star_name, star_info.ra_h_fk5, star_info.dec_d_fk5, sky FROM sched_targset INNER JOIN sched_block_seq ON sched_block_seq.id=sched_targset.block_seq_id INNER JOIN sched_blocks ON sched_blocks.id=sched_block_seq.block_id INNER JOIN star_info ON star_info.id=sched_blocks.targ_id INNER JOIN star_names ON sched_blocks.targ_id=star_names.star_id WHERE sched_targset.id=%d", targset_id);
-  mysql_query(objs->mysql_conn,qrystr);
-  result = mysql_store_result(objs->mysql_conn);
-  if (result == NULL)
-  {
-    act_log_error(act_log_msg("Could not retrieve next target set observation information - %s.", mysql_error(objs->mysql_conn)));
-    return 0;
-  }
-  
-  int rowcount = mysql_num_rows(result);
-  if (rowcount != 1)
+  act_log_debug(act_log_msg("Scheduling next block."));
+  double jd = cur_jd();
+  struct sched_block *block = NULL;
+  double slew_s = 0.0;
+  if (sched_plan_slot(objs->plan, jd) >= 0)
+    block = sched_plan_next(objs->plan, jd, objs->tel_ha_h, objs->tel_dec_d, &slew_s);
+  if ((block == NULL) && ((objs->plan == NULL) || (sched_plan_slot(objs->plan, jd) < 0) || (time(NULL) - objs->plan_load_time >= SCHED_RELOAD_PERIOD)))
   {
-    act_log_debug(act_log_msg("Invalid number of rows retrieved (%d)", rowcount));
-    return 0;
+    // Block status updates are still queued on the prefetch connection - the queue must not be read without them
+    if (sched_prefetch_flush(objs->prefetch) < 0)
+      act_log_error(act_log_msg("A queued block status update failed. The queue is reloaded without it."));
+    struct sched_plan *new_plan = sched_load_plan(objs->mysql_conn, jd, cur_epoch());
+    if (new_plan != NULL)
+    {
+      sched_plan_free(objs->plan);
+      objs->plan = new_plan;
+      objs->plan_load_time = time(NULL);
+      sched_plan_set_limits(objs->plan, &objs->targcap);
+      block = sched_plan_next(objs->plan, jd, objs->tel_ha_h, objs->tel_dec_d, &slew_s);
+    }
   }
-  
-  MYSQL_ROW row = mysql_fetch_row(result);
-  unsigned char mode_auto, sky;
-  int targ_id;
-  char targ_name[MAX_TARGID_LEN];
-  double ra_h, dec_d;
-  int num_retrieved = 0;
-  if (sscanf(row[0], "%hhu", &mode_auto) != 1)
-    act_log_error(act_log_msg("Failed to parse mode auto parameter for target set queue item %d (%s).", targset_id, row[0]));
-  else
-    num_retrieved++;
-  if (sscanf(row[1], "%d", &targ_id) != 1)
-    act_log_error(act_log_msg("Failed to parse target identifier parameter for target set queue item %d (%s).", targset_id, row[1]));
-  else
-    num_retrieved++;
-  snprintf(targ_name, sizeof(targ_name)-1, "%s", row[2]);
-  num_retrieved++;
-  if (sscanf(row[3], "%lf", &ra_h) != 1)
-    act_log_error(act_log_msg("Failed to parse RA parameter for target set queue item %d (%s).", targset_id, row[3]));
-  else
-    num_retrieved++;
-  if (sscanf(row[4], "%lf", &dec_d) != 1)
-    act_log_error(act_log_msg("Failed to parse Dec parameter for target set queue item %d (%s).", targset_id, row[4]));
-  else
-    num_retrieved++;
-  if (sscanf(row[5], "%hhu", &sky) != 1)
-    act_log_error(act_log_msg("Failed to parse star/sky parameter for target set queue item %d (%s).", targset_id, row[5]));
-  else
-    num_retrieved++;
-  mysql_free_result(result);
-  if (num_retrieved != 6)
+  if (block == NULL)
   {
-    act_log_error(act_log_msg("Failed to retrieve all parameters for next target set schedule item."));
+    act_log_debug(act_log_msg("None of the %d pending blocks can be observed now.", sched_plan_num_pending(objs->plan)));
     return 0;
   }
-
-  objs->cur_obsnid = targset_id;
-  objs->cur_msg = malloc(sizeof(struct act_msg));
-  objs->cur_msg->mtype = MT_TARG_SET;
-  struct act_msg_targset *msg_targset = &objs->cur_msg->content.msg_targset;
-
-  msg_targset->status = OBSNSTAT_GOOD;
-  msg_targset->targset_stage = TARGSET_SCHED_PRE;
-  msg_targset->targ_cent = FALSE;
-  msg_targset->focus_pos = 0;
-  msg_targset->autoguide= FALSE;
-
-  msg_targset->mode_auto = mode_auto;
-  msg_targset->targ_id = targ_id;
-  memcpy(msg_targset->targ_name, targ_name, MAX_TARGID_LEN);
-  /// TODO: Change target RA, Dec to account for star/sky
-  struct rastruct tmp_ra;
-  struct decstruct tmp_dec;
-  convert_H_HMSMS_ra(ra_h, &tmp_ra);
-  convert_D_DMS_dec(dec_d, &tmp_dec);
-  precess_coord(&tmp_ra, &tmp_dec, 2000.0, cur_epoch(), &msg_targset->targ_ra, &msg_targset->targ_dec);
-  msg_targset->adj_ra_h = 0.0;
-  msg_targset->adj_dec_d = 0.0;
-  
+  act_log_debug(act_log_msg("Next block id: %lu (priority %d, estimated slew %.0f s, duration %.0f s)", block->id, block->priority, slew_s, block->dur_s));
+  objs->cur_blockid = block->id;
+  objs->cur_block_stat = 0;
   return 1;
 }
 
-unsigned char sched_next_datapmt(struct formobjects *objs, int datapmt_id)
+/** \brief Load all pending observing blocks into a new plan.
+ * \param mysql_conn MySQL connection.
+ * \param start_jd Julian date at which the plan starts (it covers SCHED_PLAN_HOURS).
+ * \param epoch Epoch to which target coordinates are precessed.
+ * \return New plan, or NULL on error.
+ *
+ * The duration of each block is estimated from the remaining observations in it. Blocks without pending observations
+ * are not included.
+ */
+struct sched_plan *sched_load_plan(MYSQL *mysql_conn, double start_jd, float epoch)
 {
-  act_log_debug(act_log_msg("Selecting next data pmt."));
+  act_log_debug(act_log_msg("Loading observing queue."));
   MYSQL_RES *result;
-  char qrystr[1024];
-  
-  sprintf(qrystr, "SELECT mode_auto, sched_blocks.targ_id, star_names.star_name, star_info.ra_h_fk5, star_info.dec_d_fk5, sky, sample_period_s, prebin, repetitions, pmt_filt_id, filter_types.name, pmt_filters.slot, pmt_aper_id, pmt_apertures.name, pmt_apertures.slot, sched_blocks.user_id FROM sched_datapmt INNER JOIN sched_block_seq ON sched_datapmt.block_seq_id=sched_block_seq.id INNER JOIN sched_blocks ON sched_blocks.id=sched_block_seq.block_id INNER JOIN star_info ON star_info.id=sched_blocks.targ_id INNER JOIN star_names ON star_names.star_id=star_info.id INNER JOIN pmt_filters ON pmt_filters.id=sched_datapmt.pmt_filt_id INNER JOIN filter_types ON filter_types.id=pmt_filters.type INNER JOIN pmt_apertures ON pmt_apertures.id=sched_datapmt.pmt_aper_id WHERE sched_datapmt.id=%d;", datapmt_id);
-  mysql_query(objs->mysql_conn,qrystr);
-  result = mysql_store_result(objs->mysql_conn);
+  char qrystr[2048];
+  sprintf(qrystr, "SELECT sched_blocks.id, sched_blocks.priority, star_info.ra_h_fk5, star_info.dec_d_fk5, (SELECT COUNT(*) FROM sched_targset INNER JOIN sched_block_seq ON sched_block_seq.id=sched_targset.block_seq_id WHERE sched_block_seq.block_id=sched_blocks.id AND sched_targset.status=0), (SELECT COUNT(*) FROM sched_datapmt INNER JOIN sched_block_seq ON sched_block_seq.id=sched_datapmt.block_seq_id WHERE sched_block_seq.block_id=sched_blocks.id AND sched_datapmt.status=0), (SELECT COALESCE(SUM(sample_period_s*prebin*repetitions),0) FROM sched_datapmt INNER JOIN sched_block_seq ON sched_block_seq.id=sched_datapmt.block_seq_id WHERE sched_block_seq.block_id=sched_blocks.id AND sched_datapmt.status=0), (SELECT COUNT(*) FROM sched_dataccd INNER JOIN sched_block_seq ON sched_block_seq.id=sched_dataccd.block_seq_id WHERE sched_block_seq.block_id=sched_blocks.id AND sched_dataccd.status=0), (SELECT COALESCE(SUM((exp_t_s+%f)*repetitions),0) FROM sched_dataccd INNER JOIN sched_block_seq ON sched_block_seq.id=sched_dataccd.block_seq_id WHERE sched_block_seq.block_id=sched_blocks.id AND sched_dataccd.status=0) FROM sched_blocks INNER JOIN star_info ON star_info.id=sched_blocks.targ_id WHERE sched_blocks.status=0;", SCHED_CCD_READOUT_S);
+  mysql_query(mysql_conn,qrystr);
+  result = mysql_store_result(mysql_conn);
   if (result == NULL)
   {
-    act_log_error(act_log_msg("Could not retrieve next Data PMT observation information - %s.", mysql_error(objs->mysql_conn)));
-    return 0;
+    act_log_error(act_log_msg("Could not retrieve pending observing blocks - %s.", mysql_error(mysql_conn)));
+    return NULL;
   }
-  act_log_debug(act_log_msg("Results retrieved."));
   
-  int rowcount = mysql_num_rows(result);
-  if (rowcount != 1)
+  struct sched_plan *plan = sched_plan_new(start_jd, SCHED_PLAN_HOURS*3600/SCHED_SLOT_S);
+  if (plan == NULL)
   {
-    act_log_debug(act_log_msg("Invalid number of rows retrieved (%d)", rowcount));
-    return 0;
+    mysql_free_result(result);
+    return NULL;
   }
-  act_log_debug(act_log_msg("1 row returned"));
-  
-  MYSQL_ROW row = mysql_fetch_row(result);
-  unsigned char mode_auto, sky, filt_slot, aper_slot;
-  int targ_id, user_id, prebin_num, repetitions, filt_id, aper_id;
-  char targ_name[MAX_TARGID_LEN], filt_name[IPC_MAX_NUM_FILTAPERS], aper_name[IPC_MAX_NUM_FILTAPERS];
-  double ra_h, dec_d, sample_period_s;
-  int num_retrieved = 0;
-  if (sscanf(row[0], "%hhu", &mode_auto) != 1)
-    act_log_error(act_log_msg("Failed to parse mode auto parameter for Data PMT queue item %d (%s).", datapmt_id, row[0]));
-  else
-    num_retrieved++;
-  if (sscanf(row[1], "%d", &targ_id) != 1)
-    act_log_error(act_log_msg("Failed to parse target identifier parameter for Data PMT queue item %d (%s).", datapmt_id, row[1]));
-  else
-    num_retrieved++;
-  snprintf(targ_name, sizeof(targ_name)-1, "%s", row[2]);
-  num_retrieved++;
-  if (sscanf(row[3], "%lf", &ra_h) != 1)
-    act_log_error(act_log_msg("Failed to parse RA parameter for Data PMT queue item %d (%s).", datapmt_id, row[3]));
-  else
-    num_retrieved++;
-  if (sscanf(row[4], "%lf", &dec_d) != 1)
-    act_log_error(act_log_msg("Failed to parse Dec parameter for Data PMT queue item %d (%s).", datapmt_id, row[4]));
-  else
-    num_retrieved++;
-  if (sscanf(row[5], "%hhu", &sky) != 1)
-    act_log_error(act_log_msg("Failed to parse star/sky parameter for Data PMT queue item %d (%s).", datapmt_id, row[5]));
-  else
-    num_retrieved++;
-  if (sscanf(row[6], "%lf", &sample_period_s) != 1)
-    act_log_error(act_log_msg("Failed to parse sample period parameter for Data PMT queue item %d (%s).", datapmt_id, row[6]));
-  else
-    num_retrieved++;
-  if (sscanf(row[7], "%d", &prebin_num) != 1)
-    act_log_error(act_log_msg("Failed to parse prebin parameter for Data PMT queue item %d (%s).", datapmt_id, row[7]));
-  else
-    num_retrieved++;
-  if (sscanf(row[8], "%d", &repetitions) != 1)
-    act_log_error(act_log_msg("Failed to parse repetitions parameter for Data PMT queue item %d (%s).", datapmt_id, row[8]));
-  else
-    num_retrieved++;
-  if (sscanf(row[9], "%d", &filt_id) != 1)
-    act_log_error(act_log_msg("Failed to parse filter ID parameter for Data PMT queue item %d (%s).", datapmt_id, row[9]));
-  else
-    num_retrieved++;
-  snprintf(filt_name, sizeof(filt_name)-1, "%s", row[10]);
-  num_retrieved++;
-  if (sscanf(row[11], "%hhu", &filt_slot) != 1)
-    act_log_error(act_log_msg("Failed to parse filter slot parameter for Data PMT queue item %d (%s).", datapmt_id, row[11]));
-  else
-    num_retrieved++;
-  if (sscanf(row[12], "%d", &aper_id) != 1)
-    act_log_error(act_log_msg("Failed to parse aperture ID parameter for Data PMT queue item %d (%s).", datapmt_id, row[12]));
-  else
-    num_retrieved++;
-  snprintf(aper_name, sizeof(aper_name)-1, "%s", row[13]);
-  num_retrieved++;
-  if (sscanf(row[14], "%hhu", &aper_slot) != 1)
-    act_log_error(act_log_msg("Failed to parse aperture slot parameter for Data PMT queue item %d (%s).", datapmt_id, row[14]));
-  else
-    num_retrieved++;
-  if (sscanf(row[15], "%d", &user_id) != 1)
-    act_log_error(act_log_msg("Failed to parse user ID parameter for Data PMT queue item %d (%s).", datapmt_id, row[15]));
-  else
-    num_retrieved++;
-  mysql_free_result(result);
-  if (num_retrieved != 16)
+  MYSQL_ROW row;
+  while ((row = mysql_fetch_row(result)) != NULL)
   {
-    act_log_error(act_log_msg("Failed to retrieve all parameters for Data PMT schedule item."));
-    return 0;
+    unsigned long block_id;
+    int priority, num_targset, num_datapmt, num_dataccd;
+    double ra_h, dec_d, datapmt_s, dataccd_s;
+    if (sscanf(row[0], "%lu", &block_id) != 1)
+    {
+      act_log_error(act_log_msg("Failed to parse identifier of observing block (%s).", row[0]));
+      continue;
+    }
+    if ((sscanf(row[1], "%d", &priority) != 1) || (sscanf(row[2], "%lf", &ra_h) != 1) || (sscanf(row[3], "%lf", &dec_d) != 1) || (sscanf(row[4], "%d", &num_targset) != 1) || (sscanf(row[5], "%d", &num_datapmt) != 1) || (sscanf(row[6], "%lf", &datapmt_s) != 1) || (sscanf(row[7], "%d", &num_dataccd) != 1) || (sscanf(row[8], "%lf", &dataccd_s) != 1))
+    {
+      act_log_error(act_log_msg("Failed to parse parameters of observing block %lu. Skipping this block.", block_id));
+      continue;
+    }
+    if (num_targset + num_datapmt + num_dataccd == 0)
+      continue;
+    struct rastruct tmp_ra, targ_ra;
+    struct decstruct tmp_dec, targ_dec;
+    convert_H_HMSMS_ra(ra_h, &tmp_ra);
+    convert_D_DMS_dec(dec_d, &tmp_dec);
+    precess_coord(&tmp_ra, &tmp_dec, 2000.0, epoch, &targ_ra, &targ_dec);
+    // the first target set is accounted for in the slew time
+    double dur_s = datapmt_s + dataccd_s + (num_targset > 1 ? (num_targset - 1) * SCHED_TARGSET_S : 0.0);
+    sched_plan_add_block(plan, block_id, priority, convert_HMSMS_H_ra(&targ_ra), convert_DMS_D_dec(&targ_dec), dur_s);
   }
-  act_log_debug(act_log_msg("Parameters extracted"));
-  
-  objs->cur_obsnid = datapmt_id;
-  objs->cur_msg = malloc(sizeof(struct act_msg));
-  objs->cur_msg->mtype = MT_DATA_PMT;
-  struct act_msg_datapmt *msg_datapmt = &objs->cur_msg->content.msg_datapmt;
-  
-  msg_datapmt->status = OBSNSTAT_GOOD;
-  msg_datapmt->datapmt_stage = DATAPMT_SCHED_PRE;
-  msg_datapmt->pmt_mode = 0;
-  
-  msg_datapmt->mode_auto = mode_auto;
-  msg_datapmt->targ_id = targ_id;
-  memcpy(msg_datapmt->targ_name, targ_name, MAX_TARGID_LEN);
-  msg_datapmt->sky = sky;
-  msg_datapmt->user_id = user_id;
-  msg_datapmt->sample_period_s = sample_period_s;
-  msg_datapmt->prebin_num = prebin_num;
-  msg_datapmt->repetitions = repetitions;
-  msg_datapmt->filter.db_id = filt_id;
-  memcpy(msg_datapmt->filter.name, filt_name, IPC_MAX_FILTAPER_NAME_LEN);
-  msg_datapmt->filter.slot = filt_slot;
-  msg_datapmt->aperture.db_id = aper_id;
-  memcpy(msg_datapmt->aperture.name, aper_name, IPC_MAX_FILTAPER_NAME_LEN);
-  msg_datapmt->aperture.slot = aper_slot;
-  
-  return 1;
+  mysql_free_result(result);
+  act_log_normal(act_log_msg("Loaded %d pending observing blocks.", plan->num_blocks));
+  return plan;
 }
 
-unsigned char sched_next_dataccd(struct formobjects *objs, int dataccd_id)
+/** \brief Simulate a night of observations using the pending queue, without sending anything to act_control.
+ * \param sqlconfig Hostname or IP address of the SQL server.
+ * \param date_str Local date on which the night starts (yyyy-mm-dd).
+ * \return 0 on success, 1 on error (for use as the programme's exit status).
+ *
+ * The plan starts at local noon on the given date and the telescope limits are not known, so only the airmass and
+ * Moon distance limits apply. Each scheduled block is printed, followed by the night, scheduled and idle time.
+ */
+int sched_simulate(const char *sqlconfig, const char *date_str)
 {
-  act_log_debug(act_log_msg("Selecting next data CCD."));
-  MYSQL_RES *result;
-  char qrystr[1024];
-  
-  sprintf(qrystr, "SELECT mode_auto, sched_blocks.targ_id, star_names.star_name, star_info.ra_h_fk5, star_info.dec_d_fk5, exp_t_s, repetitions, frame_transfer, prebin_x, prebin_y, ccd_filt_id, filter_types.name, ccd_filters.slot, sched_blocks.user_id FROM sched_dataccd INNER JOIN sched_block_seq ON sched_block_seq.id=sched_dataccd.block_seq_id INNER JOIN sched_blocks ON sched_blocks.id=sched_block_seq.block_id INNER JOIN star_info ON sched_blocks.targ_id=star_info.id INNER JOIN star_names ON star_names.star_id=sched_blocks.targ_id INNER JOIN ccd_filters ON ccd_filters.id=sched_dataccd.ccd_filt_id INNER JOIN filter_types ON filter_types.id=ccd_filters.type WHERE sched_dataccd.id=%d", dataccd_id);
-  mysql_query(objs->mysql_conn,qrystr);
-  result = mysql_store_result(objs->mysql_conn);
-  if (result == NULL)
+  int year, month, day;
+  if ((sscanf(date_str, "%d-%d-%d", &year, &month, &day) != 3) || (month < 1) || (month > 12) || (day < 1) || (day > 31))
   {
-    act_log_error(act_log_msg("Could not retrieve next Data CCD observation information - %s.", mysql_error(objs->mysql_conn)));
-    return 0;
+    fprintf(stderr, "Invalid date for simulation (%s) - expected yyyy-mm-dd\n", date_str);
+    return 1;
   }
-  
-  int rowcount = mysql_num_rows(result);
-  if (rowcount != 1)
+  MYSQL *mysql_conn = mysql_init(NULL);
+  if (mysql_conn == NULL)
   {
-    act_log_debug(act_log_msg("Invalid number of rows retrieved (%d)", rowcount));
-    return 0;
+    act_log_error(act_log_msg("Error initialising MySQL connection handler."));
+    return 1;
   }
-  
-  MYSQL_ROW row = mysql_fetch_row(result);
-  unsigned char mode_auto, filt_slot;
-  int targ_id, user_id, repetitions, filt_id;
-  char targ_name[MAX_TARGID_LEN], filt_name[IPC_MAX_NUM_FILTAPERS];
-  double ra_h, dec_d, exp_t_s;
-  int num_retrieved = 0;
-  if (sscanf(row[0], "%hhu", &mode_auto) != 1)
-    act_log_error(act_log_msg("Failed to parse mode auto parameter for Data CCD queue item %d (%s).", dataccd_id, row[0]));
-  else
-    num_retrieved++;
-  if (sscanf(row[1], "%d", &targ_id) != 1)
-    act_log_error(act_log_msg("Failed to parse target identifier parameter for Data CCD queue item %d (%s).", dataccd_id, row[1]));
-  else
-    num_retrieved++;
-  snprintf(targ_name, sizeof(targ_name)-1, "%s", row[2]);
-  num_retrieved++;
-  if (sscanf(row[3], "%lf", &ra_h) != 1)
-    act_log_error(act_log_msg("Failed to parse RA parameter for Data CCD queue item %d (%s).", dataccd_id, row[3]));
-  else
-    num_retrieved++;
-  if (sscanf(row[4], "%lf", &dec_d) != 1)
-    act_log_error(act_log_msg("Failed to parse Dec parameter for Data CCD queue item %d (%s).", dataccd_id, row[4]));
-  else
-    num_retrieved++;
-  if (sscanf(row[5], "%lf", &exp_t_s) != 1)
-    act_log_error(act_log_msg("Failed to parse exposure time parameter for Data CCD queue item %d (%s).", dataccd_id, row[5]));
-  else
-    num_retrieved++;
-  if (sscanf(row[6], "%d", &repetitions) != 1)
-    act_log_error(act_log_msg("Failed to parse repetitions parameter for Data CCD queue item %d (%s).", dataccd_id, row[6]));
-  else
-    num_retrieved++;
-  if (sscanf(row[10], "%d", &filt_id) != 1)
-    act_log_error(act_log_msg("Failed to parse filter ID parameter for Data CCD queue item %d (%s).", dataccd_id, row[10]));
-  else
-    num_retrieved++;
-  snprintf(filt_name, sizeof(filt_name)-1, "%s", row[11]);
-  num_retrieved++;
-  if (sscanf(row[12], "%hhu", &filt_slot) != 1)
-    act_log_error(act_log_msg("Failed to parse filter slot parameter for Data CCD queue item %d (%s).", dataccd_id, row[12]));
-  else
-    num_retrieved++;
-  if (sscanf(row[13], "%d", &user_id) != 1)
-    act_log_error(act_log_msg("Failed to parse user ID parameter for Data CCD queue item %d (%s).", dataccd_id, row[13]));
-  else
-    num_retrieved++;
-  mysql_free_result(result);
-  if (num_retrieved != 14)
+  if (mysql_real_connect(mysql_conn, sqlconfig, "act_sched", NULL, "act", 0, NULL, 0) == NULL)
   {
-    act_log_error(act_log_msg("Failed to retrieve all parameters for Data CCD schedule item."));
-    return 0;
+    act_log_error(act_log_msg("Error connecting to MySQL database - %s.", mysql_error(mysql_conn)));
+    mysql_close(mysql_conn);
+    return 1;
   }
   
-  objs->cur_obsnid = dataccd_id;
-  objs->cur_msg = malloc(sizeof(struct act_msg));
-  objs->cur_msg->mtype = MT_DATA_CCD;
-  struct act_msg_dataccd *msg_dataccd = &objs->cur_msg->content.msg_dataccd;
-  
-  msg_dataccd->status = OBSNSTAT_GOOD;
-  msg_dataccd->dataccd_stage = DATACCD_SCHED_PRE;
-  msg_dataccd->frame_transfer = TRUE;
-  msg_dataccd->win_start_x = msg_dataccd->win_start_y = 0;
-  msg_dataccd->win_height = msg_dataccd->win_width = 0;
-  msg_dataccd->prebin_x = msg_dataccd->prebin_y = 0;
-  
-  msg_dataccd->mode_auto = mode_auto;
-  msg_dataccd->targ_id = targ_id;
-  memcpy(msg_dataccd->targ_name, targ_name, MAX_TARGID_LEN);
-  msg_dataccd->user_id = user_id;
-  msg_dataccd->exp_t_s = exp_t_s;
-  msg_dataccd->repetitions = repetitions;
-  msg_dataccd->filter.db_id = filt_id;
-  memcpy(msg_dataccd->filter.name, filt_name, IPC_MAX_FILTAPER_NAME_LEN);
-  msg_dataccd->filter.slot = filt_slot;
+  struct datestruct unid;
+  struct timestruct unit;
+  unid.year = year;
+  unid.month = month-1;
+  unid.day = day-1;
+  convert_H_HMSMS_time(12.0 - TIMEZONE, &unit);
+  double start_jd = calc_GJD(&unid, &unit);
+  struct sched_plan *plan = sched_load_plan(mysql_conn, start_jd, year + (month-1)/12.0);
+  mysql_close(mysql_conn);
+  if (plan == NULL)
+    return 1;
   
-  return 1;
+  printf("Simulating night of %s with %d pending blocks\n", date_str, plan->num_blocks);
+  struct sched_sim_stats stats;
+  sched_plan_simulate(plan, stdout, &stats);
+  printf("Night time:     %6.2f h\n", stats.night_s / 3600.0);
+  printf("Observing time: %6.2f h\n", stats.obsn_s / 3600.0);
+  printf("Slew/set time:  %6.2f h\n", stats.slew_s / 3600.0);
+  printf("Idle time:      %6.2f h (%.1f%% of night)\n", stats.idle_s / 3600.0, stats.night_s > 0.0 ? 100.0 * stats.idle_s / stats.night_s : 0.0);
+  printf("Blocks scheduled: %d, not scheduled: %d\n", stats.num_scheduled, stats.num_unscheduled);
+  sched_plan_free(plan);
+  return 0;
 }
 
 gboolean sched_idle(gpointer user_data)
@@ -0,0 +1,362 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <act_log.h>
+#include <act_site.h>
+#include <act_positastro.h>
+#include <act_ephem.h>
+#include "sched_plan.h"
+
+static double wrap_ha_h(double ha_h)
+{
+  ha_h = fmod(ha_h, 24.0);
+  if (ha_h >= 12.0)
+    ha_h -= 24.0;
+  else if (ha_h < -12.0)
+    ha_h += 24.0;
+  return ha_h;
+}
+
+static double calc_dist_deg(double ra1_h, double dec1_d, double ra2_h, double dec2_d)
+{
+  double dec1_rad = convert_DEG_RAD(dec1_d), dec2_rad = convert_DEG_RAD(dec2_d);
+  double cos_dist = sin(dec1_rad)*sin(dec2_rad) + cos(dec1_rad)*cos(dec2_rad)*cos(convert_H_RAD(ra1_h-ra2_h));
+  if (cos_dist > 1.0)
+    cos_dist = 1.0;
+  else if (cos_dist < -1.0)
+    cos_dist = -1.0;
+  return convert_RAD_DEG(acos(cos_dist));
+}
+
+/** \brief Calculate in which slots the target of a block is observable.
+ */
+static void calc_visibility(struct sched_plan *plan, struct sched_block *block)
+{
+  struct sched_limits *lim = &plan->limits;
+  int num_slots = plan->num_slots;
+  double *ha_rad = plan->work, *dec_rad = &plan->work[num_slots], *alt_rad = &plan->work[2*num_slots], *tmp = &plan->work[3*num_slots];
+  int i;
+  for (i=0; i<num_slots; i++)
+  {
+    ha_rad[i] = convert_H_RAD(wrap_ha_h(plan->slot_lst_h[i] - block->ra_h));
+    dec_rad[i] = convert_DEG_RAD(block->dec_d);
+  }
+  convert_EQUI_ALTAZ_batch(ha_rad, dec_rad, alt_rad, tmp, num_slots);
+  calc_airmass_batch(alt_rad, tmp, num_slots);
+  for (i=0; i<num_slots; i++)
+  {
+    double ha_h = convert_RAD_H(ha_rad[i]);
+    double alt_d = convert_RAD_DEG(alt_rad[i]);
+    block->airmass[i] = tmp[i];
+    block->vis[i] = 0;
+    if (block->airmass[i] > SCHED_MAX_AIRMASS)
+      continue;
+    if ((lim->alt_lim_d != 0.0) && (alt_d < lim->alt_lim_d))
+      continue;
+    if ((lim->ha_lim_W_h != 0.0) && (ha_h > lim->ha_lim_W_h))
+      continue;
+    if ((lim->ha_lim_E_h != 0.0) && (ha_h < lim->ha_lim_E_h))
+      continue;
+    if ((lim->dec_lim_N_d != 0.0) && (block->dec_d > lim->dec_lim_N_d))
+      continue;
+    if ((lim->dec_lim_S_d != 0.0) && (block->dec_d < lim->dec_lim_S_d))
+      continue;
+    if (calc_dist_deg(block->ra_h, block->dec_d, plan->slot_moon_ra_h[i], plan->slot_moon_dec_d[i]) < SCHED_MOON_DIST_MIN_DEG)
+      continue;
+    block->vis[i] = 1;
+  }
+}
+
+/** \brief Create a plan covering num_slots slots of SCHED_SLOT_S seconds, starting at start_jd.
+ * \param start_jd Geocentric Julian date at which the plan starts.
+ * \param num_slots Number of slots.
+ * \return New plan (free with sched_plan_free), or NULL on error.
+ *
+ * Sidereal time, the position of the Moon and whether it is dark are calculated for the middle of each slot.
+ */
+struct sched_plan *sched_plan_new(double start_jd, int num_slots)
+{
+  if (num_slots <= 0)
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return NULL;
+  }
+  struct sched_plan *plan = malloc(sizeof(struct sched_plan));
+  if (plan == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for observing plan."));
+    return NULL;
+  }
+  memset(plan, 0, sizeof(struct sched_plan));
+  plan->start_jd = start_jd;
+  plan->num_slots = num_slots;
+  plan->slot_lst_h = malloc(num_slots*sizeof(double));
+  plan->slot_moon_ra_h = malloc(num_slots*sizeof(double));
+  plan->slot_moon_dec_d = malloc(num_slots*sizeof(double));
+  plan->slot_dark = malloc(num_slots);
+  plan->work = malloc(4*num_slots*sizeof(double));
+  plan->ephem = act_ephem_new(start_jd, num_slots * SCHED_SLOT_S / 3600.0);
+  if ((plan->slot_lst_h == NULL) || (plan->slot_moon_ra_h == NULL) || (plan->slot_moon_dec_d == NULL) || (plan->slot_dark == NULL) || (plan->work == NULL) || (plan->ephem == NULL))
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for observing plan."));
+    sched_plan_free(plan);
+    return NULL;
+  }
+
+  int i;
+  for (i=0; i<num_slots; i++)
+  {
+    double jd = start_jd + (i + 0.5) * SCHED_SLOT_S / 86400.0;
+    plan->slot_lst_h[i] = act_ephem_sidt(plan->ephem, jd);
+    plan->slot_dark[i] = convert_RAD_DEG(act_ephem_sun_alt(plan->ephem, jd)) < SCHED_SUN_ALT_DARK_DEG;
+    double moon_ra_rad, moon_dec_rad;
+    act_ephem_moon(plan->ephem, jd, &moon_ra_rad, &moon_dec_rad);
+    plan->slot_moon_ra_h[i] = convert_RAD_H(moon_ra_rad);
+    plan->slot_moon_dec_d[i] = convert_RAD_DEG(moon_dec_rad);
+  }
+  return plan;
+}
+
+void sched_plan_free(struct sched_plan *plan)
+{
+  if (plan == NULL)
+    return;
+  int i;
+  for (i=0; i<plan->num_blocks; i++)
+  {
+    free(plan->blocks[i].vis);
+    free(plan->blocks[i].airmass);
+  }
+  free(plan->blocks);
+  free(plan->slot_lst_h);
+  free(plan->slot_moon_ra_h);
+  free(plan->slot_moon_dec_d);
+  free(plan->slot_dark);
+  free(plan->work);
+  act_ephem_free(plan->ephem);
+  free(plan);
+}
+
+/** \brief Set the telescope limits (as merged by act_control) and recalculate the visibility of all blocks.
+ */
+void sched_plan_set_limits(struct sched_plan *plan, struct act_msg_targcap *targcap)
+{
+  if ((plan == NULL) || (targcap == NULL))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return;
+  }
+  plan->limits.ha_lim_W_h = convert_HMSMS_H_ha(&targcap->ha_lim_W);
+  plan->limits.ha_lim_E_h = convert_HMSMS_H_ha(&targcap->ha_lim_E);
+  plan->limits.dec_lim_N_d = convert_DMS_D_dec(&targcap->dec_lim_N);
+  plan->limits.dec_lim_S_d = convert_DMS_D_dec(&targcap->dec_lim_S);
+  plan->limits.alt_lim_d = convert_DMS_D_alt(&targcap->alt_lim);
+  int i;
+  for (i=0; i<plan->num_blocks; i++)
+    calc_visibility(plan, &plan->blocks[i]);
+}
+
+/** \brief Add a pending block to the plan and calculate its visibility.
+ * \param plan The plan.
+ * \param id Database identifier of the block.
+ * \param priority Priority of the block (lower values are more important).
+ * \param ra_h Right ascension of the target at the current epoch (hours).
+ * \param dec_d Declination of the target at the current epoch (degrees).
+ * \param dur_s Estimated duration of the remaining observations in the block (seconds).
+ * \return 0 on success, <0 on error.
+ */
+int sched_plan_add_block(struct sched_plan *plan, unsigned long id, int priority, double ra_h, double dec_d, double dur_s)
+{
+  if (plan == NULL)
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return -1;
+  }
+  if (plan->num_blocks == plan->max_blocks)
+  {
+    int new_max = plan->max_blocks > 0 ? plan->max_blocks*2 : 64;
+    struct sched_block *new_blocks = realloc(plan->blocks, new_max*sizeof(struct sched_block));
+    if (new_blocks == NULL)
+    {
+      act_log_error(act_log_msg("Failed to allocate memory for observing block %lu.", id));
+      return -1;
+    }
+    plan->blocks = new_blocks;
+    plan->max_blocks = new_max;
+  }
+  struct sched_block *block = &plan->blocks[plan->num_blocks];
+  memset(block, 0, sizeof(struct sched_block));
+  block->vis = malloc(plan->num_slots);
+  block->airmass = malloc(plan->num_slots*sizeof(float));
+  if ((block->vis == NULL) || (block->airmass == NULL))
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for visibility of observing block %lu.", id));
+    free(block->vis);
+    free(block->airmass);
+    return -1;
+  }
+  block->id = id;
+  block->priority = priority;
+  block->ra_h = ra_h;
+  block->dec_d = dec_d;
+  block->dur_s = dur_s;
+  calc_visibility(plan, block);
+  plan->num_blocks++;
+  return 0;
+}
+
+/** \brief Remove a block from consideration (completed or abandoned).
+ */
+void sched_plan_block_done(struct sched_plan *plan, unsigned long id)
+{
+  if (plan == NULL)
+    return;
+  int i;
+  for (i=0; i<plan->num_blocks; i++)
+  {
+    if (plan->blocks[i].id == id)
+      plan->blocks[i].done = 1;
+  }
+}
+
+/** \brief Index of the slot containing the given time, or -1 if the time is outside the plan.
+ */
+int sched_plan_slot(struct sched_plan *plan, double jd)
+{
+  if (plan == NULL)
+    return -1;
+  // allow for rounding, so that the time at which a slot starts (as calculated in sched_plan_simulate) lies in it
+  double slot = floor((jd - plan->start_jd) * 86400.0 / SCHED_SLOT_S + 1.0e-6);
+  if ((slot < 0.0) || (slot >= plan->num_slots))
+    return -1;
+  return (int)slot;
+}
+
+int sched_plan_num_pending(struct sched_plan *plan)
+{
+  if (plan == NULL)
+    return 0;
+  int i, num_pending = 0;
+  for (i=0; i<plan->num_blocks; i++)
+  {
+    if (!plan->blocks[i].done)
+      num_pending++;
+  }
+  return num_pending;
+}
+
+/** \brief Choose the block to observe next.
+ * \param plan The plan.
+ * \param jd Geocentric Julian date at which the block would start.
+ * \param tel_ha_h Current hour angle of the telescope (hours).
+ * \param tel_dec_d Current declination of the telescope (degrees).
+ * \param slew_s If not NULL, the estimated time needed to slew to and set the target is stored here (seconds).
+ * \return The chosen block, or NULL if no pending block is observable for its whole duration.
+ *
+ * Blocks that are observable from the start of the slew until the estimated end of their observations (or the end of
+ * the plan) are scored by priority, slew time from the current telescope position, airmass, and how long the target
+ * remains observable - targets that set soon are preferred over ones that can still be observed later. The block with
+ * the lowest score is chosen.
+ */
+struct sched_block *sched_plan_next(struct sched_plan *plan, double jd, double tel_ha_h, double tel_dec_d, double *slew_s)
+{
+  int start_slot = sched_plan_slot(plan, jd);
+  if (start_slot < 0)
+    return NULL;
+  double lst_h = act_ephem_sidt(plan->ephem, jd);
+  struct sched_block *best = NULL;
+  double best_score = 0.0, best_slew_s = 0.0;
+  int i, j;
+  for (i=0; i<plan->num_blocks; i++)
+  {
+    struct sched_block *block = &plan->blocks[i];
+    if ((block->done) || (!block->vis[start_slot]))
+      continue;
+    double ha_h = wrap_ha_h(lst_h - block->ra_h);
+    double slew_deg = fabs(ha_h - tel_ha_h) * 15.0;
+    if (fabs(block->dec_d - tel_dec_d) > slew_deg)
+      slew_deg = fabs(block->dec_d - tel_dec_d);
+    double block_slew_s = slew_deg / SCHED_SLEW_RATE_DEG_S + SCHED_SLEW_SETTLE_S + SCHED_TARGSET_S;
+    int end_slot = start_slot + (int)((block_slew_s + block->dur_s) / SCHED_SLOT_S);
+    if (end_slot >= plan->num_slots)
+      end_slot = plan->num_slots - 1;
+    for (j=start_slot; j<=end_slot; j++)
+    {
+      if (!block->vis[j])
+        break;
+    }
+    if (j <= end_slot)
+      continue;
+    for (j=end_slot+1; j<plan->num_slots; j++)
+    {
+      if (!block->vis[j])
+        break;
+    }
+    double remain_h = (j - start_slot) * SCHED_SLOT_S / 3600.0;
+    double score = block->priority * SCHED_PRIORITY_COST_S + block_slew_s + (block->airmass[start_slot] - 1.0) * SCHED_AIRMASS_COST_S + remain_h * SCHED_URGENCY_COST_S;
+    if ((best == NULL) || (score < best_score))
+    {
+      best = block;
+      best_score = score;
+      best_slew_s = block_slew_s;
+    }
+  }
+  if ((best != NULL) && (slew_s != NULL))
+    *slew_s = best_slew_s;
+  return best;
+}
+
+/** \brief Replay the plan offline, from the start of the plan with the telescope at the zenith.
+ * \param plan The plan - all scheduled blocks are marked as done.
+ * \param report If not NULL, a line is written here for every scheduled block.
+ * \param stats Where the night, observing, slewing and idle time are stored.
+ * \return (void)
+ *
+ * Blocks are only started during night time (Sun below SCHED_SUN_ALT_DARK_DEG). When nothing can be observed, the
+ * simulation waits for the next slot and the time is counted as idle.
+ */
+void sched_plan_simulate(struct sched_plan *plan, FILE *report, struct sched_sim_stats *stats)
+{
+  if ((plan == NULL) || (stats == NULL))
+  {
+    act_log_error(act_log_msg("Invalid input parameters."));
+    return;
+  }
+  memset(stats, 0, sizeof(struct sched_sim_stats));
+  int slot;
+  for (slot=0; slot<plan->num_slots; slot++)
+  {
+    if (plan->slot_dark[slot])
+      stats->night_s += SCHED_SLOT_S;
+  }
+  double tel_ha_h = 0.0, tel_dec_d = LATITUDE;
+  double jd = plan->start_jd;
+  while ((slot = sched_plan_slot(plan, jd)) >= 0)
+  {
+    struct sched_block *block = NULL;
+    double slew_s = 0.0;
+    if (plan->slot_dark[slot])
+      block = sched_plan_next(plan, jd, tel_ha_h, tel_dec_d, &slew_s);
+    if (block == NULL)
+    {
+      double next_jd = plan->start_jd + (slot + 1) * SCHED_SLOT_S / 86400.0;
+      if (plan->slot_dark[slot])
+        stats->idle_s += (next_jd - jd) * 86400.0;
+      jd = next_jd;
+      continue;
+    }
+    if (report != NULL)
+    {
+      double ut_h = fmod(jd + 0.5, 1.0) * 24.0;
+      fprintf(report, "%02d:%02d UT  block %6lu  priority %3d  slew %5.0f s  observe %6.0f s  airmass %4.2f\n", (int)ut_h, (int)(fmod(ut_h, 1.0)*60.0), block->id, block->priority, slew_s, block->dur_s, block->airmass[slot]);
+    }
+    stats->slew_s += slew_s;
+    stats->obsn_s += block->dur_s;
+    stats->num_scheduled++;
+    block->done = 1;
+    jd += (slew_s + block->dur_s) / 86400.0;
+    tel_ha_h = wrap_ha_h(act_ephem_sidt(plan->ephem, jd) - block->ra_h);
+    tel_dec_d = block->dec_d;
+  }
+  stats->num_unscheduled = sched_plan_num_pending(plan);
+}
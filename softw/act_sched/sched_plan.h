@@ -0,0 +1,100 @@
+#ifndef SCHED_PLAN_H
+#define SCHED_PLAN_H
+
+#include <stdio.h>
+#include <act_ipc.h>
+#include <act_ephem.h>
+
+//! Length of the visibility time slots (seconds)
+#define SCHED_SLOT_S               300
+//! Length of the period for which visibility is calculated when the queue is loaded (hours)
+#define SCHED_PLAN_HOURS           16
+//! Maximum airmass at which a target is considered observable
+#define SCHED_MAX_AIRMASS          2.5
+//! Minimum angular distance between a target and the Moon (degrees)
+#define SCHED_MOON_DIST_MIN_DEG    10.0
+//! Maximum altitude of the Sun for a slot to count as night time (degrees), used for the simulation report
+#define SCHED_SUN_ALT_DARK_DEG     -12.0
+//! Approximate slew rate of the telescope on each axis (degrees per second) and settling time after a slew (seconds)
+#define SCHED_SLEW_RATE_DEG_S      1.0
+#define SCHED_SLEW_SETTLE_S        30.0
+//! Time needed to set a target (acquisition, centring) in addition to the slew (seconds)
+#define SCHED_TARGSET_S            120.0
+/** \name Score weights
+ * \brief Cost (in equivalent seconds of slewing) of one priority level, one unit of airmass above 1 and each hour
+ * \brief the target remains observable tonight.
+ * \{
+ */
+#define SCHED_PRIORITY_COST_S      900.0
+#define SCHED_AIRMASS_COST_S       300.0
+#define SCHED_URGENCY_COST_S       60.0
+/** \} */
+
+/** \brief A pending observing block, with its visibility over the planning period.
+ */
+struct sched_block
+{
+  unsigned long id;
+  int priority;
+  //! Target coordinates at the current epoch
+  double ra_h, dec_d;
+  //! Estimated time needed to complete the remaining observations in the block (seconds)
+  double dur_s;
+  //! Set once the block has been completed (or abandoned) tonight
+  char done;
+  //! Per slot: whether the target is observable and its airmass
+  unsigned char *vis;
+  float *airmass;
+};
+
+/** \brief Telescope limits used to calculate visibility - 0 means no limit, as with act_msg_targcap.
+ */
+struct sched_limits
+{
+  double ha_lim_W_h, ha_lim_E_h;
+  double dec_lim_N_d, dec_lim_S_d;
+  double alt_lim_d;
+};
+
+/** \brief In-memory copy of the observing queue with precomputed visibility windows.
+ *
+ * Everything that only depends on time (sidereal time, Sun and Moon positions) is looked up in the ephemeris tables
+ * once per slot when the plan is created and everything that depends on the target is calculated once per block per slot
+ * when the block is added, so choosing the next block (sched_plan_next) only compares precomputed values.
+ */
+struct sched_plan
+{
+  //! Geocentric Julian date at the start of the first slot
+  double start_jd;
+  int num_slots;
+  //! Per slot: local sidereal time, position of the Moon and whether it is night time
+  double *slot_lst_h, *slot_moon_ra_h, *slot_moon_dec_d;
+  char *slot_dark;
+  //! Sun, Moon and sidereal time over the period of the plan
+  struct act_ephem *ephem;
+  //! Scratch space for the batch coordinate conversions when a block's visibility is calculated (4 doubles per slot)
+  double *work;
+  struct sched_limits limits;
+  struct sched_block *blocks;
+  int num_blocks, max_blocks;
+};
+
+//! Outcome of a simulated night (sched_plan_simulate)
+struct sched_sim_stats
+{
+  //! Night time, time spent observing, slewing/setting targets and idle (seconds)
+  double night_s, obsn_s, slew_s, idle_s;
+  int num_scheduled, num_unscheduled;
+};
+
+struct sched_plan *sched_plan_new(double start_jd, int num_slots);
+void sched_plan_free(struct sched_plan *plan);
+void sched_plan_set_limits(struct sched_plan *plan, struct act_msg_targcap *targcap);
+int sched_plan_add_block(struct sched_plan *plan, unsigned long id, int priority, double ra_h, double dec_d, double dur_s);
+void sched_plan_block_done(struct sched_plan *plan, unsigned long id);
+int sched_plan_slot(struct sched_plan *plan, double jd);
+int sched_plan_num_pending(struct sched_plan *plan);
+struct sched_block *sched_plan_next(struct sched_plan *plan, double jd, double tel_ha_h, double tel_dec_d, double *slew_s);
+void sched_plan_simulate(struct sched_plan *plan, FILE *report, struct sched_sim_stats *stats);
+
+#endif
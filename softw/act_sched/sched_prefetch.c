@@ -0,0 +1,639 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <mysql/mysql.h>
+#include <act_log.h>
+#include <act_positastro.h>
+#include "sched_prefetch.h"
+
+static void *prefetch_thread(void *sched_prefetch);
+static MYSQL *prefetch_connect(const char *sqlhost);
+static char fetch_obsn(MYSQL *conn, unsigned long block_id, int skip_type, unsigned long skip_id, struct act_msg *msg, unsigned long *obsn_id);
+static char fetch_targset(MYSQL *conn, int targset_id, struct act_msg *msg);
+static char fetch_datapmt(MYSQL *conn, int datapmt_id, struct act_msg *msg);
+static char fetch_dataccd(MYSQL *conn, int dataccd_id, struct act_msg *msg);
+
+/** \brief Start the prefetch thread.
+ * \param sqlhost Hostname or IP address of the SQL server.
+ * \return New prefetcher, or NULL on error.
+ *
+ * Must be called after the main thread has initialised the MySQL library (mysql_init).
+ */
+struct sched_prefetch *sched_prefetch_new(const char *sqlhost)
+{
+  struct sched_prefetch *prefetch = malloc(sizeof(struct sched_prefetch));
+  if (prefetch == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for observation prefetcher."));
+    return NULL;
+  }
+  memset(prefetch, 0, sizeof(struct sched_prefetch));
+  prefetch->sqlhost = strdup(sqlhost);
+  pthread_mutex_init(&prefetch->mutex, NULL);
+  pthread_cond_init(&prefetch->cond, NULL);
+  int ret = pthread_create(&prefetch->thr, NULL, prefetch_thread, prefetch);
+  if (ret != 0)
+  {
+    act_log_error(act_log_msg("Failed to create observation prefetch thread - %s.", strerror(ret)));
+    pthread_cond_destroy(&prefetch->cond);
+    pthread_mutex_destroy(&prefetch->mutex);
+    free(prefetch->sqlhost);
+    free(prefetch);
+    return NULL;
+  }
+  return prefetch;
+}
+
+/** \brief Stop the prefetch thread, after it has written all queued status updates.
+ */
+void sched_prefetch_free(struct sched_prefetch *prefetch)
+{
+  if (prefetch == NULL)
+    return;
+  pthread_mutex_lock(&prefetch->mutex);
+  prefetch->exiting = TRUE;
+  pthread_cond_broadcast(&prefetch->cond);
+  pthread_mutex_unlock(&prefetch->mutex);
+  pthread_join(prefetch->thr, NULL);
+  act_log_normal(act_log_msg("%lu observations were prefetched in time, %lu had to be waited for.", prefetch->num_hits, prefetch->num_misses));
+  pthread_cond_destroy(&prefetch->cond);
+  pthread_mutex_destroy(&prefetch->mutex);
+  free(prefetch->sqlhost);
+  free(prefetch);
+}
+
+/** \brief Queue a status update query, to be executed by the prefetch thread.
+ */
+void sched_prefetch_update(struct sched_prefetch *prefetch, const char *qrystr)
+{
+  struct sched_update *update = malloc(sizeof(struct sched_update));
+  if (update == NULL)
+  {
+    act_log_error(act_log_msg("Failed to allocate memory for status update (%s).", qrystr));
+    return;
+  }
+  snprintf(update->qrystr, sizeof(update->qrystr), "%s", qrystr);
+  update->next = NULL;
+  pthread_mutex_lock(&prefetch->mutex);
+  if (prefetch->updates_tail == NULL)
+    prefetch->updates_head = update;
+  else
+    prefetch->updates_tail->next = update;
+  prefetch->updates_tail = update;
+  pthread_cond_broadcast(&prefetch->cond);
+  pthread_mutex_unlock(&prefetch->mutex);
+}
+
+/** \brief Wait until all queued status updates have been written.
+ * \return 0 if they all succeeded, -1 if any update queued since the last flush failed.
+ */
+char sched_prefetch_flush(struct sched_prefetch *prefetch)
+{
+  pthread_mutex_lock(&prefetch->mutex);
+  while ((prefetch->updates_head != NULL) || (prefetch->updating))
+    pthread_cond_wait(&prefetch->cond, &prefetch->mutex);
+  char ret = prefetch->update_failed ? -1 : 0;
+  prefetch->update_failed = FALSE;
+  pthread_mutex_unlock(&prefetch->mutex);
+  return ret;
+}
+
+static void request_locked(struct sched_prefetch *prefetch, unsigned long block_id, int skip_mtype, unsigned long skip_id)
+{
+  if ((prefetch->req_valid) && (prefetch->req_block_id == block_id) && (prefetch->req_skip_mtype == skip_mtype) && (prefetch->req_skip_id == skip_id))
+    return;
+  prefetch->req_valid = prefetch->req_pending = TRUE;
+  prefetch->req_block_id = block_id;
+  prefetch->req_skip_mtype = skip_mtype;
+  prefetch->req_skip_id = skip_id;
+  prefetch->res_ready = FALSE;
+  pthread_cond_broadcast(&prefetch->cond);
+}
+
+/** \brief Start looking up the observation that follows the given one in a block.
+ * \param prefetch The prefetcher.
+ * \param block_id Identifier of the observing block.
+ * \param skip_mtype Message type of the observation currently being executed (0 if none).
+ * \param skip_id Identifier of the observation currently being executed.
+ * \return (void)
+ */
+void sched_prefetch_request(struct sched_prefetch *prefetch, unsigned long block_id, int skip_mtype, unsigned long skip_id)
+{
+  pthread_mutex_lock(&prefetch->mutex);
+  request_locked(prefetch, block_id, skip_mtype, skip_id);
+  pthread_mutex_unlock(&prefetch->mutex);
+}
+
+/** \brief Get the observation that follows the given one in a block.
+ * \param prefetch The prefetcher.
+ * \param block_id, skip_mtype, skip_id As for sched_prefetch_request.
+ * \param msg Where the observation message is stored.
+ * \param obsn_id Where the identifier of the observation is stored.
+ * \param prefetched If not NULL, set to TRUE if the look-up was already complete.
+ * \return 1 if an observation was found, 0 if the block has no more pending observations, <0 on database error.
+ *
+ * If this look-up was not requested beforehand, it is started now. Waits for the look-up to complete.
+ */
+char sched_prefetch_get(struct sched_prefetch *prefetch, unsigned long block_id, int skip_mtype, unsigned long skip_id, struct act_msg *msg, unsigned long *obsn_id, char *prefetched)
+{
+  pthread_mutex_lock(&prefetch->mutex);
+  request_locked(prefetch, block_id, skip_mtype, skip_id);
+  if (prefetched != NULL)
+    *prefetched = prefetch->res_ready;
+  if (prefetch->res_ready)
+    prefetch->num_hits++;
+  else
+    prefetch->num_misses++;
+  while (!prefetch->res_ready)
+    pthread_cond_wait(&prefetch->cond, &prefetch->mutex);
+  char ret = prefetch->res_ret;
+  if (ret > 0)
+  {
+    memcpy(msg, &prefetch->res_msg, sizeof(struct act_msg));
+    *obsn_id = prefetch->res_obsn_id;
+  }
+  // the observation will now be executed, so the result must not be used again
+  prefetch->req_valid = FALSE;
+  pthread_mutex_unlock(&prefetch->mutex);
+  return ret;
+}
+
+static int obsn_type(int mtype)
+{
+  switch (mtype)
+  {
+    case MT_TARG_SET:
+      return 1;
+    case MT_DATA_CCD:
+      return 2;
+    case MT_DATA_PMT:
+      return 3;
+  }
+  return 0;
+}
+
+static void *prefetch_thread(void *sched_prefetch)
+{
+  struct sched_prefetch *prefetch = (struct sched_prefetch *)sched_prefetch;
+  mysql_thread_init();
+  MYSQL *conn = prefetch_connect(prefetch->sqlhost);
+  
+  pthread_mutex_lock(&prefetch->mutex);
+  while (TRUE)
+  {
+    while ((!prefetch->exiting) && (prefetch->updates_head == NULL) && (!prefetch->req_pending))
+      pthread_cond_wait(&prefetch->cond, &prefetch->mutex);
+    if (conn == NULL)
+    {
+      pthread_mutex_unlock(&prefetch->mutex);
+      conn = prefetch_connect(prefetch->sqlhost);
+      pthread_mutex_lock(&prefetch->mutex);
+    }
+    
+    // status updates first, so look-ups see them
+    struct sched_update *update = prefetch->updates_head;
+    if (update != NULL)
+    {
+      prefetch->updates_head = update->next;
+      if (prefetch->updates_head == NULL)
+        prefetch->updates_tail = NULL;
+      prefetch->updating = TRUE;
+      pthread_mutex_unlock(&prefetch->mutex);
+      char failed = TRUE;
+      if (conn == NULL)
+        act_log_error(act_log_msg("No database connection, status update lost (%s).", update->qrystr));
+      else if (mysql_query(conn, update->qrystr) != 0)
+        act_log_error(act_log_msg("Failed to update observation status (%s) - %s.", update->qrystr, mysql_error(conn)));
+      else
+        failed = FALSE;
+      free(update);
+      pthread_mutex_lock(&prefetch->mutex);
+      prefetch->updating = FALSE;
+      if (failed)
+        prefetch->update_failed = TRUE;
+      pthread_cond_broadcast(&prefetch->cond);
+      continue;
+    }
+    if (prefetch->exiting)
+      break;
+    
+    unsigned long block_id = prefetch->req_block_id, skip_id = prefetch->req_skip_id;
+    int skip_mtype = prefetch->req_skip_mtype;
+    prefetch->req_pending = FALSE;
+    pthread_mutex_unlock(&prefetch->mutex);
+    struct act_msg msg;
+    unsigned long obsn_id = 0;
+    char ret = -1;
+    if (conn != NULL)
+      ret = fetch_obsn(conn, block_id, obsn_type(skip_mtype), skip_id, &msg, &obsn_id);
+    pthread_mutex_lock(&prefetch->mutex);
+    // only keep the result if the main loop has not asked for something else in the mean time
+    if ((prefetch->req_pending) || (!prefetch->req_valid))
+      continue;
+    prefetch->res_ret = ret;
+    prefetch->res_obsn_id = obsn_id;
+    if (ret > 0)
+      memcpy(&prefetch->res_msg, &msg, sizeof(struct act_msg));
+    prefetch->res_ready = TRUE;
+    pthread_cond_broadcast(&prefetch->cond);
+  }
+  pthread_mutex_unlock(&prefetch->mutex);
+  
+  if (conn != NULL)
+    mysql_close(conn);
+  mysql_thread_end();
+  return NULL;
+}
+
+static MYSQL *prefetch_connect(const char *sqlhost)
+{
+  MYSQL *conn = mysql_init(NULL);
+  if (conn == NULL)
+  {
+    act_log_error(act_log_msg("Error initialising MySQL connection handler for prefetch thread."));
+    return NULL;
+  }
+  if (mysql_real_connect(conn, sqlhost, "act_sched", NULL, "act", 0, NULL, 0) == NULL)
+  {
+    act_log_error(act_log_msg("Error connecting to MySQL database from prefetch thread - %s.", mysql_error(conn)));
+    mysql_close(conn);
+    return NULL;
+  }
+  return conn;
+}
+
+/** \brief Find the next pending observation in a block and build the message for it.
+ * \param conn MySQL connection.
+ * \param block_id Identifier of the observing block.
+ * \param skip_type Observation type (1 target set, 2 data CCD, 3 data PMT) of an observation to skip, 0 for none.
+ * \param skip_id Identifier of the observation to skip.
+ * \param msg Where the observation message is built.
+ * \param obsn_id Where the identifier of the observation is stored.
+ * \return 1 if an observation was found, 0 if the block has no (valid) pending observations, <0 on database error.
+ *
+ * The skipped observation is the one currently being executed, which is still marked as pending in the database.
+ */
+static char fetch_obsn(MYSQL *conn, unsigned long block_id, int skip_type, unsigned long skip_id, struct act_msg *msg, unsigned long *obsn_id)
+{
+  act_log_debug(act_log_msg("Selecting new observation."));  
+  char qrystr[768];
+  sprintf(qrystr, "SELECT obsn_queue.id,obsn_queue.obsntype FROM (SELECT id,block_seq_id,status,1 AS obsntype FROM sched_targset UNION SELECT id,block_seq_id,status,2 AS obsntype FROM sched_dataccd UNION SELECT id,block_seq_id,status,3 AS obsntype FROM sched_datapmt) AS obsn_queue INNER JOIN sched_block_seq ON sched_block_seq.id=obsn_queue.block_seq_id WHERE sched_block_seq.block_id=%lu AND obsn_queue.status=0 AND NOT (obsn_queue.obsntype=%d AND obsn_queue.id=%lu) ORDER BY sched_block_seq.seqnum LIMIT 1;", block_id, skip_type, skip_id);
+  MYSQL_RES *result;
+  mysql_query(conn,qrystr);
+  result = mysql_store_result(conn);
+  if (result == NULL)
+  {
+    act_log_error(act_log_msg("Could not retrieve next schedule item identifier - %s.", mysql_error(conn)));
+    return -1;
+  }
+  act_log_debug(act_log_msg("Results retrieved"));
+  
+  int rowcount = mysql_num_rows(result);
+  if (rowcount != 1)
+  {
+    act_log_debug(act_log_msg("Queue empty for observing block %lu", block_id));
+    mysql_free_result(result);
+    return 0;
+  }
+  act_log_debug(act_log_msg("1 new observation"));
+  
+  MYSQL_ROW row = mysql_fetch_row(result);
+  int obsntype, obsnid;
+  if (sscanf(row[1], "%d", &obsntype) != 1)
+  {
+    act_log_error(act_log_msg("Failed to parse observation type information for next schedule item (%s).", row[2]));
+    mysql_free_result(result);
+    return 0;
+  }
+  if (sscanf(row[0], "%d", &obsnid) != 1)
+  {
+    act_log_error(act_log_msg("Failed to parse observation identifier for next schedule item (%s).", row[0]));
+    mysql_free_result(result);
+    return 0;
+  }
+  act_log_debug(act_log_msg("New observation type: %d ID: %d", obsntype, obsnid));
+  mysql_free_result(result);
+  char ret = 0;
+  switch(obsntype)
+  {
+    case 1:
+      ret = fetch_targset(conn, obsnid, msg);
+      break;
+    case 2:
+      ret = fetch_dataccd(conn, obsnid, msg);
+      break;
+    case 3:
+      ret = fetch_datapmt(conn, obsnid, msg);
+      break;
+    default:
+      act_log_error(act_log_msg("Next schedule item has invalid observation type (%d). Skipping this item.", obsntype));
+      ret = 0;
+  }
+  if (ret > 0)
+    *obsn_id = obsnid;
+  return ret;
+}
+
+static char fetch_targset(MYSQL *conn, int targset_id, struct act_msg *msg)
+{
+  act_log_debug(act_log_msg("Selecting next target set."));
+  MYSQL_RES *result;
+  char qrystr[512];
+  sprintf(qrystr, "SELECT mode_auto, sched_blocks.targ_id, star_names.star_name, star_info.ra_h_fk5, star_info.dec_d_fk5, sky FROM sched_targset INNER JOIN sched_block_seq ON sched_block_seq.id=sched_targset.block_seq_id INNER JOIN sched_blocks ON sched_blocks.id=sched_block_seq.block_id INNER JOIN star_info ON star_info.id=sched_blocks.targ_id INNER JOIN star_names ON sched_blocks.targ_id=star_names.star_id WHERE sched_targset.id=%d", targset_id);
+  mysql_query(conn,qrystr);
+  result = mysql_store_result(conn);
+  if (result == NULL)
+  {
+    act_log_error(act_log_msg("Could not retrieve next target set observation information - %s.", mysql_error(conn)));
+    return 0;
+  }
+  
+  int rowcount = mysql_num_rows(result);
+  if (rowcount != 1)
+  {
+    act_log_debug(act_log_msg("Invalid number of rows retrieved (%d)", rowcount));
+    mysql_free_result(result);
+    return 0;
+  }
+  
+  MYSQL_ROW row = mysql_fetch_row(result);
+  unsigned char mode_auto, sky;
+  int targ_id;
+  char targ_name[MAX_TARGID_LEN];
+  double ra_h, dec_d;
+  int num_retrieved = 0;
+  if (sscanf(row[0], "%hhu", &mode_auto) != 1)
+    act_log_error(act_log_msg("Failed to parse mode auto parameter for target set queue item %d (%s).", targset_id, row[0]));
+  else
+    num_retrieved++;
+  if (sscanf(row[1], "%d", &targ_id) != 1)
+    act_log_error(act_log_msg("Failed to parse target identifier parameter for target set queue item %d (%s).", targset_id, row[1]));
+  else
+    num_retrieved++;
+  snprintf(targ_name, sizeof(targ_name)-1, "%s", row[2]);
+  num_retrieved++;
+  if (sscanf(row[3], "%lf", &ra_h) != 1)
+    act_log_error(act_log_msg("Failed to parse RA parameter for target set queue item %d (%s).", targset_id, row[3]));
+  else
+    num_retrieved++;
+  if (sscanf(row[4], "%lf", &dec_d) != 1)
+    act_log_error(act_log_msg("Failed to parse Dec parameter for target set queue item %d (%s).", targset_id, row[4]));
+  else
+    num_retrieved++;
+  if (sscanf(row[5], "%hhu", &sky) != 1)
+    act_log_error(act_log_msg("Failed to parse star/sky parameter for target set queue item %d (%s).", targset_id, row[5]));
+  else
+    num_retrieved++;
+  mysql_free_result(result);
+  if (num_retrieved != 6)
+  {
+    act_log_error(act_log_msg("Failed to retrieve all parameters for next target set schedule item."));
+    return 0;
+  }
+
+  msg->mtype = MT_TARG_SET;
+  struct act_msg_targset *msg_targset = &msg->content.msg_targset;
+
+  msg_targset->status = OBSNSTAT_GOOD;
+  msg_targset->targset_stage = TARGSET_SCHED_PRE;
+  msg_targset->targ_cent = FALSE;
+  msg_targset->focus_pos = 0;
+  msg_targset->autoguide= FALSE;
+
+  msg_targset->mode_auto = mode_auto;
+  msg_targset->targ_id = targ_id;
+  memcpy(msg_targset->targ_name, targ_name, MAX_TARGID_LEN);
+  /// TODO: Change target RA, Dec to account for star/sky
+  struct rastruct tmp_ra;
+  struct decstruct tmp_dec;
+  convert_H_HMSMS_ra(ra_h, &tmp_ra);
+  convert_D_DMS_dec(dec_d, &tmp_dec);
+  precess_coord(&tmp_ra, &tmp_dec, 2000.0, SEC_TO_YEAR(time(NULL)), &msg_targset->targ_ra, &msg_targset->targ_dec);
+  msg_targset->adj_ra_h = 0.0;
+  msg_targset->adj_dec_d = 0.0;
+  
+  return 1;
+}
+
+static char fetch_datapmt(MYSQL *conn, int datapmt_id, struct act_msg *msg)
+{
+  act_log_debug(act_log_msg("Selecting next data pmt."));
+  MYSQL_RES *result;
+  char qrystr[1024];
+  
+  sprintf(qrystr, "SELECT mode_auto, sched_blocks.targ_id, star_names.star_name, star_info.ra_h_fk5, star_info.dec_d_fk5, sky, sample_period_s, prebin, repetitions, pmt_filt_id, filter_types.name, pmt_filters.slot, pmt_aper_id, pmt_apertures.name, pmt_apertures.slot, sched_blocks.user_id FROM sched_datapmt INNER JOIN sched_block_seq ON sched_datapmt.block_seq_id=sched_block_seq.id INNER JOIN sched_blocks ON sched_blocks.id=sched_block_seq.block_id INNER JOIN star_info ON star_info.id=sched_blocks.targ_id INNER JOIN star_names ON star_names.star_id=star_info.id INNER JOIN pmt_filters ON pmt_filters.id=sched_datapmt.pmt_filt_id INNER JOIN filter_types ON filter_types.id=pmt_filters.type INNER JOIN pmt_apertures ON pmt_apertures.id=sched_datapmt.pmt_aper_id WHERE sched_datapmt.id=%d;", datapmt_id);
+  mysql_query(conn,qrystr);
+  result = mysql_store_result(conn);
+  if (result == NULL)
+  {
+    act_log_error(act_log_msg("Could not retrieve next Data PMT observation information - %s.", mysql_error(conn)));
+    return 0;
+  }
+  act_log_debug(act_log_msg("Results retrieved."));
+  
+  int rowcount = mysql_num_rows(result);
+  if (rowcount != 1)
+  {
+    act_log_debug(act_log_msg("Invalid number of rows retrieved (%d)", rowcount));
+    mysql_free_result(result);
+    return 0;
+  }
+  act_log_debug(act_log_msg("1 row returned"));
+  
+  MYSQL_ROW row = mysql_fetch_row(result);
+  unsigned char mode_auto, sky, filt_slot, aper_slot;
+  int targ_id, user_id, prebin_num, repetitions, filt_id, aper_id;
+  char targ_name[MAX_TARGID_LEN], filt_name[IPC_MAX_NUM_FILTAPERS], aper_name[IPC_MAX_NUM_FILTAPERS];
+  double ra_h, dec_d, sample_period_s;
+  int num_retrieved = 0;
+  if (sscanf(row[0], "%hhu", &mode_auto) != 1)
+    act_log_error(act_log_msg("Failed to parse mode auto parameter for Data PMT queue item %d (%s).", datapmt_id, row[0]));
+  else
+    num_retrieved++;
+  if (sscanf(row[1], "%d", &targ_id) != 1)
+    act_log_error(act_log_msg("Failed to parse target identifier parameter for Data PMT queue item %d (%s).", datapmt_id, row[1]));
+  else
+    num_retrieved++;
+  snprintf(targ_name, sizeof(targ_name)-1, "%s", row[2]);
+  num_retrieved++;
+  if (sscanf(row[3], "%lf", &ra_h) != 1)
+    act_log_error(act_log_msg("Failed to parse RA parameter for Data PMT queue item %d (%s).", datapmt_id, row[3]));
+  else
+    num_retrieved++;
+  if (sscanf(row[4], "%lf", &dec_d) != 1)
+    act_log_error(act_log_msg("Failed to parse Dec parameter for Data PMT queue item %d (%s).", datapmt_id, row[4]));
+  else
+    num_retrieved++;
+  if (sscanf(row[5], "%hhu", &sky) != 1)
+    act_log_error(act_log_msg("Failed to parse star/sky parameter for Data PMT queue item %d (%s).", datapmt_id, row[5]));
+  else
+    num_retrieved++;
+  if (sscanf(row[6], "%lf", &sample_period_s) != 1)
+    act_log_error(act_log_msg("Failed to parse sample period parameter for Data PMT queue item %d (%s).", datapmt_id, row[6]));
+  else
+    num_retrieved++;
+  if (sscanf(row[7], "%d", &prebin_num) != 1)
+    act_log_error(act_log_msg("Failed to parse prebin parameter for Data PMT queue item %d (%s).", datapmt_id, row[7]));
+  else
+    num_retrieved++;
+  if (sscanf(row[8], "%d", &repetitions) != 1)
+    act_log_error(act_log_msg("Failed to parse repetitions parameter for Data PMT queue item %d (%s).", datapmt_id, row[8]));
+  else
+    num_retrieved++;
+  if (sscanf(row[9], "%d", &filt_id) != 1)
+    act_log_error(act_log_msg("Failed to parse filter ID parameter for Data PMT queue item %d (%s).", datapmt_id, row[9]));
+  else
+    num_retrieved++;
+  snprintf(filt_name, sizeof(filt_name)-1, "%s", row[10]);
+  num_retrieved++;
+  if (sscanf(row[11], "%hhu", &filt_slot) != 1)
+    act_log_error(act_log_msg("Failed to parse filter slot parameter for Data PMT queue item %d (%s).", datapmt_id, row[11]));
+  else
+    num_retrieved++;
+  if (sscanf(row[12], "%d", &aper_id) != 1)
+    act_log_error(act_log_msg("Failed to parse aperture ID parameter for Data PMT queue item %d (%s).", datapmt_id, row[12]));
+  else
+    num_retrieved++;
+  snprintf(aper_name, sizeof(aper_name)-1, "%s", row[13]);
+  num_retrieved++;
+  if (sscanf(row[14], "%hhu", &aper_slot) != 1)
+    act_log_error(act_log_msg("Failed to parse aperture slot parameter for Data PMT queue item %d (%s).", datapmt_id, row[14]));
+  else
+    num_retrieved++;
+  if (sscanf(row[15], "%d", &user_id) != 1)
+    act_log_error(act_log_msg("Failed to parse user ID parameter for Data PMT queue item %d (%s).", datapmt_id, row[15]));
+  else
+    num_retrieved++;
+  mysql_free_result(result);
+  if (num_retrieved != 16)
+  {
+    act_log_error(act_log_msg("Failed to retrieve all parameters for Data PMT schedule item."));
+    return 0;
+  }
+  act_log_debug(act_log_msg("Parameters extracted"));
+  
+  msg->mtype = MT_DATA_PMT;
+  struct act_msg_datapmt *msg_datapmt = &msg->content.msg_datapmt;
+  
+  msg_datapmt->status = OBSNSTAT_GOOD;
+  msg_datapmt->datapmt_stage = DATAPMT_SCHED_PRE;
+  msg_datapmt->pmt_mode = 0;
+  
+  msg_datapmt->mode_auto = mode_auto;
+  msg_datapmt->targ_id = targ_id;
+  memcpy(msg_datapmt->targ_name, targ_name, MAX_TARGID_LEN);
+  msg_datapmt->sky = sky;
+  msg_datapmt->user_id = user_id;
+  msg_datapmt->sample_period_s = sample_period_s;
+  msg_datapmt->prebin_num = prebin_num;
+  msg_datapmt->repetitions = repetitions;
+  msg_datapmt->filter.db_id = filt_id;
+  memcpy(msg_datapmt->filter.name, filt_name, IPC_MAX_FILTAPER_NAME_LEN);
+  msg_datapmt->filter.slot = filt_slot;
+  msg_datapmt->aperture.db_id = aper_id;
+  memcpy(msg_datapmt->aperture.name, aper_name, IPC_MAX_FILTAPER_NAME_LEN);
+  msg_datapmt->aperture.slot = aper_slot;
+  
+  return 1;
+}
+
+static char fetch_dataccd(MYSQL *conn, int dataccd_id, struct act_msg *msg)
+{
+  act_log_debug(act_log_msg("Selecting next data CCD."));
+  MYSQL_RES *result;
+  char qrystr[1024];
+  
+  sprintf(qrystr, "SELECT mode_auto, sched_blocks.targ_id, star_names.star_name, star_info.ra_h_fk5, star_info.dec_d_fk5, exp_t_s, repetitions, frame_transfer, prebin_x, prebin_y, ccd_filt_id, filter_types.name, ccd_filters.slot, sched_blocks.user_id FROM sched_dataccd INNER JOIN sched_block_seq ON sched_block_seq.id=sched_dataccd.block_seq_id INNER JOIN sched_blocks ON sched_blocks.id=sched_block_seq.block_id INNER JOIN star_info ON sched_blocks.targ_id=star_info.id INNER JOIN star_names ON star_names.star_id=sched_blocks.targ_id INNER JOIN ccd_filters ON ccd_filters.id=sched_dataccd.ccd_filt_id INNER JOIN filter_types ON filter_types.id=ccd_filters.type WHERE sched_dataccd.id=%d", dataccd_id);
+  mysql_query(conn,qrystr);
+  result = mysql_store_result(conn);
+  if (result == NULL)
+  {
+    act_log_error(act_log_msg("Could not retrieve next Data CCD observation information - %s.", mysql_error(conn)));
+    return 0;
+  }
+  
+  int rowcount = mysql_num_rows(result);
+  if (rowcount != 1)
+  {
+    act_log_debug(act_log_msg("Invalid number of rows retrieved (%d)", rowcount));
+    mysql_free_result(result);
+    return 0;
+  }
+  
+  MYSQL_ROW row = mysql_fetch_row(result);
+  unsigned char mode_auto, filt_slot;
+  int targ_id, user_id, repetitions, filt_id;
+  char targ_name[MAX_TARGID_LEN], filt_name[IPC_MAX_NUM_FILTAPERS];
+  double ra_h, dec_d, exp_t_s;
+  int num_retrieved = 0;
+  if (sscanf(row[0], "%hhu", &mode_auto) != 1)
+    act_log_error(act_log_msg("Failed to parse mode auto parameter for Data CCD queue item %d (%s).", dataccd_id, row[0]));
+  else
+    num_retrieved++;
+  if (sscanf(row[1], "%d", &targ_id) != 1)
+    act_log_error(act_log_msg("Failed to parse target identifier parameter for Data CCD queue item %d (%s).", dataccd_id, row[1]));
+  else
+    num_retrieved++;
+  snprintf(targ_name, sizeof(targ_name)-1, "%s", row[2]);
+  num_retrieved++;
+  if (sscanf(row[3], "%lf", &ra_h) != 1)
+    act_log_error(act_log_msg("Failed to parse RA parameter for Data CCD queue item %d (%s).", dataccd_id, row[3]));
+  else
+    num_retrieved++;
+  if (sscanf(row[4], "%lf", &dec_d) != 1)
+    act_log_error(act_log_msg("Failed to parse Dec parameter for Data CCD queue item %d (%s).", dataccd_id, row[4]));
+  else
+    num_retrieved++;
+  if (sscanf(row[5], "%lf", &exp_t_s) != 1)
+    act_log_error(act_log_msg("Failed to parse exposure time parameter for Data CCD queue item %d (%s).", dataccd_id, row[5]));
+  else
+    num_retrieved++;
+  if (sscanf(row[6], "%d", &repetitions) != 1)
+    act_log_error(act_log_msg("Failed to parse repetitions parameter for Data CCD queue item %d (%s).", dataccd_id, row[6]));
+  else
+    num_retrieved++;
+  if (sscanf(row[10], "%d", &filt_id) != 1)
+    act_log_error(act_log_msg("Failed to parse filter ID parameter for Data CCD queue item %d (%s).", dataccd_id, row[10]));
+  else
+    num_retrieved++;
+  snprintf(filt_name, sizeof(filt_name)-1, "%s", row[11]);
+  num_retrieved++;
+  if (sscanf(row[12], "%hhu", &filt_slot) != 1)
+    act_log_error(act_log_msg("Failed to parse filter slot parameter for Data CCD queue item %d (%s).", dataccd_id, row[12]));
+  else
+    num_retrieved++;
+  if (sscanf(row[13], "%d", &user_id) != 1)
+    act_log_error(act_log_msg("Failed to parse user ID parameter for Data CCD queue item %d (%s).", dataccd_id, row[13]));
+  else
+    num_retrieved++;
+  mysql_free_result(result);
+  if (num_retrieved != 14)
+  {
+    act_log_error(act_log_msg("Failed to retrieve all parameters for Data CCD schedule item."));
+    return 0;
+  }
+  
+  msg->mtype = MT_DATA_CCD;
+  struct act_msg_dataccd *msg_dataccd = &msg->content.msg_dataccd;
+  
+  msg_dataccd->status = OBSNSTAT_GOOD;
+  msg_dataccd->dataccd_stage = DATACCD_SCHED_PRE;
+  msg_dataccd->frame_transfer = TRUE;
+  msg_dataccd->win_start_x = msg_dataccd->win_start_y = 0;
+  msg_dataccd->win_height = msg_dataccd->win_width = 0;
+  msg_dataccd->prebin_x = msg_dataccd->prebin_y = 0;
+  
+  msg_dataccd->mode_auto = mode_auto;
+  msg_dataccd->targ_id = targ_id;
+  memcpy(msg_dataccd->targ_name, targ_name, MAX_TARGID_LEN);
+  msg_dataccd->user_id = user_id;
+  msg_dataccd->exp_t_s = exp_t_s;
+  msg_dataccd->repetitions = repetitions;
+  msg_dataccd->filter.db_id = filt_id;
+  memcpy(msg_dataccd->filter.name, filt_name, IPC_MAX_FILTAPER_NAME_LEN);
+  msg_dataccd->filter.slot = filt_slot;
+  
+  return 1;
+}
+
@@ -0,0 +1,57 @@
+#ifndef SCHED_PREFETCH_H
+#define SCHED_PREFETCH_H
+
+#include <pthread.h>
+#include <act_ipc.h>
+
+/// Converts time in seconds since the UNIX epoch to fractional number of years (for coordinates epoch)
+#define SEC_TO_YEAR(sec)   (1970 + sec/(float)31556926)
+
+//! A database status update waiting to be written by the prefetch thread
+struct sched_update
+{
+  char qrystr[256];
+  struct sched_update *next;
+};
+
+/** \brief Thread that looks up and builds observation messages and writes status updates, on its own MySQL connection.
+ *
+ * While an observation is executing, the main loop asks for the observation that follows it (sched_prefetch_request).
+ * The thread runs the queries and builds the message, so that when the observation completes the next message can be
+ * sent immediately (sched_prefetch_get). Status updates (sched_prefetch_update) are written in the order they were
+ * queued, before the next look-up. The main loop waits for them (sched_prefetch_flush) only where it must know that
+ * they have been written, i.e. before it reads the observation queue on its own connection or relies on an update
+ * having succeeded.
+ */
+struct sched_prefetch
+{
+  char *sqlhost;
+  pthread_t thr;
+  //! Protects everything below
+  pthread_mutex_t mutex;
+  //! Signalled when work is queued and when a look-up is complete
+  pthread_cond_t cond;
+  char exiting;
+  struct sched_update *updates_head, *updates_tail;
+  //! Set while an update taken off the queue is being written, and once an update has failed (until the next flush)
+  char updating, update_failed;
+  //! Current look-up: next observation in block req_block_id, skipping observation req_skip_id of type req_skip_mtype
+  char req_valid, req_pending;
+  unsigned long req_block_id, req_skip_id;
+  int req_skip_mtype;
+  //! Result of the current look-up, valid once res_ready is set
+  char res_ready, res_ret;
+  unsigned long res_obsn_id;
+  struct act_msg res_msg;
+  //! Number of look-ups that were complete when they were needed, and that had to be waited for
+  unsigned long num_hits, num_misses;
+};
+
+struct sched_prefetch *sched_prefetch_new(const char *sqlhost);
+void sched_prefetch_free(struct sched_prefetch *prefetch);
+void sched_prefetch_update(struct sched_prefetch *prefetch, const char *qrystr);
+char sched_prefetch_flush(struct sched_prefetch *prefetch);
+void sched_prefetch_request(struct sched_prefetch *prefetch, unsigned long block_id, int skip_mtype, unsigned long skip_id);
+char sched_prefetch_get(struct sched_prefetch *prefetch, unsigned long block_id, int skip_mtype, unsigned long skip_id, struct act_msg *msg, unsigned long *obsn_id, char *prefetched);
+
+#endif
@@ -0,0 +1,119 @@
+/* Compile from local directory with:
+ * gcc -Wall -Wextra -O2 -I../ -I../../../libs/ ./sched_sim_test.c ../sched_plan.c ../../../libs/act_positastro.c
+ * ../../../libs/act_ephem.c ../../../libs/act_timecoord.c ../../../libs/act_log.c -lpthread -lm -o ./sched_sim_test
+ *
+ * Offline test of the act_sched scheduling engine. Generates a random queue of observing blocks (targets spread over
+ * the sky visible from the site, random priorities and durations) and replays a night with it twice:
+ *  - with the old strategy - always the lowest priority value first, regardless of whether the target is observable
+ *    (an unobservable target costs a slew and target set before being rejected);
+ *  - with sched_plan_simulate.
+ * Reports the night, observing, slew and idle time of each:
+ *   ./sched_sim_test [number of blocks] [julian date of the start of the night] [random seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <act_site.h>
+#include <act_positastro.h>
+#include "sched_plan.h"
+
+static struct sched_plan *make_plan(double start_jd, int num_blocks, unsigned int seed)
+{
+  struct sched_plan *plan = sched_plan_new(start_jd, SCHED_PLAN_HOURS*3600/SCHED_SLOT_S);
+  if (plan == NULL)
+    return NULL;
+  srand(seed);
+  int i;
+  for (i=0; i<num_blocks; i++)
+  {
+    double ra_h = 24.0 * rand() / (RAND_MAX + 1.0);
+    double dec_d = -90.0 + 120.0 * rand() / (RAND_MAX + 1.0);
+    int priority = rand() % 10;
+    double dur_s = 600.0 + 3000.0 * rand() / (RAND_MAX + 1.0);
+    sched_plan_add_block(plan, i+1, priority, ra_h, dec_d, dur_s);
+  }
+  return plan;
+}
+
+static void simulate_priority_only(struct sched_plan *plan, struct sched_sim_stats *stats)
+{
+  int slot, i;
+  for (slot=0; slot<plan->num_slots; slot++)
+  {
+    if (plan->slot_dark[slot])
+      stats->night_s += SCHED_SLOT_S;
+  }
+  double tel_ha_h = 0.0, tel_dec_d = LATITUDE, jd = plan->start_jd;
+  while ((slot = sched_plan_slot(plan, jd)) >= 0)
+  {
+    struct sched_block *block = NULL;
+    for (i=0; (plan->slot_dark[slot]) && (i<plan->num_blocks); i++)
+    {
+      if ((!plan->blocks[i].done) && ((block == NULL) || (plan->blocks[i].priority < block->priority)))
+        block = &plan->blocks[i];
+    }
+    if (block == NULL)
+    {
+      double next_jd = plan->start_jd + (slot + 1) * SCHED_SLOT_S / 86400.0;
+      if (plan->slot_dark[slot])
+        stats->idle_s += (next_jd - jd) * 86400.0;
+      jd = next_jd;
+      continue;
+    }
+    double ha_h = fmod(calc_SidT(jd) - block->ra_h + 36.0, 24.0) - 12.0;
+    double slew_deg = fabs(ha_h - tel_ha_h) * 15.0;
+    if (fabs(block->dec_d - tel_dec_d) > slew_deg)
+      slew_deg = fabs(block->dec_d - tel_dec_d);
+    double slew_s = slew_deg / SCHED_SLEW_RATE_DEG_S + SCHED_SLEW_SETTLE_S + SCHED_TARGSET_S;
+    block->done = 1;
+    stats->slew_s += slew_s;
+    jd += slew_s / 86400.0;
+    tel_ha_h = ha_h;
+    tel_dec_d = block->dec_d;
+    if (!block->vis[slot])
+    {
+      stats->num_unscheduled++;
+      continue;
+    }
+    stats->obsn_s += block->dur_s;
+    stats->num_scheduled++;
+    jd += block->dur_s / 86400.0;
+  }
+  for (i=0; i<plan->num_blocks; i++)
+  {
+    if (!plan->blocks[i].done)
+      stats->num_unscheduled++;
+  }
+}
+
+static void print_stats(const char *desc, struct sched_sim_stats *stats)
+{
+  printf("%-16s night %5.2f h  observing %5.2f h  slew/set %5.2f h  idle %5.2f h  (%4.1f%% of night observing)  %3d blocks done, %3d not\n", desc, stats->night_s/3600.0, stats->obsn_s/3600.0, stats->slew_s/3600.0, stats->idle_s/3600.0, 100.0*stats->obsn_s/stats->night_s, stats->num_scheduled, stats->num_unscheduled);
+}
+
+int main(int argc, char **argv)
+{
+  int num_blocks = argc > 1 ? atoi(argv[1]) : 200;
+  // 2015-06-15 12:00 local time (SAST) by default
+  double start_jd = argc > 2 ? atof(argv[2]) : 2457188.9167;
+  unsigned int seed = argc > 3 ? atoi(argv[3]) : 1;
+
+  struct sched_sim_stats old_stats = { 0 }, new_stats;
+  struct sched_plan *plan = make_plan(start_jd, num_blocks, seed);
+  if (plan == NULL)
+    return 1;
+  simulate_priority_only(plan, &old_stats);
+  sched_plan_free(plan);
+
+  plan = make_plan(start_jd, num_blocks, seed);
+  if (plan == NULL)
+    return 1;
+  sched_plan_simulate(plan, NULL, &new_stats);
+  sched_plan_free(plan);
+
+  printf("%d blocks, night starting JD %.4f\n", num_blocks, start_jd);
+  print_stats("priority only:", &old_stats);
+  print_stats("lookahead:", &new_stats);
+  return new_stats.obsn_s < old_stats.obsn_s;
+}
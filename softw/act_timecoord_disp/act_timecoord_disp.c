@@ -29,6 +29,7 @@
 #include <gtk/gtk.h>
 #include <act_ipc.h>
 #include <act_positastro.h>
+#include <act_ephem.h>
 #include <act_timecoord.h>
 #include <act_site.h>
 #include <act_log.h>
@@ -79,8 +80,12 @@ void disp_coords();
  */
 struct act_msg_time G_msg_time;
 struct act_msg_coord *G_msg_coord = NULL;
+/// Ephemeris tables for the current night, used for the sidereal time and HJD
+struct act_ephem *G_ephem = NULL;
 
 int G_netsock_fd;
+unsigned int G_net_tx_seq = 0;
+struct act_msg_rx G_net_rx;
 int G_signal_pipe[2];
 struct formobjects G_form_objs;
 /** \} */
@@ -249,7 +254,7 @@ void calc_sidtime(double jd, struct timestruct *sidt)
     act_log_error(act_log_msg("Invalid input parameters"));
     return;
   }
-  double sidt_h = calc_SidT (jd);
+  double sidt_h = act_ephem_covers(G_ephem, jd) ? act_ephem_sidt(G_ephem, jd) : calc_SidT (jd);
   while (sidt_h < 0.0)
     sidt_h += 24.0;
   while (sidt_h > 24.0)
@@ -280,7 +285,7 @@ void send_times()
   struct act_msg msg;
   msg.mtype = MT_TIME;
   memcpy(&msg.content.msg_time, &G_msg_time, sizeof(struct act_msg_time));
-  if (send(G_netsock_fd, &msg, sizeof(struct act_msg), MSG_DONTWAIT) == -1)
+  if (act_msg_send(G_netsock_fd, &msg, &G_net_tx_seq) == -1)
     act_log_error(act_log_msg("Failed to send telescope coordinates - %s", strerror(errno)));
 /*  else
   {
@@ -298,7 +303,7 @@ int request_guisock()
   struct act_msg guimsg;
   guimsg.mtype = MT_GUISOCK;
   memset(&guimsg.content.msg_guisock, 0, sizeof(struct act_msg_guisock));
-  if (send(G_netsock_fd, &guimsg, sizeof(struct act_msg), 0) == -1)
+  if (act_msg_send(G_netsock_fd, &guimsg, &G_net_tx_seq) == -1)
   {
     act_log_error(act_log_msg("Failed to send GUI socket request - %s.", strerror(errno)));
     return -1;
@@ -323,14 +328,18 @@ int check_net_messages()
 {
   int ret = 0;
   struct act_msg msgbuf;
-  memset(&msgbuf, 0, sizeof(struct act_msg));
-  int numbytes = recv(G_netsock_fd, &msgbuf, sizeof(struct act_msg), MSG_DONTWAIT);
-  if ((numbytes == -1) && (errno == EAGAIN))
-    return 0;
-  if (numbytes == -1)
+  if (!act_msg_rx_next(&G_net_rx, &msgbuf))
   {
-    act_log_error(act_log_msg("Failed to receive message - %s.", strerror(errno)));
-    return -1;
+    int numbytes = act_msg_rx_fill(&G_net_rx, G_netsock_fd);
+    if ((numbytes == -1) && (errno == EAGAIN))
+      return 0;
+    if (numbytes == -1)
+    {
+      act_log_error(act_log_msg("Failed to receive message - %s.", strerror(errno)));
+      return -1;
+    }
+    if (!act_msg_rx_next(&G_net_rx, &msgbuf))
+      return 0;
   }
   switch (msgbuf.mtype)
   {
@@ -349,7 +358,7 @@ int check_net_messages()
       cap_msg->datapmt_prov = 0;
       cap_msg->dataccd_prov = 0;
       snprintf(cap_msg->version_str, MAX_VERSION_LEN, "%d.%d", MAJOR_VER, MINOR_VER);
-      if (send(G_netsock_fd, &msgbuf, sizeof(struct act_msg), 0) == -1)
+      if (act_msg_send(G_netsock_fd, &msgbuf, &G_net_tx_seq) == -1)
       {
         act_log_error(act_log_msg("Failed to send capabilities message - %s.", strerror(errno)));
         ret = -1;
@@ -361,7 +370,7 @@ int check_net_messages()
     case MT_STAT:
     {
       msgbuf.content.msg_stat.status = PROGSTAT_RUNNING;
-      if (send(G_netsock_fd, &msgbuf, sizeof(struct act_msg), 0) == -1)
+      if (act_msg_send(G_netsock_fd, &msgbuf, &G_net_tx_seq) == -1)
       {
         act_log_error(act_log_msg("Failed to send status message - %s.", strerror(errno)));
         ret = -1;
@@ -543,7 +552,8 @@ gboolean process_signal(GIOChannel *source, GIOCondition cond, gpointer user_dat
     if (error != NULL)
       break;
     int ret;
-    ret = check_net_messages();
+    // one read may return several messages
+    while ((ret = check_net_messages()) > 0);
     if (ret < 0)
       act_log_error(act_log_msg("Error reading messages."));
   }
@@ -610,7 +620,16 @@ gboolean disptimes_timeout()
   if (!get_meantime(&G_msg_time.loct, &G_msg_time.locd, &G_msg_time.unit, &G_msg_time.unid))
     act_log_error(act_log_msg("Error reading mean date/time."));
   G_msg_time.gjd = calc_GJD (&G_msg_time.unid, &G_msg_time.unit);
-  if (G_msg_coord != NULL)
+  if (!act_ephem_covers(G_ephem, G_msg_time.gjd))
+  {
+    act_ephem_free(G_ephem);
+    G_ephem = act_ephem_new_night(G_msg_time.gjd);
+    if (G_ephem == NULL)
+      act_log_error(act_log_msg("Failed to calculate ephemeris tables for the night."));
+  }
+  if ((G_msg_coord != NULL) && (G_ephem != NULL))
+    G_msg_time.hjd = act_ephem_hjd(G_ephem, G_msg_time.gjd, convert_H_RAD(convert_HMSMS_H_ra(&G_msg_coord->ra)), convert_DEG_RAD(convert_DMS_D_dec(&G_msg_coord->dec)));
+  else if (G_msg_coord != NULL)
     calc_sun (G_msg_time.gjd, &G_msg_coord->ra, &G_msg_coord->dec, NULL, NULL, &G_msg_time.hjd);
   calc_sidtime(G_msg_time.gjd, &G_msg_time.sidt);
   disp_times();
@@ -777,6 +796,7 @@ int main(int argc, char** argv)
   g_source_remove(guicheck_to_id);
   g_source_remove(iowatch_id);
   close(G_netsock_fd);
+  act_ephem_free(G_ephem);
   act_log_normal(act_log_msg("Exiting"));
   return 0;
 }
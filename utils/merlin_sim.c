@@ -464,20 +464,31 @@ void send_image(gpointer user_data)
   int shift_x = shift_ra_m / ccd_res_ra_m;
   int shift_y = shift_dec_am / ccd_res_dec_am;
   
-  unsigned char shifted_image[CCD_WIDTH_PX * CCD_HEIGHT_PX];
-  memset(shifted_image, 0, sizeof(shifted_image));
+  // The driver copies a whole struct merlin_img into the next free slot of its image ring
+  struct merlin_img *sim_img = calloc(1, sizeof(struct merlin_img));
+  if (sim_img == NULL)
+  {
+    fprintf(stderr, "[%s] Error allocating simulated image.\n", G_progname);
+    return;
+  }
+  sim_img->img_params.img_len = CCD_WIDTH_PX * CCD_HEIGHT_PX;
+  sim_img->img_params.prebin_x = sim_img->img_params.prebin_y = 1;
+  sim_img->img_params.win_width = CCD_WIDTH_PX;
+  sim_img->img_params.win_height = CCD_HEIGHT_PX;
+  sim_img->img_params.start_sec = time(NULL);
   int row, col;
   for (row=0; row<CCD_HEIGHT_PX; row++)
   {
     for (col=0; col<CCD_WIDTH_PX; col++)
     {
       if ((row+shift_y<CCD_HEIGHT_PX) && (row+shift_y>0) && (col+shift_x<CCD_WIDTH_PX) && (col+shift_x>0))
-        shifted_image[(row+shift_y)*CCD_WIDTH_PX+(col+shift_x)] = G_image[row*CCD_WIDTH_PX+col];
+        sim_img->img_data[(row+shift_y)*CCD_WIDTH_PX+(col+shift_x)] = G_image[row*CCD_WIDTH_PX+col];
     }
   }
   
-  if (ioctl(objs->fd_ccddev, IOCTL_SET_IMAGE, (unsigned long)shifted_image) <= 0)
+  if (ioctl(objs->fd_ccddev, IOCTL_SET_IMAGE, (unsigned long)sim_img) < 0)
     fprintf(stderr, "[%s] Error sending simulated image to CCD driver.\n", G_progname);
+  free(sim_img);
 }
 
 void send_obsn(gpointer user_data)